@@ -69,38 +69,47 @@ int main(void)
 // USB CDC
 //--------------------------------------------------------------------+
 #if CFG_TUH_CDC
-CFG_TUSB_MEM_SECTION static char serial_in_buffer[64] = { 0 };
 
-void tuh_mount_cb(uint8_t dev_addr)
+void tuh_cdc_mount_cb(uint8_t idx)
 {
-  // application set-up
-  printf("A device with address %d is mounted\r\n", dev_addr);
+  cdc_line_coding_t line_coding = { 0 };
+  tuh_cdc_get_line_coding(idx, &line_coding);
 
-  tuh_cdc_receive(dev_addr, serial_in_buffer, sizeof(serial_in_buffer), true); // schedule first transfer
+  printf("CDC Interface is mounted: address = %u, index = %u, baudrate = %lu\r\n",
+         tuh_cdc_get_dev_addr(idx), idx, (unsigned long) line_coding.bit_rate);
 }
 
-void tuh_umount_cb(uint8_t dev_addr)
+void tuh_cdc_umount_cb(uint8_t idx)
 {
-  // application tear-down
-  printf("A device with address %d is unmounted \r\n", dev_addr);
-}
-
-// invoked ISR context
-void tuh_cdc_xfer_isr(uint8_t dev_addr, xfer_result_t event, cdc_pipeid_t pipe_id, uint32_t xferred_bytes)
-{
-  (void) event;
-  (void) pipe_id;
-  (void) xferred_bytes;
-
-  printf(serial_in_buffer);
-  tu_memclr(serial_in_buffer, sizeof(serial_in_buffer));
-
-  tuh_cdc_receive(dev_addr, serial_in_buffer, sizeof(serial_in_buffer), true); // waiting for next data
+  printf("CDC Interface is unmounted: index = %u\r\n", idx);
 }
 
+// forward data between serial device and console
 void cdc_task(void)
 {
+  uint8_t buf[64+1]; // +1 for extra null character
 
+  for(uint8_t idx=0; idx<CFG_TUH_CDC; idx++)
+  {
+    if ( !tuh_cdc_mounted(idx) ) continue;
+
+    // device -> console
+    uint32_t const count = tuh_cdc_read(idx, buf, sizeof(buf)-1);
+    if ( count )
+    {
+      buf[count] = 0;
+      printf("%s", (char*) buf);
+    }
+
+    // console -> device
+    int ch = board_uart_getchar();
+    if ( ch > 0 )
+    {
+      uint8_t const c = (uint8_t) ch;
+      tuh_cdc_write(idx, &c, 1);
+      tuh_cdc_write_flush(idx);
+    }
+  }
 }
 
 #endif
@@ -109,6 +118,18 @@ void cdc_task(void)
 // TinyUSB Callbacks
 //--------------------------------------------------------------------+
 
+void tuh_mount_cb(uint8_t dev_addr)
+{
+  // application set-up
+  printf("A device with address %d is mounted\r\n", dev_addr);
+}
+
+void tuh_umount_cb(uint8_t dev_addr)
+{
+  // application tear-down
+  printf("A device with address %d is unmounted \r\n", dev_addr);
+}
+
 //--------------------------------------------------------------------+
 // Blinking Task
 //--------------------------------------------------------------------+
@@ -27,11 +27,17 @@
 
 #if CFG_TUH_MSC
 
+#include "ff.h"
+#include "diskio.h"
+
 //--------------------------------------------------------------------+
 // MACRO TYPEDEF CONSTANT ENUM DECLARATION
 //--------------------------------------------------------------------+
 static scsi_inquiry_resp_t inquiry_resp;
 
+// FatFs volume, physical drive number is dev_addr-1
+static FATFS fatfs[CFG_TUH_DEVICE_MAX];
+
 bool inquiry_complete_cb(uint8_t dev_addr, msc_cbw_t const* cbw, msc_csw_t const* csw)
 {
   if (csw->status != 0)
@@ -60,47 +66,25 @@ void tuh_msc_mount_cb(uint8_t dev_addr)
 
   uint8_t const lun = 0;
   tuh_msc_inquiry(dev_addr, lun, &inquiry_resp, inquiry_complete_cb);
-//
-//  //------------- file system (only 1 LUN support) -------------//
-//  uint8_t phy_disk = dev_addr-1;
-//  disk_initialize(phy_disk);
-//
-//  if ( disk_is_ready(phy_disk) )
-//  {
-//    if ( f_mount(phy_disk, &fatfs[phy_disk]) != FR_OK )
-//    {
-//      puts("mount failed");
-//      return;
-//    }
-//
-//    f_chdrive(phy_disk); // change to newly mounted drive
-//    f_chdir("/"); // root as current dir
-//
-//    cli_init();
-//  }
+
+  //------------- file system (only 1 LUN support) -------------//
+  // f_mount() only registers the volume, disk is accessed on the first file operation.
+  // Note: file operations must not be called within host stack callbacks, since
+  // diskio runs tuh_task() while waiting for transfer completion.
+  uint8_t const drive_num = dev_addr-1;
+  if ( f_mount(drive_num, &fatfs[drive_num]) != FR_OK )
+  {
+    printf("mount failed\r\n");
+  }
 }
 
 void tuh_msc_umount_cb(uint8_t dev_addr)
 {
-  (void) dev_addr;
   printf("A MassStorage device is unmounted\r\n");
 
-//  uint8_t phy_disk = dev_addr-1;
-//
-//  f_mount(phy_disk, NULL); // unmount disk
-//  disk_deinitialize(phy_disk);
-//
-//  if ( phy_disk == f_get_current_drive() )
-//  { // active drive is unplugged --> change to other drive
-//    for(uint8_t i=0; i<CFG_TUH_DEVICE_MAX; i++)
-//    {
-//      if ( disk_is_ready(i) )
-//      {
-//        f_chdrive(i);
-//        cli_init(); // refractor, rename
-//      }
-//    }
-//  }
+  uint8_t const drive_num = dev_addr-1;
+  f_mount(drive_num, NULL); // unmount disk
+  disk_deinitialize(drive_num);
 }
 
 #endif
@@ -27,58 +27,204 @@
 #include "tusb.h"
 
 #if CFG_TUH_MSC
+
 //--------------------------------------------------------------------+
 // INCLUDE
 //--------------------------------------------------------------------+
 #include "ffconf.h"
 #include "diskio.h"
+
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF
 //--------------------------------------------------------------------+
-// TODO change it to portable init
-static DSTATUS disk_state[CFG_TUH_DEVICE_MAX];
+
+// Physical drive number is MassStorage device address - 1, only LUN 0 is used.
+// Requests are executed with block cache when CFG_TUH_MSC_CACHE_LINES is enabled.
+
+// Sectors of bounce buffer, used when FatFs buffer is not word-aligned for DMA
+#ifndef CFG_TUH_MSC_DISKIO_BOUNCE_SECTORS
+#define CFG_TUH_MSC_DISKIO_BOUNCE_SECTORS   4
+#endif
+
+typedef struct
+{
+  bool initialized;
+  volatile bool busy;
+  volatile bool failed;
+
+#if CFG_TUSB_OS != OPT_OS_NONE
+  osal_semaphore_def_t sem_def;
+  osal_semaphore_t sem;
+#endif
+}diskio_drive_t;
+
+static diskio_drive_t _drive[CFG_TUH_DEVICE_MAX];
+
+// shared by all drives: FatFs is not re-entrant (_FS_REENTRANT = 0)
+CFG_TUSB_MEM_SECTION TU_ATTR_ALIGNED(4)
+static uint8_t _bounce_buf[CFG_TUH_MSC_DISKIO_BOUNCE_SECTORS*_MAX_SS];
 
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
 
-//--------------------------------------------------------------------+
-// IMPLEMENTATION
-//--------------------------------------------------------------------+
-static DRESULT wait_for_io_complete(uint8_t usb_addr)
+// Invoked by host stack task when command is complete
+static void io_complete(uint8_t dev_addr, bool success)
+{
+  diskio_drive_t* drv = &_drive[dev_addr-1];
+
+  drv->failed = !success;
+  drv->busy   = false;
+
+#if CFG_TUSB_OS != OPT_OS_NONE
+  osal_semaphore_post(drv->sem, false);
+#endif
+}
+
+#if CFG_TUH_MSC_CACHE_LINES
+static bool io_cache_complete(uint8_t dev_addr, uint8_t lun, bool success)
+{
+  (void) lun;
+  io_complete(dev_addr, success);
+  return true;
+}
+#else
+static bool io_scsi_complete(uint8_t dev_addr, msc_cbw_t const* cbw, msc_csw_t const* csw)
 {
-  // TODO with RTOS, this should use semaphore instead of blocking
-  while ( !tuh_msc_ready(usb_addr) )
+  (void) cbw;
+  io_complete(dev_addr, csw->status == MSC_CSW_STATUS_PASSED);
+  return true;
+}
+#endif
+
+// Let host stack run while waiting: invoke tuh_task() without RTOS, otherwise yield to usbh task.
+// Return false if device is unplugged
+static bool wait_for_host(uint8_t dev_addr)
+{
+#if CFG_TUSB_OS == OPT_OS_NONE
+  tuh_task();
+  if (diskio_wait_cb) diskio_wait_cb(dev_addr-1);
+#else
+  osal_task_delay(1);
+#endif
+
+  return tuh_msc_mounted(dev_addr);
+}
+
+// Submit request (retry while MSC queue is full) and wait for its completion.
+static DRESULT disk_xfer(BYTE pdrv, bool is_write, BYTE* buff, DWORD sector, uint16_t count)
+{
+  uint8_t const dev_addr = pdrv + 1;
+  diskio_drive_t* drv = &_drive[pdrv];
+
+  drv->busy   = true;
+  drv->failed = false;
+
+#if CFG_TUSB_OS != OPT_OS_NONE
+  osal_semaphore_reset(drv->sem);
+#endif
+
+  while (1)
+  {
+#if CFG_TUH_MSC_CACHE_LINES
+    bool const queued = is_write ? tuh_msc_cache_write(dev_addr, 0, buff, sector, count, io_cache_complete) :
+                                   tuh_msc_cache_read (dev_addr, 0, buff, sector, count, io_cache_complete);
+#else
+    bool const queued = is_write ? tuh_msc_write10(dev_addr, 0, buff, sector, count, io_scsi_complete) :
+                                   tuh_msc_read10 (dev_addr, 0, buff, sector, count, io_scsi_complete);
+#endif
+
+    if ( queued ) break;
+    if ( !wait_for_host(dev_addr) ) return RES_NOTRDY;
+  }
+
+#if CFG_TUSB_OS == OPT_OS_NONE
+  while ( drv->busy )
+  {
+    if ( !wait_for_host(dev_addr) ) return RES_NOTRDY;
+  }
+#else
+  // wake up periodically to check if device is unplugged
+  while ( !osal_semaphore_wait(drv->sem, 100) )
+  {
+    if ( !tuh_msc_mounted(dev_addr) ) return RES_NOTRDY;
+  }
+#endif
+
+  return drv->failed ? RES_ERROR : RES_OK;
+}
+
+static DRESULT disk_rw(BYTE pdrv, bool is_write, BYTE* buff, DWORD sector, BYTE count)
+{
+  TU_VERIFY(pdrv < CFG_TUH_DEVICE_MAX && count, RES_PARERR);
+  if ( disk_status(pdrv) & STA_NOINIT ) return RES_NOTRDY;
+
+  // Zero-copy: multiple sectors are transferred with FatFs buffer in a single command
+  if ( 0 == (((uintptr_t) buff) & 3) ) return disk_xfer(pdrv, is_write, buff, sector, count);
+
+  uint32_t const block_size = tuh_msc_get_block_size(pdrv + 1, 0);
+  uint32_t const max_count  = sizeof(_bounce_buf) / block_size;
+
+  TU_VERIFY(max_count, RES_PARERR);
+
+  while ( count )
   {
-    // TODO should have timeout here
-    #if CFG_TUSB_OS != OPT_OS_NONE
-    osal_task_delay(10);
-    #endif
+    uint8_t const n = (uint8_t) tu_min32(count, max_count);
+
+    if ( is_write ) memcpy(_bounce_buf, buff, n*block_size);
+
+    DRESULT const res = disk_xfer(pdrv, is_write, _bounce_buf, sector, n);
+    if ( res != RES_OK ) return res;
+
+    if ( !is_write ) memcpy(buff, _bounce_buf, n*block_size);
+
+    buff   += n*block_size;
+    sector += n;
+    count  -= n;
   }
 
   return RES_OK;
 }
 
+//--------------------------------------------------------------------+
+// IMPLEMENTATION
+//--------------------------------------------------------------------+
 void diskio_init(void)
 {
-  memset(disk_state, STA_NOINIT, CFG_TUH_DEVICE_MAX);
+  for(uint8_t i=0; i<CFG_TUH_DEVICE_MAX; i++) _drive[i].initialized = false;
 }
 
 //pdrv Specifies the physical drive number.
 DSTATUS disk_initialize ( BYTE pdrv )
 {
-  disk_state[pdrv] &= (~STA_NOINIT); // clear NOINIT bit
-  return disk_state[pdrv];
+  TU_VERIFY(pdrv < CFG_TUH_DEVICE_MAX, STA_NOINIT);
+
+  // sector must fit FatFs window
+  if ( tuh_msc_mounted(pdrv+1) && tuh_msc_get_block_size(pdrv+1, 0) <= _MAX_SS )
+  {
+#if CFG_TUSB_OS != OPT_OS_NONE
+    if ( _drive[pdrv].sem == NULL ) _drive[pdrv].sem = osal_semaphore_create(&_drive[pdrv].sem_def);
+#endif
+
+    _drive[pdrv].initialized = true;
+  }
+
+  return disk_status(pdrv);
 }
 
 void disk_deinitialize ( BYTE pdrv )
 {
-  disk_state[pdrv] |= STA_NOINIT; // set NOINIT bit
+  _drive[pdrv].initialized = false;
 }
 
 DSTATUS disk_status (BYTE pdrv)
 {
-  return disk_state[pdrv];
+  TU_VERIFY(pdrv < CFG_TUH_DEVICE_MAX, STA_NOINIT);
+
+  // device is unplugged: FatFs will re-initialize drive when it is accessed again
+  if ( !tuh_msc_mounted(pdrv+1) ) _drive[pdrv].initialized = false;
+
+  return _drive[pdrv].initialized ? 0 : STA_NOINIT;
 }
 
 //pdrv
@@ -92,21 +238,12 @@ DSTATUS disk_status (BYTE pdrv)
 //    must not be split into single sector transactions to the device, or you may not get good read performance.
 DRESULT disk_read (BYTE pdrv, BYTE*buff, DWORD sector, BYTE count)
 {
-  uint8_t usb_addr = pdrv+1;
-
-	if ( TUSB_ERROR_NONE != tuh_msc_read10(usb_addr, 0, buff, sector, count) )		return RES_ERROR;
-
-	return wait_for_io_complete(usb_addr);
+  return disk_rw(pdrv, false, buff, sector, count);
 }
 
-
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, BYTE count)
 {
-  uint8_t usb_addr = pdrv+1;
-
-	if ( TUSB_ERROR_NONE != tuh_msc_write10(usb_addr, 0, buff, sector, count) )		return RES_ERROR;
-
-	return wait_for_io_complete(usb_addr);
+  return disk_rw(pdrv, true, (BYTE*)(uintptr_t) buff, sector, count);
 }
 
 /* [IN] Drive number */
@@ -114,10 +251,62 @@ DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, BYTE count)
 /* [I/O] Parameter and data buffer */
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff)
 {
-  (void) buff; (void) pdrv; // compiler warnings
+  TU_VERIFY(pdrv < CFG_TUH_DEVICE_MAX, RES_PARERR);
+  if ( disk_status(pdrv) & STA_NOINIT ) return RES_NOTRDY;
 
-  if (cmd != CTRL_SYNC) return RES_ERROR;
-  return RES_OK;
+  uint8_t const dev_addr = pdrv + 1;
+
+  switch ( cmd )
+  {
+    case CTRL_SYNC:
+#if CFG_TUH_MSC_CACHE_LINES
+    {
+      // write back cached sectors
+      diskio_drive_t* drv = &_drive[pdrv];
+
+      drv->busy   = true;
+      drv->failed = false;
+#if CFG_TUSB_OS != OPT_OS_NONE
+      osal_semaphore_reset(drv->sem);
+#endif
+
+      while ( !tuh_msc_cache_flush(dev_addr, io_cache_complete) )
+      {
+        if ( !wait_for_host(dev_addr) ) return RES_NOTRDY;
+      }
+
+#if CFG_TUSB_OS == OPT_OS_NONE
+      while ( drv->busy )
+      {
+        if ( !wait_for_host(dev_addr) ) return RES_NOTRDY;
+      }
+#else
+      while ( !osal_semaphore_wait(drv->sem, 100) )
+      {
+        if ( !tuh_msc_mounted(dev_addr) ) return RES_NOTRDY;
+      }
+#endif
+
+      return drv->failed ? RES_ERROR : RES_OK;
+    }
+#else
+      return RES_OK;
+#endif
+
+    case GET_SECTOR_COUNT:
+      *((DWORD*) buff) = tuh_msc_get_block_count(dev_addr, 0);
+      return RES_OK;
+
+    case GET_SECTOR_SIZE:
+      *((WORD*) buff) = (WORD) tuh_msc_get_block_size(dev_addr, 0);
+      return RES_OK;
+
+    case GET_BLOCK_SIZE:
+      *((DWORD*) buff) = 1; // erase block size is unknown
+      return RES_OK;
+
+    default: return RES_PARERR;
+  }
 }
 
 static inline uint8_t month2number(char* p_ch)
@@ -80,6 +80,10 @@ DRESULT disk_read (BYTE pdrv, BYTE*buff, DWORD sector, BYTE count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, BYTE count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
+// Invoked while waiting for I/O completion without RTOS, after running tuh_task().
+// Could be used to enter low power mode until next USB interrupt.
+TU_ATTR_WEAK void diskio_wait_cb(BYTE pdrv);
+
 static inline bool disk_is_ready(BYTE pdrv);
 static inline bool disk_is_ready(BYTE pdrv)
 {
@@ -9,7 +9,7 @@
 #ifndef _FFCONF
 #define _FFCONF 82786	/* Revision ID */
 
-#include "tusb_config.h"
+#include "tusb_option.h"
 
 /*---------------------------------------------------------------------------/
 / Functions and Buffer Configurations
@@ -41,7 +41,9 @@
 /* To enable string functions, set _USE_STRFUNC to 1 or 2. */
 
 
+#ifndef _USE_MKFS
 #define	_USE_MKFS		0	/* 0:Disable or 1:Enable */
+#endif
 /* To enable f_mkfs function, set _USE_MKFS to 1 and set _FS_READONLY to 0 */
 
 
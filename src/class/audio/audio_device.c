@@ -2275,6 +2275,20 @@ bool tud_audio_n_fb_set(uint8_t func_id, uint32_t feedback)
 
   return true;
 }
+
+#if CFG_TUD_SOF_CLOCK
+bool tud_audio_n_fb_update(uint8_t func_id, uint32_t sample_rate)
+{
+  // Local clock ticks per SOF interval in 24.8 format
+  uint32_t const ticks_per_sof = tud_sof_clock_ticks_per_sof();
+  TU_VERIFY(ticks_per_sof);
+
+  // Samples per SOF interval in 16.16 format: sample_rate * ticks_per_sof / local clock frequency
+  uint32_t const feedback = (uint32_t) ((((uint64_t) sample_rate * ticks_per_sof) << 8) / CFG_TUD_SOF_CLOCK_FREQUENCY);
+
+  return tud_audio_n_fb_set(func_id, feedback);
+}
+#endif
 #endif
 
 // No security checks here - internal function only which should always succeed
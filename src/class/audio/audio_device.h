@@ -460,6 +460,14 @@ TU_ATTR_WEAK bool tud_audio_fb_done_cb(uint8_t rhport);
 // Feedback value will be sent at FB endpoint interval till it's changed.
 bool tud_audio_n_fb_set(uint8_t func_id, uint32_t feedback);
 static inline bool tud_audio_fb_set(uint32_t feedback);
+
+#if CFG_TUD_SOF_CLOCK
+// Compute the feedback value from the SOF clock service of the device stack and set it.
+// The local clock of the SOF clock service must be derived from the same master clock as
+// the audio sample clock running at sample_rate. Call it periodically e.g in tud_audio_fb_done_cb().
+bool tud_audio_n_fb_update(uint8_t func_id, uint32_t sample_rate);
+static inline bool tud_audio_fb_update(uint32_t sample_rate);
+#endif
 #endif
 
 #if CFG_TUD_AUDIO_INT_CTR_EPSIZE_IN
@@ -606,6 +614,13 @@ static inline bool tud_audio_fb_set(uint32_t feedback)
 {
   return tud_audio_n_fb_set(0, feedback);
 }
+
+#if CFG_TUD_SOF_CLOCK
+static inline bool tud_audio_fb_update(uint32_t sample_rate)
+{
+  return tud_audio_n_fb_update(0, sample_rate);
+}
+#endif
 #endif
 
 //--------------------------------------------------------------------+
@@ -378,6 +378,29 @@ static inline uint8_t cdc_functional_desc_typeof(uint8_t const * p_desc)
 //--------------------------------------------------------------------+
 // Requests
 //--------------------------------------------------------------------+
+enum
+{
+  CDC_LINE_CODING_STOP_BITS_1   = 0,
+  CDC_LINE_CODING_STOP_BITS_1_5 = 1,
+  CDC_LINE_CODING_STOP_BITS_2   = 2,
+};
+
+enum
+{
+  CDC_LINE_CODING_PARITY_NONE  = 0,
+  CDC_LINE_CODING_PARITY_ODD   = 1,
+  CDC_LINE_CODING_PARITY_EVEN  = 2,
+  CDC_LINE_CODING_PARITY_MARK  = 3,
+  CDC_LINE_CODING_PARITY_SPACE = 4,
+};
+
+// wValue of Set Control Line State
+enum
+{
+  CDC_CONTROL_LINE_STATE_DTR = 0x01,
+  CDC_CONTROL_LINE_STATE_RTS = 0x02,
+};
+
 typedef struct TU_ATTR_PACKED
 {
   uint32_t bit_rate;
@@ -33,136 +33,852 @@
 
 #include "cdc_host.h"
 
+#if CFG_TUH_CDC_FTDI
+  #include "serial/ftdi_sio.h"
+#endif
+
+#if CFG_TUH_CDC_CP210X
+  #include "serial/cp210x.h"
+#endif
+
+#if CFG_TUH_CDC_CH34X
+  #include "serial/ch34x.h"
+#endif
+
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF
 //--------------------------------------------------------------------+
-typedef struct {
+
+// Vendor specific serial adapter is supported
+#define CDCH_VENDOR_SERIAL   (CFG_TUH_CDC_FTDI || CFG_TUH_CDC_CP210X || CFG_TUH_CDC_CH34X)
+
+// Control requests of an interface are executed one after another as a sequence
+enum
+{
+  CTRL_SEQ_NONE = 0,
+  CTRL_SEQ_ENUM,         // configure interface on enumeration
+  CTRL_SEQ_LINE_STATE,   // set DTR & RTS
+  CTRL_SEQ_LINE_CODING,  // set baudrate, parity, stop & data bits
+};
+
+// Operation of a sequence stage, each results in one control request (or none if skipped by driver)
+enum
+{
+  SERIAL_OP_END = 0,
+  SERIAL_OP_INIT,        // driver specific initialization
+  SERIAL_OP_INIT2,
+  SERIAL_OP_LINE_STATE,
+  SERIAL_OP_BAUDRATE,    // ACM: SET_LINE_CODING with all settings
+  SERIAL_OP_DATA_FORMAT, // parity, stop & data bits
+};
+
+typedef struct
+{
+  uint8_t daddr;
   uint8_t itf_num;
   uint8_t itf_protocol;
+  uint8_t serial_drid;   // index of serial_drivers[]
+  bool    mounted;       // configured and ready for data transfer
+
+  cdc_acm_capability_t acm_capability;
 
   uint8_t ep_notif;
   uint8_t ep_in;
   uint8_t ep_out;
+  uint16_t ep_in_packet_size;
+  uint16_t ep_out_packet_size;
 
-  cdc_acm_capability_t acm_capability;
+#if CFG_TUH_CDC_FTDI
+  uint8_t ftdi_port;     // port number in wIndex, 0 for single port chip
+#endif
+
+#if CFG_TUH_CDC_CH34X
+  uint8_t ch34x_version;
+#endif
+
+  // Bit 0: DTR (Data Terminal Ready), Bit 1: RTS (Request to Send)
+  uint8_t line_state;
+  cdc_line_coding_t line_coding; // bit_rate is 0 if not known
+
+  // Control request sequence, values are applied to line state & coding when it is complete
+  uint8_t ctrl_seq;
+  uint8_t ctrl_stage;
+  uint8_t ctrl_bRequest;
+  uint16_t ctrl_wIndex;
+  uint8_t ctrl_line_state;
+  cdc_line_coding_t ctrl_line_coding;
+  tuh_control_complete_cb_t ctrl_complete_cb;
+
+  /*------------- From this point, data is not cleared by close -------------*/
+
+  // FIFO
+  tu_fifo_t rx_ff;
+  tu_fifo_t tx_ff;
+
+  uint8_t rx_ff_buf[CFG_TUH_CDC_RX_BUFSIZE];
+  uint8_t tx_ff_buf[CFG_TUH_CDC_TX_BUFSIZE];
+
+#if CFG_FIFO_MUTEX
+  osal_mutex_def_t rx_ff_mutex;
+  osal_mutex_def_t tx_ff_mutex;
+#endif
+
+  // Endpoint Transfer buffer
+  CFG_TUSB_MEM_ALIGN uint8_t epin_buf[CFG_TUH_CDC_RX_EPSIZE];
+  CFG_TUSB_MEM_ALIGN uint8_t epout_buf[CFG_TUH_CDC_TX_EPSIZE];
+
+  // Data stage of control request
+  CFG_TUSB_MEM_ALIGN uint8_t ctrl_buf[8];
+} cdch_interface_t;
 
-} cdch_data_t;
+#define ITF_MEM_RESET_SIZE   offsetof(cdch_interface_t, rx_ff)
+
+typedef struct
+{
+  uint16_t const (*vid_pid_list)[2];
+  uint16_t vid_pid_count;
+
+  // number of status bytes at the start of each IN packet
+  uint8_t status_bytes;
+
+  // operations of enumeration sequence
+  uint8_t const* enum_ops;
+
+  bool (* const open) (uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+
+  // Prepare request for an operation of a sequence, return false if there is nothing to do
+  bool (* const prepare_request) (cdch_interface_t* p_cdc, uint8_t op, tusb_control_request_t* request, uint8_t** buffer);
+} cdch_serial_driver_t;
 
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
-static cdch_data_t cdch_data[CFG_TUH_DEVICE_MAX];
+CFG_TUSB_MEM_SECTION static cdch_interface_t cdch_data[CFG_TUH_CDC];
+
+static bool acm_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+static bool acm_prepare_request(cdch_interface_t* p_cdc, uint8_t op, tusb_control_request_t* request, uint8_t** buffer);
 
-static inline cdch_data_t* get_itf(uint8_t dev_addr)
+#if CFG_TUH_CDC_FTDI
+static uint16_t const ftdi_vid_pid_list[][2] = { FTDI_PID_LIST };
+static bool ftdi_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+static bool ftdi_prepare_request(cdch_interface_t* p_cdc, uint8_t op, tusb_control_request_t* request, uint8_t** buffer);
+#endif
+
+#if CFG_TUH_CDC_CP210X
+static uint16_t const cp210x_vid_pid_list[][2] = { CP210X_PID_LIST };
+static bool cp210x_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+static bool cp210x_prepare_request(cdch_interface_t* p_cdc, uint8_t op, tusb_control_request_t* request, uint8_t** buffer);
+#endif
+
+#if CFG_TUH_CDC_CH34X
+static uint16_t const ch34x_vid_pid_list[][2] = { CH34X_PID_LIST };
+static bool ch34x_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+static bool ch34x_prepare_request(cdch_interface_t* p_cdc, uint8_t op, tusb_control_request_t* request, uint8_t** buffer);
+#endif
+
+enum
 {
-  return &cdch_data[dev_addr-1];
-}
+  SERIAL_DRIVER_ACM = 0,
+
+#if CFG_TUH_CDC_FTDI
+  SERIAL_DRIVER_FTDI,
+#endif
+
+#if CFG_TUH_CDC_CP210X
+  SERIAL_DRIVER_CP210X,
+#endif
+
+#if CFG_TUH_CDC_CH34X
+  SERIAL_DRIVER_CH34X,
+#endif
+
+  SERIAL_DRIVER_COUNT
+};
+
+static cdch_serial_driver_t const serial_drivers[] =
+{
+  [SERIAL_DRIVER_ACM] =
+  {
+    .vid_pid_list    = NULL,
+    .vid_pid_count   = 0,
+    .status_bytes    = 0,
+    .enum_ops        = (uint8_t const[]) { SERIAL_OP_LINE_STATE, SERIAL_OP_BAUDRATE, SERIAL_OP_END },
+    .open            = acm_open,
+    .prepare_request = acm_prepare_request
+  },
+
+#if CFG_TUH_CDC_FTDI
+  [SERIAL_DRIVER_FTDI] =
+  {
+    .vid_pid_list    = ftdi_vid_pid_list,
+    .vid_pid_count   = TU_ARRAY_SIZE(ftdi_vid_pid_list),
+    .status_bytes    = FTDI_STATUS_BYTES,
+    .enum_ops        = (uint8_t const[]) { SERIAL_OP_INIT, SERIAL_OP_BAUDRATE, SERIAL_OP_DATA_FORMAT, SERIAL_OP_LINE_STATE, SERIAL_OP_END },
+    .open            = ftdi_open,
+    .prepare_request = ftdi_prepare_request
+  },
+#endif
 
-bool tuh_cdc_mounted(uint8_t dev_addr)
+#if CFG_TUH_CDC_CP210X
+  [SERIAL_DRIVER_CP210X] =
+  {
+    .vid_pid_list    = cp210x_vid_pid_list,
+    .vid_pid_count   = TU_ARRAY_SIZE(cp210x_vid_pid_list),
+    .status_bytes    = 0,
+    .enum_ops        = (uint8_t const[]) { SERIAL_OP_INIT, SERIAL_OP_BAUDRATE, SERIAL_OP_DATA_FORMAT, SERIAL_OP_LINE_STATE, SERIAL_OP_END },
+    .open            = cp210x_open,
+    .prepare_request = cp210x_prepare_request
+  },
+#endif
+
+#if CFG_TUH_CDC_CH34X
+  [SERIAL_DRIVER_CH34X] =
+  {
+    .vid_pid_list    = ch34x_vid_pid_list,
+    .vid_pid_count   = TU_ARRAY_SIZE(ch34x_vid_pid_list),
+    .status_bytes    = 0,
+    .enum_ops        = (uint8_t const[]) { SERIAL_OP_INIT, SERIAL_OP_INIT2, SERIAL_OP_BAUDRATE, SERIAL_OP_DATA_FORMAT, SERIAL_OP_LINE_STATE, SERIAL_OP_END },
+    .open            = ch34x_open,
+    .prepare_request = ch34x_prepare_request
+  },
+#endif
+};
+
+TU_VERIFY_STATIC(TU_ARRAY_SIZE(serial_drivers) == SERIAL_DRIVER_COUNT, "serial driver count mismatch");
+
+static uint8_t const seq_line_state_ops[]  = { SERIAL_OP_LINE_STATE, SERIAL_OP_END };
+static uint8_t const seq_line_coding_ops[] = { SERIAL_OP_BAUDRATE, SERIAL_OP_DATA_FORMAT, SERIAL_OP_END };
+
+static inline cdch_interface_t* get_itf(uint8_t idx)
 {
-  cdch_data_t* cdc = get_itf(dev_addr);
-  return cdc->ep_in && cdc->ep_out;
+  TU_ASSERT(idx < CFG_TUH_CDC, NULL);
+  cdch_interface_t* p_cdc = &cdch_data[idx];
+
+  return p_cdc->daddr ? p_cdc : NULL;
 }
 
-bool tuh_cdc_is_busy(uint8_t dev_addr, cdc_pipeid_t pipeid)
+static inline uint8_t get_idx_by_ep_addr(uint8_t daddr, uint8_t ep_addr)
 {
-  if ( !tuh_cdc_mounted(dev_addr) ) return false;
+  for(uint8_t i=0; i<CFG_TUH_CDC; i++)
+  {
+    cdch_interface_t* p_cdc = &cdch_data[i];
+    if ( (p_cdc->daddr == daddr) &&
+         (ep_addr == p_cdc->ep_notif || ep_addr == p_cdc->ep_in || ep_addr == p_cdc->ep_out) )
+    {
+      return i;
+    }
+  }
 
-  cdch_data_t const * p_cdc = get_itf(dev_addr);
+  return TUSB_INDEX_INVALID;
+}
 
-  switch (pipeid)
+static cdch_interface_t* make_new_itf(uint8_t daddr, tusb_desc_interface_t const *itf_desc)
+{
+  for(uint8_t i=0; i<CFG_TUH_CDC; i++)
   {
-    case CDC_PIPE_NOTIFICATION:
-      return usbh_edpt_busy(dev_addr, p_cdc->ep_notif );
+    if ( cdch_data[i].daddr == 0 )
+    {
+      cdch_interface_t* p_cdc = &cdch_data[i];
 
-    case CDC_PIPE_DATA_IN:
-      return usbh_edpt_busy(dev_addr, p_cdc->ep_in );
+      p_cdc->daddr        = daddr;
+      p_cdc->itf_num      = itf_desc->bInterfaceNumber;
+      p_cdc->itf_protocol = itf_desc->bInterfaceProtocol;
 
-    case CDC_PIPE_DATA_OUT:
-      return usbh_edpt_busy(dev_addr, p_cdc->ep_out );
+#ifdef CFG_TUH_CDC_LINE_CONTROL_ON_ENUM
+      p_cdc->ctrl_line_state = CFG_TUH_CDC_LINE_CONTROL_ON_ENUM;
+#endif
 
-    default:
-      return false;
+      return p_cdc;
+    }
   }
+
+  return NULL;
 }
 
+static bool open_data_endpoints(uint8_t rhport, cdch_interface_t* p_cdc, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+static bool rx_prep_xfer(cdch_interface_t* p_cdc);
+static bool ctrl_seq_start(cdch_interface_t* p_cdc, uint8_t seq, tuh_control_complete_cb_t complete_cb);
+
 //--------------------------------------------------------------------+
-// APPLICATION API (parameter validation needed)
+// APPLICATION API
 //--------------------------------------------------------------------+
-bool tuh_cdc_serial_is_mounted(uint8_t dev_addr)
+uint8_t tuh_cdc_itf_get_index(uint8_t dev_addr, uint8_t itf_num)
+{
+  for(uint8_t i=0; i<CFG_TUH_CDC; i++)
+  {
+    cdch_interface_t const* p_cdc = &cdch_data[i];
+    if ( p_cdc->daddr == dev_addr && p_cdc->itf_num == itf_num ) return i;
+  }
+
+  return TUSB_INDEX_INVALID;
+}
+
+uint8_t tuh_cdc_get_dev_addr(uint8_t idx)
+{
+  cdch_interface_t const* p_cdc = get_itf(idx);
+  return (p_cdc && p_cdc->mounted) ? p_cdc->daddr : 0;
+}
+
+bool tuh_cdc_mounted(uint8_t idx)
+{
+  cdch_interface_t const* p_cdc = get_itf(idx);
+  return p_cdc && p_cdc->mounted;
+}
+
+bool tuh_cdc_connected(uint8_t idx)
+{
+  return tuh_cdc_get_line_state(idx) & CDC_CONTROL_LINE_STATE_DTR;
+}
+
+uint8_t tuh_cdc_get_line_state(uint8_t idx)
+{
+  cdch_interface_t const* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc, 0);
+
+  return p_cdc->line_state;
+}
+
+bool tuh_cdc_get_line_coding(uint8_t idx, cdc_line_coding_t* line_coding)
+{
+  cdch_interface_t const* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc && p_cdc->line_coding.bit_rate);
+
+  *line_coding = p_cdc->line_coding;
+  return true;
+}
+
+//------------- Write -------------//
+uint32_t tuh_cdc_write(uint8_t idx, void const* buffer, uint32_t bufsize)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc, 0);
+
+  uint16_t const ret = tu_fifo_write_n(&p_cdc->tx_ff, buffer, (uint16_t) tu_min32(bufsize, UINT16_MAX));
+
+  // flush if queue more than packet size
+  if ( tu_fifo_count(&p_cdc->tx_ff) >= p_cdc->ep_out_packet_size )
+  {
+    tuh_cdc_write_flush(idx);
+  }
+
+  return ret;
+}
+
+uint32_t tuh_cdc_write_flush(uint8_t idx)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc && p_cdc->mounted, 0);
+
+  // No data to send
+  if ( !tu_fifo_count(&p_cdc->tx_ff) ) return 0;
+
+  // Claim the endpoint
+  TU_VERIFY( usbh_edpt_claim(p_cdc->daddr, p_cdc->ep_out), 0 );
+
+  // Pull data from FIFO
+  uint16_t const count = tu_fifo_read_n(&p_cdc->tx_ff, p_cdc->epout_buf, sizeof(p_cdc->epout_buf));
+
+  if ( count )
+  {
+    TU_ASSERT( usbh_edpt_xfer(p_cdc->daddr, p_cdc->ep_out, p_cdc->epout_buf, count), 0 );
+    return count;
+  }else
+  {
+    // Release endpoint since we don't make any transfer
+    usbh_edpt_release(p_cdc->daddr, p_cdc->ep_out);
+    return 0;
+  }
+}
+
+uint32_t tuh_cdc_write_available(uint8_t idx)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc, 0);
+
+  return tu_fifo_remaining(&p_cdc->tx_ff);
+}
+
+bool tuh_cdc_write_clear(uint8_t idx)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc);
+
+  return tu_fifo_clear(&p_cdc->tx_ff);
+}
+
+//------------- Read -------------//
+uint32_t tuh_cdc_available(uint8_t idx)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc, 0);
+
+  return tu_fifo_count(&p_cdc->rx_ff);
+}
+
+uint32_t tuh_cdc_read(uint8_t idx, void* buffer, uint32_t bufsize)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc, 0);
+
+  uint32_t const num_read = tu_fifo_read_n(&p_cdc->rx_ff, buffer, (uint16_t) tu_min32(bufsize, UINT16_MAX));
+
+  // there could be room for next transfer
+  rx_prep_xfer(p_cdc);
+
+  return num_read;
+}
+
+bool tuh_cdc_peek(uint8_t idx, uint8_t* ch)
 {
-  // TODO consider all AT Command as serial candidate
-  return tuh_cdc_mounted(dev_addr)                                         &&
-      (cdch_data[dev_addr-1].itf_protocol <= CDC_COMM_PROTOCOL_ATCOMMAND_CDMA);
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc);
+
+  return tu_fifo_peek(&p_cdc->rx_ff, ch);
 }
 
-bool tuh_cdc_send(uint8_t dev_addr, void const * p_data, uint32_t length, bool is_notify)
+bool tuh_cdc_read_clear(uint8_t idx)
 {
-  (void) is_notify;
-  TU_VERIFY( tuh_cdc_mounted(dev_addr) );
-  TU_VERIFY( p_data != NULL && length, TUSB_ERROR_INVALID_PARA);
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc);
+
+  bool const ret = tu_fifo_clear(&p_cdc->rx_ff);
+  rx_prep_xfer(p_cdc);
 
-  uint8_t const ep_out = cdch_data[dev_addr-1].ep_out;
-  if ( usbh_edpt_busy(dev_addr, ep_out) ) return false;
+  return ret;
+}
+
+//------------- Control Request -------------//
+bool tuh_cdc_set_control_line_state(uint8_t idx, bool dtr, bool rts, tuh_control_complete_cb_t complete_cb)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc && p_cdc->mounted && p_cdc->ctrl_seq == CTRL_SEQ_NONE);
+
+  p_cdc->ctrl_line_state = (uint8_t) ((rts ? CDC_CONTROL_LINE_STATE_RTS : 0) | (dtr ? CDC_CONTROL_LINE_STATE_DTR : 0));
+
+  return ctrl_seq_start(p_cdc, CTRL_SEQ_LINE_STATE, complete_cb);
+}
+
+bool tuh_cdc_set_line_coding(uint8_t idx, cdc_line_coding_t const* line_coding, tuh_control_complete_cb_t complete_cb)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc && p_cdc->mounted && p_cdc->ctrl_seq == CTRL_SEQ_NONE);
+  TU_VERIFY(line_coding->bit_rate);
+
+  // vendor serial adapters only support 5 to 8 data bits
+  TU_VERIFY(p_cdc->serial_drid == SERIAL_DRIVER_ACM || (line_coding->data_bits >= 5 && line_coding->data_bits <= 8));
+
+  p_cdc->ctrl_line_coding = *line_coding;
+
+  return ctrl_seq_start(p_cdc, CTRL_SEQ_LINE_CODING, complete_cb);
+}
+
+bool tuh_cdc_set_baudrate(uint8_t idx, uint32_t baudrate, tuh_control_complete_cb_t complete_cb)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc);
+
+  cdc_line_coding_t line_coding = p_cdc->line_coding;
+  line_coding.bit_rate = baudrate;
+
+  // line coding is not known yet: 8N1
+  if ( line_coding.data_bits == 0 ) line_coding.data_bits = 8;
+
+  return tuh_cdc_set_line_coding(idx, &line_coding, complete_cb);
+}
+
+//--------------------------------------------------------------------+
+// Control Request Sequence
+//--------------------------------------------------------------------+
+
+// Find interface waiting for this request
+static cdch_interface_t* get_itf_by_ctrl_request(uint8_t daddr, tusb_control_request_t const* request)
+{
+  for(uint8_t i=0; i<CFG_TUH_CDC; i++)
+  {
+    cdch_interface_t* p_cdc = &cdch_data[i];
+
+    if ( p_cdc->daddr == daddr && p_cdc->ctrl_seq != CTRL_SEQ_NONE &&
+         p_cdc->ctrl_bRequest == request->bRequest && p_cdc->ctrl_wIndex == tu_le16toh(request->wIndex) )
+    {
+      return p_cdc;
+    }
+  }
 
-  return usbh_edpt_xfer(dev_addr, ep_out, (void*)(uintptr_t) p_data, length);
+  return NULL;
 }
 
-bool tuh_cdc_receive(uint8_t dev_addr, void * p_buffer, uint32_t length, bool is_notify)
+static void ctrl_seq_complete(cdch_interface_t* p_cdc, tusb_control_request_t const* request, xfer_result_t result)
 {
-  (void) is_notify;
-  TU_VERIFY( tuh_cdc_mounted(dev_addr) );
-  TU_VERIFY( p_buffer != NULL && length, TUSB_ERROR_INVALID_PARA);
+  uint8_t const seq = p_cdc->ctrl_seq;
+  p_cdc->ctrl_seq = CTRL_SEQ_NONE;
 
-  uint8_t const ep_in = cdch_data[dev_addr-1].ep_in;
-  if ( usbh_edpt_busy(dev_addr, ep_in) ) return false;
+  if ( XFER_RESULT_SUCCESS == result )
+  {
+    if ( seq != CTRL_SEQ_LINE_CODING ) p_cdc->line_state  = p_cdc->ctrl_line_state;
+    if ( seq != CTRL_SEQ_LINE_STATE  ) p_cdc->line_coding = p_cdc->ctrl_line_coding;
+  }
+
+  if ( seq == CTRL_SEQ_ENUM )
+  {
+    uint8_t const daddr = p_cdc->daddr;
+
+    // Interface is not usable if it fails to configure but enumeration continues with other interfaces
+    if ( XFER_RESULT_SUCCESS == result )
+    {
+      p_cdc->mounted = true;
+      rx_prep_xfer(p_cdc);
+
+      if (tuh_cdc_mount_cb) tuh_cdc_mount_cb((uint8_t) (p_cdc - cdch_data));
+    }else
+    {
+      TU_LOG1("CDC: failed to configure interface %u\r\n", p_cdc->itf_num);
+    }
 
-  return usbh_edpt_xfer(dev_addr, ep_in, p_buffer, length);
+    // notify usbh that driver enumeration is complete
+    usbh_driver_set_config_complete(daddr, p_cdc->itf_num);
+  }
+  else if ( p_cdc->ctrl_complete_cb )
+  {
+    p_cdc->ctrl_complete_cb(p_cdc->daddr, request, result);
+  }
 }
 
-bool tuh_cdc_set_control_line_state(uint8_t dev_addr, bool dtr, bool rts, tuh_control_complete_cb_t complete_cb)
+static bool ctrl_seq_complete_cb(uint8_t daddr, tusb_control_request_t const* request, xfer_result_t result);
+
+// Submit request of current or following stage, sequence is complete if there is nothing left to do.
+// Return false if request cannot be submitted
+static bool ctrl_seq_next(cdch_interface_t* p_cdc)
 {
-  cdch_data_t const * p_cdc = get_itf(dev_addr);
-  tusb_control_request_t const request =
+  cdch_serial_driver_t const* driver = &serial_drivers[p_cdc->serial_drid];
+
+  uint8_t const* ops = (p_cdc->ctrl_seq == CTRL_SEQ_ENUM      ) ? driver->enum_ops   :
+                       (p_cdc->ctrl_seq == CTRL_SEQ_LINE_STATE) ? seq_line_state_ops : seq_line_coding_ops;
+
+  for( ; ops[p_cdc->ctrl_stage] != SERIAL_OP_END; p_cdc->ctrl_stage++)
   {
-    .bmRequestType_bit =
+    uint8_t const op = ops[p_cdc->ctrl_stage];
+
+#ifndef CFG_TUH_CDC_LINE_CONTROL_ON_ENUM
+    // line state is only set on enumeration if configured
+    if ( p_cdc->ctrl_seq == CTRL_SEQ_ENUM && op == SERIAL_OP_LINE_STATE ) continue;
+#endif
+
+    tusb_control_request_t request;
+    uint8_t* buffer = NULL;
+
+    if ( driver->prepare_request(p_cdc, op, &request, &buffer) )
     {
-      .recipient = TUSB_REQ_RCPT_INTERFACE,
-      .type      = TUSB_REQ_TYPE_CLASS,
-      .direction = TUSB_DIR_OUT
-    },
-    .bRequest = CDC_REQUEST_SET_CONTROL_LINE_STATE,
-    .wValue   = (rts ? 2 : 0) | (dtr ? 1 : 0),
-    .wIndex   = p_cdc->itf_num,
-    .wLength  = 0
-  };
-
-  TU_ASSERT( tuh_control_xfer(dev_addr, &request, NULL, complete_cb) );
+      p_cdc->ctrl_bRequest = request.bRequest;
+      p_cdc->ctrl_wIndex   = request.wIndex;
+
+      request.wValue  = tu_htole16(request.wValue);
+      request.wIndex  = tu_htole16(request.wIndex);
+      request.wLength = tu_htole16(request.wLength);
+
+      return tuh_control_xfer(p_cdc->daddr, &request, buffer, ctrl_seq_complete_cb);
+    }
+  }
+
+  ctrl_seq_complete(p_cdc, NULL, XFER_RESULT_SUCCESS);
   return true;
 }
 
+static bool ctrl_seq_start(cdch_interface_t* p_cdc, uint8_t seq, tuh_control_complete_cb_t complete_cb)
+{
+  TU_VERIFY(p_cdc->ctrl_seq == CTRL_SEQ_NONE);
+
+  p_cdc->ctrl_seq         = seq;
+  p_cdc->ctrl_stage       = 0;
+  p_cdc->ctrl_complete_cb = complete_cb;
+
+  if ( !ctrl_seq_next(p_cdc) )
+  {
+    p_cdc->ctrl_seq = CTRL_SEQ_NONE;
+    return false;
+  }
+
+  return true;
+}
+
+static bool ctrl_seq_complete_cb(uint8_t daddr, tusb_control_request_t const* request, xfer_result_t result)
+{
+  cdch_interface_t* p_cdc = get_itf_by_ctrl_request(daddr, request);
+  TU_VERIFY(p_cdc);
+
+  if ( XFER_RESULT_SUCCESS == result )
+  {
+    p_cdc->ctrl_stage++;
+    if ( !ctrl_seq_next(p_cdc) ) ctrl_seq_complete(p_cdc, request, XFER_RESULT_FAILED);
+  }else
+  {
+    ctrl_seq_complete(p_cdc, request, result);
+  }
+
+  return true;
+}
+
+static inline void fill_request(tusb_control_request_t* request, uint8_t type, uint8_t recipient, uint8_t dir,
+                                uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength)
+{
+  request->bmRequestType = (uint8_t) ((dir << 7) | (type << 5) | recipient);
+
+  request->bRequest = bRequest;
+  request->wValue   = wValue;
+  request->wIndex   = wIndex;
+  request->wLength  = wLength;
+}
+
 //--------------------------------------------------------------------+
 // USBH-CLASS DRIVER API
 //--------------------------------------------------------------------+
 void cdch_init(void)
 {
   tu_memclr(cdch_data, sizeof(cdch_data));
+
+  for(uint8_t i=0; i<CFG_TUH_CDC; i++)
+  {
+    cdch_interface_t* p_cdc = &cdch_data[i];
+
+    tu_fifo_config(&p_cdc->rx_ff, p_cdc->rx_ff_buf, TU_ARRAY_SIZE(p_cdc->rx_ff_buf), 1, false);
+    tu_fifo_config(&p_cdc->tx_ff, p_cdc->tx_ff_buf, TU_ARRAY_SIZE(p_cdc->tx_ff_buf), 1, false);
+
+#if CFG_FIFO_MUTEX
+    tu_fifo_config_mutex(&p_cdc->rx_ff, NULL, osal_mutex_create(&p_cdc->rx_ff_mutex));
+    tu_fifo_config_mutex(&p_cdc->tx_ff, osal_mutex_create(&p_cdc->tx_ff_mutex), NULL);
+#endif
+  }
 }
 
 bool cdch_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
 {
-  (void) max_len;
-
   // Only support ACM subclass
   // Protocol 0xFF can be RNDIS device for windows XP
-  TU_VERIFY( TUSB_CLASS_CDC                           == itf_desc->bInterfaceClass &&
-             CDC_COMM_SUBCLASS_ABSTRACT_CONTROL_MODEL == itf_desc->bInterfaceSubClass &&
-             0xFF                                     != itf_desc->bInterfaceProtocol);
+  if ( TUSB_CLASS_CDC                           == itf_desc->bInterfaceClass &&
+       CDC_COMM_SUBCLASS_ABSTRACT_CONTROL_MODEL == itf_desc->bInterfaceSubClass &&
+       0xFF                                     != itf_desc->bInterfaceProtocol )
+  {
+    return acm_open(rhport, dev_addr, itf_desc, max_len);
+  }
 
-  cdch_data_t * p_cdc = get_itf(dev_addr);
+#if CDCH_VENDOR_SERIAL
+  if ( TUSB_CLASS_VENDOR_SPECIFIC == itf_desc->bInterfaceClass )
+  {
+    uint16_t vid, pid;
+    TU_VERIFY(tuh_vid_pid_get(dev_addr, &vid, &pid));
+
+    for(uint8_t drid = SERIAL_DRIVER_ACM+1; drid < SERIAL_DRIVER_COUNT; drid++)
+    {
+      cdch_serial_driver_t const* driver = &serial_drivers[drid];
+
+      for(uint16_t i=0; i<driver->vid_pid_count; i++)
+      {
+        if ( driver->vid_pid_list[i][0] == vid && driver->vid_pid_list[i][1] == pid )
+        {
+          return driver->open(rhport, dev_addr, itf_desc, max_len);
+        }
+      }
+    }
+  }
+#endif
+
+  return false;
+}
+
+bool cdch_set_config(uint8_t dev_addr, uint8_t itf_num)
+{
+  uint8_t const idx = tuh_cdc_itf_get_index(dev_addr, itf_num);
+
+  // Data interface of ACM is also bound to this driver, there is nothing to configure
+  if ( idx >= CFG_TUH_CDC )
+  {
+    usbh_driver_set_config_complete(dev_addr, itf_num);
+    return true;
+  }
+
+  cdch_interface_t* p_cdc = &cdch_data[idx];
+
+  // configure interface with control requests, set_config is complete when the sequence is done
+  if ( !ctrl_seq_start(p_cdc, CTRL_SEQ_ENUM, NULL) )
+  {
+    TU_LOG1("CDC: failed to configure interface %u\r\n", itf_num);
+    usbh_driver_set_config_complete(dev_addr, itf_num);
+  }
+
+  return true;
+}
+
+bool cdch_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes)
+{
+  uint8_t const idx = get_idx_by_ep_addr(dev_addr, ep_addr);
+  TU_ASSERT(idx < CFG_TUH_CDC);
+
+  cdch_interface_t* p_cdc = &cdch_data[idx];
+
+  // Received new data
+  if ( ep_addr == p_cdc->ep_in )
+  {
+    if ( XFER_RESULT_SUCCESS == event )
+    {
+      uint8_t const status_bytes = serial_drivers[p_cdc->serial_drid].status_bytes;
+
+      if ( status_bytes )
+      {
+        // strip status at the start of each packet
+        for(uint32_t offset = 0; offset < xferred_bytes; offset += p_cdc->ep_in_packet_size)
+        {
+          uint32_t const len = tu_min32(xferred_bytes - offset, p_cdc->ep_in_packet_size);
+          if ( len > status_bytes )
+          {
+            tu_fifo_write_n(&p_cdc->rx_ff, p_cdc->epin_buf + offset + status_bytes, (uint16_t) (len - status_bytes));
+          }
+        }
+      }else
+      {
+        tu_fifo_write_n(&p_cdc->rx_ff, p_cdc->epin_buf, (uint16_t) xferred_bytes);
+      }
+
+      // invoke receive callback (if there is still data)
+      if ( tuh_cdc_rx_cb && !tu_fifo_empty(&p_cdc->rx_ff) ) tuh_cdc_rx_cb(idx);
+    }
+
+    // prepare for next IN transfer
+    rx_prep_xfer(p_cdc);
+  }
+
+  // Data sent to device, we continue to fetch from tx fifo to send.
+  if ( ep_addr == p_cdc->ep_out )
+  {
+    // invoke transmit callback to possibly refill tx fifo
+    if ( tuh_cdc_tx_complete_cb ) tuh_cdc_tx_complete_cb(idx);
+
+    if ( 0 == tuh_cdc_write_flush(idx) )
+    {
+      // If there is no data left, a ZLP should be sent if
+      // xferred_bytes is multiple of EP Packet size and not zero
+      if ( !tu_fifo_count(&p_cdc->tx_ff) && xferred_bytes && (0 == (xferred_bytes % p_cdc->ep_out_packet_size)) )
+      {
+        if ( usbh_edpt_claim(dev_addr, p_cdc->ep_out) )
+        {
+          usbh_edpt_xfer(dev_addr, p_cdc->ep_out, NULL, 0);
+        }
+      }
+    }
+  }
+
+  // nothing to do with notif endpoint for now
+
+  return true;
+}
+
+void cdch_close(uint8_t dev_addr)
+{
+  for(uint8_t idx=0; idx<CFG_TUH_CDC; idx++)
+  {
+    cdch_interface_t* p_cdc = &cdch_data[idx];
+    if ( p_cdc->daddr != dev_addr ) continue;
+
+    if ( p_cdc->mounted && tuh_cdc_umount_cb ) tuh_cdc_umount_cb(idx);
+
+    tu_memclr(p_cdc, ITF_MEM_RESET_SIZE);
+    tu_fifo_clear(&p_cdc->rx_ff);
+    tu_fifo_clear(&p_cdc->tx_ff);
+  }
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+// Start IN transfer if there is room in RX FIFO for a full endpoint buffer
+static bool rx_prep_xfer(cdch_interface_t* p_cdc)
+{
+  TU_VERIFY(p_cdc->mounted);
+
+  // This pre-check reduces endpoint claiming
+  TU_VERIFY(tu_fifo_remaining(&p_cdc->rx_ff) >= sizeof(p_cdc->epin_buf));
+
+  // claim endpoint
+  TU_VERIFY(usbh_edpt_claim(p_cdc->daddr, p_cdc->ep_in));
+
+  // fifo can be changed before endpoint is claimed
+  if ( tu_fifo_remaining(&p_cdc->rx_ff) >= sizeof(p_cdc->epin_buf) )
+  {
+    return usbh_edpt_xfer(p_cdc->daddr, p_cdc->ep_in, p_cdc->epin_buf, sizeof(p_cdc->epin_buf));
+  }else
+  {
+    // Release endpoint since we don't make any transfer
+    usbh_edpt_release(p_cdc->daddr, p_cdc->ep_in);
+    return false;
+  }
+}
+
+// Open bulk IN & OUT endpoints of data interface, other endpoints are skipped
+static bool open_data_endpoints(uint8_t rhport, cdch_interface_t* p_cdc, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
+{
+  uint8_t const* p_desc = (uint8_t const*) itf_desc;
+  uint8_t const* desc_end = p_desc + max_len;
+  uint8_t ep_count = 0;
+
+  p_desc = tu_desc_next(p_desc);
+
+  while ( p_desc < desc_end && ep_count < itf_desc->bNumEndpoints )
+  {
+    if ( TUSB_DESC_ENDPOINT == tu_desc_type(p_desc) )
+    {
+      tusb_desc_endpoint_t const * desc_ep = (tusb_desc_endpoint_t const *) p_desc;
+      ep_count++;
 
-  p_cdc->itf_num      = itf_desc->bInterfaceNumber;
-  p_cdc->itf_protocol = itf_desc->bInterfaceProtocol;
+      if ( TUSB_XFER_BULK == desc_ep->bmAttributes.xfer )
+      {
+        TU_ASSERT(usbh_edpt_open(rhport, p_cdc->daddr, desc_ep));
+
+        if ( tu_edpt_dir(desc_ep->bEndpointAddress) == TUSB_DIR_IN )
+        {
+          p_cdc->ep_in             = desc_ep->bEndpointAddress;
+          p_cdc->ep_in_packet_size = tu_edpt_packet_size(desc_ep);
+        }else
+        {
+          p_cdc->ep_out             = desc_ep->bEndpointAddress;
+          p_cdc->ep_out_packet_size = tu_edpt_packet_size(desc_ep);
+        }
+      }
+    }
+
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  TU_ASSERT(p_cdc->ep_in && p_cdc->ep_out);
+
+  // endpoint buffer must hold at least one packet
+  TU_ASSERT(p_cdc->ep_in_packet_size <= CFG_TUH_CDC_RX_EPSIZE && p_cdc->ep_out_packet_size <= CFG_TUH_CDC_TX_EPSIZE);
+
+  return true;
+}
+
+// Line coding to be set on enumeration
+static void set_enum_line_coding(cdch_interface_t* p_cdc, bool is_vendor)
+{
+#ifdef CFG_TUH_CDC_LINE_CODING_ON_ENUM
+  (void) is_vendor;
+  p_cdc->ctrl_line_coding = (cdc_line_coding_t) CFG_TUH_CDC_LINE_CODING_ON_ENUM;
+#else
+  if ( is_vendor )
+  {
+    p_cdc->ctrl_line_coding = (cdc_line_coding_t) { 115200, CDC_LINE_CODING_STOP_BITS_1, CDC_LINE_CODING_PARITY_NONE, 8 };
+  }
+#endif
+}
+
+//--------------------------------------------------------------------+
+// ACM
+//--------------------------------------------------------------------+
+
+static bool acm_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
+{
+  cdch_interface_t * p_cdc = make_new_itf(daddr, itf_desc);
+  TU_VERIFY(p_cdc);
+
+  p_cdc->serial_drid = SERIAL_DRIVER_ACM;
 
   //------------- Communication Interface -------------//
   uint16_t drv_len = tu_desc_len(itf_desc);
@@ -186,64 +902,310 @@ bool cdch_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *it
     // notification endpoint
     tusb_desc_endpoint_t const * desc_ep = (tusb_desc_endpoint_t const *) p_desc;
 
-    TU_ASSERT( usbh_edpt_open(rhport, dev_addr, desc_ep) );
+    TU_ASSERT( usbh_edpt_open(rhport, daddr, desc_ep) );
     p_cdc->ep_notif = desc_ep->bEndpointAddress;
 
     drv_len += tu_desc_len(p_desc);
     p_desc = tu_desc_next(p_desc);
   }
 
-  //------------- Data Interface (if any) -------------//
-  if ( (TUSB_DESC_INTERFACE == tu_desc_type(p_desc)) &&
-       (TUSB_CLASS_CDC_DATA == ((tusb_desc_interface_t const *) p_desc)->bInterfaceClass) )
+  //------------- Data Interface -------------//
+  TU_ASSERT( drv_len < max_len &&
+             TUSB_DESC_INTERFACE == tu_desc_type(p_desc) &&
+             TUSB_CLASS_CDC_DATA == ((tusb_desc_interface_t const *) p_desc)->bInterfaceClass );
+
+  TU_ASSERT( open_data_endpoints(rhport, p_cdc, (tusb_desc_interface_t const *) p_desc, (uint16_t) (max_len - drv_len)) );
+
+  // line coding is only set on enumeration if configured and supported
+  if ( p_cdc->acm_capability.support_line_request ) set_enum_line_coding(p_cdc, false);
+
+  return true;
+}
+
+static bool acm_prepare_request(cdch_interface_t* p_cdc, uint8_t op, tusb_control_request_t* request, uint8_t** buffer)
+{
+  switch ( op )
   {
-    // next to endpoint descriptor
-    drv_len += tu_desc_len(p_desc);
-    p_desc = tu_desc_next(p_desc);
+    case SERIAL_OP_LINE_STATE:
+      fill_request(request, TUSB_REQ_TYPE_CLASS, TUSB_REQ_RCPT_INTERFACE, TUSB_DIR_OUT,
+                   CDC_REQUEST_SET_CONTROL_LINE_STATE, p_cdc->ctrl_line_state, p_cdc->itf_num, 0);
+      return true;
 
-    // data endpoints expected to be in pairs
-    for(uint32_t i=0; i<2; i++)
-    {
-      tusb_desc_endpoint_t const *desc_ep = (tusb_desc_endpoint_t const *) p_desc;
-      TU_ASSERT(TUSB_DESC_ENDPOINT == desc_ep->bDescriptorType && TUSB_XFER_BULK == desc_ep->bmAttributes.xfer);
+    case SERIAL_OP_BAUDRATE:
+      // line coding is not configured
+      if ( 0 == p_cdc->ctrl_line_coding.bit_rate ) return false;
 
-      TU_ASSERT(usbh_edpt_open(rhport, dev_addr, desc_ep));
+      memcpy(p_cdc->ctrl_buf, &p_cdc->ctrl_line_coding, sizeof(cdc_line_coding_t));
+      *buffer = p_cdc->ctrl_buf;
 
-      if ( tu_edpt_dir(desc_ep->bEndpointAddress) == TUSB_DIR_IN )
-      {
-        p_cdc->ep_in = desc_ep->bEndpointAddress;
-      }else
-      {
-        p_cdc->ep_out = desc_ep->bEndpointAddress;
-      }
+      fill_request(request, TUSB_REQ_TYPE_CLASS, TUSB_REQ_RCPT_INTERFACE, TUSB_DIR_OUT,
+                   CDC_REQUEST_SET_LINE_CODING, 0, p_cdc->itf_num, sizeof(cdc_line_coding_t));
+      return true;
 
-      drv_len += tu_desc_len(p_desc);
-      p_desc = tu_desc_next( p_desc );
-    }
+    // included in SET_LINE_CODING
+    default: return false;
   }
+}
 
-  return true;
+//--------------------------------------------------------------------+
+// Vendor serial adapters
+//--------------------------------------------------------------------+
+#if CDCH_VENDOR_SERIAL
+
+static cdch_interface_t* vendor_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len, uint8_t drid)
+{
+  cdch_interface_t * p_cdc = make_new_itf(daddr, itf_desc);
+  TU_VERIFY(p_cdc, NULL);
+
+  p_cdc->serial_drid = drid;
+  TU_ASSERT(open_data_endpoints(rhport, p_cdc, itf_desc, max_len), NULL);
+
+  set_enum_line_coding(p_cdc, true);
+
+  return p_cdc;
 }
 
-bool cdch_set_config(uint8_t dev_addr, uint8_t itf_num)
+#endif
+
+//------------- FTDI -------------//
+#if CFG_TUH_CDC_FTDI
+
+static bool ftdi_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
 {
-  (void) dev_addr; (void) itf_num;
+  cdch_interface_t* p_cdc = vendor_open(rhport, daddr, itf_desc, max_len, SERIAL_DRIVER_FTDI);
+  TU_VERIFY(p_cdc);
+
+  uint16_t vid, pid;
+  tuh_vid_pid_get(daddr, &vid, &pid);
+
+  p_cdc->ftdi_port = FTDI_PID_IS_MULTI_PORT(pid) ? (uint8_t) (itf_desc->bInterfaceNumber + 1) : 0;
+
   return true;
 }
 
-bool cdch_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes)
+// Encode baudrate divisor: 14-bit integer part and 3-bit fraction of 3 MHz
+static uint32_t ftdi_baud_to_divisor(uint32_t baud)
 {
-  (void) ep_addr;
-  tuh_cdc_xfer_isr( dev_addr, event, 0, xferred_bytes );
-  return true;
+  static uint8_t const divfrac[8] = { 0, 3, 2, 4, 1, 5, 6, 7 };
+
+  // divisor shifted 3 bits to the left
+  uint32_t const divisor3 = (FTDI_BASE_CLOCK + baud) / (2*baud);
+  uint32_t divisor = (divisor3 >> 3) | ((uint32_t) divfrac[divisor3 & 0x7] << 14);
+
+  // special cases for highest baudrates
+  if ( divisor == 1 )
+  {
+    divisor = 0;      // 3 Mbaud
+  }
+  else if ( divisor == 0x4001 )
+  {
+    divisor = 1;      // 2 Mbaud
+  }
+
+  return divisor;
 }
 
-void cdch_close(uint8_t dev_addr)
+static bool ftdi_prepare_request(cdch_interface_t* p_cdc, uint8_t op, tusb_control_request_t* request, uint8_t** buffer)
 {
-  TU_VERIFY(dev_addr <= CFG_TUH_DEVICE_MAX, );
+  (void) buffer;
+  uint8_t const port = p_cdc->ftdi_port;
+  cdc_line_coding_t const* coding = &p_cdc->ctrl_line_coding;
+
+  switch ( op )
+  {
+    case SERIAL_OP_INIT:
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT,
+                   FTDI_SIO_RESET, FTDI_SIO_RESET_SIO, port, 0);
+      return true;
+
+    case SERIAL_OP_LINE_STATE:
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT, FTDI_SIO_MODEM_CTRL,
+                   (uint16_t) (((FTDI_SIO_SET_DTR_MASK | FTDI_SIO_SET_RTS_MASK) << 8) | p_cdc->ctrl_line_state), port, 0);
+      return true;
+
+    case SERIAL_OP_BAUDRATE:
+    {
+      uint32_t const divisor = ftdi_baud_to_divisor(coding->bit_rate);
+
+      // bit 16 of divisor is in wIndex, moved to high byte for multi-port chip
+      uint16_t const index = port ? (uint16_t) (((divisor >> 8) & 0xFF00) | port) : (uint16_t) (divisor >> 16);
+
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT,
+                   FTDI_SIO_SET_BAUD_RATE, (uint16_t) divisor, index, 0);
+      return true;
+    }
+
+    case SERIAL_OP_DATA_FORMAT:
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT, FTDI_SIO_SET_DATA,
+                   (uint16_t) (coding->data_bits | (coding->parity << FTDI_SIO_SET_DATA_PARITY_SHIFT) |
+                               (coding->stop_bits << FTDI_SIO_SET_DATA_STOP_SHIFT)), port, 0);
+      return true;
 
-  cdch_data_t * p_cdc = get_itf(dev_addr);
-  tu_memclr(p_cdc, sizeof(cdch_data_t));
+    default: return false;
+  }
+}
+
+#endif
+
+//------------- CP210x -------------//
+#if CFG_TUH_CDC_CP210X
+
+static bool cp210x_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
+{
+  return NULL != vendor_open(rhport, daddr, itf_desc, max_len, SERIAL_DRIVER_CP210X);
 }
 
+static bool cp210x_prepare_request(cdch_interface_t* p_cdc, uint8_t op, tusb_control_request_t* request, uint8_t** buffer)
+{
+  cdc_line_coding_t const* coding = &p_cdc->ctrl_line_coding;
+
+  switch ( op )
+  {
+    case SERIAL_OP_INIT:
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_INTERFACE, TUSB_DIR_OUT,
+                   CP210X_IFC_ENABLE, CP210X_UART_ENABLE, p_cdc->itf_num, 0);
+      return true;
+
+    case SERIAL_OP_LINE_STATE:
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_INTERFACE, TUSB_DIR_OUT, CP210X_SET_MHS,
+                   (uint16_t) (CP210X_MHS_DTR_MASK | CP210X_MHS_RTS_MASK | p_cdc->ctrl_line_state), p_cdc->itf_num, 0);
+      return true;
+
+    case SERIAL_OP_BAUDRATE:
+      tu_unaligned_write32(p_cdc->ctrl_buf, tu_htole32(coding->bit_rate));
+      *buffer = p_cdc->ctrl_buf;
+
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_INTERFACE, TUSB_DIR_OUT,
+                   CP210X_SET_BAUDRATE, 0, p_cdc->itf_num, 4);
+      return true;
+
+    case SERIAL_OP_DATA_FORMAT:
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_INTERFACE, TUSB_DIR_OUT, CP210X_SET_LINE_CTL,
+                   (uint16_t) (coding->stop_bits | (coding->parity << CP210X_LINE_CTL_PARITY_SHIFT) |
+                               (coding->data_bits << CP210X_LINE_CTL_DATA_SHIFT)), p_cdc->itf_num, 0);
+      return true;
+
+    default: return false;
+  }
+}
+
+#endif
+
+//------------- CH34x -------------//
+#if CFG_TUH_CDC_CH34X
+
+static bool ch34x_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
+{
+  return NULL != vendor_open(rhport, daddr, itf_desc, max_len, SERIAL_DRIVER_CH34X);
+}
+
+// Prescaler & divisor register value: divisor is (0x100 - div) in high byte, prescaler in low byte
+static uint16_t ch34x_get_divisor(uint32_t speed)
+{
+  #define CH34X_CLK_DIV(ps, fact)   (1u << (12 - 3*(ps) - (fact)))
+  #define CH34X_MIN_RATE(ps)        (CH34X_CLKRATE / (CH34X_CLK_DIV((ps), 1) * 512))
+
+  speed = tu_max32(CH34X_MIN_BPS, tu_min32(speed, CH34X_MAX_BPS));
+
+  // Start with highest possible base clock (fact = 1) that will give a divisor strictly less than 512
+  uint32_t fact = 1;
+  uint32_t ps;
+  for (ps = 3; ps > 0; ps--)
+  {
+    if ( speed > CH34X_MIN_RATE(ps) ) break;
+  }
+
+  // Determine corresponding divisor, rounding down
+  uint32_t clk_div = CH34X_CLK_DIV(ps, fact);
+  uint32_t div = CH34X_CLKRATE / (clk_div * speed);
+
+  // Halve base clock (fact = 0) if required
+  if ( div < 9 || div > 255 )
+  {
+    div /= 2;
+    clk_div *= 2;
+    fact = 0;
+  }
+
+  // Pick next divisor if resulting rate is closer to the requested one, scale up to avoid rounding errors on low rates
+  if ( 16*CH34X_CLKRATE / (clk_div*div) - 16*speed >= 16*speed - 16*CH34X_CLKRATE / (clk_div*(div + 1)) ) div++;
+
+  // Prefer lower base clock (fact = 0) if even divisor, this makes the receiver more tolerant to errors
+  if ( fact == 1 && (div % 2) == 0 )
+  {
+    div /= 2;
+    fact = 0;
+  }
+
+  return (uint16_t) (((0x100 - div) << 8) | (fact << 2) | ps);
+}
+
+static uint8_t ch34x_get_lcr(cdc_line_coding_t const* coding)
+{
+  uint8_t lcr = CH34X_LCR_ENABLE_RX | CH34X_LCR_ENABLE_TX | (uint8_t) (coding->data_bits - 5);
+
+  switch ( coding->parity )
+  {
+    case CDC_LINE_CODING_PARITY_ODD  : lcr |= CH34X_LCR_ENABLE_PAR; break;
+    case CDC_LINE_CODING_PARITY_EVEN : lcr |= CH34X_LCR_ENABLE_PAR | CH34X_LCR_PAR_EVEN; break;
+    case CDC_LINE_CODING_PARITY_MARK : lcr |= CH34X_LCR_ENABLE_PAR | CH34X_LCR_MARK_SPACE; break;
+    case CDC_LINE_CODING_PARITY_SPACE: lcr |= CH34X_LCR_ENABLE_PAR | CH34X_LCR_MARK_SPACE | CH34X_LCR_PAR_EVEN; break;
+    default: break;
+  }
+
+  if ( coding->stop_bits == CDC_LINE_CODING_STOP_BITS_2 ) lcr |= CH34X_LCR_STOP_BITS_2;
+
+  return lcr;
+}
+
+static bool ch34x_prepare_request(cdch_interface_t* p_cdc, uint8_t op, tusb_control_request_t* request, uint8_t** buffer)
+{
+  switch ( op )
+  {
+    case SERIAL_OP_INIT:
+      *buffer = p_cdc->ctrl_buf;
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_IN,
+                   CH34X_REQ_READ_VERSION, 0, 0, 2);
+      return true;
+
+    case SERIAL_OP_INIT2:
+      // version is read by previous stage
+      p_cdc->ch34x_version = p_cdc->ctrl_buf[0];
+
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT,
+                   CH34X_REQ_SERIAL_INIT, 0, 0, 0);
+      return true;
+
+    case SERIAL_OP_LINE_STATE:
+    {
+      uint8_t const control = (uint8_t) (((p_cdc->ctrl_line_state & CDC_CONTROL_LINE_STATE_DTR) ? CH34X_BIT_DTR : 0) |
+                                         ((p_cdc->ctrl_line_state & CDC_CONTROL_LINE_STATE_RTS) ? CH34X_BIT_RTS : 0));
+
+      // modem control bits are active low
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT,
+                   CH34X_REQ_MODEM_CTRL, (uint16_t) ~control, 0, 0);
+      return true;
+    }
+
+    case SERIAL_OP_BAUDRATE:
+    {
+      uint16_t divisor = ch34x_get_divisor(p_cdc->ctrl_line_coding.bit_rate);
+      if ( p_cdc->ch34x_version > 0x27 ) divisor |= CH34X_DIVISOR_NO_BUFFER;
+
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT, CH34X_REQ_WRITE_REG,
+                   (CH34X_REG_DIVISOR << 8) | CH34X_REG_PRESCALER, divisor, 0);
+      return true;
+    }
+
+    case SERIAL_OP_DATA_FORMAT:
+      fill_request(request, TUSB_REQ_TYPE_VENDOR, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT, CH34X_REQ_WRITE_REG,
+                   (CH34X_REG_LCR2 << 8) | CH34X_REG_LCR, ch34x_get_lcr(&p_cdc->ctrl_line_coding), 0);
+      return true;
+
+    default: return false;
+  }
+}
+
+#endif
+
 #endif
@@ -33,6 +33,50 @@
  extern "C" {
 #endif
 
+//--------------------------------------------------------------------+
+// Class Driver Configuration
+//--------------------------------------------------------------------+
+
+// CFG_TUH_CDC is the number of serial interfaces supported, a device can have more than one e.g FT2232, CP2105
+
+// Size of endpoint buffers, transfers of multiple packets allows higher throughput on full speed
+#ifndef CFG_TUH_CDC_RX_EPSIZE
+#define CFG_TUH_CDC_RX_EPSIZE     (TUH_OPT_HIGH_SPEED ? 512 : 64)
+#endif
+
+#ifndef CFG_TUH_CDC_TX_EPSIZE
+#define CFG_TUH_CDC_TX_EPSIZE     (TUH_OPT_HIGH_SPEED ? 512 : 64)
+#endif
+
+// RX & TX FIFO size
+#ifndef CFG_TUH_CDC_RX_BUFSIZE
+#define CFG_TUH_CDC_RX_BUFSIZE    (2*CFG_TUH_CDC_RX_EPSIZE)
+#endif
+
+#ifndef CFG_TUH_CDC_TX_BUFSIZE
+#define CFG_TUH_CDC_TX_BUFSIZE    (2*CFG_TUH_CDC_TX_EPSIZE)
+#endif
+
+// Vendor serial adapters which are not CDC ACM compliant
+#ifndef CFG_TUH_CDC_FTDI
+#define CFG_TUH_CDC_FTDI          0
+#endif
+
+#ifndef CFG_TUH_CDC_CP210X
+#define CFG_TUH_CDC_CP210X        0
+#endif
+
+#ifndef CFG_TUH_CDC_CH34X
+#define CFG_TUH_CDC_CH34X         0
+#endif
+
+// Set line state (bit 0: DTR, bit 1: RTS) on enumeration, not set if not defined
+//#define CFG_TUH_CDC_LINE_CONTROL_ON_ENUM    0x03
+
+// Set line coding on enumeration e.g { 115200, 0, 0, 8 }, not set for CDC ACM if not defined.
+// Vendor serial adapters are always configured, with 115200 8N1 if not defined
+//#define CFG_TUH_CDC_LINE_CODING_ON_ENUM     { 115200, CDC_LINE_CODING_STOP_BITS_1, CDC_LINE_CODING_PARITY_NONE, 8 }
+
 //--------------------------------------------------------------------+
 // CDC APPLICATION PUBLIC API
 //--------------------------------------------------------------------+
@@ -42,78 +86,93 @@
  * \defgroup   CDC_Serial_Host Host
  * @{ */
 
-bool tuh_cdc_set_control_line_state(uint8_t dev_addr, bool dtr, bool rts, tuh_control_complete_cb_t complete_cb);
+// Each serial interface has an index from 0 to CFG_TUH_CDC-1, which is passed to the API and callbacks
+
+// Get index of serial interface from device address and interface number,
+// return TUSB_INDEX_INVALID (0xFF) if not found
+uint8_t tuh_cdc_itf_get_index(uint8_t dev_addr, uint8_t itf_num);
+
+// Get device address of serial interface, 0 if not mounted
+uint8_t tuh_cdc_get_dev_addr(uint8_t idx);
+
+// Check if serial interface is mounted and configured
+bool tuh_cdc_mounted(uint8_t idx);
+
+// Check if DTR is set, i.e terminal is connected
+bool tuh_cdc_connected(uint8_t idx);
+
+// Get current line state. Bit 0: DTR, Bit 1: RTS
+uint8_t tuh_cdc_get_line_state(uint8_t idx);
 
-static inline bool tuh_cdc_connect(uint8_t dev_addr, tuh_control_complete_cb_t complete_cb)
+// Get line coding last set to the device
+bool tuh_cdc_get_line_coding(uint8_t idx, cdc_line_coding_t* line_coding);
+
+//------------- Write -------------//
+
+// Write bytes to TX FIFO, data may remain in the FIFO for a while
+uint32_t tuh_cdc_write(uint8_t idx, void const* buffer, uint32_t bufsize);
+
+// Force sending data if possible, return number of forced bytes
+uint32_t tuh_cdc_write_flush(uint8_t idx);
+
+// Return the number of bytes available for writing to TX FIFO
+uint32_t tuh_cdc_write_available(uint8_t idx);
+
+// Clear the transmit FIFO
+bool tuh_cdc_write_clear(uint8_t idx);
+
+//------------- Read -------------//
+
+// Get the number of bytes available for reading
+uint32_t tuh_cdc_available(uint8_t idx);
+
+// Read received bytes
+uint32_t tuh_cdc_read(uint8_t idx, void* buffer, uint32_t bufsize);
+
+// Get a byte from RX FIFO without removing it
+bool tuh_cdc_peek(uint8_t idx, uint8_t* ch);
+
+// Clear the received FIFO
+bool tuh_cdc_read_clear(uint8_t idx);
+
+//------------- Control Request -------------//
+// Requests are asynchronous, result is reported by complete_cb (if not NULL) when all transfers of the request are done.
+// Only one request per interface can be pending, false is returned if interface is busy with previous one.
+
+// Set DTR & RTS
+bool tuh_cdc_set_control_line_state(uint8_t idx, bool dtr, bool rts, tuh_control_complete_cb_t complete_cb);
+
+// Set baudrate, parity, stop and data bits
+bool tuh_cdc_set_line_coding(uint8_t idx, cdc_line_coding_t const* line_coding, tuh_control_complete_cb_t complete_cb);
+
+// Set baudrate, other settings of line coding are kept
+bool tuh_cdc_set_baudrate(uint8_t idx, uint32_t baudrate, tuh_control_complete_cb_t complete_cb);
+
+static inline bool tuh_cdc_connect(uint8_t idx, tuh_control_complete_cb_t complete_cb)
 {
-  return tuh_cdc_set_control_line_state(dev_addr, true, true, complete_cb);
+  return tuh_cdc_set_control_line_state(idx, true, true, complete_cb);
 }
 
-static inline bool tuh_cdc_disconnect(uint8_t dev_addr, tuh_control_complete_cb_t complete_cb)
+static inline bool tuh_cdc_disconnect(uint8_t idx, tuh_control_complete_cb_t complete_cb)
 {
-  return tuh_cdc_set_control_line_state(dev_addr, false, false, complete_cb);
+  return tuh_cdc_set_control_line_state(idx, false, false, complete_cb);
 }
 
-/** \brief 			Check if device support CDC Serial interface or not
- * \param[in]		dev_addr	device address
- * \retval      true if device supports
- * \retval      false if device does not support or is not mounted
- */
-bool tuh_cdc_serial_is_mounted(uint8_t dev_addr);
-
-/** \brief      Check if the interface is currently busy or not
- * \param[in]   dev_addr device address
- * \param[in]   pipeid value from \ref cdc_pipeid_t to indicate target pipe.
- * \retval      true if the interface is busy, meaning the stack is still transferring/waiting data from/to device
- * \retval      false if the interface is not busy, meaning the stack successfully transferred data from/to device
- * \note        This function is used to check if previous transfer is complete (success or error), so that the next transfer
- *              can be scheduled. User needs to make sure the corresponding interface is mounted
- *              (by \ref tuh_cdc_serial_is_mounted) before calling this function.
- */
-bool tuh_cdc_is_busy(uint8_t dev_addr, cdc_pipeid_t pipeid);
-
-/** \brief 			Perform USB OUT transfer to device
- * \param[in]		dev_addr	device address
- * \param[in]	  p_data    Buffer containing data. Must be accessible by USB controller (see \ref CFG_TUSB_MEM_SECTION)
- * \param[in]		length    Number of bytes to be transferred via USB bus
- * \retval      TUSB_ERROR_NONE on success
- * \retval      TUSB_ERROR_INTERFACE_IS_BUSY if the interface is already transferring data with device
- * \retval      TUSB_ERROR_DEVICE_NOT_READY if device is not yet configured (by SET CONFIGURED request)
- * \retval      TUSB_ERROR_INVALID_PARA if input parameters are not correct
- * \note        This function is non-blocking and returns immediately. The result of USB transfer will be reported by the
- *              interface's callback function. \a p_data must be declared with \ref CFG_TUSB_MEM_SECTION.
- */
-bool tuh_cdc_send(uint8_t dev_addr, void const * p_data, uint32_t length, bool is_notify);
-
-/** \brief 			Perform USB IN transfer to get data from device
- * \param[in]		dev_addr	device address
- * \param[in]	  p_buffer  Buffer containing received data. Must be accessible by USB controller (see \ref CFG_TUSB_MEM_SECTION)
- * \param[in]		length    Number of bytes to be transferred via USB bus
- * \retval      TUSB_ERROR_NONE on success
- * \retval      TUSB_ERROR_INTERFACE_IS_BUSY if the interface is already transferring data with device
- * \retval      TUSB_ERROR_DEVICE_NOT_READY if device is not yet configured (by SET CONFIGURED request)
- * \retval      TUSB_ERROR_INVALID_PARA if input parameters are not correct
- * \note        This function is non-blocking and returns immediately. The result of USB transfer will be reported by the
- *              interface's callback function. \a p_data must be declared with \ref CFG_TUSB_MEM_SECTION.
- */
-bool tuh_cdc_receive(uint8_t dev_addr, void * p_buffer, uint32_t length, bool is_notify);
-
 //--------------------------------------------------------------------+
 // CDC APPLICATION CALLBACKS
 //--------------------------------------------------------------------+
 
-/** \brief      Callback function that is invoked when an transferring event occurred
- * \param[in]		dev_addr	Address of device
- * \param[in]   event an value from \ref xfer_result_t
- * \param[in]   pipe_id value from \ref cdc_pipeid_t indicate the pipe
- * \param[in]   xferred_bytes Number of bytes transferred via USB bus
- * \note        event can be one of following
- *              - XFER_RESULT_SUCCESS : previously scheduled transfer completes successfully.
- *              - XFER_RESULT_FAILED   : previously scheduled transfer encountered a transaction error.
- *              - XFER_RESULT_STALLED : previously scheduled transfer is stalled by device.
- * \note
- */
-void tuh_cdc_xfer_isr(uint8_t dev_addr, xfer_result_t event, cdc_pipeid_t pipe_id, uint32_t xferred_bytes);
+// Invoked when a serial interface is mounted i.e configured and ready for data transfer
+TU_ATTR_WEAK void tuh_cdc_mount_cb(uint8_t idx);
+
+// Invoked when a serial interface is unmounted
+TU_ATTR_WEAK void tuh_cdc_umount_cb(uint8_t idx);
+
+// Invoked when received new data
+TU_ATTR_WEAK void tuh_cdc_rx_cb(uint8_t idx);
+
+// Invoked when a TX transfer is complete and space becomes available in TX FIFO
+TU_ATTR_WEAK void tuh_cdc_tx_complete_cb(uint8_t idx);
 
 /// @} // group CDC_Serial_Host
 /// @}
@@ -0,0 +1,76 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_CH34X_H_
+#define _TUSB_CH34X_H_
+
+// WCH CH340/CH341 USB serial converter. Requests are vendor type with device recipient,
+// registers are written in pair: wValue is address of (reg2 << 8 | reg1), wIndex is (val2 << 8 | val1).
+// Data on bulk endpoints is raw without header.
+
+#define WCH_VID                     0x1A86
+
+#define CH34X_PID_LIST \
+  {WCH_VID, 0x7523}, {WCH_VID, 0x5523}
+
+// Requests
+#define CH34X_REQ_READ_VERSION      0x5F
+#define CH34X_REQ_WRITE_REG         0x9A
+#define CH34X_REQ_READ_REG          0x95
+#define CH34X_REQ_SERIAL_INIT       0xA1
+#define CH34X_REQ_MODEM_CTRL        0xA4 // wValue is inverted modem control bits
+
+// Registers
+#define CH34X_REG_PRESCALER         0x12
+#define CH34X_REG_DIVISOR           0x13
+#define CH34X_REG_LCR               0x18
+#define CH34X_REG_LCR2              0x25
+
+// Line control register
+#define CH34X_LCR_ENABLE_RX         0x80
+#define CH34X_LCR_ENABLE_TX         0x40
+#define CH34X_LCR_MARK_SPACE        0x20
+#define CH34X_LCR_PAR_EVEN          0x10
+#define CH34X_LCR_ENABLE_PAR        0x08
+#define CH34X_LCR_STOP_BITS_2       0x04
+#define CH34X_LCR_CS8               0x03
+#define CH34X_LCR_CS7               0x02
+#define CH34X_LCR_CS6               0x01
+#define CH34X_LCR_CS5               0x00
+
+// Modem control bits
+#define CH34X_BIT_DTR               0x20
+#define CH34X_BIT_RTS               0x40
+
+// Baud rate is derived from 48 MHz clock with prescaler and 8-bit divisor, supported from 46 to 3 Mbaud
+#define CH34X_CLKRATE               48000000u
+#define CH34X_MIN_BPS               46
+#define CH34X_MAX_BPS               3000000u
+
+// Divisor register: set bit 7 for chip version > 0x27
+#define CH34X_DIVISOR_NO_BUFFER     0x80
+
+#endif /* _TUSB_CH34X_H_ */
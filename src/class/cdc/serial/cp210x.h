@@ -0,0 +1,69 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_CP210X_H_
+#define _TUSB_CP210X_H_
+
+// Silicon Labs CP210x USB to UART bridge e.g CP2102, CP2104, CP2105. Requests are vendor type with
+// interface recipient. Data on bulk endpoints is raw without header.
+
+#define SILABS_VID                  0x10C4
+
+#define CP210X_PID_LIST \
+  {SILABS_VID, 0xEA60}, {SILABS_VID, 0xEA70}, {SILABS_VID, 0xEA71}
+
+// Requests
+#define CP210X_IFC_ENABLE           0x00 // Enable / Disable UART
+#define CP210X_SET_BAUDDIV          0x01
+#define CP210X_GET_BAUDDIV          0x02
+#define CP210X_SET_LINE_CTL         0x03 // Set parity, data bits, stop bits
+#define CP210X_GET_LINE_CTL         0x04
+#define CP210X_SET_BREAK            0x05
+#define CP210X_IMM_CHAR             0x06
+#define CP210X_SET_MHS              0x07 // Set DTR & RTS
+#define CP210X_GET_MDMSTS           0x08
+#define CP210X_SET_XON              0x09
+#define CP210X_SET_XOFF             0x0A
+#define CP210X_GET_FLOW             0x14
+#define CP210X_SET_FLOW             0x13
+#define CP210X_GET_BAUDRATE         0x1D
+#define CP210X_SET_BAUDRATE         0x1E // Set baud rate, data is 4 bytes
+
+// CP210X_IFC_ENABLE wValue
+#define CP210X_UART_DISABLE         0x0000
+#define CP210X_UART_ENABLE          0x0001
+
+// CP210X_SET_LINE_CTL wValue: bit 0-3 stop bits, 4-7 parity, 8-15 data bits
+#define CP210X_LINE_CTL_PARITY_SHIFT  4
+#define CP210X_LINE_CTL_DATA_SHIFT    8
+
+// CP210X_SET_MHS wValue: bit 0 DTR, bit 1 RTS, bit 8 & 9 are mask of DTR & RTS to set
+#define CP210X_MHS_DTR              0x0001
+#define CP210X_MHS_RTS              0x0002
+#define CP210X_MHS_DTR_MASK         0x0100
+#define CP210X_MHS_RTS_MASK         0x0200
+
+#endif /* _TUSB_CP210X_H_ */
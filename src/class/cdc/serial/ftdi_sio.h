@@ -0,0 +1,70 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_FTDI_SIO_H_
+#define _TUSB_FTDI_SIO_H_
+
+// FTDI USB serial converter e.g FT232R, FT2232H, FT-X. Requests are vendor type with
+// device recipient, wIndex is port number (interface number + 1) for multi-port chips.
+// Each IN packet starts with 2 bytes of modem & line status.
+
+#define FTDI_VID                    0x0403
+
+#define FTDI_PID_LIST \
+  {FTDI_VID, 0x6001}, {FTDI_VID, 0x6006}, {FTDI_VID, 0x6010}, {FTDI_VID, 0x6011}, \
+  {FTDI_VID, 0x6014}, {FTDI_VID, 0x6015}
+
+// FT2232 & FT4232 have more than one port
+#define FTDI_PID_IS_MULTI_PORT(_pid)  ((_pid) == 0x6010 || (_pid) == 0x6011)
+
+#define FTDI_STATUS_BYTES           2
+
+// Requests
+#define FTDI_SIO_RESET              0 // Reset the port
+#define FTDI_SIO_MODEM_CTRL         1 // Set the modem control register
+#define FTDI_SIO_SET_FLOW_CTRL      2 // Set flow control register
+#define FTDI_SIO_SET_BAUD_RATE      3 // Set baud rate
+#define FTDI_SIO_SET_DATA           4 // Set the data characteristics of the port
+#define FTDI_SIO_GET_MODEM_STATUS   5 // Retrieve current value of modem status register
+#define FTDI_SIO_SET_LATENCY_TIMER  9 // Set the latency timer
+
+// FTDI_SIO_RESET wValue
+#define FTDI_SIO_RESET_SIO          0
+#define FTDI_SIO_RESET_PURGE_RX     1
+#define FTDI_SIO_RESET_PURGE_TX     2
+
+// FTDI_SIO_MODEM_CTRL wValue: low byte is the value, high byte is the mask of value to set
+#define FTDI_SIO_SET_DTR_MASK       0x1
+#define FTDI_SIO_SET_RTS_MASK       0x2
+
+// FTDI_SIO_SET_DATA wValue: bit 0-7 data bits, 8-10 parity, 11-13 stop bits
+#define FTDI_SIO_SET_DATA_PARITY_SHIFT  8
+#define FTDI_SIO_SET_DATA_STOP_SHIFT    11
+
+// Baud rate is derived from 3 MHz (48 MHz / 16) with 3-bit fractional divisor, supported up to 3 Mbaud
+#define FTDI_BASE_CLOCK             48000000u
+
+#endif /* _TUSB_FTDI_SIO_H_ */
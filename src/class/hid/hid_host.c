@@ -37,6 +37,13 @@
 // MACRO CONSTANT TYPEDEF
 //--------------------------------------------------------------------+
 
+enum
+{
+  AUTO_XFER_NONE = 0,
+  AUTO_XFER_QUEUE,
+  AUTO_XFER_EPIN_BUF
+};
+
 typedef struct
 {
   uint8_t itf_num;
@@ -54,6 +61,24 @@ typedef struct
 
   uint8_t epin_buf[CFG_TUH_HID_EPIN_BUFSIZE];
   uint8_t epout_buf[CFG_TUH_HID_EPOUT_BUFSIZE];
+
+#if CFG_TUH_HID_REPORT_QUEUE_SZ
+  // Automatic polling: report is received directly into free slot of the queue,
+  // or into epin_buf if the queue is full when the transfer is queued.
+  bool    auto_poll;
+  uint8_t auto_xfer;          // destination of pending transfer queued by automatic polling
+
+  volatile uint16_t queue_wr; // free running index
+  volatile uint16_t queue_rd;
+  uint32_t overrun;
+
+  tuh_hid_report_t queue[CFG_TUH_HID_REPORT_QUEUE_SZ];
+#endif
+
+#if CFG_TUH_HID_FIELD_MAX
+  uint16_t field_count;
+  tuh_hid_field_t fields[CFG_TUH_HID_FIELD_MAX];
+#endif
 } hidh_interface_t;
 
 typedef struct
@@ -193,12 +218,155 @@ bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t instance)
 {
   hidh_interface_t* hid_itf = get_instance(dev_addr, instance);
 
+#if CFG_TUH_HID_REPORT_QUEUE_SZ
+  // endpoint is managed by automatic polling
+  TU_VERIFY( !hid_itf->auto_poll );
+#endif
+
   // claim endpoint
   TU_VERIFY( usbh_edpt_claim(dev_addr, hid_itf->ep_in) );
 
   return usbh_edpt_xfer(dev_addr, hid_itf->ep_in, hid_itf->epin_buf, hid_itf->epin_size);
 }
 
+#if CFG_TUH_HID_REPORT_QUEUE_SZ
+
+TU_ATTR_ALWAYS_INLINE static inline uint16_t queue_count(hidh_interface_t const* hid_itf)
+{
+  return (uint16_t) (hid_itf->queue_wr - hid_itf->queue_rd);
+}
+
+// Queue transfer on interrupt endpoint into next free slot
+static bool queue_receive_report(uint8_t dev_addr, hidh_interface_t* hid_itf)
+{
+  TU_VERIFY( usbh_edpt_claim(dev_addr, hid_itf->ep_in) );
+
+  uint8_t* buffer;
+  if ( queue_count(hid_itf) < CFG_TUH_HID_REPORT_QUEUE_SZ )
+  {
+    buffer = hid_itf->queue[hid_itf->queue_wr & (CFG_TUH_HID_REPORT_QUEUE_SZ-1)].data;
+    hid_itf->auto_xfer = AUTO_XFER_QUEUE;
+  }else
+  {
+    buffer = hid_itf->epin_buf;
+    hid_itf->auto_xfer = AUTO_XFER_EPIN_BUF;
+  }
+
+  if ( !usbh_edpt_xfer(dev_addr, hid_itf->ep_in, buffer, tu_min16(hid_itf->epin_size, CFG_TUH_HID_EPIN_BUFSIZE)) )
+  {
+    hid_itf->auto_xfer = AUTO_XFER_NONE;
+    return false;
+  }
+
+  return true;
+}
+
+static void queue_xfer_complete(uint8_t dev_addr, uint8_t instance, hidh_interface_t* hid_itf, xfer_result_t result, uint32_t xferred_bytes)
+{
+  uint8_t const auto_xfer = hid_itf->auto_xfer;
+  hid_itf->auto_xfer = AUTO_XFER_NONE;
+
+  if ( XFER_RESULT_SUCCESS != result )
+  {
+    // stop polling e.g endpoint is stalled
+    TU_LOG1("HID auto polling stopped (%u, %u)\r\n", dev_addr, instance);
+    hid_itf->auto_poll = false;
+    return;
+  }
+
+  // zero length report is not queued
+  if ( xferred_bytes )
+  {
+    uint16_t const wr = hid_itf->queue_wr & (CFG_TUH_HID_REPORT_QUEUE_SZ-1);
+
+    if ( auto_xfer == AUTO_XFER_QUEUE )
+    {
+      hid_itf->queue[wr].len = (uint16_t) xferred_bytes;
+      hid_itf->queue_wr++;
+    }
+    else if ( queue_count(hid_itf) < CFG_TUH_HID_REPORT_QUEUE_SZ )
+    {
+      // queue was full when transfer is queued, but application has read some reports since then
+      memcpy(hid_itf->queue[wr].data, hid_itf->epin_buf, xferred_bytes);
+      hid_itf->queue[wr].len = (uint16_t) xferred_bytes;
+      hid_itf->queue_wr++;
+    }
+    else
+    {
+      hid_itf->overrun++;
+    }
+  }
+
+  // poll again at next interval
+  if ( hid_itf->auto_poll ) queue_receive_report(dev_addr, hid_itf);
+
+  if ( xferred_bytes && tuh_hid_report_queued_cb ) tuh_hid_report_queued_cb(dev_addr, instance, queue_count(hid_itf));
+}
+
+bool tuh_hid_receive_auto(uint8_t dev_addr, uint8_t instance, bool enabled)
+{
+  hidh_interface_t* hid_itf = get_instance(dev_addr, instance);
+  TU_VERIFY(hid_itf->ep_in);
+
+  if ( hid_itf->auto_poll == enabled ) return true;
+
+  if ( enabled )
+  {
+    // transfer of previous polling is still pending, endpoint is re-armed when it is complete
+    if ( hid_itf->auto_xfer != AUTO_XFER_NONE )
+    {
+      hid_itf->auto_poll = true;
+      return true;
+    }
+
+    // endpoint could be still busy with tuh_hid_receive_report()
+    TU_VERIFY( !usbh_edpt_busy(dev_addr, hid_itf->ep_in) );
+
+    hid_itf->auto_poll = true;
+    if ( !queue_receive_report(dev_addr, hid_itf) )
+    {
+      hid_itf->auto_poll = false;
+      return false;
+    }
+  }else
+  {
+    // pending transfer is complete as usual but endpoint is not polled anymore
+    hid_itf->auto_poll = false;
+  }
+
+  return true;
+}
+
+uint16_t tuh_hid_report_available(uint8_t dev_addr, uint8_t instance)
+{
+  return queue_count(get_instance(dev_addr, instance));
+}
+
+uint16_t tuh_hid_report_read(uint8_t dev_addr, uint8_t instance, tuh_hid_report_t* reports, uint16_t count)
+{
+  hidh_interface_t* hid_itf = get_instance(dev_addr, instance);
+
+  count = tu_min16(count, queue_count(hid_itf));
+
+  // copy in at most 2 chunks since queue can wrap around
+  uint16_t const rd    = hid_itf->queue_rd & (CFG_TUH_HID_REPORT_QUEUE_SZ-1);
+  uint16_t const count1 = tu_min16(count, (uint16_t) (CFG_TUH_HID_REPORT_QUEUE_SZ - rd));
+
+  memcpy(reports, &hid_itf->queue[rd], count1*sizeof(tuh_hid_report_t));
+  if ( count > count1 ) memcpy(reports + count1, hid_itf->queue, (count - count1)*sizeof(tuh_hid_report_t));
+
+  hid_itf->queue_rd = (uint16_t) (hid_itf->queue_rd + count);
+
+  return count;
+}
+
+uint32_t tuh_hid_report_overrun(uint8_t dev_addr, uint8_t instance)
+{
+  return get_instance(dev_addr, instance)->overrun;
+}
+
+#endif
+
 //bool tuh_n_hid_n_ready(uint8_t dev_addr, uint8_t instance)
 //{
 //  TU_VERIFY(tuh_n_hid_n_mounted(dev_addr, instance));
@@ -227,6 +395,14 @@ bool hidh_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint3
 
   if ( dir == TUSB_DIR_IN )
   {
+#if CFG_TUH_HID_REPORT_QUEUE_SZ
+    if ( hid_itf->auto_xfer != AUTO_XFER_NONE )
+    {
+      queue_xfer_complete(dev_addr, instance, hid_itf, result, xferred_bytes);
+      return true;
+    }
+#endif
+
     TU_LOG2("  Get Report callback (%u, %u)\r\n", dev_addr, instance);
     TU_LOG3_MEM(hid_itf->epin_buf, xferred_bytes, 2);
     tuh_hid_report_received_cb(dev_addr, instance, hid_itf->epin_buf, xferred_bytes);
@@ -417,7 +593,7 @@ static bool config_get_report_desc(uint8_t dev_addr, tusb_control_request_t cons
       .wLength  = hid_itf->report_desc_len
     };
 
-    TU_ASSERT(tuh_control_xfer(dev_addr, &new_request, usbh_get_enum_buf(), config_get_report_desc_complete));
+    TU_ASSERT(tuh_control_xfer(dev_addr, &new_request, usbh_get_enum_buf(dev_addr), config_get_report_desc_complete));
   }
 
   return true;
@@ -430,7 +606,7 @@ static bool config_get_report_desc_complete(uint8_t dev_addr, tusb_control_reque
   uint8_t const itf_num      = (uint8_t) request->wIndex;
   uint8_t const instance     = get_instance_id_by_itfnum(dev_addr, itf_num);
 
-  uint8_t const* desc_report = usbh_get_enum_buf();
+  uint8_t const* desc_report = usbh_get_enum_buf(dev_addr);
   uint16_t const desc_len    = request->wLength;
 
   config_driver_mount_complete(dev_addr, instance, desc_report, desc_len);
@@ -442,6 +618,11 @@ static void config_driver_mount_complete(uint8_t dev_addr, uint8_t instance, uin
 {
   hidh_interface_t* hid_itf = get_instance(dev_addr, instance);
 
+#if CFG_TUH_HID_FIELD_MAX
+  // compile report descriptor while it is still available, fields is empty if failed
+  hid_itf->field_count = desc_report ? tuh_hid_report_compile(hid_itf->fields, CFG_TUH_HID_FIELD_MAX, desc_report, desc_len) : 0;
+#endif
+
   // enumeration is complete
   tuh_hid_mount_cb(dev_addr, instance, desc_report, desc_len);
 
@@ -487,7 +668,8 @@ uint8_t tuh_hid_parse_report_descriptor(tuh_hid_report_info_t* report_info_arr,
     uint8_t const type = header.type;
     uint8_t const size = header.size;
 
-    uint8_t const data8 = desc_report[0];
+    // item without data may be the last byte of descriptor
+    uint8_t const data8 = size ? desc_report[0] : 0;
 
     TU_LOG(3, "tag = %d, type = %d, size = %d, data = ", tag, type, size);
     for(uint32_t i=0; i<size; i++) TU_LOG(3, "%02X ", desc_report[i]);
@@ -591,6 +773,423 @@ uint8_t tuh_hid_parse_report_descriptor(tuh_hid_report_info_t* report_info_arr,
   return report_num;
 }
 
+//--------------------------------------------------------------------+
+// Report Descriptor Compiler
+// Descriptor is parsed once into a flat field table, decoding a report is then
+// a single pass over the table without interpreting any item.
+//--------------------------------------------------------------------+
+
+enum
+{
+  RC_STACK_DEPTH  = 4,  // push/pop
+  RC_USAGE_MAX    = 16, // local usages of a main item
+  RC_REPORT_ID_MAX = 16 // distinct report IDs
+};
+
+typedef struct
+{
+  uint16_t usage_page;
+  uint8_t  report_id;
+  uint8_t  report_size;
+  uint16_t report_count;
+  int32_t  logical_min;
+  int32_t  logical_max;
+  uint32_t logical_max_unsigned;
+} rc_global_t;
+
+typedef struct
+{
+  uint32_t usages[RC_USAGE_MAX]; // extended usage: page << 16 | id
+  uint8_t  usage_count;
+  bool     has_range;
+  uint32_t usage_min;
+  uint32_t usage_max;
+} rc_local_t;
+
+static uint32_t rc_item_data(uint8_t const* data, uint8_t size)
+{
+  uint32_t value = 0;
+  for(uint8_t i=0; i<size; i++) value |= ((uint32_t) data[i]) << (8*i);
+  return value;
+}
+
+static int32_t rc_item_data_signed(uint8_t const* data, uint8_t size)
+{
+  uint32_t const value = rc_item_data(data, size);
+  switch (size)
+  {
+    case 1 : return (int8_t)  value;
+    case 2 : return (int16_t) value;
+    default: return (int32_t) value;
+  }
+}
+
+// Usage of i-th value of a main item, usage list comes first then usage range
+static uint32_t rc_local_usage(rc_local_t const* local, uint16_t i)
+{
+  if ( i < local->usage_count ) return local->usages[i];
+
+  if ( local->has_range )
+  {
+    uint32_t const usage = local->usage_min + (uint32_t) (i - local->usage_count);
+    return tu_min32(usage, local->usage_max);
+  }
+
+  return local->usage_count ? local->usages[local->usage_count-1] : 0;
+}
+
+// Extend local usage with current usage page unless it is already an extended usage (4 bytes)
+static uint32_t rc_extended_usage(rc_global_t const* global, uint8_t const* data, uint8_t size)
+{
+  uint32_t const usage = rc_item_data(data, size);
+  return (size == 4) ? usage : ((((uint32_t) global->usage_page) << 16) | usage);
+}
+
+static tuh_hid_field_t* rc_new_field(tuh_hid_field_t* fields, uint16_t max_fields, uint16_t* field_count,
+                                     rc_global_t const* global, uint8_t report_type, uint8_t flags, uint16_t bit_offset)
+{
+  TU_VERIFY(*field_count < max_fields, NULL);
+
+  tuh_hid_field_t* field = &fields[(*field_count)++];
+
+  field->bit_offset  = bit_offset;
+  field->value_index = 0;
+  field->bit_size    = global->report_size;
+  field->count       = 0;
+  field->report_id   = global->report_id;
+  field->report_type = report_type;
+  field->flags       = flags;
+  field->logical_min = global->logical_min;
+
+  // logical maximum is unsigned when minimum is not negative e.g 0 .. 255 encoded as 1 byte 0xFF
+  field->logical_max = (global->logical_min >= 0 && global->logical_max < global->logical_min) ?
+                       (int32_t) global->logical_max_unsigned : global->logical_max;
+  field->is_signed   = (uint8_t) (global->logical_min < 0);
+
+  return field;
+}
+
+static bool rc_main_item(tuh_hid_field_t* fields, uint16_t max_fields, uint16_t* field_count, uint16_t* value_count,
+                         rc_global_t const* global, rc_local_t const* local, uint8_t report_type, uint8_t flags, uint16_t* bit_offset)
+{
+  uint16_t const count = global->report_count;
+  uint8_t  const size  = global->report_size;
+  uint32_t const total_bits = ((uint32_t) size) * count;
+
+  TU_VERIFY(*bit_offset + total_bits <= UINT16_MAX);
+
+  // Constant (padding) and too large value only take space in the report
+  if ( count && size && size <= 32 && !(flags & HID_CONSTANT) )
+  {
+    bool const is_input = (report_type == HID_REPORT_TYPE_INPUT);
+    uint16_t const first_field = *field_count;
+
+    if ( flags & HID_VARIABLE )
+    {
+      // consecutive usages of the same page are merged into one field
+      for(uint16_t i=0; i<count; i++)
+      {
+        uint32_t const usage = rc_local_usage(local, i);
+        tuh_hid_field_t* field = (*field_count > first_field) ? &fields[*field_count-1] : NULL;
+
+        if ( !(field && field->count < UINT8_MAX && field->usage_page == (usage >> 16) &&
+               ((uint32_t) field->usage) + field->count == (usage & 0xFFFFu)) )
+        {
+          field = rc_new_field(fields, max_fields, field_count, global, report_type, flags, (uint16_t) (*bit_offset + i*size));
+          TU_VERIFY(field);
+
+          field->usage_page  = (uint16_t) (usage >> 16);
+          field->usage       = (uint16_t) usage;
+          field->value_index = *value_count;
+        }
+
+        field->count++;
+        if ( is_input ) (*value_count)++;
+      }
+    }
+    else
+    {
+      // array: each value is an index into usage range, split by 255 values per field
+      uint32_t const usage = local->has_range ? local->usage_min : rc_local_usage(local, 0);
+
+      for(uint16_t i=0; i<count; i += UINT8_MAX)
+      {
+        tuh_hid_field_t* field = rc_new_field(fields, max_fields, field_count, global, report_type, flags, (uint16_t) (*bit_offset + i*size));
+        TU_VERIFY(field);
+
+        field->usage_page  = (uint16_t) (usage >> 16);
+        field->usage       = (uint16_t) usage;
+        field->count       = (uint8_t) tu_min16((uint16_t) (count - i), UINT8_MAX);
+        field->value_index = *value_count;
+
+        if ( is_input ) (*value_count) = (uint16_t) (*value_count + field->count);
+      }
+    }
+  }
+
+  *bit_offset = (uint16_t) (*bit_offset + total_bits);
+
+  return true;
+}
+
+uint16_t tuh_hid_report_compile(tuh_hid_field_t* fields, uint16_t max_fields, uint8_t const* desc_report, uint16_t desc_len)
+{
+  TU_VERIFY(fields && desc_report, 0);
+
+  rc_global_t global = { 0 };
+  rc_global_t stack[RC_STACK_DEPTH];
+  uint8_t stack_count = 0;
+
+  rc_local_t local = { 0 };
+
+  // bit offset of each report type (Input, Output, Feature) per report ID
+  uint8_t  report_ids[RC_REPORT_ID_MAX];
+  uint16_t report_offsets[RC_REPORT_ID_MAX][3];
+  uint8_t  report_id_count = 0;
+
+  uint16_t field_count = 0;
+  uint16_t value_count = 0;
+
+  while ( desc_len )
+  {
+    uint8_t const header = *desc_report++;
+    desc_len--;
+
+    // long item: skip data
+    if ( header == 0xFE )
+    {
+      TU_VERIFY(desc_len >= 2, 0);
+      uint16_t const skip = (uint16_t) (2 + desc_report[0]);
+      TU_VERIFY(desc_len >= skip, 0);
+
+      desc_report += skip;
+      desc_len     = (uint16_t) (desc_len - skip);
+      continue;
+    }
+
+    // Report Item 6.2.2.2 USB HID 1.11, size code 3 is 4 bytes
+    uint8_t const size = (uint8_t) ((header & 0x03) == 3 ? 4 : (header & 0x03));
+    uint8_t const type = (header >> 2) & 0x03;
+    uint8_t const tag  = (header >> 4);
+
+    TU_VERIFY(desc_len >= size, 0);
+
+    switch ( type )
+    {
+      case RI_TYPE_MAIN:
+      {
+        uint8_t report_type = 0;
+        switch ( tag )
+        {
+          case RI_MAIN_INPUT  : report_type = HID_REPORT_TYPE_INPUT  ; break;
+          case RI_MAIN_OUTPUT : report_type = HID_REPORT_TYPE_OUTPUT ; break;
+          case RI_MAIN_FEATURE: report_type = HID_REPORT_TYPE_FEATURE; break;
+          default: break;
+        }
+
+        if ( report_type )
+        {
+          uint8_t idx;
+          for(idx=0; idx<report_id_count; idx++)
+          {
+            if ( report_ids[idx] == global.report_id ) break;
+          }
+
+          if ( idx == report_id_count )
+          {
+            TU_VERIFY(report_id_count < RC_REPORT_ID_MAX, 0);
+            report_ids[idx] = global.report_id;
+            tu_memclr(report_offsets[idx], sizeof(report_offsets[idx]));
+            report_id_count++;
+          }
+
+          uint8_t const flags = (uint8_t) rc_item_data(desc_report, size);
+          TU_VERIFY(rc_main_item(fields, max_fields, &field_count, &value_count, &global, &local,
+                                 report_type, flags, &report_offsets[idx][report_type-1]), 0);
+        }
+
+        // local items only apply to the next main item
+        tu_memclr(&local, sizeof(local));
+      }
+      break;
+
+      case RI_TYPE_GLOBAL:
+        switch ( tag )
+        {
+          case RI_GLOBAL_USAGE_PAGE  : global.usage_page   = (uint16_t) rc_item_data(desc_report, size); break;
+          case RI_GLOBAL_REPORT_SIZE : global.report_size  = (uint8_t)  rc_item_data(desc_report, size); break;
+          case RI_GLOBAL_REPORT_COUNT: global.report_count = (uint16_t) rc_item_data(desc_report, size); break;
+
+          case RI_GLOBAL_REPORT_ID:
+            global.report_id = (uint8_t) rc_item_data(desc_report, size);
+            TU_VERIFY(global.report_id, 0);
+          break;
+
+          case RI_GLOBAL_LOGICAL_MIN:
+            global.logical_min = rc_item_data_signed(desc_report, size);
+          break;
+
+          case RI_GLOBAL_LOGICAL_MAX:
+            global.logical_max          = rc_item_data_signed(desc_report, size);
+            global.logical_max_unsigned = rc_item_data(desc_report, size);
+          break;
+
+          case RI_GLOBAL_PUSH:
+            TU_VERIFY(stack_count < RC_STACK_DEPTH, 0);
+            stack[stack_count++] = global;
+          break;
+
+          case RI_GLOBAL_POP:
+            TU_VERIFY(stack_count, 0);
+            global = stack[--stack_count];
+          break;
+
+          default: break;
+        }
+      break;
+
+      case RI_TYPE_LOCAL:
+        switch ( tag )
+        {
+          case RI_LOCAL_USAGE:
+            if ( local.usage_count < RC_USAGE_MAX ) local.usages[local.usage_count++] = rc_extended_usage(&global, desc_report, size);
+          break;
+
+          case RI_LOCAL_USAGE_MIN:
+            local.usage_min = rc_extended_usage(&global, desc_report, size);
+            local.has_range = true;
+          break;
+
+          case RI_LOCAL_USAGE_MAX:
+            local.usage_max = rc_extended_usage(&global, desc_report, size);
+            local.has_range = true;
+          break;
+
+          default: break;
+        }
+      break;
+
+      // reserved
+      default: break;
+    }
+
+    desc_report += size;
+    desc_len     = (uint16_t) (desc_len - size);
+  }
+
+  TU_LOG2("HID report compiled: %u fields, %u input values\r\n", field_count, value_count);
+
+  return field_count;
+}
+
+uint16_t tuh_hid_report_value_count(tuh_hid_field_t const* fields, uint16_t field_count)
+{
+  uint16_t count = 0;
+  for(uint16_t i=0; i<field_count; i++)
+  {
+    if ( fields[i].report_type == HID_REPORT_TYPE_INPUT ) count = (uint16_t) (fields[i].value_index + fields[i].count);
+  }
+  return count;
+}
+
+bool tuh_hid_report_find_value(tuh_hid_field_t const* fields, uint16_t field_count, uint16_t usage_page, uint16_t usage, uint16_t* value_index)
+{
+  for(uint16_t i=0; i<field_count; i++)
+  {
+    tuh_hid_field_t const* field = &fields[i];
+
+    if ( field->report_type == HID_REPORT_TYPE_INPUT && (field->flags & HID_VARIABLE) &&
+         field->usage_page == usage_page && usage >= field->usage && usage < field->usage + field->count )
+    {
+      *value_index = (uint16_t) (field->value_index + usage - field->usage);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Get value of bit_size (1-32) bits at bit offset, spanning up to 5 bytes
+TU_ATTR_ALWAYS_INLINE static inline uint32_t rc_get_bits(uint8_t const* report, uint32_t bit_offset, uint8_t bit_size)
+{
+  uint8_t const* p = report + (bit_offset >> 3);
+  uint8_t const shift = (uint8_t) (bit_offset & 7);
+  uint8_t const nbytes = (uint8_t) ((shift + bit_size + 7) >> 3);
+
+  uint64_t raw = 0;
+  for(uint8_t i=0; i<nbytes; i++) raw |= ((uint64_t) p[i]) << (8*i);
+  raw >>= shift;
+
+  return (bit_size == 32) ? (uint32_t) raw : ((uint32_t) raw) & (uint32_t) (TU_BIT(bit_size) - 1);
+}
+
+uint16_t tuh_hid_report_decode(tuh_hid_field_t const* fields, uint16_t field_count, uint8_t const* report, uint16_t len, int32_t* values)
+{
+  TU_VERIFY(field_count && len, 0);
+
+  // if report ID is used, all reports have it
+  uint8_t report_id = 0;
+  if ( fields[0].report_id )
+  {
+    report_id = *report++;
+    len--;
+  }
+
+  uint32_t const len_bits = 8ul*len;
+  uint16_t decoded = 0;
+
+  for(uint16_t i=0; i<field_count; i++)
+  {
+    tuh_hid_field_t const* field = &fields[i];
+    if ( field->report_type != HID_REPORT_TYPE_INPUT || field->report_id != report_id ) continue;
+
+    uint32_t bit_offset = field->bit_offset;
+    uint8_t const bit_size = field->bit_size;
+
+    // skip field not included in (short) report
+    if ( bit_offset + ((uint32_t) bit_size)*field->count > len_bits ) continue;
+
+    int32_t* value = values + field->value_index;
+
+    if ( bit_size == 8 && !(bit_offset & 7) )
+    {
+      // byte aligned fast path
+      uint8_t const* p = report + (bit_offset >> 3);
+      for(uint8_t n=0; n<field->count; n++) value[n] = field->is_signed ? (int8_t) p[n] : p[n];
+    }
+    else
+    {
+      uint32_t const sign = (field->is_signed && bit_size < 32) ? (1ul << (bit_size-1)) : 0;
+
+      for(uint8_t n=0; n<field->count; n++)
+      {
+        uint32_t const raw = rc_get_bits(report, bit_offset, bit_size);
+        value[n] = sign ? (int32_t) ((raw ^ sign) - sign) : (int32_t) raw;
+        bit_offset += bit_size;
+      }
+    }
+
+    decoded = (uint16_t) (decoded + field->count);
+  }
+
+  return decoded;
+}
+
+#if CFG_TUH_HID_FIELD_MAX
+tuh_hid_field_t const* tuh_hid_get_fields(uint8_t dev_addr, uint8_t instance, uint16_t* field_count)
+{
+  hidh_interface_t* hid_itf = get_instance(dev_addr, instance);
+  if ( field_count ) *field_count = hid_itf->field_count;
+  return hid_itf->fields;
+}
+
+uint16_t tuh_hid_decode_report(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len, int32_t* values)
+{
+  hidh_interface_t* hid_itf = get_instance(dev_addr, instance);
+  return tuh_hid_report_decode(hid_itf->fields, hid_itf->field_count, report, len, values);
+}
+#endif
+
 //--------------------------------------------------------------------+
 // Helper
 //--------------------------------------------------------------------+
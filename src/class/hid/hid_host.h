@@ -46,6 +46,19 @@
 #define CFG_TUH_HID_EPOUT_BUFSIZE 64
 #endif
 
+// Number of reports queued per instance when interrupt endpoint is polled automatically
+// (tuh_hid_receive_auto). Must be power of 2, 0 to disable automatic polling.
+#ifndef CFG_TUH_HID_REPORT_QUEUE_SZ
+#define CFG_TUH_HID_REPORT_QUEUE_SZ 0
+#endif
+
+TU_VERIFY_STATIC((CFG_TUH_HID_REPORT_QUEUE_SZ & (CFG_TUH_HID_REPORT_QUEUE_SZ-1)) == 0, "CFG_TUH_HID_REPORT_QUEUE_SZ must be power of 2");
+
+// Max number of fields of report descriptor compiled on mount per instance, 0 to disable.
+// Report descriptor can also be compiled by application with tuh_hid_report_compile()
+#ifndef CFG_TUH_HID_FIELD_MAX
+#define CFG_TUH_HID_FIELD_MAX 0
+#endif
 
 typedef struct
 {
@@ -58,6 +71,33 @@ typedef struct
 //  uint8_t out_len;     // length of OUT report
 } tuh_hid_report_info_t;
 
+// Field of a report compiled from report descriptor: part of a main item (Input, Output or Feature)
+// with count values of bit_size bits each.
+// - Variable: value i has usage (usage + i)
+// - Array   : value is a usage index, selected usage is (usage + value - logical_min)
+typedef struct
+{
+  uint16_t bit_offset;    // offset in report, excluding report ID
+  uint16_t value_index;   // index of first value in array decoded by tuh_hid_report_decode(), Input only
+  uint16_t usage_page;
+  uint16_t usage;         // usage of first value, or usage minimum of array
+  uint8_t  bit_size;      // 1 to 32
+  uint8_t  count;
+  uint8_t  report_id;     // 0 if report ID is not used
+  uint8_t  report_type;   // hid_report_type_t
+  uint8_t  flags;         // data of main item e.g HID_VARIABLE, HID_RELATIVE
+  uint8_t  is_signed;     // logical minimum is negative, value is sign extended
+  int32_t  logical_min;
+  int32_t  logical_max;
+} tuh_hid_field_t;
+
+// Report received on interrupt endpoint, used by report queue
+typedef struct
+{
+  uint16_t len;
+  uint8_t  data[CFG_TUH_HID_EPIN_BUFSIZE];
+} tuh_hid_report_t;
+
 //--------------------------------------------------------------------+
 // Interface API
 //--------------------------------------------------------------------+
@@ -75,6 +115,28 @@ uint8_t tuh_hid_interface_protocol(uint8_t dev_addr, uint8_t instance);
 // For complicated report, application should write its own parser.
 uint8_t tuh_hid_parse_report_descriptor(tuh_hid_report_info_t* reports_info_arr, uint8_t arr_count, uint8_t const* desc_report, uint16_t desc_len) TU_ATTR_UNUSED;
 
+// Compile report descriptor into field table, parsing is done once so that reports can be decoded quickly.
+// Return number of fields, 0 if descriptor is malformed or table is too small.
+uint16_t tuh_hid_report_compile(tuh_hid_field_t* fields, uint16_t max_fields, uint8_t const* desc_report, uint16_t desc_len);
+
+// Get number of values of all Input fields, i.e size of value array for tuh_hid_report_decode()
+uint16_t tuh_hid_report_value_count(tuh_hid_field_t const* fields, uint16_t field_count);
+
+// Find value index of an Input usage, return false if not found
+bool tuh_hid_report_find_value(tuh_hid_field_t const* fields, uint16_t field_count, uint16_t usage_page, uint16_t usage, uint16_t* value_index);
+
+// Decode all Input fields of a report (including report ID if used) into values[value_index] in one pass.
+// Values of other report IDs are left untouched. Return number of decoded values.
+uint16_t tuh_hid_report_decode(tuh_hid_field_t const* fields, uint16_t field_count, uint8_t const* report, uint16_t len, int32_t* values);
+
+#if CFG_TUH_HID_FIELD_MAX
+// Get fields compiled from report descriptor on mount
+tuh_hid_field_t const* tuh_hid_get_fields(uint8_t dev_addr, uint8_t instance, uint16_t* field_count);
+
+// Decode report received from instance, see tuh_hid_report_decode()
+uint16_t tuh_hid_decode_report(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len, int32_t* values);
+#endif
+
 //--------------------------------------------------------------------+
 // Control Endpoint API
 //--------------------------------------------------------------------+
@@ -108,6 +170,22 @@ bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t instance);
 // If report_id > 0 (composite), it will be sent as 1st byte, then report contents. Otherwise only report content is sent.
 //void tuh_hid_send_report(uint8_t dev_addr, uint8_t instance, uint8_t report_id, uint8_t const* report, uint16_t len);
 
+#if CFG_TUH_HID_REPORT_QUEUE_SZ
+// Enable/Disable automatic polling: interrupt endpoint is re-armed as soon as a report is received,
+// i.e it is polled every bInterval. Reports are queued and read with tuh_hid_report_read() instead of
+// tuh_hid_report_received_cb(). Report received while the queue is full is dropped and counted as overrun.
+bool tuh_hid_receive_auto(uint8_t dev_addr, uint8_t instance, bool enabled);
+
+// Get number of queued reports
+uint16_t tuh_hid_report_available(uint8_t dev_addr, uint8_t instance);
+
+// Read up to count queued reports (oldest first), return number of reports read
+uint16_t tuh_hid_report_read(uint8_t dev_addr, uint8_t instance, tuh_hid_report_t* reports, uint16_t count);
+
+// Get number of reports dropped because queue is full since instance is mounted
+uint32_t tuh_hid_report_overrun(uint8_t dev_addr, uint8_t instance);
+#endif
+
 //--------------------------------------------------------------------+
 // Callbacks (Weak is optional)
 //--------------------------------------------------------------------+
@@ -126,6 +204,9 @@ TU_ATTR_WEAK void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance);
 // Note: if there is report ID (composite), it is 1st byte of report
 void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
 
+// Invoked when report is queued by automatic polling
+TU_ATTR_WEAK void tuh_hid_report_queued_cb(uint8_t dev_addr, uint8_t instance, uint16_t count);
+
 // Invoked when sent report to device successfully via interrupt endpoint
 TU_ATTR_WEAK void tuh_hid_report_sent_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
 
@@ -34,20 +34,9 @@
 #include "midi_host.h"
 
 
-//extern "C" {
-
-
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF
 //--------------------------------------------------------------------+
-#ifndef CFG_TUH_MAX_CABLES
-  #define CFG_TUH_MAX_CABLES 16
-#endif
-#define CFG_TUH_MIDI_RX_BUFSIZE 64
-#define CFG_TUH_MIDI_TX_BUFSIZE 64
-#ifndef CFG_TUH_MIDI_EP_BUFSIZE
-  #define CFG_TUH_MIDI_EP_BUFSIZE 64
-#endif
 
 // TODO: refactor to share code with the MIDI Device driver
 typedef struct
@@ -64,23 +53,25 @@ typedef struct
 
   uint8_t ep_in;          // IN endpoint address
   uint8_t ep_out;         // OUT endpoint address
-  uint16_t ep_in_max;     // min( CFG_TUH_MIDI_RX_BUFSIZE, wMaxPacketSize of the IN endpoint)
-  uint16_t ep_out_max;    //  min( CFG_TUH_MIDI_TX_BUFSIZE, wMaxPacketSize of the OUT endpoint)
+  uint16_t ep_in_max;     // min( CFG_TUH_MIDI_EP_BUFSIZE, wMaxPacketSize of the IN endpoint)
+  uint16_t ep_out_max;    // min( CFG_TUH_MIDI_EP_BUFSIZE, wMaxPacketSize of the OUT endpoint)
 
   uint8_t num_cables_rx;  // IN endpoint CS descriptor bNumEmbMIDIJack value
   uint8_t num_cables_tx;  // OUT endpoint CS descriptor bNumEmbMIDIJack value
 
+  bool configured;
+
   // For Stream read()/write() API
-  // Messages are always 4 bytes long, queue them for reading and writing so the
-  // callers can use the Stream interface with single-byte read/write calls.
-  midi_stream_t stream_write;
-  midi_stream_t stream_read;
+  // Messages are packed into 4-byte packets separately for each cable so that
+  // streams written to different cables can be interleaved.
+  midi_stream_t stream_write[CFG_TUH_MAX_CABLES];
+  uint8_t stream_read[4];
+  uint16_t cable_sysex_in_progress; // bit i is set if received MIDI_STATUS_SYSEX_START but not MIDI_STATUS_SYSEX_END
 
   //------------- From this point, data is not cleared by bus reset -------------
-  // Endpoint FIFOs
+  // FIFOs of 4-byte event packets
   tu_fifo_t rx_ff;
   tu_fifo_t tx_ff;
- 
 
   uint8_t rx_ff_buf[CFG_TUH_MIDI_RX_BUFSIZE];
   uint8_t tx_ff_buf[CFG_TUH_MIDI_TX_BUFSIZE];
@@ -93,20 +84,33 @@ typedef struct
   // Endpoint Transfer buffer
   CFG_TUSB_MEM_ALIGN uint8_t epout_buf[CFG_TUH_MIDI_EP_BUFSIZE];
   CFG_TUSB_MEM_ALIGN uint8_t epin_buf[CFG_TUH_MIDI_EP_BUFSIZE];
-
-  bool configured;
 }midih_interface_t;
 
-static midih_interface_t _midi_host[CFG_TUH_DEVICE_MAX];
+#define ITF_MEM_RESET_SIZE   offsetof(midih_interface_t, rx_ff)
+
+static midih_interface_t _midi_host[CFG_TUH_MIDI];
 
 static midih_interface_t *get_midi_host(uint8_t dev_addr)
 {
-  TU_ASSERT(dev_addr >0 && dev_addr <= CFG_TUH_DEVICE_MAX);
-  return (_midi_host + dev_addr - 1);
+  for(uint8_t i=0; i<CFG_TUH_MIDI; i++)
+  {
+    if ( dev_addr && _midi_host[i].dev_addr == dev_addr ) return &_midi_host[i];
+  }
+  return NULL;
+}
+
+static midih_interface_t *find_new_midi_host(void)
+{
+  for(uint8_t i=0; i<CFG_TUH_MIDI; i++)
+  {
+    if ( _midi_host[i].dev_addr == 0 ) return &_midi_host[i];
+  }
+  return NULL;
 }
 
 //------------- Internal prototypes -------------//
 static uint32_t write_flush(uint8_t dev_addr, midih_interface_t* midi);
+static bool rx_arm(midih_interface_t* midi);
 
 //--------------------------------------------------------------------+
 // USBH API
@@ -116,11 +120,11 @@ void midih_init(void)
   tu_memclr(&_midi_host, sizeof(_midi_host));
 
   // config fifos
-  for (int inst = 0; inst < CFG_TUH_DEVICE_MAX; inst++)
+  for (int inst = 0; inst < CFG_TUH_MIDI; inst++)
   {
     midih_interface_t *p_midi_host = &_midi_host[inst];
-    tu_fifo_config(&p_midi_host->rx_ff, p_midi_host->rx_ff_buf, CFG_TUH_MIDI_RX_BUFSIZE, 1, false); // true, true
-    tu_fifo_config(&p_midi_host->tx_ff, p_midi_host->tx_ff_buf, CFG_TUH_MIDI_TX_BUFSIZE, 1, false); // OBVS.
+    tu_fifo_config(&p_midi_host->rx_ff, p_midi_host->rx_ff_buf, CFG_TUH_MIDI_RX_BUFSIZE/4, 4, false);
+    tu_fifo_config(&p_midi_host->tx_ff, p_midi_host->tx_ff_buf, CFG_TUH_MIDI_TX_BUFSIZE/4, 4, false);
 
   #if CFG_FIFO_MUTEX
     tu_fifo_config_mutex(&p_midi_host->rx_ff, NULL, osal_mutex_create(&p_midi_host->rx_ff_mutex));
@@ -132,54 +136,56 @@ void midih_init(void)
 bool midih_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
 {
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
+  TU_VERIFY(p_midi_host);
+
   if ( ep_addr == p_midi_host->ep_in)
   {
-    if (0 == xferred_bytes)
-    {
-      return true; // No data to handle
-    }
+    // stop polling on error e.g stalled
+    TU_VERIFY(result == XFER_RESULT_SUCCESS);
 
-    // receive new data if available
+    // put in the RX FIFO only non-zero MIDI IN 4-byte packets
     uint32_t packets_queued = 0;
-    if (xferred_bytes)
+    uint8_t const* buf = p_midi_host->epin_buf;
+    uint32_t const npackets = xferred_bytes / 4;
+
+    for (uint32_t packet_num = 0; packet_num < npackets; packet_num++)
     {
-      // put in the RX FIFO only non-zero MIDI IN 4-byte packets
-      uint8_t* buf = p_midi_host->epin_buf;
-      uint32_t npackets = xferred_bytes / 4;
-      uint32_t packet_num;
-      for (packet_num = 0; packet_num < npackets; packet_num++)
+      // some devices send back all zero packets even if there is no data ready
+      if ( buf[0] || buf[1] || buf[2] || buf[3] )
       {
-        // some devices send back all zero packets even if there is no data ready
-        uint32_t packet = (uint32_t)((*buf)<<24) | ((uint32_t)(*(buf+1))<<16) | ((uint32_t)(*(buf+2))<<8) | ((uint32_t)(*(buf+3)));
-        if (packet != 0)
-        {
-          tu_fifo_write_n(&p_midi_host->rx_ff, buf, 4);
-          ++packets_queued;
-          TU_LOG3("MIDI RX=%08x\r\n", packet);
-        }
-        buf += 4;
+        tu_fifo_write(&p_midi_host->rx_ff, buf);
+        ++packets_queued;
+        TU_LOG3("MIDI RX=%02x %02x %02x %02x\r\n", buf[0], buf[1], buf[2], buf[3]);
       }
+      buf += 4;
     }
+
     // invoke receive callback if available
-    if (tuh_midi_rx_cb)
+    if (packets_queued && tuh_midi_rx_cb)
     {
       tuh_midi_rx_cb(dev_addr, packets_queued);
     }
+
+    // keep polling if there is room, otherwise it is re-armed when application reads
+    rx_arm(p_midi_host);
   }
   else if ( ep_addr == p_midi_host->ep_out )
   {
-    if (0 == write_flush(dev_addr, p_midi_host))
+    if ( tu_fifo_count(&p_midi_host->tx_ff) )
+    {
+      // packets written while the transfer was in progress
+      write_flush(dev_addr, p_midi_host);
+    }
+    else if ( xferred_bytes && (0 == (xferred_bytes % p_midi_host->ep_out_max)) )
     {
       // If there is no data left, a ZLP should be sent if
       // xferred_bytes is multiple of EP size and not zero
-      if ( !tu_fifo_count(&p_midi_host->tx_ff) && xferred_bytes && (0 == (xferred_bytes % p_midi_host->ep_out_max)) )
+      if ( usbh_edpt_claim(dev_addr, p_midi_host->ep_out) )
       {
-        if ( usbh_edpt_claim(dev_addr, p_midi_host->ep_out) )
-        {
-          TU_ASSERT(usbh_edpt_xfer(dev_addr, p_midi_host->ep_out, XFER_RESULT_SUCCESS, 0));
-        }
+        TU_ASSERT(usbh_edpt_xfer(dev_addr, p_midi_host->ep_out, NULL, 0));
       }
     }
+
     if (tuh_midi_tx_cb)
     {
       tuh_midi_tx_cb(dev_addr);
@@ -192,21 +198,14 @@ bool midih_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint
 void midih_close(uint8_t dev_addr)
 {
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
+  if ( p_midi_host == NULL ) return;
+
   if (tuh_midi_umount_cb)
     tuh_midi_umount_cb(dev_addr, 0);
+
   tu_fifo_clear(&p_midi_host->rx_ff);
   tu_fifo_clear(&p_midi_host->tx_ff);
-  p_midi_host->ep_in = 0;
-  p_midi_host->ep_in_max = 0;
-  p_midi_host->ep_out = 0;
-  p_midi_host->ep_out_max = 0;
-  p_midi_host->itf_num = 0;
-  p_midi_host->num_cables_rx = 0;
-  p_midi_host->num_cables_tx = 0;
-  p_midi_host->dev_addr = 255; // invalid
-  p_midi_host->configured = false;
-  tu_memclr(&p_midi_host->stream_read, sizeof(p_midi_host->stream_read));
-  tu_memclr(&p_midi_host->stream_write, sizeof(p_midi_host->stream_write));
+  tu_memclr(p_midi_host, ITF_MEM_RESET_SIZE);
 }
 
 //--------------------------------------------------------------------+
@@ -215,8 +214,12 @@ void midih_close(uint8_t dev_addr)
 bool midih_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len)
 {
   (void) rhport;
-  midih_interface_t *p_midi_host = get_midi_host(dev_addr);
   TU_VERIFY(TUSB_CLASS_AUDIO == desc_itf->bInterfaceClass);
+
+  midih_interface_t *p_midi_host = find_new_midi_host();
+  TU_VERIFY(p_midi_host);
+  tu_memclr(p_midi_host, ITF_MEM_RESET_SIZE);
+
   // There can be just a MIDI interface or an audio and a MIDI interface. Only open the MIDI interface
   uint8_t const *p_desc = (uint8_t const *) desc_itf;
   uint16_t len_parsed = 0;
@@ -361,7 +364,7 @@ bool midih_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *d
     // callback is fired. Aborting the NAK'd transfer to allow other transfers 
     // to happen on the one shared epx endpoint is needed to allow these devices 
     // to finish mounting and be in a usable state after enumeration.
-    usbh_edpt_clear_in_on_nak(p_midi_host->dev_addr, p_midi_host->ep_in);
+    usbh_edpt_clear_in_on_nak(dev_addr, p_midi_host->ep_in);
   }
   if (out_desc)
   {
@@ -369,42 +372,70 @@ bool midih_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *d
   }
   p_midi_host->dev_addr = dev_addr;
 
-  if (tuh_midi_mount_cb)
-  {
-    tuh_midi_mount_cb(dev_addr, p_midi_host->ep_in, p_midi_host->ep_out, p_midi_host->num_cables_rx, p_midi_host->num_cables_tx);
-  }
   return true;
 }
 
 bool tuh_midi_configured(uint8_t dev_addr)
 {
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
-  return p_midi_host->configured;
+  return p_midi_host && p_midi_host->configured;
 }
 
 bool midih_set_config(uint8_t dev_addr, uint8_t itf_num)
 {
-  (void) itf_num;
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
-  p_midi_host->configured = true;
 
-  // TODO I don't think there are any special config things to do for MIDI
+  // set_config is also invoked for the Audio Control interface
+  if ( p_midi_host && itf_num == p_midi_host->itf_num )
+  {
+    p_midi_host->configured = true;
+
+    if (tuh_midi_mount_cb)
+    {
+      tuh_midi_mount_cb(dev_addr, p_midi_host->ep_in, p_midi_host->ep_out, p_midi_host->num_cables_rx, p_midi_host->num_cables_tx);
+    }
+
+    // start polling IN endpoint
+    rx_arm(p_midi_host);
+  }
+
+  // notify usbh that driver enumeration is complete
+  usbh_driver_set_config_complete(dev_addr, itf_num);
 
   return true;
 }
 
 //--------------------------------------------------------------------+
-// Stream API
+// Packet API
 //--------------------------------------------------------------------+
+
+// Queue IN transfer if there is room in RX FIFO for a full endpoint packet
+static bool rx_arm(midih_interface_t* midi)
+{
+  TU_VERIFY(midi->configured && midi->ep_in);
+  TU_VERIFY(4*tu_fifo_remaining(&midi->rx_ff) >= midi->ep_in_max);
+
+  // skip if transfer is already pending
+  TU_VERIFY(usbh_edpt_claim(midi->dev_addr, midi->ep_in));
+
+  if ( !usbh_edpt_xfer(midi->dev_addr, midi->ep_in, midi->epin_buf, midi->ep_in_max) )
+  {
+    usbh_edpt_release(midi->dev_addr, midi->ep_in);
+    return false;
+  }
+
+  return true;
+}
+
 static uint32_t write_flush(uint8_t dev_addr, midih_interface_t* midi)
 {
   // No data to send
   if ( !tu_fifo_count(&midi->tx_ff) ) return 0;
 
   // skip if previous transfer not complete
-  TU_VERIFY( usbh_edpt_claim(dev_addr, midi->ep_out) );
+  TU_VERIFY( usbh_edpt_claim(dev_addr, midi->ep_out), 0 );
 
-  uint16_t count = tu_fifo_read_n(&midi->tx_ff, midi->epout_buf, midi->ep_out_max);
+  uint16_t const count = (uint16_t) (4*tu_fifo_read_n(&midi->tx_ff, midi->epout_buf, midi->ep_out_max/4));
 
   if (count)
   {
@@ -418,58 +449,104 @@ static uint32_t write_flush(uint8_t dev_addr, midih_interface_t* midi)
   }
 }
 
+uint32_t tuh_midi_available(uint8_t dev_addr)
+{
+  midih_interface_t *p_midi_host = get_midi_host(dev_addr);
+  TU_VERIFY(p_midi_host, 0);
+  return tu_fifo_count(&p_midi_host->rx_ff);
+}
+
+uint32_t tuh_midi_write_available(uint8_t dev_addr)
+{
+  midih_interface_t *p_midi_host = get_midi_host(dev_addr);
+  TU_VERIFY(p_midi_host && p_midi_host->ep_out, 0);
+  return tu_fifo_remaining(&p_midi_host->tx_ff);
+}
+
 bool tuh_midi_read_poll( uint8_t dev_addr )
 {
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
-  // MIDI bulk endpoints are shared with the control endpoints. None can be busy before we start a transfer
-  bool control_edpt_not_busy = !usbh_edpt_busy(dev_addr,0) && !usbh_edpt_busy(dev_addr,0x80);
-  bool out_edpt_not_busy = true;
-  bool result = false;
-  if (p_midi_host->num_cables_tx > 0)
-    out_edpt_not_busy = !usbh_edpt_busy(p_midi_host->dev_addr, p_midi_host->ep_out);
-  if (control_edpt_not_busy && out_edpt_not_busy)
+  TU_VERIFY(p_midi_host);
+
+  if ( usbh_edpt_busy(dev_addr, p_midi_host->ep_in) )
   {
-    bool in_edpt_not_busy = !usbh_edpt_busy(dev_addr, p_midi_host->ep_in);
-    if (in_edpt_not_busy)
-    {
-      TU_LOG2("Requesting poll IN endpoint %d\r\n", p_midi_host->ep_in);
-      TU_ASSERT(usbh_edpt_xfer(p_midi_host->dev_addr, p_midi_host->ep_in, _midi_host->epin_buf, _midi_host->ep_in_max), 0);
-      result = true;
-    }
-    else
-    {
-      // Maybe the IN endpoint is only busy because the RP2040 host hardware
-      // is retrying a NAK'd IN transfer forever. Try aborting the NAK'd
-      // transfer to allow other transfers to happen on the one shared
-      // epx endpoint.
-      usbh_edpt_clear_in_on_nak(p_midi_host->dev_addr, p_midi_host->ep_in);
-    }
+    // Maybe the IN endpoint is only busy because the RP2040 host hardware
+    // is retrying a NAK'd IN transfer forever. Try aborting the NAK'd
+    // transfer to allow other transfers to happen on the one shared
+    // epx endpoint.
+    usbh_edpt_clear_in_on_nak(dev_addr, p_midi_host->ep_in);
+    return false;
   }
-  return result;
+
+  TU_LOG2("Requesting poll IN endpoint %d\r\n", p_midi_host->ep_in);
+  return rx_arm(p_midi_host);
+}
+
+uint32_t tuh_midi_packet_read_n(uint8_t dev_addr, uint8_t* packets, uint32_t max_packets)
+{
+  midih_interface_t *p_midi_host = get_midi_host(dev_addr);
+  TU_VERIFY(p_midi_host, 0);
+
+  uint32_t const count = tu_fifo_read_n(&p_midi_host->rx_ff, packets, (uint16_t) tu_min32(max_packets, UINT16_MAX));
+
+  // resume polling stopped by full FIFO
+  if ( count ) rx_arm(p_midi_host);
+
+  return count;
+}
+
+bool tuh_midi_packet_read(uint8_t dev_addr, uint8_t packet[4])
+{
+  return 1 == tuh_midi_packet_read_n(dev_addr, packet, 1);
+}
+
+uint32_t tuh_midi_packet_write_n(uint8_t dev_addr, uint8_t const* packets, uint32_t count)
+{
+  midih_interface_t *p_midi_host = get_midi_host(dev_addr);
+  TU_VERIFY(p_midi_host && p_midi_host->configured && p_midi_host->ep_out, 0);
+
+  uint32_t const written = tu_fifo_write_n(&p_midi_host->tx_ff, packets, (uint16_t) tu_min32(count, UINT16_MAX));
+
+  // skipped if previous transfer not complete, its completion sends the rest
+  if ( written ) write_flush(dev_addr, p_midi_host);
+
+  return written;
+}
+
+bool tuh_midi_packet_write(uint8_t dev_addr, uint8_t const packet[4])
+{
+  return 1 == tuh_midi_packet_write_n(dev_addr, packet, 1);
+}
+
+//--------------------------------------------------------------------+
+// Stream API
+//--------------------------------------------------------------------+
+// Queue event packet of a stream, cable number is added to the CIN
+static bool stream_queue_packet(midih_interface_t* midi, uint8_t cable_num, uint8_t const buffer[4])
+{
+  uint8_t const packet[4] = { (uint8_t) ((cable_num << 4) | (buffer[0] & 0x0f)), buffer[1], buffer[2], buffer[3] };
+  TU_LOG3_MEM(packet, 4, 2);
+  return tu_fifo_write(&midi->tx_ff, packet);
 }
 
 uint32_t tuh_midi_stream_write (uint8_t dev_addr, uint8_t cable_num, uint8_t const* buffer, uint32_t bufsize)
 {
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
-  TU_VERIFY(cable_num < p_midi_host->num_cables_tx);
-  midi_stream_t *stream = &p_midi_host->stream_write;
+  TU_VERIFY(p_midi_host && p_midi_host->configured, 0);
+  TU_VERIFY(cable_num < p_midi_host->num_cables_tx && cable_num < CFG_TUH_MAX_CABLES, 0);
+  midi_stream_t *stream = &p_midi_host->stream_write[cable_num];
 
   uint32_t i = 0;
-  while ( (i < bufsize) && (tu_fifo_remaining(&p_midi_host->tx_ff) >= 4) )
+  while ( (i < bufsize) && (tu_fifo_remaining(&p_midi_host->tx_ff) >= 1) )
   {
     uint8_t const data = buffer[i];
     i++;
     if (data >= MIDI_STATUS_SYSREAL_TIMING_CLOCK)
     {
       // real-time messages need to be sent right away
-      midi_stream_t streamrt;
-      streamrt.buffer[0] = MIDI_CIN_SYSEX_END_1BYTE;
-      streamrt.buffer[1] = data;
-      streamrt.index = 2;
-      streamrt.total = 2;
-      uint16_t const count = tu_fifo_write_n(&p_midi_host->tx_ff, streamrt.buffer, 4);
+      uint8_t const packet_rt[4] = { MIDI_CIN_SYSEX_END_1BYTE, data, 0, 0 };
       // FIFO overflown, since we already check fifo remaining. It is probably race condition
-      TU_ASSERT(count == 4, i);
+      TU_ASSERT(stream_queue_packet(p_midi_host, cable_num, packet_rt), i);
     }
     else if ( stream->index == 0 )
     {
@@ -496,13 +573,13 @@ uint32_t tuh_midi_stream_write (uint8_t dev_addr, uint8_t cable_num, uint8_t con
       else if ( (msg >= 0x8 && msg <= 0xB) || msg == 0xE )
       {
         // Channel Voice Messages
-        stream->buffer[0] = (cable_num << 4) | msg;
+        stream->buffer[0] = msg;
         stream->total = 4;
       }
       else if ( msg == 0xC || msg == 0xD)
       {
         // Channel Voice Messages, two-byte variants (Program Change and Channel Pressure)
-        stream->buffer[0] = (cable_num << 4) | msg;
+        stream->buffer[0] = msg;
         stream->total = 3;
       }
       else if ( msg == 0xf )
@@ -532,7 +609,7 @@ uint32_t tuh_midi_stream_write (uint8_t dev_addr, uint8_t cable_num, uint8_t con
       else
       {
         // Pack individual bytes if we don't support packing them into words.
-        stream->buffer[0] = cable_num << 4 | 0xf;
+        stream->buffer[0] = 0xf;
         stream->buffer[2] = 0;
         stream->buffer[3] = 0;
         stream->index = 2;
@@ -549,7 +626,7 @@ uint32_t tuh_midi_stream_write (uint8_t dev_addr, uint8_t cable_num, uint8_t con
       // See if this byte ends a SysEx.
       if ( stream->buffer[0] == MIDI_CIN_SYSEX_START && data == MIDI_STATUS_SYSEX_END )
       {
-        stream->buffer[0] = MIDI_CIN_SYSEX_START + (stream->index - 1);
+        stream->buffer[0] = (uint8_t) (MIDI_CIN_SYSEX_START + (stream->index - 1));
         stream->total = stream->index;
       }
     }
@@ -559,50 +636,46 @@ uint32_t tuh_midi_stream_write (uint8_t dev_addr, uint8_t cable_num, uint8_t con
     {
       // zeroes unused bytes
       for(uint8_t idx = stream->total; idx < 4; idx++) stream->buffer[idx] = 0;
-      TU_LOG3_MEM(stream->buffer, 4, 2);
 
-      uint16_t const count = tu_fifo_write_n(&p_midi_host->tx_ff, stream->buffer, 4);
+      bool const queued = stream_queue_packet(p_midi_host, cable_num, stream->buffer);
 
       // complete current event packet, reset stream
       stream->index = 0;
       stream->total = 0;
 
       // FIFO overflown, since we already check fifo remaining. It is probably race condition
-      TU_ASSERT(count == 4, i);
+      TU_ASSERT(queued, i);
     }
   }
+
+  // skipped if previous transfer not complete, its completion sends the rest
+  write_flush(dev_addr, p_midi_host);
+
   return i;
 }
 
 uint32_t tuh_midi_stream_flush( uint8_t dev_addr )
 {
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
-  bool control_edpt_not_busy = !usbh_edpt_busy(dev_addr,0) && !usbh_edpt_busy(dev_addr,0x80);
-  bool in_edpt_not_busy = true;
+  TU_VERIFY(p_midi_host && p_midi_host->configured && p_midi_host->ep_out, 0);
 
-  uint32_t bytes_flushed = 0;
-  if (p_midi_host->num_cables_rx > 0)
-    in_edpt_not_busy = !usbh_edpt_busy(dev_addr, p_midi_host->ep_in);
-  if (control_edpt_not_busy && in_edpt_not_busy && !usbh_edpt_busy(p_midi_host->dev_addr, p_midi_host->ep_out))
-  {
-    bytes_flushed = write_flush(dev_addr, p_midi_host);
-  }
-  return bytes_flushed;
+  return write_flush(dev_addr, p_midi_host);
 }
+
 //--------------------------------------------------------------------+
 // Helper
 //--------------------------------------------------------------------+
 uint8_t tuh_midih_get_num_tx_cables (uint8_t dev_addr)
 {
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
-  TU_VERIFY(p_midi_host->ep_out != 0); // returns 0 if fails
+  TU_VERIFY(p_midi_host && p_midi_host->ep_out != 0); // returns 0 if fails
   return p_midi_host->num_cables_tx;
 }
 
 uint8_t tuh_midih_get_num_rx_cables (uint8_t dev_addr)
 {
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
-  TU_VERIFY(p_midi_host->ep_in != 0); // returns 0 if fails
+  TU_VERIFY(p_midi_host && p_midi_host->ep_in != 0); // returns 0 if fails
   return p_midi_host->num_cables_rx;
 }
 
@@ -610,47 +683,51 @@ uint32_t tuh_midi_stream_read (uint8_t dev_addr, uint8_t *p_cable_num, uint8_t *
 {
   midih_interface_t *p_midi_host = get_midi_host(dev_addr);
   uint32_t bytes_buffered = 0;
+  TU_VERIFY(p_midi_host, 0);
   TU_ASSERT(p_cable_num);
   TU_ASSERT(p_buffer);
   TU_ASSERT(bufsize);
-  uint8_t one_byte;
-  if (!tu_fifo_peek(&p_midi_host->rx_ff, &one_byte))
+  uint8_t* packet = p_midi_host->stream_read;
+  if (!tu_fifo_peek(&p_midi_host->rx_ff, packet))
   {
     return 0;
   }
-  *p_cable_num = (one_byte >> 4) & 0xf;
-  uint32_t nread = tu_fifo_read_n(&p_midi_host->rx_ff, p_midi_host->stream_read.buffer, 4);
-  static uint16_t cable_sysex_in_progress; // bit i is set if received MIDI_STATUS_SYSEX_START but not MIDI_STATUS_SYSEX_END
-  while (nread == 4 && bytes_buffered < bufsize)
+  *p_cable_num = (packet[0] >> 4) & 0xf;
+
+  // a message is at most 3 bytes, stop before it may overflow the buffer
+  while (bytes_buffered + 3 <= bufsize && tu_fifo_peek(&p_midi_host->rx_ff, packet))
   {
-    *p_cable_num=(p_midi_host->stream_read.buffer[0] >> 4) & 0x0f;
+    // stop at packet of another cable
+    if ( ((packet[0] >> 4) & 0x0f) != *p_cable_num ) break;
+    tu_fifo_read(&p_midi_host->rx_ff, packet);
+
     uint8_t bytes_to_add_to_stream = 0;
     if (*p_cable_num < p_midi_host->num_cables_rx)
     {
       // ignore the CIN field; too many devices out there encode this wrong
-      uint8_t status = p_midi_host->stream_read.buffer[1];
-      uint16_t cable_mask = 1 << *p_cable_num;
+      uint8_t status = packet[1];
+      uint16_t cable_mask = (uint16_t) (1u << *p_cable_num);
       if (status <= MIDI_MAX_DATA_VAL || status == MIDI_STATUS_SYSEX_START)
       {
         if (status == MIDI_STATUS_SYSEX_START)
         {
-          cable_sysex_in_progress |= cable_mask;
+          p_midi_host->cable_sysex_in_progress |= cable_mask;
         }
         // only add the packet if a sysex message is in progress
-        if (cable_sysex_in_progress & cable_mask)
+        if (p_midi_host->cable_sysex_in_progress & cable_mask)
         {
           ++bytes_to_add_to_stream;
           uint8_t idx;
           for (idx = 2; idx < 4; idx++)
           {
-            if (p_midi_host->stream_read.buffer[idx] <= MIDI_MAX_DATA_VAL)
+            if (packet[idx] <= MIDI_MAX_DATA_VAL)
             {
               ++bytes_to_add_to_stream;
             }
-            else if (p_midi_host->stream_read.buffer[idx] == MIDI_STATUS_SYSEX_END)
+            else if (packet[idx] == MIDI_STATUS_SYSEX_END)
             {
               ++bytes_to_add_to_stream;
-              cable_sysex_in_progress &= ~cable_mask;
+              p_midi_host->cable_sysex_in_progress &= (uint16_t) ~cable_mask;
               idx = 4; // force the loop to exit; I hate break statements in loops
             }
           }
@@ -676,7 +753,7 @@ uint32_t tuh_midi_stream_read (uint8_t dev_addr, uint8_t *p_cable_num, uint8_t *
           default:
             break; // Should not get this
         }
-        cable_sysex_in_progress &= ~cable_mask;
+        p_midi_host->cable_sysex_in_progress &= (uint16_t) ~cable_mask;
       }
       else if (status < MIDI_STATUS_SYSREAL_TIMING_CLOCK)
       {
@@ -695,8 +772,9 @@ uint32_t tuh_midi_stream_read (uint8_t dev_addr, uint8_t *p_cable_num, uint8_t *
             break;
           default:
             break;
-          cable_sysex_in_progress &= ~cable_mask;
         }
+        // system common message ends any sysex
+        p_midi_host->cable_sysex_in_progress &= (uint16_t) ~cable_mask;
       }
       else
       {
@@ -708,23 +786,15 @@ uint32_t tuh_midi_stream_read (uint8_t dev_addr, uint8_t *p_cable_num, uint8_t *
     uint8_t idx;
     for (idx = 1; idx <= bytes_to_add_to_stream; idx++)
     {
-      *p_buffer++ = p_midi_host->stream_read.buffer[idx];
+      *p_buffer++ = packet[idx];
     }
     bytes_buffered += bytes_to_add_to_stream;
-    nread = 0;
-    if (tu_fifo_peek(&p_midi_host->rx_ff, &one_byte))
-    {
-      uint8_t new_cable = (one_byte >> 4) & 0xf;
-      if (new_cable == *p_cable_num)
-      {
-        // still on the same cable. Continue reading the stream
-        nread = tu_fifo_read_n(&p_midi_host->rx_ff, p_midi_host->stream_read.buffer, 4);
-      }
-    }
   }
 
+  // resume polling stopped by full FIFO
+  rx_arm(p_midi_host);
+
   return bytes_buffered;
 }
-#endif
 
-//} // extern C
+#endif
@@ -38,20 +38,43 @@
 // Class Driver Configuration
 //--------------------------------------------------------------------+
 
-// TODO Highspeed bulk transfer can be up to 512 bytes
-#ifndef CFG_TUH_HID_EPIN_BUFSIZE
-#define CFG_TUH_HID_EPIN_BUFSIZE 64
+// CFG_TUH_MIDI is the max number of MIDI devices supported at the same time
+
+#ifndef CFG_TUH_MAX_CABLES
+#define CFG_TUH_MAX_CABLES 16
+#endif
+
+// RX & TX FIFO size in bytes of 4-byte event packets
+#ifndef CFG_TUH_MIDI_RX_BUFSIZE
+#define CFG_TUH_MIDI_RX_BUFSIZE 128
+#endif
+
+#ifndef CFG_TUH_MIDI_TX_BUFSIZE
+#define CFG_TUH_MIDI_TX_BUFSIZE 128
 #endif
 
-#ifndef CFG_TUH_HID_EPOUT_BUFSIZE
-#define CFG_TUH_HID_EPOUT_BUFSIZE 64
+// Endpoint transfer buffer, high speed bulk endpoint can be up to 512 bytes
+#ifndef CFG_TUH_MIDI_EP_BUFSIZE
+#define CFG_TUH_MIDI_EP_BUFSIZE 64
 #endif
 
+TU_VERIFY_STATIC(CFG_TUH_MIDI_RX_BUFSIZE % 4 == 0 && CFG_TUH_MIDI_TX_BUFSIZE % 4 == 0, "MIDI FIFO size must be multiple of 4");
+
 //--------------------------------------------------------------------+
-// Application API (Single Interface)
+// Application API
+// Each MIDI device has its own RX & TX FIFO of event packets.
+// - IN endpoint is polled automatically once the device is configured, and is re-armed
+//   whenever the RX FIFO has room for a full endpoint packet.
+// - Packets written by application are sent right away if the OUT endpoint is idle, otherwise
+//   they are sent together once the transfer in progress completes.
 //--------------------------------------------------------------------+
 bool     tuh_midi_configured      (uint8_t dev_addr);
-uint32_t tuh_midi_available    (uint8_t dev_addr);
+
+// Number of event packets in RX FIFO
+uint32_t tuh_midi_available       (uint8_t dev_addr);
+
+// Number of event packets that can be written to TX FIFO
+uint32_t tuh_midi_write_available (uint8_t dev_addr);
 
 // return the number of virtual midi cables on the device's OUT endpoint
 uint8_t tuh_midih_get_num_tx_cables (uint8_t dev_addr);
@@ -59,19 +82,32 @@ uint8_t tuh_midih_get_num_tx_cables (uint8_t dev_addr);
 // return the number of virtual midi cables on the device's IN endpoint
 uint8_t tuh_midih_get_num_rx_cables (uint8_t dev_addr);
 
-// request available data from the device. tuh_midi_message_received_cb() will
-// be called if the device has any data to send. Otherwise, the device will
-// respond NAK. This function blocks until the transfer completes or the
-// devices sends NAK.
-// This function will return false if the hardware is busy.
+// IN endpoint is polled automatically, this only queues a transfer if it is not pending already
+// e.g when RX FIFO was full. Return false if the transfer can not be queued.
 bool tuh_midi_read_poll( uint8_t dev_addr );
 
-// Queue a message to the device. The application
-// must call tuh_midi_stream_flush to actually have the
-// data go out.
+//------------- Packet API -------------//
+
+// Read an event packet, return true if a packet is read
+bool     tuh_midi_packet_read    (uint8_t dev_addr, uint8_t packet[4]);
+
+// Read up to max_packets event packets, return number of packets read
+uint32_t tuh_midi_packet_read_n  (uint8_t dev_addr, uint8_t* packets, uint32_t max_packets);
+
+// Queue an event packet (cable number in the upper nibble of the first byte),
+// return true if the packet is queued
+bool     tuh_midi_packet_write   (uint8_t dev_addr, uint8_t const packet[4]);
+
+// Queue up to count event packets, return number of packets queued
+uint32_t tuh_midi_packet_write_n (uint8_t dev_addr, uint8_t const* packets, uint32_t count);
+
+//------------- Stream API -------------//
+
+// Queue a message to the device. Messages are packed into event packets
+// separately for each cable, and are sent as packets are written
 uint32_t tuh_midi_stream_write (uint8_t dev_addr, uint8_t cable_num, uint8_t const* p_buffer, uint32_t bufsize);
 
-// Send any queued packets to the device if the host hardware is able to do it
+// Send queued packets to the device if the OUT endpoint is idle
 // Returns the number of bytes flushed to the host hardware or 0 if
 // the host hardware is busy or there is nothing in queue to send.
 uint32_t tuh_midi_stream_flush( uint8_t dev_addr);
@@ -98,18 +134,20 @@ void midih_close      (uint8_t dev_addr);
 // Callbacks (Weak is optional)
 //--------------------------------------------------------------------+
 
-// Invoked when device with MIDI interface is mounted.
-// **If the MIDI host application requires MIDI IN, it should requst an
-// IN transfer here. The device will likely NAK this transfer. How the driver
-// handles the NAK is hardware dependent,** 
+// Invoked when device with MIDI interface is mounted, IN endpoint is polled
+// automatically afterwards.
 TU_ATTR_WEAK void tuh_midi_mount_cb(uint8_t dev_addr, uint8_t in_ep, uint8_t out_ep, uint8_t num_cables_rx, uint16_t num_cables_tx);
 
 // Invoked when device with MIDI interface is un-mounted
 // For now, the instance parameter is always 0 and can be ignored
 TU_ATTR_WEAK void tuh_midi_umount_cb(uint8_t dev_addr, uint8_t instance);
 
+// Invoked when packets are received and queued into RX FIFO
 TU_ATTR_WEAK void tuh_midi_rx_cb(uint8_t dev_addr, uint32_t num_packets);
+
+// Invoked when a transfer on OUT endpoint is complete
 TU_ATTR_WEAK void tuh_midi_tx_cb(uint8_t dev_addr);
+
 #ifdef __cplusplus
 }
 #endif
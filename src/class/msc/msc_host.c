@@ -36,6 +36,11 @@
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF
 //--------------------------------------------------------------------+
+enum
+{
+  MSC_CBW_TAG = 0x54555342, // TUSB
+};
+
 enum
 {
   MSC_STAGE_IDLE = 0,
@@ -44,6 +49,29 @@ enum
   MSC_STAGE_STATUS,
 };
 
+// Queued SCSI command
+typedef struct
+{
+  msc_cbw_t cbw; // first member, used as transfer buffer of command stage
+  void*     buffer;
+  tuh_msc_complete_cb_t complete_cb;
+}msch_command_t;
+
+#if CFG_TUH_MSC_CACHE_LINES
+// Block cache operation in progress
+typedef struct
+{
+  uint8_t  type;
+  uint8_t  lun;
+  bool     failed;
+  uint8_t  direct;  // number of queued commands transferring with application buffer
+  uint8_t* buffer;
+  uint32_t lba;
+  uint32_t count;   // number of blocks not yet processed
+  tuh_msc_cache_complete_cb_t complete_cb;
+}msch_cache_op_t;
+#endif
+
 typedef struct
 {
   uint8_t itf_num;
@@ -61,16 +89,27 @@ typedef struct
   } capacity[CFG_TUH_MSC_MAXLUN];
 
   //------------- SCSI -------------//
+  // Bulk-Only Transport executes one command at a time for all LUNs: commands are queued and
+  // the CBW of the next one is sent as soon as CSW of the current one is received.
   uint8_t stage;
-  void*   buffer;
-  tuh_msc_complete_cb_t complete_cb;
+  uint8_t queue_rd;
+  uint8_t queue_count;
 
-  msc_cbw_t cbw;
+  msch_command_t queue[CFG_TUH_MSC_QUEUE_SIZE];
   msc_csw_t csw;
+
+#if CFG_TUH_MSC_CACHE_LINES
+  msch_cache_op_t cache_op;
+#endif
 }msch_interface_t;
 
 CFG_TUSB_MEM_SECTION static msch_interface_t _msch_itf[CFG_TUH_DEVICE_MAX];
 
+#if CFG_TUH_MSC_CACHE_LINES
+static void cache_op_continue(uint8_t dev_addr);
+static void cache_close(uint8_t dev_addr);
+#endif
+
 // buffer used to read scsi information when mounted
 // largest response data currently is inquiry TODO Inquiry is not part of enum anymore
 CFG_TUSB_MEM_SECTION TU_ATTR_ALIGNED(4)
@@ -112,7 +151,13 @@ bool tuh_msc_mounted(uint8_t dev_addr)
 bool tuh_msc_ready(uint8_t dev_addr)
 {
   msch_interface_t* p_msc = get_itf(dev_addr);
-  return p_msc->mounted && !usbh_edpt_busy(dev_addr, p_msc->ep_in);
+  return p_msc->mounted && (p_msc->queue_count == 0);
+}
+
+uint8_t tuh_msc_queue_available(uint8_t dev_addr)
+{
+  msch_interface_t* p_msc = get_itf(dev_addr);
+  return CFG_TUH_MSC_QUEUE_SIZE - p_msc->queue_count;
 }
 
 //--------------------------------------------------------------------+
@@ -122,23 +167,35 @@ static inline void cbw_init(msc_cbw_t *cbw, uint8_t lun)
 {
   tu_memclr(cbw, sizeof(msc_cbw_t));
   cbw->signature = MSC_CBW_SIGNATURE;
-  cbw->tag       = 0x54555342; // TUSB
+  cbw->tag       = MSC_CBW_TAG;
   cbw->lun       = lun;
 }
 
+// Send CBW of the command at queue head
+static bool command_start(uint8_t dev_addr, msch_interface_t* p_msc)
+{
+  p_msc->stage = MSC_STAGE_CMD;
+  TU_ASSERT(usbh_edpt_xfer(dev_addr, p_msc->ep_out, (uint8_t*) &p_msc->queue[p_msc->queue_rd].cbw, sizeof(msc_cbw_t)));
+
+  return true;
+}
+
 bool tuh_msc_scsi_command(uint8_t dev_addr, msc_cbw_t const* cbw, void* data, tuh_msc_complete_cb_t complete_cb)
 {
   msch_interface_t* p_msc = get_itf(dev_addr);
-  TU_VERIFY(p_msc->configured);
+  TU_VERIFY(p_msc->configured && p_msc->queue_count < CFG_TUH_MSC_QUEUE_SIZE);
 
-  // TODO claim endpoint
+  uint8_t const idx = (p_msc->queue_rd + p_msc->queue_count) % CFG_TUH_MSC_QUEUE_SIZE;
+  msch_command_t* cmd = &p_msc->queue[idx];
 
-  p_msc->cbw = *cbw;
-  p_msc->stage = MSC_STAGE_CMD;
-  p_msc->buffer = data;
-  p_msc->complete_cb = complete_cb;
+  cmd->cbw         = *cbw;
+  cmd->buffer      = data;
+  cmd->complete_cb = complete_cb;
 
-  TU_ASSERT(usbh_edpt_xfer(dev_addr, p_msc->ep_out, (uint8_t*) &p_msc->cbw, sizeof(msc_cbw_t)));
+  // start right away if there is no command in progress
+  if ( p_msc->queue_count == 0 ) TU_VERIFY(command_start(dev_addr, p_msc));
+
+  p_msc->queue_count++;
 
   return true;
 }
@@ -218,54 +275,481 @@ bool tuh_msc_request_sense(uint8_t dev_addr, uint8_t lun, void *resposne, tuh_ms
   return tuh_msc_scsi_command(dev_addr, &cbw, resposne, complete_cb);
 }
 
-bool tuh_msc_read10(uint8_t dev_addr, uint8_t lun, void * buffer, uint32_t lba, uint16_t block_count, tuh_msc_complete_cb_t complete_cb)
+// READ10 & WRITE10 have the same layout
+static bool scsi_rw10(uint8_t dev_addr, uint8_t lun, bool is_write, void* buffer, uint32_t lba, uint16_t block_count,
+                      uint32_t tag, tuh_msc_complete_cb_t complete_cb)
 {
   msch_interface_t* p_msc = get_itf(dev_addr);
   TU_VERIFY(p_msc->mounted);
 
   msc_cbw_t cbw;
   cbw_init(&cbw, lun);
- 
+
+  cbw.tag         = tag;
   cbw.total_bytes = block_count*p_msc->capacity[lun].block_size;
-  cbw.dir         = TUSB_DIR_IN_MASK;
+  cbw.dir         = is_write ? TUSB_DIR_OUT : TUSB_DIR_IN_MASK;
   cbw.cmd_len     = sizeof(scsi_read10_t);
- 
-  scsi_read10_t const cmd_read10 =
+
+  scsi_read10_t const cmd_rw10 =
   {
-    .cmd_code    = SCSI_CMD_READ_10,
+    .cmd_code    = is_write ? SCSI_CMD_WRITE_10 : SCSI_CMD_READ_10,
     .lba         = tu_htonl(lba),
     .block_count = tu_htons(block_count)
   };
- 
-  memcpy(cbw.command, &cmd_read10, cbw.cmd_len);
- 
+
+  memcpy(cbw.command, &cmd_rw10, cbw.cmd_len);
+
   return tuh_msc_scsi_command(dev_addr, &cbw, buffer, complete_cb);
 }
- 
+
+bool tuh_msc_read10(uint8_t dev_addr, uint8_t lun, void * buffer, uint32_t lba, uint16_t block_count, tuh_msc_complete_cb_t complete_cb)
+{
+  return scsi_rw10(dev_addr, lun, false, buffer, lba, block_count, MSC_CBW_TAG, complete_cb);
+}
+
 bool tuh_msc_write10(uint8_t dev_addr, uint8_t lun, void const * buffer, uint32_t lba, uint16_t block_count, tuh_msc_complete_cb_t complete_cb)
+{
+  return scsi_rw10(dev_addr, lun, true, (void*)(uintptr_t) buffer, lba, block_count, MSC_CBW_TAG, complete_cb);
+}
+
+//--------------------------------------------------------------------+
+// PUBLIC API: BLOCK CACHE
+//--------------------------------------------------------------------+
+#if CFG_TUH_MSC_CACHE_LINES
+
+TU_VERIFY_STATIC(CFG_TUH_MSC_CACHE_LINE_BLOCKS <= 32, "line valid/dirty bitmap is 32-bit");
+TU_VERIFY_STATIC(CFG_TUH_MSC_CACHE_LINES >= 4 && CFG_TUH_MSC_CACHE_LINES <= 256, "cache lines must be 4-256");
+
+#define CACHE_LINE_BYTES    (CFG_TUH_MSC_CACHE_LINE_BLOCKS*CFG_TUH_MSC_CACHE_BLOCK_SIZE)
+
+// Cache commands are identified by CBW tag: "TU" + kind + line index
+#define CACHE_TAG(_kind, _idx)   (0x54550000ul | ((uint32_t) (_kind) << 8) | (_idx))
+
+enum
+{
+  CACHE_OP_NONE = 0,
+  CACHE_OP_READ,
+  CACHE_OP_WRITE,
+  CACHE_OP_FLUSH,
+};
+
+enum
+{
+  CACHE_CMD_LOAD = 1, // read whole line from device
+  CACHE_CMD_FLUSH,    // write dirty blocks of line to device
+  CACHE_CMD_DIRECT,   // read/write with application buffer
+};
+
+// Each line holds CFG_TUH_MSC_CACHE_LINE_BLOCKS contiguous blocks, aligned to line size
+typedef struct
+{
+  uint8_t  dev_addr;  // 0 if not used
+  uint8_t  lun;
+  uint8_t  busy;      // number of queued commands using line data
+  bool     loading;   // LOAD command is queued
+  uint32_t lba;       // first block
+  uint32_t valid;     // bitmap of blocks having data
+  uint32_t dirty;     // bitmap of blocks not yet written to device
+  uint32_t last_used; // LRU stamp
+}msch_cache_line_t;
+
+static msch_cache_line_t _cache_line[CFG_TUH_MSC_CACHE_LINES];
+static uint32_t _cache_stamp;
+
+CFG_TUSB_MEM_SECTION TU_ATTR_ALIGNED(4)
+static uint8_t _cache_data[CFG_TUH_MSC_CACHE_LINES][CACHE_LINE_BYTES];
+
+TU_ATTR_ALWAYS_INLINE static inline uint32_t block_mask(uint32_t offset, uint32_t count)
+{
+  return (count >= 32 ? UINT32_MAX : (TU_BIT(count) - 1)) << offset;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline uint8_t line_index(msch_cache_line_t const* line)
+{
+  return (uint8_t) (line - _cache_line);
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void line_touch(msch_cache_line_t* line)
+{
+  line->last_used = ++_cache_stamp;
+}
+
+static bool cache_cmd_complete(uint8_t dev_addr, msc_cbw_t const* cbw, msc_csw_t const* csw);
+
+static msch_cache_line_t* line_find(uint8_t dev_addr, uint8_t lun, uint32_t lba)
+{
+  for(uint32_t i=0; i<CFG_TUH_MSC_CACHE_LINES; i++)
+  {
+    msch_cache_line_t* line = &_cache_line[i];
+    if ( line->dev_addr == dev_addr && line->lun == lun && line->lba == lba ) return line;
+  }
+
+  return NULL;
+}
+
+// Write each contiguous dirty run of the line
+static bool line_flush(uint8_t dev_addr, msch_cache_line_t* line)
+{
+  uint32_t dirty = line->dirty;
+
+  while ( dirty )
+  {
+    uint32_t offset = 0;
+    while ( !(dirty & TU_BIT(offset)) ) offset++;
+
+    uint32_t count = 0;
+    while ( (offset + count < 32) && (dirty & TU_BIT(offset + count)) ) count++;
+
+    // stop if queue is full, remaining runs will be flushed when resumed
+    TU_VERIFY(scsi_rw10(dev_addr, line->lun, true, _cache_data[line_index(line)] + offset*CFG_TUH_MSC_CACHE_BLOCK_SIZE,
+                        line->lba + offset, (uint16_t) count, CACHE_TAG(CACHE_CMD_FLUSH, line_index(line)), cache_cmd_complete));
+    line->busy++;
+
+    dirty &= ~block_mask(offset, count);
+  }
+
+  return true;
+}
+
+// Read whole line, dirty blocks are written first so that they are not lost.
+// Commands are executed in queue order, write's data stage is done before read overwrites line.
+static bool line_load(uint8_t dev_addr, msch_cache_line_t* line)
+{
+  // wait for flush of dirty blocks if it is in progress
+  TU_VERIFY(line->busy == 0 && line_flush(dev_addr, line));
+
+  TU_VERIFY(scsi_rw10(dev_addr, line->lun, false, _cache_data[line_index(line)], line->lba,
+                      CFG_TUH_MSC_CACHE_LINE_BLOCKS, CACHE_TAG(CACHE_CMD_LOAD, line_index(line)), cache_cmd_complete));
+  line->busy++;
+  line->loading = true;
+
+  return true;
+}
+
+// Allocate a line for blocks starting at lba: free or least recently used idle line.
+// If victim has dirty blocks, it is flushed (when allowed) and NULL is returned: caller retries when flush is complete.
+static msch_cache_line_t* line_alloc(uint8_t dev_addr, uint8_t lun, uint32_t lba, bool allow_flush)
+{
+  msch_cache_line_t* victim = NULL;
+
+  for(uint32_t i=0; i<CFG_TUH_MSC_CACHE_LINES; i++)
+  {
+    msch_cache_line_t* line = &_cache_line[i];
+    if ( line->busy ) continue;
+
+    if ( line->dev_addr == 0 )
+    {
+      victim = line;
+      break;
+    }
+
+    if ( !allow_flush && line->dirty ) continue;
+
+    if ( !victim || (int32_t) (line->last_used - victim->last_used) < 0 ) victim = line;
+  }
+
+  TU_VERIFY(victim, NULL);
+
+  if ( victim->dirty )
+  {
+    line_flush(victim->dev_addr, victim);
+    return NULL;
+  }
+
+  victim->dev_addr = dev_addr;
+  victim->lun      = lun;
+  victim->lba      = lba;
+  victim->valid    = 0;
+  line_touch(victim);
+
+  return victim;
+}
+
+static bool cache_cmd_complete(uint8_t dev_addr, msc_cbw_t const* cbw, msc_csw_t const* csw)
 {
   msch_interface_t* p_msc = get_itf(dev_addr);
-  TU_VERIFY(p_msc->mounted);
+  bool const success = (csw->status == MSC_CSW_STATUS_PASSED);
 
-  msc_cbw_t cbw;
-  cbw_init(&cbw, lun);
+  uint8_t const kind = (uint8_t) (cbw->tag >> 8);
+  msch_cache_line_t* line = &_cache_line[(uint8_t) cbw->tag];
 
-  cbw.total_bytes = block_count*p_msc->capacity[lun].block_size;
-  cbw.dir         = TUSB_DIR_OUT;
-  cbw.cmd_len     = sizeof(scsi_write10_t);
+  switch ( kind )
+  {
+    case CACHE_CMD_LOAD:
+      line->busy--;
+      line->loading = false;
+      line->valid   = success ? block_mask(0, CFG_TUH_MSC_CACHE_LINE_BLOCKS) : 0;
+    break;
+
+    case CACHE_CMD_FLUSH:
+      line->busy--;
+      if ( success )
+      {
+        scsi_write10_t const* cmd = (scsi_write10_t const*) cbw->command;
+        line->dirty &= ~block_mask(tu_ntohl(cmd->lba) - line->lba, tu_ntohs(cmd->block_count));
+      }
+    break;
+
+    case CACHE_CMD_DIRECT:
+      p_msc->cache_op.direct--;
+    break;
 
-  scsi_write10_t const cmd_write10 =
+    default: break;
+  }
+
+  if ( !success ) p_msc->cache_op.failed = true;
+
+  return true;
+}
+
+// Large read bypasses cache: dirty blocks in range are written first
+static void cache_read_direct(uint8_t dev_addr)
+{
+  msch_interface_t* p_msc = get_itf(dev_addr);
+  msch_cache_op_t* op = &p_msc->cache_op;
+
+  for(uint32_t i=0; i<CFG_TUH_MSC_CACHE_LINES; i++)
   {
-    .cmd_code    = SCSI_CMD_WRITE_10,
-    .lba         = tu_htonl(lba),
-    .block_count = tu_htons(block_count)
-  };
+    msch_cache_line_t* line = &_cache_line[i];
+
+    if ( line->dev_addr == dev_addr && line->lun == op->lun && line->dirty && !line->busy &&
+         line->lba < op->lba + op->count && op->lba < line->lba + CFG_TUH_MSC_CACHE_LINE_BLOCKS )
+    {
+      TU_VERIFY(line_flush(dev_addr, line), );
+    }
+  }
+
+  TU_VERIFY(scsi_rw10(dev_addr, op->lun, false, op->buffer, op->lba, (uint16_t) op->count,
+                      CACHE_TAG(CACHE_CMD_DIRECT, 0), cache_cmd_complete), );
+  op->direct++;
+  op->count = 0;
+}
+
+// Large write bypasses cache: cached blocks in range are dropped
+static void cache_write_direct(uint8_t dev_addr)
+{
+  msch_interface_t* p_msc = get_itf(dev_addr);
+  msch_cache_op_t* op = &p_msc->cache_op;
+
+  for(uint32_t i=0; i<CFG_TUH_MSC_CACHE_LINES; i++)
+  {
+    msch_cache_line_t* line = &_cache_line[i];
+
+    if ( line->dev_addr == dev_addr && line->lun == op->lun &&
+         line->lba < op->lba + op->count && op->lba < line->lba + CFG_TUH_MSC_CACHE_LINE_BLOCKS )
+    {
+      // wait for queued load/flush of this line
+      if ( line->busy ) return;
+
+      uint32_t const first = tu_max32(op->lba, line->lba);
+      uint32_t const last  = tu_min32(op->lba + op->count, line->lba + CFG_TUH_MSC_CACHE_LINE_BLOCKS);
+      uint32_t const mask  = block_mask(first - line->lba, last - first);
+
+      line->valid &= ~mask;
+      line->dirty &= ~mask;
+    }
+  }
+
+  TU_VERIFY(scsi_rw10(dev_addr, op->lun, true, op->buffer, op->lba, (uint16_t) op->count,
+                      CACHE_TAG(CACHE_CMD_DIRECT, 0), cache_cmd_complete), );
+  op->direct++;
+  op->count = 0;
+}
+
+static void cache_read(uint8_t dev_addr)
+{
+  msch_interface_t* p_msc = get_itf(dev_addr);
+  msch_cache_op_t* op = &p_msc->cache_op;
+
+  // Queue loads of all missing lines in range (and the next one for read-ahead) back to back
+  uint32_t const first = op->lba - (op->lba % CFG_TUH_MSC_CACHE_LINE_BLOCKS);
+  uint32_t const end   = op->lba + op->count + CFG_TUH_MSC_CACHE_LINE_BLOCKS;
+
+  for(uint32_t lba = first; lba < end && lba < p_msc->capacity[op->lun].block_count; lba += CFG_TUH_MSC_CACHE_LINE_BLOCKS)
+  {
+    bool const is_ahead = (lba >= op->lba + op->count);
+    msch_cache_line_t* line = line_find(dev_addr, op->lun, lba);
+
+    if ( !line )
+    {
+      // read-ahead only takes a clean line
+      line = line_alloc(dev_addr, op->lun, lba, !is_ahead);
+      if ( !line ) break;
+    }else if ( !is_ahead )
+    {
+      // keep it from being evicted by read-ahead
+      line_touch(line);
+    }
+
+    if ( !line->loading && (line->valid != block_mask(0, CFG_TUH_MSC_CACHE_LINE_BLOCKS)) )
+    {
+      if ( !line_load(dev_addr, line) ) break;
+    }
+  }
+
+  // Copy blocks of loaded lines
+  while ( op->count )
+  {
+    uint32_t const offset = op->lba % CFG_TUH_MSC_CACHE_LINE_BLOCKS;
+    uint32_t const count  = tu_min32(op->count, CFG_TUH_MSC_CACHE_LINE_BLOCKS - offset);
+
+    msch_cache_line_t* line = line_find(dev_addr, op->lun, op->lba - offset);
 
-  memcpy(cbw.command, &cmd_write10, cbw.cmd_len);
+    // wait for line to be loaded
+    if ( !line || line->loading ) return;
 
-  return tuh_msc_scsi_command(dev_addr, &cbw, (void*)(uintptr_t) buffer, complete_cb);
+    uint32_t const mask = block_mask(offset, count);
+    if ( (line->valid & mask) != mask ) return;
+
+    memcpy(op->buffer, _cache_data[line_index(line)] + offset*CFG_TUH_MSC_CACHE_BLOCK_SIZE, count*CFG_TUH_MSC_CACHE_BLOCK_SIZE);
+    line_touch(line);
+
+    op->buffer += count*CFG_TUH_MSC_CACHE_BLOCK_SIZE;
+    op->lba    += count;
+    op->count  -= count;
+  }
 }
 
+static void cache_write(uint8_t dev_addr)
+{
+  msch_interface_t* p_msc = get_itf(dev_addr);
+  msch_cache_op_t* op = &p_msc->cache_op;
+
+  while ( op->count )
+  {
+    uint32_t const offset = op->lba % CFG_TUH_MSC_CACHE_LINE_BLOCKS;
+    uint32_t const count  = tu_min32(op->count, CFG_TUH_MSC_CACHE_LINE_BLOCKS - offset);
+
+    msch_cache_line_t* line = line_find(dev_addr, op->lun, op->lba - offset);
+
+    if ( !line )
+    {
+      line = line_alloc(dev_addr, op->lun, op->lba - offset, true);
+      if ( !line ) return;
+    }
+
+    // data of queued load/flush must not be modified
+    if ( line->busy ) return;
+
+    uint32_t const mask = block_mask(offset, count);
+
+    memcpy(_cache_data[line_index(line)] + offset*CFG_TUH_MSC_CACHE_BLOCK_SIZE, op->buffer, count*CFG_TUH_MSC_CACHE_BLOCK_SIZE);
+    line->valid |= mask;
+    line->dirty |= mask;
+    line_touch(line);
+
+    op->buffer += count*CFG_TUH_MSC_CACHE_BLOCK_SIZE;
+    op->lba    += count;
+    op->count  -= count;
+  }
+}
+
+// return true if all dirty lines of device are written
+static bool cache_flush(uint8_t dev_addr)
+{
+  bool done = true;
+
+  for(uint32_t i=0; i<CFG_TUH_MSC_CACHE_LINES; i++)
+  {
+    msch_cache_line_t* line = &_cache_line[i];
+    if ( line->dev_addr != dev_addr || !(line->dirty || line->busy) ) continue;
+
+    done = false;
+    if ( !line->busy && !line_flush(dev_addr, line) ) break;
+  }
+
+  return done;
+}
+
+static void cache_op_continue(uint8_t dev_addr)
+{
+  msch_interface_t* p_msc = get_itf(dev_addr);
+  msch_cache_op_t* op = &p_msc->cache_op;
+
+  if ( op->type == CACHE_OP_NONE ) return;
+
+  if ( !op->failed )
+  {
+    // large transfer or block size not supported by cache
+    bool const is_direct = (op->count >= CFG_TUH_MSC_CACHE_LINE_BLOCKS) ||
+                           (p_msc->capacity[op->lun].block_size != CFG_TUH_MSC_CACHE_BLOCK_SIZE);
+
+    switch ( op->type )
+    {
+      case CACHE_OP_READ : if ( op->count ) is_direct ? cache_read_direct(dev_addr)  : cache_read(dev_addr) ; break;
+      case CACHE_OP_WRITE: if ( op->count ) is_direct ? cache_write_direct(dev_addr) : cache_write(dev_addr); break;
+
+      case CACHE_OP_FLUSH:
+        if ( !cache_flush(dev_addr) ) return;
+      break;
+
+      default: break;
+    }
+
+    if ( op->count ) return;
+  }
+
+  // application buffer is still in use
+  if ( op->direct ) return;
+
+  op->type = CACHE_OP_NONE;
+  if ( op->complete_cb ) op->complete_cb(dev_addr, op->lun, !op->failed);
+}
+
+static bool cache_op_start(uint8_t dev_addr, uint8_t type, uint8_t lun, void* buffer, uint32_t lba, uint16_t block_count,
+                           tuh_msc_cache_complete_cb_t complete_cb)
+{
+  msch_interface_t* p_msc = get_itf(dev_addr);
+  msch_cache_op_t* op = &p_msc->cache_op;
+
+  TU_VERIFY(p_msc->mounted && op->type == CACHE_OP_NONE);
+
+  op->type        = type;
+  op->lun         = lun;
+  op->failed      = false;
+  op->direct      = 0;
+  op->buffer      = (uint8_t*) buffer;
+  op->lba         = lba;
+  op->count       = block_count;
+  op->complete_cb = complete_cb;
+
+  cache_op_continue(dev_addr);
+
+  return true;
+}
+
+// device is unplugged, cached data is discarded
+static void cache_close(uint8_t dev_addr)
+{
+  for(uint32_t i=0; i<CFG_TUH_MSC_CACHE_LINES; i++)
+  {
+    if ( _cache_line[i].dev_addr == dev_addr ) tu_memclr(&_cache_line[i], sizeof(msch_cache_line_t));
+  }
+}
+
+bool tuh_msc_cache_read(uint8_t dev_addr, uint8_t lun, void* buffer, uint32_t lba, uint16_t block_count, tuh_msc_cache_complete_cb_t complete_cb)
+{
+  return cache_op_start(dev_addr, CACHE_OP_READ, lun, buffer, lba, block_count, complete_cb);
+}
+
+bool tuh_msc_cache_write(uint8_t dev_addr, uint8_t lun, void const* buffer, uint32_t lba, uint16_t block_count, tuh_msc_cache_complete_cb_t complete_cb)
+{
+  return cache_op_start(dev_addr, CACHE_OP_WRITE, lun, (void*)(uintptr_t) buffer, lba, block_count, complete_cb);
+}
+
+bool tuh_msc_cache_flush(uint8_t dev_addr, tuh_msc_cache_complete_cb_t complete_cb)
+{
+  return cache_op_start(dev_addr, CACHE_OP_FLUSH, 0, NULL, 0, 0, complete_cb);
+}
+
+bool tuh_msc_cache_busy(uint8_t dev_addr)
+{
+  msch_interface_t* p_msc = get_itf(dev_addr);
+  return p_msc->cache_op.type != CACHE_OP_NONE;
+}
+
+#endif
+
 #if 0
 // MSC interface Reset (not used now)
 bool tuh_msc_reset(uint8_t dev_addr)
@@ -304,13 +788,18 @@ void msch_close(uint8_t dev_addr)
   // invoke Application Callback
   if (p_msc->mounted && tuh_msc_umount_cb) tuh_msc_umount_cb(dev_addr);
 
+#if CFG_TUH_MSC_CACHE_LINES
+  cache_close(dev_addr);
+#endif
+
   tu_memclr(p_msc, sizeof(msch_interface_t));
 }
 
 bool msch_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes)
 {
   msch_interface_t* p_msc = get_itf(dev_addr);
-  msc_cbw_t const * cbw = &p_msc->cbw;
+  msch_command_t  * cmd = &p_msc->queue[p_msc->queue_rd];
+  msc_cbw_t const * cbw = &cmd->cbw;
   msc_csw_t       * csw = &p_msc->csw;
 
   switch (p_msc->stage)
@@ -319,13 +808,13 @@ bool msch_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t event, uint32
       // Must be Command Block
       TU_ASSERT(ep_addr == p_msc->ep_out &&  event == XFER_RESULT_SUCCESS && xferred_bytes == sizeof(msc_cbw_t));
 
-      if ( cbw->total_bytes && p_msc->buffer )
+      if ( cbw->total_bytes && cmd->buffer )
       {
         // Data stage if any
         p_msc->stage = MSC_STAGE_DATA;
 
         uint8_t const ep_data = (cbw->dir & TUSB_DIR_IN_MASK) ? p_msc->ep_in : p_msc->ep_out;
-        TU_ASSERT(usbh_edpt_xfer(dev_addr, ep_data, p_msc->buffer, cbw->total_bytes));
+        TU_ASSERT(usbh_edpt_xfer(dev_addr, ep_data, cmd->buffer, cbw->total_bytes));
       }else
       {
         // Status stage
@@ -341,10 +830,24 @@ bool msch_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t event, uint32
     break;
 
     case MSC_STAGE_STATUS:
-      // SCSI op is complete
-      p_msc->stage = MSC_STAGE_IDLE;
+    {
+      // SCSI op is complete, release its queue slot (keep a copy for callback)
+      msch_command_t const done = *cmd;
+
+      p_msc->stage    = MSC_STAGE_IDLE;
+      p_msc->queue_rd = (p_msc->queue_rd + 1) % CFG_TUH_MSC_QUEUE_SIZE;
+      p_msc->queue_count--;
+
+      // Send next CBW before invoking callback, CSW buffer is not used until its status stage
+      if ( p_msc->queue_count ) TU_ASSERT(command_start(dev_addr, p_msc));
 
-      if (p_msc->complete_cb) p_msc->complete_cb(dev_addr, cbw, csw);
+      if (done.complete_cb) done.complete_cb(dev_addr, &done.cbw, csw);
+
+#if CFG_TUH_MSC_CACHE_LINES
+      // a queue slot is freed or cached blocks are updated, resume pending cache operation
+      cache_op_continue(dev_addr);
+#endif
+    }
     break;
 
     // unknown state
@@ -418,7 +921,7 @@ bool msch_set_config(uint8_t dev_addr, uint8_t itf_num)
     .wIndex   = itf_num,
     .wLength  = 1
   };
-  TU_ASSERT(tuh_control_xfer(dev_addr, &request, &p_msc->max_lun, config_get_maxlun_complete));
+  TU_ASSERT(tuh_control_xfer(dev_addr, &request, _msch_buffer, config_get_maxlun_complete));
 
   return true;
 }
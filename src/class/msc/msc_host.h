@@ -41,7 +41,28 @@
 #define CFG_TUH_MSC_MAXLUN  4
 #endif
 
+// Number of SCSI commands that can be queued per device
+#ifndef CFG_TUH_MSC_QUEUE_SIZE
+#define CFG_TUH_MSC_QUEUE_SIZE  4
+#endif
+
+// Block cache shared by all devices, 0 to disable. Each line holds CFG_TUH_MSC_CACHE_LINE_BLOCKS blocks
+// (up to 32) which is also the read-ahead unit.
+#ifndef CFG_TUH_MSC_CACHE_LINES
+#define CFG_TUH_MSC_CACHE_LINES  0
+#endif
+
+#ifndef CFG_TUH_MSC_CACHE_LINE_BLOCKS
+#define CFG_TUH_MSC_CACHE_LINE_BLOCKS  8
+#endif
+
+// Only LUN with this block size is cached, others are accessed directly
+#ifndef CFG_TUH_MSC_CACHE_BLOCK_SIZE
+#define CFG_TUH_MSC_CACHE_BLOCK_SIZE  512
+#endif
+
 typedef bool (*tuh_msc_complete_cb_t)(uint8_t dev_addr, msc_cbw_t const* cbw, msc_csw_t const* csw);
+typedef bool (*tuh_msc_cache_complete_cb_t)(uint8_t dev_addr, uint8_t lun, bool success);
 
 //--------------------------------------------------------------------+
 // Application API
@@ -54,6 +75,9 @@ bool tuh_msc_mounted(uint8_t dev_addr);
 // Check if the interface is currently ready or busy transferring data
 bool tuh_msc_ready(uint8_t dev_addr);
 
+// Get number of SCSI commands that can be queued
+uint8_t tuh_msc_queue_available(uint8_t dev_addr);
+
 // Get Max Lun
 uint8_t tuh_msc_get_maxlun(uint8_t dev_addr);
 
@@ -64,8 +88,9 @@ uint32_t tuh_msc_get_block_count(uint8_t dev_addr, uint8_t lun);
 uint32_t tuh_msc_get_block_size(uint8_t dev_addr, uint8_t lun);
 
 // Perform a full SCSI command (cbw, data, csw) in non-blocking manner.
+// Command is queued and executed after the pending ones, CBW is sent right after CSW of previous command.
 // Complete callback is invoked when SCSI op is complete.
-// return true if success, false if there is already pending operation.
+// return true if success, false if the queue is full.
 bool tuh_msc_scsi_command(uint8_t dev_addr, msc_cbw_t const* cbw, void* data, tuh_msc_complete_cb_t complete_cb);
 
 // Perform SCSI Inquiry command
@@ -94,6 +119,21 @@ bool tuh_msc_write10(uint8_t dev_addr, uint8_t lun, void const * buffer, uint32_
 // simply call tuh_msc_get_block_count() and tuh_msc_get_block_size()
 bool tuh_msc_read_capacity(uint8_t dev_addr, uint8_t lun, scsi_read_capacity10_resp_t* response, tuh_msc_complete_cb_t complete_cb);
 
+//------------- Block Cache -------------//
+// Read/Write through the block cache (CFG_TUH_MSC_CACHE_LINES > 0). Small transfers are served from
+// cache lines loaded with read-ahead, writes are kept in cache until tuh_msc_cache_flush() or eviction.
+// Transfers of at least one line go directly to the device. Only one cache operation per device at a time.
+// Complete callback may be invoked before the function returns if all blocks are in cache.
+
+bool tuh_msc_cache_read(uint8_t dev_addr, uint8_t lun, void* buffer, uint32_t lba, uint16_t block_count, tuh_msc_cache_complete_cb_t complete_cb);
+bool tuh_msc_cache_write(uint8_t dev_addr, uint8_t lun, void const* buffer, uint32_t lba, uint16_t block_count, tuh_msc_cache_complete_cb_t complete_cb);
+
+// Write all modified blocks of device
+bool tuh_msc_cache_flush(uint8_t dev_addr, tuh_msc_cache_complete_cb_t complete_cb);
+
+// Check if a cache operation is in progress
+bool tuh_msc_cache_busy(uint8_t dev_addr);
+
 //------------- Application Callback -------------//
 
 // Invoked when a device with MassStorage interface is mounted
@@ -37,6 +37,12 @@
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF
 //--------------------------------------------------------------------+
+#if CFG_TUD_VIDEO_STREAMING_PTS_SCR
+  #define PAYLOAD_HEADER_LEN     sizeof(tusb_video_payload_header_pts_scr_t)
+#else
+  #define PAYLOAD_HEADER_LEN     sizeof(tusb_video_payload_header_t)
+#endif
+
 typedef struct {
   tusb_desc_interface_t            std;
   tusb_desc_cs_video_ctl_itf_hdr_t ctl;
@@ -59,6 +65,38 @@ typedef struct TU_ATTR_PACKED {
   uint8_t bEntityId;
 } tusb_desc_cs_video_entity_itf_t;
 
+/* format descriptor: the leading fields are common to all supported formats */
+typedef union {
+  struct TU_ATTR_PACKED {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bDescriptorSubType;
+    uint8_t bFormatIndex;
+    uint8_t bNumFrameDescriptors;
+  };
+  tusb_desc_cs_video_fmt_uncompressed_t uncompressed;
+  tusb_desc_cs_video_fmt_mjpeg_t        mjpeg;
+  tusb_desc_cs_video_fmt_frame_based_t  frame_based;
+} tusb_desc_cs_video_fmt_t;
+
+/* frame descriptor: the leading fields are common to all supported formats */
+typedef union {
+  struct TU_ATTR_PACKED {
+    uint8_t  bLength;
+    uint8_t  bDescriptorType;
+    uint8_t  bDescriptorSubType;
+    uint8_t  bFrameIndex;
+    uint8_t  bmCapabilities;
+    uint16_t wWidth;
+    uint16_t wHeight;
+    uint32_t dwMinBitRate;
+    uint32_t dwMaxBitRate;
+  };
+  tusb_desc_cs_video_frm_uncompressed_t uncompressed;
+  tusb_desc_cs_video_frm_mjpeg_t        mjpeg;
+  tusb_desc_cs_video_frm_frame_based_t  frame_based;
+} tusb_desc_cs_video_frm_t;
+
 /* video streaming interface */
 typedef struct TU_ATTR_PACKED {
   uint8_t index_vc;  /* index of bound video control interface */
@@ -74,6 +112,24 @@ typedef struct TU_ATTR_PACKED {
   uint32_t offset;   /* offset for the next payload transfer */
   uint32_t max_payload_transfer_size;
   uint8_t  error_code;/* error code */
+  struct {
+    uint8_t  rd;     /* index of the next frame to be transferred */
+    uint8_t  wr;     /* index of the next free entry */
+    struct TU_ATTR_PACKED {
+      uint8_t *buffer;
+      uint32_t bufsize;
+#if CFG_TUD_VIDEO_STREAMING_PTS_SCR
+      uint32_t pts;
+#endif
+    } frm[CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE];
+  } queue;           /* frames waiting for the current frame to be completed */
+#if CFG_TUD_VIDEO_STREAMING_PTS_SCR
+  uint32_t pts;      /* presentation time stamp of the current frame */
+#endif
+#if CFG_TUD_VIDEO_STREAMING_ZERO_COPY
+  uint8_t *hdr_pos;  /* position in the frame buffer where the payload header was written */
+  uint8_t  hdr_save[PAYLOAD_HEADER_LEN]; /* frame data overwritten by the header */
+#endif
   /*------------- From this point, data is not cleared by bus reset -------------*/
   CFG_TUSB_MEM_ALIGN uint8_t ep_buf[CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE]; /* EP transfer buffer for streaming */
 } videod_streaming_interface_t;
@@ -99,6 +155,9 @@ typedef struct TU_ATTR_PACKED {
 //--------------------------------------------------------------------+
 CFG_TUSB_MEM_SECTION static videod_interface_t _videod_itf[CFG_TUD_VIDEO];
 CFG_TUSB_MEM_SECTION static videod_streaming_interface_t _videod_streaming_itf[CFG_TUD_VIDEO_STREAMING];
+/* Reply to GET_MIN/MAX/RES/DEF of the probe control. Control requests do not overlap,
+ * so all streaming interfaces share it. */
+CFG_TUSB_MEM_SECTION static video_probe_and_commit_control_t _videod_probe_reply;
 
 static uint8_t const _cap_get     = 0x1u; /* support for GET */
 static uint8_t const _cap_get_set = 0x3u; /* support for GET and SET */
@@ -276,17 +335,128 @@ static inline void const* _end_of_streaming_descriptor(void const *desc)
 }
 
 /** Find the first format descriptor with the specified format number. */
-static inline tusb_desc_cs_video_fmt_uncompressed_t const *_find_desc_format(void const *beg, void const *end, uint_fast8_t fmtnum)
+static tusb_desc_cs_video_fmt_t const *_find_desc_format(void const *beg, void const *end, uint_fast8_t fmtnum)
+{
+  for (void const *cur = _find_desc(beg, end, TUSB_DESC_CS_INTERFACE); cur < end;
+       cur = _find_desc(tu_desc_next(cur), end, TUSB_DESC_CS_INTERFACE)) {
+    uint8_t const *p = (uint8_t const *)cur;
+    switch (p[2]) {
+      case VIDEO_CS_ITF_VS_FORMAT_UNCOMPRESSED:
+      case VIDEO_CS_ITF_VS_FORMAT_MJPEG:
+      case VIDEO_CS_ITF_VS_FORMAT_FRAME_BASED:
+        if (p[3] == fmtnum) return (tusb_desc_cs_video_fmt_t const *)cur;
+        break;
+      default: break;
+    }
+  }
+  return end;
+}
+
+/** Find the first frame descriptor of the format with the specified frame number. */
+static inline tusb_desc_cs_video_frm_t const *_find_desc_frame(tusb_desc_cs_video_fmt_t const *fmt, void const *end, uint_fast8_t frmnum)
+{
+  /* The frame descriptor subtype immediately follows the format descriptor subtype. */
+  return (tusb_desc_cs_video_frm_t const*)
+    _find_desc_3(tu_desc_next(fmt), end, TUSB_DESC_CS_INTERFACE, fmt->bDescriptorSubType + 1, frmnum);
+}
+
+/** Return the default frame index of the format. */
+static uint_fast8_t _fmt_default_frame_index(tusb_desc_cs_video_fmt_t const *fmt)
+{
+  switch (fmt->bDescriptorSubType) {
+    case VIDEO_CS_ITF_VS_FORMAT_MJPEG:       return fmt->mjpeg.bDefaultFrameIndex;
+    case VIDEO_CS_ITF_VS_FORMAT_FRAME_BASED: return fmt->frame_based.bDefaultFrameIndex;
+    default:                                 return fmt->uncompressed.bDefaultFrameIndex;
+  }
+}
+
+/** Return the frame interval type of the frame. 0: continuous, otherwise the number of discrete intervals */
+static uint_fast8_t _frm_interval_type(tusb_desc_cs_video_frm_t const *frm)
+{
+  if (VIDEO_CS_ITF_VS_FRAME_FRAME_BASED == frm->bDescriptorSubType) {
+    return frm->frame_based.bFrameIntervalType;
+  }
+  return frm->uncompressed.bFrameIntervalType;
+}
+
+/** Return the default frame interval of the frame in 100 ns units. */
+static uint_fast32_t _frm_default_interval(tusb_desc_cs_video_frm_t const *frm)
 {
-  return (tusb_desc_cs_video_fmt_uncompressed_t const*)
-    _find_desc_3(beg, end, TUSB_DESC_CS_INTERFACE, VIDEO_CS_ITF_VS_FORMAT_UNCOMPRESSED, fmtnum);
+  if (VIDEO_CS_ITF_VS_FRAME_FRAME_BASED == frm->bDescriptorSubType) {
+    return frm->frame_based.dwDefaultFrameInterval;
+  }
+  return frm->uncompressed.dwDefaultFrameInterval;
+}
+
+/** Return the n-th frame interval of the frame in 100 ns units.
+ *
+ * For continuous intervals, 0: min, 1: max, 2: step */
+static uint_fast32_t _frm_interval(tusb_desc_cs_video_frm_t const *frm, uint_fast8_t n)
+{
+  if (VIDEO_CS_ITF_VS_FRAME_FRAME_BASED == frm->bDescriptorSubType) {
+    return frm->frame_based.dwFrameInterval[n];
+  }
+  return frm->uncompressed.dwFrameInterval[n];
 }
 
-/** Find the first frame descriptor with the specified format number. */
-static inline tusb_desc_cs_video_frm_uncompressed_t const *_find_desc_frame(void const *beg, void const *end, uint_fast8_t frmnum)
+/** Return the maximum byte size of a frame.
+ *
+ * Uncompressed frames have a fixed size. The size of a compressed frame varies per frame, so the
+ * maximum is taken from the descriptors or the application instead of the raw frame size.
+ * dwMaxBitRate is not used since it is an average and key frames routinely exceed it. */
+static uint_fast32_t _get_max_frame_size(videod_streaming_interface_t const *stm,
+                                         tusb_desc_cs_video_fmt_t const *fmt,
+                                         tusb_desc_cs_video_frm_t const *frm)
 {
-  return (tusb_desc_cs_video_frm_uncompressed_t const*)
-    _find_desc_3(beg, end, TUSB_DESC_CS_INTERFACE, VIDEO_CS_ITF_VS_FRAME_UNCOMPRESSED, frmnum);
+  switch (fmt->bDescriptorSubType) {
+    case VIDEO_CS_ITF_VS_FORMAT_MJPEG:
+      if (frm->mjpeg.dwMaxVideoFrameBufferSize) return frm->mjpeg.dwMaxVideoFrameBufferSize;
+      /* Not more than YUY2 */
+      return (uint_fast32_t)frm->wWidth * frm->wHeight * 16 / 8;
+
+    case VIDEO_CS_ITF_VS_FORMAT_FRAME_BASED:
+      /* The frame based frame descriptor has no buffer size, ask the application */
+      if (tud_video_max_frame_size_cb) {
+        uint32_t size = tud_video_max_frame_size_cb(stm->index_vc, stm->index_vs,
+                                                    fmt->bFormatIndex, frm->bFrameIndex);
+        if (size) return size;
+      }
+      /* Not more than the raw frame */
+      return (uint_fast32_t)frm->wWidth * frm->wHeight * fmt->frame_based.bBitsPerPixel / 8;
+
+    default:
+      return (uint_fast32_t)frm->wWidth * frm->wHeight * fmt->uncompressed.bBitsPerPixel / 8;
+  }
+}
+
+/** Return true if the streaming interface transfers video data via a bulk endpoint.
+ *
+ * Bulk streaming has the endpoint in the alternate setting 0 instead of alternate settings. */
+static bool _is_bulk_streaming(videod_streaming_interface_t const *stm)
+{
+  void const *desc = _videod_itf[stm->index_vc].beg;
+  void const *beg  = desc + stm->desc.beg;
+  void const *end  = desc + stm->desc.end;
+  if (!((tusb_desc_interface_t const *)beg)->bNumEndpoints) return false;
+  tusb_desc_endpoint_t const *ep = (tusb_desc_endpoint_t const *)_find_desc_ep(tu_desc_next(beg), end);
+  return ((void const*)ep < end) && (TUSB_XFER_BULK == ep->bmAttributes.xfer);
+}
+
+/** Return the maximum payload transfer size for a frame size and a frame interval
+ *
+ * An isochronous payload is sent every frame, so it carries a share of the video frame per
+ * millisecond. A bulk payload spans multiple packets up to the size of the endpoint buffer,
+ * the interval does not matter then.
+ *
+ * @param[in] interval_ms  Frame interval in milliseconds, 0 to send the whole frame in a payload */
+static uint_fast32_t _get_max_payload_transfer_size(videod_streaming_interface_t const *stm,
+                                                    uint_fast32_t frame_size, uint_fast32_t interval_ms)
+{
+  if (_is_bulk_streaming(stm)) {
+    return TU_MIN(frame_size + PAYLOAD_HEADER_LEN, CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE);
+  }
+  if (!interval_ms) return frame_size + PAYLOAD_HEADER_LEN;
+  return (frame_size + interval_ms - 1) / interval_ms + PAYLOAD_HEADER_LEN;
 }
 
 /** Set uniquely determined values to variables that have not been set
@@ -310,7 +480,7 @@ static bool _update_streaming_parameters(videod_streaming_interface_t const *stm
   param->wCompQuality     = 1; /* 1 to 10000 */
   param->wCompWindowSize  = 1; /* GOP size? */
   param->wDelay           = 0; /* milliseconds */
-  param->dwClockFrequency = 27000000; /* same as MPEG-2 system time clock  */
+  param->dwClockFrequency = CFG_TUD_VIDEO_STREAMING_CLOCK_FREQUENCY;
   param->bmFramingInfo    = 0x3; /* enables FrameID and EndOfFrame */
   param->bPreferedVersion = 1;
   param->bMinVersion      = 1;
@@ -319,8 +489,8 @@ static bool _update_streaming_parameters(videod_streaming_interface_t const *stm
   param->bBitDepthLuma    = 8;
 
   void const *end = _end_of_streaming_descriptor(vs);
-  tusb_desc_cs_video_fmt_uncompressed_t const *fmt = _find_desc_format(tu_desc_next(vs), end, fmtnum);
-  TU_ASSERT(fmt != end);
+  tusb_desc_cs_video_fmt_t const *fmt = _find_desc_format(tu_desc_next(vs), end, fmtnum);
+  TU_ASSERT((void const*)fmt != end);
   uint_fast8_t frmnum = param->bFrameIndex;
   TU_ASSERT(frmnum <= fmt->bNumFrameDescriptors);
   if (!frmnum) {
@@ -328,29 +498,29 @@ static bool _update_streaming_parameters(videod_streaming_interface_t const *stm
     frmnum = 1;
     param->bFrameIndex = 1;
   }
-  tusb_desc_cs_video_frm_uncompressed_t const *frm = _find_desc_frame(tu_desc_next(fmt), end, frmnum);
-  TU_ASSERT(frm != end);
+  tusb_desc_cs_video_frm_t const *frm = _find_desc_frame(fmt, end, frmnum);
+  TU_ASSERT((void const*)frm != end);
 
   /* Set the parameters determined by the frame  */
   uint_fast32_t frame_size = param->dwMaxVideoFrameSize;
   if (!frame_size) {
-    frame_size = (uint_fast32_t)frm->wWidth * frm->wHeight * fmt->bBitsPerPixel / 8;
+    frame_size = _get_max_frame_size(stm, fmt, frm);
     param->dwMaxVideoFrameSize = frame_size;
   }
 
   uint_fast32_t interval = param->dwFrameInterval;
   if (!interval) {
-    if ((1 < frm->bFrameIntervalType) ||
-        ((0 == frm->bFrameIntervalType) && (frm->dwFrameInterval[1] != frm->dwFrameInterval[0]))) {
+    uint_fast8_t interval_type = _frm_interval_type(frm);
+    if ((1 < interval_type) ||
+        ((0 == interval_type) && (_frm_interval(frm, 1) != _frm_interval(frm, 0)))) {
       return true;
     }
-    interval = frm->dwFrameInterval[0];
+    interval = _frm_interval(frm, 0);
     param->dwFrameInterval = interval;
   }
   uint_fast32_t interval_ms = interval / 10000;
-  TU_ASSERT(interval_ms);
-  uint_fast32_t payload_size = (frame_size + interval_ms - 1) / interval_ms + 2;
-  param->dwMaxPayloadTransferSize = payload_size;
+  TU_ASSERT(interval_ms || _is_bulk_streaming(stm));
+  param->dwMaxPayloadTransferSize = _get_max_payload_transfer_size(stm, frame_size, interval_ms);
   return true;
 }
 
@@ -380,7 +550,7 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
     param->wCompQuality     = 1; /* 1 to 10000 */
     param->wCompWindowSize  = 1; /* GOP size? */
     param->wDelay           = 0; /* milliseconds */
-    param->dwClockFrequency = 27000000; /* same as MPEG-2 system time clock  */
+    param->dwClockFrequency = CFG_TUD_VIDEO_STREAMING_CLOCK_FREQUENCY;
     param->bmFramingInfo    = 0x3; /* enables FrameID and EndOfFrame */
     param->bPreferedVersion = 1;
     param->bMinVersion      = 1;
@@ -394,7 +564,8 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
   if (!frmnum) {
     tusb_desc_vs_itf_t const *vs = _get_desc_vs(stm);
     void const *end = _end_of_streaming_descriptor(vs);
-    tusb_desc_cs_video_fmt_uncompressed_t const *fmt = _find_desc_format(tu_desc_next(vs), end, fmtnum);
+    tusb_desc_cs_video_fmt_t const *fmt = _find_desc_format(tu_desc_next(vs), end, fmtnum);
+    TU_VERIFY((void const*)fmt != end);
     switch (request) {
       case VIDEO_REQUEST_GET_MAX:
         frmnum = fmt->bNumFrameDescriptors;
@@ -403,31 +574,34 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
         frmnum = 1;
         break;
       case VIDEO_REQUEST_GET_DEF:
-        frmnum = fmt->bDefaultFrameIndex;
+        frmnum = _fmt_default_frame_index(fmt);
         break;
       default: return false;
     }
     param->bFrameIndex = frmnum;
     /* Set the parameters determined by the frame */
-    tusb_desc_cs_video_frm_uncompressed_t const *frm = _find_desc_frame(tu_desc_next(fmt), end, frmnum);
-    param->dwMaxVideoFrameSize = frm->wWidth * frm->wHeight * fmt->bBitsPerPixel / 8;
+    tusb_desc_cs_video_frm_t const *frm = _find_desc_frame(fmt, end, frmnum);
+    TU_VERIFY((void const*)frm != end);
+    param->dwMaxVideoFrameSize = _get_max_frame_size(stm, fmt, frm);
     return true;
   }
 
   if (!param->dwFrameInterval) {
     tusb_desc_vs_itf_t const *vs = _get_desc_vs(stm);
     void const *end = _end_of_streaming_descriptor(vs);
-    tusb_desc_cs_video_fmt_uncompressed_t const *fmt = _find_desc_format(tu_desc_next(vs), end, fmtnum);
-    tusb_desc_cs_video_frm_uncompressed_t const *frm = _find_desc_frame(tu_desc_next(fmt), end, frmnum);
+    tusb_desc_cs_video_fmt_t const *fmt = _find_desc_format(tu_desc_next(vs), end, fmtnum);
+    TU_VERIFY((void const*)fmt != end);
+    tusb_desc_cs_video_frm_t const *frm = _find_desc_frame(fmt, end, frmnum);
+    TU_VERIFY((void const*)frm != end);
 
     uint_fast32_t interval, interval_ms;
     switch (request) {
       case VIDEO_REQUEST_GET_MAX:
         {
           uint_fast32_t min_interval, max_interval;
-          uint_fast8_t num_intervals = frm->bFrameIntervalType;
-          max_interval = num_intervals ? frm->dwFrameInterval[num_intervals - 1]: frm->dwFrameInterval[1];
-          min_interval = frm->dwFrameInterval[0];
+          uint_fast8_t num_intervals = _frm_interval_type(frm);
+          max_interval = _frm_interval(frm, num_intervals ? num_intervals - 1 : 1);
+          min_interval = _frm_interval(frm, 0);
           interval = max_interval;
           interval_ms = min_interval / 10000;
         }
@@ -435,24 +609,24 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
       case VIDEO_REQUEST_GET_MIN:
         {
           uint_fast32_t min_interval, max_interval;
-          uint_fast8_t num_intervals = frm->bFrameIntervalType;
-          max_interval = num_intervals ? frm->dwFrameInterval[num_intervals - 1]: frm->dwFrameInterval[1];
-          min_interval = frm->dwFrameInterval[0];
+          uint_fast8_t num_intervals = _frm_interval_type(frm);
+          max_interval = _frm_interval(frm, num_intervals ? num_intervals - 1 : 1);
+          min_interval = _frm_interval(frm, 0);
           interval = min_interval;
           interval_ms = max_interval / 10000;
         }
         break;
       case VIDEO_REQUEST_GET_DEF:
-        interval = frm->dwDefaultFrameInterval;
+        interval = _frm_default_interval(frm);
         interval_ms = interval / 10000;
         break;
       case VIDEO_REQUEST_GET_RES:
         {
-          uint_fast8_t num_intervals = frm->bFrameIntervalType;
+          uint_fast8_t num_intervals = _frm_interval_type(frm);
           if (num_intervals) {
             interval = 0;
           } else {
-            interval = frm->dwFrameInterval[2];
+            interval = _frm_interval(frm, 2);
             interval_ms = interval / 10000;
           }
         }
@@ -463,18 +637,161 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
     if (!interval) {
       param->dwMaxPayloadTransferSize = 0;
     } else {
-      uint_fast32_t frame_size = param->dwMaxVideoFrameSize;
-      if (!interval_ms) {
-        param->dwMaxPayloadTransferSize = frame_size + 2;
-      } else {
-        param->dwMaxPayloadTransferSize = (frame_size + interval_ms - 1) / interval_ms + 2;
-      }
+      param->dwMaxPayloadTransferSize = _get_max_payload_transfer_size(stm, param->dwMaxVideoFrameSize, interval_ms);
     }
     return true;
   }
   return true;
 }
 
+/** Return the number of frames in the frame queue. */
+static inline uint_fast8_t _queue_count(videod_streaming_interface_t const *stm)
+{
+  uint_fast8_t const depth = 2 * CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE;
+  return (stm->queue.wr + depth - stm->queue.rd) % depth;
+}
+
+/** Advance an index of the frame queue.
+ *
+ * The indices run in [0, 2 * depth) so that a full queue can be distinguished from an empty one. */
+static inline uint8_t _queue_next(uint_fast8_t idx)
+{
+  return (idx + 1) % (2 * CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE);
+}
+
+/** Return the endpoint address for streaming, or 0 if not streaming. */
+static uint_fast8_t _get_ep_addr_streaming(videod_streaming_interface_t const *stm)
+{
+  uint_fast16_t ofs_ep = stm->desc.ep[0];
+  if (!ofs_ep) return 0;
+  return _desc_ep_addr(_videod_itf[stm->index_vc].beg + ofs_ep);
+}
+
+#if CFG_TUD_VIDEO_STREAMING_PTS_SCR
+/** Sample the device clock and the SOF counter for SCR. */
+static bool _get_device_clock(uint32_t *stc, uint16_t *sof)
+{
+  if (tud_video_clock_cb) return tud_video_clock_cb(stc, sof);
+#if CFG_TUD_SOF_CLOCK
+  return tud_sof_clock_get(stc, sof);
+#else
+  return false;
+#endif
+}
+#endif
+
+/** Update PTS and SCR of the payload header.
+ *
+ * The header includes both only if the device clock is available, otherwise the bare header is used. */
+static void _update_payload_header_time(videod_streaming_interface_t *stm)
+{
+#if CFG_TUD_VIDEO_STREAMING_PTS_SCR
+  tusb_video_payload_header_pts_scr_t *hdr = (tusb_video_payload_header_pts_scr_t*)stm->ep_buf;
+  uint32_t stc;
+  uint16_t sof;
+  if (_get_device_clock(&stc, &sof)) {
+    hdr->header.bHeaderLength           = sizeof(*hdr);
+    hdr->header.PresentationTime        = 1;
+    hdr->header.SourceClockReference    = 1;
+    hdr->dwPresentationTime             = stm->pts;
+    hdr->scrSourceTimeClock             = stc;
+    hdr->scrSourceClockSOF              = sof & 0x7FFu;
+  } else {
+    hdr->header.bHeaderLength           = sizeof(hdr->header);
+    hdr->header.PresentationTime        = 0;
+    hdr->header.SourceClockReference    = 0;
+  }
+#else
+  (void)stm;
+#endif
+}
+
+/** Prepare the next packet payload.
+ *
+ * @param[in,out] stm      Streaming interface context.
+ * @param[out]    payload  The head of the payload including the payload header.
+ *
+ * @return Byte length of the payload */
+static uint_fast16_t _prepare_in_payload(videod_streaming_interface_t *stm, uint8_t **payload)
+{
+  _update_payload_header_time(stm);
+  uint_fast32_t remaining = stm->bufsize - stm->offset;
+  uint_fast16_t hdr_len   = stm->ep_buf[0];
+  uint_fast32_t pkt_len   = stm->max_payload_transfer_size;
+  if (hdr_len + remaining < pkt_len) {
+    pkt_len = hdr_len + remaining;
+  }
+  uint_fast16_t data_len = pkt_len - hdr_len;
+  uint8_t *data = stm->buffer + stm->offset;
+  stm->offset += data_len;
+  if (remaining == data_len) {
+    tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
+    hdr->EndOfFrame = 1;
+  }
+#if CFG_TUD_VIDEO_STREAMING_ZERO_COPY
+  if (stm->buffer + hdr_len <= data) {
+    /* The bytes in front of the data have been sent in the previous payload.
+     * Save them and write the payload header there instead of copying the data. */
+    uint8_t *pos = data - hdr_len;
+    memcpy(stm->hdr_save, pos, hdr_len);
+    memcpy(pos, stm->ep_buf, hdr_len);
+    stm->hdr_pos = pos;
+    *payload = pos;
+    return hdr_len + data_len;
+  }
+#endif
+  memcpy(&stm->ep_buf[hdr_len], data, data_len);
+  *payload = stm->ep_buf;
+  return hdr_len + data_len;
+}
+
+/** Restore the frame data overwritten by the payload header of the last payload. */
+static inline void _restore_in_payload(videod_streaming_interface_t *stm)
+{
+#if CFG_TUD_VIDEO_STREAMING_ZERO_COPY
+  if (stm->hdr_pos) {
+    memcpy(stm->hdr_pos, stm->hdr_save, stm->ep_buf[0]);
+    stm->hdr_pos = NULL;
+  }
+#else
+  (void)stm;
+#endif
+}
+
+/** Start transferring the next frame in the queue if no frame is being transferred.
+ *
+ * The endpoint claim arbitrates between the application and the completion handler,
+ * so only one of them dequeues the next frame. */
+static bool _start_next_frame(uint8_t rhport, videod_streaming_interface_t *stm)
+{
+  if (stm->buffer || !_queue_count(stm)) return true;
+  uint_fast8_t ep_addr = _get_ep_addr_streaming(stm);
+  TU_VERIFY(ep_addr);
+  /* The other side is starting the transfer if the endpoint can not be claimed. */
+  if (!usbd_edpt_claim(rhport, ep_addr)) return true;
+  if (stm->buffer || !_queue_count(stm)) {
+    usbd_edpt_release(rhport, ep_addr);
+    return true;
+  }
+  uint_fast8_t idx = stm->queue.rd % CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE;
+  stm->buffer    = stm->queue.frm[idx].buffer;
+  stm->bufsize   = stm->queue.frm[idx].bufsize;
+#if CFG_TUD_VIDEO_STREAMING_PTS_SCR
+  stm->pts       = stm->queue.frm[idx].pts;
+#endif
+  stm->offset    = 0;
+  stm->queue.rd  = _queue_next(stm->queue.rd);
+  /* update the packet header */
+  tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
+  hdr->FrameID   ^= 1;
+  hdr->EndOfFrame = 0;
+  /* update the packet data */
+  uint8_t *payload;
+  uint_fast16_t pkt_len = _prepare_in_payload(stm, &payload);
+  TU_ASSERT( usbd_edpt_xfer(rhport, ep_addr, payload, pkt_len) );
+  return true;
+}
+
 /** Close current video control interface.
  *
  * @param[in,out] self     Video control interface context.
@@ -536,18 +853,13 @@ static bool _open_vc_itf(uint8_t rhport, videod_interface_t *self, uint_fast8_t
   return true;
 }
 
-/** Set the alternate setting to own video streaming interface.
+/** Close endpoints of the current settings and drop all frames.
  *
- * @param[in,out] stm      Streaming interface context.
- * @param[in]     altnum   The target alternate setting number. */
-static bool _open_vs_itf(uint8_t rhport, videod_streaming_interface_t *stm, uint_fast8_t altnum)
+ * @param[in,out] stm      Streaming interface context. */
+static void _close_vs_endpoints(uint8_t rhport, videod_streaming_interface_t *stm)
 {
-  uint_fast8_t i;
-  TU_LOG2("    reopen VS %d\n", altnum);
   void const *desc = _videod_itf[stm->index_vc].beg;
-
-  /* Close endpoints of previous settings. */
-  for (i = 0; i < TU_ARRAY_SIZE(stm->desc.ep); ++i) {
+  for (uint_fast8_t i = 0; i < TU_ARRAY_SIZE(stm->desc.ep); ++i) {
     uint_fast16_t ofs_ep = stm->desc.ep[i];
     if (!ofs_ep) break;
     uint_fast8_t  ep_adr = _desc_ep_addr(desc + ofs_ep);
@@ -556,27 +868,25 @@ static bool _open_vs_itf(uint8_t rhport, videod_streaming_interface_t *stm, uint
     TU_LOG2("    close EP%02x\n", ep_adr);
   }
   /* clear transfer management information */
-  stm->buffer  = NULL;
-  stm->bufsize = 0;
-  stm->offset  = 0;
+  _restore_in_payload(stm);
+  stm->buffer   = NULL;
+  stm->bufsize  = 0;
+  stm->offset   = 0;
+  stm->queue.rd = 0;
+  stm->queue.wr = 0;
+}
 
-  /* Find a alternate interface */
-  void const *beg = desc + stm->desc.beg;
-  void const *end = desc + stm->desc.end;
-  void const *cur = _find_desc_itf(beg, end, _desc_itfnum(beg), altnum);
-  TU_VERIFY(cur < end);
+/** Open endpoints of the current settings with the negotiated parameters.
+ *
+ * @param[in,out] stm      Streaming interface context. */
+static bool _open_vs_endpoints(uint8_t rhport, videod_streaming_interface_t *stm)
+{
+  void const *desc = _videod_itf[stm->index_vc].beg;
+  void const *end  = desc + stm->desc.end;
+  void const *cur  = desc + stm->desc.cur;
   uint_fast8_t numeps = ((tusb_desc_interface_t const *)cur)->bNumEndpoints;
   TU_ASSERT(numeps <= TU_ARRAY_SIZE(stm->desc.ep));
-  stm->desc.cur = cur - desc; /* Save the offset of the new settings */
-  if (!altnum) {
-    /* initialize streaming settings */
-    stm->max_payload_transfer_size = 0;
-    video_probe_and_commit_control_t *param =
-      (video_probe_and_commit_control_t *)&stm->ep_buf;
-    tu_memclr(param, sizeof(*param));
-    return _update_streaming_parameters(stm, param);
-  }
-  /* Open endpoints of the new settings. */
+  uint_fast8_t i;
   for (i = 0, cur = tu_desc_next(cur); i < numeps; ++i, cur = tu_desc_next(cur)) {
     cur = _find_desc_ep(cur, end);
     TU_ASSERT(cur < end);
@@ -605,24 +915,35 @@ static bool _open_vs_itf(uint8_t rhport, videod_streaming_interface_t *stm, uint
   return true;
 }
 
-/** Prepare the next packet payload. */
-static uint_fast16_t _prepare_in_payload(videod_streaming_interface_t *stm)
+/** Set the alternate setting to own video streaming interface.
+ *
+ * @param[in,out] stm      Streaming interface context.
+ * @param[in]     altnum   The target alternate setting number. */
+static bool _open_vs_itf(uint8_t rhport, videod_streaming_interface_t *stm, uint_fast8_t altnum)
 {
-  uint_fast16_t remaining = stm->bufsize - stm->offset;
-  uint_fast16_t hdr_len   = stm->ep_buf[0];
-  uint_fast16_t pkt_len   = stm->max_payload_transfer_size;
-  if (hdr_len + remaining < pkt_len) {
-    pkt_len = hdr_len + remaining;
-  }
-  uint_fast16_t data_len = pkt_len - hdr_len;
-  memcpy(&stm->ep_buf[hdr_len], stm->buffer + stm->offset, data_len);
-  stm->offset += data_len;
-  remaining -= data_len;
-  if (!remaining) {
-    tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
-    hdr->EndOfFrame = 1;
+  TU_LOG2("    reopen VS %d\n", altnum);
+  void const *desc = _videod_itf[stm->index_vc].beg;
+
+  /* Close endpoints of previous settings. */
+  _close_vs_endpoints(rhport, stm);
+
+  /* Find a alternate interface */
+  void const *beg = desc + stm->desc.beg;
+  void const *end = desc + stm->desc.end;
+  void const *cur = _find_desc_itf(beg, end, _desc_itfnum(beg), altnum);
+  TU_VERIFY(cur < end);
+  stm->desc.cur = cur - desc; /* Save the offset of the new settings */
+  if (!altnum) {
+    /* initialize streaming settings */
+    stm->max_payload_transfer_size = 0;
+    video_probe_and_commit_control_t *param =
+      (video_probe_and_commit_control_t *)&stm->ep_buf;
+    tu_memclr(param, sizeof(*param));
+    /* Endpoints of bulk streaming are opened by VS_COMMIT_CONTROL */
+    return _update_streaming_parameters(stm, param);
   }
-  return hdr_len + data_len;
+  /* Open endpoints of the new settings. */
+  return _open_vs_endpoints(rhport, stm);
 }
 
 /** Handle a standard request to the video control interface. */
@@ -840,10 +1161,10 @@ static int handle_video_stm_cs_req(uint8_t rhport, uint8_t stage,
           if (stage == CONTROL_STAGE_SETUP)
           {
             TU_VERIFY(request->wLength, VIDEO_ERROR_UNKNOWN);
-            video_probe_and_commit_control_t tmp;
-            tmp = *(video_probe_and_commit_control_t*)&self->ep_buf;
-            TU_VERIFY(_negotiate_streaming_parameters(self, request->bRequest, &tmp), VIDEO_ERROR_INVALID_VALUE_WITHIN_RANGE);
-            TU_VERIFY(tud_control_xfer(rhport, request, self->ep_buf, sizeof(video_probe_and_commit_control_t)), VIDEO_ERROR_UNKNOWN);
+            video_probe_and_commit_control_t *tmp = &_videod_probe_reply;
+            *tmp = *(video_probe_and_commit_control_t*)&self->ep_buf;
+            TU_VERIFY(_negotiate_streaming_parameters(self, request->bRequest, tmp), VIDEO_ERROR_INVALID_VALUE_WITHIN_RANGE);
+            TU_VERIFY(tud_control_xfer(rhport, request, tmp, sizeof(*tmp)), VIDEO_ERROR_UNKNOWN);
           }
           return VIDEO_ERROR_NONE;
 
@@ -877,7 +1198,14 @@ static int handle_video_stm_cs_req(uint8_t rhport, uint8_t stage,
           } else if (stage == CONTROL_STAGE_ACK) {
             TU_VERIFY(_update_streaming_parameters(self, (video_probe_and_commit_control_t*)self->ep_buf), VIDEO_ERROR_INVALID_VALUE_WITHIN_RANGE);
             if (tud_video_commit_cb) {
-              return tud_video_commit_cb(self->index_vc, self->index_vs, (video_probe_and_commit_control_t*)self->ep_buf);
+              int err = tud_video_commit_cb(self->index_vc, self->index_vs, (video_probe_and_commit_control_t*)self->ep_buf);
+              if (err) return err;
+            }
+            if (_is_bulk_streaming(self)) {
+              /* Bulk streaming starts by the commit instead of selecting an alternate setting. */
+              _close_vs_endpoints(rhport, self);
+              self->max_payload_transfer_size = 0;
+              TU_VERIFY(_open_vs_endpoints(rhport, self), VIDEO_ERROR_UNKNOWN);
             }
           }
           return VIDEO_ERROR_NONE;
@@ -945,6 +1273,31 @@ static int handle_video_stm_req(uint8_t rhport, uint8_t stage,
   return VIDEO_ERROR_UNKNOWN;
 }
 
+/** Handle a request to the streaming endpoint.
+ *
+ * The host stops bulk streaming by CLEAR_FEATURE(ENDPOINT_HALT). */
+static bool handle_video_stm_ep_req(uint8_t rhport, uint8_t stage,
+                                    tusb_control_request_t const *request)
+{
+  if ((CONTROL_STAGE_SETUP     != stage) ||
+      (TUSB_REQ_TYPE_STANDARD  != request->bmRequestType_bit.type) ||
+      (TUSB_REQ_CLEAR_FEATURE  != request->bRequest) ||
+      (TUSB_REQ_FEATURE_EDPT_HALT != request->wValue)) {
+    return true;
+  }
+  uint_fast8_t ep_addr = tu_u16_low(request->wIndex);
+  for (uint_fast8_t itf = 0; itf < CFG_TUD_VIDEO_STREAMING; ++itf) {
+    videod_streaming_interface_t *stm = &_videod_streaming_itf[itf];
+    if (!stm->desc.beg || (ep_addr != _get_ep_addr_streaming(stm))) continue;
+    if (_is_bulk_streaming(stm)) {
+      TU_LOG2("    stop bulk streaming\n");
+      _close_vs_endpoints(rhport, stm);
+    }
+    return true;
+  }
+  return true;
+}
+
 //--------------------------------------------------------------------+
 // APPLICATION API
 //--------------------------------------------------------------------+
@@ -966,36 +1319,56 @@ bool tud_video_n_streaming(uint_fast8_t ctl_idx, uint_fast8_t stm_idx)
   return true;
 }
 
-bool tud_video_n_frame_xfer(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize)
+/** Queue a frame and start the transfer if no frame is being transferred. */
+static bool _frame_xfer(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize, uint32_t pts)
 {
   TU_ASSERT(ctl_idx < CFG_TUD_VIDEO);
   TU_ASSERT(stm_idx < CFG_TUD_VIDEO_STREAMING);
   if (!buffer || !bufsize) return false;
   videod_streaming_interface_t *stm = _get_instance_streaming(ctl_idx, stm_idx);
-  if (!stm || !stm->desc.ep[0] || stm->buffer) return false;
+  if (!stm || !stm->desc.ep[0]) return false;
+  if (CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE <= _queue_count(stm)) return false;
+
+  /* enqueue the frame */
+  uint_fast8_t idx = stm->queue.wr % CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE;
+  stm->queue.frm[idx].buffer  = (uint8_t*)buffer;
+  stm->queue.frm[idx].bufsize = bufsize;
+#if CFG_TUD_VIDEO_STREAMING_PTS_SCR
+  stm->queue.frm[idx].pts     = pts;
+#else
+  (void)pts;
+#endif
+  stm->queue.wr = _queue_next(stm->queue.wr);
 
-  /* Find EP address */
-  void const *desc = _videod_itf[stm->index_vc].beg;
-  uint_fast8_t ep_addr = 0;
-  for (uint_fast8_t i = 0; i < CFG_TUD_VIDEO_STREAMING; ++i) {
-    uint_fast16_t ofs_ep = stm->desc.ep[i];
-    if (!ofs_ep) continue;
-    ep_addr = _desc_ep_addr(desc + ofs_ep);
-    break;
-  }
-  if (!ep_addr) return false;
+  return _start_next_frame(0, stm);
+}
 
-  TU_VERIFY( usbd_edpt_claim(0, ep_addr));
-  /* update the packet header */
-  tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
-  hdr->FrameID   ^= 1;
-  hdr->EndOfFrame = 0;
-  /* update the packet data */
-  stm->buffer     = (uint8_t*)buffer;
-  stm->bufsize    = bufsize;
-  uint_fast16_t pkt_len = _prepare_in_payload(stm);
-  TU_ASSERT( usbd_edpt_xfer(0, ep_addr, stm->ep_buf, pkt_len), 0);
-  return true;
+bool tud_video_n_frame_xfer(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize)
+{
+  uint32_t pts = 0;
+#if CFG_TUD_VIDEO_STREAMING_PTS_SCR
+  /* Stamp the time the frame is handed over */
+  uint16_t sof;
+  if (tud_video_clock_cb) tud_video_clock_cb(&pts, &sof);
+#if CFG_TUD_SOF_CLOCK
+  else pts = tud_sof_clock_ticks_cb();
+#endif
+#endif
+  return _frame_xfer(ctl_idx, stm_idx, buffer, bufsize, pts);
+}
+
+bool tud_video_n_frame_xfer_pts(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize, uint32_t pts)
+{
+  return _frame_xfer(ctl_idx, stm_idx, buffer, bufsize, pts);
+}
+
+uint_fast8_t tud_video_n_frame_queue_available(uint_fast8_t ctl_idx, uint_fast8_t stm_idx)
+{
+  TU_ASSERT(ctl_idx < CFG_TUD_VIDEO, 0);
+  TU_ASSERT(stm_idx < CFG_TUD_VIDEO_STREAMING, 0);
+  videod_streaming_interface_t *stm = _get_instance_streaming(ctl_idx, stm_idx);
+  if (!stm || !stm->desc.ep[0]) return 0;
+  return CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE - _queue_count(stm);
 }
 
 //--------------------------------------------------------------------+
@@ -1022,6 +1395,8 @@ void videod_reset(uint8_t rhport)
   }
   for (uint_fast8_t i = 0; i < CFG_TUD_VIDEO_STREAMING; ++i) {
     videod_streaming_interface_t *stm = &_videod_streaming_itf[i];
+    /* Give back the frame data under the header of an aborted payload */
+    _restore_in_payload(stm);
     tu_memclr(stm, ITF_STM_MEM_RESET_SIZE);
   }
 }
@@ -1077,6 +1452,9 @@ uint16_t videod_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uin
 bool videod_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request)
 {
   int err;
+  if (TUSB_REQ_RCPT_ENDPOINT == request->bmRequestType_bit.recipient) {
+    return handle_video_stm_ep_req(rhport, stage, request);
+  }
   TU_VERIFY(request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_INTERFACE);
   uint_fast8_t itfnum = tu_u16_low(request->wIndex);
 
@@ -1114,7 +1492,7 @@ bool videod_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_
 
 bool videod_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
 {
-  (void)result; (void)xferred_bytes;
+  (void)result;
 
   /* find streaming handle */
   uint_fast8_t itf;
@@ -1130,11 +1508,22 @@ bool videod_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint3
   }
 
   TU_ASSERT(itf < CFG_TUD_VIDEO_STREAMING);
+  _restore_in_payload(stm);
+  tusb_desc_endpoint_t const *ep = (tusb_desc_endpoint_t const*)(ctl->beg + stm->desc.ep[0]);
+  if ((TUSB_XFER_BULK == ep->bmAttributes.xfer) &&
+      xferred_bytes && (xferred_bytes < stm->max_payload_transfer_size) &&
+      (0 == (xferred_bytes % tu_edpt_packet_size(ep)))) {
+    /* A short bulk payload must be terminated by ZLP, otherwise the host merges it with the next one. */
+    TU_VERIFY( usbd_edpt_claim(rhport, ep_addr), 0);
+    TU_ASSERT( usbd_edpt_xfer(rhport, ep_addr, NULL, 0), 0);
+    return true;
+  }
   if (stm->offset < stm->bufsize) {
     /* Claim the endpoint */
     TU_VERIFY( usbd_edpt_claim(rhport, ep_addr), 0);
-    uint_fast16_t pkt_len = _prepare_in_payload(stm);
-    TU_ASSERT( usbd_edpt_xfer(rhport, ep_addr, stm->ep_buf, pkt_len), 0);
+    uint8_t *payload;
+    uint_fast16_t pkt_len = _prepare_in_payload(stm, &payload);
+    TU_ASSERT( usbd_edpt_xfer(rhport, ep_addr, payload, pkt_len), 0);
   } else {
     stm->buffer  = NULL;
     stm->bufsize = 0;
@@ -1142,6 +1531,7 @@ bool videod_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint3
     if (tud_video_frame_xfer_complete_cb) {
       tud_video_frame_xfer_complete_cb(stm->index_vc, stm->index_vs);
     }
+    TU_ASSERT(_start_next_frame(rhport, stm));
   }
   return true;
 }
@@ -31,6 +31,39 @@
 #include "common/tusb_common.h"
 #include "video.h"
 
+//--------------------------------------------------------------------+
+// Class Driver Configuration
+//--------------------------------------------------------------------+
+
+// Number of frames which can be queued in addition to the frame being transferred.
+// The default allows the application to hand over frame N+1 while frame N is streaming.
+#ifndef CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE
+  #define CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE  1
+#endif
+
+// Send payload data directly from the frame buffer instead of copying it into the
+// endpoint buffer. The payload header is written in place in front of the data, so the
+// frame buffer must be writable while queued, and the DCD must accept unaligned buffers.
+#ifndef CFG_TUD_VIDEO_STREAMING_ZERO_COPY
+  #define CFG_TUD_VIDEO_STREAMING_ZERO_COPY    0
+#endif
+
+// Add the presentation time stamp (PTS) and the source clock reference (SCR) to payload headers.
+// The device clock and the SOF counter are sampled by tud_video_clock_cb(), or taken from
+// the SOF clock service of the device stack if CFG_TUD_SOF_CLOCK is enabled.
+#ifndef CFG_TUD_VIDEO_STREAMING_PTS_SCR
+  #define CFG_TUD_VIDEO_STREAMING_PTS_SCR      0
+#endif
+
+// Frequency of the device clock in Hz reported as dwClockFrequency, PTS and SCR are in this unit
+#ifndef CFG_TUD_VIDEO_STREAMING_CLOCK_FREQUENCY
+  #if CFG_TUD_SOF_CLOCK
+    #define CFG_TUD_VIDEO_STREAMING_CLOCK_FREQUENCY  CFG_TUD_SOF_CLOCK_FREQUENCY
+  #else
+    #define CFG_TUD_VIDEO_STREAMING_CLOCK_FREQUENCY  27000000
+  #endif
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -47,13 +80,31 @@ extern "C" {
 bool tud_video_n_streaming(uint_fast8_t ctl_idx, uint_fast8_t stm_idx);
 
 /** Transfer a frame
+ *
+ * If a frame is being transferred, the frame is queued and sent right after the current one.
  *
  * @param[in] ctl_idx    Destination control interface index
  * @param[in] stm_idx    Destination streaming interface index
  * @param[in] buffer     Frame buffer. The caller must not use this buffer until the operation is completed.
- * @param[in] bufsize    Byte size of the frame buffer */
+ * @param[in] bufsize    Byte size of the frame. For compressed formats (MJPEG, frame based) the size
+ *                       may vary per frame up to the negotiated dwMaxVideoFrameSize.
+ * @return false if not streaming or the frame queue is full */
 bool tud_video_n_frame_xfer(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize);
 
+/** Transfer a frame with the presentation time stamp
+ *
+ * Same as tud_video_n_frame_xfer() except that the PTS of the payload headers is
+ * the given capture time instead of the time the frame is queued.
+ *
+ * @param[in] pts        Capture time of the frame in the device clock. See tud_video_clock_cb() */
+bool tud_video_n_frame_xfer_pts(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize, uint32_t pts);
+
+/** Return the number of frames which can be queued by tud_video_n_frame_xfer()
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index */
+uint_fast8_t tud_video_n_frame_queue_available(uint_fast8_t ctl_idx, uint_fast8_t stm_idx);
+
 /*------------- Optional callbacks -------------*/
 /** Invoked when compeletion of a frame transfer
  *
@@ -65,6 +116,30 @@ TU_ATTR_WEAK void tud_video_frame_xfer_complete_cb(uint_fast8_t ctl_idx, uint_fa
 // Application Callback API (weak is optional)
 //--------------------------------------------------------------------+
 
+/** Invoked to sample the device clock for PTS and SCR of payload headers
+ *
+ * Required only if CFG_TUD_VIDEO_STREAMING_PTS_SCR is enabled without CFG_TUD_SOF_CLOCK.
+ * If CFG_TUD_SOF_CLOCK is enabled, the local clock sampled at the latest SOF is used by default.
+ *
+ * @param[out] stc   Device clock in CFG_TUD_VIDEO_STREAMING_CLOCK_FREQUENCY Hz
+ * @param[out] sof   USB frame number (1 kHz SOF counter) when stc is sampled
+ * @return false if the clock is not available. PTS and SCR are omitted then. */
+TU_ATTR_WEAK bool tud_video_clock_cb(uint32_t *stc, uint16_t *sof);
+
+/** Invoked to get the maximum byte size of a frame of a frame based format
+ *
+ * Frame based frame descriptors have no buffer size, so dwMaxVideoFrameSize is negotiated from
+ * the value returned here. If not implemented or 0 is returned, the raw frame size
+ * wWidth * wHeight * bBitsPerPixel / 8 is used.
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index
+ * @param[in] fmt_idx    bFormatIndex of the format descriptor
+ * @param[in] frm_idx    bFrameIndex of the frame descriptor
+ * @return maximum byte size of a frame including key frames */
+TU_ATTR_WEAK uint32_t tud_video_max_frame_size_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx,
+                                                  uint_fast8_t fmt_idx, uint_fast8_t frm_idx);
+
 /** Invoked when SET_POWER_MODE request received
  *
  * @param[in] ctl_idx    Destination control interface index
@@ -249,6 +249,11 @@ enum
   INTERFACE_INVALID_NUMBER = 0xff
 };
 
+enum
+{
+  TUSB_INDEX_INVALID = 0xff
+};
+
 
 typedef enum
 {
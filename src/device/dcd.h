@@ -78,6 +78,13 @@ typedef struct TU_ATTR_ALIGNED(4)
       tusb_speed_t speed;
     } bus_reset;
 
+    // SOF
+    struct {
+      uint32_t frame_count;  // USB frame number of the SOF
+      bool     frame_valid;  // false if the DCD does not report the frame number
+      bool     microframe;   // SOF is signaled every microframe (high speed), otherwise once per frame
+    }sof;
+
     // SETUP_RECEIVED
     tusb_control_request_t setup_received;
 
@@ -133,6 +140,9 @@ void dcd_connect(uint8_t rhport) TU_ATTR_WEAK;
 // Disconnect by disabling internal pull-up resistor on D+/D-
 void dcd_disconnect(uint8_t rhport) TU_ATTR_WEAK;
 
+// Enable/Disable Start-of-frame interrupt. Default is disabled
+void dcd_sof_enable(uint8_t rhport, bool en) TU_ATTR_WEAK;
+
 //--------------------------------------------------------------------+
 // Endpoint API
 //--------------------------------------------------------------------+
@@ -141,6 +151,10 @@ void dcd_disconnect(uint8_t rhport) TU_ATTR_WEAK;
 // May help DCD to prepare for next control transfer, this API is optional.
 void dcd_edpt0_status_complete(uint8_t rhport, tusb_control_request_t const * request) TU_ATTR_WEAK;
 
+// Invoked by SET_CONFIGURATION before endpoints of the configuration are opened, endpoints of all
+// alternate settings are in the descriptor. May help DCD to plan endpoint memory, this API is optional.
+void dcd_edpt_plan            (uint8_t rhport, tusb_desc_configuration_t const * desc_cfg) TU_ATTR_WEAK;
+
 // Configure endpoint's registers according to descriptor
 bool dcd_edpt_open            (uint8_t rhport, tusb_desc_endpoint_t const * desc_ep);
 
@@ -180,6 +194,11 @@ extern void dcd_event_bus_signal (uint8_t rhport, dcd_eventid_t eid, bool in_isr
 // helper to send bus reset event
 extern void dcd_event_bus_reset (uint8_t rhport, tusb_speed_t speed, bool in_isr);
 
+// helper to send SOF event with the frame number read from the controller.
+// microframe is true if the controller signals SOF every microframe in high speed, false if once per frame.
+// SOF sent by dcd_event_bus_signal() is taken as once per frame.
+extern void dcd_event_sof(uint8_t rhport, uint32_t frame_count, bool microframe, bool in_isr);
+
 // helper to send setup received
 extern void dcd_event_setup_received(uint8_t rhport, uint8_t const * setup, bool in_isr);
 
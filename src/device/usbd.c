@@ -83,6 +83,29 @@ typedef struct
 
 static usbd_device_t _usbd_dev;
 
+#if CFG_TUD_SOF_CLOCK
+
+#ifndef CFG_TUD_SOF_CLOCK_FREQUENCY
+  #error "CFG_TUD_SOF_CLOCK_FREQUENCY must be defined as the nominal frequency of the local clock"
+#endif
+
+// Local clock sampled at SOF, updated in ISR
+typedef struct
+{
+  volatile uint32_t sof_count;     // number of SOFs since bus reset
+  volatile uint32_t ticks;         // local clock at the latest SOF
+  volatile uint32_t ticks_per_sof; // averaged ticks per SOF interval in 24.8 format
+  volatile uint16_t frame_number;  // USB frame number of the latest SOF
+
+  uint8_t  speed;
+  uint32_t win_count;              // sof_count at the start of the current measurement
+  uint32_t win_ticks;              // local clock at the start of the current measurement
+}usbd_sof_clock_t;
+
+static usbd_sof_clock_t _usbd_sof_clock;
+
+#endif
+
 //--------------------------------------------------------------------+
 // Class Driver
 //--------------------------------------------------------------------+
@@ -498,7 +521,7 @@ void tud_task (void)
   {
     dcd_event_t event;
 
-    if ( !osal_queue_receive(_usbd_q, &event) ) return;
+    if ( !osal_queue_receive(_usbd_q, &event, OSAL_TIMEOUT_WAIT_FOREVER) ) return;
 
 #if CFG_TUSB_DEBUG >= 2
     if (event.event_id == DCD_EVENT_SETUP_RECEIVED) TU_LOG2("\r\n"); // extra line for setup
@@ -894,6 +917,9 @@ static bool process_set_config(uint8_t rhport, uint8_t cfg_num)
   _usbd_dev.remote_wakeup_support = (desc_cfg->bmAttributes & TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP) ? 1 : 0;
   _usbd_dev.self_powered          = (desc_cfg->bmAttributes & TUSB_DESC_CONFIG_ATT_SELF_POWERED ) ? 1 : 0;
 
+  // Let DCD plan endpoint memory for the whole configuration
+  if ( dcd_edpt_plan ) dcd_edpt_plan(rhport, desc_cfg);
+
   // Parse interface descriptor
   uint8_t const * p_desc   = ((uint8_t const*) desc_cfg) + sizeof(tusb_desc_configuration_t);
   uint8_t const * desc_end = ((uint8_t const*) desc_cfg) + tu_le16toh(desc_cfg->wTotalLength);
@@ -1084,6 +1110,99 @@ static bool process_get_descriptor(uint8_t rhport, tusb_control_request_t const
   }
 }
 
+//--------------------------------------------------------------------+
+// SOF Clock Recovery
+//--------------------------------------------------------------------+
+#if CFG_TUD_SOF_CLOCK
+
+// Nominal ticks per SOF interval in 24.8 format
+static inline uint32_t sof_clock_nominal(bool high_speed)
+{
+  return (uint32_t) (((uint64_t) CFG_TUD_SOF_CLOCK_FREQUENCY << 8) / (high_speed ? 8000u : 1000u));
+}
+
+static void sof_clock_reset(uint8_t speed)
+{
+  tu_varclr(&_usbd_sof_clock);
+  _usbd_sof_clock.speed = speed;
+}
+
+// Called in ISR on every SOF
+static void sof_clock_sample(dcd_event_t const * event)
+{
+  usbd_sof_clock_t* clk = &_usbd_sof_clock;
+  bool const high_speed = (clk->speed == TUSB_SPEED_HIGH);
+  bool const microframe = event->sof.microframe;
+
+  uint32_t const now   = tud_sof_clock_ticks_cb();
+  uint32_t const count = clk->sof_count + 1;
+
+  // Without frame number from DCD, count it ourselves (8 microframes per frame)
+  uint32_t const frame = event->sof.frame_valid ? event->sof.frame_count : (microframe ? count >> 3 : count);
+
+  clk->ticks        = now;
+  clk->frame_number = (uint16_t) (frame & 0x7FFu);
+  clk->sof_count    = count; // update last, readers check it for consistency
+
+  if ( count == 1 )
+  {
+    clk->win_count = count;
+    clk->win_ticks = now;
+    return;
+  }
+
+  uint32_t const n = count - clk->win_count;
+  if ( n < CFG_TUD_SOF_CLOCK_INTERVAL ) return;
+
+  uint32_t tps = (uint32_t) (((uint64_t) (now - clk->win_ticks) << 8) / n);
+
+  // ticks_per_sof is per microframe in high speed, scale it if the DCD signals SOF once per frame
+  if ( high_speed && !microframe ) tps /= 8;
+
+  // Moving average to filter out SOF interrupt latency
+  if ( clk->ticks_per_sof == 0 )
+  {
+    clk->ticks_per_sof = tps;
+  }else
+  {
+    clk->ticks_per_sof = (uint32_t) ((int32_t) clk->ticks_per_sof + ((int32_t) (tps - clk->ticks_per_sof)) / 8);
+  }
+
+  clk->win_count = count;
+  clk->win_ticks = now;
+}
+
+bool tud_sof_clock_get(uint32_t* ticks, uint16_t* frame_number)
+{
+  uint32_t count;
+
+  // retry if SOF ISR kicks in while reading
+  do
+  {
+    count         = _usbd_sof_clock.sof_count;
+    *ticks        = _usbd_sof_clock.ticks;
+    *frame_number = _usbd_sof_clock.frame_number;
+  } while ( count != _usbd_sof_clock.sof_count );
+
+  return count != 0;
+}
+
+uint32_t tud_sof_clock_ticks_per_sof(void)
+{
+  return _usbd_sof_clock.ticks_per_sof;
+}
+
+int32_t tud_sof_clock_drift_ppm(void)
+{
+  uint32_t const tps = _usbd_sof_clock.ticks_per_sof;
+  TU_VERIFY(tps, 0);
+
+  int64_t const nominal = sof_clock_nominal(_usbd_sof_clock.speed == TUSB_SPEED_HIGH);
+  return (int32_t) ((((int64_t) tps) - nominal) * 1000000 / nominal);
+}
+
+#endif
+
 //--------------------------------------------------------------------+
 // DCD Event Handler
 //--------------------------------------------------------------------+
@@ -1091,6 +1210,14 @@ void dcd_event_handler(dcd_event_t const * event, bool in_isr)
 {
   switch (event->event_id)
   {
+    case DCD_EVENT_BUS_RESET:
+      #if CFG_TUD_SOF_CLOCK
+      sof_clock_reset(event->bus_reset.speed);
+      if ( dcd_sof_enable ) dcd_sof_enable(event->rhport, true);
+      #endif
+      osal_queue_send(_usbd_q, event, in_isr);
+    break;
+
     case DCD_EVENT_UNPLUGGED:
       _usbd_dev.connected  = 0;
       _usbd_dev.addressed  = 0;
@@ -1129,6 +1256,10 @@ void dcd_event_handler(dcd_event_t const * event, bool in_isr)
         dcd_event_t const event_resume = { .rhport = event->rhport, .event_id = DCD_EVENT_RESUME };
         osal_queue_send(_usbd_q, &event_resume, in_isr);
       }
+
+      #if CFG_TUD_SOF_CLOCK
+      sof_clock_sample(event);
+      #endif
     break;
 
     default:
@@ -1150,6 +1281,15 @@ void dcd_event_bus_reset (uint8_t rhport, tusb_speed_t speed, bool in_isr)
   dcd_event_handler(&event, in_isr);
 }
 
+void dcd_event_sof(uint8_t rhport, uint32_t frame_count, bool microframe, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_SOF };
+  event.sof.frame_count = frame_count;
+  event.sof.frame_valid = true;
+  event.sof.microframe  = microframe;
+  dcd_event_handler(&event, in_isr);
+}
+
 void dcd_event_setup_received(uint8_t rhport, uint8_t const * setup, bool in_isr)
 {
   dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_SETUP_RECEIVED };
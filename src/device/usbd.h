@@ -92,6 +92,19 @@ bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const * request, vo
 // Send STATUS (zero length) packet
 bool tud_control_status(uint8_t rhport, tusb_control_request_t const * request);
 
+#if CFG_TUD_SOF_CLOCK
+// Get the local clock and the USB frame number sampled at the latest SOF
+// Return false if no SOF is received since bus reset
+bool tud_sof_clock_get(uint32_t* ticks, uint16_t* frame_number);
+
+// Average local clock ticks per SOF interval (1ms for FS, 125us for HS) in 24.8 format
+// Return 0 if not measured yet
+uint32_t tud_sof_clock_ticks_per_sof(void);
+
+// Drift of the local clock against the host clock in ppm, positive if the local clock is faster
+int32_t tud_sof_clock_drift_ppm(void);
+#endif
+
 //--------------------------------------------------------------------+
 // Application Callbacks (WEAK is optional)
 //--------------------------------------------------------------------+
@@ -139,6 +152,12 @@ TU_ATTR_WEAK void tud_resume_cb(void);
 // Invoked when received control request with VENDOR TYPE
 TU_ATTR_WEAK bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request);
 
+#if CFG_TUD_SOF_CLOCK
+// Invoked in ISR on every SOF, return the free-running local clock e.g a cycle counter or
+// a timer clocked by the audio/video master clock, running at CFG_TUD_SOF_CLOCK_FREQUENCY
+uint32_t tud_sof_clock_ticks_cb(void);
+#endif
+
 //--------------------------------------------------------------------+
 // Binary Device Object Store (BOS) Descriptor Templates
 //--------------------------------------------------------------------+
@@ -32,6 +32,8 @@
 // Attribute includes
 // - ENDPOINT_MAX: max (logical) number of endpoint
 // - PORT_HIGHSPEED: mask to indicate which port support highspeed mode, bit0 for port0 and so on.
+// - CONTROL_SHARED: only one control pipe for all devices, control transfers of different
+//   devices are serialized by usbh
 
 //------------- NXP -------------//
 #if TU_CHECK_MCU(OPT_MCU_LPC175X_6X, OPT_MCU_LPC177X_8X, OPT_MCU_LPC40XX)
@@ -80,6 +82,11 @@
 
 //------------- Raspberry Pi -------------//
 #elif TU_CHECK_MCU(OPT_MCU_RP2040)
+  #define HCD_ATTR_CONTROL_SHARED
+
+//------------- TI -------------//
+#elif TU_CHECK_MCU(OPT_MCU_MSP432E4, OPT_MCU_TM4C123, OPT_MCU_TM4C129)
+  #define HCD_ATTR_CONTROL_SHARED
 
 //------------- Silabs -------------//
 #elif TU_CHECK_MCU(OPT_MCU_EFM32GG)
@@ -274,32 +274,40 @@ static bool config_port_power_complete (uint8_t dev_addr, tusb_control_request_t
 
 static bool connection_get_status_complete (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
 static bool connection_clear_conn_change_complete (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
-static bool connection_port_reset_complete (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
 
-// callback as response of interrupt endpoint polling
-bool hub_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+// Handle ports with status change one at a time, then queue status pipe for next changes.
+// If a request cannot be queued (e.g control queue is full with enumeration of other ports),
+// status pipe is also queued: since the change is not cleared, hub will report it again.
+static bool connection_process_next_port(uint8_t dev_addr)
 {
-  (void) xferred_bytes; // TODO can be more than 1 for hub with lots of ports
-  (void) ep_addr;
-  TU_ASSERT(result == XFER_RESULT_SUCCESS);
-
   hub_interface_t* p_hub = get_itf(dev_addr);
 
-  TU_LOG2("  Port Status Change = 0x%02X\r\n", p_hub->status_change);
-
   // Hub ignore bit0 in status change
   for (uint8_t port=1; port <= p_hub->port_count; port++)
   {
     if ( tu_bit_test(p_hub->status_change, port) )
     {
-      hub_port_get_status(dev_addr, port, &p_hub->port_status, connection_get_status_complete);
+      p_hub->status_change = (uint8_t) tu_bit_clear(p_hub->status_change, port);
+
+      if ( hub_port_get_status(dev_addr, port, &p_hub->port_status, connection_get_status_complete) ) return true;
       break;
     }
   }
 
-  // NOTE: next status transfer is queued by usbh.c after handling this request
+  // all changed ports are handled, waiting for next data on status pipe
+  return hub_status_pipe_queue(dev_addr);
+}
+
+// callback as response of interrupt endpoint polling
+bool hub_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+  (void) xferred_bytes; // TODO can be more than 1 for hub with lots of ports
+  (void) ep_addr;
+  TU_ASSERT(result == XFER_RESULT_SUCCESS);
 
-  return true;
+  TU_LOG2("  Port Status Change = 0x%02X\r\n", get_itf(dev_addr)->status_change);
+
+  return connection_process_next_port(dev_addr);
 }
 
 static bool connection_get_status_complete (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
@@ -316,18 +324,17 @@ static bool connection_get_status_complete (uint8_t dev_addr, tusb_control_reque
     //TU_VERIFY(port_status.status_current.port_power && port_status.status_current.port_enable, );
 
     // Acknowledge Port Connection Change
-    hub_port_clear_feature(dev_addr, port_num, HUB_FEATURE_PORT_CONNECTION_CHANGE, connection_clear_conn_change_complete);
+    if ( hub_port_clear_feature(dev_addr, port_num, HUB_FEATURE_PORT_CONNECTION_CHANGE, connection_clear_conn_change_complete) ) return true;
+
+    return hub_status_pipe_queue(dev_addr);
   }else
   {
     // Other changes are: Enable, Suspend, Over Current, Reset, L1 state
     // TODO clear change
+    // Reset change is acknowledged by enumeration in usbh.c
 
-    // prepare for next hub status
-    // TODO continue with status_change, or maybe we can do it again with status
-    hub_status_pipe_queue(dev_addr);
+    return connection_process_next_port(dev_addr);
   }
-
-  return true;
 }
 
 static bool connection_clear_conn_change_complete (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
@@ -337,42 +344,11 @@ static bool connection_clear_conn_change_complete (uint8_t dev_addr, tusb_contro
   hub_interface_t* p_hub = get_itf(dev_addr);
   uint8_t const port_num = (uint8_t) request->wIndex;
 
-  if ( p_hub->port_status.status.connection )
-  {
-    // Reset port if attach event
-    hub_port_reset(dev_addr, port_num, connection_port_reset_complete);
-  }else
-  {
-    // submit detach event
-    hcd_event_t event =
-    {
-      .rhport     = usbh_get_rhport(dev_addr),
-      .event_id   = HCD_EVENT_DEVICE_REMOVE,
-      .connection =
-       {
-         .hub_addr = dev_addr,
-         .hub_port = port_num
-       }
-    };
-
-    hcd_event_handler(&event, false);
-  }
-
-  return true;
-}
-
-static bool connection_port_reset_complete (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
-{
-  TU_ASSERT(result == XFER_RESULT_SUCCESS);
-
-  // hub_interface_t* p_hub = get_itf(dev_addr);
-  uint8_t const port_num = (uint8_t) request->wIndex;
-
-  // submit attach event
+  // submit attach or detach event, port is reset by usbh.c as part of enumeration
   hcd_event_t event =
   {
     .rhport     = usbh_get_rhport(dev_addr),
-    .event_id   = HCD_EVENT_DEVICE_ATTACH,
+    .event_id   = p_hub->port_status.status.connection ? HCD_EVENT_DEVICE_ATTACH : HCD_EVENT_DEVICE_REMOVE,
     .connection =
     {
       .hub_addr = dev_addr,
@@ -382,7 +358,7 @@ static bool connection_port_reset_complete (uint8_t dev_addr, tusb_control_reque
 
   hcd_event_handler(&event, false);
 
-  return true;
+  return connection_process_next_port(dev_addr);
 }
 
 #endif
@@ -121,6 +121,30 @@ typedef struct {
 
 } usbh_device_t;
 
+// Enumeration of a newly attached device, each device being enumerated has
+// its own slot so that devices on different hub ports are enumerated in parallel
+typedef struct
+{
+  // descriptors and hub port status are read into this buffer
+  CFG_TUSB_MEM_ALIGN uint8_t buf[CFG_TUH_ENUMERATION_BUFSIZE];
+
+  uint8_t state;       // value from enum_state_t
+
+  // port
+  uint8_t rhport;
+  uint8_t hub_addr;
+  uint8_t hub_port;
+  uint8_t speed;
+
+  uint8_t dev_addr;    // assigned address, 0 until SET_ADDRESS
+  uint8_t ep0_size;    // 0 until the first 8 bytes of device descriptor is received
+  bool    is_hub;
+  uint8_t reset_poll;  // number of port status polls waiting for hub port reset
+
+  uint32_t timer_start; // frame number when timer is started
+  uint16_t timer_ms;    // 0 if timer is not running
+} usbh_enum_t;
+
 
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF
@@ -208,6 +232,12 @@ enum { USBH_CLASS_DRIVER_COUNT = TU_ARRAY_SIZE(usbh_class_drivers) };
 
 enum { RESET_DELAY = 500 };  // 200 USB specs say only 50ms but many devices require much longer
 
+// Hub port reset is complete when hub reports it, port status is polled with this interval
+enum { HUB_RESET_POLL_INTERVAL = 10, HUB_RESET_POLL_MAX = 10 };
+
+// Recovery time after hub port reset before addressing device: specs TRSTRCY is 10ms, give some margin
+enum { RESET_RECOVERY_DELAY = 50 };
+
 enum { CONFIG_NUM = 1 }; // default to use configuration 1
 
 
@@ -229,7 +259,19 @@ CFG_TUSB_MEM_SECTION usbh_device_t _usbh_devices[CFG_TUH_DEVICE_MAX + CFG_TUH_HU
 OSAL_QUEUE_DEF(OPT_MODE_HOST, _usbh_qdef, CFG_TUH_TASK_QUEUE_SZ, hcd_event_t);
 static osal_queue_t _usbh_q;
 
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t _usbh_ctrl_buf[CFG_TUH_ENUMERATION_BUFSIZE];
+// Devices being enumerated
+CFG_TUSB_MEM_SECTION static usbh_enum_t _usbh_enum[CFG_TUH_ENUMERATION_MAX];
+
+// Attached ports waiting for a free enumeration slot
+typedef struct
+{
+  uint8_t rhport;
+  uint8_t hub_addr;
+  uint8_t hub_port;
+} usbh_enum_pending_t;
+
+static usbh_enum_pending_t _enum_pending[CFG_TUH_DEVICE_MAX];
+static uint8_t _enum_pending_count;
 
 //------------- Helper Function -------------//
 
@@ -240,12 +282,15 @@ static inline usbh_device_t* get_device(uint8_t dev_addr)
   return &_usbh_devices[dev_addr-1];
 }
 
-static bool enum_new_device(hcd_event_t* event);
+static bool enum_new_device(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port);
+static void enum_timer_process(void);
+static uint32_t enum_timer_remaining(void);
 static void process_device_unplugged(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port);
 static bool usbh_edpt_control_open(uint8_t dev_addr, uint8_t max_packet_size);
 
 // from usbh_control.c
 extern bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+extern void usbh_control_close(uint8_t dev_addr);
 
 //--------------------------------------------------------------------+
 // PUBLIC API (Parameter Verification is required)
@@ -259,10 +304,11 @@ bool tuh_vid_pid_get(uint8_t dev_addr, uint16_t* vid, uint16_t* pid)
 {
   *vid = *pid = 0;
 
-  TU_VERIFY(tuh_mounted(dev_addr));
-
   usbh_device_t const* dev = get_device(dev_addr);
 
+  // available once device descriptor is read, class driver may need it when opening interface
+  TU_VERIFY(dev->addressed);
+
   *vid = dev->vid;
   *pid = dev->pid;
 
@@ -302,6 +348,7 @@ bool tuh_init(uint8_t rhport)
 
   tu_memclr(_usbh_devices, sizeof(_usbh_devices));
   tu_memclr(&_dev0, sizeof(_dev0));
+  tu_memclr(_usbh_enum, sizeof(_usbh_enum));
 
   //------------- Enumeration & Reporter Task init -------------//
   _usbh_q = osal_queue_create( &_usbh_qdef );
@@ -361,30 +408,27 @@ void tuh_task(void)
   // Loop until there is no more events in the queue
   while (1)
   {
+    // Enumeration delays are timers instead of blocking, process the expired ones
+    enum_timer_process();
+
+    // RTOS only wait until the next enumeration timer expires
     hcd_event_t event;
-    if ( !osal_queue_receive(_usbh_q, &event) ) return;
+    if ( !osal_queue_receive(_usbh_q, &event, enum_timer_remaining()) )
+    {
+      enum_timer_process();
+      return;
+    }
 
     switch (event.event_id)
     {
       case HCD_EVENT_DEVICE_ATTACH:
-        // TODO due to the shared _usbh_ctrl_buf, we must complete enumerating
-        // one device before enumerating another one.
         TU_LOG2("USBH DEVICE ATTACH\r\n");
-        enum_new_device(&event);
+        enum_new_device(event.rhport, event.connection.hub_addr, event.connection.hub_port);
       break;
 
       case HCD_EVENT_DEVICE_REMOVE:
         TU_LOG2("USBH DEVICE REMOVED\r\n");
         process_device_unplugged(event.rhport, event.connection.hub_addr, event.connection.hub_port);
-
-        #if CFG_TUH_HUB
-        // TODO remove
-        if ( event.connection.hub_addr != 0)
-        {
-          // done with hub, waiting for next data on status pipe
-          (void) hub_status_pipe_queue( event.connection.hub_addr );
-        }
-        #endif
       break;
 
       case HCD_EVENT_XFER_COMPLETE:
@@ -440,9 +484,12 @@ uint8_t usbh_get_rhport(uint8_t dev_addr)
   return (dev_addr == 0) ? _dev0.rhport : get_device(dev_addr)->rhport;
 }
 
-uint8_t* usbh_get_enum_buf(void)
+static usbh_enum_t* enum_find_by_addr(uint8_t dev_addr);
+
+uint8_t* usbh_get_enum_buf(uint8_t dev_addr)
 {
-  return _usbh_ctrl_buf;
+  usbh_enum_t* e = enum_find_by_addr(dev_addr);
+  return e ? e->buf : NULL;
 }
 
 //--------------------------------------------------------------------+
@@ -525,41 +572,64 @@ void hcd_event_device_remove(uint8_t hostid, bool in_isr)
 }
 
 
+static bool enum_abort_port(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port);
+
+// hub_addr == 0 & hub_port == 0 means roothub
+TU_ATTR_ALWAYS_INLINE
+static inline bool is_under_port(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port,
+                                 uint8_t dev_rhport, uint8_t dev_hub_addr, uint8_t dev_hub_port)
+{
+  return (dev_rhport == rhport) &&
+         (hub_addr == 0 || dev_hub_addr == hub_addr) &&
+         (hub_port == 0 || dev_hub_port == hub_port);
+}
+
+// Close all drivers and endpoints of device, its address can be re-used afterwards
+static void device_close(uint8_t dev_addr)
+{
+  usbh_device_t* dev = get_device(dev_addr);
+
+  // Invoke callback before close driver
+  if (dev->configured && tuh_umount_cb) tuh_umount_cb(dev_addr);
+
+  // Close class driver
+  for (uint8_t drv_id = 0; drv_id < USBH_CLASS_DRIVER_COUNT; drv_id++)
+  {
+    TU_LOG2("%s close\r\n", usbh_class_drivers[drv_id].name);
+    usbh_class_drivers[drv_id].close(dev_addr);
+  }
+
+  hcd_device_close(dev->rhport, dev_addr);
+  usbh_control_close(dev_addr);
+
+  // release all endpoints associated with the device
+  memset(dev->itf2drv, DRVID_INVALID, sizeof(dev->itf2drv)); // invalid mapping
+  memset(dev->ep2drv , DRVID_INVALID, sizeof(dev->ep2drv )); // invalid mapping
+  tu_memclr(dev->ep_status, sizeof(dev->ep_status));
+
+  dev->connected  = 0;
+  dev->addressed  = 0;
+  dev->configured = 0;
+  dev->state      = TUSB_DEVICE_STATE_UNPLUG;
+}
+
 // a device unplugged on hostid, hub_addr, hub_port
 // return true if found and unmounted device, false if cannot find
 void process_device_unplugged(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port)
 {
+  // stop enumerating devices under the port first
+  enum_abort_port(rhport, hub_addr, hub_port);
+
   //------------- find the all devices (star-network) under port that is unplugged -------------//
-  // TODO mark as disconnected in ISR, also handle dev0
+  // TODO mark as disconnected in ISR
   for ( uint8_t dev_id = 0; dev_id < TU_ARRAY_SIZE(_usbh_devices); dev_id++ )
   {
     usbh_device_t* dev = &_usbh_devices[dev_id];
-    uint8_t const dev_addr = dev_id+1;
 
     // TODO Hub multiple level
-    if (dev->rhport == rhport   &&
-        (hub_addr == 0 || dev->hub_addr == hub_addr) && // hub_addr == 0 & hub_port == 0 means roothub
-        (hub_port == 0 || dev->hub_port == hub_port) &&
-        dev->state    != TUSB_DEVICE_STATE_UNPLUG)
+    if ( dev->connected && is_under_port(rhport, hub_addr, hub_port, dev->rhport, dev->hub_addr, dev->hub_port) )
     {
-      // Invoke callback before close driver
-      if (tuh_umount_cb) tuh_umount_cb(dev_addr);
-
-      // Close class driver
-      for (uint8_t drv_id = 0; drv_id < USBH_CLASS_DRIVER_COUNT; drv_id++)
-      {
-        TU_LOG2("%s close\r\n", usbh_class_drivers[drv_id].name);
-        usbh_class_drivers[drv_id].close(dev_addr);
-      }
-
-      hcd_device_close(rhport, dev_addr);
-
-      // release all endpoints associated with the device
-      memset(dev->itf2drv, DRVID_INVALID, sizeof(dev->itf2drv)); // invalid mapping
-      memset(dev->ep2drv , DRVID_INVALID, sizeof(dev->ep2drv )); // invalid mapping
-      tu_memclr(dev->ep_status, sizeof(dev->ep_status));
-
-      dev->state = TUSB_DEVICE_STATE_UNPLUG;
+      device_close(dev_id+1);
     }
   }
 }
@@ -575,11 +645,13 @@ static uint8_t get_new_address(bool is_hub)
   for (uint8_t i=0; i < count; i++)
   {
     uint8_t const addr = start + i;
-    if (get_device(addr)->state == TUSB_DEVICE_STATE_UNPLUG) return addr;
+    if ( !get_device(addr)->connected ) return addr;
   }
   return ADDR_INVALID;
 }
 
+static void enum_free(usbh_enum_t* e);
+
 void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num)
 {
   usbh_device_t* dev = get_device(dev_addr);
@@ -601,6 +673,10 @@ void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num)
   // all interface are configured
   if (itf_num == sizeof(dev->itf2drv))
   {
+    // enumeration is complete, its slot can be used for other device
+    usbh_enum_t* e = enum_find_by_addr(dev_addr);
+    if (e) enum_free(e);
+
     // Invoke callback if available
     if (tuh_mount_cb) tuh_mount_cb(dev_addr);
   }
@@ -609,385 +685,620 @@ void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num)
 //--------------------------------------------------------------------+
 // Enumeration Process
 // is a lengthy process with a seires of control transfer to configure
-// newly attached device. Each step is handled by a function in this
-// section
-// TODO due to the shared _usbh_ctrl_buf, we must complete enumerating
-// one device before enumerating another one.
+// newly attached device. Each device being enumerated has its own slot
+// with state and descriptor buffer, delays are done with timers polled by
+// tuh_task() instead of blocking. Therefore devices on different hub ports
+// are enumerated in parallel, only the window from port reset until
+// SET_ADDRESS is serialized since only one device can be at address 0.
 //--------------------------------------------------------------------+
 
-static bool enum_request_addr0_device_desc(void);
-static bool enum_request_set_addr(void);
-
-static bool enum_get_addr0_device_desc_complete (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
-static bool enum_set_address_complete           (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
-static bool enum_get_device_desc_complete       (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
-static bool enum_get_9byte_config_desc_complete (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
-static bool enum_get_config_desc_complete       (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
-static bool enum_set_config_complete            (uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
-static bool parse_configuration_descriptor      (uint8_t dev_addr, tusb_desc_configuration_t const* desc_cfg);
+// Each state is the next step to perform, which is either started right
+// away or when the slot timer expires
+typedef enum
+{
+  ENUM_IDLE = 0,
+  ENUM_ROOT_CHECK,       // root port: check connection after debouncing
+  ENUM_HUB_CHECK,        // hub port : check connection after debouncing
+  ENUM_ADDR0,            // acquire address 0, wait if other device is using it
+  ENUM_HUB_RESET,        // hub port reset
+  ENUM_HUB_RESET_STATUS, // poll hub port status until reset is complete
+  ENUM_HUB_RESET_CLEAR,  // acknowledge hub port reset change
+  ENUM_GET_DESC8,        // get first 8 bytes of device descriptor at address 0
+  ENUM_SET_ADDR,
+  ENUM_GET_DEVICE_DESC,
+  ENUM_GET_9BYTE_CONFIG_DESC,
+  ENUM_GET_CONFIG_DESC,
+  ENUM_SET_CONFIG,
+  ENUM_CONFIG_DRIVERS    // class drivers set_config, slot is freed when all are done
+} enum_state_t;
+
+// Enumeration slot that owns address 0
+static usbh_enum_t* _enum_addr0_owner;
+
+static void enum_process(usbh_enum_t* e);
+static bool enum_control_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result);
+static bool parse_configuration_descriptor(uint8_t dev_addr, tusb_desc_configuration_t const* desc_cfg);
+
+static void enum_timer_start(usbh_enum_t* e, uint16_t msec)
+{
+  e->timer_start = hcd_frame_number(e->rhport);
+  e->timer_ms    = msec;
+}
 
-#if CFG_TUH_HUB
-static bool enum_hub_clear_reset0_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
+// run slots whose timer expired
+static void enum_timer_process(void)
 {
-  (void) dev_addr; (void) request;
-  TU_ASSERT(XFER_RESULT_SUCCESS == result);
-  enum_request_addr0_device_desc();
-  return true;
+  for(uint8_t i=0; i<CFG_TUH_ENUMERATION_MAX; i++)
+  {
+    usbh_enum_t* e = &_usbh_enum[i];
+
+    if ( e->timer_ms && (hcd_frame_number(e->rhport) - e->timer_start) >= e->timer_ms )
+    {
+      e->timer_ms = 0;
+      enum_process(e);
+    }
+  }
 }
 
-static bool enum_hub_clear_reset1_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
+// time until the earliest slot timer expires
+static uint32_t enum_timer_remaining(void)
 {
-  (void) dev_addr; (void) request;
-  TU_ASSERT(XFER_RESULT_SUCCESS == result);
+  uint32_t remaining = OSAL_TIMEOUT_WAIT_FOREVER;
 
-  enum_request_set_addr();
+  for(uint8_t i=0; i<CFG_TUH_ENUMERATION_MAX; i++)
+  {
+    usbh_enum_t const* e = &_usbh_enum[i];
 
-  // done with hub, waiting for next data on status pipe
-  (void) hub_status_pipe_queue( _dev0.hub_addr );
+    if ( e->timer_ms )
+    {
+      uint32_t const elapsed = hcd_frame_number(e->rhport) - e->timer_start;
+      uint32_t const left    = (elapsed < e->timer_ms) ? (e->timer_ms - elapsed) : 0;
+      remaining = tu_min32(remaining, left);
+    }
+  }
 
-  return true;
+  return remaining;
 }
 
-static bool enum_hub_get_status1_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
+static usbh_enum_t* enum_find_by_addr(uint8_t dev_addr)
 {
-  (void) dev_addr; (void) request;
-  TU_ASSERT(XFER_RESULT_SUCCESS == result);
+  for(uint8_t i=0; i<CFG_TUH_ENUMERATION_MAX; i++)
+  {
+    usbh_enum_t* e = &_usbh_enum[i];
+    if ( e->state != ENUM_IDLE && e->dev_addr == dev_addr ) return e;
+  }
 
-  hub_port_status_response_t port_status;
-  memcpy(&port_status, _usbh_ctrl_buf, sizeof(hub_port_status_response_t));
+  return NULL;
+}
+
+// Find slot which a completed control transfer belongs to: transfers are made
+// to address 0, to the parent hub for port requests or to the new address
+static usbh_enum_t* enum_find_by_control(uint8_t dev_addr, tusb_control_request_t const * request)
+{
+  if ( dev_addr == 0 ) return _enum_addr0_owner;
 
-  // Acknowledge Port Reset Change if Reset Successful
-  if (port_status.change.reset)
+  for(uint8_t i=0; i<CFG_TUH_ENUMERATION_MAX; i++)
   {
-    TU_ASSERT( hub_port_clear_feature(_dev0.hub_addr, _dev0.hub_port, HUB_FEATURE_PORT_RESET_CHANGE, enum_hub_clear_reset1_complete) );
+    usbh_enum_t* e = &_usbh_enum[i];
+
+    if ( e->state >= ENUM_GET_DEVICE_DESC && e->state <= ENUM_SET_CONFIG && e->dev_addr == dev_addr ) return e;
+
+    if ( (e->state == ENUM_HUB_CHECK || (e->state >= ENUM_HUB_RESET && e->state <= ENUM_HUB_RESET_CLEAR)) &&
+         e->hub_addr == dev_addr && e->hub_port == request->wIndex )
+    {
+      return e;
+    }
   }
 
+  return NULL;
+}
+
+static bool enum_addr0_acquire(usbh_enum_t* e)
+{
+  if ( _enum_addr0_owner && _enum_addr0_owner != e ) return false;
+
+  _enum_addr0_owner = e;
+
+  _dev0.rhport   = e->rhport;
+  _dev0.hub_addr = e->hub_addr;
+  _dev0.hub_port = e->hub_port;
+  _dev0.speed    = e->speed;
+
   return true;
 }
 
-static bool enum_hub_get_status0_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
+static void enum_addr0_release(usbh_enum_t* e)
+{
+  if ( _enum_addr0_owner != e ) return;
+
+  _enum_addr0_owner = NULL;
+
+  // hand address 0 over to the next waiting slot
+  for(uint8_t i=0; i<CFG_TUH_ENUMERATION_MAX; i++)
+  {
+    usbh_enum_t* waiter = &_usbh_enum[i];
+    if ( waiter->state == ENUM_ADDR0 && waiter->timer_ms == 0 )
+    {
+      enum_process(waiter);
+      break;
+    }
+  }
+}
+
+static void enum_free(usbh_enum_t* e)
 {
-  (void) dev_addr; (void) request;
-  TU_ASSERT(XFER_RESULT_SUCCESS == result);
+  enum_addr0_release(e);
 
-  hub_port_status_response_t port_status;
-  memcpy(&port_status, _usbh_ctrl_buf, sizeof(hub_port_status_response_t));
+  e->state    = ENUM_IDLE;
+  e->timer_ms = 0;
 
-  if ( !port_status.status.connection )
+  // start the next port waiting for a free slot
+  if ( _enum_pending_count )
   {
-    // device unplugged while delaying, nothing else to do, queue hub status
-    return hub_status_pipe_queue(dev_addr);
+    usbh_enum_pending_t const pending = _enum_pending[0];
+
+    _enum_pending_count--;
+    memmove(_enum_pending, _enum_pending+1, _enum_pending_count*sizeof(usbh_enum_pending_t));
+
+    enum_new_device(pending.rhport, pending.hub_addr, pending.hub_port);
   }
+}
 
-  _dev0.speed = (port_status.status.high_speed) ? TUSB_SPEED_HIGH :
-                (port_status.status.low_speed ) ? TUSB_SPEED_LOW  : TUSB_SPEED_FULL;
+// Enumeration failed or device is unplugged
+static void enum_abort(usbh_enum_t* e)
+{
+  TU_LOG2("Enumeration aborted: hub_addr = %u, hub_port = %u\r\n", e->hub_addr, e->hub_port);
 
-  // Acknowledge Port Reset Change
-  if (port_status.change.reset)
+  if ( _enum_addr0_owner == e )
   {
-    hub_port_clear_feature(_dev0.hub_addr, _dev0.hub_port, HUB_FEATURE_PORT_RESET_CHANGE, enum_hub_clear_reset0_complete);
+    hcd_device_close(e->rhport, 0);
+    usbh_control_close(0);
   }
 
-  return true;
+  if ( e->dev_addr )
+  {
+    usbh_device_t* dev = get_device(e->dev_addr);
+
+    // device is not mounted yet, don't invoke unmount callback
+    dev->configured = 0;
+
+    if ( dev->addressed )
+    {
+      device_close(e->dev_addr);
+    }else
+    {
+      dev->connected = 0;
+    }
+  }
+
+  enum_free(e);
 }
-#endif
 
-static bool enum_new_device(hcd_event_t* event)
+static bool enum_abort_port(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port)
 {
-  _dev0.rhport   = event->rhport; // TODO refractor integrate to device_pool
-  _dev0.hub_addr = event->connection.hub_addr;
-  _dev0.hub_port = event->connection.hub_port;
+  bool found = false;
 
-  //------------- connected/disconnected directly with roothub -------------//
-  if (_dev0.hub_addr == 0)
+  for(uint8_t i=0; i<CFG_TUH_ENUMERATION_MAX; i++)
   {
-    // wait until device is stable TODO non blocking
-    osal_task_delay(RESET_DELAY);
+    usbh_enum_t* e = &_usbh_enum[i];
 
-    // device unplugged while delaying
-    if ( !hcd_port_connect_status(_dev0.rhport) ) return true;
+    if ( e->state != ENUM_IDLE && is_under_port(rhport, hub_addr, hub_port, e->rhport, e->hub_addr, e->hub_port) )
+    {
+      enum_abort(e);
+      found = true;
+    }
+  }
 
-    _dev0.speed = hcd_port_speed_get(_dev0.rhport );
+  // drop ports waiting for a slot
+  for(uint8_t i=0; i<_enum_pending_count; )
+  {
+    usbh_enum_pending_t const* pending = &_enum_pending[i];
 
-    enum_request_addr0_device_desc();
+    if ( is_under_port(rhport, hub_addr, hub_port, pending->rhport, pending->hub_addr, pending->hub_port) )
+    {
+      _enum_pending_count--;
+      memmove(&_enum_pending[i], &_enum_pending[i+1], (_enum_pending_count-i)*sizeof(usbh_enum_pending_t));
+      found = true;
+    }else
+    {
+      i++;
+    }
   }
-#if CFG_TUH_HUB
-  //------------- connected/disconnected via hub -------------//
-  else
+
+  return found;
+}
+
+static bool enum_new_device(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port)
+{
+  // re-attached while enumerating: start over
+  enum_abort_port(rhport, hub_addr, hub_port);
+
+  usbh_enum_t* e = NULL;
+  for(uint8_t i=0; i<CFG_TUH_ENUMERATION_MAX; i++)
   {
-    // wait until device is stable
-    osal_task_delay(RESET_DELAY);
-    TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, _usbh_ctrl_buf, enum_hub_get_status0_complete) );
+    if ( _usbh_enum[i].state == ENUM_IDLE )
+    {
+      e = &_usbh_enum[i];
+      break;
+    }
+  }
+
+  if ( e == NULL )
+  {
+    // all slots are busy, enumerate when one is freed
+    TU_ASSERT(_enum_pending_count < TU_ARRAY_SIZE(_enum_pending));
+    _enum_pending[_enum_pending_count++] = (usbh_enum_pending_t) { rhport, hub_addr, hub_port };
+    return true;
   }
-#endif // CFG_TUH_HUB
+
+  tu_memclr(e, sizeof(usbh_enum_t));
+
+  e->rhport   = rhport;
+  e->hub_addr = hub_addr;
+  e->hub_port = hub_port;
+
+  // wait until device is stable
+  e->state = (hub_addr == 0) ? ENUM_ROOT_CHECK : ENUM_HUB_CHECK;
+  enum_timer_start(e, RESET_DELAY);
 
   return true;
 }
 
-static bool enum_request_addr0_device_desc(void)
+static bool enum_request(usbh_enum_t* e, uint8_t dev_addr, uint8_t recipient, uint8_t direction,
+                         uint8_t bRequest, uint16_t wValue, uint16_t wLength)
 {
-  // TODO probably doesn't need to open/close each enumeration
-  uint8_t const addr0 = 0;
-  TU_ASSERT( usbh_edpt_control_open(addr0, 8) );
-
-  //------------- Get first 8 bytes of device descriptor to get Control Endpoint Size -------------//
-  TU_LOG2("Get 8 byte of Device Descriptor\r\n");
   tusb_control_request_t const request =
   {
     .bmRequestType_bit =
     {
-      .recipient = TUSB_REQ_RCPT_DEVICE,
+      .recipient = recipient,
       .type      = TUSB_REQ_TYPE_STANDARD,
-      .direction = TUSB_DIR_IN
+      .direction = direction
     },
-    .bRequest = TUSB_REQ_GET_DESCRIPTOR,
-    .wValue   = TUSB_DESC_DEVICE << 8,
+    .bRequest = bRequest,
+    .wValue   = wValue,
     .wIndex   = 0,
-    .wLength  = 8
+    .wLength  = wLength
   };
-  TU_ASSERT( tuh_control_xfer(addr0, &request, _usbh_ctrl_buf, enum_get_addr0_device_desc_complete) );
 
-  return true;
+  return tuh_control_xfer(dev_addr, &request, wLength ? e->buf : NULL, enum_control_complete);
 }
 
-// After Get Device Descriptor of Address 0
-static bool enum_get_addr0_device_desc_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
+// Perform the step of current state
+static void enum_process(usbh_enum_t* e)
 {
-  (void) request;
-  TU_ASSERT(0 == dev_addr);
+  bool submitted = true;
 
-  if (XFER_RESULT_SUCCESS != result)
+  switch (e->state)
   {
-#if CFG_TUH_HUB
-    // TODO remove, waiting for next data on status pipe
-    if (_dev0.hub_addr != 0) hub_status_pipe_queue(_dev0.hub_addr);
-#endif
+    case ENUM_ROOT_CHECK:
+      // device unplugged while delaying
+      if ( !hcd_port_connect_status(e->rhport) )
+      {
+        enum_free(e);
+        return;
+      }
 
-    return false;
-  }
+      e->speed = hcd_port_speed_get(e->rhport);
+      e->state = ENUM_ADDR0;
+      enum_process(e);
+    break;
 
-  tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) _usbh_ctrl_buf;
-  TU_ASSERT( tu_desc_type(desc_device) == TUSB_DESC_DEVICE );
+#if CFG_TUH_HUB
+    case ENUM_HUB_CHECK:
+      submitted = hub_port_get_status(e->hub_addr, e->hub_port, e->buf, enum_control_complete);
+    break;
+#endif
 
-  // Reset device again before Set Address
-  TU_LOG2("Port reset \r\n");
+    case ENUM_ADDR0:
+      // other device is being addressed, released owner will resume this slot
+      if ( !enum_addr0_acquire(e) ) return;
 
-  if (_dev0.hub_addr == 0)
-  {
-    // connected directly to roothub
-    hcd_port_reset( _dev0.rhport ); // reset port after 8 byte descriptor
-    osal_task_delay(RESET_DELAY);
+      if ( e->hub_addr == 0 )
+      {
+        // root port is already reset by the controller when device is attached
+        if ( !usbh_edpt_control_open(0, 8) )
+        {
+          enum_abort(e);
+          return;
+        }
+        e->state = ENUM_GET_DESC8;
+      }else
+      {
+        e->state = ENUM_HUB_RESET;
+      }
+      enum_process(e);
+    break;
 
-    enum_request_set_addr();
-  }
 #if CFG_TUH_HUB
-  else
-  {
-    // after RESET_DELAY the hub_port_reset() already complete
-    TU_ASSERT( hub_port_reset(_dev0.hub_addr, _dev0.hub_port, NULL) );
-    osal_task_delay(RESET_DELAY);
+    case ENUM_HUB_RESET:
+      TU_LOG2("Port reset \r\n");
+      submitted = hub_port_reset(e->hub_addr, e->hub_port, enum_control_complete);
+    break;
 
-    tuh_task(); // FIXME temporarily to clean up port_reset control transfer
+    case ENUM_HUB_RESET_STATUS:
+      submitted = hub_port_get_status(e->hub_addr, e->hub_port, e->buf, enum_control_complete);
+    break;
 
-    TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, _usbh_ctrl_buf, enum_hub_get_status1_complete) );
-  }
+    case ENUM_HUB_RESET_CLEAR:
+      submitted = hub_port_clear_feature(e->hub_addr, e->hub_port, HUB_FEATURE_PORT_RESET_CHANGE, enum_control_complete);
+    break;
 #endif
 
-  return true;
-}
+    case ENUM_GET_DESC8:
+      //------------- Get first 8 bytes of device descriptor to get Control Endpoint Size -------------//
+      TU_LOG2("Get 8 byte of Device Descriptor\r\n");
+      submitted = enum_request(e, 0, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_IN, TUSB_REQ_GET_DESCRIPTOR, TUSB_DESC_DEVICE << 8, 8);
+    break;
 
-static bool enum_request_set_addr(void)
-{
-  uint8_t const addr0 = 0;
-  tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) _usbh_ctrl_buf;
+    case ENUM_SET_ADDR:
+      if ( e->dev_addr == 0 )
+      {
+        // Get new address
+        uint8_t const new_addr = get_new_address(e->is_hub);
+        if ( new_addr == ADDR_INVALID )
+        {
+          TU_LOG(USBH_DBG_LVL, "No free address\r\n");
+          enum_abort(e);
+          return;
+        }
 
-  // Get new address
-  uint8_t const new_addr = get_new_address(desc_device->bDeviceClass == TUSB_CLASS_HUB);
-  TU_ASSERT(new_addr != ADDR_INVALID);
+        usbh_device_t* new_dev = get_device(new_addr);
 
-  TU_LOG2("Set Address = %d\r\n", new_addr);
+        new_dev->rhport    = e->rhport;
+        new_dev->hub_addr  = e->hub_addr;
+        new_dev->hub_port  = e->hub_port;
+        new_dev->speed     = e->speed;
+        new_dev->connected = 1;
+        new_dev->ep0_size  = e->ep0_size;
 
-  usbh_device_t* new_dev = get_device(new_addr);
+        e->dev_addr = new_addr;
+      }
 
-  new_dev->rhport    = _dev0.rhport;
-  new_dev->hub_addr  = _dev0.hub_addr;
-  new_dev->hub_port  = _dev0.hub_port;
-  new_dev->speed     = _dev0.speed;
-  new_dev->connected = 1;
-  new_dev->ep0_size  = desc_device->bMaxPacketSize0;
+      TU_LOG2("Set Address = %d\r\n", e->dev_addr);
+      submitted = enum_request(e, 0, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT, TUSB_REQ_SET_ADDRESS, e->dev_addr, 0);
+    break;
 
-  tusb_control_request_t const new_request =
-  {
-    .bmRequestType_bit =
+    case ENUM_GET_DEVICE_DESC:
+      TU_LOG2("Get Device Descriptor\r\n");
+      submitted = enum_request(e, e->dev_addr, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_IN, TUSB_REQ_GET_DESCRIPTOR,
+                               TUSB_DESC_DEVICE << 8, sizeof(tusb_desc_device_t));
+    break;
+
+    case ENUM_GET_9BYTE_CONFIG_DESC:
+      TU_LOG2("Get 9 bytes of Configuration Descriptor\r\n");
+      submitted = enum_request(e, e->dev_addr, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_IN, TUSB_REQ_GET_DESCRIPTOR,
+                               (TUSB_DESC_CONFIGURATION << 8) | (CONFIG_NUM - 1), 9);
+    break;
+
+    case ENUM_GET_CONFIG_DESC:
     {
-      .recipient = TUSB_REQ_RCPT_DEVICE,
-      .type      = TUSB_REQ_TYPE_STANDARD,
-      .direction = TUSB_DIR_OUT
-    },
-    .bRequest = TUSB_REQ_SET_ADDRESS,
-    .wValue   = new_addr,
-    .wIndex   = 0,
-    .wLength  = 0
-  };
+      // Use offsetof to avoid pointer to the odd/misaligned address
+      uint16_t const total_len = tu_le16toh( tu_unaligned_read16(e->buf + offsetof(tusb_desc_configuration_t, wTotalLength)) );
 
-  TU_ASSERT( tuh_control_xfer(addr0, &new_request, NULL, enum_set_address_complete) );
+      // TODO not enough buffer to hold configuration descriptor
+      if ( total_len > CFG_TUH_ENUMERATION_BUFSIZE )
+      {
+        TU_LOG(USBH_DBG_LVL, "Configuration descriptor (%u bytes) is larger than CFG_TUH_ENUMERATION_BUFSIZE\r\n", total_len);
+        enum_abort(e);
+        return;
+      }
 
-  return true;
-}
+      TU_LOG2("Get Configuration Descriptor\r\n");
+      submitted = enum_request(e, e->dev_addr, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_IN, TUSB_REQ_GET_DESCRIPTOR,
+                               (TUSB_DESC_CONFIGURATION << 8) | (CONFIG_NUM - 1), total_len);
+    }
+    break;
 
-// After SET_ADDRESS is complete
-static bool enum_set_address_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
-{
-  TU_ASSERT(0 == dev_addr);
-  TU_ASSERT(XFER_RESULT_SUCCESS == result);
+    case ENUM_SET_CONFIG:
+      TU_LOG2("Set Configuration = %d\r\n", CONFIG_NUM);
+      submitted = enum_request(e, e->dev_addr, TUSB_REQ_RCPT_DEVICE, TUSB_DIR_OUT, TUSB_REQ_SET_CONFIGURATION, CONFIG_NUM, 0);
+    break;
 
-  uint8_t const new_addr = (uint8_t const) request->wValue;
+    default: break;
+  }
 
-  usbh_device_t* new_dev = get_device(new_addr);
-  new_dev->addressed = 1;
+  // control queue of the device (or its hub) is full, try again later
+  if ( !submitted ) enum_timer_start(e, 1);
+}
 
-  // TODO close device 0, may not be needed
-  hcd_device_close(_dev0.rhport, 0);
+static bool enum_control_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
+{
+  usbh_enum_t* e = enum_find_by_control(dev_addr, request);
+  TU_VERIFY(e);
 
-  // open control pipe for new address
-  TU_ASSERT( usbh_edpt_control_open(new_addr, new_dev->ep0_size) );
+  if ( XFER_RESULT_SUCCESS != result )
+  {
+    enum_abort(e);
+    return false;
+  }
 
-  // Get full device descriptor
-  TU_LOG2("Get Device Descriptor\r\n");
-  tusb_control_request_t const new_request =
+  switch (e->state)
   {
-    .bmRequestType_bit =
+#if CFG_TUH_HUB
+    case ENUM_HUB_CHECK:
     {
-      .recipient = TUSB_REQ_RCPT_DEVICE,
-      .type      = TUSB_REQ_TYPE_STANDARD,
-      .direction = TUSB_DIR_IN
-    },
-    .bRequest = TUSB_REQ_GET_DESCRIPTOR,
-    .wValue   = TUSB_DESC_DEVICE << 8,
-    .wIndex   = 0,
-    .wLength  = sizeof(tusb_desc_device_t)
-  };
-
-  TU_ASSERT(tuh_control_xfer(new_addr, &new_request, _usbh_ctrl_buf, enum_get_device_desc_complete));
-
-  return true;
-}
+      hub_port_status_response_t port_status;
+      memcpy(&port_status, e->buf, sizeof(hub_port_status_response_t));
 
-static bool enum_get_device_desc_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
-{
-  (void) request;
-  TU_ASSERT(XFER_RESULT_SUCCESS == result);
+      // device unplugged while delaying
+      if ( !port_status.status.connection )
+      {
+        enum_free(e);
+        return true;
+      }
 
-  tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) _usbh_ctrl_buf;
-  usbh_device_t* dev = get_device(dev_addr);
+      e->speed = (port_status.status.high_speed) ? TUSB_SPEED_HIGH :
+                 (port_status.status.low_speed ) ? TUSB_SPEED_LOW  : TUSB_SPEED_FULL;
 
-  dev->vid            = desc_device->idVendor;
-  dev->pid            = desc_device->idProduct;
-  dev->i_manufacturer = desc_device->iManufacturer;
-  dev->i_product      = desc_device->iProduct;
-  dev->i_serial       = desc_device->iSerialNumber;
+      e->state = ENUM_ADDR0;
+      enum_process(e);
+    }
+    break;
 
-//  if (tuh_attach_cb) tuh_attach_cb((tusb_desc_device_t*) _usbh_ctrl_buf);
+    case ENUM_HUB_RESET:
+      e->reset_poll = 0;
+      e->state      = ENUM_HUB_RESET_STATUS;
+      enum_timer_start(e, HUB_RESET_POLL_INTERVAL);
+    break;
 
-  TU_LOG2("Get 9 bytes of Configuration Descriptor\r\n");
-  tusb_control_request_t const new_request =
-  {
-    .bmRequestType_bit =
+    case ENUM_HUB_RESET_STATUS:
     {
-      .recipient = TUSB_REQ_RCPT_DEVICE,
-      .type      = TUSB_REQ_TYPE_STANDARD,
-      .direction = TUSB_DIR_IN
-    },
-    .bRequest = TUSB_REQ_GET_DESCRIPTOR,
-    .wValue   = (TUSB_DESC_CONFIGURATION << 8) | (CONFIG_NUM - 1),
-    .wIndex   = 0,
-    .wLength  = 9
-  };
+      hub_port_status_response_t port_status;
+      memcpy(&port_status, e->buf, sizeof(hub_port_status_response_t));
 
-  TU_ASSERT( tuh_control_xfer(dev_addr, &new_request, _usbh_ctrl_buf, enum_get_9byte_config_desc_complete) );
+      if ( !port_status.status.connection )
+      {
+        enum_abort(e);
+        return true;
+      }
 
-  return true;
-}
+      if ( !port_status.change.reset )
+      {
+        // reset is not complete yet
+        if ( ++e->reset_poll >= HUB_RESET_POLL_MAX )
+        {
+          enum_abort(e);
+        }else
+        {
+          enum_timer_start(e, HUB_RESET_POLL_INTERVAL);
+        }
+        return true;
+      }
 
-static bool enum_get_9byte_config_desc_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
-{
-  (void) request;
-  TU_ASSERT(XFER_RESULT_SUCCESS == result);
+      e->speed    = (port_status.status.high_speed) ? TUSB_SPEED_HIGH :
+                    (port_status.status.low_speed ) ? TUSB_SPEED_LOW  : TUSB_SPEED_FULL;
+      _dev0.speed = e->speed;
 
-  // TODO not enough buffer to hold configuration descriptor
-  uint8_t const * desc_config = _usbh_ctrl_buf;
+      e->state = ENUM_HUB_RESET_CLEAR;
+      enum_process(e);
+    }
+    break;
 
-  // Use offsetof to avoid pointer to the odd/misaligned address
-  uint16_t const total_len = tu_le16toh( tu_unaligned_read16(desc_config + offsetof(tusb_desc_configuration_t, wTotalLength)) );
+    case ENUM_HUB_RESET_CLEAR:
+      if ( e->ep0_size == 0 )
+      {
+        // first reset: open address 0 to get device descriptor
+        if ( !usbh_edpt_control_open(0, 8) )
+        {
+          enum_abort(e);
+          return false;
+        }
+        e->state = ENUM_GET_DESC8;
+      }else
+      {
+        e->state = ENUM_SET_ADDR;
+      }
 
-  TU_ASSERT(total_len <= CFG_TUH_ENUMERATION_BUFSIZE);
+      enum_timer_start(e, RESET_RECOVERY_DELAY);
+    break;
+#endif
 
-  // Get full configuration descriptor
-  TU_LOG2("Get Configuration Descriptor\r\n");
-  tusb_control_request_t const new_request =
-  {
-    .bmRequestType_bit =
+    case ENUM_GET_DESC8:
     {
-      .recipient = TUSB_REQ_RCPT_DEVICE,
-      .type      = TUSB_REQ_TYPE_STANDARD,
-      .direction = TUSB_DIR_IN
-    },
-    .bRequest = TUSB_REQ_GET_DESCRIPTOR,
-    .wValue   = (TUSB_DESC_CONFIGURATION << 8) | (CONFIG_NUM - 1),
-    .wIndex   = 0,
-    .wLength  = total_len
+      tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) e->buf;
+      if ( tu_desc_type(desc_device) != TUSB_DESC_DEVICE )
+      {
+        enum_abort(e);
+        return false;
+      }
 
-  };
+      e->ep0_size = desc_device->bMaxPacketSize0;
+      e->is_hub   = (desc_device->bDeviceClass == TUSB_CLASS_HUB);
 
-  TU_ASSERT( tuh_control_xfer(dev_addr, &new_request, _usbh_ctrl_buf, enum_get_config_desc_complete) );
+      // Reset device again before Set Address
+      if ( e->hub_addr == 0 )
+      {
+        // connected directly to roothub
+        TU_LOG2("Port reset \r\n");
+        hcd_port_reset(e->rhport);
 
-  return true;
-}
+        e->state = ENUM_SET_ADDR;
+        enum_timer_start(e, RESET_DELAY);
+      }else
+      {
+        e->state = ENUM_HUB_RESET;
+        enum_process(e);
+      }
+    }
+    break;
 
-static bool enum_get_config_desc_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
-{
-  (void) request;
-  TU_ASSERT(XFER_RESULT_SUCCESS == result);
+    case ENUM_SET_ADDR:
+    {
+      usbh_device_t* new_dev = get_device(e->dev_addr);
+      new_dev->addressed = 1;
 
-  // Parse configuration & set up drivers
-  // Driver open aren't allowed to make any usb transfer yet
-  TU_ASSERT( parse_configuration_descriptor(dev_addr, (tusb_desc_configuration_t*) _usbh_ctrl_buf) );
+      // TODO close device 0, may not be needed
+      hcd_device_close(e->rhport, 0);
 
-  TU_LOG2("Set Configuration = %d\r\n", CONFIG_NUM);
-  tusb_control_request_t const new_request =
-  {
-    .bmRequestType_bit =
+      // done with address 0, let next device use it
+      enum_addr0_release(e);
+
+      // open control pipe for new address
+      if ( !usbh_edpt_control_open(e->dev_addr, new_dev->ep0_size) )
+      {
+        enum_abort(e);
+        return false;
+      }
+
+      e->state = ENUM_GET_DEVICE_DESC;
+      enum_process(e);
+    }
+    break;
+
+    case ENUM_GET_DEVICE_DESC:
     {
-      .recipient = TUSB_REQ_RCPT_DEVICE,
-      .type      = TUSB_REQ_TYPE_STANDARD,
-      .direction = TUSB_DIR_OUT
-    },
-    .bRequest = TUSB_REQ_SET_CONFIGURATION,
-    .wValue   = CONFIG_NUM,
-    .wIndex   = 0,
-    .wLength  = 0
-  };
+      tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) e->buf;
+      usbh_device_t* dev = get_device(dev_addr);
 
-  TU_ASSERT( tuh_control_xfer(dev_addr, &new_request, NULL, enum_set_config_complete) );
+      dev->vid            = desc_device->idVendor;
+      dev->pid            = desc_device->idProduct;
+      dev->i_manufacturer = desc_device->iManufacturer;
+      dev->i_product      = desc_device->iProduct;
+      dev->i_serial       = desc_device->iSerialNumber;
 
-  return true;
-}
+      e->state = ENUM_GET_9BYTE_CONFIG_DESC;
+      enum_process(e);
+    }
+    break;
 
-static bool enum_set_config_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
-{
-  (void) request;
-  TU_ASSERT(XFER_RESULT_SUCCESS == result);
+    case ENUM_GET_9BYTE_CONFIG_DESC:
+      e->state = ENUM_GET_CONFIG_DESC;
+      enum_process(e);
+    break;
 
-  TU_LOG2("Device configured\r\n");
-  usbh_device_t* dev = get_device(dev_addr);
-  dev->configured = 1;
-  dev->state = TUSB_DEVICE_STATE_CONFIGURED;
+    case ENUM_GET_CONFIG_DESC:
+      // Parse configuration & set up drivers
+      // Driver open aren't allowed to make any usb transfer yet
+      if ( !parse_configuration_descriptor(dev_addr, (tusb_desc_configuration_t*) e->buf) )
+      {
+        enum_abort(e);
+        return false;
+      }
 
-  // Start the Set Configuration process for interfaces (itf = DRVID_INVALID)
-  // Since driver can perform control transfer within its set_config, this is done asynchronously.
-  // The process continue with next interface when class driver complete its sequence with usbh_driver_set_config_complete()
-  // TODO use separated API instead of using DRVID_INVALID
-  usbh_driver_set_config_complete(dev_addr, DRVID_INVALID);
+      e->state = ENUM_SET_CONFIG;
+      enum_process(e);
+    break;
+
+    case ENUM_SET_CONFIG:
+    {
+      TU_LOG2("Device configured\r\n");
+      usbh_device_t* dev = get_device(dev_addr);
+      dev->configured = 1;
+      dev->state = TUSB_DEVICE_STATE_CONFIGURED;
+
+      e->state = ENUM_CONFIG_DRIVERS;
+
+      // Start the Set Configuration process for interfaces (itf = DRVID_INVALID)
+      // Since driver can perform control transfer within its set_config, this is done asynchronously.
+      // The process continue with next interface when class driver complete its sequence with usbh_driver_set_config_complete()
+      // TODO use separated API instead of using DRVID_INVALID
+      usbh_driver_set_config_complete(dev_addr, DRVID_INVALID);
+    }
+    break;
+
+    default: break;
+  }
 
   return true;
 }
@@ -1032,6 +1343,16 @@ static bool parse_configuration_descriptor(uint8_t dev_addr, tusb_desc_configura
     }
 #endif
 
+#if CFG_TUH_CDC
+    // Some CDC ACM devices do not have IAD, Communication interface is followed by Data interface
+    if (1                                        == assoc_itf_count              &&
+        TUSB_CLASS_CDC                           == desc_itf->bInterfaceClass    &&
+        CDC_COMM_SUBCLASS_ABSTRACT_CONTROL_MODEL == desc_itf->bInterfaceSubClass)
+    {
+      assoc_itf_count = 2;
+    }
+#endif
+
     uint16_t const drv_len = tu_desc_get_interface_total_len(desc_itf, assoc_itf_count, desc_end-p_desc);
     TU_ASSERT(drv_len >= sizeof(tusb_desc_interface_t));
 
@@ -1144,14 +1465,14 @@ bool usbh_edpt_release(uint8_t dev_addr, uint8_t ep_addr)
 }
 
 // TODO has some duplication code with device, refactor later
-bool usbh_edpt_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes)
+bool usbh_edpt_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint32_t total_bytes)
 {
   uint8_t const epnum = tu_edpt_number(ep_addr);
   uint8_t const dir   = tu_edpt_dir(ep_addr);
 
   usbh_device_t* dev = get_device(dev_addr);
 
-  TU_LOG2("  Queue EP %02X with %u bytes ... ", ep_addr, total_bytes);
+  TU_LOG2("  Queue EP %02X with %lu bytes ... ", ep_addr, (unsigned long) total_bytes);
 
   // Attempt to transfer on a busy endpoint, sound like an race condition !
   TU_ASSERT(dev->ep_status[epnum][dir].busy == 0);
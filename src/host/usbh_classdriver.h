@@ -55,7 +55,8 @@ void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num);
 
 uint8_t usbh_get_rhport(uint8_t dev_addr);
 
-uint8_t* usbh_get_enum_buf(void);
+// Descriptor buffer of device being enumerated, only valid until device is mounted
+uint8_t* usbh_get_enum_buf(uint8_t dev_addr);
 
 //--------------------------------------------------------------------+
 // USBH Endpoint API
@@ -65,7 +66,7 @@ uint8_t* usbh_get_enum_buf(void);
 bool usbh_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const * desc_ep);
 
 // Submit a usb transfer
-bool usbh_edpt_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes);
+bool usbh_edpt_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint32_t total_bytes);
 
 // Claim an endpoint before submitting a transfer.
 // If caller does not make any transfer, it must release endpoint for others.
@@ -33,45 +33,127 @@
 
 enum
 {
+  STAGE_IDLE,
   STAGE_SETUP,
   STAGE_DATA,
   STAGE_ACK
 };
 
+enum { ADDR_NONE = 0xFFu };
+
 typedef struct
 {
   tusb_control_request_t request TU_ATTR_ALIGNED(4);
 
-  uint8_t stage;
   uint8_t* buffer;
   tuh_control_complete_cb_t complete_cb;
+} usbh_control_req_t;
+
+// Control transfers of a device, request at the head of queue is in progress
+typedef struct
+{
+  usbh_control_req_t queue[CFG_TUH_CONTROL_QUEUE_SZ];
+
+  uint8_t rd_idx;
+  uint8_t count;
+  uint8_t stage;
 } usbh_control_xfer_t;
 
-static usbh_control_xfer_t _ctrl_xfer;
+// indexed by device address, address 0 is used for enumeration
+static usbh_control_xfer_t _ctrl_xfer[CFG_TUH_DEVICE_MAX + CFG_TUH_HUB + 1];
 
-//CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN
-//static uint8_t _tuh_ctrl_buf[CFG_TUH_ENUMERATION_BUFSIZE];
+#ifdef HCD_ATTR_CONTROL_SHARED
+// HCD has only one control pipe for all devices, transfers of other devices wait until it is free
+static uint8_t _ctrl_pipe_owner = ADDR_NONE;
+#endif
 
 //--------------------------------------------------------------------+
 // MACRO TYPEDEF CONSTANT ENUM DECLARATION
 //--------------------------------------------------------------------+
 
-bool tuh_control_xfer (uint8_t dev_addr, tusb_control_request_t const* request, void* buffer, tuh_control_complete_cb_t complete_cb)
+static void _xfer_complete(uint8_t dev_addr, xfer_result_t result);
+
+// Send setup packet of the request at head of queue
+static bool _ctrl_start(uint8_t dev_addr)
 {
-  // TODO need to claim the endpoint first
-  const uint8_t rhport = usbh_get_rhport(dev_addr);
+  usbh_control_xfer_t* ctrl = &_ctrl_xfer[dev_addr];
+  usbh_control_req_t const* req = &ctrl->queue[ctrl->rd_idx];
 
-  _ctrl_xfer.request     = (*request);
-  _ctrl_xfer.buffer      = buffer;
-  _ctrl_xfer.stage       = STAGE_SETUP;
-  _ctrl_xfer.complete_cb = complete_cb;
+#ifdef HCD_ATTR_CONTROL_SHARED
+  // pipe is used by other device, will be started when it is released
+  if ( _ctrl_pipe_owner != ADDR_NONE ) return true;
+  _ctrl_pipe_owner = dev_addr;
+#endif
+
+  ctrl->stage = STAGE_SETUP;
 
   TU_LOG2("Control Setup (addr = %u): ", dev_addr);
-  TU_LOG2_VAR(request);
+  TU_LOG2_VAR(&req->request);
   TU_LOG2("\r\n");
 
-  // Send setup packet
-  TU_ASSERT( hcd_setup_send(rhport, dev_addr, (uint8_t const*) &_ctrl_xfer.request) );
+  if ( !hcd_setup_send(usbh_get_rhport(dev_addr), dev_addr, (uint8_t const*) &req->request) )
+  {
+    ctrl->stage = STAGE_IDLE;
+#ifdef HCD_ATTR_CONTROL_SHARED
+    _ctrl_pipe_owner = ADDR_NONE;
+#endif
+    return false;
+  }
+
+  return true;
+}
+
+// Start next queued transfer if control pipe is idle
+static void _ctrl_start_next(uint8_t dev_addr)
+{
+#ifdef HCD_ATTR_CONTROL_SHARED
+  if ( _ctrl_pipe_owner != ADDR_NONE ) return;
+
+  // round-robin from the next device so that a busy device cannot starve the others
+  for(uint8_t i = 1; i <= TU_ARRAY_SIZE(_ctrl_xfer); i++)
+  {
+    uint8_t const addr = (uint8_t) ((dev_addr + i) % TU_ARRAY_SIZE(_ctrl_xfer));
+    if ( _ctrl_xfer[addr].count && _ctrl_xfer[addr].stage == STAGE_IDLE )
+    {
+      dev_addr = addr;
+      break;
+    }
+  }
+#endif
+
+  usbh_control_xfer_t* ctrl = &_ctrl_xfer[dev_addr];
+  if ( ctrl->count && ctrl->stage == STAGE_IDLE && !_ctrl_start(dev_addr) )
+  {
+    _xfer_complete(dev_addr, XFER_RESULT_FAILED);
+  }
+}
+
+bool tuh_control_xfer (uint8_t dev_addr, tusb_control_request_t const* request, void* buffer, tuh_control_complete_cb_t complete_cb)
+{
+  TU_ASSERT(dev_addr < TU_ARRAY_SIZE(_ctrl_xfer));
+
+  usbh_control_xfer_t* ctrl = &_ctrl_xfer[dev_addr];
+
+  // queue is full
+  TU_VERIFY(ctrl->count < CFG_TUH_CONTROL_QUEUE_SZ);
+
+  usbh_control_req_t* req = &ctrl->queue[(ctrl->rd_idx + ctrl->count) % CFG_TUH_CONTROL_QUEUE_SZ];
+
+  req->request     = (*request);
+  req->buffer      = buffer;
+  req->complete_cb = complete_cb;
+
+  // Start right away if queue was empty, otherwise it is started when the requests ahead complete.
+  // Requests ahead may be idle while waiting for a shared control pipe, leave them at the head.
+  bool const start = (ctrl->count == 0);
+  ctrl->count++;
+
+  if ( start && !_ctrl_start(dev_addr) )
+  {
+    ctrl->count--;
+    TU_BREAKPOINT();
+    return false;
+  }
 
   return true;
 }
@@ -79,7 +161,39 @@ bool tuh_control_xfer (uint8_t dev_addr, tusb_control_request_t const* request,
 static void _xfer_complete(uint8_t dev_addr, xfer_result_t result)
 {
   TU_LOG2("\r\n");
-  if (_ctrl_xfer.complete_cb) _ctrl_xfer.complete_cb(dev_addr, &_ctrl_xfer.request, result);
+
+  usbh_control_xfer_t* ctrl = &_ctrl_xfer[dev_addr];
+
+  // Remove from queue before invoking callback, which may queue another transfer
+  usbh_control_req_t const req = ctrl->queue[ctrl->rd_idx];
+
+  ctrl->rd_idx = (uint8_t) ((ctrl->rd_idx + 1) % CFG_TUH_CONTROL_QUEUE_SZ);
+  ctrl->count--;
+  ctrl->stage = STAGE_IDLE;
+
+#ifdef HCD_ATTR_CONTROL_SHARED
+  _ctrl_pipe_owner = ADDR_NONE;
+#endif
+
+  if (req.complete_cb) req.complete_cb(dev_addr, &req.request, result);
+
+  _ctrl_start_next(dev_addr);
+}
+
+// Drop all queued transfers of a closed device
+void usbh_control_close(uint8_t dev_addr)
+{
+  usbh_control_xfer_t* ctrl = &_ctrl_xfer[dev_addr];
+
+  tu_varclr(ctrl);
+
+#ifdef HCD_ATTR_CONTROL_SHARED
+  if ( _ctrl_pipe_owner == dev_addr )
+  {
+    _ctrl_pipe_owner = ADDR_NONE;
+    _ctrl_start_next(dev_addr);
+  }
+#endif
 }
 
 bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
@@ -89,7 +203,12 @@ bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result_t resu
 
   const uint8_t rhport = usbh_get_rhport(dev_addr);
 
-  tusb_control_request_t const * request = &_ctrl_xfer.request;
+  usbh_control_xfer_t* ctrl = &_ctrl_xfer[dev_addr];
+  usbh_control_req_t const* req = &ctrl->queue[ctrl->rd_idx];
+  tusb_control_request_t const * request = &req->request;
+
+  // stale event of a closed device
+  TU_VERIFY(ctrl->stage != STAGE_IDLE);
 
   if (XFER_RESULT_SUCCESS != result)
   {
@@ -99,25 +218,25 @@ bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result_t resu
     _xfer_complete(dev_addr, result);
   }else
   {
-    switch(_ctrl_xfer.stage)
+    switch(ctrl->stage)
     {
       case STAGE_SETUP:
-        _ctrl_xfer.stage = STAGE_DATA;
+        ctrl->stage = STAGE_DATA;
         if (request->wLength)
         {
           // DATA stage: initial data toggle is always 1
-          hcd_edpt_xfer(rhport, dev_addr, tu_edpt_addr(0, request->bmRequestType_bit.direction), _ctrl_xfer.buffer, request->wLength);
+          hcd_edpt_xfer(rhport, dev_addr, tu_edpt_addr(0, request->bmRequestType_bit.direction), req->buffer, request->wLength);
           return true;
         }
         __attribute__((fallthrough));
 
       case STAGE_DATA:
-        _ctrl_xfer.stage = STAGE_ACK;
+        ctrl->stage = STAGE_ACK;
 
         if (request->wLength)
         {
           TU_LOG2("Control data (addr = %u):\r\n", dev_addr);
-          TU_LOG2_MEM(_ctrl_xfer.buffer, request->wLength, 2);
+          TU_LOG2_MEM(req->buffer, request->wLength, 2);
         }
 
         // ACK stage: toggle is always 1
@@ -58,39 +58,144 @@
 
 #define FRAMELIST_SIZE                  (1024 >> FRAMELIST_SIZE_BIT_VALUE)
 
+// qTD has 5 page pointers, 16 KB can always be transferred regardless of buffer alignment.
+// Larger transfer is chained with multiple qTDs.
+#define QTD_MAX_BYTES                   (4*4096u)
+
+// Periodic bandwidth budget (USB 2.0 5.6.4): 80% of a microframe for high speed, 90% of a frame
+// for full speed behind the transaction translator. Bytes, including transaction overhead.
+#define HS_PERIODIC_BYTES               6000u
+#define FS_PERIODIC_BYTES               1350u
+#define HS_ISO_OVERHEAD                 38u
+#define FS_ISO_OVERHEAD                 9u
+#define HS_INT_OVERHEAD                 55u
+#define FS_INT_OVERHEAD                 13u
+
+// Max payload of a full speed start or complete split in one microframe
+#define SPLIT_MAX_BYTES                 188u
+
+// Frames between now and the first frame of a new (non continuous) isochronous transfer
+#define ISO_SCHEDULE_SLACK              2u
+
+// Periodic schedule tree: leaves have the longest polling interval, which is the frame list size up to
+// 32 ms. Endpoint with longer interval is polled at this rate (USB 2.0 allows shorter period).
+#define PERIOD_TREE_LEAF                ((FRAMELIST_SIZE < 32) ? FRAMELIST_SIZE : 32)
+
+// Device addresses with a control endpoint: devices, hubs and address 0
+#define DEVICE_COUNT                    (CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1)
+
+// All queue heads: control qHD of each device address followed by qHD pool
+#define QHD_COUNT                       (DEVICE_COUNT+HCD_MAX_ENDPOINT)
+
+// Terminator of free lists, which are linked by pool index
+#define INDEX_LIST_END                  0xFFFFu
+
+// Isochronous endpoint. iTDs (high speed) or siTDs (full speed via TT) of a transfer are linked
+// in front of the frame list slots of their frames, one TD per serviced frame. A transfer must
+// end within the frame list i.e before the current slot is visited again.
+typedef struct
+{
+  uint8_t  used;
+  uint8_t  highspeed;     // iTD, otherwise siTD
+  uint8_t  dev_addr;
+  uint8_t  ep_addr;
+
+  uint16_t max_packet_size;
+  uint16_t packet_size;   // max bytes per service: max packet size x mult
+  uint8_t  mult;
+
+  uint8_t  frame_phase;   // frame (modulo step) of reserved bandwidth
+  uint8_t  uframe_phase;  // first microframe of reserved bandwidth
+  uint8_t  td_count;      // TDs of current transfer, 0 if idle
+
+  uint16_t interval;      // microframes for high speed, frames for full speed
+  uint16_t step;          // frames between TDs
+
+  uint8_t  hub_addr;      // transaction translator for full speed
+  uint8_t  hub_port;
+
+  uint32_t frame_start;   // frame of first TD of current transfer
+  uint32_t frame_next;    // frame following current transfer, to continue the stream without gap
+
+  uint8_t* buffer;
+  uint32_t buflen;
+
+  uint8_t  td_idx[FRAMELIST_SIZE]; // iTD or siTD pool index of current transfer
+}ehci_iso_t;
+
 typedef struct
 {
   ehci_link_t period_framelist[FRAMELIST_SIZE];
 
-  // TODO only implement 1 ms & 2 ms & 4 ms, 8 ms (framelist)
-  // [0] : 1ms, [1] : 2ms, [2] : 4ms, [3] : 8 ms
-  // TODO better implementation without dummy head to save SRAM
-  ehci_qhd_t period_head_arr[4];
+  // Binary tree of dummy queue heads, one node per (interval, phase) with interval of 1, 2, 4 .. leaf frames.
+  // Node of interval 2^k and phase p is at [2^k - 1 + p], it is visited in frames where frame % 2^k = p.
+  // Interrupt queue heads are linked right after the node of their interval and phase.
+  ehci_qhd_t period_head_arr[2*PERIOD_TREE_LEAF - 1];
 
   // Note control qhd of dev0 is used as head of async list
   struct {
     ehci_qhd_t qhd;
     ehci_qtd_t qtd;
-  }control[CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1];
+  }control[DEVICE_COUNT];
 
   ehci_qhd_t qhd_pool[HCD_MAX_ENDPOINT];
   ehci_qtd_t qtd_pool[HCD_MAX_XFER] TU_ATTR_ALIGNED(32);
 
+  // Inactive qTD as Alternate Next of chained IN qTDs: controller stops here on short packet
+  ehci_qtd_t qtd_short_stop TU_ATTR_ALIGNED(32);
+
+  bool qtd_used[HCD_MAX_XFER];
+
+  // Free lists of qHD and qTD pool. Controller may still reach a removed qHD or a retired qTD,
+  // links are kept in separated arrays instead of descriptor words.
+  uint16_t qhd_free_head;
+  uint16_t qhd_removing_head; // removed from async list, freed on async advance
+  uint16_t qtd_free_head;
+  uint16_t qhd_free_next[HCD_MAX_ENDPOINT];
+  uint16_t qtd_free_next[HCD_MAX_XFER];
+
+  // Endpoint lookup by (dev_addr, ep_addr) for non-control endpoint: 1 + qHD pool index,
+  // 1 + HCD_MAX_ENDPOINT + iso index, or 0 if not opened
+  uint8_t ep_index[DEVICE_COUNT][30];
+
+  // Bitmap of queue heads (by qhd_id) with queued qTDs, only those are checked by transfer isr
+  uint32_t qhd_busy[(QHD_COUNT+31)/32];
+
+  ehci_itd_t  itd_pool[EHCI_MAX_ITD];
+  ehci_sitd_t sitd_pool[EHCI_MAX_SITD];
+  bool itd_used[EHCI_MAX_ITD];
+
+  ehci_iso_t iso[EHCI_MAX_ISO];
+
+  // periodic bandwidth reserved by interrupt and isochronous endpoints
+  uint16_t uframe_bw[FRAMELIST_SIZE][8];
+  uint16_t fs_bw[FRAMELIST_SIZE];
+
   ehci_registers_t* regs;
 
   volatile uint32_t uframe_number;
 }ehci_data_t;
 
+TU_VERIFY_STATIC( HCD_MAX_ENDPOINT + EHCI_MAX_ISO < 256, "ep_index is 8-bit" );
+TU_VERIFY_STATIC( HCD_MAX_XFER < INDEX_LIST_END, "free list index is 16-bit" );
+
 // Periodic frame list must be 4K alignment
 CFG_TUSB_MEM_SECTION TU_ATTR_ALIGNED(4096) static ehci_data_t ehci_data;
 
 //--------------------------------------------------------------------+
 // PROTOTYPE
 //--------------------------------------------------------------------+
-static inline ehci_link_t* get_period_head(uint8_t rhport, uint32_t interval_ms)
+// interval must be power of 2 not larger than tree leaf
+static inline ehci_link_t* get_period_head(uint8_t rhport, uint32_t interval_ms, uint32_t phase)
 {
   (void) rhport;
-  return (ehci_link_t*) &ehci_data.period_head_arr[ tu_log2( tu_min32(FRAMELIST_SIZE, interval_ms) ) ];
+  return (ehci_link_t*) &ehci_data.period_head_arr[ interval_ms - 1 + (phase & (interval_ms - 1)) ];
+}
+
+static inline bool is_period_head(uint32_t addr)
+{
+  return (addr >= (uint32_t) ehci_data.period_head_arr) &&
+         (addr <  (uint32_t) (ehci_data.period_head_arr + TU_ARRAY_SIZE(ehci_data.period_head_arr)));
 }
 
 static inline ehci_qhd_t* qhd_control(uint8_t dev_addr)
@@ -110,10 +215,33 @@ static inline ehci_qtd_t* qtd_control(uint8_t dev_addr)
   return &ehci_data.control[dev_addr].qtd;
 }
 
+// Link all entries of a pool in order, return list head
+static uint16_t index_list_init(uint16_t* next, uint16_t count)
+{
+  for(uint16_t i = 0; i < count; i++) next[i] = (i+1 < count) ? (uint16_t) (i+1) : INDEX_LIST_END;
+  return count ? 0 : INDEX_LIST_END;
+}
+
+static inline void index_list_push(uint16_t* head, uint16_t* next, uint16_t idx)
+{
+  next[idx] = *head;
+  *head     = idx;
+}
+
+static inline uint16_t index_list_pop(uint16_t* head, uint16_t const* next)
+{
+  uint16_t const idx = *head;
+  if ( idx != INDEX_LIST_END ) *head = next[idx];
+  return idx;
+}
+
 
-static inline ehci_qhd_t* qhd_next (ehci_qhd_t const * p_qhd);
 static inline ehci_qhd_t* qhd_find_free (void);
+static inline void qhd_free (ehci_qhd_t* p_qhd);
 static inline ehci_qhd_t* qhd_get_from_addr (uint8_t dev_addr, uint8_t ep_addr);
+static inline uint8_t* ep_index_get (uint8_t dev_addr, uint8_t ep_addr);
+static inline void qhd_set_busy (ehci_qhd_t const * p_qhd, bool busy);
+static void qhd_busy_foreach (void (*isr) (ehci_qhd_t*));
 
 // determine if a queue head has bus-related error
 static inline bool qhd_has_xact_error (ehci_qhd_t * p_qhd)
@@ -123,16 +251,30 @@ static inline bool qhd_has_xact_error (ehci_qhd_t * p_qhd)
 }
 
 static void qhd_init(ehci_qhd_t *p_qhd, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc);
+static uint16_t qhd_int_bw_bytes(ehci_qhd_t const* p_qhd);
+static void qhd_int_bw_update(ehci_qhd_t const* p_qhd, bool reserve);
+
+static uint8_t period_uframe_mask(uint16_t interval, uint8_t uframe_phase);
+static bool period_bw_reserve(bool highspeed, uint16_t interval, uint16_t step, uint16_t bytes,
+                              uint8_t* frame_phase, uint8_t* uframe_phase);
 
 static inline ehci_qtd_t* qtd_find_free (void);
+static inline void qtd_free (ehci_qtd_t* p_qtd);
 static inline ehci_qtd_t* qtd_next (ehci_qtd_t const * p_qtd);
 static inline void qtd_insert_to_qhd (ehci_qhd_t *p_qhd, ehci_qtd_t *p_qtd_new);
 static inline void qtd_remove_1st_from_qhd (ehci_qhd_t *p_qhd);
+static uint32_t qtd_remove_xfer_from_qhd (ehci_qhd_t *p_qhd);
 static void qtd_init (ehci_qtd_t* p_qtd, void const* buffer, uint16_t total_bytes);
 
 static inline void list_insert (ehci_link_t *current, ehci_link_t *new, uint8_t new_type);
 static inline ehci_link_t* list_next (ehci_link_t *p_link_pointer);
 
+static bool iso_open(uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc);
+static void iso_close(uint8_t dev_addr);
+static ehci_iso_t* iso_get_from_addr(uint8_t dev_addr, uint8_t ep_addr);
+static bool iso_xfer(uint8_t rhport, ehci_iso_t* iso, uint8_t * buffer, uint32_t buflen);
+static void iso_xfer_complete_isr(uint8_t rhport);
+
 //--------------------------------------------------------------------+
 // HCD API
 //--------------------------------------------------------------------+
@@ -140,7 +282,8 @@ static inline ehci_link_t* list_next (ehci_link_t *p_link_pointer);
 uint32_t hcd_frame_number(uint8_t rhport)
 {
   (void) rhport;
-  return (ehci_data.uframe_number + ehci_data.regs->frame_index) >> 3;
+  // frame index is free running, only its bits within frame list are not yet counted by rollover
+  return (ehci_data.uframe_number + (ehci_data.regs->frame_index & ((FRAMELIST_SIZE << 3) - 1))) >> 3;
 }
 
 void hcd_port_reset(uint8_t rhport)
@@ -184,13 +327,18 @@ tusb_speed_t hcd_port_speed_get(uint8_t rhport)
 
 static void list_remove_qhd_by_addr(ehci_link_t* list_head, uint8_t dev_addr)
 {
-  for(ehci_link_t* prev = list_head;
-      !prev->terminate && (tu_align32(prev->address) != (uint32_t) list_head);
-      prev = list_next(prev) )
+  // period list continues with the tree node of shorter interval, which is walked on its own
+  ehci_link_t* prev = list_head;
+
+  while ( !prev->terminate && (tu_align32(prev->address) != (uint32_t) list_head) &&
+          !is_period_head(tu_align32(prev->address)) )
   {
     // TODO check type for ISO iTD and siTD
     ehci_qhd_t* qhd = (ehci_qhd_t*) list_next(prev);
-    if ( qhd->dev_addr == dev_addr )
+    if ( qhd->dev_addr != dev_addr )
+    {
+      prev = list_next(prev);
+    }else
     {
       // TODO deactive all TD, wait for QHD to inactive before removal
       prev->address = qhd->next.address;
@@ -198,15 +346,21 @@ static void list_remove_qhd_by_addr(ehci_link_t* list_head, uint8_t dev_addr)
       // EHCI 4.8.2 link the removed qhd to async head (which always reachable by Host Controller)
       qhd->next.address = ((uint32_t) list_head) | (EHCI_QTYPE_QHD << 1);
 
+      qhd_set_busy(qhd, false);
+
       if ( qhd->int_smask )
       {
         // period list queue element is guarantee to be free in the next frame (1 ms)
-        qhd->used = 0;
+        qhd_int_bw_update(qhd, false);
+        qhd_free(qhd);
       }else
       {
         // async list use async advance handshake
         // mark as removing, will completely re-usable when async advance isr occurs
         qhd->removing = 1;
+
+        uint32_t const idx = (uint32_t) (qhd - ehci_data.qhd_pool);
+        if ( idx < HCD_MAX_ENDPOINT ) index_list_push(&ehci_data.qhd_removing_head, ehci_data.qhd_free_next, (uint16_t) idx);
       }
     }
   }
@@ -218,15 +372,24 @@ void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
   // skip dev0
   if (dev_addr == 0) return;
 
+  // free lists and busy bitmap are also updated by isr
+  hcd_int_disable(rhport);
+
   // Remove from async list
   list_remove_qhd_by_addr( (ehci_link_t*) qhd_async_head(rhport), dev_addr );
 
-  // Remove from all interval period list
+  // Remove from all nodes of period tree
   for(uint8_t i = 0; i < TU_ARRAY_SIZE(ehci_data.period_head_arr); i++)
   {
     list_remove_qhd_by_addr( (ehci_link_t*) &ehci_data.period_head_arr[i], dev_addr);
   }
 
+  iso_close(dev_addr);
+
+  if ( dev_addr < DEVICE_COUNT ) tu_memclr(ehci_data.ep_index[dev_addr], sizeof(ehci_data.ep_index[dev_addr]));
+
+  hcd_int_enable(rhport);
+
   // Async doorbell (EHCI 4.8.2 for operational details)
   ehci_data.regs->command_bm.async_adv_doorbell = 1;
 }
@@ -261,49 +424,51 @@ bool ehci_init(uint8_t rhport, uint32_t capability_reg, uint32_t operatial_reg)
 
   regs->async_list_addr = (uint32_t) async_head;
 
+  ehci_data.qtd_short_stop.next.terminate      = 1;
+  ehci_data.qtd_short_stop.alternate.terminate = 1;
+
+  //------------- Free lists -------------//
+  ehci_data.qhd_free_head     = index_list_init(ehci_data.qhd_free_next, HCD_MAX_ENDPOINT);
+  ehci_data.qtd_free_head     = index_list_init(ehci_data.qtd_free_next, HCD_MAX_XFER);
+  ehci_data.qhd_removing_head = INDEX_LIST_END;
+
   //------------- Periodic List -------------//
-  // Build the polling interval tree with 1 ms, 2 ms, 4 ms and 8 ms (framesize) only
+  // Build the polling interval tree: node of interval 2^k and phase p links to node of interval 2^(k-1)
+  // and phase p % 2^(k-1), down to the 1 ms root. Frame list slot i starts at the leaf of phase i % leaf.
   for ( uint32_t i = 0; i < TU_ARRAY_SIZE(ehci_data.period_head_arr); i++ )
   {
     ehci_data.period_head_arr[i].int_smask          = 1; // queue head in period list must have smask non-zero
     ehci_data.period_head_arr[i].qtd_overlay.halted = 1; // dummy node, always inactive
   }
 
-  ehci_link_t * const framelist  = ehci_data.period_framelist;
-  ehci_link_t * const period_1ms = get_period_head(rhport, 1u);
-
-  // all links --> period_head_arr[0] (1ms)
-  // 0, 2, 4, 6 etc --> period_head_arr[1] (2ms)
-  // 1, 5 --> period_head_arr[2] (4ms)
-  // 3 --> period_head_arr[3] (8ms)
-
-  // TODO EHCI_FRAMELIST_SIZE with other size than 8
-  for(uint32_t i=0; i<FRAMELIST_SIZE; i++)
+  for ( uint32_t interval = 2; interval <= PERIOD_TREE_LEAF; interval <<= 1 )
   {
-    framelist[i].address = (uint32_t) period_1ms;
-    framelist[i].type    = EHCI_QTYPE_QHD;
+    for ( uint32_t phase = 0; phase < interval; phase++ )
+    {
+      ehci_link_t* node = get_period_head(rhport, interval, phase);
+      node->address = (uint32_t) get_period_head(rhport, interval >> 1, phase);
+      node->type    = EHCI_QTYPE_QHD;
+    }
   }
 
-  for(uint32_t i=0; i<FRAMELIST_SIZE; i+=2)
-  {
-    list_insert(framelist + i, get_period_head(rhport, 2u), EHCI_QTYPE_QHD);
-  }
+  get_period_head(rhport, 1u, 0)->terminate = 1;
 
-  for(uint32_t i=1; i<FRAMELIST_SIZE; i+=4)
+  ehci_link_t * const framelist = ehci_data.period_framelist;
+  for(uint32_t i=0; i<FRAMELIST_SIZE; i++)
   {
-    list_insert(framelist + i, get_period_head(rhport, 4u), EHCI_QTYPE_QHD);
+    framelist[i].address = (uint32_t) get_period_head(rhport, PERIOD_TREE_LEAF, i);
+    framelist[i].type    = EHCI_QTYPE_QHD;
   }
 
-  list_insert(framelist+3, get_period_head(rhport, 8u), EHCI_QTYPE_QHD);
-
-  period_1ms->terminate    = 1;
-
   regs->periodic_list_base = (uint32_t) framelist;
 
   //------------- TT Control (NXP only) -------------//
   regs->nxp_tt_control = 0;
 
   //------------- USB CMD Register -------------//
+  // interrupt at the next microframe (default is 8): isochronous stream can be continued in the same frame
+  regs->command_bm.int_threshold = 1;
+
   regs->command |= TU_BIT(EHCI_USBCMD_POS_RUN_STOP) | TU_BIT(EHCI_USBCMD_POS_ASYNC_ENABLE) |
                    TU_BIT(EHCI_USBCMD_POS_PERIOD_ENABLE) |  // TODO enable period list only there is int/iso endpoint
                    FRAMELIST_SIZE_USBCMD_VALUE;
@@ -336,23 +501,42 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
 {
   (void) rhport;
 
-  // TODO not support ISO yet
-  TU_ASSERT (ep_desc->bmAttributes.xfer != TUSB_XFER_ISOCHRONOUS);
+  // iTD/siTD are linked directly to frame list when transfer is queued
+  if ( ep_desc->bmAttributes.xfer == TUSB_XFER_ISOCHRONOUS ) return iso_open(dev_addr, ep_desc);
 
   //------------- Prepare Queue Head -------------//
   ehci_qhd_t * p_qhd;
 
+  uint8_t* ep_idx = NULL;
+
   if ( ep_desc->bEndpointAddress == 0 )
   {
+    TU_ASSERT(dev_addr < DEVICE_COUNT);
     p_qhd = qhd_control(dev_addr);
   }else
   {
+    ep_idx = ep_index_get(dev_addr, ep_desc->bEndpointAddress);
+    TU_ASSERT(ep_idx);
+
+    hcd_int_disable(rhport);
     p_qhd = qhd_find_free();
+    hcd_int_enable(rhport);
   }
   TU_ASSERT(p_qhd);
 
   qhd_init(p_qhd, dev_addr, ep_desc);
 
+  // invalid endpoint descriptor
+  if ( !p_qhd->used )
+  {
+    hcd_int_disable(rhport);
+    qhd_free(p_qhd);
+    hcd_int_enable(rhport);
+    TU_ASSERT(false);
+  }
+
+  if ( ep_idx ) *ep_idx = (uint8_t) (1 + (p_qhd - ehci_data.qhd_pool));
+
   // control of dev0 is always present as async head
   if ( dev_addr == 0 ) return true;
 
@@ -367,11 +551,7 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
     break;
 
     case TUSB_XFER_INTERRUPT:
-      list_head = get_period_head(rhport, p_qhd->interval_ms);
-    break;
-
-    case TUSB_XFER_ISOCHRONOUS:
-      // TODO iso is not supported
+      list_head = get_period_head(rhport, p_qhd->interval_ms, p_qhd->frame_phase);
     break;
 
     default: break;
@@ -400,6 +580,11 @@ bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet
   // sw region
   qhd->p_qtd_list_head = td;
   qhd->p_qtd_list_tail = td;
+  qhd->total_bytes     = 8;
+
+  hcd_int_disable(rhport);
+  qhd_set_busy(qhd, true);
+  hcd_int_enable(rhport);
 
   // attach TD
   qhd->qtd_overlay.next.address = (uint32_t) td;
@@ -407,7 +592,7 @@ bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet
   return true;
 }
 
-bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen)
+bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint32_t buflen)
 {
   (void) rhport;
 
@@ -419,7 +604,10 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *
     ehci_qhd_t* qhd = qhd_control(dev_addr);
     ehci_qtd_t* qtd = qtd_control(dev_addr);
 
-    qtd_init(qtd, buffer, buflen);
+    // control transfer has only one qTD
+    TU_ASSERT(buflen <= QTD_MAX_BYTES);
+
+    qtd_init(qtd, buffer, (uint16_t) buflen);
 
     // first first data toggle is always 1 (data & setup stage)
     qtd->data_toggle = 1;
@@ -430,22 +618,83 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *
     // sw region
     qhd->p_qtd_list_head = qtd;
     qhd->p_qtd_list_tail = qtd;
+    qhd->total_bytes     = buflen;
+
+    hcd_int_disable(rhport);
+    qhd_set_busy(qhd, true);
+    hcd_int_enable(rhport);
 
     // attach TD
     qhd->qtd_overlay.next.address = (uint32_t) qtd;
   }else
   {
+    ehci_iso_t* iso = iso_get_from_addr(dev_addr, ep_addr);
+    if ( iso ) return iso_xfer(rhport, iso, buffer, buflen);
+
     ehci_qhd_t *p_qhd = qhd_get_from_addr(dev_addr, ep_addr);
-    ehci_qtd_t *p_qtd = qtd_find_free();
-    TU_ASSERT(p_qtd);
+    TU_ASSERT(p_qhd);
+
+    // Each qTD except the last one transfers a multiple of max packet size, so that short packet only
+    // occurs at the end of transfer or on IN endpoint where the alternate pointer stops the queue.
+    uint32_t const qtd_max = QTD_MAX_BYTES - (QTD_MAX_BYTES % p_qhd->max_packet_size);
+
+    ehci_qtd_t* head = NULL;
+    ehci_qtd_t* prev = NULL;
+    uint32_t offset = 0;
+
+    // qTD free list and busy bitmap are also updated by isr
+    hcd_int_disable(rhport);
+
+    do
+    {
+      ehci_qtd_t *p_qtd = qtd_find_free();
 
-    qtd_init(p_qtd, buffer, buflen);
-    p_qtd->pid = p_qhd->pid;
+      if ( p_qtd == NULL )
+      {
+        // not enough qTD, release ones allocated for this transfer
+        while ( head )
+        {
+          ehci_qtd_t* next = (head == prev) ? NULL : qtd_next(head);
+          qtd_free(head);
+          head = next;
+        }
+        hcd_int_enable(rhport);
+        TU_ASSERT(false);
+      }
+
+      uint16_t const len = (uint16_t) tu_min32(buflen - offset, qtd_max);
+
+      qtd_init(p_qtd, buffer + offset, len);
+      p_qtd->pid = p_qhd->pid;
+
+      if ( prev )
+      {
+        prev->next.address = (uint32_t) p_qtd;
+
+        // short packet on IN stops the queue instead of continuing with the rest of this transfer
+        if ( p_qhd->pid == EHCI_PID_IN ) prev->alternate.address = (uint32_t) &ehci_data.qtd_short_stop;
+      }else
+      {
+        head = p_qtd;
+      }
+
+      prev    = p_qtd;
+      offset += len;
+    } while ( offset < buflen );
+
+    prev->int_on_complete = 1;
 
-    // Insert TD to QH
-    qtd_insert_to_qhd(p_qhd, p_qtd);
+    p_qhd->total_bytes = buflen;
 
-    p_qhd->p_qtd_list_tail->int_on_complete = 1;
+    // Insert TDs to QH
+    qtd_insert_to_qhd(p_qhd, head);
+    p_qhd->p_qtd_list_tail = prev;
+
+    qhd_set_busy(p_qhd, true);
+    hcd_int_enable(rhport);
+
+    // Previous transfer may end with short packet that leaves alternate pointer in overlay
+    p_qhd->qtd_overlay.alternate.terminate = 1;
 
     // attach head QTD to QHD start transferring
     p_qhd->qtd_overlay.next.address = (uint32_t) p_qhd->p_qtd_list_head;
@@ -457,6 +706,8 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *
 bool hcd_edpt_clear_stall(uint8_t dev_addr, uint8_t ep_addr)
 {
   ehci_qhd_t *p_qhd = qhd_get_from_addr(dev_addr, ep_addr);
+  TU_ASSERT(p_qhd);
+
   p_qhd->qtd_overlay.halted = 0;
   // TODO reset data toggle ?
   return true;
@@ -473,14 +724,12 @@ static void async_advance_isr(uint8_t rhport)
 {
   (void) rhport;
 
-  ehci_qhd_t* qhd_pool = ehci_data.qhd_pool;
-  for(uint32_t i = 0; i < HCD_MAX_ENDPOINT; i++)
+  uint16_t idx;
+  while ( INDEX_LIST_END != (idx = index_list_pop(&ehci_data.qhd_removing_head, ehci_data.qhd_free_next)) )
   {
-    if ( qhd_pool[i].removing )
-    {
-      qhd_pool[i].removing = 0;
-      qhd_pool[i].used     = 0;
-    }
+    ehci_qhd_t* qhd = &ehci_data.qhd_pool[idx];
+    qhd->removing = 0;
+    qhd_free(qhd);
   }
 }
 
@@ -499,72 +748,29 @@ static void port_connect_status_change_isr(uint8_t rhport)
 
 static void qhd_xfer_complete_isr(ehci_qhd_t * p_qhd)
 {
+  // halted or error is processed in error isr
+  if ( p_qhd->qtd_overlay.halted ) return;
+
   // free all TDs from the head td to the first active TD
   while(p_qhd->p_qtd_list_head != NULL && !p_qhd->p_qtd_list_head->active)
   {
     ehci_qtd_t * volatile qtd = (ehci_qtd_t * volatile) p_qhd->p_qtd_list_head;
-    bool const is_ioc = (qtd->int_on_complete != 0);
     uint8_t const ep_addr = tu_edpt_addr(p_qhd->ep_number, qtd->pid == EHCI_PID_IN ? 1 : 0);
 
-    p_qhd->total_xferred_bytes += qtd->expected_bytes - qtd->total_bytes;
-
-    // TD need to be freed and removed from qhd, before invoking callback
-    qtd->used = 0; // free QTD
-    qtd_remove_1st_from_qhd(p_qhd);
-
-    if (is_ioc)
+    if ( qtd->int_on_complete || qtd->total_bytes )
     {
-      hcd_event_xfer_complete(p_qhd->dev_addr, ep_addr, p_qhd->total_xferred_bytes, XFER_RESULT_SUCCESS, true);
-      p_qhd->total_xferred_bytes = 0;
-    }
-  }
-}
+      // Last qTD or short packet: transfer is complete, remaining qTDs (if any) are not executed.
+      // TD need to be freed and removed from qhd, before invoking callback
+      uint32_t const xferred_bytes = p_qhd->total_bytes - qtd_remove_xfer_from_qhd(p_qhd);
+      if ( p_qhd->p_qtd_list_head == NULL ) qhd_set_busy(p_qhd, false);
 
-static void async_list_xfer_complete_isr(ehci_qhd_t * const async_head)
-{
-  ehci_qhd_t *p_qhd = async_head;
-  do
-  {
-    if ( !p_qhd->qtd_overlay.halted ) // halted or error is processed in error isr
+      hcd_event_xfer_complete(p_qhd->dev_addr, ep_addr, xferred_bytes, XFER_RESULT_SUCCESS, true);
+    }else
     {
-      qhd_xfer_complete_isr(p_qhd);
+      // qTD in the middle of transfer
+      qtd_remove_1st_from_qhd(p_qhd);
+      qtd_free(qtd);
     }
-    p_qhd = qhd_next(p_qhd);
-  }while(p_qhd != async_head); // async list traversal, stop if loop around
-}
-
-static void period_list_xfer_complete_isr(uint8_t hostid, uint32_t interval_ms)
-{
-  uint16_t max_loop = 0;
-  uint32_t const period_1ms_addr = (uint32_t) get_period_head(hostid, 1u);
-  ehci_link_t next_item = * get_period_head(hostid, interval_ms);
-
-  // TODO abstract max loop guard for period
-  while( !next_item.terminate &&
-      !(interval_ms > 1 && period_1ms_addr == tu_align32(next_item.address)) &&
-      max_loop < (HCD_MAX_ENDPOINT + EHCI_MAX_ITD + EHCI_MAX_SITD)*CFG_TUH_DEVICE_MAX)
-  {
-    switch ( next_item.type )
-    {
-      case EHCI_QTYPE_QHD:
-      {
-        ehci_qhd_t *p_qhd_int = (ehci_qhd_t *) tu_align32(next_item.address);
-        if ( !p_qhd_int->qtd_overlay.halted )
-        {
-          qhd_xfer_complete_isr(p_qhd_int);
-        }
-      }
-      break;
-
-      case EHCI_QTYPE_ITD: // TODO support hs/fs ISO
-      case EHCI_QTYPE_SITD:
-      case EHCI_QTYPE_FSTN:
-				
-      default: break;
-    }
-
-    next_item = *list_next(&next_item);
-    max_loop++;
   }
 }
 
@@ -579,12 +785,13 @@ static void qhd_xfer_error_isr(ehci_qhd_t * p_qhd)
     // no error bits are set, endpoint is halted due to STALL
     error_event = qhd_has_xact_error(p_qhd) ? XFER_RESULT_FAILED : XFER_RESULT_STALLED;
 
-    p_qhd->total_xferred_bytes += p_qhd->p_qtd_list_head->expected_bytes - p_qhd->p_qtd_list_head->total_bytes;
-
 //    if ( XFER_RESULT_FAILED == error_event )    TU_BREAKPOINT(); // TODO skip unplugged device
 
-    p_qhd->p_qtd_list_head->used = 0; // free QTD
-    qtd_remove_1st_from_qhd(p_qhd);
+    // remove all qTDs of the failed transfer
+    uint32_t const xferred_bytes = p_qhd->total_bytes - qtd_remove_xfer_from_qhd(p_qhd);
+
+    p_qhd->qtd_overlay.next.terminate      = 1;
+    p_qhd->qtd_overlay.alternate.terminate = 1;
 
     if ( 0 == p_qhd->ep_number )
     {
@@ -592,60 +799,13 @@ static void qhd_xfer_error_isr(ehci_qhd_t * p_qhd)
       p_qhd->p_qtd_list_head = NULL;
       p_qhd->p_qtd_list_tail = NULL;
 
-      p_qhd->qtd_overlay.next.terminate      = 1;
-      p_qhd->qtd_overlay.alternate.terminate = 1;
-      p_qhd->qtd_overlay.halted              = 0;
-
-      ehci_qtd_t *p_setup = qtd_control(p_qhd->dev_addr);
-      p_setup->used = 0;
+      p_qhd->qtd_overlay.halted = 0;
     }
 
-    // call USBH callback
-    hcd_event_xfer_complete(p_qhd->dev_addr, tu_edpt_addr(p_qhd->ep_number, p_qhd->pid == EHCI_PID_IN ? 1 : 0), p_qhd->total_xferred_bytes, error_event, true);
-
-    p_qhd->total_xferred_bytes = 0;
-  }
-}
-
-static void xfer_error_isr(uint8_t hostid)
-{
-  //------------- async list -------------//
-  ehci_qhd_t * const async_head = qhd_async_head(hostid);
-  ehci_qhd_t *p_qhd = async_head;
-  do
-  {
-    qhd_xfer_error_isr( p_qhd );
-    p_qhd = qhd_next(p_qhd);
-  }while(p_qhd != async_head); // async list traversal, stop if loop around
-
-  //------------- TODO refractor period list -------------//
-  uint32_t const period_1ms_addr = (uint32_t) get_period_head(hostid, 1u);
-  for (uint32_t interval_ms=1; interval_ms <= FRAMELIST_SIZE; interval_ms *= 2)
-  {
-    ehci_link_t next_item = * get_period_head(hostid, interval_ms);
-
-    // TODO abstract max loop guard for period
-    while( !next_item.terminate &&
-           !(interval_ms > 1 && period_1ms_addr == tu_align32(next_item.address)) )
-    {
-      switch ( next_item.type )
-      {
-        case EHCI_QTYPE_QHD:
-        {
-          ehci_qhd_t *p_qhd_int = (ehci_qhd_t *) tu_align32(next_item.address);
-          qhd_xfer_error_isr(p_qhd_int);
-        }
-        break;
-
-				// TODO support hs/fs ISO
-        case EHCI_QTYPE_ITD:
-        case EHCI_QTYPE_SITD:
-        case EHCI_QTYPE_FSTN:
-        default: break;
-      }
+    if ( p_qhd->p_qtd_list_head == NULL ) qhd_set_busy(p_qhd, false);
 
-      next_item = *list_next(&next_item);
-    }
+    // call USBH callback
+    hcd_event_xfer_complete(p_qhd->dev_addr, tu_edpt_addr(p_qhd->ep_number, p_qhd->pid == EHCI_PID_IN ? 1 : 0), xferred_bytes, error_event, true);
   }
 }
 
@@ -682,21 +842,21 @@ void hcd_int_handler(uint8_t rhport)
 
   if (int_status & EHCI_INT_MASK_ERROR)
   {
-    xfer_error_isr(rhport);
+    qhd_busy_foreach(qhd_xfer_error_isr);
   }
 
-  //------------- some QTD/SITD/ITD with IOC set is completed -------------//
-  if (int_status & EHCI_INT_MASK_NXP_ASYNC)
+  // Isochronous transfer is complete when its last TD is retired, or its last frame has passed
+  // without it (e.g queued too late). Rollover occurs every frame list period and catches the latter.
+  if (int_status & (EHCI_INT_MASK_ERROR | EHCI_INT_MASK_NXP_PERIODIC | EHCI_INT_MASK_FRAMELIST_ROLLOVER))
   {
-    async_list_xfer_complete_isr( qhd_async_head(rhport) );
+    iso_xfer_complete_isr(rhport);
   }
 
-  if (int_status & EHCI_INT_MASK_NXP_PERIODIC)
+  //------------- some QTD/SITD/ITD with IOC set is completed -------------//
+  // only queue heads with queued qTDs are checked regardless of async or period list
+  if (int_status & (EHCI_INT_MASK_NXP_ASYNC | EHCI_INT_MASK_NXP_PERIODIC))
   {
-    for (uint32_t i=1; i <= FRAMELIST_SIZE; i *= 2)
-    {
-      period_list_xfer_complete_isr( rhport, i );
-    }
+    qhd_busy_foreach(qhd_xfer_complete_isr);
   }
 
   //------------- There is some removed async previously -------------//
@@ -714,44 +874,96 @@ void hcd_int_handler(uint8_t rhport)
 //------------- queue head helper -------------//
 static inline ehci_qhd_t* qhd_find_free (void)
 {
-  for (uint32_t i=0; i<HCD_MAX_ENDPOINT; i++)
-  {
-    if ( !ehci_data.qhd_pool[i].used ) return &ehci_data.qhd_pool[i];
-  }
+  uint16_t const idx = index_list_pop(&ehci_data.qhd_free_head, ehci_data.qhd_free_next);
+  return (idx == INDEX_LIST_END) ? NULL : &ehci_data.qhd_pool[idx];
+}
+
+// control qHDs are not allocated from pool
+static inline void qhd_free(ehci_qhd_t* p_qhd)
+{
+  p_qhd->used = 0;
 
-  return NULL;
+  uint32_t const idx = (uint32_t) (p_qhd - ehci_data.qhd_pool);
+  if ( idx < HCD_MAX_ENDPOINT ) index_list_push(&ehci_data.qhd_free_head, ehci_data.qhd_free_next, (uint16_t) idx);
 }
 
-static inline ehci_qhd_t* qhd_next(ehci_qhd_t const * p_qhd)
+// Entry of endpoint lookup table, NULL if address is out of range
+static inline uint8_t* ep_index_get(uint8_t dev_addr, uint8_t ep_addr)
 {
-  return (ehci_qhd_t*) tu_align32(p_qhd->next.address);
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  if ( dev_addr >= DEVICE_COUNT || epnum == 0 ) return NULL;
+
+  return &ehci_data.ep_index[dev_addr][2*(epnum-1) + tu_edpt_dir(ep_addr)];
 }
 
 static inline ehci_qhd_t* qhd_get_from_addr(uint8_t dev_addr, uint8_t ep_addr)
 {
-  ehci_qhd_t* qhd_pool = ehci_data.qhd_pool;
+  if ( tu_edpt_number(ep_addr) == 0 ) return (dev_addr < DEVICE_COUNT) ? qhd_control(dev_addr) : NULL;
+
+  uint8_t const* ep_idx = ep_index_get(dev_addr, ep_addr);
+  if ( ep_idx == NULL || *ep_idx == 0 || *ep_idx > HCD_MAX_ENDPOINT ) return NULL;
+
+  return &ehci_data.qhd_pool[*ep_idx - 1];
+}
+
+// Control qHD is identified by its device address, pool qHD follows
+static inline uint16_t qhd_id(ehci_qhd_t const * p_qhd)
+{
+  if ( p_qhd->ep_number == 0 ) return p_qhd->dev_addr;
+  return (uint16_t) (DEVICE_COUNT + (p_qhd - ehci_data.qhd_pool));
+}
+
+static inline ehci_qhd_t* qhd_from_id(uint16_t id)
+{
+  return (id < DEVICE_COUNT) ? qhd_control((uint8_t) id) : &ehci_data.qhd_pool[id - DEVICE_COUNT];
+}
+
+static inline void qhd_set_busy(ehci_qhd_t const * p_qhd, bool busy)
+{
+  uint16_t const id = qhd_id(p_qhd);
 
-  for(uint32_t i=0; i<HCD_MAX_ENDPOINT; i++)
+  if ( busy )
+  {
+    ehci_data.qhd_busy[id / 32] |= TU_BIT(id % 32);
+  }else
+  {
+    ehci_data.qhd_busy[id / 32] &= ~TU_BIT(id % 32);
+  }
+}
+
+// Invoke isr on each queue head with queued qTDs, idle endpoints cost a bit each
+static void qhd_busy_foreach(void (*isr) (ehci_qhd_t*))
+{
+  for(uint16_t i = 0; i < TU_ARRAY_SIZE(ehci_data.qhd_busy); i++)
   {
-    if ( (qhd_pool[i].dev_addr == dev_addr) &&
-          ep_addr == tu_edpt_addr(qhd_pool[i].ep_number, qhd_pool[i].pid) )
+    uint32_t busy = ehci_data.qhd_busy[i];
+
+    for(uint16_t id = (uint16_t) (i*32); busy; id++, busy >>= 1)
     {
-      return &qhd_pool[i];
+      if ( busy & 1 ) isr( qhd_from_id(id) );
     }
   }
-
-  return NULL;
 }
 
 //------------- TD helper -------------//
 static inline ehci_qtd_t* qtd_find_free(void)
 {
-  for (uint32_t i=0; i<HCD_MAX_XFER; i++)
+  uint16_t const idx = index_list_pop(&ehci_data.qtd_free_head, ehci_data.qtd_free_next);
+  if ( idx == INDEX_LIST_END ) return NULL;
+
+  ehci_data.qtd_used[idx] = true;
+  return &ehci_data.qtd_pool[idx];
+}
+
+// control qTDs are not allocated from pool
+static inline void qtd_free(ehci_qtd_t* p_qtd)
+{
+  uint32_t const idx = (uint32_t) (p_qtd - ehci_data.qtd_pool);
+  if ( idx < HCD_MAX_XFER && ehci_data.qtd_used[idx] )
   {
-    if ( !ehci_data.qtd_pool[i].used ) return &ehci_data.qtd_pool[i];
+    ehci_data.qtd_used[idx] = false;
+    index_list_push(&ehci_data.qtd_free_head, ehci_data.qtd_free_next, (uint16_t) idx);
   }
-
-  return NULL;
 }
 
 static inline ehci_qtd_t* qtd_next(ehci_qtd_t const * p_qtd )
@@ -782,6 +994,27 @@ static inline void qtd_insert_to_qhd(ehci_qhd_t *p_qhd, ehci_qtd_t *p_qtd_new)
   }
 }
 
+// Remove qTDs from head up to the last one of current transfer, return number of bytes not transferred
+static uint32_t qtd_remove_xfer_from_qhd(ehci_qhd_t *p_qhd)
+{
+  uint32_t remaining = 0;
+
+  while ( p_qhd->p_qtd_list_head != NULL )
+  {
+    ehci_qtd_t* qtd = p_qhd->p_qtd_list_head;
+    bool const is_last = (qtd->int_on_complete != 0);
+
+    remaining += qtd->total_bytes;
+
+    qtd_remove_1st_from_qhd(p_qhd);
+    qtd_free(qtd);
+
+    if ( is_last ) break;
+  }
+
+  return remaining;
+}
+
 static void qhd_init(ehci_qhd_t *p_qhd, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
 {
   // address 0 is used as async head, which always on the list --> cannot be cleared (ehci halted otherwise)
@@ -807,29 +1040,31 @@ static void qhd_init(ehci_qhd_t *p_qhd, uint8_t dev_addr, tusb_desc_endpoint_t c
   p_qhd->nak_reload         = 0;
 
   // Bulk/Control -> smask = cmask = 0
-  // TODO Isochronous
+  // Interrupt is polled every power of 2 frames (up to tree leaf) at the least loaded phase
   if (TUSB_XFER_INTERRUPT == xfer_type)
   {
+    uint8_t uframe_phase = 0;
+
     if (TUSB_SPEED_HIGH == p_qhd->ep_speed)
     {
-      TU_ASSERT( interval <= 16, );
-      if ( interval < 4) // sub milisecond interval
-      {
-        p_qhd->interval_ms = 0;
-        p_qhd->int_smask   = (interval == 1) ? TU_BIN8(11111111) :
-                             (interval == 2) ? TU_BIN8(10101010) : TU_BIN8(01000100);
-      }else
-      {
-        p_qhd->interval_ms = (uint8_t) tu_min16( 1 << (interval-4), 255 );
-        p_qhd->int_smask = TU_BIT(interval % 8);
-      }
+      TU_ASSERT( 1 <= interval && interval <= 16, );
+      uint16_t const interval_uframe = (uint16_t) (1u << (interval-1));
+
+      p_qhd->interval_ms = (uint8_t) tu_min16( tu_max16(1, interval_uframe >> 3), PERIOD_TREE_LEAF );
+      TU_VERIFY( period_bw_reserve(true, interval_uframe, p_qhd->interval_ms, qhd_int_bw_bytes(p_qhd),
+                                   &p_qhd->frame_phase, &uframe_phase), );
+
+      p_qhd->int_smask = period_uframe_mask(interval_uframe, uframe_phase);
     }else
     {
       TU_ASSERT( 0 != interval, );
+      p_qhd->interval_ms = (uint8_t) tu_min32( 1u << tu_log2(interval), PERIOD_TREE_LEAF );
+      TU_VERIFY( period_bw_reserve(false, 1, p_qhd->interval_ms, qhd_int_bw_bytes(p_qhd),
+                                   &p_qhd->frame_phase, &uframe_phase), );
+
       // Full/Low: 4.12.2.1 (EHCI) case 1 schedule start split at 1 us & complete split at 2,3,4 uframes
       p_qhd->int_smask    = 0x01;
       p_qhd->fl_int_cmask = TU_BIN8(11100);
-      p_qhd->interval_ms  = interval;
     }
   }else
   {
@@ -861,15 +1096,12 @@ static void qtd_init(ehci_qtd_t* p_qtd, void const* buffer, uint16_t total_bytes
 {
   tu_memclr(p_qtd, sizeof(ehci_qtd_t));
 
-  p_qtd->used                = 1;
-
   p_qtd->next.terminate      = 1; // init to null
-  p_qtd->alternate.terminate = 1; // not used, always set to terminated
+  p_qtd->alternate.terminate = 1; // only used by chained IN qTDs
   p_qtd->active              = 1;
   p_qtd->err_count           = 3; // TODO 3 consecutive errors tolerance
   p_qtd->data_toggle         = 0;
   p_qtd->total_bytes         = total_bytes;
-  p_qtd->expected_bytes      = total_bytes;
 
   p_qtd->buffer[0] = (uint32_t) buffer;
   for(uint8_t i=1; i<5; i++)
@@ -878,6 +1110,513 @@ static void qtd_init(ehci_qtd_t* p_qtd, void const* buffer, uint16_t total_bytes
   }
 }
 
+//------------- Isochronous helper -------------//
+
+static inline uint8_t iso_packet_per_td(ehci_iso_t const* iso)
+{
+  // iTD holds all microframes of a frame, siTD one full speed packet
+  return (iso->highspeed && iso->interval < 8) ? (uint8_t) (8 / iso->interval) : 1;
+}
+
+static inline uint32_t iso_packet_count(ehci_iso_t const* iso)
+{
+  // zero length transfer still has one (empty) packet
+  return tu_max32(1, tu_div_ceil(iso->buflen, iso->packet_size));
+}
+
+// IN expects full packets except the last one, which is limited by buffer length
+static inline uint16_t iso_packet_len(ehci_iso_t const* iso, uint32_t packet)
+{
+  return (uint16_t) tu_min32(iso->packet_size, iso->buflen - packet*iso->packet_size);
+}
+
+static inline ehci_link_t* iso_td(ehci_iso_t const* iso, uint8_t i)
+{
+  return iso->highspeed ? (ehci_link_t*) &ehci_data.itd_pool[iso->td_idx[i]] :
+                          (ehci_link_t*) &ehci_data.sitd_pool[iso->td_idx[i]];
+}
+
+static inline uint32_t iso_td_frame(ehci_iso_t const* iso, uint8_t i)
+{
+  return iso->frame_start + i*iso->step;
+}
+
+static bool iso_td_active(ehci_iso_t const* iso, uint8_t i)
+{
+  if ( !iso->highspeed ) return ehci_data.sitd_pool[iso->td_idx[i]].active;
+
+  ehci_itd_t const* itd = &ehci_data.itd_pool[iso->td_idx[i]];
+  for(uint8_t u=0; u<8; u++)
+  {
+    if ( itd->xact[u].active ) return true;
+  }
+
+  return false;
+}
+
+static bool iso_td_alloc(ehci_iso_t* iso, uint8_t count)
+{
+  uint8_t const pool_size = iso->highspeed ? EHCI_MAX_ITD : EHCI_MAX_SITD;
+  uint8_t n = 0;
+
+  for(uint8_t i=0; i<pool_size && n < count; i++)
+  {
+    bool const used = iso->highspeed ? ehci_data.itd_used[i] : ehci_data.sitd_pool[i].used;
+    if ( !used ) iso->td_idx[n++] = i;
+  }
+
+  TU_VERIFY(n == count);
+
+  for(uint8_t i=0; i<count; i++)
+  {
+    if ( iso->highspeed ) ehci_data.itd_used[iso->td_idx[i]] = true;
+    else                  ehci_data.sitd_pool[iso->td_idx[i]].used = 1;
+  }
+
+  return true;
+}
+
+// iTD/siTD are always in front of the interrupt queue heads of a frame list slot
+static void list_remove_iso_td(uint32_t slot, ehci_link_t* td)
+{
+  ehci_link_t* prev = &ehci_data.period_framelist[slot];
+
+  while ( !prev->terminate && prev->type != EHCI_QTYPE_QHD )
+  {
+    ehci_link_t* next = list_next(prev);
+    if ( next == td )
+    {
+      prev->address = td->address;
+      return;
+    }
+    prev = next;
+  }
+}
+
+// Deactivate, unlink and free all TDs of current transfer.
+// Only called when their frames are over or endpoint is closed, slots being executed are never re-used
+// since new TDs are linked to frames ahead of the current one.
+static void iso_td_release(ehci_iso_t* iso)
+{
+  for(uint8_t i=0; i<iso->td_count; i++)
+  {
+    uint8_t const idx = iso->td_idx[i];
+
+    if ( iso->highspeed )
+    {
+      ehci_itd_t* itd = &ehci_data.itd_pool[idx];
+      for(uint8_t u=0; u<8; u++) itd->xact[u].active = 0;
+
+      list_remove_iso_td(iso_td_frame(iso, i) % FRAMELIST_SIZE, (ehci_link_t*) itd);
+      ehci_data.itd_used[idx] = false;
+    }else
+    {
+      ehci_sitd_t* sitd = &ehci_data.sitd_pool[idx];
+      sitd->active = 0;
+
+      list_remove_iso_td(iso_td_frame(iso, i) % FRAMELIST_SIZE, (ehci_link_t*) sitd);
+      sitd->used = 0;
+    }
+  }
+
+  iso->td_count = 0;
+}
+
+static void itd_init(ehci_iso_t const* iso, ehci_itd_t* itd, uint32_t packet, uint8_t count, bool last)
+{
+  tu_memclr(itd, sizeof(ehci_itd_t));
+
+  // up to 8 x 3 KB from first packet, always within 7 pages
+  uint32_t const base = tu_align4k((uint32_t) (iso->buffer + packet*iso->packet_size));
+  for(uint8_t p=0; p<7; p++)
+  {
+    itd->BufferPointer[p] = base + p*4096u;
+  }
+
+  itd->BufferPointer[0] |= (uint32_t) (iso->dev_addr | (tu_edpt_number(iso->ep_addr) << 8));
+  itd->BufferPointer[1] |= (uint32_t) (iso->max_packet_size | (tu_edpt_dir(iso->ep_addr) << 11));
+  itd->BufferPointer[2] |= iso->mult;
+
+  uint32_t uframe = iso->uframe_phase;
+  for(uint8_t i=0; i<count; i++)
+  {
+    uint32_t const addr = (uint32_t) (iso->buffer + (packet+i)*iso->packet_size);
+
+    itd->xact[uframe].offset          = addr & 0xFFFu;
+    itd->xact[uframe].page_select     = (addr - base) >> 12;
+    itd->xact[uframe].length          = iso_packet_len(iso, packet+i);
+    itd->xact[uframe].int_on_complete = (last && i == count-1) ? 1 : 0;
+    itd->xact[uframe].active          = 1;
+
+    uframe += iso->interval;
+  }
+}
+
+static void sitd_init(ehci_iso_t const* iso, ehci_sitd_t* sitd, uint32_t packet, bool last)
+{
+  uint32_t const addr = (uint32_t) (iso->buffer + packet*iso->packet_size);
+  uint16_t const len  = iso_packet_len(iso, packet);
+
+  tu_memclr(sitd, sizeof(ehci_sitd_t));
+
+  sitd->dev_addr    = iso->dev_addr;
+  sitd->ep_number   = tu_edpt_number(iso->ep_addr);
+  sitd->hub_addr    = iso->hub_addr;
+  sitd->port_number = iso->hub_port;
+  sitd->direction   = tu_edpt_dir(iso->ep_addr);
+
+  sitd->buffer[0] = addr;
+  sitd->buffer[1] = tu_align4k(addr) + 4096u;
+
+  if ( sitd->direction )
+  {
+    // EHCI 4.12.3: one start split, then complete splits from the 2nd microframe after it until end of frame
+    sitd->int_smask    = TU_BIT(0);
+    sitd->fl_int_cmask = TU_BIN8(11111100);
+  }else
+  {
+    // one start split per 188 bytes in consecutive microframes, no complete split.
+    // Transaction position: All (single split) or Begin, T-Count: number of start splits
+    uint8_t const split_count = (uint8_t) tu_max32(1, tu_div_ceil(len, SPLIT_MAX_BYTES));
+
+    sitd->int_smask    = (uint8_t) (TU_BIT(split_count) - 1);
+    sitd->fl_int_cmask = 0;
+    sitd->buffer[1]   |= ((split_count > 1 ? 1u : 0u) << 3) | split_count;
+  }
+
+  sitd->total_bytes     = len;
+  sitd->int_on_complete = last ? 1 : 0;
+  sitd->back.terminate  = 1;
+  sitd->active          = 1;
+  sitd->used            = 1;
+}
+
+//--------------------------------------------------------------------+
+// Periodic Bandwidth
+// Bytes are accounted per microframe (high speed) or per transaction translator frame (full/low speed).
+// Endpoint is serviced every step frames from frame_phase, in microframes of uframe_mask within these frames.
+//--------------------------------------------------------------------+
+
+// Microframes serviced in a frame by high speed endpoint of interval (microframes)
+static uint8_t period_uframe_mask(uint16_t interval, uint8_t uframe_phase)
+{
+  uint8_t mask = 0;
+  for(uint32_t u = uframe_phase; u < 8; u += interval)
+  {
+    mask |= TU_BIT(u);
+  }
+  return mask;
+}
+
+// Most loaded slot serviced by endpoint with this phase.
+// Full speed only accounts for transaction translator frame, start/complete splits are not counted.
+static uint16_t period_bw_load(bool highspeed, uint16_t step, uint8_t frame_phase, uint8_t uframe_mask)
+{
+  uint16_t load = 0;
+
+  for(uint32_t f = frame_phase; f < FRAMELIST_SIZE; f += step)
+  {
+    if ( highspeed )
+    {
+      for(uint8_t u=0; u<8; u++)
+      {
+        if ( uframe_mask & TU_BIT(u) ) load = tu_max16(load, ehci_data.uframe_bw[f][u]);
+      }
+    }else
+    {
+      load = tu_max16(load, ehci_data.fs_bw[f]);
+    }
+  }
+
+  return load;
+}
+
+static void period_bw_update(bool highspeed, uint16_t step, uint8_t frame_phase, uint8_t uframe_mask,
+                             uint16_t bytes, bool reserve)
+{
+  for(uint32_t f = frame_phase; f < FRAMELIST_SIZE; f += step)
+  {
+    if ( highspeed )
+    {
+      for(uint8_t u=0; u<8; u++)
+      {
+        if ( uframe_mask & TU_BIT(u) )
+        {
+          ehci_data.uframe_bw[f][u] = (uint16_t) (reserve ? ehci_data.uframe_bw[f][u] + bytes : ehci_data.uframe_bw[f][u] - bytes);
+        }
+      }
+    }else
+    {
+      ehci_data.fs_bw[f] = (uint16_t) (reserve ? ehci_data.fs_bw[f] + bytes : ehci_data.fs_bw[f] - bytes);
+    }
+  }
+}
+
+// Choose the phase whose slots are least loaded, and reserve bandwidth there.
+// interval (microframes) is only used by high speed to spread within a frame, step is in frames.
+static bool period_bw_reserve(bool highspeed, uint16_t interval, uint16_t step, uint16_t bytes,
+                              uint8_t* frame_phase, uint8_t* uframe_phase)
+{
+  uint16_t const budget       = highspeed ? HS_PERIODIC_BYTES : FS_PERIODIC_BYTES;
+  uint8_t  const uframe_count = highspeed ? (uint8_t) tu_min16(interval, 8) : 1;
+
+  uint16_t best_load   = UINT16_MAX;
+  uint8_t  best_frame  = 0;
+  uint8_t  best_uframe = 0;
+
+  for(uint8_t f=0; f<step; f++)
+  {
+    for(uint8_t u=0; u<uframe_count; u++)
+    {
+      uint16_t const load = period_bw_load(highspeed, step, f, period_uframe_mask(interval, u));
+      if ( load < best_load )
+      {
+        best_load   = load;
+        best_frame  = f;
+        best_uframe = u;
+      }
+    }
+  }
+
+  TU_VERIFY(best_load + bytes <= budget);
+
+  *frame_phase  = best_frame;
+  *uframe_phase = best_uframe;
+  period_bw_update(highspeed, step, best_frame, period_uframe_mask(interval, best_uframe), bytes, true);
+
+  return true;
+}
+
+// Bandwidth of one interrupt transaction, low speed bit time is 8 times of full speed
+static uint16_t qhd_int_bw_bytes(ehci_qhd_t const* p_qhd)
+{
+  switch ( p_qhd->ep_speed )
+  {
+    case TUSB_SPEED_HIGH: return (uint16_t) (p_qhd->max_packet_size + HS_INT_OVERHEAD);
+    case TUSB_SPEED_LOW : return (uint16_t) ((p_qhd->max_packet_size + FS_INT_OVERHEAD) * 8);
+    default             : return (uint16_t) (p_qhd->max_packet_size + FS_INT_OVERHEAD);
+  }
+}
+
+static void qhd_int_bw_update(ehci_qhd_t const* p_qhd, bool reserve)
+{
+  period_bw_update(p_qhd->ep_speed == TUSB_SPEED_HIGH, p_qhd->interval_ms, p_qhd->frame_phase, p_qhd->int_smask,
+                   qhd_int_bw_bytes(p_qhd), reserve);
+}
+
+// Bandwidth of one service, for microframe (high speed) or frame (full speed) budget
+static inline uint16_t iso_bw_bytes(ehci_iso_t const* iso)
+{
+  return (uint16_t) (iso->packet_size + (iso->highspeed ? HS_ISO_OVERHEAD : FS_ISO_OVERHEAD));
+}
+
+static void iso_bw_update(ehci_iso_t const* iso, bool reserve)
+{
+  period_bw_update(iso->highspeed, iso->step, iso->frame_phase, period_uframe_mask(iso->interval, iso->uframe_phase),
+                   iso_bw_bytes(iso), reserve);
+}
+
+static ehci_iso_t* iso_get_from_addr(uint8_t dev_addr, uint8_t ep_addr)
+{
+  uint8_t const* ep_idx = ep_index_get(dev_addr, ep_addr);
+  if ( ep_idx == NULL || *ep_idx <= HCD_MAX_ENDPOINT ) return NULL;
+
+  return &ehci_data.iso[*ep_idx - HCD_MAX_ENDPOINT - 1];
+}
+
+static bool iso_open(uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
+{
+  hcd_devtree_info_t devtree_info;
+  hcd_devtree_get_info(dev_addr, &devtree_info);
+
+  // low speed does not support isochronous
+  TU_ASSERT(devtree_info.speed != TUSB_SPEED_LOW);
+  TU_ASSERT(1 <= ep_desc->bInterval && ep_desc->bInterval <= 16);
+
+  uint8_t* ep_idx = ep_index_get(dev_addr, ep_desc->bEndpointAddress);
+  TU_ASSERT(ep_idx);
+
+  ehci_iso_t* iso = NULL;
+  uint8_t iso_idx;
+  for(iso_idx=0; iso_idx<EHCI_MAX_ISO; iso_idx++)
+  {
+    if ( !ehci_data.iso[iso_idx].used )
+    {
+      iso = &ehci_data.iso[iso_idx];
+      break;
+    }
+  }
+  TU_ASSERT(iso);
+
+  tu_memclr(iso, sizeof(ehci_iso_t));
+
+  iso->highspeed       = (devtree_info.speed == TUSB_SPEED_HIGH) ? 1 : 0;
+  iso->dev_addr        = dev_addr;
+  iso->ep_addr         = ep_desc->bEndpointAddress;
+  iso->hub_addr        = devtree_info.hub_addr;
+  iso->hub_port        = devtree_info.hub_port;
+  iso->max_packet_size = tu_edpt_packet_size(ep_desc);
+
+  // high bandwidth: up to 3 transactions per microframe
+  iso->mult            = iso->highspeed ? (uint8_t) (1 + ((tu_le16toh(ep_desc->wMaxPacketSize) >> 11) & 0x03)) : 1;
+  iso->packet_size     = (uint16_t) (iso->max_packet_size * iso->mult);
+
+  iso->interval        = (uint16_t) (1u << (ep_desc->bInterval - 1));
+  iso->step            = iso->highspeed ? tu_max16(1, iso->interval >> 3) : iso->interval;
+
+  // a transfer must start after slack and end before the current frame list slot is visited again
+  TU_ASSERT(iso->step <= FRAMELIST_SIZE/2);
+  TU_ASSERT(iso->mult <= 3);
+
+  TU_ASSERT(period_bw_reserve(iso->highspeed, iso->interval, iso->step, iso_bw_bytes(iso),
+                              &iso->frame_phase, &iso->uframe_phase));
+  iso->used = 1;
+
+  *ep_idx = (uint8_t) (1 + HCD_MAX_ENDPOINT + iso_idx);
+
+  return true;
+}
+
+static void iso_close(uint8_t dev_addr)
+{
+  for(uint8_t i=0; i<EHCI_MAX_ISO; i++)
+  {
+    ehci_iso_t* iso = &ehci_data.iso[i];
+
+    if ( iso->used && iso->dev_addr == dev_addr )
+    {
+      iso_td_release(iso);
+      iso_bw_update(iso, false);
+      iso->used = 0;
+    }
+  }
+}
+
+// Packets are placed at a multiple of packet size in buffer, one (siTD) or up to 8 (iTD) per TD.
+// The transfer continues the stream right after the previous one if it is queued in time.
+static bool iso_xfer(uint8_t rhport, ehci_iso_t* iso, uint8_t * buffer, uint32_t buflen)
+{
+  TU_ASSERT(iso->td_count == 0);
+
+  iso->buffer = buffer;
+  iso->buflen = buflen;
+
+  uint8_t  const per_td   = iso_packet_per_td(iso);
+  uint32_t const pkt_count = iso_packet_count(iso);
+  uint32_t const td_count = tu_div_ceil(pkt_count, per_td);
+
+  uint32_t const now = hcd_frame_number(rhport);
+  uint32_t start = iso->frame_next;
+
+  if ( (int32_t) (start - now) < 1 )
+  {
+    // first transfer or stream is interrupted: restart at reserved phase after some slack
+    start  = now + ISO_SCHEDULE_SLACK;
+    start += (iso->step + iso->frame_phase - (start % iso->step)) % iso->step;
+  }
+
+  // TDs can only be linked to frames ahead of current one within the frame list
+  TU_ASSERT(start + (td_count-1)*iso->step - now < FRAMELIST_SIZE);
+  TU_ASSERT(iso_td_alloc(iso, (uint8_t) td_count));
+
+  iso->frame_start = start;
+  iso->frame_next  = start + td_count*iso->step;
+
+  for(uint8_t i=0; i<td_count; i++)
+  {
+    uint32_t const packet = i*per_td;
+    bool const last = (i == td_count-1);
+    ehci_link_t* td = iso_td(iso, i);
+
+    if ( iso->highspeed )
+    {
+      itd_init(iso, (ehci_itd_t*) td, packet, (uint8_t) tu_min32(per_td, pkt_count - packet), last);
+    }else
+    {
+      sitd_init(iso, (ehci_sitd_t*) td, packet, last);
+    }
+
+    list_insert(&ehci_data.period_framelist[iso_td_frame(iso, i) % FRAMELIST_SIZE], td,
+                iso->highspeed ? EHCI_QTYPE_ITD : EHCI_QTYPE_SITD);
+  }
+
+  // visible to isr only when all TDs are linked
+  iso->td_count = (uint8_t) td_count;
+
+  return true;
+}
+
+// Collect status of each packet, failed or missed packets carry no data. Received data is moved
+// toward the buffer start so that it is contiguous. Return number of bytes transferred.
+static uint32_t iso_xfer_collect(ehci_iso_t* iso, xfer_result_t* result)
+{
+  bool     const is_in     = (tu_edpt_dir(iso->ep_addr) == TUSB_DIR_IN);
+  uint8_t  const per_td    = iso_packet_per_td(iso);
+  uint32_t const pkt_count = iso_packet_count(iso);
+  uint32_t xferred = 0;
+
+  *result = XFER_RESULT_SUCCESS;
+
+  for(uint32_t packet=0; packet < pkt_count; packet++)
+  {
+    uint8_t const td_i = (uint8_t) (packet / per_td);
+    bool failed;
+    uint16_t len;
+
+    if ( iso->highspeed )
+    {
+      ehci_itd_t const* itd = (ehci_itd_t const*) iso_td(iso, td_i);
+      uint32_t const uframe = iso->uframe_phase + (packet % per_td)*iso->interval;
+
+      failed = itd->xact[uframe].active || itd->xact[uframe].error || itd->xact[uframe].babble_err ||
+               itd->xact[uframe].buffer_err;
+      len    = is_in ? (uint16_t) itd->xact[uframe].length : iso_packet_len(iso, packet);
+    }else
+    {
+      ehci_sitd_t const* sitd = (ehci_sitd_t const*) iso_td(iso, td_i);
+      uint16_t const expected = iso_packet_len(iso, packet);
+
+      failed = sitd->active || sitd->error || sitd->xact_err || sitd->babble_err || sitd->buffer_err ||
+               sitd->missed_uframe;
+      len    = is_in ? (uint16_t) (expected - sitd->total_bytes) : expected;
+    }
+
+    if ( failed )
+    {
+      *result = XFER_RESULT_FAILED;
+      continue;
+    }
+
+    uint8_t* const data = iso->buffer + packet*iso->packet_size;
+    if ( is_in && len && data != iso->buffer + xferred ) memmove(iso->buffer + xferred, data, len);
+
+    xferred += len;
+  }
+
+  return xferred;
+}
+
+static void iso_xfer_complete_isr(uint8_t rhport)
+{
+  uint32_t const now = hcd_frame_number(rhport);
+
+  for(uint8_t i=0; i<EHCI_MAX_ISO; i++)
+  {
+    ehci_iso_t* iso = &ehci_data.iso[i];
+    if ( !iso->used || !iso->td_count ) continue;
+
+    // wait for the last TD, unless its frame is already over
+    uint8_t const last = (uint8_t) (iso->td_count - 1);
+    if ( iso_td_active(iso, last) && (int32_t) (now - iso_td_frame(iso, last)) <= 0 ) continue;
+
+    xfer_result_t result;
+    uint32_t const xferred = iso_xfer_collect(iso, &result);
+    iso_td_release(iso);
+
+    hcd_event_xfer_complete(iso->dev_addr, iso->ep_addr, xferred, result, true);
+  }
+}
+
 //------------- List Managing Helper -------------//
 static inline void list_insert(ehci_link_t *current, ehci_link_t *new, uint8_t new_type)
 {
@@ -49,8 +49,9 @@
 
 // TODO merge OHCI with EHCI
 enum {
-  EHCI_MAX_ITD  = 4,
-  EHCI_MAX_SITD = 16
+  EHCI_MAX_ISO  = 4,  // isochronous endpoints
+  EHCI_MAX_ITD  = 16, // shared by all high speed isochronous endpoints
+  EHCI_MAX_SITD = 16  // shared by all split full speed isochronous endpoints
 };
 
 //--------------------------------------------------------------------+
@@ -88,16 +89,8 @@ typedef struct
 	// Word 0: Next QTD Pointer
 	ehci_link_t next;
 
-	// Word 1: Alternate Next QTD Pointer (not used)
-	union{
-	  ehci_link_t alternate;
-	  struct {
-	    uint32_t                : 5;
-	    uint32_t used           : 1;
-	    uint32_t                : 10;
-	    uint32_t expected_bytes : 16;
-	  };
-	};
+	// Word 1: Alternate Next QTD Pointer, used by IN transfer spanning multiple qTDs to stop on short packet
+	ehci_link_t alternate;
 
 	// Word 2: qTQ Token
 	volatile uint32_t ping_err             : 1  ; ///< For Highspeed: 0 Out, 1 Ping. Full/Slow used as error indicator
@@ -157,19 +150,21 @@ typedef struct TU_ATTR_ALIGNED(32)
   /// Due to the fact QHD is 32 bytes aligned but occupies only 48 bytes
 	/// thus there are 16 bytes padding free that we can make use of.
   //--------------------------------------------------------------------+
-	uint8_t used;
-	uint8_t removing; // removed from asyn list, waiting for async advance
+	uint8_t used        : 1;
+	uint8_t removing    : 1; // removed from asyn list, waiting for async advance
+	uint8_t             : 6;
 	uint8_t pid;
-	uint8_t interval_ms; // polling interval in frames (or milisecond)
+	uint8_t interval_ms; // polling interval in frames (or milisecond), 1 for sub-millisecond
+	uint8_t frame_phase; // frame (modulo interval_ms) of periodic schedule
 
-	uint16_t total_xferred_bytes; // number of bytes xferred until a qtd with ioc bit set
-	uint8_t reserved2[2];
+	uint32_t total_bytes; // number of bytes of current transfer, which can span multiple qTDs
 
 	ehci_qtd_t * volatile p_qtd_list_head;	// head of the scheduled TD list
 	ehci_qtd_t * volatile p_qtd_list_tail;	// tail of the scheduled TD list
 } ehci_qhd_t;
 
-TU_VERIFY_STATIC( sizeof(ehci_qhd_t) == 64, "size is not correct" );
+// software area only fits in the padding with 32-bit pointers, it is larger when built for a 64-bit host model
+TU_VERIFY_STATIC( sizeof(ehci_qhd_t) == 64 || sizeof(void*) > 4, "size is not correct" );
 
 /// Highspeed Isochronous Transfer Descriptor (section 3.3)
 typedef struct TU_ATTR_ALIGNED(32) {
@@ -192,6 +187,8 @@ typedef struct TU_ATTR_ALIGNED(32) {
 	} xact[8];
 
 	// Word 9-15  Buffer Page Pointer List (Plus)
+	// Lower 12 bits of page 0: device address [6:0], endpoint [11:8]
+	// page 1: max packet size [10:0], direction [11] (1 = IN), page 2: mult [1:0]
 	uint32_t BufferPointer[7];
 
 //	// FIXME: Store meta data into buffer pointer reserved for saving memory
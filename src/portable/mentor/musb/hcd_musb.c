@@ -100,8 +100,8 @@ typedef union {
 typedef struct TU_ATTR_PACKED
 {
   void      *buf;      /* the start address of a transfer data buffer */
-  uint16_t  length;    /* the number of bytes in the buffer */
-  uint16_t  remaining; /* the number of bytes remaining in the buffer */
+  uint32_t  length;    /* the number of bytes in the buffer */
+  uint32_t  remaining; /* the number of bytes remaining in the buffer */
 } pipe_state_t;
 
 typedef struct TU_ATTR_PACKED
@@ -321,7 +321,7 @@ static bool edpt0_xfer_in(void)
   return false;
 }
 
-static bool edpt0_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *buffer, uint16_t buflen)
+static bool edpt0_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *buffer, uint32_t buflen)
 {
   (void)rhport;
 
@@ -395,7 +395,7 @@ static bool pipe_xfer_in(uint_fast8_t pipenum)
   return false;
 }
 
-static bool edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *buffer, uint16_t buflen)
+static bool edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *buffer, uint32_t buflen)
 {
   (void)rhport;
   unsigned const pipenum = find_pipe(dev_addr, ep_addr);
@@ -805,7 +805,7 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
   return true;
 }
 
-bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *buffer, uint16_t buflen)
+bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *buffer, uint32_t buflen)
 {
   (void)rhport;
   bool ret = false;
@@ -180,6 +180,20 @@ void dcd_connect(uint8_t rhport)
    USB->DEVICE.CTRLB.reg &= ~USB_DEVICE_CTRLB_DETACH;
 }
 
+void dcd_sof_enable(uint8_t rhport, bool en)
+{
+  (void) rhport;
+
+  if ( en )
+  {
+    USB->DEVICE.INTFLAG.reg  = USB_DEVICE_INTFLAG_SOF;
+    USB->DEVICE.INTENSET.reg = USB_DEVICE_INTENSET_SOF;
+  }else
+  {
+    USB->DEVICE.INTENCLR.reg = USB_DEVICE_INTENCLR_SOF;
+  }
+}
+
 /*------------------------------------------------------------------*/
 /* DCD Endpoint port
  *------------------------------------------------------------------*/
@@ -359,7 +373,7 @@ void dcd_int_handler (uint8_t rhport)
   if ( int_status & USB_DEVICE_INTFLAG_SOF )
   {
     USB->DEVICE.INTFLAG.reg = USB_DEVICE_INTFLAG_SOF;
-    dcd_event_bus_signal(0, DCD_EVENT_SOF, true);
+    dcd_event_sof(0, USB->DEVICE.FNUM.bit.FNUM, false, true);
   }
 
   // SAMD doesn't distinguish between Suspend and Disconnect state.
@@ -36,7 +36,6 @@
 
 // TODO remove later
 #include "device/usbd.h"
-#include "device/usbd_pvt.h" // to use defer function helper
 
 /*------------------------------------------------------------------*/
 /* MACRO TYPEDEF CONSTANT ENUM
@@ -57,6 +56,20 @@ enum
   EP_CBI_COUNT = 8  // Control Bulk Interrupt endpoints count
 };
 
+// EasyDMA request waiting for the one running, lower is started first: ISO, control then
+// IN and OUT of endpoint 1 to 7. Each endpoint has at most one request at a time
+enum
+{
+  DMA_REQ_ISOOUT = 0,
+  DMA_REQ_ISOIN,
+  DMA_REQ_EP0STATUS,
+  DMA_REQ_EP0RCVOUT,
+  DMA_REQ_EPIN0,      // EPIN n is DMA_REQ_EPIN0 + 2n, EPOUT n is next to it
+  DMA_REQ_COUNT = DMA_REQ_EPIN0 + 2*EP_CBI_COUNT
+};
+
+TU_VERIFY_STATIC(DMA_REQ_COUNT <= 32, "DMA requests do not fit in bitmap");
+
 // Transfer Descriptor
 typedef struct
 {
@@ -84,6 +97,12 @@ static struct
 
   // nRF can only carry one DMA at a time, this is used to guard the access to EasyDMA
   volatile bool dma_running;
+
+  // Requests waiting for EasyDMA (bit per DMA_REQ), started when running one is complete
+  volatile uint32_t dma_pending;
+
+  // SOF interrupt is requested by stack, keep it enabled
+  bool sof_enabled;
 }_dcd;
 
 /*------------------------------------------------------------------*/
@@ -128,52 +147,88 @@ static void start_dma(volatile uint32_t* reg_startep)
   }
 }
 
-// only 1 EasyDMA can be active at any time
+// DMA request of a start task register
+static uint8_t dma_req_id(volatile uint32_t* reg_startep)
+{
+  if ( reg_startep == &NRF_USBD->TASKS_STARTISOOUT ) return DMA_REQ_ISOOUT;
+  if ( reg_startep == &NRF_USBD->TASKS_STARTISOIN  ) return DMA_REQ_ISOIN;
+  if ( reg_startep == &NRF_USBD->TASKS_EP0STATUS   ) return DMA_REQ_EP0STATUS;
+  if ( reg_startep == &NRF_USBD->TASKS_EP0RCVOUT   ) return DMA_REQ_EP0RCVOUT;
+
+  if ( reg_startep < &NRF_USBD->TASKS_STARTEPOUT[0] )
+  {
+    return (uint8_t) (DMA_REQ_EPIN0 + 2*(reg_startep - &NRF_USBD->TASKS_STARTEPIN[0]));
+  }
+
+  return (uint8_t) (DMA_REQ_EPIN0 + 2*(reg_startep - &NRF_USBD->TASKS_STARTEPOUT[0]) + 1);
+}
+
+static volatile uint32_t* dma_req_task(uint8_t id)
+{
+  switch ( id )
+  {
+    case DMA_REQ_ISOOUT   : return &NRF_USBD->TASKS_STARTISOOUT;
+    case DMA_REQ_ISOIN    : return &NRF_USBD->TASKS_STARTISOIN;
+    case DMA_REQ_EP0STATUS: return &NRF_USBD->TASKS_EP0STATUS;
+    case DMA_REQ_EP0RCVOUT: return &NRF_USBD->TASKS_EP0RCVOUT;
+
+    default:
+    {
+      uint8_t const epnum = (id - DMA_REQ_EPIN0) / 2;
+      return ((id - DMA_REQ_EPIN0) & 1) ? &NRF_USBD->TASKS_STARTEPOUT[epnum] : &NRF_USBD->TASKS_STARTEPIN[epnum];
+    }
+  }
+}
+
+// only 1 EasyDMA can be active at any time: request is started right away if it is available,
+// otherwise it is queued and started by the ISR once running one is complete.
 // TODO use Cortex M4 LDREX and STREX command (atomic) to have better mutex access to EasyDMA
 // since current implementation does not 100% guarded against race condition
 static void edpt_dma_start(volatile uint32_t* reg_startep)
 {
+  uint8_t const rhport = 0;
+
   // Called in critical section i.e within USB ISR, or USB/Global interrupt disabled
-  if ( is_in_isr() || __get_PRIMASK() || !NVIC_GetEnableIRQ(USBD_IRQn) )
+  bool const in_critical = is_in_isr() || __get_PRIMASK() || !NVIC_GetEnableIRQ(USBD_IRQn);
+
+  // LDREX/STREX may be needed in form of std atomic (required C11) or
+  // use osal mutex to guard against multiple core MCUs such as nRF53
+  if ( !in_critical ) dcd_int_disable(rhport);
+
+  if ( _dcd.dma_running )
   {
-    if (_dcd.dma_running)
-    {
-      //use usbd task to defer later
-      usbd_defer_func((osal_task_func_t) edpt_dma_start, (void*) (uintptr_t) reg_startep, true);
-    }else
-    {
-      start_dma(reg_startep);
-    }
+    _dcd.dma_pending |= TU_BIT(dma_req_id(reg_startep));
   }else
   {
-    // Called in non-critical thread-mode, should be 99% of the time.
-    // Should be safe to blocking wait until previous DMA transfer complete
-    uint8_t const rhport = 0;
-    bool started = false;
-    while(!started)
-    {
-      // LDREX/STREX may be needed in form of std atomic (required C11) or
-      // use osal mutex to guard against multiple core MCUs such as nRF53
-      dcd_int_disable(rhport);
-
-      if ( !_dcd.dma_running )
-      {
-        start_dma(reg_startep);
-        started = true;
-      }
-
-      dcd_int_enable(rhport);
-
-      // osal_yield();
-    }
+    start_dma(reg_startep);
   }
+
+  if ( !in_critical ) dcd_int_enable(rhport);
 }
 
-// DMA is complete
+// DMA is complete, start queued requests: EP0STATUS and EP0RCVOUT don't keep EasyDMA running
 static void edpt_dma_end(void)
 {
   TU_ASSERT(_dcd.dma_running, );
   _dcd.dma_running = false;
+
+  while ( !_dcd.dma_running && _dcd.dma_pending )
+  {
+    uint8_t const id = (uint8_t) __builtin_ctz(_dcd.dma_pending);
+    _dcd.dma_pending &= ~TU_BIT(id);
+    start_dma(dma_req_task(id));
+  }
+}
+
+// Drop queued request of closed endpoint
+static void edpt_dma_cancel(uint32_t req_mask)
+{
+  uint8_t const rhport = 0;
+  bool const in_critical = is_in_isr() || __get_PRIMASK() || !NVIC_GetEnableIRQ(USBD_IRQn);
+
+  if ( !in_critical ) dcd_int_disable(rhport);
+  _dcd.dma_pending &= ~req_mask;
+  if ( !in_critical ) dcd_int_enable(rhport);
 }
 
 // helper getting td
@@ -297,6 +352,25 @@ void dcd_connect(uint8_t rhport)
   NRF_USBD->USBPULLUP = 1;
 }
 
+void dcd_sof_enable(uint8_t rhport, bool en)
+{
+  (void) rhport;
+
+  _dcd.sof_enabled = en;
+
+  if ( en )
+  {
+    // Clear SOF event in case interrupt was not enabled yet.
+    if ((NRF_USBD->INTEN & USBD_INTEN_SOF_Msk) == 0) NRF_USBD->EVENTS_SOF = 0;
+    NRF_USBD->INTENSET = USBD_INTENSET_SOF_Msk;
+  }
+  else if ( _dcd.xfer[EP_ISO_NUM][TUSB_DIR_IN].mps + _dcd.xfer[EP_ISO_NUM][TUSB_DIR_OUT].mps == 0 )
+  {
+    // ISO endpoints still need SOF
+    NRF_USBD->INTENCLR = USBD_INTENCLR_SOF_Msk;
+  }
+}
+
 //--------------------------------------------------------------------+
 // Endpoint API
 //--------------------------------------------------------------------+
@@ -393,6 +467,9 @@ void dcd_edpt_close_all (uint8_t rhport)
 
   tu_memclr(_dcd.xfer[EP_ISO_NUM], 2*sizeof(xfer_td_t));
 
+  // drop queued DMA of all non-control
+  edpt_dma_cancel((uint32_t) ~(TU_BIT(DMA_REQ_EP0STATUS) | TU_BIT(DMA_REQ_EP0RCVOUT) | TU_BIT(DMA_REQ_EPIN0) | TU_BIT(DMA_REQ_EPIN0+1)));
+
   // de-activate all non-control
   NRF_USBD->EPOUTEN = 1UL;
   NRF_USBD->EPINEN = 1UL;
@@ -420,6 +497,8 @@ void dcd_edpt_close (uint8_t rhport, uint8_t ep_addr)
       NRF_USBD->INTENCLR = TU_BIT(USBD_INTEN_ENDEPIN0_Pos + epnum);
       NRF_USBD->EPINEN &= ~TU_BIT(epnum);
     }
+
+    edpt_dma_cancel(TU_BIT(DMA_REQ_EPIN0 + 2*epnum + (dir == TUSB_DIR_OUT ? 1 : 0)));
   }
   else
   {
@@ -436,10 +515,12 @@ void dcd_edpt_close (uint8_t rhport, uint8_t ep_addr)
       NRF_USBD->INTENCLR = USBD_INTENCLR_ENDISOIN_Msk;
       NRF_USBD->EPINEN &= ~USBD_EPINEN_ISOIN_Msk;
     }
+    edpt_dma_cancel(TU_BIT(dir == TUSB_DIR_OUT ? DMA_REQ_ISOOUT : DMA_REQ_ISOIN));
+
     // One of the ISO endpoints closed, no need to split buffers any more.
     NRF_USBD->ISOSPLIT = USBD_ISOSPLIT_SPLIT_OneDir;
     // When both ISO endpoint are close there is no need for SOF any more.
-    if (_dcd.xfer[EP_ISO_NUM][TUSB_DIR_IN].mps + _dcd.xfer[EP_ISO_NUM][TUSB_DIR_OUT].mps == 0) NRF_USBD->INTENCLR = USBD_INTENCLR_SOF_Msk;
+    if (_dcd.xfer[EP_ISO_NUM][TUSB_DIR_IN].mps + _dcd.xfer[EP_ISO_NUM][TUSB_DIR_OUT].mps == 0 && !_dcd.sof_enabled) NRF_USBD->INTENCLR = USBD_INTENCLR_SOF_Msk;
   }
   __ISB(); __DSB();
 }
@@ -610,17 +691,6 @@ void dcd_int_handler(uint8_t rhport)
     dcd_event_bus_reset(0, TUSB_SPEED_FULL, true);
   }
 
-  // ISOIN: Data was moved to endpoint buffer, client will be notified in SOF
-  if ( int_status & USBD_INTEN_ENDISOIN_Msk )
-  {
-    xfer_td_t* xfer = get_td(EP_ISO_NUM, TUSB_DIR_IN);
-
-    xfer->actual_len = NRF_USBD->ISOIN.AMOUNT;
-    // Data transferred from RAM to endpoint output buffer.
-    // Next transfer can be scheduled after SOF.
-    xfer->iso_in_transfer_ready = true;
-  }
-
   if ( int_status & USBD_INTEN_SOF_Msk )
   {
     bool iso_enabled = false;
@@ -645,14 +715,28 @@ void dcd_int_handler(uint8_t rhport)
       }
     }
 
-    if ( !iso_enabled )
+    if ( !iso_enabled && !_dcd.sof_enabled )
     {
       // ISO endpoint is not used, SOF is only enabled one-time for remote wakeup
       // so we disable it now
       NRF_USBD->INTENCLR = USBD_INTENSET_SOF_Msk;
     }
 
-    dcd_event_bus_signal(0, DCD_EVENT_SOF, true);
+    dcd_event_sof(0, NRF_USBD->FRAMECNTR, false, true);
+  }
+
+  // ISOIN: Data was moved to endpoint buffer, client will be notified in next SOF.
+  // Handled after SOF: when a late interrupt has both, DMA may have ended after that SOF and data is
+  // only sent in the frame started by the next one. Reporting it now would let the next packet
+  // overwrite it. At worst the next packet is one frame late and a zero length packet is sent instead.
+  if ( int_status & USBD_INTEN_ENDISOIN_Msk )
+  {
+    xfer_td_t* xfer = get_td(EP_ISO_NUM, TUSB_DIR_IN);
+
+    xfer->actual_len = NRF_USBD->ISOIN.AMOUNT;
+    // Data transferred from RAM to endpoint output buffer.
+    // Next transfer can be scheduled after SOF.
+    xfer->iso_in_transfer_ready = true;
   }
 
   if ( int_status & USBD_INTEN_USBEVENT_Msk )
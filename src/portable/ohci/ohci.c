@@ -122,6 +122,10 @@ enum {
   OHCI_INT_ON_COMPLETE_NO  = TU_BIN8(111)
 };
 
+// gTD buffer can span at most 2 pages, 4 KB can always be transferred regardless of buffer alignment.
+// Larger transfer is chained with multiple gTDs.
+#define GTD_MAX_BYTES   4096u
+
 enum {
   GTD_DT_TOGGLE_CARRY = 0,
   GTD_DT_DATA0 = TU_BIT(1) | 0,
@@ -138,6 +142,13 @@ enum {
   PID_FROM_TD = 0,
 };
 
+// Terminator of free lists, which are linked by pool index
+#define INDEX_LIST_END   0xFFFFu
+
+TU_VERIFY_STATIC( HCD_MAX_ENDPOINT < 256, "ep_index is 8-bit" );
+TU_VERIFY_STATIC( HCD_MAX_XFER < INDEX_LIST_END, "free list index is 16-bit" );
+TU_VERIFY_STATIC( CFG_TUH_DEVICE_MAX < 16, "control gTD index is 4-bit" );
+
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
@@ -153,6 +164,8 @@ static ohci_ed_t * const p_ed_head[] =
 
 static void ed_list_insert(ohci_ed_t * p_pre, ohci_ed_t * p_ed);
 static void ed_list_remove_by_addr(ohci_ed_t * p_head, uint8_t dev_addr);
+static void gtd_free(ohci_gtd_t * p_gtd);
+static uint16_t index_list_init(uint16_t* next, uint16_t count);
 
 //--------------------------------------------------------------------+
 // USBH-HCD API
@@ -173,6 +186,9 @@ bool hcd_init(uint8_t rhport)
   ohci_data.bulk_head_ed.skip   = 1;
   ohci_data.period_head_ed.skip = 1;
 
+  ohci_data.ed_free_head  = index_list_init(ohci_data.ed_free_next, HCD_MAX_ENDPOINT);
+  ohci_data.gtd_free_head = index_list_init(ohci_data.gtd_free_next, HCD_MAX_XFER);
+
   // reset controller
   OHCI_REG->command_status_bit.controller_reset = 1;
   while( OHCI_REG->command_status_bit.controller_reset ) {} // should not take longer than 10 us
@@ -241,6 +257,9 @@ void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
     ohci_data.control[0].ed.skip = 1;
   }else
   {
+    // gTD free list is also updated by done queue isr
+    hcd_int_disable(rhport);
+
     // remove control
     ed_list_remove_by_addr( p_ed_head[TUSB_XFER_CONTROL], dev_addr);
 
@@ -250,7 +269,11 @@ void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
     // remove interrupt
     ed_list_remove_by_addr(p_ed_head[TUSB_XFER_INTERRUPT], dev_addr);
 
+    hcd_int_enable(rhport);
+
     // TODO remove ISO
+
+    if ( dev_addr < TU_ARRAY_SIZE(ohci_data.ep_index) ) tu_memclr(ohci_data.ep_index[dev_addr], sizeof(ohci_data.ep_index[dev_addr]));
   }
 }
 
@@ -303,38 +326,64 @@ static void gtd_init(ohci_gtd_t* p_td, uint8_t* data_ptr, uint16_t total_bytes)
   p_td->delay_interrupt        = OHCI_INT_ON_COMPLETE_NO;
   p_td->condition_code         = OHCI_CCODE_NOT_ACCESSED;
 
-  p_td->current_buffer_pointer = data_ptr;
-  p_td->buffer_end             = total_bytes ? (data_ptr + total_bytes-1) : data_ptr;
+  p_td->current_buffer_pointer = (uint32_t) data_ptr;
+  p_td->buffer_end             = (uint32_t) (total_bytes ? (data_ptr + total_bytes-1) : data_ptr);
+}
+
+//------------- Free list -------------//
+
+// Link all entries of a pool in order, return list head
+static uint16_t index_list_init(uint16_t* next, uint16_t count)
+{
+  for(uint16_t i = 0; i < count; i++) next[i] = (i+1 < count) ? (uint16_t) (i+1) : INDEX_LIST_END;
+  return count ? 0 : INDEX_LIST_END;
+}
+
+static inline void index_list_push(uint16_t* head, uint16_t* next, uint16_t idx)
+{
+  next[idx] = *head;
+  *head     = idx;
+}
+
+static inline uint16_t index_list_pop(uint16_t* head, uint16_t const* next)
+{
+  uint16_t const idx = *head;
+  if ( idx != INDEX_LIST_END ) *head = next[idx];
+  return idx;
+}
+
+// Entry of ED lookup table, NULL if address is out of range
+static inline uint8_t* ep_index_get(uint8_t dev_addr, uint8_t ep_addr)
+{
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  if ( dev_addr >= TU_ARRAY_SIZE(ohci_data.ep_index) || epnum == 0 ) return NULL;
+
+  return &ohci_data.ep_index[dev_addr][2*(epnum-1) + tu_edpt_dir(ep_addr)];
 }
 
 static ohci_ed_t * ed_from_addr(uint8_t dev_addr, uint8_t ep_addr)
 {
   if ( tu_edpt_number(ep_addr) == 0 ) return &ohci_data.control[dev_addr].ed;
 
-  ohci_ed_t* ed_pool = ohci_data.ed_pool;
-
-  for(uint32_t i=0; i<HCD_MAX_ENDPOINT; i++)
-  {
-    if ( (ed_pool[i].dev_addr == dev_addr) &&
-          ep_addr == tu_edpt_addr(ed_pool[i].ep_number, ed_pool[i].pid == PID_IN) )
-    {
-      return &ed_pool[i];
-    }
-  }
+  uint8_t const* ep_idx = ep_index_get(dev_addr, ep_addr);
+  if ( ep_idx == NULL || *ep_idx == 0 ) return NULL;
 
-  return NULL;
+  return &ohci_data.ed_pool[*ep_idx - 1];
 }
 
 static ohci_ed_t * ed_find_free(void)
 {
-  ohci_ed_t* ed_pool = ohci_data.ed_pool;
+  uint16_t const idx = index_list_pop(&ohci_data.ed_free_head, ohci_data.ed_free_next);
+  return (idx == INDEX_LIST_END) ? NULL : &ohci_data.ed_pool[idx];
+}
 
-  for(uint8_t i = 0; i < HCD_MAX_ENDPOINT; i++)
-  {
-    if ( !ed_pool[i].used ) return &ed_pool[i];
-  }
+// control EDs are not allocated from pool
+static void ed_free(ohci_ed_t * p_ed)
+{
+  p_ed->used = 0;
 
-  return NULL;
+  uint32_t const idx = (uint32_t) (p_ed - ohci_data.ed_pool);
+  if ( idx < HCD_MAX_ENDPOINT ) index_list_push(&ohci_data.ed_free_head, ohci_data.ed_free_next, (uint16_t) idx);
 }
 
 static void ed_list_insert(ohci_ed_t * p_pre, ohci_ed_t * p_ed)
@@ -358,22 +407,33 @@ static void ed_list_remove_by_addr(ohci_ed_t * p_head, uint8_t dev_addr)
 
       // point the removed ED's next pointer to list head to make sure HC can always safely move away from this ED
       ed->next = (uint32_t) p_head;
-      ed->used = 0;
-    }
 
-    // check next valid since we could remove it
-    if (p_prev->next) p_prev = (ohci_ed_t*) p_prev->next;
+      // release TDs still queued e.g. pending interrupt transfer
+      for ( ohci_gtd_t* p = (ohci_gtd_t*) tu_align16(ed->td_head.address); p != NULL; p = (ohci_gtd_t*) p->next ) gtd_free(p);
+      ed->td_head.address = 0;
+
+      ed_free(ed);
+    }else
+    {
+      // ED following a removed one is checked in next round
+      p_prev = ed;
+    }
   }
 }
 
 static ohci_gtd_t * gtd_find_free(void)
 {
-  for(uint8_t i=0; i < HCD_MAX_XFER; i++)
-  {
-    if ( !ohci_data.gtd_pool[i].used ) return &ohci_data.gtd_pool[i];
-  }
+  uint16_t const idx = index_list_pop(&ohci_data.gtd_free_head, ohci_data.gtd_free_next);
+  return (idx == INDEX_LIST_END) ? NULL : &ohci_data.gtd_pool[idx];
+}
 
-  return NULL;
+// control gTDs are not allocated from pool
+static void gtd_free(ohci_gtd_t * p_gtd)
+{
+  uint32_t const idx = (uint32_t) (p_gtd - ohci_data.gtd_pool);
+
+  if ( idx < HCD_MAX_XFER && p_gtd->used ) index_list_push(&ohci_data.gtd_free_head, ohci_data.gtd_free_next, (uint16_t) idx);
+  p_gtd->used = 0;
 }
 
 static void td_insert_to_ed(ohci_ed_t* p_ed, ohci_gtd_t * p_gtd)
@@ -384,11 +444,34 @@ static void td_insert_to_ed(ohci_ed_t* p_ed, ohci_gtd_t * p_gtd)
     p_ed->td_head.address |= (uint32_t) p_gtd;
   }
   else
-  { // TODO currently only support queue up to 2 TD each endpoint at a time
-    ((ohci_gtd_t*) tu_align16(p_ed->td_head.address))->next = (uint32_t) p_gtd;
+  { // append to the last TD of the queue
+    ohci_gtd_t* p_last = (ohci_gtd_t*) tu_align16(p_ed->td_head.address);
+    while ( p_last->next ) p_last = (ohci_gtd_t*) p_last->next;
+
+    p_last->next = (uint32_t) p_gtd;
   }
 }
 
+// Free the remaining TDs of a transfer that ended before its last TD (error or short packet).
+// ED must be halted, its head is moved to the TD following the transfer.
+static void td_remove_xfer_from_ed(ohci_ed_t* p_ed)
+{
+  ohci_gtd_t* p_gtd = (ohci_gtd_t*) tu_align16(p_ed->td_head.address);
+
+  while ( p_gtd )
+  {
+    bool const is_last = (p_gtd->delay_interrupt == OHCI_INT_ON_COMPLETE_YES);
+
+    gtd_free(p_gtd);
+    p_gtd = (ohci_gtd_t*) p_gtd->next;
+
+    if ( is_last ) break;
+  }
+
+  // keep halted & toggle bits
+  p_ed->td_head.address = (p_ed->td_head.address & 0x0Ful) | (uint32_t) p_gtd;
+}
+
 //--------------------------------------------------------------------+
 // Endpoint API
 //--------------------------------------------------------------------+
@@ -408,6 +491,7 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
     p_ed = &ohci_data.control[dev_addr].ed;
   }else
   {
+    TU_ASSERT(ep_index_get(dev_addr, ep_desc->bEndpointAddress));
     p_ed = ed_find_free();
   }
   TU_ASSERT(p_ed);
@@ -415,6 +499,11 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
   ed_init( p_ed, dev_addr, tu_edpt_packet_size(ep_desc), ep_desc->bEndpointAddress,
             ep_desc->bmAttributes.xfer, ep_desc->bInterval );
 
+  if ( ep_desc->bEndpointAddress != 0 )
+  {
+    *ep_index_get(dev_addr, ep_desc->bEndpointAddress) = (uint8_t) (1 + (p_ed - ohci_data.ed_pool));
+  }
+
   // control of dev0 is used as static async head
   if ( dev_addr == 0 )
   {
@@ -448,7 +537,7 @@ bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet
   return true;
 }
 
-bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen)
+bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint32_t buflen)
 {
   (void) rhport;
 
@@ -460,7 +549,10 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *
     ohci_ed_t*  ed  = &ohci_data.control[dev_addr].ed;
     ohci_gtd_t* gtd = &ohci_data.control[dev_addr].gtd;
 
-    gtd_init(gtd, buffer, buflen);
+    // control transfer has only one gTD
+    TU_ASSERT(buflen <= GTD_MAX_BYTES);
+
+    gtd_init(gtd, buffer, (uint16_t) buflen);
 
     gtd->index           = dev_addr;
     gtd->pid             = dir ? PID_IN : PID_OUT;
@@ -473,17 +565,61 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *
   }else
   {
     ohci_ed_t * ed = ed_from_addr(dev_addr, ep_addr);
-    ohci_gtd_t* gtd = gtd_find_free();
+    TU_ASSERT(ed);
 
-    TU_ASSERT(gtd);
+    uint8_t const ed_idx = (uint8_t) (ed-ohci_data.ed_pool);
 
-    gtd_init(gtd, buffer, buflen);
-    gtd->index = ed-ohci_data.ed_pool;
-    gtd->delay_interrupt = 0;
+    // Each gTD except the last one transfers a multiple of max packet size. Its buffer rounding is
+    // disabled so that a short packet halts the ED with DATA_UNDERRUN and ends the transfer.
+    uint32_t const gtd_max = GTD_MAX_BYTES - (GTD_MAX_BYTES % ed->max_packet_size);
+
+    ohci_gtd_t* head = NULL;
+    ohci_gtd_t* prev = NULL;
+    uint32_t offset = 0;
+
+    // gTD free list is also updated by done queue isr
+    hcd_int_disable(rhport);
+
+    do
+    {
+      ohci_gtd_t* gtd = gtd_find_free();
+
+      if ( gtd == NULL )
+      {
+        // not enough gTD, release ones allocated for this transfer
+        for ( ohci_gtd_t* p = head; p != NULL; p = (ohci_gtd_t*) p->next ) gtd_free(p);
+        hcd_int_enable(rhport);
+        TU_ASSERT(false);
+      }
 
-    td_insert_to_ed(ed, gtd);
+      uint16_t const len = (uint16_t) tu_min32(buflen - offset, gtd_max);
 
-    tusb_xfer_type_t xfer_type = ed_get_xfer_type( ed_from_addr(dev_addr, ep_addr) );
+      gtd_init(gtd, buffer + offset, len);
+      ohci_data.gtd_ed_index[gtd - ohci_data.gtd_pool] = ed_idx;
+      gtd->buffer_rounding = 0;
+
+      if ( prev )
+      {
+        prev->next = (uint32_t) gtd;
+      }else
+      {
+        head = gtd;
+      }
+
+      prev    = gtd;
+      offset += len;
+    } while ( offset < buflen );
+
+    hcd_int_enable(rhport);
+
+    prev->buffer_rounding = 1;
+    prev->delay_interrupt = OHCI_INT_ON_COMPLETE_YES;
+
+    ohci_data.xferred_bytes[ed_idx] = 0;
+
+    td_insert_to_ed(ed, head);
+
+    tusb_xfer_type_t xfer_type = ed_get_xfer_type(ed);
     if (TUSB_XFER_BULK == xfer_type) OHCI_REG->command_status_bit.bulk_list_filled = 1;
   }
 
@@ -539,7 +675,7 @@ static inline ohci_ed_t* gtd_get_ed(ohci_gtd_t const * const p_qtd)
     return &ohci_data.control[p_qtd->index].ed;
   }else
   {
-    return &ohci_data.ed_pool[p_qtd->index];
+    return &ohci_data.ed_pool[ohci_data.gtd_ed_index[p_qtd - ohci_data.gtd_pool]];
   }
 }
 
@@ -566,15 +702,36 @@ static void done_queue_isr(uint8_t hostid)
     // TODO check if td_head is iso td
     //------------- Non ISO transfer -------------//
     ohci_gtd_t * const qtd = (ohci_gtd_t *) td_head;
-    xfer_result_t const event = (qtd->condition_code == OHCI_CCODE_NO_ERROR) ? XFER_RESULT_SUCCESS :
+    bool const is_last = (qtd->delay_interrupt == OHCI_INT_ON_COMPLETE_YES);
+
+    // short packet on gTD in the middle of chained transfer: transfer is complete
+    bool const is_short = !is_last && (qtd->condition_code == OHCI_CCODE_DATA_UNDERRUN);
+
+    xfer_result_t const event = (qtd->condition_code == OHCI_CCODE_NO_ERROR || is_short) ? XFER_RESULT_SUCCESS :
                                 (qtd->condition_code == OHCI_CCODE_STALL) ? XFER_RESULT_STALLED : XFER_RESULT_FAILED;
 
-    qtd->used = 0; // free TD
-    if ( (qtd->delay_interrupt == OHCI_INT_ON_COMPLETE_YES) || (event != XFER_RESULT_SUCCESS) )
+    ohci_ed_t * const ed = gtd_get_ed(qtd);
+
+    uint32_t xferred_bytes = qtd->expected_bytes - gtd_xfer_byte_left(qtd->buffer_end, qtd->current_buffer_pointer);
+
+    if ( !gtd_is_control(qtd) )
     {
-      ohci_ed_t * const ed  = gtd_get_ed(qtd);
+      uint32_t* ed_xferred = &ohci_data.xferred_bytes[ed - ohci_data.ed_pool];
+      *ed_xferred  += xferred_bytes;
+      xferred_bytes = *ed_xferred;
+    }
+
+    gtd_free(qtd);
+    if ( is_last || (event != XFER_RESULT_SUCCESS) || is_short )
+    {
+      // ED is halted with remaining TDs of this transfer
+      if ( !is_last && !gtd_is_control(qtd) ) td_remove_xfer_from_ed(ed);
 
-      uint32_t const xferred_bytes = qtd->expected_bytes - gtd_xfer_byte_left((uint32_t) qtd->buffer_end, (uint32_t) qtd->current_buffer_pointer);
+      if ( is_short )
+      {
+        ed->td_head.halted = 0;
+        if ( TUSB_XFER_BULK == ed_get_xfer_type(ed) ) OHCI_REG->command_status_bit.bulk_list_filled = 1;
+      }
 
       // NOTE Assuming the current list is BULK and there is no other EDs in the list has queued TDs.
       // When there is a error resulting this ED is halted, and this EP still has other queued TD
@@ -65,7 +65,7 @@ typedef struct TU_ATTR_ALIGNED(16)
 {
 	// Word 0
 	uint32_t used                    : 1;
-	uint32_t index                   : 4;  // endpoint index the td belongs to, or device address in case of control xfer
+	uint32_t index                   : 4;  // device address in case of control xfer, see gtd_ed_index otherwise
   uint32_t expected_bytes          : 13; // TODO available for hcd
 
   uint32_t buffer_rounding         : 1;
@@ -76,13 +76,13 @@ typedef struct TU_ATTR_ALIGNED(16)
   volatile uint32_t condition_code : 4;
 
 	// Word 1
-	volatile uint8_t* current_buffer_pointer;
+	volatile uint32_t current_buffer_pointer;
 
 	// Word 2 : next TD
 	volatile uint32_t next;
 
 	// Word 3
-	uint8_t* buffer_end;
+	uint32_t buffer_end;
 } ohci_gtd_t;
 
 TU_VERIFY_STATIC( sizeof(ohci_gtd_t) == 16, "size is not correct" );
@@ -165,6 +165,22 @@ typedef struct TU_ATTR_ALIGNED(256)
   ohci_ed_t ed_pool[HCD_MAX_ENDPOINT];
   ohci_gtd_t gtd_pool[HCD_MAX_XFER];
 
+  // bytes transferred by completed gTDs of current (chained) transfer on each endpoint
+  uint32_t xferred_bytes[HCD_MAX_ENDPOINT];
+
+  // ED pool index each gTD of pool belongs to, too large for index field of gTD
+  uint8_t gtd_ed_index[HCD_MAX_XFER];
+
+  // Free lists of ED and gTD pool linked by index of next free entry. Controller may still
+  // reach a removed ED, links are kept in separated arrays instead of descriptor words.
+  uint16_t ed_free_head;
+  uint16_t gtd_free_head;
+  uint16_t ed_free_next[HCD_MAX_ENDPOINT];
+  uint16_t gtd_free_next[HCD_MAX_XFER];
+
+  // ED lookup by (dev_addr, ep_addr) for non-control endpoint: 1 + ED pool index, 0 if not opened
+  uint8_t ep_index[CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1][30];
+
   volatile uint16_t frame_number_hi;
 
 } ohci_data_t;
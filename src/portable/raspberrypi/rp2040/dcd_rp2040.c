@@ -49,8 +49,9 @@
 #define usb_hw_set hw_set_alias(usb_hw)
 #define usb_hw_clear hw_clear_alias(usb_hw)
 
-// Init these in dcd_init
-static uint8_t *next_buffer_ptr;
+// DPRAM for endpoint buffers in 64-byte blocks, bit set if used
+#define DPRAM_BLOCK_COUNT  (sizeof(usb_dpram->epx_data) / 64)
+static uint64_t _dpram_used;
 
 // USB_MAX_ENDPOINTS Endpoints, direction TUSB_DIR_OUT for out and TUSB_DIR_IN for in.
 static struct hw_endpoint hw_endpoints[USB_MAX_ENDPOINTS][2];
@@ -67,34 +68,59 @@ static struct hw_endpoint *hw_endpoint_get_by_addr(uint8_t ep_addr)
   return hw_endpoint_get_by_num(num, dir);
 }
 
-static void _hw_endpoint_alloc(struct hw_endpoint *ep, uint8_t transfer_type)
+// DPRAM blocks of endpoint buffers relative to buffer 0
+static uint64_t dpram_mask(struct hw_endpoint const *ep, bool double_buf)
 {
-  // size must be multiple of 64
-  uint size = tu_div_ceil(ep->wMaxPacketSize, 64) * 64u;
+  uint64_t const buf_mask = (1ull << tu_div_ceil(ep->wMaxPacketSize, 64)) - 1;
+  return double_buf ? (buf_mask | (buf_mask << (hw_endpoint_buf1_offset(ep) / 64))) : buf_mask;
+}
+
+// Bulk and isochronous endpoints are double buffered if there is space left
+static bool _hw_endpoint_alloc(struct hw_endpoint *ep, uint8_t transfer_type)
+{
+  bool double_buf = (transfer_type == TUSB_XFER_BULK || transfer_type == TUSB_XFER_ISOCHRONOUS);
 
-  // double buffered Bulk endpoint
-  if ( transfer_type == TUSB_XFER_BULK )
+  for(uint8_t attempt = 0; attempt < 2; attempt++, double_buf = false)
   {
-    size *= 2u;
-  }
+    uint64_t const mask = dpram_mask(ep, double_buf);
+    uint8_t  const span = (uint8_t) (64 - __builtin_clzll(mask));
 
-  ep->hw_data_buf = next_buffer_ptr;
-  next_buffer_ptr += size;
+    // first fit
+    for ( uint8_t block = 0; block + span <= DPRAM_BLOCK_COUNT; block++ )
+    {
+      if ( _dpram_used & (mask << block) ) continue;
 
-  assert(((uintptr_t )next_buffer_ptr & 0b111111u) == 0);
-  uint dpram_offset = hw_data_offset(ep->hw_data_buf);
-  hard_assert(hw_data_offset(next_buffer_ptr) <= USB_DPRAM_MAX);
+      _dpram_used |= mask << block;
+      ep->hw_data_buf = &usb_dpram->epx_data[64*block];
 
-  pico_info("  Alloced %d bytes at offset 0x%x (0x%p)\r\n", size, dpram_offset, ep->hw_data_buf);
+      uint dpram_offset = hw_data_offset(ep->hw_data_buf);
+      pico_info("  Alloced %s buffer at offset 0x%x (0x%p)\r\n", double_buf ? "double" : "single", dpram_offset, ep->hw_data_buf);
 
-  // Fill in endpoint control register with buffer offset
-  uint32_t const reg = EP_CTRL_ENABLE_BITS | ((uint)transfer_type << EP_CTRL_BUFFER_TYPE_LSB) | dpram_offset;
+      // Fill in endpoint control register with buffer offset, buffer status is raised per buffer
+      uint32_t reg = EP_CTRL_ENABLE_BITS | EP_CTRL_INTERRUPT_PER_BUFFER | ((uint)transfer_type << EP_CTRL_BUFFER_TYPE_LSB) | dpram_offset;
+      if ( double_buf ) reg |= EP_CTRL_DOUBLE_BUFFERED_BITS;
 
-  *ep->endpoint_control = reg;
+      *ep->endpoint_control = reg;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void _hw_endpoint_free(struct hw_endpoint *ep)
+{
+  uint8_t const block = (uint8_t) ((ep->hw_data_buf - usb_dpram->epx_data) / 64);
+  bool const double_buf = (*ep->endpoint_control) & EP_CTRL_DOUBLE_BUFFERED_BITS;
+
+  _dpram_used &= ~(dpram_mask(ep, double_buf) << block);
 }
 
 static void _hw_endpoint_close(struct hw_endpoint *ep)
 {
+    // Give back buffer space
+    if (ep->hw_data_buf) _hw_endpoint_free(ep);
+
     // Clear hardware registers and then zero the struct
     // Clears endpoint enable
     *ep->endpoint_control = 0;
@@ -102,21 +128,6 @@ static void _hw_endpoint_close(struct hw_endpoint *ep)
     *ep->buffer_control = 0;
     // Clear any endpoint state
     memset(ep, 0, sizeof(struct hw_endpoint));
-
-    // Reclaim buffer space if all endpoints are closed
-    bool reclaim_buffers = true;
-    for ( uint8_t i = 1; i < USB_MAX_ENDPOINTS; i++ )
-    {
-        if (hw_endpoint_get_by_num(i, TUSB_DIR_OUT)->hw_data_buf != NULL || hw_endpoint_get_by_num(i, TUSB_DIR_IN)->hw_data_buf != NULL)
-        {
-            reclaim_buffers = false;
-            break;
-        }
-    }
-    if (reclaim_buffers)
-    {
-        next_buffer_ptr = &usb_dpram->epx_data[0];
-    }
 }
 
 static void hw_endpoint_close(uint8_t ep_addr)
@@ -125,13 +136,16 @@ static void hw_endpoint_close(uint8_t ep_addr)
     _hw_endpoint_close(ep);
 }
 
-static void hw_endpoint_init(uint8_t ep_addr, uint16_t wMaxPacketSize, uint8_t transfer_type)
+static bool hw_endpoint_init(uint8_t ep_addr, uint16_t wMaxPacketSize, uint8_t transfer_type)
 {
   struct hw_endpoint *ep = hw_endpoint_get_by_addr(ep_addr);
 
   const uint8_t num = tu_edpt_number(ep_addr);
   const tusb_dir_t dir = tu_edpt_dir(ep_addr);
 
+  // Opened again without close e.g for alternate setting: give back its buffer first
+  if ( num && ep->hw_data_buf ) _hw_endpoint_close(ep);
+
   ep->ep_addr = ep_addr;
 
   // For device, IN is a tx transfer and OUT is an rx transfer
@@ -175,14 +189,22 @@ static void hw_endpoint_init(uint8_t ep_addr, uint16_t wMaxPacketSize, uint8_t t
     }
 
     // alloc a buffer and fill in endpoint control register
-    _hw_endpoint_alloc(ep, transfer_type);
+    return _hw_endpoint_alloc(ep, transfer_type);
   }
+
+  return true;
 }
 
 static void hw_endpoint_xfer(uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes)
 {
     struct hw_endpoint *ep = hw_endpoint_get_by_addr(ep_addr);
-    hw_endpoint_xfer_start(ep, buffer, total_bytes);
+
+    // OUT transfer can be complete with a packet received before it is queued
+    if ( hw_endpoint_xfer_start(ep, buffer, total_bytes) )
+    {
+        dcd_event_xfer_complete(0, ep->ep_addr, ep->xferred_len, XFER_RESULT_SUCCESS, false);
+        hw_endpoint_reset_transfer(ep);
+    }
 }
 
 static void hw_handle_buff_status(void)
@@ -239,7 +261,7 @@ static void reset_non_control_endpoints(void)
   tu_memclr(hw_endpoints[1], sizeof(hw_endpoints) - 2*sizeof(hw_endpoint_t));
 
   // reclaim buffer space
-  next_buffer_ptr = &usb_dpram->epx_data[0];
+  _dpram_used = 0;
 }
 
 static void dcd_rp2040_irq(void)
@@ -443,7 +465,7 @@ void dcd_edpt0_status_complete(uint8_t rhport, tusb_control_request_t const * re
 bool dcd_edpt_open (__unused uint8_t rhport, tusb_desc_endpoint_t const * desc_edpt)
 {
     assert(rhport == 0);
-    hw_endpoint_init(desc_edpt->bEndpointAddress, tu_edpt_packet_size(desc_edpt), desc_edpt->bmAttributes.xfer);
+    TU_ASSERT(hw_endpoint_init(desc_edpt->bEndpointAddress, tu_edpt_packet_size(desc_edpt), desc_edpt->bmAttributes.xfer));
     return true;
 }
 
@@ -477,6 +499,7 @@ void dcd_edpt_stall(uint8_t rhport, uint8_t ep_addr)
   // stall and clear current pending buffer
   // may need to use EP_ABORT
   _hw_endpoint_buffer_control_set_value32(ep, USB_BUF_CTRL_STALL);
+  ep->buf_armed = 0;
 }
 
 void dcd_edpt_clear_stall(uint8_t rhport, uint8_t ep_addr)
@@ -51,6 +51,21 @@
 #endif
 static_assert(PICO_USB_HOST_INTERRUPT_ENDPOINTS <= USB_MAX_ENDPOINTS, "");
 
+// Packets of a turn on the shared epx before it is given to the next pending transfer
+#ifndef PICO_USB_HOST_EPX_TURN_PACKETS
+#define PICO_USB_HOST_EPX_TURN_PACKETS 8
+#endif
+
+// Frames a transfer yielding epx on NAK waits before it is retried, unless there is nothing else to do.
+// It is doubled on each consecutive yield up to the max frames, e.g an idle CDC notification or data IN
+#ifndef PICO_USB_HOST_EPX_NAK_RETRY_FRAMES
+#define PICO_USB_HOST_EPX_NAK_RETRY_FRAMES 4
+#endif
+
+#ifndef PICO_USB_HOST_EPX_NAK_RETRY_MAX_FRAMES
+#define PICO_USB_HOST_EPX_NAK_RETRY_MAX_FRAMES 16
+#endif
+
 // Host mode uses one shared endpoint register for non-interrupt endpoint
 static struct hw_endpoint ep_pool[1 + PICO_USB_HOST_INTERRUPT_ENDPOINTS];
 #define epx (ep_pool[0])
@@ -58,6 +73,26 @@ static struct hw_endpoint ep_pool[1 + PICO_USB_HOST_INTERRUPT_ENDPOINTS];
 // The epx endpoint is shared among control, bulk and isochronous endpoints
 struct hw_endpoint *_current_epx_endpoint = &epx;
 
+// Software scheduler of the shared epx. Transfers of control (epx itself) and bulk/isochronous endpoints
+// (ep_pool index) are pending until their turn, which is given round-robin. While other transfers are
+// waiting, a turn ends after PICO_USB_HOST_EPX_TURN_PACKETS packets, or at start of frame if the endpoint
+// only got NAK during the previous frame (hardware retries NAK on its own).
+static struct
+{
+  uint32_t pending;       // bitmap of ep_pool index
+  uint8_t  last;          // index of the last bulk/isochronous turn, next one is searched after it
+  bool     busy;          // _current_epx_endpoint has a turn running
+  bool     setup;         // next control turn sends setup packet
+  bool     progress;      // a buffer completed since turn started or last start of frame
+  uint16_t retry_frame[1 + PICO_USB_HOST_INTERRUPT_ENDPOINTS]; // frame from which an endpoint yielding on NAK is retried
+  uint16_t retry_delay[1 + PICO_USB_HOST_INTERRUPT_ENDPOINTS]; // frames to wait on next yield, reset on progress
+} _epx;
+
+TU_VERIFY_STATIC(TU_ARRAY_SIZE(ep_pool) <= 32, "pending bitmap is 32-bit");
+
+// Control endpoint size of each device, epx is used by all of them
+static uint8_t _ep0_size[CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1];
+
 #define usb_hw_set   hw_set_alias(usb_hw)
 #define usb_hw_clear hw_clear_alias(usb_hw)
 
@@ -118,6 +153,202 @@ static void hw_xfer_complete(struct hw_endpoint *ep, xfer_result_t xfer_result)
     hcd_event_xfer_complete(dev_addr, ep_addr, xferred_len, xfer_result, true);
 }
 
+//--------------------------------------------------------------------+
+// epx scheduler
+//--------------------------------------------------------------------+
+
+static void _hw_endpoint_reinit_epx(struct hw_endpoint *ep);
+
+static inline uint8_t epx_index(struct hw_endpoint const *ep)
+{
+    return (uint8_t) (ep - ep_pool);
+}
+
+// Setup packet is being sent
+static inline bool epx_setup_turn(void)
+{
+    return _epx.busy && _epx.setup && _current_epx_endpoint == &epx;
+}
+
+// Frame number is 11-bit
+static inline bool frame_reached(uint16_t frame)
+{
+    return ((usb_hw->sof_rd - frame) & 0x7FFu) < 0x400u;
+}
+
+static void epx_pend(struct hw_endpoint *ep, uint16_t retry_frame)
+{
+    uint8_t const idx = epx_index(ep);
+    _epx.pending |= TU_BIT(idx);
+    _epx.retry_frame[idx] = retry_frame;
+
+    // Running turn was not limited since nothing else was waiting, it ends with the next armed buffer
+    struct hw_endpoint *cur = _current_epx_endpoint;
+    if ( _epx.busy && cur != ep && cur->turn_packets == 0 ) cur->turn_packets = 1;
+}
+
+// Control stage goes first since it is short and serialized by usbh, then round-robin after the
+// last turn. Endpoint waiting after NAK is only taken if there is nothing else
+static uint8_t epx_next(void)
+{
+    uint8_t const count = TU_ARRAY_SIZE(ep_pool);
+    uint8_t deferred = count;
+
+    if ( (_epx.pending & 0b1) && frame_reached(_epx.retry_frame[0]) ) return 0;
+
+    for (uint8_t i = 1; i <= count; i++)
+    {
+        uint8_t const idx = (uint8_t) ((_epx.last + i) % count);
+        if ( !(_epx.pending & TU_BIT(idx)) ) continue;
+
+        if ( frame_reached(_epx.retry_frame[idx]) ) return idx;
+        if ( deferred == count ) deferred = idx;
+    }
+
+    return deferred;
+}
+
+static void epx_start(struct hw_endpoint *ep)
+{
+    _current_epx_endpoint = ep;
+    _epx.busy = true;
+    _epx.progress = false;
+
+    _hw_endpoint_reinit_epx(ep);
+    usb_hw->dev_addr_ctrl = ep->dev_addr | (tu_edpt_number(ep->ep_addr) << USB_ADDR_ENDP_ENDPOINT_LSB);
+
+    // Set pre if we are a low speed device on full speed hub
+    uint32_t flags = SIE_CTRL_BASE | (need_pre(ep->dev_addr) ? USB_SIE_CTRL_PREAMBLE_EN_BITS : 0);
+
+    if ( ep == &epx && _epx.setup )
+    {
+        flags |= USB_SIE_CTRL_SEND_SETUP_BITS;
+    }else
+    {
+        ep->turn_packets = _epx.pending ? PICO_USB_HOST_EPX_TURN_PACKETS : 0;
+        hw_endpoint_xfer_resume(ep);
+        flags |= ep->rx ? USB_SIE_CTRL_RECEIVE_DATA_BITS : USB_SIE_CTRL_SEND_DATA_BITS;
+    }
+
+    // Set up the hardware with all flags except the start bit, then start the transaction.
+    // If you don't do this in two parts, and the host has switched direction, sometimes
+    // the transaction does not start
+    usb_hw->sie_ctrl = flags;
+    usb_hw->sie_ctrl = flags | USB_SIE_CTRL_START_TRANS_BITS;
+}
+
+// Start of frame interrupt is only needed to take epx back from an endpoint retried on NAK
+static void epx_sof_int_update(void)
+{
+    if ( _epx.busy && _epx.pending )
+    {
+        usb_hw_set->inte = USB_INTE_HOST_SOF_BITS;
+    }else
+    {
+        usb_hw_clear->inte = USB_INTE_HOST_SOF_BITS;
+    }
+}
+
+// Give epx to the next pending transfer if it is free
+static void epx_schedule(void)
+{
+    if ( !_epx.busy && _epx.pending )
+    {
+        uint8_t const idx = epx_next();
+        _epx.pending &= ~TU_BIT(idx);
+
+        // control stage does not take a place in round-robin
+        if ( idx ) _epx.last = idx;
+        epx_start(&ep_pool[idx]);
+    }
+
+    epx_sof_int_update();
+}
+
+static void epx_complete(struct hw_endpoint *ep, xfer_result_t xfer_result)
+{
+    _epx.busy = false;
+    hw_xfer_complete(ep, xfer_result);
+    epx_schedule();
+}
+
+// Stop the turn while it is retried on NAK, returns true if transfer turns out to be complete
+static bool epx_stop(struct hw_endpoint *ep)
+{
+    usb_hw_set->sie_ctrl = USB_SIE_CTRL_STOP_TRANS_BITS;
+    clear_nak_received();
+    _epx.busy = false;
+
+    // buffer completed just before stop is synced by rewind
+    bool const done = hw_endpoint_xfer_rewind(ep);
+    usb_hw_clear->buf_status = 0b1;
+
+    return done;
+}
+
+// Endpoint is closed: drop its pending transfer or stop its turn
+static void epx_release(struct hw_endpoint *ep)
+{
+    _epx.pending &= ~TU_BIT(epx_index(ep));
+
+    if ( _epx.busy && ep == _current_epx_endpoint )
+    {
+        usb_hw_set->sie_ctrl = USB_SIE_CTRL_STOP_TRANS_BITS;
+        _hw_endpoint_buffer_control_set_value32(ep, 0);
+        usb_hw_clear->buf_status = 0b1;
+        _epx.busy = false;
+    }
+}
+
+static void epx_buff_status(struct hw_endpoint *ep)
+{
+    // LAST is set on the buffer ending the transfer or the turn
+    bool const turn_end = _hw_endpoint_buffer_control_get_value32(ep) & (USB_BUF_CTRL_LAST | (USB_BUF_CTRL_LAST << 16));
+    _epx.progress = true;
+    _epx.retry_delay[epx_index(ep)] = 0;
+
+    if ( hw_endpoint_xfer_sync(ep) )
+    {
+        epx_complete(ep, XFER_RESULT_SUCCESS);
+    }else if ( turn_end )
+    {
+        _epx.busy = false;
+        epx_pend(ep, (uint16_t) usb_hw->sof_rd);
+        epx_schedule();
+    }else
+    {
+        hw_endpoint_xfer_resume(ep);
+    }
+}
+
+static void epx_sof_isr(void)
+{
+    uint16_t const frame = (uint16_t) usb_hw->sof_rd; // also clear the interrupt
+    struct hw_endpoint *ep = _current_epx_endpoint;
+
+    // Only NAK since last frame while others are waiting: yield epx
+    if ( _epx.busy && !epx_setup_turn() && !_epx.progress && _epx.pending && nak_received() &&
+         !(usb_hw->ints & (USB_INTS_BUFF_STATUS_BITS | USB_INTS_TRANS_COMPLETE_BITS)) )
+    {
+        if ( epx_stop(ep) )
+        {
+            epx_complete(ep, XFER_RESULT_SUCCESS);
+        }else
+        {
+            uint8_t const idx = epx_index(ep);
+            uint16_t delay = _epx.retry_delay[idx];
+            delay = delay ? tu_min16(2*delay, PICO_USB_HOST_EPX_NAK_RETRY_MAX_FRAMES) : PICO_USB_HOST_EPX_NAK_RETRY_FRAMES;
+            _epx.retry_delay[idx] = delay;
+
+            epx_pend(ep, (uint16_t) (frame + delay));
+            epx_schedule();
+        }
+    }
+
+    _epx.progress = false;
+    clear_nak_received();
+}
+
 static void _handle_buff_status_bit(uint bit, struct hw_endpoint *ep)
 {
     usb_hw_clear->buf_status = bit;
@@ -150,7 +381,8 @@ static void hw_handle_buff_status(void)
         }
         TU_LOG_HEX(3, ep_ctrl);
 
-        _handle_buff_status_bit(bit, ep);
+        usb_hw_clear->buf_status = bit;
+        epx_buff_status(ep);
     }
 
     // Check interrupt endpoints
@@ -178,12 +410,13 @@ static void hw_handle_buff_status(void)
 
 static void hw_trans_complete(void)
 {
-  if (usb_hw->sie_ctrl & USB_SIE_CTRL_SEND_SETUP_BITS)
+  if (epx_setup_turn())
   {
     pico_trace("Sent setup packet\n");
     struct hw_endpoint *ep = &epx;
     assert(ep->active);
-    hw_xfer_complete(ep, XFER_RESULT_SUCCESS);
+    _epx.setup = false;
+    epx_complete(ep, XFER_RESULT_SUCCESS);
   }
   else
   {
@@ -214,13 +447,7 @@ static void hcd_rp2040_irq(void)
         usb_hw_clear->sie_status = USB_SIE_STATUS_SPEED_BITS;
     }
 
-    if (status & USB_INTS_BUFF_STATUS_BITS)
-    {
-        handled |= USB_INTS_BUFF_STATUS_BITS;
-        TU_LOG(2, "Buffer complete\n");
-        hw_handle_buff_status();
-    }
-
+    // Transfer complete is handled first: a setup started by buffer status (epx scheduler) is not yet sent
     if (status & USB_INTS_TRANS_COMPLETE_BITS)
     {
         handled |= USB_INTS_TRANS_COMPLETE_BITS;
@@ -229,13 +456,27 @@ static void hcd_rp2040_irq(void)
         hw_trans_complete();
     }
 
+    if (status & USB_INTS_BUFF_STATUS_BITS)
+    {
+        handled |= USB_INTS_BUFF_STATUS_BITS;
+        TU_LOG(2, "Buffer complete\n");
+        hw_handle_buff_status();
+    }
+
     if (status & USB_INTS_STALL_BITS)
     {
         // We have rx'd a stall or a NAK from the device
         pico_trace("Stall REC\n");
         handled |= USB_INTS_STALL_BITS;
         usb_hw_clear->sie_status = USB_SIE_STATUS_STALL_REC_BITS;
-        hw_xfer_complete(&epx, XFER_RESULT_STALLED);
+        _hw_endpoint_buffer_control_set_value32(_current_epx_endpoint, 0);
+        epx_complete(_current_epx_endpoint, XFER_RESULT_STALLED);
+    }
+
+    if (status & USB_INTS_HOST_SOF_BITS)
+    {
+        handled |= USB_INTS_HOST_SOF_BITS;
+        epx_sof_isr();
     }
 
     if (status & USB_INTS_ERROR_RX_TIMEOUT_BITS)
@@ -357,13 +598,15 @@ static void _hw_endpoint_init(struct hw_endpoint *ep, uint8_t dev_addr, uint8_t
                   | EP_CTRL_INTERRUPT_PER_BUFFER
                   | (ep->transfer_type << EP_CTRL_BUFFER_TYPE_LSB)
                   | dpram_offset;
-    ep_reg |= bmInterval ? (bmInterval - 1) << EP_CTRL_HOST_INTERRUPT_INTERVAL_LSB : 0;
-    *ep->endpoint_control = ep_reg;
-    pico_trace("endpoint control (0x%p) <- 0x%x\n", ep->endpoint_control, ep_reg);
     ep->configured = true;
 
+    // epx register is only set up when the endpoint gets its turn, see epx_start()
     if (bmInterval)
     {
+        ep_reg |= (bmInterval - 1) << EP_CTRL_HOST_INTERRUPT_INTERVAL_LSB;
+        *ep->endpoint_control = ep_reg;
+        pico_trace("endpoint control (0x%p) <- 0x%x\n", ep->endpoint_control, ep_reg);
+
         // This is an interrupt endpoint
         // so need to set up interrupt endpoint address control register with:
         // device address
@@ -406,6 +649,8 @@ bool hcd_init(uint8_t rhport)
 
     // clear epx and interrupt eps
     memset(&ep_pool, 0, sizeof(ep_pool));
+    tu_memclr(&_epx, sizeof(_epx));
+    _current_epx_endpoint = &epx;
 
     // Enable in host mode with SOF / Keep alive on
     usb_hw->main_ctrl = USB_MAIN_CTRL_CONTROLLER_EN_BITS | USB_MAIN_CTRL_HOST_NDEVICE_BITS;
@@ -462,23 +707,43 @@ void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
 
   if (dev_addr == 0) return;
   skip_hcd_edpt_clear_in_on_nak = SKIP_CLEAR_IN_ON_NAK_COUNT;
+
+  hcd_int_disable(rhport);
+
   for (size_t i = 1; i < TU_ARRAY_SIZE(ep_pool); i++)
   {
     hw_endpoint_t* ep = &ep_pool[i];
 
     if (ep->dev_addr == dev_addr && ep->configured)
     {
-      // in case it is an interrupt endpoint, disable it
-      usb_hw_clear->int_ep_ctrl = (1 << (ep->interrupt_num + 1));
-      usb_hw->int_ep_addr_ctrl[ep->interrupt_num] = 0;
+      if (ep->transfer_type == TUSB_XFER_INTERRUPT)
+      {
+        usb_hw_clear->int_ep_ctrl = (1 << (ep->interrupt_num + 1));
+        usb_hw->int_ep_addr_ctrl[ep->interrupt_num] = 0;
+
+        *ep->endpoint_control = 0;
+        *ep->buffer_control = 0;
+      }else
+      {
+        // epx is shared, only its transfer is dropped
+        epx_release(ep);
+      }
 
       // unconfigure the endpoint
       ep->configured = false;
-      *ep->endpoint_control = 0;
-      *ep->buffer_control = 0;
       hw_endpoint_reset_transfer(ep);
     }
   }
+
+  if (epx.dev_addr == dev_addr)
+  {
+    epx_release(&epx);
+    _epx.setup = false;
+    hw_endpoint_reset_transfer(&epx);
+  }
+
+  epx_schedule();
+  hcd_int_enable(rhport);
 }
 
 uint32_t hcd_frame_number(uint8_t rhport)
@@ -510,15 +775,26 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
 
     pico_trace("hcd_edpt_open dev_addr %d, ep_addr %d\n", dev_addr, ep_desc->bEndpointAddress);
 
+    uint8_t const xfer_type = ep_desc->bmAttributes.xfer;
+
+    if (xfer_type == TUSB_XFER_CONTROL)
+    {
+        TU_ASSERT(dev_addr < TU_ARRAY_SIZE(_ep0_size));
+        _ep0_size[dev_addr] = (uint8_t) tu_edpt_packet_size(ep_desc);
+
+        // epx is set up for the device on each setup packet
+        return true;
+    }
+
     // Allocated differently based on if it's an interrupt endpoint or not
-    struct hw_endpoint *ep = _hw_endpoint_allocate(ep_desc->bmAttributes.xfer);
+    struct hw_endpoint *ep = _hw_endpoint_allocate(xfer_type);
 
     _hw_endpoint_init(ep,
         dev_addr,
         ep_desc->bEndpointAddress,
         tu_edpt_packet_size(ep_desc),
-        ep_desc->bmAttributes.xfer,
-        ep_desc->bInterval);
+        xfer_type,
+        (xfer_type == TUSB_XFER_INTERRUPT) ? ep_desc->bInterval : 0);
 
     return true;
 }
@@ -554,106 +830,65 @@ static void _hw_endpoint_reinit_epx(struct hw_endpoint *ep)
     }
 }
 
-bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen)
+bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint32_t buflen)
 {
-    (void) rhport;
-
     pico_trace("hcd_edpt_xfer dev_addr %d, ep_addr 0x%x, len %d\n", dev_addr, ep_addr, buflen);
 
-    uint8_t const ep_num = tu_edpt_number(ep_addr);
-    tusb_dir_t const ep_dir = tu_edpt_dir(ep_addr);
-
     // Get appropriate ep. Either EPX or interrupt endpoint
     struct hw_endpoint *ep = get_dev_ep(dev_addr, ep_addr);
-    assert(ep);
+    TU_ASSERT(ep);
 
-    if ( ep_num == 0 )
+    // Interrupt endpoint is polled by hardware on its own
+    if ( ep != &epx && ep->transfer_type == TUSB_XFER_INTERRUPT )
     {
-        // exp buffers might not have been used for endpoint 0 or control endpoint might have changed direction 0x00 <-> 0x80
-        if ( _current_epx_endpoint != &epx || ep_addr != ep->ep_addr )
-        {
-            // Re-init endpoint
-            _hw_endpoint_init(ep, dev_addr, ep_addr, ep->wMaxPacketSize, ep->transfer_type, 0);
-        }
-        _current_epx_endpoint = &epx;        
-    } 
-
-    bool is_bulk_or_isochronous = (ep != &epx && (ep->transfer_type == TUSB_XFER_BULK || ep->transfer_type == TUSB_XFER_ISOCHRONOUS));
-    // the epx endpoint is shared among control, bulk and isochronous endpoints
-    if ( is_bulk_or_isochronous )
-    {
-        if (ep != _current_epx_endpoint)
-        {
-            _hw_endpoint_reinit_epx(ep);
-        }
-        _current_epx_endpoint = ep;
         hw_endpoint_xfer_start(ep, buffer, buflen);
+        return true;
+    }
 
-        // That has set up buffer control, endpoint control etc
-        // for host we have to initiate the transfer
-        usb_hw->dev_addr_ctrl = dev_addr | (ep_num << USB_ADDR_ENDP_ENDPOINT_LSB);
-
-        uint32_t flags = SIE_CTRL_BASE |
-                 (ep_dir ? USB_SIE_CTRL_RECEIVE_DATA_BITS : USB_SIE_CTRL_SEND_DATA_BITS);
-        // Set pre if we are a low speed device on full speed hub
-        flags |= need_pre(dev_addr) ? USB_SIE_CTRL_PREAMBLE_EN_BITS : 0;
-        // Set up the hardware with all flags except the start bit
-        usb_hw->sie_ctrl = flags;
-        // Now start the transaction; if you don't do this in two parts,
-        // and the host has switched direction, sometimes the transaction
-        // does not start
-        flags |= USB_SIE_CTRL_START_TRANS_BITS;
-        usb_hw->sie_ctrl = flags;
-    }else
-    // If a normal transfer (non-interrupt) then initiate using
-    // sie ctrl registers. Otherwise interrupt ep registers should
-    // already be configured
-    if (ep == &epx) {
-        hw_endpoint_xfer_start(ep, buffer, buflen);
-
-        // That has set up buffer control, endpoint control etc
-        // for host we have to initiate the transfer
-        usb_hw->dev_addr_ctrl = dev_addr | (ep_num << USB_ADDR_ENDP_ENDPOINT_LSB);
-
-        uint32_t flags = USB_SIE_CTRL_START_TRANS_BITS | SIE_CTRL_BASE |
-                         (ep_dir ? USB_SIE_CTRL_RECEIVE_DATA_BITS : USB_SIE_CTRL_SEND_DATA_BITS);
-        // Set pre if we are a low speed device on full speed hub
-        flags |= need_pre(dev_addr) ? USB_SIE_CTRL_PREAMBLE_EN_BITS : 0;
-
-        usb_hw->sie_ctrl = flags;
-    }else
+    if ( ep == &epx )
     {
-      hw_endpoint_xfer_start(ep, buffer, buflen);
+        // Data or status stage of the control transfer started by hcd_setup_send(),
+        // direction might have changed 0x00 <-> 0x80
+        ep->dev_addr = dev_addr;
+        ep->ep_addr  = ep_addr;
+        ep->rx       = (tu_edpt_dir(ep_addr) == TUSB_DIR_IN);
+        ep->next_pid = 1;
     }
 
+    // Control, bulk and isochronous share epx: transfer waits for its turn
+    hcd_int_disable(rhport);
+    hw_endpoint_xfer_setup(ep, buffer, buflen);
+    epx_pend(ep, (uint16_t) usb_hw->sof_rd);
+    epx_schedule();
+    hcd_int_enable(rhport);
+
     return true;
 }
 
 bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet[8])
 {
-    (void) rhport;
-
-    // Copy data into setup packet buffer
-    memcpy((void*)&usbh_dpram->setup_packet[0], setup_packet, 8);
+    TU_ASSERT(dev_addr < TU_ARRAY_SIZE(_ep0_size));
 
     // Configure EP0 struct with setup info for the trans complete
     struct hw_endpoint *ep = _hw_endpoint_allocate(0);
 
+    hcd_int_disable(rhport);
+
+    // Setup packet buffer is not used by bulk transfers, control transfers are serialized by usbh
+    memcpy((void*)&usbh_dpram->setup_packet[0], setup_packet, 8);
+
     // EP0 out
-    _hw_endpoint_init(ep, dev_addr, 0x00, ep->wMaxPacketSize, 0, 0);
+    _hw_endpoint_init(ep, dev_addr, 0x00, _ep0_size[dev_addr], 0, 0);
     assert(ep->configured);
 
     ep->remaining_len = 8;
     ep->active        = true;
 
-    // Set device address
-    usb_hw->dev_addr_ctrl = dev_addr;
+    _epx.setup = true;
+    epx_pend(ep, (uint16_t) usb_hw->sof_rd);
+    epx_schedule();
 
-    // Set pre if we are a low speed device on full speed hub
-    uint32_t const flags = SIE_CTRL_BASE | USB_SIE_CTRL_SEND_SETUP_BITS | USB_SIE_CTRL_START_TRANS_BITS |
-                           (need_pre(dev_addr) ? USB_SIE_CTRL_PREAMBLE_EN_BITS : 0);
-
-    usb_hw->sie_ctrl = flags;
+    hcd_int_enable(rhport);
 
     return true;
 }
@@ -698,7 +933,7 @@ void hcd_edpt_force_last_buffer(uint8_t dev_addr, uint8_t ep_addr, bool force)
 void hcd_edpt_clear_in_on_nak(uint8_t dev_addr, uint8_t ep_addr)
 {
     struct hw_endpoint *ep = get_dev_ep(dev_addr, ep_addr);
-    if (ep == _current_epx_endpoint)
+    if (_epx.busy && ep == _current_epx_endpoint)
     {
         if (nak_received() && (usb_hw->ints & (USB_INTS_BUFF_STATUS_BITS | USB_INTS_TRANS_COMPLETE_BITS)) == 0)
         {
@@ -718,25 +953,18 @@ void hcd_edpt_clear_in_on_nak(uint8_t dev_addr, uint8_t ep_addr)
             uint32_t masked_ints = (usb_hw->intr & temp_inte);
             while (!nak_received() && masked_ints == 0)
                 masked_ints = (usb_hw->intr & temp_inte);
+            // restore the USB interrupts; a transaction is in process
+            usb_hw->inte = temp_inte;
+
             if (masked_ints == 0 && nak_received())
             {
-                // stop the current transaction to free up the host epx HW
-                usb_hw_set->sie_ctrl = USB_SIE_CTRL_STOP_TRANS_BITS;
-                // clear the NAK status bit
-                clear_nak_received();
-                // There was no transfer, but the logic that sets up the buffer
-                // control register needs to see USB_BUF_CTRL_AVAIL bit clear
-                // or else it will assert.
-                _hw_endpoint_buffer_control_clear_mask32(ep, USB_BUF_CTRL_AVAIL);
-                // Fixup next PID: prepare_ep_buffer() toggles the PID, but there was
-                // no successful data transfer, so we need to toggle it here so that
-                // it is back where we started.
-                ep->next_pid ^= 1u;
-                // Notify host stack that the transfer is done (clears busy)
-                hw_xfer_complete(ep, XFER_RESULT_SUCCESS);
+                // stop the current transaction to free up the host epx HW, there
+                // was no transfer since NAK: buffer and next PID are given back
+                (void) epx_stop(ep);
+
+                // Notify host stack that the transfer is done (clears busy), epx goes to next transfer
+                epx_complete(ep, XFER_RESULT_SUCCESS);
             }
-            // restore the USB interrupts; a transaction is in process
-            usb_hw->inte = temp_inte;
         }
     }
 }
@@ -44,9 +44,6 @@ static inline void _hw_endpoint_lock_update(__unused struct hw_endpoint * ep, __
     //  sense to have worker and IRQ on same core, however I think using critsec is about equivalent.
 }
 
-static void _hw_endpoint_xfer_sync(struct hw_endpoint *ep);
-static void _hw_endpoint_start_next_buffer(struct hw_endpoint *ep);
-
 //--------------------------------------------------------------------+
 //
 //--------------------------------------------------------------------+
@@ -73,6 +70,15 @@ void hw_endpoint_reset_transfer(struct hw_endpoint *ep)
   ep->user_buf = 0;
 }
 
+static inline void _hw_endpoint_buffer_available_delay(void)
+{
+  // 12 cycle delay.. (should be good for 48*12Mhz = 576Mhz)
+  // Don't need delay in host mode as host is in charge
+#if !TUSB_OPT_HOST_ENABLED
+  busy_wait_at_least_cycles(12);
+#endif
+}
+
 void _hw_endpoint_buffer_control_update32(struct hw_endpoint *ep, uint32_t and_mask, uint32_t or_mask) {
     uint32_t value = 0;
     if (and_mask) {
@@ -85,29 +91,18 @@ void _hw_endpoint_buffer_control_update32(struct hw_endpoint *ep, uint32_t and_m
                 panic("ep %d %s was already available", tu_edpt_number(ep->ep_addr), ep_dir_string[tu_edpt_dir(ep->ep_addr)]);
             }
             *ep->buffer_control = value & ~USB_BUF_CTRL_AVAIL;
-            // 12 cycle delay.. (should be good for 48*12Mhz = 576Mhz)
-            // Don't need delay in host mode as host is in charge
-#if !TUSB_OPT_HOST_ENABLED
-            __asm volatile (
-                    "b 1f\n"
-                    "1: b 1f\n"
-                    "1: b 1f\n"
-                    "1: b 1f\n"
-                    "1: b 1f\n"
-                    "1: b 1f\n"
-                    "1:\n"
-                    : : : "memory");
-#endif
+            _hw_endpoint_buffer_available_delay();
         }
     }
     *ep->buffer_control = value;
 }
 
+#if TUSB_OPT_HOST_ENABLED
 // prepare buffer, return buffer control
 static uint32_t prepare_ep_buffer(struct hw_endpoint *ep, uint8_t buf_id)
 {
-  uint16_t const buflen = tu_min16(ep->remaining_len, ep->wMaxPacketSize);
-  ep->remaining_len = (uint16_t)(ep->remaining_len - buflen);
+  uint16_t const buflen = (uint16_t) tu_min32(ep->remaining_len, ep->wMaxPacketSize);
+  ep->remaining_len -= buflen;
 
   uint32_t buf_ctrl = buflen | USB_BUF_CTRL_AVAIL;
 
@@ -118,21 +113,19 @@ static uint32_t prepare_ep_buffer(struct hw_endpoint *ep, uint8_t buf_id)
   if ( !ep->rx )
   {
     // Copy data from user buffer to hw buffer
-    memcpy(ep->hw_data_buf + buf_id*64, ep->user_buf, buflen);
+    if ( buflen ) memcpy(ep->hw_data_buf + buf_id*64, ep->user_buf, buflen);
     ep->user_buf += buflen;
 
     // Mark as full
     buf_ctrl |= USB_BUF_CTRL_FULL;
   }
 
-  // Is this the last buffer? Only really matters for host mode. Will trigger
-  // the trans complete irq but also stop it polling. We only really care about
-  // trans complete for setup packets being sent and for bulk transfers
-  #if TUSB_OPT_HOST_ENABLED
-  if (ep->remaining_len == 0 || ep->force_last_buff)
-  #else
-  if (ep->remaining_len == 0)
-  #endif
+  // Is this the last buffer? Will trigger the trans complete irq but also stop it polling.
+  // We only really care about trans complete for setup packets being sent and for bulk transfers
+  bool const turn_end = (ep->turn_packets == 1);
+  if (ep->turn_packets) ep->turn_packets--;
+
+  if (ep->remaining_len == 0 || ep->force_last_buff || turn_end)
   {
     buf_ctrl |= USB_BUF_CTRL_LAST;
   }
@@ -150,16 +143,10 @@ static void _hw_endpoint_start_next_buffer(struct hw_endpoint *ep)
   // always compute and start with buffer 0
   uint32_t buf_ctrl = prepare_ep_buffer(ep, 0) | USB_BUF_CTRL_SEL;
 
-  // For now: skip double buffered for Device mode, OUT endpoint since
-  // host could send < 64 bytes and cause short packet on buffer0
-  // NOTE this could happen to Host mode IN endpoint
-  bool const force_single = !(usb_hw->main_ctrl & USB_MAIN_CTRL_HOST_NDEVICE_BITS) && !tu_edpt_dir(ep->ep_addr);
-
-  if(ep->remaining_len && !force_single)
+  // Buffer 1 is not used if transfer (or host epx turn) ends with buffer 0
+  if(ep->remaining_len && !(buf_ctrl & USB_BUF_CTRL_LAST))
   {
     // Use buffer 1 (double buffered) if there is still data
-    // TODO: Isochronous for buffer1 bit-field is different than CBI (control bulk, interrupt)
-
     buf_ctrl |= prepare_ep_buffer(ep, 1);
 
     // Set endpoint control double buffered bit if needed
@@ -180,11 +167,183 @@ static void _hw_endpoint_start_next_buffer(struct hw_endpoint *ep)
   // the next time the controller polls this dpram address
   _hw_endpoint_buffer_control_set_value32(ep, buf_ctrl);
 }
+#endif
 
-void hw_endpoint_xfer_start(struct hw_endpoint *ep, uint8_t *buffer, uint16_t total_len)
+#if TUSB_OPT_DEVICE_ENABLED
+//--------------------------------------------------------------------+
+// Device: bulk and isochronous endpoints are double buffered, the controller uses the buffers in turn
+// (from buffer 0 after SEL) and raises buffer status for each. A completed buffer is armed again with
+// the next packet while the other one is in use. Buffers complete in order, next_buf_id is the one
+// to complete next.
+//--------------------------------------------------------------------+
+
+static inline bool dev_double_buffered(struct hw_endpoint *ep)
 {
-  _hw_endpoint_lock_update(ep, 1);
+  // EP0 has no endpoint control and is single buffered
+  return ep->endpoint_control && ((*ep->endpoint_control) & EP_CTRL_DOUBLE_BUFFERED_BITS);
+}
+
+static inline uint8_t *dev_hw_buffer(struct hw_endpoint *ep, uint8_t buf_id)
+{
+  return ep->hw_data_buf + (buf_id ? hw_endpoint_buf1_offset(ep) : 0);
+}
+
+// Buffer control of a buffer is its 16-bit half, accessed alone since the other buffer may be in use by the controller
+static inline uint16_t dev_buffer_control_get(struct hw_endpoint *ep, uint8_t buf_id)
+{
+  return ((io_rw_16 *) ep->buffer_control)[buf_id];
+}
+
+static void dev_buffer_control_set(struct hw_endpoint *ep, uint8_t buf_id, uint16_t value)
+{
+  io_rw_16 *buf_ctrl = ((io_rw_16 *) ep->buffer_control) + buf_id;
+
+  if (value & USB_BUF_CTRL_AVAIL)
+  {
+    if (*buf_ctrl & USB_BUF_CTRL_AVAIL)
+    {
+      panic("ep %d %s buffer %u was already available", tu_edpt_number(ep->ep_addr), ep_dir_string[tu_edpt_dir(ep->ep_addr)], buf_id);
+    }
+    *buf_ctrl = (uint16_t) (value & ~USB_BUF_CTRL_AVAIL);
+    _hw_endpoint_buffer_available_delay();
+  }
+
+  *buf_ctrl = value;
+}
+
+// Arm buffer with next packet of transfer
+static void dev_buffer_arm(struct hw_endpoint *ep, uint8_t buf_id, bool sel_reset)
+{
+  uint16_t const buflen = (uint16_t) tu_min32(ep->remaining_len, ep->wMaxPacketSize);
+  ep->remaining_len -= buflen;
+
+  // OUT buffer takes a full packet, data past the transfer length is dropped when it is copied
+  uint32_t buf_ctrl = (ep->rx ? ep->wMaxPacketSize : buflen) | USB_BUF_CTRL_AVAIL;
+
+  // PID, isochronous is always DATA0
+  buf_ctrl |= ep->next_pid ? USB_BUF_CTRL_DATA1_PID : USB_BUF_CTRL_DATA0_PID;
+  if (ep->transfer_type != TUSB_XFER_ISOCHRONOUS) ep->next_pid ^= 1u;
 
+  if ( !ep->rx )
+  {
+    if ( buflen ) memcpy(dev_hw_buffer(ep, buf_id), ep->user_buf, buflen);
+    ep->user_buf += buflen;
+    buf_ctrl |= USB_BUF_CTRL_FULL;
+  }
+
+  if (ep->remaining_len == 0) buf_ctrl |= USB_BUF_CTRL_LAST;
+  if (sel_reset) buf_ctrl |= USB_BUF_CTRL_SEL;
+
+  // Isochronous buffer 1 offset is in the upper half
+  if (buf_id && ep->transfer_type == TUSB_XFER_ISOCHRONOUS)
+  {
+    uint32_t const offset_code = (uint32_t) __builtin_ctz(hw_endpoint_buf1_offset(ep) / 128u);
+    buf_ctrl |= offset_code << (BUF_CTRL_ISO_OFFSET_LSB - 16u);
+  }
+
+  ep->buf_armed |= TU_BIT(buf_id);
+  dev_buffer_control_set(ep, buf_id, (uint16_t) buf_ctrl);
+}
+
+// Arm free buffers in the order the controller uses them
+static void dev_xfer_fill(struct hw_endpoint *ep)
+{
+  uint8_t const buf_count = dev_double_buffered(ep) ? 2 : 1;
+
+  for(uint8_t i = 0; i < buf_count && ep->remaining_len; i++)
+  {
+    uint8_t const buf_id = (uint8_t) (ep->next_buf_id ^ i);
+    if ( !(ep->buf_armed & TU_BIT(buf_id)) ) dev_buffer_arm(ep, buf_id, false);
+  }
+}
+
+// Transfer ends with a short packet while the other buffer is armed. It is taken back with EP_ABORT, unless it
+// has received the first packet of next transfer already: then it stays armed (full) until that transfer starts.
+static void dev_buffer_revoke(struct hw_endpoint *ep)
+{
+  uint8_t  const buf_id  = ep->next_buf_id;
+  uint32_t const ep_mask = TU_BIT(2*tu_edpt_number(ep->ep_addr) + (ep->rx ? 1 : 0));
+
+  hw_set_alias(usb_hw)->abort = ep_mask;
+  while ( !(usb_hw->abort_done & ep_mask) ) tight_loop_contents();
+
+  if ( dev_buffer_control_get(ep, buf_id) & USB_BUF_CTRL_AVAIL )
+  {
+    dev_buffer_control_set(ep, buf_id, 0);
+    ep->buf_armed &= (uint8_t) ~TU_BIT(buf_id);
+    if (ep->transfer_type != TUSB_XFER_ISOCHRONOUS) ep->next_pid ^= 1u;
+  }else
+  {
+    pico_trace("  Packet on buffer %u kept for next transfer\n", buf_id);
+  }
+
+  hw_clear_alias(usb_hw)->abort = ep_mask;
+  usb_hw->abort_done = ep_mask;
+}
+
+// Sync completed buffers in order and arm them again, returns true if transfer is complete
+static bool dev_xfer_sync(struct hw_endpoint *ep)
+{
+  bool const double_buf = dev_double_buffered(ep);
+
+  while ( ep->buf_armed & TU_BIT(ep->next_buf_id) )
+  {
+    uint8_t  const buf_id   = ep->next_buf_id;
+    uint16_t const buf_ctrl = dev_buffer_control_get(ep, buf_id);
+
+    if (buf_ctrl & USB_BUF_CTRL_AVAIL) break;
+
+    ep->buf_armed &= (uint8_t) ~TU_BIT(buf_id);
+    if (double_buf) ep->next_buf_id ^= 1u;
+
+    uint16_t const xferred_bytes = buf_ctrl & USB_BUF_CTRL_LEN_MASK;
+
+    if ( ep->rx )
+    {
+      uint16_t const count = (uint16_t) tu_min32(xferred_bytes, ep->total_len - ep->xferred_len);
+      if ( count ) memcpy(ep->user_buf, dev_hw_buffer(ep, buf_id), count);
+      ep->user_buf += count;
+      ep->xferred_len += count;
+    }else
+    {
+      ep->xferred_len += xferred_bytes;
+    }
+
+    if ( xferred_bytes < ep->wMaxPacketSize || (ep->remaining_len == 0 && !ep->buf_armed) )
+    {
+      pico_trace("  Completed on buffer %u with %u bytes\n", buf_id, xferred_bytes);
+      if (ep->buf_armed) dev_buffer_revoke(ep);
+      return true;
+    }
+  }
+
+  dev_xfer_fill(ep);
+  return false;
+}
+
+// Returns true if transfer is complete with a packet received before it is started
+static bool dev_xfer_start(struct hw_endpoint *ep)
+{
+  if ( !dev_double_buffered(ep) ) ep->buf_armed = 0;
+
+  if ( ep->buf_armed )
+  {
+    // buffer kept from previous transfer has the first packet
+    ep->remaining_len -= tu_min32(ep->remaining_len, ep->wMaxPacketSize);
+    return dev_xfer_sync(ep);
+  }
+
+  // controller starts with buffer 0 after SEL
+  ep->next_buf_id = 0;
+  dev_buffer_arm(ep, 0, true);
+  dev_xfer_fill(ep);
+
+  return false;
+}
+#endif
+
+static void _hw_endpoint_xfer_setup(struct hw_endpoint *ep, uint8_t *buffer, uint32_t total_len)
+{
   if ( ep->active )
   {
     // TODO: Is this acceptable for interrupt packets?
@@ -199,11 +358,27 @@ void hw_endpoint_xfer_start(struct hw_endpoint *ep, uint8_t *buffer, uint16_t to
   ep->xferred_len   = 0;
   ep->active        = true;
   ep->user_buf      = buffer;
+#if TUSB_OPT_DEVICE_ENABLED
+  ep->total_len     = total_len;
+#endif
+}
 
+bool hw_endpoint_xfer_start(struct hw_endpoint *ep, uint8_t *buffer, uint32_t total_len)
+{
+  _hw_endpoint_lock_update(ep, 1);
+  _hw_endpoint_xfer_setup(ep, buffer, total_len);
+#if TUSB_OPT_DEVICE_ENABLED
+  bool const done = dev_xfer_start(ep);
+#else
   _hw_endpoint_start_next_buffer(ep);
+  bool const done = false;
+#endif
   _hw_endpoint_lock_update(ep, -1);
+
+  return done;
 }
 
+#if TUSB_OPT_HOST_ENABLED
 // sync endpoint buffer and return transferred bytes
 static uint16_t sync_ep_buffer(struct hw_endpoint *ep, uint8_t buf_id)
 {
@@ -218,7 +393,7 @@ static uint16_t sync_ep_buffer(struct hw_endpoint *ep, uint8_t buf_id)
     // sent some data can increase the length we have sent
     assert(!(buf_ctrl & USB_BUF_CTRL_FULL));
 
-    ep->xferred_len = (uint16_t)(ep->xferred_len + xferred_bytes);
+    ep->xferred_len += xferred_bytes;
   }else
   {
     // If we have received some data, so can increase the length
@@ -226,7 +401,7 @@ static uint16_t sync_ep_buffer(struct hw_endpoint *ep, uint8_t buf_id)
     assert(buf_ctrl & USB_BUF_CTRL_FULL);
 
     memcpy(ep->user_buf, ep->hw_data_buf + buf_id*64, xferred_bytes);
-    ep->xferred_len = (uint16_t)(ep->xferred_len + xferred_bytes);
+    ep->xferred_len += xferred_bytes;
     ep->user_buf += xferred_bytes;
   }
 
@@ -259,42 +434,98 @@ static void _hw_endpoint_xfer_sync (struct hw_endpoint *ep)
     {
       // sync buffer 1 if not short packet
       sync_ep_buffer(ep, 1);
-    }else
-    {
-      // short packet on buffer 0
-      // TODO couldn't figure out how to handle this case which happen with net_lwip_webserver example
-      // At this time (currently trigger per 2 buffer), the buffer1 is probably filled with data from
-      // the next transfer (not current one). For now we disable double buffered for device OUT
-      // NOTE this could happen to Host IN
-#if 0
-      uint8_t const ep_num = tu_edpt_number(ep->ep_addr);
-      uint8_t const dir =  (uint8_t) tu_edpt_dir(ep->ep_addr);
-      uint8_t const ep_id = 2*ep_num + (dir ? 0 : 1);
+    }
+    // else short packet on buffer 0 ends the transfer, buffer 1 is not used
+  }
+}
 
-      // abort queued transfer on buffer 1
-      usb_hw->abort |= TU_BIT(ep_id);
+void hw_endpoint_xfer_setup(struct hw_endpoint *ep, uint8_t *buffer, uint32_t total_len)
+{
+  _hw_endpoint_lock_update(ep, 1);
+  _hw_endpoint_xfer_setup(ep, buffer, total_len);
+  _hw_endpoint_lock_update(ep, -1);
+}
 
-      while ( !(usb_hw->abort_done & TU_BIT(ep_id)) ) {}
+void hw_endpoint_xfer_resume(struct hw_endpoint *ep)
+{
+  _hw_endpoint_lock_update(ep, 1);
+  _hw_endpoint_start_next_buffer(ep);
+  _hw_endpoint_lock_update(ep, -1);
+}
 
-      uint32_t ep_ctrl = *ep->endpoint_control;
-      ep_ctrl &= ~(EP_CTRL_DOUBLE_BUFFERED_BITS | EP_CTRL_INTERRUPT_PER_DOUBLE_BUFFER);
-      ep_ctrl |= EP_CTRL_INTERRUPT_PER_BUFFER;
+// Returns true if transfer is complete, next buffer is not started
+bool hw_endpoint_xfer_sync(struct hw_endpoint *ep)
+{
+  _hw_endpoint_lock_update(ep, 1);
+  if (!ep->active)
+  {
+    panic("Can't sync xfer on inactive ep %d %s", tu_edpt_number(ep->ep_addr), ep_dir_string[tu_edpt_dir(ep->ep_addr)]);
+  }
 
-      _hw_endpoint_buffer_control_set_value32(ep, 0);
+  _hw_endpoint_xfer_sync(ep);
+  _hw_endpoint_lock_update(ep, -1);
 
-      usb_hw->abort &= ~TU_BIT(ep_id);
+  return ep->remaining_len == 0;
+}
 
-      TU_LOG(3, "----SHORT PACKET buffer0 on EP %02X:\r\n", ep->ep_addr);
-      TU_LOG(3, "  BufCtrl: [0] = 0x%04u  [1] = 0x%04x\r\n", tu_u32_low16(buf_ctrl), tu_u32_high16(buf_ctrl));
-#endif
+// Transfer is stopped before its buffers complete e.g while retrying on NAK. Buffers still available are given
+// back (length, data toggle and OUT data), completed ones are synced. Returns true if transfer is complete
+bool hw_endpoint_xfer_rewind(struct hw_endpoint *ep)
+{
+  _hw_endpoint_lock_update(ep, 1);
+
+  uint32_t const buf_ctrl   = _hw_endpoint_buffer_control_get_value32(ep);
+  uint8_t  const buf_count  = ((*ep->endpoint_control) & EP_CTRL_DOUBLE_BUFFERED_BITS) ? 2 : 1;
+
+  // give back first so that a short packet on a completed buffer still ends the transfer
+  for(uint8_t buf_id = 0; buf_id < buf_count; buf_id++)
+  {
+    uint32_t const bc = buf_id ? (buf_ctrl >> 16) : buf_ctrl;
+    if ( bc & USB_BUF_CTRL_AVAIL )
+    {
+      uint16_t const buflen = bc & USB_BUF_CTRL_LEN_MASK;
+      ep->remaining_len += buflen;
+      if ( !ep->rx ) ep->user_buf -= buflen;
+      ep->next_pid ^= 1u;
     }
   }
+
+  for(uint8_t buf_id = 0; buf_id < buf_count; buf_id++)
+  {
+    uint32_t const bc = buf_id ? (buf_ctrl >> 16) : buf_ctrl;
+    if ( !(bc & USB_BUF_CTRL_AVAIL) && sync_ep_buffer(ep, buf_id) < ep->wMaxPacketSize ) break;
+  }
+
+  _hw_endpoint_buffer_control_set_value32(ep, 0);
+  _hw_endpoint_lock_update(ep, -1);
+
+  return ep->remaining_len == 0;
 }
+#endif
 
 // Returns true if transfer is complete
 bool hw_endpoint_xfer_continue(struct hw_endpoint *ep)
 {
   _hw_endpoint_lock_update(ep, 1);
+
+#if TUSB_OPT_DEVICE_ENABLED
+  // Buffer status of OUT packet kept for next transfer
+  if (!ep->active)
+  {
+    _hw_endpoint_lock_update(ep, -1);
+    return false;
+  }
+
+  bool const done = dev_xfer_sync(ep);
+  if (done)
+  {
+    pico_trace("Completed transfer of %d bytes on ep %d %s\n",
+               ep->xferred_len, tu_edpt_number(ep->ep_addr), ep_dir_string[tu_edpt_dir(ep->ep_addr)]);
+  }
+
+  _hw_endpoint_lock_update(ep, -1);
+  return done;
+#else
   // Part way through a transfer
   if (!ep->active)
   {
@@ -322,6 +553,7 @@ bool hw_endpoint_xfer_continue(struct hw_endpoint *ep)
   _hw_endpoint_lock_update(ep, -1);
   // More work to do
   return false;
+#endif
 }
 
 #endif
@@ -44,8 +44,8 @@ typedef struct hw_endpoint
 
     // Current transfer information
     bool active;
-    uint16_t remaining_len;
-    uint16_t xferred_len;
+    uint32_t remaining_len;
+    uint32_t xferred_len;
 
     // User buffer in main memory
     uint8_t *user_buf;
@@ -65,15 +65,37 @@ typedef struct hw_endpoint
 
     // Set to true to force the LAST_BUFF flag to true in the next xfer request
     bool force_last_buff;
+
+    // Shared epx: packets left in the current turn, LAST_BUFF is set on the buffer ending it. 0 for no limit
+    uint16_t turn_packets;
+#endif
+
+#if TUSB_OPT_DEVICE_ENABLED
+    uint32_t total_len;
+
+    // Buffer to complete next and buffers armed (bit per buffer). An OUT buffer still armed
+    // when its transfer is complete has received the first packet of the next one
+    uint8_t next_buf_id;
+    uint8_t buf_armed;
 #endif
 } hw_endpoint_t;
 
 void rp2040_usb_init(void);
 
-void hw_endpoint_xfer_start(struct hw_endpoint *ep, uint8_t *buffer, uint16_t total_len);
+// Returns true if transfer is complete already (device OUT packet received before it is started)
+bool hw_endpoint_xfer_start(struct hw_endpoint *ep, uint8_t *buffer, uint32_t total_len);
 bool hw_endpoint_xfer_continue(struct hw_endpoint *ep);
 void hw_endpoint_reset_transfer(struct hw_endpoint *ep);
 
+#if TUSB_OPT_HOST_ENABLED
+// Host epx is shared among endpoints: transfer is set up without arming buffers, then it is
+// resumed (buffers armed) and synced turn by turn. A turn stopped before its buffers complete is rewound.
+void hw_endpoint_xfer_setup(struct hw_endpoint *ep, uint8_t *buffer, uint32_t total_len);
+void hw_endpoint_xfer_resume(struct hw_endpoint *ep);
+bool hw_endpoint_xfer_sync(struct hw_endpoint *ep);
+bool hw_endpoint_xfer_rewind(struct hw_endpoint *ep);
+#endif
+
 void _hw_endpoint_buffer_control_update32(struct hw_endpoint *ep, uint32_t and_mask, uint32_t or_mask);
 static inline uint32_t _hw_endpoint_buffer_control_get_value32(struct hw_endpoint *ep) {
     return *ep->buffer_control;
@@ -88,6 +110,20 @@ static inline void _hw_endpoint_buffer_control_clear_mask32(struct hw_endpoint *
     return _hw_endpoint_buffer_control_update32(ep, ~value, 0);
 }
 
+// Buffer control: buffer 1 offset of double buffered isochronous endpoint is 128 << value
+#define BUF_CTRL_ISO_OFFSET_LSB  27u
+
+// Offset of buffer 1 from buffer 0 of double buffered endpoint: isochronous one is 128, 256, 512 or 1024
+// bytes to fit its max packet size, others are 64 bytes apart
+static inline uint16_t hw_endpoint_buf1_offset(struct hw_endpoint const *ep)
+{
+    if (ep->transfer_type != TUSB_XFER_ISOCHRONOUS) return 64;
+
+    uint16_t offset = 128;
+    while (offset < ep->wMaxPacketSize) offset <<= 1;
+    return offset;
+}
+
 static inline uintptr_t hw_data_offset(uint8_t *buf)
 {
     // Remove usb base from buffer pointer
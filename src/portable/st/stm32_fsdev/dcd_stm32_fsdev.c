@@ -71,7 +71,8 @@
  * - Packet buffer memory is copied in the interrupt.
  *   - This is better for performance, but means interrupts are disabled for longer
  *   - DMA may be the best choice, but it could also be pushed to the USBD task.
- * - No double-buffering
+ * - Double-buffering only for bulk endpoints whose number is not used by the other direction,
+ *   and only when the configuration is planned by dcd_edpt_plan()
  * - No DMA
  * - Minimal error handling
  *   - Perhaps error interrupts should be reported to the stack, or cause a device reset?
@@ -96,9 +97,9 @@
  * - Tiny (saves RAM, assumes a single USB peripheral)
  *
  * Notes:
- * - The buffer table is allocated as endpoints are opened. The allocation is only
- *   cleared when the device is reset. This may be bad if the USB device needs
- *   to be reconfigured.
+ * - Packet buffers of a configuration are planned by dcd_edpt_plan() from its descriptor, with the
+ *   largest packet size among alternate settings. Without a plan (or if it does not fit), they are
+ *   allocated as endpoints are opened. Either way they are freed when all endpoints are closed.
  */
 
 #include "tusb_option.h"
@@ -142,10 +143,10 @@
 #  define DCD_STM32_BTABLE_LENGTH (PMA_LENGTH - DCD_STM32_BTABLE_BASE)
 #endif
 
-// Since TinyUSB doesn't use SOF for now, and this interrupt too often (1ms interval)
-// We disable SOF for now until needed later on
-#ifndef USE_SOF
-#  define USE_SOF     0
+// Bulk endpoint used in a single direction is double buffered when its configuration is planned:
+// hardware moves a packet with one buffer while the other one is copied in the interrupt
+#ifndef DCD_STM32_DOUBLE_BUFFER
+#  define DCD_STM32_DOUBLE_BUFFER 1
 #endif
 
 /***************************************************
@@ -168,7 +169,9 @@ typedef struct
   uint16_t queued_len;
   uint16_t pma_ptr;
   uint8_t max_packet_size;
-  uint8_t pma_alloc_size;
+  uint8_t pma_alloc_size; // double buffered: size of each buffer, buffer 1 follows buffer 0
+  bool dbl_buf;
+  bool dbl_queued;        // IN: next packet is in the buffer owned by the driver
 } xfer_ctl_t;
 
 static xfer_ctl_t xfer_status[MAX_EP_COUNT][2];
@@ -185,12 +188,15 @@ static uint8_t remoteWakeCountdown; // When wake is requested
 // into the stack.
 static void dcd_handle_bus_reset(void);
 static void dcd_transmit_packet(xfer_ctl_t * xfer, uint16_t ep_ix);
+static void dcd_transmit_packet_dbl(xfer_ctl_t * xfer, uint16_t ep_ix, uint32_t buf_id);
 static void dcd_ep_ctr_handler(void);
 
 // PMA allocation/access 
 static uint8_t open_ep_count;
 static uint16_t ep_buf_ptr; ///< Points to first free memory location
+static bool pma_planned;    ///< Buffers of current configuration are set by dcd_edpt_plan()
 static void dcd_pma_alloc_reset(void);
+static void dcd_pma_free_config(void);
 static uint16_t dcd_pma_alloc(uint8_t ep_addr, size_t length);
 static void dcd_pma_free(uint8_t ep_addr);
 static bool dcd_write_packet_memory(uint16_t dst, const void *__restrict src, size_t wNBytes);
@@ -247,7 +253,8 @@ void dcd_init (uint8_t rhport)
     pcd_set_endpoint(USB,i,0u);
   }
 
-  USB->CNTR |= USB_CNTR_RESETM | (USE_SOF ? USB_CNTR_SOFM : 0) | USB_CNTR_ESOFM | USB_CNTR_CTRM | USB_CNTR_SUSPM | USB_CNTR_WKUPM;
+  // SOF interrupt occurs too often (1ms interval), it stays disabled until the stack enables it with dcd_sof_enable()
+  USB->CNTR |= USB_CNTR_RESETM | USB_CNTR_ESOFM | USB_CNTR_CTRM | USB_CNTR_SUSPM | USB_CNTR_WKUPM;
   dcd_handle_bus_reset();
   
   // Enable pull-up if supported
@@ -390,6 +397,19 @@ void dcd_set_address(uint8_t rhport, uint8_t dev_addr)
   // do it at dcd_edpt0_status_complete()
 }
 
+void dcd_sof_enable(uint8_t rhport, bool en)
+{
+  (void) rhport;
+
+  if ( en )
+  {
+    USB->CNTR |= (uint16_t) USB_CNTR_SOFM;
+  }else
+  {
+    USB->CNTR &= (uint16_t) ~USB_CNTR_SOFM;
+  }
+}
+
 void dcd_remote_wakeup(uint8_t rhport)
 {
   (void) rhport;
@@ -457,14 +477,31 @@ static void dcd_ep_ctr_tx_handler(uint32_t wIstr)
   pcd_clear_tx_ep_ctr(USB, EPindex);
 
   xfer_ctl_t * xfer = xfer_ctl_ptr(EPindex,TUSB_DIR_IN);
-  if((xfer->total_len != xfer->queued_len)) /* TX not complete */
+  if(xfer->dbl_buf)
   {
-      dcd_transmit_packet(xfer, EPindex);
+    if(xfer->dbl_queued) /* TX not complete */
+    {
+      // Packet written meanwhile is handed to hardware first, then the next one is written to
+      // the buffer just sent, which DTOG_TX has left.
+      uint32_t const buf_id = (wEPRegVal & USB_EP_DTOG_TX) ? 0U : 1U;
+      pcd_free_user_buffer(USB, EPindex, TUSB_DIR_IN);
+      xfer->dbl_queued = false;
+
+      if(xfer->total_len != xfer->queued_len)
+      {
+        dcd_transmit_packet_dbl(xfer, EPindex, buf_id);
+      }
+      return;
+    }
   }
-  else /* TX Complete */
+  else if((xfer->total_len != xfer->queued_len)) /* TX not complete */
   {
-    dcd_event_xfer_complete(0, (uint8_t)(0x80 + EPindex), xfer->total_len, XFER_RESULT_SUCCESS, true);
+    dcd_transmit_packet(xfer, EPindex);
+    return;
   }
+
+  /* TX Complete */
+  dcd_event_xfer_complete(0, (uint8_t)(0x80 + EPindex), xfer->total_len, XFER_RESULT_SUCCESS, true);
 }
 
 // Handle CTR interrupt for the RX/OUT direction
@@ -500,6 +537,35 @@ static void dcd_ep_ctr_rx_handler(uint32_t wIstr)
       dcd_event_setup_received(0, (uint8_t*)userMemBuf, true);
     }
   }
+  else if(xfer->dbl_buf)
+  {
+    // Buffer filled by hardware is the one DTOG_RX has left
+    uint32_t const buf_id = (wEPRegVal & USB_EP_DTOG_RX) ? 0U : 1U;
+    uint32_t const remaining = (uint32_t)xfer->total_len - (uint32_t)xfer->queued_len;
+    count = pcd_get_ep_dbuf_cnt(USB, EPindex, buf_id);
+
+    pcd_clear_rx_ep_ctr(USB, EPindex);
+
+    // The other buffer is handed to hardware before this one is read, unless the transfer
+    // ends with this packet: endpoint then NAKs until next transfer.
+    bool const complete = (count < xfer->max_packet_size) || (count >= remaining);
+    if(!complete)
+    {
+      pcd_free_user_buffer(USB, EPindex, TUSB_DIR_OUT);
+    }
+
+    count = tu_min32(count, remaining);
+    if (count != 0U)
+    {
+      dcd_read_packet_memory(&(xfer->buffer[xfer->queued_len]), *pcd_ep_dbuf_addr_ptr(USB, EPindex, buf_id), count);
+      xfer->queued_len = (uint16_t)(xfer->queued_len + count);
+    }
+
+    if(complete)
+    {
+      dcd_event_xfer_complete(0, EPindex, xfer->queued_len, XFER_RESULT_SUCCESS, true);
+    }
+  }
   else
   {
     // Clear RX CTR interrupt flag
@@ -623,12 +689,11 @@ void dcd_int_handler(uint8_t rhport) {
     dcd_event_bus_signal(0, DCD_EVENT_SUSPEND, true);
   }
 
-#if USE_SOF
-  if(int_status & USB_ISTR_SOF) {
+  // SOF flag is set regardless of the interrupt mask
+  if((int_status & USB_ISTR_SOF) && (USB->CNTR & USB_CNTR_SOFM)) {
     clear_istr_bits(USB_ISTR_SOF);
-    dcd_event_bus_signal(0, DCD_EVENT_SOF, true);
+    dcd_event_sof(0, USB->FNR & USB_FNR_FN, false, true);
   }
-#endif 
 
   if(int_status & USB_ISTR_ESOF) {
     if(remoteWakeCountdown == 1u)
@@ -665,16 +730,50 @@ void dcd_edpt0_status_complete(uint8_t rhport, tusb_control_request_t const * re
   }
 }
 
+// Size of packet buffer: RX count register counts 2-byte blocks up to 62 bytes, 32-byte blocks
+// above. TX buffers are rounded the same so that all buffers are 16-bit aligned.
+static inline uint16_t dcd_pma_buf_size(uint16_t packet_size)
+{
+  return (uint16_t) ((packet_size > 62U) ? tu_align(packet_size + 31U, 32U) : tu_align(packet_size + 1U, 2U));
+}
+
 static void dcd_pma_alloc_reset(void)
 {
   ep_buf_ptr = DCD_STM32_BTABLE_BASE + 8*MAX_EP_COUNT; // 8 bytes per endpoint (two TX and two RX words, each)
+  open_ep_count = 0;
+  pma_planned = false;
   //TU_LOG2("dcd_pma_alloc_reset()\r\n");
   for(uint32_t i=0; i<MAX_EP_COUNT; i++)
   {
-    xfer_ctl_ptr(i,TUSB_DIR_OUT)->pma_alloc_size = 0U;
-    xfer_ctl_ptr(i,TUSB_DIR_IN)->pma_alloc_size = 0U;
-    xfer_ctl_ptr(i,TUSB_DIR_OUT)->pma_ptr = 0U;
-    xfer_ctl_ptr(i,TUSB_DIR_IN)->pma_ptr = 0U;
+    for(uint32_t dir=0; dir<2; dir++)
+    {
+      xfer_ctl_t* xfer = xfer_ctl_ptr(i,dir);
+      xfer->max_packet_size = 0U;
+      xfer->pma_alloc_size = 0U;
+      xfer->pma_ptr = 0U;
+      xfer->dbl_buf = false;
+    }
+  }
+}
+
+// Free PMA of all endpoints but EP0, whose buffers follow the buffer table
+static void dcd_pma_free_config(void)
+{
+  ep_buf_ptr = DCD_STM32_BTABLE_BASE + 8*MAX_EP_COUNT + 2*CFG_TUD_ENDPOINT0_SIZE; // 8 bytes per endpoint (two TX and two RX words, each), and EP0
+  open_ep_count = 2;
+  pma_planned = false;
+
+  // Skip EP0
+  for(uint32_t i=1; i<MAX_EP_COUNT; i++)
+  {
+    for(uint32_t dir=0; dir<2; dir++)
+    {
+      xfer_ctl_t* xfer = xfer_ctl_ptr(i,dir);
+      xfer->max_packet_size = 0U;
+      xfer->pma_alloc_size = 0U;
+      xfer->pma_ptr = 0U;
+      xfer->dbl_buf = false;
+    }
   }
 }
 
@@ -701,14 +800,16 @@ static uint16_t dcd_pma_alloc(uint8_t ep_addr, size_t length)
     return epXferCtl->pma_ptr;
   }
   
+  length = dcd_pma_buf_size((uint16_t) length);
+
+  // Verify no overflow
+  TU_ASSERT(ep_buf_ptr + length <= DCD_STM32_BTABLE_BASE + DCD_STM32_BTABLE_LENGTH, 0xFFFF);
+
   uint16_t addr = ep_buf_ptr; 
   ep_buf_ptr = (uint16_t)(ep_buf_ptr + length); // increment buffer pointer
   
-  // Verify no overflow
-  TU_ASSERT(ep_buf_ptr <= PMA_LENGTH, 0xFFFF);
-  
   epXferCtl->pma_ptr = addr;
-  epXferCtl->pma_alloc_size = length;
+  epXferCtl->pma_alloc_size = (uint8_t) length;
   //TU_LOG2("dcd_pma_alloc(%x,%x)=%x\r\n",ep_addr,length,addr);
 
   return addr;
@@ -721,27 +822,106 @@ static void dcd_pma_free(uint8_t ep_addr)
 {
   uint8_t const epnum = tu_edpt_number(ep_addr);
   uint8_t const dir   = tu_edpt_dir(ep_addr);
+  xfer_ctl_t* epXferCtl = xfer_ctl_ptr(epnum,dir);
 
   // Presently, this should never be called for EP0 IN/OUT
   TU_ASSERT(open_ep_count > 2, /**/);
-  TU_ASSERT(xfer_ctl_ptr(epnum,dir)->max_packet_size != 0, /**/);
+  TU_ASSERT(epXferCtl->max_packet_size != 0, /**/);
   open_ep_count--;
+  epXferCtl->max_packet_size = 0;
 
   // If count is 2, only EP0 should be open, so allocations can be mostly reset.
+  // Planned buffers are kept for other alternate settings until all endpoints are closed.
+  if(open_ep_count == 2 && !pma_planned)
+  {
+    dcd_pma_free_config();
+  }
+}
+
+// Plan PMA for the whole configuration: each endpoint gets a fixed buffer sized for its largest
+// packet over all alternate settings. Room left gives a second buffer to bulk endpoints whose
+// number is not used by the other direction (lowest numbers first): they are double buffered.
+// If configuration does not fit, buffers are allocated as endpoints are opened.
+void dcd_edpt_plan(uint8_t rhport, tusb_desc_configuration_t const * desc_cfg)
+{
+  (void) rhport;
 
-  if(open_ep_count == 2)
+  // Only when no other endpoint than EP0 has a buffer i.e after bus reset or closing all endpoints
+  TU_VERIFY(open_ep_count == 2, );
+  dcd_pma_free_config();
+
+  uint16_t size[MAX_EP_COUNT][2] = { { 0 } };
+  bool non_bulk[MAX_EP_COUNT][2] = { { false } };
+
+  uint8_t const * p_desc   = ((uint8_t const*) desc_cfg) + sizeof(tusb_desc_configuration_t);
+  uint8_t const * desc_end = ((uint8_t const*) desc_cfg) + tu_le16toh(desc_cfg->wTotalLength);
+
+  while( p_desc < desc_end )
   {
-    ep_buf_ptr = DCD_STM32_BTABLE_BASE + 8*MAX_EP_COUNT + 2*CFG_TUD_ENDPOINT0_SIZE; // 8 bytes per endpoint (two TX and two RX words, each), and EP0
+    if ( TUSB_DESC_ENDPOINT == tu_desc_type(p_desc) )
+    {
+      tusb_desc_endpoint_t const * desc_ep = (tusb_desc_endpoint_t const *) p_desc;
+      uint8_t const epnum = tu_edpt_number(desc_ep->bEndpointAddress);
+      uint8_t const dir   = tu_edpt_dir(desc_ep->bEndpointAddress);
 
-    // Skip EP0
-    for(uint32_t i=1; i<MAX_EP_COUNT; i++)
+      // endpoint could not be opened anyway
+      TU_VERIFY(epnum > 0 && epnum < MAX_EP_COUNT, );
+      TU_VERIFY(desc_ep->bmAttributes.xfer != TUSB_XFER_ISOCHRONOUS, );
+      TU_VERIFY(tu_edpt_packet_size(desc_ep) <= 64, );
+
+      size[epnum][dir] = tu_max16(size[epnum][dir], dcd_pma_buf_size(tu_edpt_packet_size(desc_ep)));
+      if ( desc_ep->bmAttributes.xfer != TUSB_XFER_BULK ) non_bulk[epnum][dir] = true;
+    }
+
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  uint32_t const total = DCD_STM32_BTABLE_BASE + DCD_STM32_BTABLE_LENGTH - ep_buf_ptr;
+  uint32_t used = 0;
+  bool dbl_buf[MAX_EP_COUNT][2] = { { false } };
+
+  for ( uint32_t n = 1; n < MAX_EP_COUNT; n++ )
+  {
+    used += size[n][TUSB_DIR_OUT] + size[n][TUSB_DIR_IN];
+  }
+
+  if ( used > total )
+  {
+    TU_LOG2("    PMA is too small to plan configuration: %u bytes needed\r\n", (unsigned) used);
+    return;
+  }
+
+#if DCD_STM32_DOUBLE_BUFFER
+  for ( uint32_t n = 1; n < MAX_EP_COUNT; n++ )
+  {
+    for ( uint32_t dir = 0; dir < 2; dir++ )
     {
-      xfer_ctl_ptr(i,TUSB_DIR_OUT)->pma_alloc_size = 0U;
-      xfer_ctl_ptr(i,TUSB_DIR_IN)->pma_alloc_size = 0U;
-      xfer_ctl_ptr(i,TUSB_DIR_OUT)->pma_ptr = 0U;
-      xfer_ctl_ptr(i,TUSB_DIR_IN)->pma_ptr = 0U;
+      if ( size[n][dir] && !non_bulk[n][dir] && !size[n][dir ^ 1] && used + size[n][dir] <= total )
+      {
+        dbl_buf[n][dir] = true;
+        used += size[n][dir];
+      }
     }
   }
+#endif
+
+  // Buffers follow those of EP0 in endpoint order
+  for ( uint32_t n = 1; n < MAX_EP_COUNT; n++ )
+  {
+    for ( uint32_t dir = 0; dir < 2; dir++ )
+    {
+      if ( !size[n][dir] ) continue;
+
+      xfer_ctl_t* xfer = xfer_ctl_ptr(n, dir);
+      xfer->pma_ptr        = ep_buf_ptr;
+      xfer->pma_alloc_size = (uint8_t) size[n][dir];
+      xfer->dbl_buf        = dbl_buf[n][dir];
+
+      ep_buf_ptr = (uint16_t) (ep_buf_ptr + size[n][dir] * (dbl_buf[n][dir] ? 2U : 1U));
+    }
+  }
+
+  pma_planned = true;
 }
 
 // The STM32F0 doesn't seem to like |= or &= to manipulate the EP#R registers,
@@ -755,6 +935,7 @@ bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * p_endpoint_desc
   const uint16_t epMaxPktSize = tu_edpt_packet_size(p_endpoint_desc);
   uint16_t pma_addr;
   uint32_t wType;
+  xfer_ctl_t * xfer = xfer_ctl_ptr(epnum, dir);
   
   // Isochronous not supported (yet), and some other driver assumptions.
   TU_ASSERT(p_endpoint_desc->bmAttributes.xfer != TUSB_XFER_ISOCHRONOUS);
@@ -772,7 +953,8 @@ bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * p_endpoint_desc
 #endif
 
   case TUSB_XFER_BULK:
-    wType = USB_EP_CONTROL;
+    // Double buffered endpoint must have bulk type, single buffered one runs as control type
+    wType = xfer->dbl_buf ? USB_EP_BULK : USB_EP_CONTROL;
     break;
 
   case TUSB_XFER_INTERRUPT:
@@ -785,13 +967,37 @@ bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * p_endpoint_desc
 
   pcd_set_eptype(USB, epnum, wType);
   pcd_set_ep_address(USB, epnum, epnum);
-  // Be normal, for now, instead of only accepting zero-byte packets (on control endpoint)
-  // or being double-buffered (bulk endpoints)
-  pcd_clear_ep_kind(USB,0);
 
   pma_addr = dcd_pma_alloc(p_endpoint_desc->bEndpointAddress, epMaxPktSize);
+  TU_ASSERT(pma_addr != 0xFFFF);
 
-  if(dir == TUSB_DIR_IN)
+  if(xfer->dbl_buf)
+  {
+    // EP_KIND is DBL_BUF: buffer 0 is described by TX entries of the buffer table, buffer 1 by RX
+    // ones. DTOG of the direction selects the buffer used by hardware next (and data PID), the
+    // other DTOG is SW_BUF. Both are cleared: while they are equal, both buffers are owned by the
+    // driver and hardware NAKs. The other direction of the endpoint is not used.
+    pcd_set_ep_kind(USB, epnum);
+    *pcd_ep_dbuf_addr_ptr(USB, epnum, 0) = pma_addr;
+    *pcd_ep_dbuf_addr_ptr(USB, epnum, 1) = (uint16_t) (pma_addr + xfer->pma_alloc_size);
+    pcd_clear_rx_dtog(USB, epnum);
+    pcd_clear_tx_dtog(USB, epnum);
+    xfer->dbl_queued = false;
+
+    if(dir == TUSB_DIR_IN)
+    {
+      pcd_set_ep_rx_status(USB, epnum, USB_EP_RX_DIS);
+      pcd_set_ep_tx_status(USB, epnum, USB_EP_TX_VALID);
+    }
+    else
+    {
+      pcd_set_ep_cnt_rx_reg(pcd_ep_dbuf_cnt_ptr(USB, epnum, 0), epMaxPktSize);
+      pcd_set_ep_cnt_rx_reg(pcd_ep_dbuf_cnt_ptr(USB, epnum, 1), epMaxPktSize);
+      pcd_set_ep_tx_status(USB, epnum, USB_EP_TX_DIS);
+      pcd_set_ep_rx_status(USB, epnum, USB_EP_RX_VALID);
+    }
+  }
+  else if(dir == TUSB_DIR_IN)
   {
     *pcd_ep_tx_address_ptr(USB, epnum) = pma_addr;
     pcd_set_ep_tx_cnt(USB, epnum, epMaxPktSize);
@@ -806,15 +1012,36 @@ bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * p_endpoint_desc
     pcd_set_ep_rx_status(USB, epnum, USB_EP_RX_NAK);
   }
 
-  xfer_ctl_ptr(epnum, dir)->max_packet_size = epMaxPktSize;
+  if(!xfer->dbl_buf)
+  {
+    // Be normal, instead of only accepting zero-byte packets (on control endpoint)
+    pcd_clear_ep_kind(USB, epnum);
+  }
+
+  if(xfer->max_packet_size == 0)
+  {
+    open_ep_count++;
+  }
+  xfer->max_packet_size = epMaxPktSize;
 
   return true;
 }
 
+// Close all non-control endpoints, cancel all pending transfers if any.
 void dcd_edpt_close_all (uint8_t rhport)
 {
   (void) rhport;
-  // TODO implement dcd_edpt_close_all()
+
+  for(uint32_t i=1; i<MAX_EP_COUNT; i++)
+  {
+    pcd_set_ep_tx_status(USB, i, USB_EP_TX_DIS);
+    pcd_set_ep_rx_status(USB, i, USB_EP_RX_DIS);
+    pcd_clear_tx_ep_ctr(USB, i);
+    pcd_clear_rx_ep_ctr(USB, i);
+  }
+
+  // Buffers of the configuration are freed, planned or not
+  dcd_pma_free_config();
 }
 
 /**
@@ -870,6 +1097,24 @@ static void dcd_transmit_packet(xfer_ctl_t * xfer, uint16_t ep_ix)
   pcd_set_ep_tx_status(USB, ep_ix, USB_EP_TX_VALID);
 }
 
+// Double buffered: write next packet to a buffer owned by the driver. It is handed to hardware
+// by toggling SW_BUF once the other buffer is sent.
+static void dcd_transmit_packet_dbl(xfer_ctl_t * xfer, uint16_t ep_ix, uint32_t buf_id)
+{
+  uint16_t len = (uint16_t)(xfer->total_len - xfer->queued_len);
+
+  if(len > xfer->max_packet_size)
+  {
+    len = xfer->max_packet_size;
+  }
+
+  dcd_write_packet_memory(*pcd_ep_dbuf_addr_ptr(USB, ep_ix, buf_id), &(xfer->buffer[xfer->queued_len]), len);
+  xfer->queued_len = (uint16_t)(xfer->queued_len + len);
+
+  *pcd_ep_dbuf_cnt_ptr(USB, ep_ix, buf_id) = len;
+  xfer->dbl_queued = true;
+}
+
 bool dcd_edpt_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes)
 {
   (void) rhport;
@@ -892,6 +1137,13 @@ bool dcd_edpt_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t
     {
         xfer->buffer = (uint8_t*)_setup_packet;
     }
+    if(xfer->dbl_buf)
+    {
+      // Endpoint is idle with both buffers owned by the driver: one is handed to hardware, the
+      // other one as the first packet is received
+      pcd_free_user_buffer(USB, epnum, TUSB_DIR_OUT);
+      return true;
+    }
     if(total_bytes > xfer->max_packet_size)
     {
       pcd_set_ep_rx_cnt(USB,epnum,xfer->max_packet_size);
@@ -900,6 +1152,19 @@ bool dcd_edpt_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t
     }
     pcd_set_ep_rx_status(USB, epnum, USB_EP_RX_VALID);
   }
+  else if(xfer->dbl_buf) // IN
+  {
+    // Endpoint is idle with both buffers owned by the driver: first packet goes to the buffer
+    // hardware sends next, second one (if any) to the other buffer before the first is handed.
+    uint32_t const buf_id = (pcd_get_endpoint(USB, epnum) & USB_EP_DTOG_TX) ? 1U : 0U;
+    dcd_transmit_packet_dbl(xfer, epnum, buf_id);
+    xfer->dbl_queued = false;
+    if(xfer->total_len != xfer->queued_len)
+    {
+      dcd_transmit_packet_dbl(xfer, epnum, buf_id ^ 1U);
+    }
+    pcd_free_user_buffer(USB, epnum, TUSB_DIR_IN);
+  }
   else // IN
   {
     dcd_transmit_packet(xfer,epnum);
@@ -958,7 +1223,27 @@ void dcd_edpt_clear_stall (uint8_t rhport, uint8_t ep_addr)
 {
   (void)rhport;
 
-  if (ep_addr & 0x80)
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  uint8_t const dir   = tu_edpt_dir(ep_addr);
+  xfer_ctl_t * xfer = xfer_ctl_ptr(epnum, dir);
+
+  if (xfer->dbl_buf)
+  {
+    /* Reset to DATA0 with SW_BUF: both buffers are owned by the driver, endpoint NAKs */
+    pcd_clear_tx_dtog(USB,epnum);
+    pcd_clear_rx_dtog(USB,epnum);
+    xfer->dbl_queued = false;
+
+    if (dir == TUSB_DIR_IN)
+    {
+      pcd_set_ep_tx_status(USB,epnum, USB_EP_TX_VALID);
+    }
+    else
+    {
+      pcd_set_ep_rx_status(USB,epnum, USB_EP_RX_VALID);
+    }
+  }
+  else if (ep_addr & 0x80)
   { // IN
     ep_addr &= 0x7F;
 
@@ -399,6 +399,48 @@ static inline void pcd_clear_ep_kind(USB_TypeDef * USBx, uint32_t bEpNum)
   pcd_set_endpoint(USBx, bEpNum, regVal);
 }
 
+/**
+  * @brief  Buffer of double buffered endpoint: buffer 0 is described by the TX address and count
+  *         of the buffer table entry, buffer 1 by the RX ones.
+  * @param  USBx USB peripheral instance register address.
+  * @param  bEpNum Endpoint Number.
+  * @param  bBufId Buffer 0 or 1.
+  */
+static inline __IO uint16_t* pcd_ep_dbuf_addr_ptr(USB_TypeDef * USBx, uint32_t bEpNum, uint32_t bBufId)
+{
+  return bBufId ? pcd_ep_rx_address_ptr(USBx, bEpNum) : pcd_ep_tx_address_ptr(USBx, bEpNum);
+}
+
+static inline __IO uint16_t* pcd_ep_dbuf_cnt_ptr(USB_TypeDef * USBx, uint32_t bEpNum, uint32_t bBufId)
+{
+  return bBufId ? pcd_ep_rx_cnt_ptr(USBx, bEpNum) : pcd_ep_tx_cnt_ptr(USBx, bEpNum);
+}
+
+static inline uint32_t pcd_get_ep_dbuf_cnt(USB_TypeDef * USBx, uint32_t bEpNum, uint32_t bBufId)
+{
+  return *pcd_ep_dbuf_cnt_ptr(USBx, bEpNum, bBufId) & 0x3ffU;
+}
+
+/**
+  * @brief  Toggles SW_BUF of double buffered endpoint, handing a buffer to hardware:
+  *         SW_BUF is DTOG_TX of an OUT endpoint, DTOG_RX of an IN endpoint.
+  * @param  USBx USB peripheral instance register address.
+  * @param  bEpNum Endpoint Number.
+  * @param  bDir Endpoint direction, 0 for OUT.
+  * @retval None
+  */
+static inline void pcd_free_user_buffer(USB_TypeDef * USBx, uint32_t bEpNum, uint32_t bDir)
+{
+  if(bDir == 0u)
+  {
+    pcd_tx_dtog(USBx, bEpNum);
+  }
+  else
+  {
+    pcd_rx_dtog(USBx, bEpNum);
+  }
+}
+
 // This checks if the device has "LPM"
 #if defined(USB_ISTR_L1REQ)
 #define USB_ISTR_L1REQ_FORCED (USB_ISTR_L1REQ)
@@ -38,6 +38,7 @@
 
 #include "device/dcd.h"
 #include "dwc2_type.h"
+#include "dwc2_api.h"
 
 #if defined(DCD_ATTR_DWC2_STM32)
   #include "dwc2_stm32.h"
@@ -77,8 +78,41 @@
 #define dcache_clean_invalidate(_addr, _size)
 #endif
 
+// DMA mode: this one or the best below it that core supports (GHWCFG2 arch, GHWCFG4 dma_desc_enable) is used
+// - DWC2_DMA_SLAVE : CPU moves data through FIFO on RX FIFO level and TX FIFO empty interrupts
+// - DWC2_DMA_BUFFER: core moves data of transfer between memory and FIFO on its own
+// - DWC2_DMA_DESC  : scatter/gather, IN transfer split by FIFO wrap around is chained in a descriptor list
+// With DMA, transfer buffers and FIFOs must be in DMA accessible memory. Data that is not 4-byte aligned or wraps
+// around within a packet goes through a bounce buffer, one packet at a time. Core writes whole OUT packets, the
+// last one of an OUT transfer which is not a multiple of endpoint size is received in bounce buffer as well.
+#define DWC2_DMA_SLAVE    0
+#define DWC2_DMA_BUFFER   1
+#define DWC2_DMA_DESC     2
+
+#ifndef CFG_TUD_DWC2_DMA
+#define CFG_TUD_DWC2_DMA  DWC2_DMA_SLAVE
+#endif
+
+#if CFG_TUD_DWC2_DMA
+// Bounce buffers, one is taken by a transfer that needs it until it completes
+#ifndef CFG_TUD_DWC2_DMA_BOUNCE_NUM
+#define CFG_TUD_DWC2_DMA_BOUNCE_NUM   2
+#endif
+
+#ifndef CFG_TUD_DWC2_DMA_BOUNCE_SIZE
+#define CFG_TUD_DWC2_DMA_BOUNCE_SIZE  1024
+#endif
+#endif
 
-static TU_ATTR_ALIGNED(4) uint32_t _setup_packet[2];
+// TX FIFO of IN endpoint holds up to this many packets when configuration leaves room in FIFO RAM,
+// so that core has the next packet ready while the one sent is being refilled. Double buffering
+// gets most of the throughput, deeper FIFOs only help when the core fills them much slower than USB drains them
+#ifndef CFG_TUD_DWC2_FIFO_TX_PACKETS
+#define CFG_TUD_DWC2_FIFO_TX_PACKETS  2
+#endif
+
+// With buffer DMA, back to back setup packets are written one after another
+static TU_ATTR_ALIGNED(4) uint32_t _setup_packet[CFG_TUD_DWC2_DMA ? 6 : 2];
 
 typedef struct {
   uint8_t * buffer;
@@ -86,6 +120,14 @@ typedef struct {
   uint16_t total_len;
   uint16_t max_size;
   uint8_t interval;
+
+#if CFG_TUD_DWC2_DMA
+  tu_fifo_buffer_info_t dma_data;   // linear buffer or the two parts of FIFO
+  uint8_t * dma_bounce;             // bounce buffer taken by transfer
+  uint8_t * dma_out_addr;           // memory of OUT chunk in progress
+  uint16_t dma_offset;              // transferred bytes
+  uint16_t dma_len;                 // bytes of chunks in progress
+#endif
 } xfer_ctl_t;
 
 static xfer_ctl_t xfer_status[DWC2_EP_MAX][2];
@@ -97,6 +139,29 @@ static uint16_t ep0_pending[2];                   // Index determines direction
 // TX FIFO RAM allocation so far in words - RX FIFO size is readily available from dwc2->grxfsiz
 static uint16_t _allocated_fifo_words_tx;         // TX FIFO size in words (IN EPs)
 static bool     _out_ep_closed;                   // Flag to check if RX FIFO size needs an update (reduce its size)
+static bool     _sof_en;                          // SOF interrupt is requested by stack, keep it enabled
+static uint16_t _epinfo_words;                    // Top of FIFO RAM used by core to keep endpoint DMA address
+
+// FIFO RAM layout planned at SET_CONFIGURATION, IN endpoints in it have a fixed TX FIFO
+static dwc2_fifo_layout_t _fifo_layout;
+static bool     _fifo_planned;
+
+#if CFG_TUD_DWC2_DMA
+static uint8_t _dma_mode;
+
+static TU_ATTR_ALIGNED(32) uint8_t _dma_bounce[CFG_TUD_DWC2_DMA_BOUNCE_NUM][CFG_TUD_DWC2_DMA_BOUNCE_SIZE];
+
+static inline bool dma_enabled(void)
+{
+  return _dma_mode != DWC2_DMA_SLAVE;
+}
+#endif
+
+#if CFG_TUD_DWC2_DMA == DWC2_DMA_DESC
+// Descriptor list of each endpoint takes up a whole cache line
+#define DMA_DESC_MAX    4
+static TU_ATTR_ALIGNED(32) dwc2_dma_desc_t _dma_desc[DWC2_EP_MAX][2][DMA_DESC_MAX];
+#endif
 
 // Calculate the RX FIFO size according to recommendations from reference manual
 static inline uint16_t calc_rx_ff_size(uint16_t ep_size)
@@ -117,8 +182,9 @@ static void update_grxfsiz(uint8_t rhport)
     max_epsize = tu_max16(max_epsize, xfer_status[epnum][TUSB_DIR_OUT].max_size);
   }
 
-  // Update size of RX FIFO
-  dwc2->grxfsiz = calc_rx_ff_size(max_epsize);
+  // Update size of RX FIFO, planned size is kept
+  uint16_t const sz = calc_rx_ff_size(max_epsize);
+  dwc2->grxfsiz = _fifo_planned ? tu_max16(sz, _fifo_layout.rx) : sz;
 }
 
 // Setup the control endpoint 0.
@@ -130,6 +196,7 @@ static void bus_reset(uint8_t rhport)
 
   tu_memclr(xfer_status, sizeof(xfer_status));
   _out_ep_closed = false;
+  _fifo_planned  = false;
 
   // clear device address
   dwc2->dcfg &= ~DCFG_DAD_Msk;
@@ -197,7 +264,8 @@ static void bus_reset(uint8_t rhport)
 
   dwc2->grxfsiz = calc_rx_ff_size(TUD_OPT_HIGH_SPEED ? 512 : 64);
 
-  _allocated_fifo_words_tx = 16;
+  // With DMA, endpoint info (DMA address) is kept at the top of FIFO RAM
+  _allocated_fifo_words_tx = _epinfo_words + 16;
 
   // Control IN uses FIFO 0 with 64 bytes ( 16 32-bit word )
   dwc2->dieptxf0 = (16 << DIEPTXF0_TX0FD_Pos) | (DWC2_EP_FIFO_SIZE/4 - _allocated_fifo_words_tx);
@@ -212,6 +280,44 @@ static void bus_reset(uint8_t rhport)
   dwc2->gintmsk |= GINTMSK_OEPINT | GINTMSK_IEPINT;
 }
 
+static inline bool edpt_is_iso(dwc2_regs_t * dwc2, uint8_t epnum, uint8_t dir)
+{
+  uint32_t const epctl = (dir == TUSB_DIR_IN) ? dwc2->epin[epnum].diepctl : dwc2->epout[epnum].doepctl;
+  return (epctl & DIEPCTL_EPTYP) == DIEPCTL_EPTYP_0;
+}
+
+// Enable endpoint once its transfer size (and DMA address) is set up
+static void edpt_enable(dwc2_regs_t * dwc2, uint8_t epnum, uint8_t dir)
+{
+  if ( dir == TUSB_DIR_IN )
+  {
+    dwc2_epin_t* epin = dwc2->epin;
+
+    epin[epnum].diepctl |= DIEPCTL_EPENA | DIEPCTL_CNAK;
+
+    // For ISO endpoint set correct odd/even bit for next frame.
+    if ( (epin[epnum].diepctl & DIEPCTL_EPTYP) == DIEPCTL_EPTYP_0 && (XFER_CTL_BASE(epnum, dir))->interval == 1 )
+    {
+      // Take odd/even bit from frame counter.
+      uint32_t const odd_frame_now = (dwc2->dsts & (1u << DSTS_FNSOF_Pos));
+      epin[epnum].diepctl |= (odd_frame_now ? DIEPCTL_SD0PID_SEVNFRM_Msk : DIEPCTL_SODDFRM_Msk);
+    }
+  }
+  else
+  {
+    dwc2_epout_t* epout = dwc2->epout;
+
+    epout[epnum].doepctl |= DOEPCTL_EPENA | DOEPCTL_CNAK;
+    if ( (epout[epnum].doepctl & DOEPCTL_EPTYP) == DOEPCTL_EPTYP_0 &&
+         XFER_CTL_BASE(epnum, dir)->interval == 1 )
+    {
+      // Take odd/even bit from frame counter.
+      uint32_t const odd_frame_now = (dwc2->dsts & (1u << DSTS_FNSOF_Pos));
+      epout[epnum].doepctl |= (odd_frame_now ? DOEPCTL_SD0PID_SEVNFRM_Msk : DOEPCTL_SODDFRM_Msk);
+    }
+  }
+}
+
 static void edpt_schedule_packets(uint8_t rhport, uint8_t const epnum, uint8_t const dir, uint16_t const num_packets, uint16_t total_bytes)
 {
   (void) rhport;
@@ -236,15 +342,8 @@ static void edpt_schedule_packets(uint8_t rhport, uint8_t const epnum, uint8_t c
     epin[epnum].dieptsiz = (num_packets << DIEPTSIZ_PKTCNT_Pos) |
                            ((total_bytes << DIEPTSIZ_XFRSIZ_Pos) & DIEPTSIZ_XFRSIZ_Msk);
 
-    epin[epnum].diepctl |= DIEPCTL_EPENA | DIEPCTL_CNAK;
+    edpt_enable(dwc2, epnum, dir);
 
-    // For ISO endpoint set correct odd/even bit for next frame.
-    if ( (epin[epnum].diepctl & DIEPCTL_EPTYP) == DIEPCTL_EPTYP_0 && (XFER_CTL_BASE(epnum, dir))->interval == 1 )
-    {
-      // Take odd/even bit from frame counter.
-      uint32_t const odd_frame_now = (dwc2->dsts & (1u << DSTS_FNSOF_Pos));
-      epin[epnum].diepctl |= (odd_frame_now ? DIEPCTL_SD0PID_SEVNFRM_Msk : DIEPCTL_SODDFRM_Msk);
-    }
     // Enable fifo empty interrupt only if there are something to put in the fifo.
     if ( total_bytes != 0 )
     {
@@ -260,17 +359,380 @@ static void edpt_schedule_packets(uint8_t rhport, uint8_t const epnum, uint8_t c
     epout[epnum].doeptsiz |= (num_packets << DOEPTSIZ_PKTCNT_Pos) |
                              ((total_bytes << DOEPTSIZ_XFRSIZ_Pos) & DOEPTSIZ_XFRSIZ_Msk);
 
-    epout[epnum].doepctl |= DOEPCTL_EPENA | DOEPCTL_CNAK;
-    if ( (epout[epnum].doepctl & DOEPCTL_EPTYP) == DOEPCTL_EPTYP_0 &&
-         XFER_CTL_BASE(epnum, dir)->interval == 1 )
+    edpt_enable(dwc2, epnum, dir);
+  }
+}
+
+//--------------------------------------------------------------------+
+// DMA
+//--------------------------------------------------------------------+
+#if CFG_TUD_DWC2_DMA
+
+static uint8_t dma_mode_supported(dwc2_regs_t * dwc2)
+{
+  // arch 2: internal DMA
+  if ( dwc2->ghwcfg2_bm.arch != 2 ) return DWC2_DMA_SLAVE;
+
+  if ( CFG_TUD_DWC2_DMA == DWC2_DMA_DESC && dwc2->ghwcfg4_bm.dma_desc_enable ) return DWC2_DMA_DESC;
+
+  return DWC2_DMA_BUFFER;
+}
+
+static uint8_t * dma_bounce_get(xfer_ctl_t * xfer)
+{
+  if ( xfer->dma_bounce ) return xfer->dma_bounce;
+
+  TU_ASSERT(xfer->max_size <= CFG_TUD_DWC2_DMA_BOUNCE_SIZE, NULL);
+
+  for ( uint8_t i = 0; i < CFG_TUD_DWC2_DMA_BOUNCE_NUM; i++ )
+  {
+    bool used = false;
+    for ( uint8_t n = 0; n < DWC2_EP_MAX; n++ )
     {
-      // Take odd/even bit from frame counter.
-      uint32_t const odd_frame_now = (dwc2->dsts & (1u << DSTS_FNSOF_Pos));
-      epout[epnum].doepctl |= (odd_frame_now ? DOEPCTL_SD0PID_SEVNFRM_Msk : DOEPCTL_SODDFRM_Msk);
+      used |= (xfer_status[n][TUSB_DIR_OUT].dma_bounce == _dma_bounce[i]) ||
+              (xfer_status[n][TUSB_DIR_IN ].dma_bounce == _dma_bounce[i]);
+    }
+
+    if ( !used )
+    {
+      xfer->dma_bounce = _dma_bounce[i];
+      return xfer->dma_bounce;
+    }
+  }
+
+  TU_LOG(DWC2_DEBUG, "  No DMA bounce buffer left\r\n");
+  return NULL;
+}
+
+// DMA requires word aligned address: packets at unaligned address or straddling FIFO wrap around
+// go through bounce buffer. Core writes whole OUT packets, a short one at the end is received there too.
+static bool dma_bounce_needed(xfer_ctl_t const * xfer, uint8_t dir)
+{
+  tu_fifo_buffer_info_t const * data = &xfer->dma_data;
+
+  if ( xfer->total_len == 0 ) return false;
+  if ( dir == TUSB_DIR_OUT && (xfer->total_len % xfer->max_size) ) return true;
+  if ( (uintptr_t) data->ptr_lin & 3 ) return true;
+  if ( (xfer->max_size & 3) && xfer->total_len > xfer->max_size ) return true;
+  if ( data->len_wrap && ((data->len_lin % xfer->max_size) || ((uintptr_t) data->ptr_wrap & 3)) ) return true;
+
+  return false;
+}
+
+// Copy between bounce buffer and transfer data at offset, which may wrap around
+static void dma_bounce_copy(xfer_ctl_t const * xfer, uint16_t offset, uint16_t len, bool to_bounce)
+{
+  tu_fifo_buffer_info_t const * data = &xfer->dma_data;
+  uint8_t * bounce = xfer->dma_bounce;
+
+  while ( len )
+  {
+    uint8_t * addr;
+    uint16_t count;
+
+    if ( offset < data->len_lin )
+    {
+      addr  = (uint8_t*) data->ptr_lin + offset;
+      count = data->len_lin - offset;
+    }else
+    {
+      addr  = (uint8_t*) data->ptr_wrap + (offset - data->len_lin);
+      count = data->len_lin + data->len_wrap - offset;
+    }
+    count = tu_min16(count, len);
+
+    if ( to_bounce )
+    {
+      memcpy(bounce, addr, count);
+    }else
+    {
+      memcpy(addr, bounce, count);
+    }
+
+    bounce += count;
+    offset += count;
+    len    -= count;
+  }
+}
+
+// Memory of next chunk at offset: as many whole packets as there are in contiguous and aligned memory,
+// otherwise one packet through bounce buffer
+static uint8_t * dma_chunk(xfer_ctl_t * xfer, uint8_t dir, bool one_packet, uint16_t offset, uint16_t * chunk_len)
+{
+  tu_fifo_buffer_info_t const * data = &xfer->dma_data;
+  uint16_t const remaining = xfer->total_len - offset;
+  uint16_t len = one_packet ? tu_min16(remaining, xfer->max_size) : remaining;
+
+  // Zero length packet: setup packet buffer is used, EP0 status OUT stage may get next setup instead
+  if ( len == 0 )
+  {
+    *chunk_len = 0;
+    return (uint8_t*) _setup_packet;
+  }
+
+  uint8_t * addr;
+  uint16_t contiguous;
+
+  if ( offset < data->len_lin )
+  {
+    addr       = (uint8_t*) data->ptr_lin + offset;
+    contiguous = data->len_lin - offset;
+  }else
+  {
+    addr       = (uint8_t*) data->ptr_wrap + (offset - data->len_lin);
+    contiguous = data->len_lin + data->len_wrap - offset;
+  }
+
+  // whole packets up to where FIFO wraps around
+  if ( contiguous < len ) len = contiguous - (contiguous % xfer->max_size);
+
+  // OUT packet is written as a whole
+  if ( dir == TUSB_DIR_OUT ) len -= len % xfer->max_size;
+
+  if ( len == 0 || ((uintptr_t) addr & 3) )
+  {
+    addr = xfer->dma_bounce;
+    len  = tu_min16(remaining, xfer->max_size);
+  }
+
+  *chunk_len = len;
+  return addr;
+}
+
+// Set up next chunk(s) of transfer and enable endpoint
+static void dma_xfer_start(uint8_t rhport, uint8_t epnum, uint8_t dir)
+{
+  dwc2_regs_t * dwc2 = DWC2_REG(rhport);
+  xfer_ctl_t * xfer = XFER_CTL_BASE(epnum, dir);
+
+  // EP0 is limited to one packet each xfer, isochronous is one packet each (micro)frame
+  bool const iso = edpt_is_iso(dwc2, epnum, dir);
+  bool const one_packet = (epnum == 0) || iso;
+
+  uint16_t offset = xfer->dma_offset;
+
+#if CFG_TUD_DWC2_DMA == DWC2_DMA_DESC
+  if ( _dma_mode == DWC2_DMA_DESC )
+  {
+    dwc2_dma_desc_t * desc = _dma_desc[epnum][dir];
+
+    // Chunks of IN transfer are chained. OUT transfer ends on short packet, it has one chunk at a time
+    uint8_t const count_max = (dir == TUSB_DIR_IN && !one_packet) ? DMA_DESC_MAX : 1;
+    uint8_t count = 0;
+    bool bounced = false;
+
+    do
+    {
+      uint16_t len;
+      uint8_t * addr = dma_chunk(xfer, dir, one_packet, offset, &len);
+
+      // one bounce buffer per list
+      if ( addr == xfer->dma_bounce )
+      {
+        if ( bounced ) break;
+        bounced = true;
+        if ( dir == TUSB_DIR_IN ) dma_bounce_copy(xfer, offset, len, true);
+      }
+
+      // OUT is received in whole packets
+      uint16_t const nbytes = (dir == TUSB_DIR_OUT) ? tu_div_ceil(len, xfer->max_size) * xfer->max_size : len;
+      uint32_t status = DDESC_BS_HOST_READY | nbytes;
+
+      if ( iso )
+      {
+        // next (micro)frame
+        uint32_t const frame = (dwc2->dsts & DSTS_FNSOF_Msk) >> DSTS_FNSOF_Pos;
+        status |= ((frame + 1) << DDESC_ISO_FRNUM_Pos) & DDESC_ISO_FRNUM_Msk;
+      }
+
+      if ( dir == TUSB_DIR_IN )
+      {
+        dcache_clean(addr, len);
+        if ( len % xfer->max_size || len == 0 ) status |= DDESC_SP;
+      }else
+      {
+        dcache_clean_invalidate(addr, len);
+        xfer->dma_out_addr = addr;
+      }
+
+      desc[count].buf    = (uint32_t) (uintptr_t) addr;
+      desc[count].status = status;
+
+      offset += len;
+      count++;
+    } while ( count < count_max && offset < xfer->total_len );
+
+    desc[count-1].status |= DDESC_L | DDESC_IOC;
+    dcache_clean(desc, count*sizeof(dwc2_dma_desc_t));
+
+    if ( dir == TUSB_DIR_IN )
+    {
+      dwc2->epin[epnum].diepdma = (uint32_t) (uintptr_t) desc;
+    }else
+    {
+      dwc2->epout[epnum].doepdma = (uint32_t) (uintptr_t) desc;
+    }
+  }
+  else
+#endif
+  {
+    uint16_t len;
+    uint8_t * addr = dma_chunk(xfer, dir, one_packet, offset, &len);
+    uint16_t const num_packets = len ? tu_div_ceil(len, xfer->max_size) : 1;
+
+    if ( dir == TUSB_DIR_IN )
+    {
+      if ( addr == xfer->dma_bounce ) dma_bounce_copy(xfer, offset, len, true);
+      dcache_clean(addr, len);
+
+      dwc2->epin[epnum].dieptsiz = (num_packets << DIEPTSIZ_PKTCNT_Pos) |
+                                   ((len << DIEPTSIZ_XFRSIZ_Pos) & DIEPTSIZ_XFRSIZ_Msk);
+      dwc2->epin[epnum].diepdma  = (uint32_t) (uintptr_t) addr;
+    }else
+    {
+      dcache_clean_invalidate(addr, len);
+      xfer->dma_out_addr = addr;
+
+      // OUT is received in whole packets
+      uint32_t const xfrsiz = len ? num_packets * xfer->max_size : 0;
+
+      dwc2->epout[epnum].doeptsiz &= ~(DOEPTSIZ_PKTCNT_Msk | DOEPTSIZ_XFRSIZ);
+      dwc2->epout[epnum].doeptsiz |= (num_packets << DOEPTSIZ_PKTCNT_Pos) |
+                                     ((xfrsiz << DOEPTSIZ_XFRSIZ_Pos) & DOEPTSIZ_XFRSIZ_Msk);
+      dwc2->epout[epnum].doepdma   = (uint32_t) (uintptr_t) addr;
+    }
+
+    offset += len;
+  }
+
+  xfer->dma_len = offset - xfer->dma_offset;
+  edpt_enable(dwc2, epnum, dir);
+}
+
+// EP0 OUT is kept enabled to receive setup packet when it is not used by data or status stage
+static void dma_setup_prepare(uint8_t rhport)
+{
+  dwc2_regs_t * dwc2 = DWC2_REG(rhport);
+  dwc2_epout_t * epout = &dwc2->epout[0];
+
+  // From 3.00a, EP0 OUT stays enabled until setup packet is received
+  if ( dwc2->gsnpsid >= DWC2_CORE_REV_3_00a && (epout->doepctl & DOEPCTL_EPENA) ) return;
+
+  epout->doeptsiz = (3 << DOEPTSIZ_STUPCNT_Pos) | (1 << DOEPTSIZ_PKTCNT_Pos) | (sizeof(_setup_packet) << DOEPTSIZ_XFRSIZ_Pos);
+
+#if CFG_TUD_DWC2_DMA == DWC2_DMA_DESC
+  if ( _dma_mode == DWC2_DMA_DESC )
+  {
+    dwc2_dma_desc_t * desc = _dma_desc[0][TUSB_DIR_OUT];
+    desc->buf    = (uint32_t) (uintptr_t) _setup_packet;
+    desc->status = DDESC_BS_HOST_READY | DDESC_L | DDESC_IOC | 8;
+    dcache_clean(desc, sizeof(dwc2_dma_desc_t));
+
+    epout->doepdma = (uint32_t) (uintptr_t) desc;
+  }
+  else
+#endif
+  {
+    epout->doepdma = (uint32_t) (uintptr_t) _setup_packet;
+  }
+
+  epout->doepctl |= DOEPCTL_EPENA | DOEPCTL_USBAEP;
+}
+
+static void dma_xfer_complete(uint8_t rhport, uint8_t epnum, uint8_t dir)
+{
+  dwc2_regs_t * dwc2 = DWC2_REG(rhport);
+  xfer_ctl_t * xfer = XFER_CTL_BASE(epnum, dir);
+
+  uint16_t xferred = xfer->dma_len;
+
+  if ( dir == TUSB_DIR_OUT )
+  {
+    // bytes not received
+    uint16_t remaining;
+
+#if CFG_TUD_DWC2_DMA == DWC2_DMA_DESC
+    if ( _dma_mode == DWC2_DMA_DESC )
+    {
+      dwc2_dma_desc_t * desc = _dma_desc[epnum][dir];
+      dcache_invalidate(desc, sizeof(dwc2_dma_desc_t));
+      remaining = desc->status & (edpt_is_iso(dwc2, epnum, dir) ? DDESC_ISO_OUT_NBYTES_Msk : DDESC_NBYTES_Msk);
     }
+    else
+#endif
+    {
+      remaining = (dwc2->epout[epnum].doeptsiz & DOEPTSIZ_XFRSIZ_Msk) >> DOEPTSIZ_XFRSIZ_Pos;
+    }
+
+    uint16_t const programmed = tu_div_ceil(xferred, xfer->max_size) * xfer->max_size;
+    xferred = tu_min16(programmed - tu_min16(remaining, programmed), xferred);
+    dcache_invalidate(xfer->dma_out_addr, xferred);
+
+    if ( xfer->dma_out_addr == xfer->dma_bounce ) dma_bounce_copy(xfer, xfer->dma_offset, xferred, false);
   }
+
+  xfer->dma_offset += xferred;
+
+  // Short packet or zero length packet ends transfer
+  bool const short_packet = (xferred < xfer->dma_len) || (xfer->dma_len == 0);
+
+  if ( !short_packet && xfer->dma_offset < xfer->total_len )
+  {
+    dma_xfer_start(rhport, epnum, dir);
+    return;
+  }
+
+  xfer->dma_bounce = NULL;
+
+  if ( xfer->ff )
+  {
+    if ( dir == TUSB_DIR_IN )
+    {
+      tu_fifo_advance_read_pointer(xfer->ff, xfer->dma_offset);
+    }else
+    {
+      tu_fifo_advance_write_pointer(xfer->ff, xfer->dma_offset);
+    }
+  }
+
+  // Status stage (zero length) is done, get ready for next setup packet
+  if ( epnum == 0 && xfer->total_len == 0 ) dma_setup_prepare(rhport);
+
+  dcd_event_xfer_complete(rhport, epnum | (dir == TUSB_DIR_IN ? TUSB_DIR_IN_MASK : 0), xfer->dma_offset, XFER_RESULT_SUCCESS, true);
 }
 
+// Setup packet is written at DMA address: the latest one of back-to-back setup packets is copied to _setup_packet
+static void dma_setup_received(uint8_t rhport)
+{
+  dwc2_regs_t * dwc2 = DWC2_REG(rhport);
+  uint32_t const * setup = _setup_packet;
+
+  if ( _dma_mode == DWC2_DMA_BUFFER )
+  {
+    uint32_t const dma_addr = dwc2->epout[0].doepdma;
+    if ( dma_addr >= (uint32_t) (uintptr_t) (_setup_packet + 2) ) setup = (uint32_t const *) (uintptr_t) (dma_addr - 8);
+  }
+
+  dcache_invalidate(setup, 8);
+
+  if ( setup != _setup_packet )
+  {
+    _setup_packet[0] = setup[0];
+    _setup_packet[1] = setup[1];
+  }
+}
+
+static void dma_xfer_init(xfer_ctl_t * xfer, void * buffer, uint16_t total_bytes)
+{
+  xfer->dma_data.ptr_lin  = buffer;
+  xfer->dma_data.len_lin  = total_bytes;
+  xfer->dma_data.ptr_wrap = NULL;
+  xfer->dma_data.len_wrap = 0;
+  xfer->dma_offset        = 0;
+}
+
+#endif
+
 /*------------------------------------------------------------------*/
 /* Controller API
  *------------------------------------------------------------------*/
@@ -527,6 +989,30 @@ void dcd_init (uint8_t rhport)
   dwc2->gintmsk = GINTMSK_OTGINT   | GINTMSK_MMISM  | GINTMSK_RXFLVLM  |
                   GINTMSK_USBSUSPM | GINTMSK_USBRST | GINTMSK_ENUMDNEM | GINTMSK_WUIM;
 
+  _epinfo_words = 0;
+
+#if CFG_TUD_DWC2_DMA
+  // Fall back to slave mode if core has no internal DMA
+  _dma_mode = dma_mode_supported(dwc2);
+
+  if ( dma_enabled() )
+  {
+    // Core keeps DMA address of each endpoint at the top of FIFO RAM
+    _epinfo_words = 2*DWC2_EP_MAX;
+
+    uint32_t const dfifo_top = DWC2_EP_FIFO_SIZE/4 - _epinfo_words;
+    dwc2->gdfifocfg = (dfifo_top << GDFIFOCFG_EPINFOBASE_Pos) | (dfifo_top << GDFIFOCFG_GDFIFOCFG_Pos);
+
+    // Data is moved by DMA, no need for RX FIFO level interrupt
+    dwc2->gintmsk &= ~GINTMSK_RXFLVLM;
+    dwc2->gahbcfg = (dwc2->gahbcfg & ~GAHBCFG_HBSTLEN) | GAHBCFG_HBSTLEN_2 | GAHBCFG_DMAEN;
+
+    if ( _dma_mode == DWC2_DMA_DESC ) dwc2->dcfg |= DCFG_DESCDMA;
+  }
+
+  TU_LOG(DWC2_DEBUG, "DMA mode = %u\r\n", _dma_mode);
+#endif
+
   // Enable global interrupt
   dwc2->gahbcfg |= GAHBCFG_GINT;
 
@@ -593,11 +1079,159 @@ void dcd_disconnect(uint8_t rhport)
   dwc2->dctl |= DCTL_SDIS;
 }
 
+void dcd_sof_enable(uint8_t rhport, bool en)
+{
+  (void) rhport;
+  dwc2_regs_t * dwc2 = DWC2_REG(rhport);
+
+  _sof_en = en;
+
+  if ( en )
+  {
+    dwc2->gintsts = GINTSTS_SOF;
+    dwc2->gintmsk |= GINTMSK_SOFM;
+  }else
+  {
+    dwc2->gintmsk &= ~GINTMSK_SOFM;
+  }
+}
+
 
 /*------------------------------------------------------------------*/
 /* DCD Endpoint port
  *------------------------------------------------------------------*/
 
+// Largest data of endpoint per (micro)frame: high bandwidth periodic endpoint has up to 3 packets
+static uint16_t edpt_fifo_packet_size(tusb_desc_endpoint_t const * desc_ep)
+{
+  uint16_t const size = tu_edpt_packet_size(desc_ep);
+  if ( desc_ep->bmAttributes.xfer == TUSB_XFER_BULK ) return size;
+
+  return size * (1 + ((tu_le16toh(desc_ep->wMaxPacketSize) >> 11) & 0x03));
+}
+
+// Plan FIFO RAM for the whole configuration: each IN endpoint gets a fixed TX FIFO sized for its
+// largest packet over all alternate settings, RX FIFO is sized for the largest OUT packet. Room
+// left is given to TX FIFOs one packet at a time in endpoint order, up to CFG_TUD_DWC2_FIFO_TX_PACKETS.
+// If configuration does not fit, FIFOs are allocated as endpoints are opened.
+void dcd_edpt_plan(uint8_t rhport, tusb_desc_configuration_t const * desc_cfg)
+{
+  dwc2_regs_t * dwc2 = DWC2_REG(rhport);
+
+  _fifo_planned = false;
+
+  // Only when no other IN endpoint has a FIFO i.e after bus reset or closing all endpoints
+  TU_VERIFY(_allocated_fifo_words_tx == _epinfo_words + 16, );
+
+  uint16_t tx_words[DWC2_EP_MAX] = { 0 };
+  uint16_t rx_size = CFG_TUD_ENDPOINT0_SIZE;
+
+  uint8_t const * p_desc   = ((uint8_t const*) desc_cfg) + sizeof(tusb_desc_configuration_t);
+  uint8_t const * desc_end = ((uint8_t const*) desc_cfg) + tu_le16toh(desc_cfg->wTotalLength);
+
+  while( p_desc < desc_end )
+  {
+    if ( TUSB_DESC_ENDPOINT == tu_desc_type(p_desc) )
+    {
+      tusb_desc_endpoint_t const * desc_ep = (tusb_desc_endpoint_t const *) p_desc;
+      uint8_t const epnum = tu_edpt_number(desc_ep->bEndpointAddress);
+      uint16_t const size = edpt_fifo_packet_size(desc_ep);
+
+      // endpoint could not be opened anyway
+      TU_VERIFY(epnum > 0 && epnum < DWC2_EP_MAX, );
+
+      if ( tu_edpt_dir(desc_ep->bEndpointAddress) == TUSB_DIR_IN )
+      {
+        tx_words[epnum] = tu_max16(tx_words[epnum], tu_div_ceil(size, 4));
+      }else
+      {
+        rx_size = tu_max16(rx_size, size);
+      }
+    }
+
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  // RX FIFO is not reduced since it may hold data of current control transfer
+  uint16_t const total = DWC2_EP_FIFO_SIZE/4;
+  uint16_t const rx    = tu_max16(calc_rx_ff_size(rx_size), (uint16_t) dwc2->grxfsiz);
+
+  // One packet per TX FIFO must fit
+  uint16_t used = rx + _epinfo_words + 16;
+  uint8_t packets[DWC2_EP_MAX] = { 0 };
+
+  for ( uint8_t n = 1; n < DWC2_EP_MAX; n++ )
+  {
+    if ( tx_words[n] ) packets[n] = 1;
+    used += tx_words[n];
+  }
+
+  if ( used > total )
+  {
+    TU_LOG(DWC2_DEBUG, "    FIFO RAM is too small to plan configuration: %u bytes needed\r\n", used*4);
+    return;
+  }
+
+  // Double buffering, then deeper up to CFG_TUD_DWC2_FIFO_TX_PACKETS while room is left
+  for ( uint8_t count = 2; count <= CFG_TUD_DWC2_FIFO_TX_PACKETS; count++ )
+  {
+    for ( uint8_t n = 1; n < DWC2_EP_MAX; n++ )
+    {
+      if ( packets[n] == count-1 && used + tx_words[n] <= total )
+      {
+        packets[n] = count;
+        used += tx_words[n];
+      }
+    }
+  }
+
+  // TX FIFOs from top of RAM down: endpoint info, EP0, EP1 ...
+  tu_memclr(&_fifo_layout, sizeof(_fifo_layout));
+  _fifo_layout.total  = total;
+  _fifo_layout.rx     = rx;
+  _fifo_layout.epinfo = _epinfo_words;
+  _fifo_layout.free   = total - used;
+
+  uint16_t addr = total - _epinfo_words - 16;
+  _fifo_layout.tx[0].addr    = addr;
+  _fifo_layout.tx[0].size    = 16;
+  _fifo_layout.tx[0].packets = 1;
+
+  for ( uint8_t n = 1; n < DWC2_EP_MAX; n++ )
+  {
+    if ( !tx_words[n] ) continue;
+
+    uint16_t const size = tx_words[n] * packets[n];
+    addr -= size;
+
+    _fifo_layout.tx[n].addr    = addr;
+    _fifo_layout.tx[n].size    = size;
+    _fifo_layout.tx[n].packets = packets[n];
+
+    dwc2->dieptxf[n - 1] = (size << DIEPTXF_INEPTXFD_Pos) | addr;
+
+    TU_LOG(DWC2_DEBUG, "    TX FIFO %u: %u bytes at offset %u, %u packets\r\n", n, size*4, addr*4, packets[n]);
+  }
+
+  TU_LOG(DWC2_DEBUG, "    RX FIFO: %u bytes, %u bytes free\r\n", rx*4, _fifo_layout.free*4);
+
+  dwc2->grxfsiz = rx;
+
+  // FIFOs of endpoints not in configuration are allocated below planned ones
+  _allocated_fifo_words_tx = total - addr;
+  _fifo_planned = true;
+}
+
+bool dwc2_fifo_layout_get(uint8_t rhport, dwc2_fifo_layout_t* layout)
+{
+  (void) rhport;
+
+  TU_VERIFY(_fifo_planned);
+  *layout = _fifo_layout;
+
+  return true;
+}
+
 bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * desc_edpt)
 {
   (void) rhport;
@@ -629,6 +1263,8 @@ bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * desc_edpt)
       dwc2->grxfsiz = sz;
     }
 
+    // endpoint may be reopened with another size by alternate setting
+    dwc2->epout[epnum].doepctl &= ~(DOEPCTL_EPTYP_Msk | DOEPCTL_MPSIZ_Msk);
     dwc2->epout[epnum].doepctl |= (1 << DOEPCTL_USBAEP_Pos) |
                                   (desc_edpt->bmAttributes.xfer << DOEPCTL_EPTYP_Pos) |
                                   (desc_edpt->bmAttributes.xfer != TUSB_XFER_ISOCHRONOUS ? DOEPCTL_SD0PID_SEVNFRM : 0) |
@@ -658,18 +1294,29 @@ bool dcd_edpt_open (uint8_t rhport, tusb_desc_endpoint_t const * desc_edpt)
     //
     // In FIFO is allocated by following rules:
     // - IN EP 1 gets FIFO 1, IN EP "n" gets FIFO "n".
+    // - FIFO of endpoint in planned layout is fixed, it is sized for all alternate settings.
+    // - Otherwise FIFO is allocated below the ones allocated so far.
 
-    // Check if free space is available
-    TU_ASSERT(_allocated_fifo_words_tx + fifo_size + dwc2->grxfsiz <= DWC2_EP_FIFO_SIZE/4);
+    if ( _fifo_planned && _fifo_layout.tx[epnum].size )
+    {
+      TU_ASSERT(fifo_size <= _fifo_layout.tx[epnum].size);
+      dwc2->dieptxf[epnum - 1] = (_fifo_layout.tx[epnum].size << DIEPTXF_INEPTXFD_Pos) | _fifo_layout.tx[epnum].addr;
+    }
+    else
+    {
+      // Check if free space is available
+      TU_ASSERT(_allocated_fifo_words_tx + fifo_size + dwc2->grxfsiz <= DWC2_EP_FIFO_SIZE/4);
 
-    _allocated_fifo_words_tx += fifo_size;
+      _allocated_fifo_words_tx += fifo_size;
 
-    TU_LOG(DWC2_DEBUG, "    Allocated %u bytes at offset %u", fifo_size*4, DWC2_EP_FIFO_SIZE-_allocated_fifo_words_tx*4);
+      TU_LOG(DWC2_DEBUG, "    Allocated %u bytes at offset %u", fifo_size*4, DWC2_EP_FIFO_SIZE-_allocated_fifo_words_tx*4);
 
-    // DIEPTXF starts at FIFO #1.
-    // Both TXFD and TXSA are in unit of 32-bit words.
-    dwc2->dieptxf[epnum - 1] = (fifo_size << DIEPTXF_INEPTXFD_Pos) | (DWC2_EP_FIFO_SIZE/4 - _allocated_fifo_words_tx);
+      // DIEPTXF starts at FIFO #1.
+      // Both TXFD and TXSA are in unit of 32-bit words.
+      dwc2->dieptxf[epnum - 1] = (fifo_size << DIEPTXF_INEPTXFD_Pos) | (DWC2_EP_FIFO_SIZE/4 - _allocated_fifo_words_tx);
+    }
 
+    dwc2->epin[epnum].diepctl &= ~(DIEPCTL_TXFNUM_Msk | DIEPCTL_EPTYP_Msk | DIEPCTL_MPSIZ_Msk);
     dwc2->epin[epnum].diepctl |= (1 << DIEPCTL_USBAEP_Pos) |
                                  (epnum << DIEPCTL_TXFNUM_Pos) |
                                  (desc_edpt->bmAttributes.xfer << DIEPCTL_EPTYP_Pos) |
@@ -701,10 +1348,16 @@ void dcd_edpt_close_all (uint8_t rhport)
     // disable IN endpoint
     dwc2->epin[n].diepctl = 0;
     xfer_status[n][TUSB_DIR_IN].max_size = 0;
+
+#if CFG_TUD_DWC2_DMA
+    xfer_status[n][TUSB_DIR_OUT].dma_bounce = NULL;
+    xfer_status[n][TUSB_DIR_IN ].dma_bounce = NULL;
+#endif
   }
 
   // reset allocated fifo IN
-  _allocated_fifo_words_tx = 16;
+  _allocated_fifo_words_tx = _epinfo_words + 16;
+  _fifo_planned = false;
 }
 
 bool dcd_edpt_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes)
@@ -717,6 +1370,18 @@ bool dcd_edpt_xfer (uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t
   xfer->ff          = NULL;
   xfer->total_len   = total_bytes;
 
+#if CFG_TUD_DWC2_DMA
+  if ( dma_enabled() )
+  {
+    dma_xfer_init(xfer, buffer, total_bytes);
+
+    if ( dma_bounce_needed(xfer, dir) ) TU_ASSERT(dma_bounce_get(xfer));
+
+    dma_xfer_start(rhport, epnum, dir);
+    return true;
+  }
+#endif
+
   // EP0 can only handle one packet
   if(epnum == 0)
   {
@@ -757,6 +1422,30 @@ bool dcd_edpt_xfer_fifo (uint8_t rhport, uint8_t ep_addr, tu_fifo_t * ff, uint16
   xfer->ff          = ff;
   xfer->total_len   = total_bytes;
 
+#if CFG_TUD_DWC2_DMA
+  if ( dma_enabled() )
+  {
+    // Transfer data in place, bounce buffer is used for packet straddling wrap around
+    if ( dir == TUSB_DIR_IN )
+    {
+      tu_fifo_get_read_info(ff, &xfer->dma_data);
+    }else
+    {
+      tu_fifo_get_write_info(ff, &xfer->dma_data);
+    }
+
+    xfer->dma_data.len_lin  = tu_min16(xfer->dma_data.len_lin, total_bytes);
+    xfer->dma_data.len_wrap = tu_min16(xfer->dma_data.len_wrap, total_bytes - xfer->dma_data.len_lin);
+    xfer->total_len         = xfer->dma_data.len_lin + xfer->dma_data.len_wrap;
+    xfer->dma_offset        = 0;
+
+    if ( dma_bounce_needed(xfer, dir) ) TU_ASSERT(dma_bounce_get(xfer));
+
+    dma_xfer_start(rhport, epnum, dir);
+    return true;
+  }
+#endif
+
   uint16_t num_packets = (total_bytes / xfer->max_size);
   uint16_t const short_packet_size = total_bytes % xfer->max_size;
 
@@ -850,8 +1539,15 @@ void dcd_edpt_close (uint8_t rhport, uint8_t ep_addr)
   // Update max_size
   xfer_status[epnum][dir].max_size = 0;  // max_size = 0 marks a disabled EP - required for changing FIFO allocation
 
+#if CFG_TUD_DWC2_DMA
+  xfer_status[epnum][dir].dma_bounce = NULL;
+#endif
+
   if (dir == TUSB_DIR_IN)
   {
+    // Planned FIFO is kept for the next alternate setting
+    if ( _fifo_planned && _fifo_layout.tx[epnum].size ) return;
+
     uint16_t const fifo_size = (dwc2->dieptxf[epnum - 1] & DIEPTXF_INEPTXFD_Msk) >> DIEPTXF_INEPTXFD_Pos;
     uint16_t const fifo_start = (dwc2->dieptxf[epnum - 1] & DIEPTXF_INEPTXSA_Msk) >> DIEPTXF_INEPTXSA_Pos;
     // For now only the last opened endpoint can be closed without fuss.
@@ -867,6 +1563,11 @@ void dcd_edpt_close (uint8_t rhport, uint8_t ep_addr)
 void dcd_edpt_stall (uint8_t rhport, uint8_t ep_addr)
 {
   dcd_edpt_disable(rhport, ep_addr, true);
+
+#if CFG_TUD_DWC2_DMA
+  // Stalled control transfer has no status stage: get ready for next setup packet
+  if ( dma_enabled() && ep_addr == 0 ) dma_setup_prepare(rhport);
+#endif
 }
 
 void dcd_edpt_clear_stall (uint8_t rhport, uint8_t ep_addr)
@@ -1082,6 +1783,11 @@ static void handle_epout_irq (uint8_t rhport)
         }
 
         epout->doepint = clear_flag;
+
+#if CFG_TUD_DWC2_DMA
+        if ( dma_enabled() ) dma_setup_received(rhport);
+#endif
+
         dcd_event_setup_received(rhport, (uint8_t*) _setup_packet, true);
       }
 
@@ -1090,6 +1796,18 @@ static void handle_epout_irq (uint8_t rhport)
       {
         epout->doepint = DOEPINT_XFRC;
 
+#if CFG_TUD_DWC2_DMA
+        if ( dma_enabled() )
+        {
+          // XFRC is also generated along with setup packet from 3.00a
+          if ( !(doepint & DOEPINT_STPKTRX) || (dwc2->gsnpsid < DWC2_CORE_REV_3_00a) )
+          {
+            dma_xfer_complete(rhport, n, TUSB_DIR_OUT);
+          }
+          continue;
+        }
+#endif
+
         xfer_ctl_t *xfer = XFER_CTL_BASE(n, TUSB_DIR_OUT);
 
         // EP0 can only handle one packet
@@ -1125,6 +1843,14 @@ static void handle_epin_irq (uint8_t rhport)
       {
         epin[n].diepint = DIEPINT_XFRC;
 
+#if CFG_TUD_DWC2_DMA
+        if ( dma_enabled() )
+        {
+          dma_xfer_complete(rhport, n, TUSB_DIR_IN);
+          continue;
+        }
+#endif
+
         // EP0 can only handle one packet
         if ( (n == 0) && ep0_pending[TUSB_DIR_IN] )
         {
@@ -1221,6 +1947,11 @@ void dcd_int_handler(uint8_t rhport)
       break;
     }
 
+#if CFG_TUD_DWC2_DMA
+    // EP0 OUT must be enabled to receive setup packet
+    if ( dma_enabled() ) dma_setup_prepare(rhport);
+#endif
+
     dcd_event_bus_reset(rhport, speed, true);
   }
 
@@ -1254,12 +1985,17 @@ void dcd_int_handler(uint8_t rhport)
 
   if(int_status & GINTSTS_SOF)
   {
-    dwc2->gotgint = GINTSTS_SOF;
+    dwc2->gintsts = GINTSTS_SOF;
 
-    // Disable SOF interrupt since currently only used for remote wakeup detection
-    dwc2->gintmsk &= ~GINTMSK_SOFM;
+    // Disable SOF interrupt if only used for remote wakeup detection
+    if ( !_sof_en ) dwc2->gintmsk &= ~GINTMSK_SOFM;
+
+    // SOF is signaled every microframe in high speed, FNSOF includes the microframe number in the lower 3 bits
+    bool const high_speed = ((dwc2->dsts & DSTS_ENUMSPD_Msk) >> DSTS_ENUMSPD_Pos) == DSTS_ENUMSPD_HS;
+    uint32_t frame = (dwc2->dsts & DSTS_FNSOF_Msk) >> DSTS_FNSOF_Pos;
+    if ( high_speed ) frame >>= 3;
 
-    dcd_event_bus_signal(rhport, DCD_EVENT_SOF, true);
+    dcd_event_sof(rhport, frame, high_speed, true);
   }
 
   // RxFIFO non-empty interrupt handling.
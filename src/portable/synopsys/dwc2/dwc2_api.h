@@ -0,0 +1,64 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#ifndef _TUSB_DWC2_API_H_
+#define _TUSB_DWC2_API_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// API Implemented by DWC2
+//--------------------------------------------------------------------+
+
+// FIFO RAM layout planned at SET_CONFIGURATION for all alternate settings of the configuration.
+// All sizes and addresses are in 32-bit words.
+typedef struct
+{
+  uint16_t total;             // FIFO RAM size
+  uint16_t rx;                // shared RX FIFO, starts at 0
+  uint16_t epinfo;            // top of RAM kept by core for DMA endpoint info
+  uint16_t free;              // left between RX FIFO and the lowest TX FIFO
+
+  struct
+  {
+    uint16_t addr;
+    uint16_t size;            // 0 if endpoint is not in configuration
+    uint8_t  packets;         // largest packets the FIFO holds
+  } tx[16];                   // TX FIFO of IN endpoints, index 0 is control endpoint
+} dwc2_fifo_layout_t;
+
+// Get FIFO RAM layout, return false if there is no planned layout (not configured, or the
+// configuration does not fit and FIFOs are allocated as endpoints are opened)
+bool dwc2_fifo_layout_get(uint8_t rhport, dwc2_fifo_layout_t* layout);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
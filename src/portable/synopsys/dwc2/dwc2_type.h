@@ -283,6 +283,15 @@ TU_VERIFY_STATIC(offsetof(dwc2_regs_t, epout  ) == 0x0B00, "incorrect size");
 TU_VERIFY_STATIC(offsetof(dwc2_regs_t, pcgctl ) == 0x0E00, "incorrect size");
 TU_VERIFY_STATIC(offsetof(dwc2_regs_t, fifo   ) == 0x1000, "incorrect size");
 
+// Device DMA descriptor for scatter/gather (descriptor) DMA mode, DIEPDMA/DOEPDMA point to list of them
+typedef struct
+{
+  volatile uint32_t status;           // buffer status, flags and byte count (DDESC_*)
+  volatile uint32_t buf;              // buffer address
+} dwc2_dma_desc_t;
+
+TU_VERIFY_STATIC(sizeof(dwc2_dma_desc_t) == 8, "incorrect size");
+
 //--------------------------------------------------------------------+
 // Register Bit Definitions
 //--------------------------------------------------------------------+
@@ -420,6 +429,10 @@ TU_VERIFY_STATIC(offsetof(dwc2_regs_t, fifo   ) == 0x1000, "incorrect size");
 #define DCFG_XCVRDLY_Msk                 (0x1UL << DCFG_XCVRDLY_Pos)             /*!< 0x00004000 */
 #define DCFG_XCVRDLY                     DCFG_XCVRDLY_Msk                        // Enables delay between xcvr_sel and txvalid during device chirp
 
+#define DCFG_DESCDMA_Pos                 (23U)
+#define DCFG_DESCDMA_Msk                 (0x1UL << DCFG_DESCDMA_Pos)              // 0x00800000 */
+#define DCFG_DESCDMA                     DCFG_DESCDMA_Msk                         // Enable scatter/gather DMA in device mode */
+
 #define DCFG_PERSCHIVL_Pos               (24U)
 #define DCFG_PERSCHIVL_Msk               (0x3UL << DCFG_PERSCHIVL_Pos)            // 0x03000000 */
 #define DCFG_PERSCHIVL                   DCFG_PERSCHIVL_Msk                       // Periodic scheduling interval */
@@ -517,6 +530,14 @@ TU_VERIFY_STATIC(offsetof(dwc2_regs_t, fifo   ) == 0x1000, "incorrect size");
 #define GAHBCFG_PTXFELVL_Msk             (0x1UL << GAHBCFG_PTXFELVL_Pos)          // 0x00000100 */
 #define GAHBCFG_PTXFELVL                 GAHBCFG_PTXFELVL_Msk                     // Periodic TxFIFO empty level */
 
+/********************  Bit definition for GDFIFOCFG register  ********************/
+#define GDFIFOCFG_GDFIFOCFG_Pos          (0U)
+#define GDFIFOCFG_GDFIFOCFG_Msk          (0xFFFFUL << GDFIFOCFG_GDFIFOCFG_Pos)    // 0x0000FFFF */
+#define GDFIFOCFG_GDFIFOCFG              GDFIFOCFG_GDFIFOCFG_Msk                  // DFIFO top (in words) of Tx/Rx FIFOs */
+#define GDFIFOCFG_EPINFOBASE_Pos         (16U)
+#define GDFIFOCFG_EPINFOBASE_Msk         (0xFFFFUL << GDFIFOCFG_EPINFOBASE_Pos)   // 0xFFFF0000 */
+#define GDFIFOCFG_EPINFOBASE             GDFIFOCFG_EPINFOBASE_Msk                 // Start (in words) of endpoint info i.e DMA address */
+
 #define GSNPSID_ID_MASK                 TU_GENMASK(31, 16)
 
 /********************  Bit definition for GUSBCFG register  ********************/
@@ -1668,6 +1689,9 @@ TU_VERIFY_STATIC(offsetof(dwc2_regs_t, fifo   ) == 0x1000, "incorrect size");
 #define DOEPINT_OUTPKTERR_Pos            (8U)
 #define DOEPINT_OUTPKTERR_Msk            (0x1UL << DOEPINT_OUTPKTERR_Pos)         // 0x00000100 */
 #define DOEPINT_OUTPKTERR                DOEPINT_OUTPKTERR_Msk                    // OUT packet error */
+#define DOEPINT_BNA_Pos                  (9U)
+#define DOEPINT_BNA_Msk                  (0x1UL << DOEPINT_BNA_Pos)               // 0x00000200 */
+#define DOEPINT_BNA                      DOEPINT_BNA_Msk                          // Buffer not available interrupt */
 #define DOEPINT_NAK_Pos                  (13U)
 #define DOEPINT_NAK_Msk                  (0x1UL << DOEPINT_NAK_Pos)               // 0x00002000 */
 #define DOEPINT_NAK                      DOEPINT_NAK_Msk                          // NAK Packet is transmitted by the device */
@@ -1723,6 +1747,28 @@ TU_VERIFY_STATIC(offsetof(dwc2_regs_t, fifo   ) == 0x1000, "incorrect size");
 #define PCGCTL1_TIMER                   (0x3ul << 1)
 #define PCGCTL1_GATEEN                  TU_BIT(0)
 
+/********************  Bit definition for DMA descriptor status  ********************/
+#define DDESC_BS_Pos                    30
+#define DDESC_BS_Msk                    (0x3ul << DDESC_BS_Pos)
+#define DDESC_BS_HOST_READY             (0x0ul << DDESC_BS_Pos)  // ready to be processed by core
+#define DDESC_BS_DMA_BUSY               (0x1ul << DDESC_BS_Pos)
+#define DDESC_BS_DMA_DONE               (0x2ul << DDESC_BS_Pos)
+#define DDESC_BS_HOST_BUSY              (0x3ul << DDESC_BS_Pos)  // being set up, skipped by core
+#define DDESC_STS_Pos                   28
+#define DDESC_STS_Msk                   (0x3ul << DDESC_STS_Pos)
+#define DDESC_STS_SUCCESS               (0x0ul << DDESC_STS_Pos)
+#define DDESC_STS_BUFF_ERR              (0x3ul << DDESC_STS_Pos)
+#define DDESC_L                         TU_BIT(27)               // last descriptor of the list
+#define DDESC_SP                        TU_BIT(26)               // IN: end with short packet, OUT: short packet received
+#define DDESC_IOC                       TU_BIT(25)               // interrupt (XFRC) on completion
+#define DDESC_SR                        TU_BIT(24)               // EP0 OUT: setup packet received
+#define DDESC_MTRF                      TU_BIT(23)               // EP0 OUT: multiple transfer
+#define DDESC_NBYTES_Msk                0xFFFFul                 // IN: bytes to send, OUT: buffer size then bytes left
+#define DDESC_ISO_FRNUM_Pos             12
+#define DDESC_ISO_FRNUM_Msk             (0x7FFul << DDESC_ISO_FRNUM_Pos)
+#define DDESC_ISO_IN_NBYTES_Msk         0xFFFul
+#define DDESC_ISO_OUT_NBYTES_Msk        0x7FFul
+
 #ifdef __cplusplus
  }
 #endif
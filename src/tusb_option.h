@@ -195,6 +195,12 @@
 #define TUH_OPT_RHPORT          ( ((CFG_TUSB_RHPORT0_MODE) & OPT_MODE_HOST) ? 0 : (((CFG_TUSB_RHPORT1_MODE) & OPT_MODE_HOST) ? 1 : -1) )
 #define TUSB_OPT_HOST_ENABLED   ( TUH_OPT_RHPORT >= 0 )
 
+#if TUH_OPT_RHPORT == 0
+#define TUH_OPT_HIGH_SPEED      ( (CFG_TUSB_RHPORT0_MODE) & OPT_MODE_HIGH_SPEED )
+#else
+#define TUH_OPT_HIGH_SPEED      ( (CFG_TUSB_RHPORT1_MODE) & OPT_MODE_HIGH_SPEED )
+#endif
+
 // Which roothub port is configured as device
 #define TUD_OPT_RHPORT          ( ((CFG_TUSB_RHPORT0_MODE) & OPT_MODE_DEVICE) ? 0 : (((CFG_TUSB_RHPORT1_MODE) & OPT_MODE_DEVICE) ? 1 : -1) )
 
@@ -299,6 +305,18 @@
   #define CFG_TUD_NCM         0
 #endif
 
+// Timestamp SOFs with a local clock to recover the host clock for audio/video
+// functions, see tud_sof_clock_ticks_cb(). CFG_TUD_SOF_CLOCK_FREQUENCY must be set
+// to the nominal frequency of the local clock.
+#ifndef CFG_TUD_SOF_CLOCK
+  #define CFG_TUD_SOF_CLOCK   0
+#endif
+
+// Number of SOFs per measurement of the local clock
+#ifndef CFG_TUD_SOF_CLOCK_INTERVAL
+  #define CFG_TUD_SOF_CLOCK_INTERVAL  64
+#endif
+
 //--------------------------------------------------------------------
 // HOST OPTIONS
 //--------------------------------------------------------------------
@@ -310,6 +328,18 @@
   #ifndef CFG_TUH_ENUMERATION_BUFSIZE
     #define CFG_TUH_ENUMERATION_BUFSIZE 256
   #endif
+
+  // Number of devices can be enumerated at the same time, each has its own CFG_TUH_ENUMERATION_BUFSIZE buffer.
+  // Default to 1 i.e one device at a time. Only devices behind hubs can be enumerated in parallel, to speed up
+  // enumeration of a populated hub set it up to CFG_TUH_DEVICE_MAX at the cost of extra enumeration buffers.
+  #ifndef CFG_TUH_ENUMERATION_MAX
+    #define CFG_TUH_ENUMERATION_MAX 1
+  #endif
+
+  // Number of control transfers can be queued per device
+  #ifndef CFG_TUH_CONTROL_QUEUE_SZ
+    #define CFG_TUH_CONTROL_QUEUE_SZ 2
+  #endif
 #endif // TUSB_OPT_HOST_ENABLED
 
 //------------- CLASS -------------//
@@ -0,0 +1,94 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _DCD_PORT_H_
+#define _DCD_PORT_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Port of the common device driver suite onto a controller model: the model is the host of
+// control and endpoint transfers, the driver under test is built with the sim configuration of
+// the model. Host transfers are polled between (micro)frames.
+//--------------------------------------------------------------------+
+
+typedef void (* dcd_port_task_t) (void);
+
+typedef struct
+{
+  char const* name;
+  uint8_t  speed;               // tusb_speed_t reported on bus reset
+  uint16_t frame_us;            // 1000, or 125 for high speed microframe
+  uint16_t bulk_size;
+  uint8_t  iso_epnum;           // endpoint number that can be isochronous, 0 if none
+} dcd_port_info_t;
+
+typedef struct
+{
+  uint32_t frames;
+  uint32_t irq_count;
+  uint64_t isr_ns;              // time spent in interrupt handler on the build machine
+  uint32_t toggle_errors;       // if data toggle is modeled
+} dcd_port_stat_t;
+
+extern dcd_port_info_t const dcd_port_info;
+
+// Model and driver init, task is called after interrupt handler (or as model schedules it)
+void dcd_port_init(dcd_port_task_t task);
+
+// USB reset, its event is handled before returning
+void dcd_port_bus_reset(void);
+
+// Run one frame (microframe at high speed)
+void dcd_port_frame(void);
+
+// Host control transfer, data stage has wLength bytes
+void dcd_port_control(tusb_control_request_t const* request, uint8_t* data);
+
+// Host transfer on non-control endpoint: OUT sends len bytes (zero length packet if len is 0),
+// IN receives up to len bytes until a short packet. Isochronous endpoint has a packet per frame
+void dcd_port_xfer(uint8_t ep_addr, uint16_t mps, bool iso, uint8_t* buf, uint32_t len);
+
+// Transfer (ep_addr 0: control transfer) is still in progress
+bool dcd_port_busy(uint8_t ep_addr);
+
+// Bytes transferred by last transfer (control: data stage), -1 if it was stalled
+int32_t dcd_port_xferred(uint8_t ep_addr);
+
+// Host side data toggle back to DATA0 e.g with clear halt
+void dcd_port_toggle_reset(uint8_t ep_addr);
+
+void dcd_port_stat(dcd_port_stat_t* stat);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _DCD_PORT_H_ */
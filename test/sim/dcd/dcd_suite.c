@@ -0,0 +1,809 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "dcd_port.h"
+#include "sim_test.h"
+
+//--------------------------------------------------------------------+
+// Common device driver scenarios, run by each port against its controller model:
+// - enumerate: bus reset, descriptors, SET_ADDRESS then SET_CONFIGURATION opening the endpoints
+// - bulk burst: 1 MB each way, device transfers of 32 KB are queued again by the task
+// - short packet and zero length packet ending IN and OUT transfers
+// - isochronous OUT and IN streams of a packet per frame, if the port has an isochronous endpoint
+// - stall: unsupported request stalls control endpoint, bulk endpoints halted then cleared
+// Bulk throughput is reported with interrupts, time spent in the interrupt handler and in
+// dcd_edpt_xfer() per MB. Times are measured on the build machine, they compare drivers (and
+// changes to a driver) rather than give target cycles. Events are handled in place of usbd.
+//--------------------------------------------------------------------+
+
+#define BULK_TOTAL      (1024*1024)
+#define BULK_CHUNK      32768
+#define ISO_FRAMES      200
+#define ISO_SIZE        192
+#define TIMEOUT_FRAMES  20000
+
+enum
+{
+  EP_BULK_OUT = 0x01,
+  EP_BULK_IN  = 0x82,
+  DEV_ADDR    = 5,
+  EVENT_MAX   = 32,
+};
+
+// buffers in static memory: DMA addresses must be 32-bit
+static TU_ATTR_ALIGNED(4) uint8_t _host_buf[BULK_TOTAL];
+static TU_ATTR_ALIGNED(4) uint8_t _dev_buf[BULK_CHUNK];
+static TU_ATTR_ALIGNED(4) uint8_t _ctrl_buf[256];
+static TU_ATTR_ALIGNED(4) uint8_t _iso_dev[2][ISO_SIZE];
+static TU_ATTR_ALIGNED(4) uint8_t _iso_host[2][ISO_SIZE];
+
+static uint16_t _bulk_size;
+static uint8_t  _iso_out;
+static uint8_t  _iso_in;
+
+static inline uint8_t pattern(uint32_t seed, uint32_t offset)
+{
+  return (uint8_t) ((offset + seed) * 13 + (offset >> 8));
+}
+
+//--------------------------------------------------------------------+
+// Descriptors
+//--------------------------------------------------------------------+
+
+static tusb_desc_device_t const _desc_device =
+{
+  .bLength            = sizeof(tusb_desc_device_t),
+  .bDescriptorType    = TUSB_DESC_DEVICE,
+  .bcdUSB             = 0x0200,
+  .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
+  .idVendor           = 0xCafe,
+  .idProduct          = 0x4000,
+  .bcdDevice          = 0x0100,
+  .bNumConfigurations = 1
+};
+
+// Interface with bulk OUT/IN then isochronous OUT/IN endpoints (if port has one), packet sizes are
+// those of the port
+static uint8_t  _desc_config[9 + 9 + 4*7];
+static uint16_t _desc_config_len;
+
+static void desc_config_init(void)
+{
+  uint8_t const ep_addr[4] = { EP_BULK_OUT, EP_BULK_IN, _iso_out, _iso_in };
+  uint8_t const ep_count = _iso_out ? 4 : 2;
+  uint8_t* p = _desc_config;
+
+  _desc_config_len = (uint16_t) (9 + 9 + ep_count*7);
+
+  *p++ = 9; *p++ = TUSB_DESC_CONFIGURATION;
+  *p++ = TU_U16_LOW(_desc_config_len); *p++ = TU_U16_HIGH(_desc_config_len);
+  *p++ = 1; *p++ = 1; *p++ = 0; *p++ = 0x80; *p++ = 50;
+
+  *p++ = 9; *p++ = TUSB_DESC_INTERFACE;
+  *p++ = 0; *p++ = 0; *p++ = ep_count; *p++ = TUSB_CLASS_VENDOR_SPECIFIC; *p++ = 0; *p++ = 0; *p++ = 0;
+
+  for ( uint8_t i = 0; i < ep_count; i++ )
+  {
+    uint16_t const size = (i < 2) ? _bulk_size : ISO_SIZE;
+
+    *p++ = 7; *p++ = TUSB_DESC_ENDPOINT;
+    *p++ = ep_addr[i];
+    *p++ = (i < 2) ? TUSB_XFER_BULK : TUSB_XFER_ISOCHRONOUS;
+    *p++ = TU_U16_LOW(size); *p++ = TU_U16_HIGH(size);
+    *p++ = (i < 2) ? 0 : 1;
+  }
+}
+
+// Endpoints of the configuration are opened as usbd does
+static void configure(void)
+{
+  if ( dcd_edpt_plan ) dcd_edpt_plan(0, (tusb_desc_configuration_t const*) _desc_config);
+
+  uint8_t const* p = _desc_config;
+  uint8_t const* end = _desc_config + _desc_config_len;
+
+  while ( p < end )
+  {
+    if ( tu_desc_type(p) == TUSB_DESC_ENDPOINT ) CHECK(dcd_edpt_open(0, (tusb_desc_endpoint_t const*) p));
+    p = tu_desc_next(p);
+  }
+}
+
+//--------------------------------------------------------------------+
+// Events, in place of usbd
+//--------------------------------------------------------------------+
+
+static struct
+{
+  dcd_event_t queue[EVENT_MAX];
+  uint8_t count;
+
+  bool    bus_reset;
+  uint8_t speed;
+
+  // control
+  tusb_control_request_t request;
+  uint16_t ctrl_len;            // data stage length
+  bool     ctrl_data;           // in data stage
+  bool     ctrl_zlp;            // data stage ends with zero length packet
+  bool     ctrl_done;
+
+  // other endpoints: last completion
+  bool     done[16][2];
+  uint32_t xferred[16][2];
+
+  uint64_t xfer_ns;             // time spent in dcd_edpt_xfer()
+} _ev;
+
+void dcd_event_handler(dcd_event_t const * event, bool in_isr)
+{
+  (void) in_isr;
+  if ( _ev.count >= EVENT_MAX )
+  {
+    printf("  event queue overflow\n");
+    abort();
+  }
+  _ev.queue[_ev.count++] = *event;
+}
+
+void dcd_event_bus_signal (uint8_t rhport, dcd_eventid_t eid, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = eid };
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_bus_reset (uint8_t rhport, tusb_speed_t speed, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_BUS_RESET };
+  event.bus_reset.speed = speed;
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_sof(uint8_t rhport, uint32_t frame_count, bool microframe, bool in_isr)
+{
+  (void) rhport; (void) frame_count; (void) microframe; (void) in_isr;
+}
+
+void dcd_event_setup_received(uint8_t rhport, uint8_t const * setup, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_SETUP_RECEIVED };
+  memcpy(&event.setup_received, setup, 8);
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_xfer_complete (uint8_t rhport, uint8_t ep_addr, uint32_t xferred_bytes, uint8_t result, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_XFER_COMPLETE };
+  event.xfer_complete.ep_addr = ep_addr;
+  event.xfer_complete.len     = xferred_bytes;
+  event.xfer_complete.result  = result;
+  dcd_event_handler(&event, in_isr);
+}
+
+static bool dev_xfer(uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  _ev.done[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = false;
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  bool const ret = dcd_edpt_xfer(0, ep_addr, buf, len);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  _ev.xfer_ns += (uint64_t) (t1.tv_sec - t0.tv_sec)*1000000000u + (uint64_t) (t1.tv_nsec - t0.tv_nsec);
+  return ret;
+}
+
+static void control_stall(void)
+{
+  dcd_edpt_stall(0, 0);
+  dcd_edpt_stall(0, TUSB_DIR_IN_MASK);
+}
+
+static void control_in(void const* data, uint16_t len)
+{
+  _ev.ctrl_len  = tu_min16(len, _ev.request.wLength);
+  _ev.ctrl_zlp  = (_ev.ctrl_len < _ev.request.wLength) && (_ev.ctrl_len % CFG_TUD_ENDPOINT0_SIZE == 0);
+  _ev.ctrl_data = true;
+
+  memcpy(_ctrl_buf, data, _ev.ctrl_len);
+  CHECK(dev_xfer(TUSB_DIR_IN_MASK, _ctrl_buf, _ev.ctrl_len));
+}
+
+static void control_status(void)
+{
+  _ev.ctrl_data = false;
+  CHECK(dev_xfer(TUSB_DIR_IN_MASK, NULL, 0));
+}
+
+// Standard requests of the suite configuration, others are stalled
+static void control_setup(tusb_control_request_t const* request)
+{
+  _ev.request   = *request;
+  _ev.ctrl_done = false;
+
+  switch ( request->bRequest )
+  {
+    case TUSB_REQ_GET_DESCRIPTOR:
+      if ( tu_u16_high(request->wValue) == TUSB_DESC_DEVICE )
+      {
+        control_in(&_desc_device, sizeof(_desc_device));
+      }
+      else if ( tu_u16_high(request->wValue) == TUSB_DESC_CONFIGURATION )
+      {
+        control_in(_desc_config, _desc_config_len);
+      }
+      else
+      {
+        control_stall();
+      }
+    break;
+
+    case TUSB_REQ_SET_ADDRESS:
+      // driver sends status stage
+      _ev.ctrl_data = false;
+      dcd_set_address(0, (uint8_t) request->wValue);
+    break;
+
+    case TUSB_REQ_SET_CONFIGURATION:
+      configure();
+      control_status();
+    break;
+
+    case TUSB_REQ_CLEAR_FEATURE:
+      if ( request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_ENDPOINT && request->wValue == TUSB_REQ_FEATURE_EDPT_HALT )
+      {
+        dcd_edpt_clear_stall(0, tu_u16_low(request->wIndex));
+        control_status();
+      }
+      else
+      {
+        control_stall();
+      }
+    break;
+
+    default:
+      control_stall();
+    break;
+  }
+}
+
+static void control_complete(uint8_t ep_addr, uint32_t len)
+{
+  if ( !_ev.ctrl_data )
+  {
+    _ev.ctrl_done = true;
+    if ( dcd_edpt0_status_complete ) dcd_edpt0_status_complete(0, &_ev.request);
+    return;
+  }
+
+  if ( ep_addr == TUSB_DIR_IN_MASK && _ev.ctrl_zlp )
+  {
+    _ev.ctrl_zlp = false;
+    CHECK(dev_xfer(TUSB_DIR_IN_MASK, NULL, 0));
+    return;
+  }
+
+  CHECK(len == _ev.ctrl_len || (ep_addr == TUSB_DIR_IN_MASK && len == 0));
+
+  // status stage
+  _ev.ctrl_data = false;
+  CHECK(dev_xfer(ep_addr ^ TUSB_DIR_IN_MASK, NULL, 0));
+}
+
+//--------------------------------------------------------------------+
+// Streams: device transfers queued again by the task
+//--------------------------------------------------------------------+
+
+static struct
+{
+  bool     bulk;                // bulk burst on EP_BULK_OUT or EP_BULK_IN
+  uint8_t  bulk_ep;
+  uint32_t bulk_offset;         // of device chunk in progress
+  uint32_t bulk_errors;
+
+  bool     iso;
+  uint16_t iso_seq[2];          // device: next IN packet, last OUT packet received
+  uint32_t iso_packets[2];
+  uint32_t iso_lost[2];
+  uint32_t iso_errors;
+} _stream;
+
+static void iso_packet_fill(uint8_t* buf, uint16_t seq)
+{
+  buf[0] = tu_u16_low(seq);
+  buf[1] = tu_u16_high(seq);
+  for ( uint16_t i = 2; i < ISO_SIZE; i++ ) buf[i] = pattern(seq, i);
+}
+
+// Check packet data and its sequence number against last one: packets may be lost, never reordered
+static void iso_packet_check(uint8_t const* buf, uint32_t len, uint16_t* last, uint32_t* packets, uint32_t* lost)
+{
+  uint16_t const seq = tu_u16(buf[1], buf[0]);
+  bool ok = (len == ISO_SIZE);
+  for ( uint16_t i = 2; ok && i < ISO_SIZE; i++ ) ok = (buf[i] == pattern(seq, i));
+
+  if ( !ok || (*packets && seq <= *last) )
+  {
+    _stream.iso_errors++;
+    return;
+  }
+
+  *lost += (*packets ? (uint32_t) (seq - *last) : seq + 1u) - 1u;
+  *last = seq;
+  (*packets)++;
+}
+
+static void bulk_chunk_start(void)
+{
+  if ( _stream.bulk_ep == EP_BULK_IN )
+  {
+    for ( uint32_t i = 0; i < BULK_CHUNK; i++ ) _dev_buf[i] = pattern(0, _stream.bulk_offset + i);
+  }
+  else
+  {
+    memset(_dev_buf, 0, BULK_CHUNK);
+  }
+
+  CHECK(dev_xfer(_stream.bulk_ep, _dev_buf, BULK_CHUNK));
+}
+
+static void stream_complete(uint8_t ep_addr, uint32_t len)
+{
+  if ( _stream.bulk && ep_addr == _stream.bulk_ep )
+  {
+    if ( len != BULK_CHUNK ) _stream.bulk_errors++;
+
+    if ( ep_addr == EP_BULK_OUT )
+    {
+      for ( uint32_t i = 0; i < len; i++ )
+      {
+        if ( _dev_buf[i] != pattern(0, _stream.bulk_offset + i) ) { _stream.bulk_errors++; break; }
+      }
+    }
+
+    _stream.bulk_offset += BULK_CHUNK;
+    if ( _stream.bulk_offset < BULK_TOTAL ) bulk_chunk_start();
+  }
+
+  if ( _stream.iso && ep_addr == _iso_out )
+  {
+    iso_packet_check(_iso_dev[0], len, &_stream.iso_seq[0], &_stream.iso_packets[0], &_stream.iso_lost[0]);
+    CHECK(dev_xfer(_iso_out, _iso_dev[0], ISO_SIZE));
+  }
+
+  if ( _stream.iso && ep_addr == _iso_in )
+  {
+    iso_packet_fill(_iso_dev[1], ++_stream.iso_seq[1]);
+    CHECK(dev_xfer(_iso_in, _iso_dev[1], ISO_SIZE));
+  }
+}
+
+static void task(void)
+{
+  // events posted while handling are handled too
+  for ( uint8_t i = 0; i < _ev.count; i++ )
+  {
+    dcd_event_t const* event = &_ev.queue[i];
+
+    switch ( event->event_id )
+    {
+      case DCD_EVENT_BUS_RESET:
+        _ev.bus_reset = true;
+        _ev.speed     = event->bus_reset.speed;
+      break;
+
+      case DCD_EVENT_SETUP_RECEIVED:
+        control_setup(&event->setup_received);
+      break;
+
+      case DCD_EVENT_XFER_COMPLETE:
+      {
+        uint8_t  const ep_addr = event->xfer_complete.ep_addr;
+        uint32_t const len     = event->xfer_complete.len;
+        CHECK(event->xfer_complete.result == XFER_RESULT_SUCCESS);
+
+        if ( tu_edpt_number(ep_addr) == 0 )
+        {
+          control_complete(ep_addr, len);
+        }
+        else
+        {
+          _ev.done[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)]    = true;
+          _ev.xferred[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = len;
+          stream_complete(ep_addr, len);
+        }
+      }
+      break;
+
+      default: break;
+    }
+  }
+
+  _ev.count = 0;
+}
+
+//--------------------------------------------------------------------+
+// Helpers
+//--------------------------------------------------------------------+
+
+static bool dev_done(uint8_t ep_addr)
+{
+  return _ev.done[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+}
+
+static uint32_t dev_xferred(uint8_t ep_addr)
+{
+  return _ev.xferred[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+}
+
+static uint32_t frames(void)
+{
+  dcd_port_stat_t stat;
+  dcd_port_stat(&stat);
+  return stat.frames;
+}
+
+static bool host_done(uint8_t ep_addr)
+{
+  return !dcd_port_busy(ep_addr);
+}
+
+static bool xfer_done(uint8_t ep_addr)
+{
+  return !dcd_port_busy(ep_addr) && dev_done(ep_addr);
+}
+
+// Run until host is done with ep_addr (and device too if dev_wait), return false on timeout
+static bool run_until(uint8_t ep_addr, bool dev_wait)
+{
+  return sim_run_until(ep_addr, dev_wait ? xfer_done : host_done, dcd_port_frame, TIMEOUT_FRAMES);
+}
+
+// Host control transfer, return bytes of data stage or -1 if stalled
+static int32_t control(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength, uint8_t* data)
+{
+  tusb_control_request_t const request =
+  {
+    .bmRequestType = bmRequestType, .bRequest = bRequest, .wValue = wValue, .wIndex = wIndex, .wLength = wLength
+  };
+
+  dcd_port_control(&request, data);
+  if ( !run_until(0, false) ) return -1;
+
+  int32_t const xferred = dcd_port_xferred(0);
+  if ( xferred >= 0 ) CHECK(_ev.ctrl_done);
+  return xferred;
+}
+
+static int32_t get_descriptor(uint8_t type, uint16_t len, uint8_t* data)
+{
+  return control(0x80, TUSB_REQ_GET_DESCRIPTOR, (uint16_t) (type << 8), 0, len, data);
+}
+
+static bool scenario_result(char const* name, uint32_t errors)
+{
+  printf("  %-14s %s", name, (_errors == errors) ? "PASSED" : "FAILED");
+  return _errors == errors;
+}
+
+//--------------------------------------------------------------------+
+// Scenarios
+//--------------------------------------------------------------------+
+
+static void scenario_enumerate(void)
+{
+  uint32_t const errors = _errors;
+  uint32_t const start  = frames();
+  uint8_t data[256];
+
+  dcd_port_bus_reset();
+  CHECK(_ev.bus_reset);
+  CHECK(_ev.speed == dcd_port_info.speed);
+
+  memset(data, 0, sizeof(data));
+  CHECK(get_descriptor(TUSB_DESC_DEVICE, 64, data) == sizeof(_desc_device));
+  CHECK(memcmp(data, &_desc_device, sizeof(_desc_device)) == 0);
+
+  CHECK(control(0x00, TUSB_REQ_SET_ADDRESS, DEV_ADDR, 0, 0, NULL) == 0);
+
+  memset(data, 0, sizeof(data));
+  CHECK(get_descriptor(TUSB_DESC_CONFIGURATION, 9, data) == 9);
+  CHECK(get_descriptor(TUSB_DESC_CONFIGURATION, 255, data) == _desc_config_len);
+  CHECK(memcmp(data, _desc_config, _desc_config_len) == 0);
+
+  CHECK(control(0x00, TUSB_REQ_SET_CONFIGURATION, 1, 0, 0, NULL) == 0);
+
+  scenario_result("enumerate", errors);
+  printf("  %u frames\n", (unsigned) (frames() - start));
+}
+
+// Host transfer of BULK_TOTAL, device chunks are queued again by the task
+static void bulk_burst(uint8_t ep_addr, dcd_port_stat_t* stat)
+{
+  if ( ep_addr == EP_BULK_OUT )
+  {
+    for ( uint32_t i = 0; i < BULK_TOTAL; i++ ) _host_buf[i] = pattern(0, i);
+  }
+  else
+  {
+    memset(_host_buf, 0, BULK_TOTAL);
+  }
+
+  _stream.bulk        = true;
+  _stream.bulk_ep     = ep_addr;
+  _stream.bulk_offset = 0;
+  _stream.bulk_errors = 0;
+
+  dcd_port_stat_t start;
+  dcd_port_stat(&start);
+  _ev.xfer_ns = 0;
+
+  bulk_chunk_start();
+  dcd_port_xfer(ep_addr, _bulk_size, false, _host_buf, BULK_TOTAL);
+  run_until(ep_addr, true);
+
+  dcd_port_stat(stat);
+  stat->frames    -= start.frames;
+  stat->irq_count -= start.irq_count;
+  stat->isr_ns    -= start.isr_ns;
+
+  _stream.bulk = false;
+
+  CHECK(_stream.bulk_errors == 0);
+  CHECK(_stream.bulk_offset == BULK_TOTAL);
+  CHECK(dcd_port_xferred(ep_addr) == BULK_TOTAL);
+
+  if ( ep_addr == EP_BULK_IN )
+  {
+    for ( uint32_t i = 0; i < BULK_TOTAL; i++ )
+    {
+      if ( _host_buf[i] != pattern(0, i) ) { CHECK(_host_buf[i] == pattern(0, i)); break; }
+    }
+  }
+}
+
+static void scenario_bulk(void)
+{
+  uint32_t const errors = _errors;
+  double const mb = (double) BULK_TOTAL / (1024*1024);
+
+  dcd_port_stat_t in, out;
+  bulk_burst(EP_BULK_IN, &in);
+  uint64_t const in_xfer_ns = _ev.xfer_ns;
+  bulk_burst(EP_BULK_OUT, &out);
+  uint64_t const out_xfer_ns = _ev.xfer_ns;
+
+  scenario_result("bulk burst", errors);
+  printf("\n");
+
+  dcd_port_stat_t const* stat[2] = { &in, &out };
+  uint64_t const xfer_ns[2] = { in_xfer_ns, out_xfer_ns };
+
+  for ( uint8_t i = 0; i < 2; i++ )
+  {
+    double const secs = stat[i]->frames * dcd_port_info.frame_us * 1e-6;
+    printf("    %-3s %6.0f KB/s, %6.0f interrupts/MB, handler %6.0f us/MB, dcd_edpt_xfer %4.0f us/MB\n",
+           i ? "OUT" : "IN", BULK_TOTAL / 1024 / secs, stat[i]->irq_count / mb, stat[i]->isr_ns / 1000 / mb,
+           xfer_ns[i] / 1000 / mb);
+  }
+}
+
+static void scenario_short_zlp(void)
+{
+  uint32_t const errors = _errors;
+  uint16_t const mps = _bulk_size;
+
+  for ( uint32_t i = 0; i < 4u*mps; i++ ) _dev_buf[i] = pattern(1, i);
+
+  // IN ends with short packet
+  memset(_host_buf, 0, 4u*mps);
+  CHECK(dev_xfer(EP_BULK_IN, _dev_buf, mps + 10));
+  dcd_port_xfer(EP_BULK_IN, mps, false, _host_buf, 4u*mps);
+  run_until(EP_BULK_IN, true);
+  CHECK(dcd_port_xferred(EP_BULK_IN) == mps + 10 && dev_xferred(EP_BULK_IN) == mps + 10u);
+  CHECK(memcmp(_host_buf, _dev_buf, mps + 10) == 0);
+
+  // IN of full packets ended by zero length packet queued once it is complete
+  memset(_host_buf, 0, 4u*mps);
+  CHECK(dev_xfer(EP_BULK_IN, _dev_buf, (uint16_t) (2*mps)));
+  dcd_port_xfer(EP_BULK_IN, mps, false, _host_buf, 4u*mps);
+  for ( uint32_t i = 0; i < TIMEOUT_FRAMES && !dev_done(EP_BULK_IN); i++ ) dcd_port_frame();
+  CHECK(dev_xferred(EP_BULK_IN) == 2u*mps);
+  CHECK(dcd_port_busy(EP_BULK_IN));
+  CHECK(dev_xfer(EP_BULK_IN, NULL, 0));
+  run_until(EP_BULK_IN, true);
+  CHECK(dcd_port_xferred(EP_BULK_IN) == 2*mps && dev_xferred(EP_BULK_IN) == 0);
+  CHECK(memcmp(_host_buf, _dev_buf, 2u*mps) == 0);
+
+  // IN zero length packet alone
+  CHECK(dev_xfer(EP_BULK_IN, NULL, 0));
+  dcd_port_xfer(EP_BULK_IN, mps, false, _host_buf, mps);
+  run_until(EP_BULK_IN, true);
+  CHECK(dcd_port_xferred(EP_BULK_IN) == 0);
+
+  // OUT ends with short packet
+  for ( uint32_t i = 0; i < 4u*mps; i++ ) _host_buf[i] = pattern(2, i);
+  memset(_dev_buf, 0, 4u*mps);
+  CHECK(dev_xfer(EP_BULK_OUT, _dev_buf, (uint16_t) (4*mps)));
+  dcd_port_xfer(EP_BULK_OUT, mps, false, _host_buf, mps + 10u);
+  run_until(EP_BULK_OUT, true);
+  CHECK(dev_xferred(EP_BULK_OUT) == mps + 10u);
+  CHECK(memcmp(_host_buf, _dev_buf, mps + 10) == 0);
+
+  // OUT of full packets then zero length packet
+  memset(_dev_buf, 0, 4u*mps);
+  CHECK(dev_xfer(EP_BULK_OUT, _dev_buf, (uint16_t) (4*mps)));
+  dcd_port_xfer(EP_BULK_OUT, mps, false, _host_buf, 2u*mps);
+  run_until(EP_BULK_OUT, false);
+  CHECK(!dev_done(EP_BULK_OUT));
+  dcd_port_xfer(EP_BULK_OUT, mps, false, NULL, 0);
+  run_until(EP_BULK_OUT, true);
+  CHECK(dev_xferred(EP_BULK_OUT) == 2u*mps);
+  CHECK(memcmp(_host_buf, _dev_buf, 2u*mps) == 0);
+
+  // OUT zero length packet alone
+  CHECK(dev_xfer(EP_BULK_OUT, _dev_buf, (uint16_t) (4*mps)));
+  dcd_port_xfer(EP_BULK_OUT, mps, false, NULL, 0);
+  run_until(EP_BULK_OUT, true);
+  CHECK(dev_xferred(EP_BULK_OUT) == 0);
+
+  scenario_result("short, ZLP", errors);
+  printf("\n");
+}
+
+static void scenario_iso(void)
+{
+  uint32_t const errors = _errors;
+
+  memset(&_stream, 0, sizeof(_stream));
+  _stream.iso = true;
+
+  // host side sequence and received packets
+  uint16_t host_seq[2] = { 0, 0 };
+  uint32_t host_packets = 0, host_lost = 0;
+
+  CHECK(dev_xfer(_iso_out, _iso_dev[0], ISO_SIZE));
+  iso_packet_fill(_iso_dev[1], 0);
+  CHECK(dev_xfer(_iso_in, _iso_dev[1], ISO_SIZE));
+
+  iso_packet_fill(_iso_host[0], 0);
+  dcd_port_xfer(_iso_out, ISO_SIZE, true, _iso_host[0], ISO_SIZE);
+  dcd_port_xfer(_iso_in , ISO_SIZE, true, _iso_host[1], ISO_SIZE);
+
+  for ( uint32_t f = 0; f < ISO_FRAMES; f++ )
+  {
+    dcd_port_frame();
+
+    if ( !dcd_port_busy(_iso_out) )
+    {
+      iso_packet_fill(_iso_host[0], ++host_seq[0]);
+      dcd_port_xfer(_iso_out, ISO_SIZE, true, _iso_host[0], ISO_SIZE);
+    }
+
+    if ( !dcd_port_busy(_iso_in) )
+    {
+      iso_packet_check(_iso_host[1], (uint32_t) dcd_port_xferred(_iso_in), &host_seq[1], &host_packets, &host_lost);
+      dcd_port_xfer(_iso_in, ISO_SIZE, true, _iso_host[1], ISO_SIZE);
+    }
+  }
+
+  _stream.iso = false;
+
+  // a packet per frame: startup may take a few
+  CHECK(_stream.iso_errors == 0);
+  CHECK(_stream.iso_packets[0] + 4 >= ISO_FRAMES && _stream.iso_lost[0] <= 1);
+  CHECK(host_packets + 4 >= ISO_FRAMES && host_lost <= 1);
+
+  scenario_result("iso stream", errors);
+  printf("  %u frames: OUT %u packets %u lost, IN %u packets %u lost\n", ISO_FRAMES,
+         (unsigned) _stream.iso_packets[0], (unsigned) _stream.iso_lost[0], (unsigned) host_packets, (unsigned) host_lost);
+}
+
+static void scenario_stall(void)
+{
+  uint32_t const errors = _errors;
+  uint16_t const mps = _bulk_size;
+  uint8_t data[64];
+
+  dcd_port_stat_t start, end;
+  dcd_port_stat(&start);
+
+  // unsupported request, next one works
+  CHECK(get_descriptor(TUSB_DESC_STRING, 255, _host_buf) == -1);
+  CHECK(get_descriptor(TUSB_DESC_DEVICE, 64, data) == sizeof(_desc_device));
+
+  // halted endpoint is cleared with data toggle back to DATA0 on both sides
+  uint8_t const ep_addr[2] = { EP_BULK_IN, EP_BULK_OUT };
+  for ( uint8_t i = 0; i < 2; i++ )
+  {
+    uint8_t const ep = ep_addr[i];
+
+    dcd_edpt_stall(0, ep);
+    dcd_port_xfer(ep, mps, false, _host_buf, 100);
+    run_until(ep, false);
+    CHECK(dcd_port_xferred(ep) == -1);
+
+    CHECK(control(0x02, TUSB_REQ_CLEAR_FEATURE, TUSB_REQ_FEATURE_EDPT_HALT, ep, 0, NULL) == 0);
+    dcd_port_toggle_reset(ep);
+
+    for ( uint32_t n = 0; n < 100; n++ ) _host_buf[n] = _dev_buf[n] = pattern(3, n);
+    if ( ep == EP_BULK_IN )
+    {
+      memset(_host_buf, 0, 100);
+      CHECK(dev_xfer(ep, _dev_buf, 100));
+      dcd_port_xfer(ep, mps, false, _host_buf, 4u*mps);
+    }
+    else
+    {
+      memset(_dev_buf, 0, 100);
+      CHECK(dev_xfer(ep, _dev_buf, (uint16_t) (4*mps)));
+      dcd_port_xfer(ep, mps, false, _host_buf, 100);
+    }
+    run_until(ep, true);
+    CHECK(dcd_port_xferred(ep) == 100 && dev_xferred(ep) == 100);
+    CHECK(memcmp(_host_buf, _dev_buf, 100) == 0);
+  }
+
+  dcd_port_stat(&end);
+  CHECK(end.toggle_errors == start.toggle_errors);
+
+  scenario_result("stall, clear", errors);
+  printf("\n");
+}
+
+int main(void)
+{
+  _bulk_size = dcd_port_info.bulk_size;
+  _iso_out   = dcd_port_info.iso_epnum;
+  _iso_in    = _iso_out ? (dcd_port_info.iso_epnum | TUSB_DIR_IN_MASK) : 0;
+  desc_config_init();
+
+  printf("%s device driver (%s speed)\n", dcd_port_info.name, dcd_port_info.speed == TUSB_SPEED_HIGH ? "high" : "full");
+
+  dcd_port_init(task);
+
+  scenario_enumerate();
+  scenario_bulk();
+  scenario_short_zlp();
+  if ( _iso_out )
+  {
+    scenario_iso();
+  }
+  else
+  {
+    printf("  %-14s skipped, no isochronous endpoint\n", "iso stream");
+  }
+  scenario_stall();
+
+  return sim_result();
+}
@@ -0,0 +1,98 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "dwc2_model.h"
+#include "dcd_port.h"
+
+//--------------------------------------------------------------------+
+// DWC2 high speed core with descriptor DMA. Endpoint packet size and type are taken by the model
+// from endpoint registers, data toggle is not modeled.
+//--------------------------------------------------------------------+
+
+dcd_port_info_t const dcd_port_info =
+{
+  .name      = "dwc2",
+  .speed     = TUSB_SPEED_HIGH,
+  .frame_us  = 125,
+  .bulk_size = 512,
+  .iso_epnum = 3,
+};
+
+void dcd_port_init(dcd_port_task_t task)
+{
+  dwc2_model_init(true, task);
+  dcd_init(0);
+  dcd_int_enable(0);
+}
+
+void dcd_port_bus_reset(void)
+{
+  dwc2_model_bus_reset();
+}
+
+void dcd_port_frame(void)
+{
+  dwc2_model_uframe();
+}
+
+void dcd_port_control(tusb_control_request_t const* request, uint8_t* data)
+{
+  dwc2_model_control(request, data);
+}
+
+void dcd_port_xfer(uint8_t ep_addr, uint16_t mps, bool iso, uint8_t* buf, uint32_t len)
+{
+  (void) mps;
+  (void) iso;
+  dwc2_model_xfer(ep_addr, buf, len, false);
+}
+
+bool dcd_port_busy(uint8_t ep_addr)
+{
+  return dwc2_model_busy(ep_addr);
+}
+
+int32_t dcd_port_xferred(uint8_t ep_addr)
+{
+  return dwc2_model_xferred(ep_addr);
+}
+
+void dcd_port_toggle_reset(uint8_t ep_addr)
+{
+  (void) ep_addr;
+}
+
+void dcd_port_stat(dcd_port_stat_t* stat)
+{
+  dwc2_model_stat_t const* model = dwc2_model_stat();
+
+  stat->frames        = model->uframes;
+  stat->irq_count     = model->isr_count;
+  stat->isr_ns        = model->isr_ns;
+  stat->toggle_errors = 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "stm32f0xx.h"
+#include "fsdev_model.h"
+#include "dcd_port.h"
+
+//--------------------------------------------------------------------+
+// STM32F072 USB (FSDEV) with CPU at 48 MHz and usbd task run every 100 us. Driver has no
+// isochronous support, control transfer with OUT data stage is not modeled. Bulk OUT and IN
+// endpoints have different numbers: both are double buffered.
+//--------------------------------------------------------------------+
+
+#define CPU_MHZ    48
+#define TASK_BITS  1200
+
+dcd_port_info_t const dcd_port_info =
+{
+  .name      = "fsdev",
+  .speed     = TUSB_SPEED_FULL,
+  .frame_us  = 1000,
+  .bulk_size = 64,
+  .iso_epnum = 0,
+};
+
+// host side bytes transferred, model reports them on completion
+static uint32_t _xferred[8][2];
+
+static void host_complete(uint8_t ep_addr, uint32_t xferred)
+{
+  // control transfer is reported as 0x80
+  if ( tu_edpt_number(ep_addr) == 0 ) ep_addr = 0;
+  _xferred[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = xferred;
+}
+
+bool tud_inited(void)
+{
+  return true;
+}
+
+void dcd_port_init(dcd_port_task_t task)
+{
+  fsdev_model_init(task, CPU_MHZ, TASK_BITS);
+  fsdev_model_host_callback(host_complete);
+  dcd_init(0);
+  dcd_int_enable(0);
+}
+
+void dcd_port_bus_reset(void)
+{
+  fsdev_model_bus_reset();
+}
+
+void dcd_port_frame(void)
+{
+  fsdev_model_frame();
+}
+
+void dcd_port_control(tusb_control_request_t const* request, uint8_t* data)
+{
+  if ( request->wLength && request->bmRequestType_bit.direction == TUSB_DIR_OUT )
+  {
+    fprintf(stderr, "control OUT data stage is not modeled\n");
+    abort();
+  }
+
+  _xferred[0][0] = 0;
+  fsdev_model_control((uint8_t const*) request, data);
+}
+
+void dcd_port_xfer(uint8_t ep_addr, uint16_t mps, bool iso, uint8_t* buf, uint32_t len)
+{
+  (void) iso;
+  _xferred[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = 0;
+  fsdev_model_host_xfer(ep_addr, mps, buf, len);
+}
+
+bool dcd_port_busy(uint8_t ep_addr)
+{
+  return fsdev_model_host_busy(ep_addr);
+}
+
+int32_t dcd_port_xferred(uint8_t ep_addr)
+{
+  if ( fsdev_model_host_stalled(ep_addr) ) return -1;
+  return (int32_t) _xferred[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+}
+
+void dcd_port_toggle_reset(uint8_t ep_addr)
+{
+  fsdev_model_toggle_reset(ep_addr);
+}
+
+void dcd_port_stat(dcd_port_stat_t* stat)
+{
+  fsdev_model_stat_t const* model = fsdev_model_stat();
+
+  stat->frames        = model->frames;
+  stat->irq_count     = model->irq_count;
+  stat->isr_ns        = model->isr_ns;
+  stat->toggle_errors = model->toggle_errors;
+}
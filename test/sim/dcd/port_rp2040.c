@@ -0,0 +1,97 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "rp2040_model.h"
+#include "dcd_port.h"
+
+//--------------------------------------------------------------------+
+// RP2040 full speed device with 10 us interrupt latency, data toggle is checked by the model
+//--------------------------------------------------------------------+
+
+#define ISR_BITS  120
+
+dcd_port_info_t const dcd_port_info =
+{
+  .name      = "rp2040",
+  .speed     = TUSB_SPEED_FULL,
+  .frame_us  = 1000,
+  .bulk_size = 64,
+  .iso_epnum = 3,
+};
+
+void dcd_port_init(dcd_port_task_t task)
+{
+  rp2040_model_init(NULL, task, ISR_BITS);
+  dcd_init(0);
+  dcd_int_enable(0);
+}
+
+void dcd_port_bus_reset(void)
+{
+  rp2040_model_dev_bus_reset();
+}
+
+void dcd_port_frame(void)
+{
+  rp2040_model_frame();
+}
+
+void dcd_port_control(tusb_control_request_t const* request, uint8_t* data)
+{
+  rp2040_model_dev_control((uint8_t const*) request, data);
+}
+
+void dcd_port_xfer(uint8_t ep_addr, uint16_t mps, bool iso, uint8_t* buf, uint32_t len)
+{
+  rp2040_model_dev_xfer(ep_addr, mps, iso, buf, len);
+}
+
+bool dcd_port_busy(uint8_t ep_addr)
+{
+  return rp2040_model_dev_busy(ep_addr);
+}
+
+int32_t dcd_port_xferred(uint8_t ep_addr)
+{
+  return rp2040_model_dev_stalled(ep_addr) ? -1 : (int32_t) rp2040_model_dev_xferred(ep_addr);
+}
+
+void dcd_port_toggle_reset(uint8_t ep_addr)
+{
+  rp2040_model_dev_toggle_reset(ep_addr);
+}
+
+void dcd_port_stat(dcd_port_stat_t* stat)
+{
+  rp2040_model_stat_t const* model = rp2040_model_stat();
+
+  stat->frames        = model->frames;
+  stat->irq_count     = model->irq_count;
+  stat->isr_ns        = model->isr_ns;
+  stat->toggle_errors = model->toggle_errors;
+}
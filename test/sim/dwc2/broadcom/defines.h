@@ -0,0 +1,62 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _BROADCOM_DEFINES_H_
+#define _BROADCOM_DEFINES_H_
+
+//--------------------------------------------------------------------+
+// Stand-in of the Broadcom port headers used by dwc2_bcm.h, core registers are memory of
+// the controller model (dwc2_model.c)
+//--------------------------------------------------------------------+
+
+#include "dwc2_model.h"
+
+#define USB_OTG_GLOBAL_BASE   (&dwc2_model_regs)
+#define USB_IRQn              73
+
+// Status bits the driver busy-waits on: the model advances on each read
+#undef  GRSTCTL_CSRST
+#define GRSTCTL_CSRST           (dwc2_model_poll(), GRSTCTL_CSRST_Msk)
+
+#undef  GRSTCTL_AHBIDL
+#define GRSTCTL_AHBIDL          (dwc2_model_poll(), GRSTCTL_AHBIDL_Msk)
+
+#undef  GRSTCTL_TXFFLSH_Msk
+#define GRSTCTL_TXFFLSH_Msk     (dwc2_model_poll(), 0x1UL << GRSTCTL_TXFFLSH_Pos)
+
+#undef  DIEPINT_INEPNE
+#define DIEPINT_INEPNE          (dwc2_model_poll(), DIEPINT_INEPNE_Msk)
+
+#undef  DIEPINT_EPDISD_Msk
+#define DIEPINT_EPDISD_Msk      (dwc2_model_poll(), 0x1UL << DIEPINT_EPDISD_Pos)
+
+#undef  GINTSTS_BOUTNAKEFF_Msk
+#define GINTSTS_BOUTNAKEFF_Msk  (dwc2_model_poll(), 0x1UL << GINTSTS_BOUTNAKEFF_Pos)
+
+#undef  DOEPINT_EPDISD_Msk
+#define DOEPINT_EPDISD_Msk      (dwc2_model_poll(), 0x1UL << DOEPINT_EPDISD_Pos)
+
+#endif /* _BROADCOM_DEFINES_H_ */
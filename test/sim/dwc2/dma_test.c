@@ -0,0 +1,533 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "sim_test.h"
+#include "dwc2_model.h"
+
+//--------------------------------------------------------------------+
+// DWC2 device driver with DMA against the controller model, run with descriptor DMA then with
+// buffer DMA (core reports no descriptor support). Control, bulk, zero length packet, unaligned
+// buffer and FIFO transfers whose data wraps around are checked, bulk throughput and interrupts
+// per MB are reported. The events the driver posts are handled by a minimal control stage
+// machine in place of usbd.
+//--------------------------------------------------------------------+
+
+#define TIMEOUT_UFRAMES   100000
+#define BULK_TOTAL        (1024*1024)
+#define BULK_CHUNK        32768
+
+enum
+{
+  EP_BULK_IN   = 0x81,
+  EP_BULK_OUT  = 0x01,
+  EP_ISO_IN    = 0x82,
+  EP_FIFO_OUT  = 0x03,
+};
+
+enum
+{
+  BULK_SIZE = 512,
+  ISO_SIZE  = 192,
+};
+
+// buffers in static memory: DMA addresses must be 32-bit
+static TU_ATTR_ALIGNED(4) uint8_t _dev_buf[BULK_CHUNK + 64];
+static TU_ATTR_ALIGNED(4) uint8_t _host_buf[BULK_CHUNK + 64];
+static TU_ATTR_ALIGNED(4) uint8_t _ctrl_buf[256];
+static TU_ATTR_ALIGNED(4) uint8_t _ff_buf[3000];
+
+//--------------------------------------------------------------------+
+// Events, in place of usbd
+//--------------------------------------------------------------------+
+
+enum { EVENT_MAX = 32 };
+
+static struct
+{
+  dcd_event_t queue[EVENT_MAX];
+  uint8_t count;
+
+  bool bus_reset;
+
+  // control
+  tusb_control_request_t request;
+  uint16_t ctrl_len;            // data stage length
+  bool     ctrl_data;           // in data stage
+  bool     ctrl_zlp;            // data stage ends with zero length packet
+  bool     ctrl_done;
+
+  // other endpoints: last completion
+  bool     done[8][2];
+  uint32_t xferred[8][2];
+} _ev;
+
+void dcd_event_handler(dcd_event_t const * event, bool in_isr)
+{
+  (void) in_isr;
+  if ( _ev.count < EVENT_MAX ) _ev.queue[_ev.count++] = *event;
+}
+
+void dcd_event_bus_signal (uint8_t rhport, dcd_eventid_t eid, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = eid };
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_bus_reset (uint8_t rhport, tusb_speed_t speed, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_BUS_RESET };
+  event.bus_reset.speed = speed;
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_sof(uint8_t rhport, uint32_t frame_count, bool microframe, bool in_isr)
+{
+  (void) rhport; (void) frame_count; (void) microframe; (void) in_isr;
+}
+
+void dcd_event_setup_received(uint8_t rhport, uint8_t const * setup, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_SETUP_RECEIVED };
+  memcpy(&event.setup_received, setup, 8);
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_xfer_complete (uint8_t rhport, uint8_t ep_addr, uint32_t xferred_bytes, uint8_t result, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_XFER_COMPLETE };
+  event.xfer_complete.ep_addr = ep_addr;
+  event.xfer_complete.len     = xferred_bytes;
+  event.xfer_complete.result  = result;
+  dcd_event_handler(&event, in_isr);
+}
+
+// Control request: IN data is a pattern of wValue bytes, OUT data is received in _ctrl_buf
+static void control_setup(tusb_control_request_t const* request)
+{
+  _ev.request   = *request;
+  _ev.ctrl_done = false;
+
+  if ( request->wLength == 0 )
+  {
+    _ev.ctrl_data = false;
+    dcd_edpt_xfer(0, 0x80, NULL, 0);
+  }
+  else if ( request->bmRequestType_bit.direction == TUSB_DIR_IN )
+  {
+    _ev.ctrl_len  = tu_min16(request->wValue, request->wLength);
+    _ev.ctrl_zlp  = (_ev.ctrl_len < request->wLength) && (_ev.ctrl_len % CFG_TUD_ENDPOINT0_SIZE == 0);
+    _ev.ctrl_data = true;
+
+    for ( uint16_t i = 0; i < _ev.ctrl_len; i++ ) _ctrl_buf[i] = (uint8_t) (i*7 + 1);
+    dcd_edpt_xfer(0, 0x80, _ctrl_buf, _ev.ctrl_len);
+  }
+  else
+  {
+    _ev.ctrl_len  = request->wLength;
+    _ev.ctrl_data = true;
+    memset(_ctrl_buf, 0, sizeof(_ctrl_buf));
+    dcd_edpt_xfer(0, 0x00, _ctrl_buf, _ev.ctrl_len);
+  }
+}
+
+static void control_complete(uint8_t ep_addr, uint32_t len)
+{
+  if ( !_ev.ctrl_data )
+  {
+    _ev.ctrl_done = true;
+    return;
+  }
+
+  if ( ep_addr == 0x80 && _ev.ctrl_zlp )
+  {
+    _ev.ctrl_zlp = false;
+    dcd_edpt_xfer(0, 0x80, NULL, 0);
+    return;
+  }
+
+  CHECK(len == _ev.ctrl_len || (ep_addr == 0x80 && len == 0));
+
+  // status stage
+  _ev.ctrl_data = false;
+  dcd_edpt_xfer(0, ep_addr ^ TUSB_DIR_IN_MASK, NULL, 0);
+}
+
+static void task(void)
+{
+  for ( uint8_t i = 0; i < _ev.count; i++ )
+  {
+    dcd_event_t const* event = &_ev.queue[i];
+
+    switch ( event->event_id )
+    {
+      case DCD_EVENT_BUS_RESET:
+        _ev.bus_reset = true;
+        CHECK(event->bus_reset.speed == TUSB_SPEED_HIGH);
+      break;
+
+      case DCD_EVENT_SETUP_RECEIVED:
+        control_setup(&event->setup_received);
+      break;
+
+      case DCD_EVENT_XFER_COMPLETE:
+      {
+        uint8_t const ep_addr = event->xfer_complete.ep_addr;
+        CHECK(event->xfer_complete.result == XFER_RESULT_SUCCESS);
+
+        if ( tu_edpt_number(ep_addr) == 0 )
+        {
+          control_complete(ep_addr, event->xfer_complete.len);
+        }else
+        {
+          _ev.done[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)]    = true;
+          _ev.xferred[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = event->xfer_complete.len;
+        }
+      }
+      break;
+
+      default: break;
+    }
+  }
+
+  _ev.count = 0;
+}
+
+//--------------------------------------------------------------------+
+// Helpers
+//--------------------------------------------------------------------+
+
+static bool dev_done(uint8_t ep_addr)
+{
+  return _ev.done[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+}
+
+static uint32_t dev_xferred(uint8_t ep_addr)
+{
+  return _ev.xferred[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+}
+
+static void dev_xfer(uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  _ev.done[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = false;
+  CHECK(dcd_edpt_xfer(0, ep_addr, buf, len));
+}
+
+static void dev_xfer_fifo(uint8_t ep_addr, tu_fifo_t* ff, uint16_t len)
+{
+  _ev.done[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = false;
+  CHECK(dcd_edpt_xfer_fifo(0, ep_addr, ff, len));
+}
+
+static bool xfer_done(uint8_t ep_addr)
+{
+  return !dwc2_model_busy(ep_addr) && dev_done(ep_addr);
+}
+
+// Run until host and device are both done with ep_addr
+static bool run_xfer(uint8_t ep_addr)
+{
+  return sim_run_until(ep_addr, xfer_done, dwc2_model_uframe, TIMEOUT_UFRAMES);
+}
+
+static void fill(uint8_t* buf, uint32_t len, uint32_t seed)
+{
+  for ( uint32_t i = 0; i < len; i++ ) buf[i] = (uint8_t) ((i + seed) * 13 + (i >> 8));
+}
+
+static void open_edpt(uint8_t ep_addr, uint8_t type, uint16_t size)
+{
+  tusb_desc_endpoint_t const desc =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep_addr,
+    .bmAttributes     = { .xfer = type },
+    .wMaxPacketSize   = size,
+    .bInterval        = 1
+  };
+
+  CHECK(dcd_edpt_open(0, &desc));
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+static void test_control(void)
+{
+  // IN: multiple packets ending with short one, with zero length packet, exact length
+  uint16_t const in_len[][2] = { { 150, 200 }, { 128, 200 }, { 64, 64 }, { 18, 64 } };
+
+  for ( size_t t = 0; t < TU_ARRAY_SIZE(in_len); t++ )
+  {
+    tusb_control_request_t const request =
+    {
+      .bmRequestType = 0xC0, .bRequest = 1, .wValue = in_len[t][0], .wIndex = 0, .wLength = in_len[t][1]
+    };
+
+    uint8_t data[256];
+    memset(data, 0, sizeof(data));
+    dwc2_model_control(&request, data);
+
+    for ( uint32_t i = 0; i < 100 && dwc2_model_busy(0); i++ ) dwc2_model_uframe();
+
+    CHECK(!dwc2_model_busy(0));
+    CHECK(dwc2_model_xferred(0) == in_len[t][0]);
+    CHECK(_ev.ctrl_done);
+    for ( uint16_t i = 0; i < in_len[t][0]; i++ ) CHECK(data[i] == (uint8_t) (i*7 + 1));
+  }
+
+  // OUT: 100 bytes
+  {
+    tusb_control_request_t const request = { .bmRequestType = 0x40, .bRequest = 2, .wLength = 100 };
+    uint8_t data[100];
+    fill(data, sizeof(data), 3);
+    dwc2_model_control(&request, data);
+
+    for ( uint32_t i = 0; i < 100 && dwc2_model_busy(0); i++ ) dwc2_model_uframe();
+
+    CHECK(!dwc2_model_busy(0));
+    CHECK(_ev.ctrl_done);
+    CHECK(memcmp(_ctrl_buf, data, sizeof(data)) == 0);
+  }
+
+  // no data
+  {
+    tusb_control_request_t const request = { .bmRequestType = 0x40, .bRequest = 3 };
+    dwc2_model_control(&request, NULL);
+
+    for ( uint32_t i = 0; i < 100 && dwc2_model_busy(0); i++ ) dwc2_model_uframe();
+
+    CHECK(!dwc2_model_busy(0));
+    CHECK(_ev.ctrl_done);
+  }
+}
+
+// Return microframes taken
+static uint32_t bulk_stream(uint8_t ep_addr)
+{
+  uint32_t const start = dwc2_model_stat()->uframes;
+
+  for ( uint32_t offset = 0; offset < BULK_TOTAL; offset += BULK_CHUNK )
+  {
+    if ( ep_addr == EP_BULK_IN )
+    {
+      fill(_dev_buf, BULK_CHUNK, offset);
+      memset(_host_buf, 0, BULK_CHUNK);
+      dev_xfer(ep_addr, _dev_buf, BULK_CHUNK);
+    }else
+    {
+      fill(_host_buf, BULK_CHUNK, offset);
+      memset(_dev_buf, 0, BULK_CHUNK);
+      dev_xfer(ep_addr, _dev_buf, BULK_CHUNK);
+    }
+    dwc2_model_xfer(ep_addr, _host_buf, BULK_CHUNK, false);
+
+    if ( !run_xfer(ep_addr) ) break;
+
+    CHECK(dev_xferred(ep_addr) == BULK_CHUNK);
+    CHECK(memcmp(_dev_buf, _host_buf, BULK_CHUNK) == 0);
+  }
+
+  return dwc2_model_stat()->uframes - start;
+}
+
+static void test_bulk(bool desc)
+{
+  static char const* const name[] = { "buffer", "descriptor" };
+
+  dwc2_model_stat_clear();
+  uint32_t const uframes = bulk_stream(EP_BULK_IN);
+  uint32_t const in_isr  = dwc2_model_stat()->isr_count;
+
+  dwc2_model_stat_clear();
+  uint32_t const out_uframes = bulk_stream(EP_BULK_OUT);
+  uint32_t const out_isr     = dwc2_model_stat()->isr_count;
+
+  double const mb = (double) BULK_TOTAL / (1024*1024);
+  printf("  %-10s DMA bulk IN : %6.1f MB/s, %5.1f interrupts/MB\n", name[desc], mb / (uframes*125e-6), in_isr / mb);
+  printf("  %-10s DMA bulk OUT: %6.1f MB/s, %5.1f interrupts/MB\n", name[desc], mb / (out_uframes*125e-6), out_isr / mb);
+
+  // zero length packet
+  dev_xfer(EP_BULK_IN, _dev_buf, 0);
+  dwc2_model_xfer(EP_BULK_IN, _host_buf, BULK_SIZE, false);
+  run_xfer(EP_BULK_IN);
+  CHECK(dwc2_model_xferred(EP_BULK_IN) == 0 && dev_xferred(EP_BULK_IN) == 0);
+
+  dev_xfer(EP_BULK_OUT, _dev_buf, BULK_SIZE);
+  dwc2_model_xfer(EP_BULK_OUT, _host_buf, 0, true);
+  run_xfer(EP_BULK_OUT);
+  CHECK(dev_xferred(EP_BULK_OUT) == 0);
+
+  // short packet ends OUT transfer
+  fill(_host_buf, 700, 5);
+  dev_xfer(EP_BULK_OUT, _dev_buf, 2048);
+  dwc2_model_xfer(EP_BULK_OUT, _host_buf, 700, false);
+  run_xfer(EP_BULK_OUT);
+  CHECK(dev_xferred(EP_BULK_OUT) == 700);
+  CHECK(memcmp(_dev_buf, _host_buf, 700) == 0);
+}
+
+static void test_unaligned(void)
+{
+  // IN from odd address
+  fill(_dev_buf + 1, 3000, 7);
+  memset(_host_buf, 0, 3000);
+  dev_xfer(EP_BULK_IN, _dev_buf + 1, 3000);
+  dwc2_model_xfer(EP_BULK_IN, _host_buf, 3000, false);
+  run_xfer(EP_BULK_IN);
+  CHECK(dwc2_model_xferred(EP_BULK_IN) == 3000 && dev_xferred(EP_BULK_IN) == 3000);
+  CHECK(memcmp(_dev_buf + 1, _host_buf, 3000) == 0);
+
+  // OUT to odd address, length is not a multiple of packet size: nothing is written past it
+  fill(_host_buf, 2000, 9);
+  memset(_dev_buf, 0xA5, 2100);
+  dev_xfer(EP_BULK_OUT, _dev_buf + 3, 2000);
+  dwc2_model_xfer(EP_BULK_OUT, _host_buf, 2000, false);
+  run_xfer(EP_BULK_OUT);
+  CHECK(dev_xferred(EP_BULK_OUT) == 2000);
+  CHECK(memcmp(_dev_buf + 3, _host_buf, 2000) == 0);
+  CHECK(_dev_buf[2] == 0xA5 && _dev_buf[2003] == 0xA5);
+
+  // aligned OUT buffer, short last packet
+  memset(_dev_buf, 0xA5, 2100);
+  dev_xfer(EP_BULK_OUT, _dev_buf, 1100);
+  dwc2_model_xfer(EP_BULK_OUT, _host_buf, 1100, false);
+  run_xfer(EP_BULK_OUT);
+  CHECK(dev_xferred(EP_BULK_OUT) == 1100);
+  CHECK(memcmp(_dev_buf, _host_buf, 1100) == 0);
+  CHECK(_dev_buf[1100] == 0xA5);
+
+  CHECK(dwc2_model_stat()->babble_count == 0);
+
+  // host sends more than transfer length: last packet is received in bounce buffer, no overrun
+  memset(_dev_buf, 0xA5, 2100);
+  dev_xfer(EP_BULK_OUT, _dev_buf, 1100);
+  dwc2_model_xfer(EP_BULK_OUT, _host_buf, 3*BULK_SIZE, false);
+  run_xfer(EP_BULK_OUT);
+  CHECK(dev_xferred(EP_BULK_OUT) == 1100);
+  CHECK(memcmp(_dev_buf, _host_buf, 1100) == 0);
+  CHECK(_dev_buf[1100] == 0xA5);
+}
+
+static void test_fifo(void)
+{
+  tu_fifo_t ff;
+  uint8_t data[1500];
+  uint8_t host[1500];
+
+  // isochronous IN: 600 bytes wrap around at 200, packets straddle the wrap
+  tu_fifo_config(&ff, _ff_buf, 1000, 1, false);
+  tu_fifo_write_n(&ff, data, 800);
+  tu_fifo_read_n(&ff, data, 800);
+
+  fill(data, 600, 11);
+  tu_fifo_write_n(&ff, data, 600);
+  memset(host, 0, sizeof(host));
+
+  dev_xfer_fifo(EP_ISO_IN, &ff, 600);
+  dwc2_model_xfer(EP_ISO_IN, host, 600, false);
+  uint32_t const start = dwc2_model_stat()->uframes;
+  run_xfer(EP_ISO_IN);
+
+  CHECK(dwc2_model_xferred(EP_ISO_IN) == 600 && dev_xferred(EP_ISO_IN) == 600);
+  CHECK(memcmp(host, data, 600) == 0);
+  CHECK(tu_fifo_count(&ff) == 0);
+  CHECK(dwc2_model_stat()->uframes - start >= 4);   // one packet per microframe
+
+  // bulk OUT: 1500 bytes written at 2000 of 3000, wrap around at 1000
+  tu_fifo_config(&ff, _ff_buf, 3000, 1, false);
+  for ( int i = 0; i < 2; i++ )
+  {
+    tu_fifo_write_n(&ff, _dev_buf, 1000);
+    tu_fifo_read_n(&ff, _dev_buf, 1000);
+  }
+
+  fill(host, 1500, 13);
+  memset(data, 0, sizeof(data));
+
+  dev_xfer_fifo(EP_FIFO_OUT, &ff, 1500);
+  dwc2_model_xfer(EP_FIFO_OUT, host, 1500, false);
+  run_xfer(EP_FIFO_OUT);
+
+  CHECK(dev_xferred(EP_FIFO_OUT) == 1500);
+  CHECK(tu_fifo_count(&ff) == 1500);
+  tu_fifo_read_n(&ff, data, 1500);
+  CHECK(memcmp(host, data, 1500) == 0);
+}
+
+static void run(bool desc)
+{
+  uint32_t const errors = _errors;
+
+  memset(&_ev, 0, sizeof(_ev));
+  dwc2_model_init(desc, task);
+
+  dcd_init(0);
+  dcd_int_enable(0);
+
+  // driver picks the DMA mode from core configuration
+  CHECK(dwc2_model_regs.gahbcfg & GAHBCFG_DMAEN);
+  CHECK(((dwc2_model_regs.dcfg & DCFG_DESCDMA) != 0) == desc);
+  CHECK(!(dwc2_model_regs.gintmsk & GINTMSK_RXFLVLM));
+
+  dwc2_model_bus_reset();
+  CHECK(_ev.bus_reset);
+
+  test_control();
+
+  open_edpt(EP_BULK_IN , TUSB_XFER_BULK, BULK_SIZE);
+  open_edpt(EP_BULK_OUT, TUSB_XFER_BULK, BULK_SIZE);
+  open_edpt(EP_ISO_IN  , TUSB_XFER_ISOCHRONOUS, ISO_SIZE);
+  open_edpt(EP_FIFO_OUT, TUSB_XFER_BULK, BULK_SIZE);
+
+  test_bulk(desc);
+  test_unaligned();
+  test_fifo();
+
+  // control still works after all
+  test_control();
+
+  CHECK(dwc2_model_stat()->bna_count == 0);
+
+  printf("  %s DMA: %s\n", desc ? "descriptor" : "buffer", (_errors == errors) ? "PASSED" : "FAILED");
+}
+
+int main(void)
+{
+  printf("DWC2 device DMA\n");
+
+  run(true);
+  run(false);
+
+  return _errors ? 1 : 0;
+}
@@ -0,0 +1,892 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "dwc2_model.h"
+
+//--------------------------------------------------------------------+
+// Controller state
+//--------------------------------------------------------------------+
+
+#define EP_MAX    8
+#define REGS      (&dwc2_model_regs)
+
+dwc2_regs_t dwc2_model_regs;
+
+enum
+{
+  EPCTL_WRITE_ONLY = DIEPCTL_CNAK | DIEPCTL_SNAK | DIEPCTL_SD0PID_SEVNFRM | DIEPCTL_SODDFRM | DIEPCTL_EPDIS,
+};
+
+typedef struct
+{
+  uint32_t ctl_prev;            // EPENA as seen on last apply
+  bool     nak;
+  uint32_t desc_base;           // descriptor list taken at enable
+  uint8_t  desc_idx;
+  uint16_t desc_done;           // bytes transferred with current descriptor
+  bool     zlp_pending;         // IN descriptor with SP ended on a full packet
+  uint32_t tx_level;            // IN: bytes in TX FIFO when its fill rate is limited
+  uint32_t tx_inflight;         // IN: packet being sent, its FIFO space is freed after it
+} model_ep_t;
+
+typedef struct
+{
+  uint8_t* buf;
+  uint32_t len;
+  uint32_t xferred;
+  bool     busy;
+  bool     zlp;
+  bool     stalled;
+} host_xfer_t;
+
+enum
+{
+  CTRL_IDLE = 0,
+  CTRL_SETUP,
+  CTRL_DATA_IN,
+  CTRL_DATA_OUT,
+  CTRL_STATUS_IN,
+  CTRL_STATUS_OUT,
+};
+
+static struct
+{
+  dwc2_model_task_t task_cb;
+  bool irq_enabled;
+  bool in_isr;
+  uint32_t uframe;
+
+  model_ep_t ep[EP_MAX][2];
+
+  // pending interrupt status, registers are loaded from it at handler entry
+  uint32_t gintsts;
+  uint32_t diepint[EP_MAX];
+  uint32_t doepint[EP_MAX];
+
+  host_xfer_t host[EP_MAX][2];
+
+  struct
+  {
+    tusb_control_request_t request;
+    uint8_t* data;
+    uint8_t  stage;
+    uint16_t xferred;
+    bool     stalled;
+  } ctrl;
+
+  uint32_t tx_rate;              // TX FIFO fill, bytes per microframe, 0 is unlimited
+  uint32_t tx_frac;             // remainder of fill rate
+  uint32_t tx_time;             // bus time of microframe TX FIFOs are filled up to
+
+  dwc2_model_stat_t stat;
+} _model;
+
+static inline bool desc_mode(void)
+{
+  return (REGS->dcfg & DCFG_DESCDMA) != 0;
+}
+
+static inline uint16_t ep_mps(uint8_t epnum, uint8_t dir)
+{
+  if ( epnum == 0 ) return 64;
+  uint32_t const ctl = (dir == TUSB_DIR_IN) ? REGS->epin[epnum].diepctl : REGS->epout[epnum].doepctl;
+  return ctl & DIEPCTL_MPSIZ_Msk;
+}
+
+static inline bool ep_iso(uint8_t epnum, uint8_t dir)
+{
+  uint32_t const ctl = (dir == TUSB_DIR_IN) ? REGS->epin[epnum].diepctl : REGS->epout[epnum].doepctl;
+  return (ctl & DIEPCTL_EPTYP) == DIEPCTL_EPTYP_0;
+}
+
+static inline volatile uint32_t* ep_ctl(uint8_t epnum, uint8_t dir)
+{
+  return (dir == TUSB_DIR_IN) ? &REGS->epin[epnum].diepctl : &REGS->epout[epnum].doepctl;
+}
+
+static inline volatile uint32_t* ep_dma(uint8_t epnum, uint8_t dir)
+{
+  return (dir == TUSB_DIR_IN) ? &REGS->epin[epnum].diepdma : &REGS->epout[epnum].doepdma;
+}
+
+static void raise_ep(uint8_t epnum, uint8_t dir, uint32_t bits)
+{
+  if ( dir == TUSB_DIR_IN )
+  {
+    _model.diepint[epnum] |= bits;
+    REGS->epin[epnum].diepint |= bits;
+  }else
+  {
+    _model.doepint[epnum] |= bits;
+    REGS->epout[epnum].doepint |= bits;
+  }
+}
+
+// Control bits written by driver
+static void apply(void)
+{
+  dwc2_regs_t* regs = REGS;
+
+  for ( uint8_t n = 0; n < EP_MAX; n++ )
+  {
+    for ( uint8_t dir = 0; dir < 2; dir++ )
+    {
+      model_ep_t* ep = &_model.ep[n][dir];
+      uint32_t ctl = *ep_ctl(n, dir);
+
+      if ( ctl & DIEPCTL_SNAK ) ep->nak = true;
+      if ( ctl & DIEPCTL_CNAK ) ep->nak = false;
+
+      if ( ctl & DIEPCTL_EPDIS )
+      {
+        ctl &= ~DIEPCTL_EPENA;
+        raise_ep(n, dir, TU_BIT(DIEPINT_EPDISD_Pos));
+      }
+
+      // descriptor list is taken on enable, or when DMA address is changed while enabled
+      if ( (ctl & DIEPCTL_EPENA) && (!(ep->ctl_prev & DIEPCTL_EPENA) || (desc_mode() && *ep_dma(n, dir) != ep->desc_base)) )
+      {
+        ep->desc_base   = *ep_dma(n, dir);
+        ep->desc_idx    = 0;
+        ep->desc_done   = 0;
+        ep->zlp_pending = false;
+        ep->tx_level    = 0;
+      }
+
+      ctl &= ~EPCTL_WRITE_ONLY;
+      *ep_ctl(n, dir) = ctl;
+      ep->ctl_prev    = ctl;
+    }
+
+    if ( _model.ep[n][TUSB_DIR_IN].nak ) regs->epin[n].diepint |= TU_BIT(DIEPINT_INEPNE_Pos);
+  }
+
+  if ( regs->dctl & DCTL_SGONAK ) regs->gintsts |= TU_BIT(GINTSTS_BOUTNAKEFF_Pos);
+  if ( regs->dctl & DCTL_CGONAK ) regs->gintsts &= ~TU_BIT(GINTSTS_BOUTNAKEFF_Pos);
+  regs->dctl &= ~(DCTL_SGONAK | DCTL_CGONAK);
+
+  regs->grstctl &= ~(GRSTCTL_CSRST_Msk | TU_BIT(GRSTCTL_TXFFLSH_Pos));
+  regs->grstctl |= GRSTCTL_AHBIDL_Msk;
+}
+
+//--------------------------------------------------------------------+
+// Interrupt
+//--------------------------------------------------------------------+
+
+static uint32_t pending_status(void)
+{
+  dwc2_regs_t* regs = REGS;
+
+  uint32_t daint = 0;
+  for ( uint8_t n = 0; n < EP_MAX; n++ )
+  {
+    if ( _model.diepint[n] & regs->diepmsk ) daint |= TU_BIT(DAINT_IEPINT_Pos + n);
+    if ( _model.doepint[n] & regs->doepmsk ) daint |= TU_BIT(DAINT_OEPINT_Pos + n);
+  }
+  daint &= regs->daintmsk;
+
+  uint32_t gintsts = _model.gintsts;
+  if ( daint & 0x0000FFFFu ) gintsts |= GINTSTS_IEPINT;
+  if ( daint & 0xFFFF0000u ) gintsts |= GINTSTS_OEPINT;
+
+  regs->daint = daint;
+  return gintsts;
+}
+
+static void dispatch_irq(void)
+{
+  dwc2_regs_t* regs = REGS;
+
+  if ( _model.in_isr ) return;
+  _model.in_isr = true;
+
+  while ( _model.irq_enabled && (regs->gahbcfg & GAHBCFG_GINT) )
+  {
+    uint32_t const gintsts = pending_status();
+    if ( !(gintsts & regs->gintmsk) ) break;
+
+    // load registers
+    uint32_t diepint[EP_MAX], doepint[EP_MAX];
+    for ( uint8_t n = 0; n < EP_MAX; n++ )
+    {
+      diepint[n] = regs->epin[n].diepint  = _model.diepint[n];
+      doepint[n] = regs->epout[n].doepint = _model.doepint[n];
+    }
+    regs->gintsts = gintsts;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    dcd_int_handler(0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    _model.stat.isr_count++;
+    _model.stat.isr_ns += (uint64_t) (t1.tv_sec - t0.tv_sec)*1000000000u + (uint64_t) (t1.tv_nsec - t0.tv_nsec);
+
+    // status seen and enabled at entry is cleared
+    for ( uint8_t n = 0; n < EP_MAX; n++ )
+    {
+      _model.diepint[n] &= ~(diepint[n] & regs->diepmsk);
+      _model.doepint[n] &= ~(doepint[n] & regs->doepmsk);
+      regs->epin[n].diepint  = _model.diepint[n];
+      regs->epout[n].doepint = _model.doepint[n];
+    }
+    _model.gintsts &= ~(gintsts & regs->gintmsk);
+    regs->gintsts = _model.gintsts;
+
+    apply();
+
+    if ( _model.task_cb ) _model.task_cb();
+    apply();
+  }
+
+  _model.in_isr = false;
+}
+
+//--------------------------------------------------------------------+
+// Device side of transactions
+//--------------------------------------------------------------------+
+
+static inline dwc2_dma_desc_t* desc_get(model_ep_t const* ep)
+{
+  return (dwc2_dma_desc_t*) (uintptr_t) (ep->desc_base + ep->desc_idx*sizeof(dwc2_dma_desc_t));
+}
+
+// Bytes of IN transfer that are not sent yet
+static uint32_t tx_pending(uint8_t epnum)
+{
+  dwc2_epin_t const* epin = &REGS->epin[epnum];
+  model_ep_t const* ep = &_model.ep[epnum][TUSB_DIR_IN];
+
+  if ( !desc_mode() ) return (epin->dieptsiz & DIEPTSIZ_XFRSIZ_Msk) >> DIEPTSIZ_XFRSIZ_Pos;
+
+  uint32_t const nbytes_msk = ep_iso(epnum, TUSB_DIR_IN) ? DDESC_ISO_IN_NBYTES_Msk : DDESC_NBYTES_Msk;
+  dwc2_dma_desc_t const* desc = desc_get(ep);
+  uint32_t pending = 0;
+
+  // descriptors ready up to the last one
+  for ( uint8_t i = 0; i < 8; i++ )
+  {
+    if ( (desc[i].status & DDESC_BS_Msk) != DDESC_BS_HOST_READY ) break;
+
+    pending += (desc[i].status & nbytes_msk) - (i ? 0 : ep->desc_done);
+    if ( desc[i].status & DDESC_L ) break;
+  }
+
+  return pending;
+}
+
+// Core DMA fills TX FIFOs of enabled IN endpoints in endpoint order, during bus_bytes of bus time
+static void tx_fill(uint32_t bus_bytes)
+{
+  if ( !_model.tx_rate ) return;
+
+  uint32_t const total = bus_bytes * _model.tx_rate + _model.tx_frac;
+  uint32_t credit = total / MODEL_UFRAME_BYTES;
+  _model.tx_frac  = total % MODEL_UFRAME_BYTES;
+
+  for ( uint8_t n = 1; n < EP_MAX && credit; n++ )
+  {
+    model_ep_t* ep = &_model.ep[n][TUSB_DIR_IN];
+    if ( !(REGS->epin[n].diepctl & DIEPCTL_EPENA) ) continue;
+
+    uint32_t const depth = 4 * ((REGS->dieptxf[n-1] & DIEPTXF_INEPTXFD_Msk) >> DIEPTXF_INEPTXFD_Pos);
+    uint32_t const level = tu_min32(tu_max32(depth, ep_mps(n, TUSB_DIR_IN)), tx_pending(n));
+
+    if ( level > ep->tx_level + ep->tx_inflight )
+    {
+      uint32_t const count = tu_min32(level - ep->tx_level - ep->tx_inflight, credit);
+      ep->tx_level += count;
+      credit       -= count;
+    }
+  }
+
+  for ( uint8_t n = 1; n < EP_MAX; n++ ) _model.ep[n][TUSB_DIR_IN].tx_inflight = 0;
+}
+
+// Packet is in TX FIFO
+static bool tx_ready(uint8_t epnum, uint16_t len)
+{
+  if ( !_model.tx_rate || epnum == 0 ) return true;
+  return _model.ep[epnum][TUSB_DIR_IN].tx_level >= len;
+}
+
+static void tx_sent(uint8_t epnum, uint16_t len)
+{
+  if ( !_model.tx_rate || epnum == 0 ) return;
+  _model.ep[epnum][TUSB_DIR_IN].tx_level   -= len;
+  _model.ep[epnum][TUSB_DIR_IN].tx_inflight = len;
+}
+
+// Descriptor is done: remaining bytes are written back
+static void desc_complete(uint8_t epnum, uint8_t dir, uint32_t nbytes_msk, uint32_t remaining, bool short_packet)
+{
+  model_ep_t* ep = &_model.ep[epnum][dir];
+  dwc2_dma_desc_t* desc = desc_get(ep);
+  uint32_t status = desc->status;
+
+  status &= ~(DDESC_BS_Msk | DDESC_STS_Msk | nbytes_msk);
+  status |= DDESC_BS_DMA_DONE | DDESC_STS_SUCCESS | remaining;
+  desc->status = status;
+
+  if ( status & DDESC_IOC ) raise_ep(epnum, dir, DIEPINT_XFRC);
+
+  if ( (status & DDESC_L) || short_packet )
+  {
+    *ep_ctl(epnum, dir) &= ~DIEPCTL_EPENA;
+  }else
+  {
+    ep->desc_idx++;
+  }
+
+  ep->desc_done   = 0;
+  ep->zlp_pending = false;
+}
+
+// Return -1 for NAK, -2 for STALL, -3 for NAK while packet is not in TX FIFO yet
+static int32_t dev_in(uint8_t epnum, uint8_t* buf)
+{
+  dwc2_regs_t* regs = REGS;
+  dwc2_epin_t* epin = &regs->epin[epnum];
+  model_ep_t* ep = &_model.ep[epnum][TUSB_DIR_IN];
+
+  apply();
+
+  if ( epin->diepctl & DIEPCTL_STALL ) return -2;
+  if ( !(epin->diepctl & DIEPCTL_EPENA) || ep->nak ) return -1;
+
+  uint16_t const mps = ep_mps(epnum, TUSB_DIR_IN);
+  uint16_t len;
+
+  if ( desc_mode() )
+  {
+    dwc2_dma_desc_t* desc = desc_get(ep);
+    if ( (desc->status & DDESC_BS_Msk) != DDESC_BS_HOST_READY )
+    {
+      _model.stat.bna_count++;
+      raise_ep(epnum, TUSB_DIR_IN, DIEPINT_BNA);
+      return -1;
+    }
+
+    uint32_t const nbytes_msk = ep_iso(epnum, TUSB_DIR_IN) ? DDESC_ISO_IN_NBYTES_Msk : DDESC_NBYTES_Msk;
+    uint16_t const nbytes = desc->status & nbytes_msk;
+    uint8_t const* src = (uint8_t const*) (uintptr_t) desc->buf;
+
+    len = ep->zlp_pending ? 0 : tu_min16(nbytes - ep->desc_done, mps);
+    if ( !tx_ready(epnum, len) ) return -3;
+
+    memcpy(buf, src + ep->desc_done, len);
+    ep->desc_done += len;
+
+    if ( ep->desc_done == nbytes )
+    {
+      // short packet flag: a full last packet is followed by zero length packet
+      if ( (desc->status & DDESC_SP) && len == mps && !ep->zlp_pending )
+      {
+        ep->zlp_pending = true;
+      }else
+      {
+        desc_complete(epnum, TUSB_DIR_IN, nbytes_msk, 0, false);
+      }
+    }
+  }
+  else
+  {
+    uint32_t tsiz = epin->dieptsiz;
+    uint32_t pktcnt = (tsiz & DIEPTSIZ_PKTCNT_Msk) >> DIEPTSIZ_PKTCNT_Pos;
+    uint32_t xfrsiz = (tsiz & DIEPTSIZ_XFRSIZ_Msk) >> DIEPTSIZ_XFRSIZ_Pos;
+
+    if ( pktcnt == 0 ) return -1;
+
+    len = tu_min16(xfrsiz, mps);
+    if ( !tx_ready(epnum, len) ) return -3;
+
+    memcpy(buf, (void const*) (uintptr_t) epin->diepdma, len);
+    epin->diepdma += len;
+
+    pktcnt--;
+    xfrsiz -= len;
+    epin->dieptsiz = (tsiz & ~(DIEPTSIZ_PKTCNT_Msk | DIEPTSIZ_XFRSIZ_Msk)) |
+                     (pktcnt << DIEPTSIZ_PKTCNT_Pos) | (xfrsiz << DIEPTSIZ_XFRSIZ_Pos);
+
+    if ( pktcnt == 0 )
+    {
+      epin->diepctl &= ~DIEPCTL_EPENA;
+      raise_ep(epnum, TUSB_DIR_IN, DIEPINT_XFRC);
+    }
+  }
+
+  tx_sent(epnum, len);
+  ep->ctl_prev = epin->diepctl;
+  return len;
+}
+
+// Return -1 for NAK, -2 for STALL
+static int32_t dev_out(uint8_t epnum, uint8_t const* data, uint16_t len)
+{
+  dwc2_regs_t* regs = REGS;
+  dwc2_epout_t* epout = &regs->epout[epnum];
+  model_ep_t* ep = &_model.ep[epnum][TUSB_DIR_OUT];
+
+  apply();
+
+  if ( epout->doepctl & DOEPCTL_STALL ) return -2;
+  if ( !(epout->doepctl & DOEPCTL_EPENA) || ep->nak ) return -1;
+
+  uint16_t const mps = ep_mps(epnum, TUSB_DIR_OUT);
+  bool const short_packet = len < mps;
+
+  if ( desc_mode() )
+  {
+    dwc2_dma_desc_t* desc = desc_get(ep);
+    if ( (desc->status & DDESC_BS_Msk) != DDESC_BS_HOST_READY )
+    {
+      _model.stat.bna_count++;
+      raise_ep(epnum, TUSB_DIR_OUT, DOEPINT_BNA);
+      return -1;
+    }
+
+    uint32_t const nbytes_msk = ep_iso(epnum, TUSB_DIR_OUT) ? DDESC_ISO_OUT_NBYTES_Msk : DDESC_NBYTES_Msk;
+    uint16_t const nbytes = desc->status & nbytes_msk;
+    uint16_t count = len;
+
+    if ( count > nbytes - ep->desc_done )
+    {
+      _model.stat.babble_count++;
+      count = nbytes - ep->desc_done;
+    }
+
+    if ( count ) memcpy((uint8_t*) (uintptr_t) desc->buf + ep->desc_done, data, count);
+    ep->desc_done += count;
+
+    if ( short_packet || ep->desc_done == nbytes )
+    {
+      desc_complete(epnum, TUSB_DIR_OUT, nbytes_msk, nbytes - ep->desc_done, short_packet);
+    }
+  }
+  else
+  {
+    uint32_t tsiz = epout->doeptsiz;
+    uint32_t pktcnt = (tsiz & DOEPTSIZ_PKTCNT_Msk) >> DOEPTSIZ_PKTCNT_Pos;
+    uint32_t xfrsiz = (tsiz & DOEPTSIZ_XFRSIZ_Msk) >> DOEPTSIZ_XFRSIZ_Pos;
+    uint16_t count = len;
+
+    if ( pktcnt == 0 ) return -1;
+
+    if ( count > xfrsiz )
+    {
+      _model.stat.babble_count++;
+      count = xfrsiz;
+    }
+
+    memcpy((void*) (uintptr_t) epout->doepdma, data, count);
+    epout->doepdma += count;
+
+    pktcnt--;
+    xfrsiz -= count;
+    epout->doeptsiz = (tsiz & ~(DOEPTSIZ_PKTCNT_Msk | DOEPTSIZ_XFRSIZ_Msk)) |
+                      (pktcnt << DOEPTSIZ_PKTCNT_Pos) | (xfrsiz << DOEPTSIZ_XFRSIZ_Pos);
+
+    if ( pktcnt == 0 || short_packet )
+    {
+      epout->doepctl &= ~DOEPCTL_EPENA;
+      raise_ep(epnum, TUSB_DIR_OUT, DOEPINT_XFRC);
+    }
+  }
+
+  ep->ctl_prev = epout->doepctl;
+  return len;
+}
+
+// Return -1 if EP0 OUT is not ready for it
+static int32_t dev_setup(uint8_t const* setup)
+{
+  dwc2_regs_t* regs = REGS;
+  dwc2_epout_t* epout = &regs->epout[0];
+  model_ep_t* ep = &_model.ep[0][TUSB_DIR_OUT];
+
+  apply();
+
+  if ( !(epout->doepctl & DOEPCTL_EPENA) ) return -1;
+
+  if ( desc_mode() )
+  {
+    dwc2_dma_desc_t* desc = desc_get(ep);
+    if ( (desc->status & DDESC_BS_Msk) != DDESC_BS_HOST_READY )
+    {
+      _model.stat.bna_count++;
+      return -1;
+    }
+
+    memcpy((void*) (uintptr_t) desc->buf, setup, 8);
+    uint16_t const nbytes = desc->status & DDESC_NBYTES_Msk;
+    desc->status = (desc->status & ~(DDESC_BS_Msk | DDESC_STS_Msk | DDESC_NBYTES_Msk)) |
+                   DDESC_BS_DMA_DONE | DDESC_SR | (nbytes - 8);
+  }
+  else
+  {
+    uint32_t tsiz = epout->doeptsiz;
+    uint32_t stupcnt = (tsiz & DOEPTSIZ_STUPCNT_Msk) >> DOEPTSIZ_STUPCNT_Pos;
+    if ( stupcnt == 0 ) return -1;
+
+    memcpy((void*) (uintptr_t) epout->doepdma, setup, 8);
+    epout->doepdma += 8;
+
+    stupcnt--;
+    epout->doeptsiz = (tsiz & ~DOEPTSIZ_STUPCNT_Msk) | (stupcnt << DOEPTSIZ_STUPCNT_Pos);
+  }
+
+  // setup clears stall of control endpoint
+  regs->epin[0].diepctl  &= ~DIEPCTL_STALL;
+  regs->epout[0].doepctl &= ~(DOEPCTL_STALL | DOEPCTL_EPENA);
+  ep->ctl_prev = regs->epout[0].doepctl;
+
+  raise_ep(0, TUSB_DIR_OUT, DOEPINT_STUP);
+
+  return 8;
+}
+
+//--------------------------------------------------------------------+
+// Host side
+//--------------------------------------------------------------------+
+
+static uint32_t _budget;
+
+static bool budget_take(uint16_t len)
+{
+  uint32_t const cost = len + MODEL_PACKET_OVERHEAD;
+  if ( cost > _budget ) return false;
+
+  // TX FIFOs are filled while previous packets are on the bus
+  tx_fill(MODEL_UFRAME_BYTES - _budget - _model.tx_time);
+  _model.tx_time = MODEL_UFRAME_BYTES - _budget;
+
+  _budget -= cost;
+  return true;
+}
+
+static void count_packet(int32_t result)
+{
+  if ( result == -1 || result == -3 )
+  {
+    _model.stat.nak_count++;
+  }else if ( result == -2 )
+  {
+    _model.stat.stall_count++;
+  }else
+  {
+    _model.stat.data_packets++;
+    _model.stat.data_bytes += (uint32_t) result;
+  }
+}
+
+// One control transaction, return true if there is progress
+static bool control_step(void)
+{
+  __typeof__(_model.ctrl)* ctrl = &_model.ctrl;
+  uint16_t const wLength = ctrl->request.wLength;
+  uint8_t buf[64];
+  int32_t result;
+
+  switch ( ctrl->stage )
+  {
+    case CTRL_SETUP:
+      if ( !budget_take(8) ) return false;
+      if ( dev_setup((uint8_t const*) &ctrl->request) < 0 ) return false;
+
+      _model.stat.setup_count++;
+      ctrl->xferred = 0;
+      if ( wLength == 0 )
+      {
+        ctrl->stage = CTRL_STATUS_IN;
+      }else
+      {
+        ctrl->stage = (ctrl->request.bmRequestType_bit.direction == TUSB_DIR_IN) ? CTRL_DATA_IN : CTRL_DATA_OUT;
+      }
+      dispatch_irq();
+    return true;
+
+    case CTRL_DATA_IN:
+    case CTRL_STATUS_IN:
+      if ( !budget_take(64) ) return false;
+      result = dev_in(0, buf);
+      count_packet(result);
+      if ( result == -1 ) return false;
+
+      if ( result == -2 )
+      {
+        ctrl->stalled = true;
+        ctrl->stage   = CTRL_IDLE;
+      }
+      else if ( ctrl->stage == CTRL_STATUS_IN )
+      {
+        ctrl->stage = CTRL_IDLE;
+      }
+      else
+      {
+        uint16_t const count = tu_min16((uint16_t) result, wLength - ctrl->xferred);
+        memcpy(ctrl->data + ctrl->xferred, buf, count);
+        ctrl->xferred += count;
+        if ( result < 64 || ctrl->xferred == wLength ) ctrl->stage = CTRL_STATUS_OUT;
+      }
+      dispatch_irq();
+    return true;
+
+    case CTRL_DATA_OUT:
+    case CTRL_STATUS_OUT:
+    {
+      uint16_t const len = (ctrl->stage == CTRL_DATA_OUT) ? tu_min16(64, wLength - ctrl->xferred) : 0;
+      if ( !budget_take(len) ) return false;
+      result = dev_out(0, ctrl->data + ctrl->xferred, len);
+      count_packet(result);
+      if ( result == -1 ) return false;
+
+      if ( result == -2 )
+      {
+        ctrl->stalled = true;
+        ctrl->stage   = CTRL_IDLE;
+      }
+      else if ( ctrl->stage == CTRL_STATUS_OUT )
+      {
+        ctrl->stage = CTRL_IDLE;
+      }
+      else
+      {
+        ctrl->xferred += len;
+        if ( ctrl->xferred == wLength ) ctrl->stage = CTRL_STATUS_IN;
+      }
+      dispatch_irq();
+    }
+    return true;
+
+    default: return false;
+  }
+}
+
+// STALL ends host transfer
+static bool xfer_stalled(host_xfer_t* xfer)
+{
+  xfer->stalled = true;
+  xfer->busy    = false;
+  dispatch_irq();
+  return true;
+}
+
+// One packet of endpoint transfer, return true if there is progress
+static bool xfer_step(uint8_t epnum, uint8_t dir)
+{
+  host_xfer_t* xfer = &_model.host[epnum][dir];
+  uint16_t const mps = ep_mps(epnum, dir);
+  int32_t result;
+
+  if ( dir == TUSB_DIR_IN )
+  {
+    uint8_t buf[1024];
+    if ( !budget_take(mps) ) return false;
+
+    result = dev_in(epnum, buf);
+    count_packet(result);
+
+    // host retries while TX FIFO is being filled, NAK takes no data time
+    if ( result == -3 )
+    {
+      _budget += mps;
+      return true;
+    }
+    if ( result == -2 ) return xfer_stalled(xfer);
+    if ( result < 0 ) return false;
+
+    uint32_t const count = tu_min32((uint32_t) result, xfer->len - xfer->xferred);
+    if ( count < (uint32_t) result ) _model.stat.babble_count++;
+
+    memcpy(xfer->buf + xfer->xferred, buf, count);
+    xfer->xferred += count;
+
+    if ( result < mps || xfer->xferred == xfer->len ) xfer->busy = false;
+  }
+  else
+  {
+    uint16_t const len = (uint16_t) tu_min32(mps, xfer->len - xfer->xferred);
+    if ( !budget_take(len) ) return false;
+
+    result = dev_out(epnum, xfer->buf + xfer->xferred, len);
+    count_packet(result);
+    if ( result == -2 ) return xfer_stalled(xfer);
+    if ( result < 0 ) return false;
+
+    xfer->xferred += len;
+
+    // zero length packet follows full last packet if requested
+    if ( len < mps || (xfer->xferred == xfer->len && !xfer->zlp) ) xfer->busy = false;
+  }
+
+  dispatch_irq();
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void dwc2_model_init(bool desc_dma, dwc2_model_task_t task_cb)
+{
+  tu_memclr(&_model, sizeof(_model));
+  tu_memclr(REGS, sizeof(dwc2_regs_t));
+
+  _model.task_cb = task_cb;
+
+  dwc2_regs_t* regs = REGS;
+
+  regs->gsnpsid = DWC2_OTG_ID | 0x280a;
+  regs->ghwcfg2_bm.arch        = 2;
+  regs->ghwcfg2_bm.hs_phy_type = HS_PHY_TYPE_UTMI;
+  regs->ghwcfg2_bm.num_dev_ep  = EP_MAX-1;
+  regs->ghwcfg3_bm.total_fifo_size = 4096/4;
+  regs->ghwcfg4_bm.dedicated_fifos = 1;
+  regs->ghwcfg4_bm.num_dev_in_eps  = EP_MAX;
+  regs->ghwcfg4_bm.dma_desc_enable = desc_dma ? 1 : 0;
+  regs->grstctl = GRSTCTL_AHBIDL_Msk;
+}
+
+void dwc2_model_bus_reset(void)
+{
+  dwc2_regs_t* regs = REGS;
+
+  for ( uint8_t n = 0; n < EP_MAX; n++ )
+  {
+    _model.host[n][0].busy = _model.host[n][1].busy = false;
+  }
+  _model.ctrl.stage = CTRL_IDLE;
+
+  regs->dsts = (regs->dsts & ~DSTS_ENUMSPD_Msk) | (DSTS_ENUMSPD_HS << DSTS_ENUMSPD_Pos);
+  _model.gintsts |= GINTSTS_USBRST | GINTSTS_ENUMDNE;
+
+  dispatch_irq();
+}
+
+void dwc2_model_control(tusb_control_request_t const* request, uint8_t* data)
+{
+  _model.ctrl.request = *request;
+  _model.ctrl.data    = data;
+  _model.ctrl.xferred = 0;
+  _model.ctrl.stalled = false;
+  _model.ctrl.stage   = CTRL_SETUP;
+}
+
+void dwc2_model_xfer(uint8_t ep_addr, uint8_t* buf, uint32_t len, bool zlp)
+{
+  host_xfer_t* xfer = &_model.host[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+
+  xfer->buf     = buf;
+  xfer->len     = len;
+  xfer->xferred = 0;
+  xfer->zlp     = zlp;
+  xfer->stalled = false;
+  xfer->busy    = true;
+}
+
+bool dwc2_model_busy(uint8_t ep_addr)
+{
+  if ( tu_edpt_number(ep_addr) == 0 ) return _model.ctrl.stage != CTRL_IDLE;
+  return _model.host[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].busy;
+}
+
+int32_t dwc2_model_xferred(uint8_t ep_addr)
+{
+  if ( tu_edpt_number(ep_addr) == 0 ) return _model.ctrl.stalled ? -1 : _model.ctrl.xferred;
+
+  host_xfer_t const* xfer = &_model.host[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+  return xfer->stalled ? -1 : (int32_t) xfer->xferred;
+}
+
+void dwc2_model_uframe(void)
+{
+  dwc2_regs_t* regs = REGS;
+
+  _model.uframe++;
+  _model.stat.uframes++;
+  regs->dsts = (regs->dsts & ~DSTS_FNSOF_Msk) | ((_model.uframe << DSTS_FNSOF_Pos) & DSTS_FNSOF_Msk);
+
+  _budget = MODEL_UFRAME_BYTES;
+  _model.tx_time = 0;
+
+  while ( control_step() ) {}
+
+  // isochronous: one packet per microframe
+  bool iso_done[EP_MAX][2] = { { false } };
+  bool progress = true;
+
+  while ( progress )
+  {
+    progress = false;
+
+    for ( uint8_t n = 1; n < EP_MAX; n++ )
+    {
+      for ( uint8_t dir = 0; dir < 2; dir++ )
+      {
+        if ( !_model.host[n][dir].busy || iso_done[n][dir] ) continue;
+
+        if ( ep_iso(n, dir) ) iso_done[n][dir] = true;
+        if ( xfer_step(n, dir) ) progress = true;
+      }
+    }
+  }
+
+  // and for the rest of microframe
+  tx_fill(MODEL_UFRAME_BYTES - _model.tx_time);
+
+  dispatch_irq();
+}
+
+void dwc2_model_poll(void)
+{
+  apply();
+}
+
+void dwc2_model_tx_rate(uint32_t bytes_per_uframe)
+{
+  _model.tx_rate = bytes_per_uframe;
+  _model.tx_frac = 0;
+}
+
+void dwc2_model_irq_enable(bool enabled)
+{
+  _model.irq_enabled = enabled;
+}
+
+dwc2_model_stat_t const* dwc2_model_stat(void)
+{
+  return &_model.stat;
+}
+
+void dwc2_model_stat_clear(void)
+{
+  tu_memclr(&_model.stat, sizeof(_model.stat));
+}
@@ -0,0 +1,119 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _DWC2_MODEL_H_
+#define _DWC2_MODEL_H_
+
+#include "common/tusb_common.h"
+#include "portable/synopsys/dwc2/dwc2_type.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Register level model of the DWC2 core in high speed device mode with internal DMA, buffer or
+// descriptor (scatter/gather) mode as selected by DCFG DESCDMA. Each call to dwc2_model_uframe()
+// runs one microframe of host traffic within its byte budget: the control transfer first, then
+// the other endpoints round robin, one packet each turn (isochronous: one per microframe).
+// - Buffer DMA: DIEPTSIZ/DOEPTSIZ count packets and bytes, DMA address register advances.
+// - Descriptor DMA: descriptor list at DMA address is walked from the enable, BS/NBYTES are updated
+//   on completion, IOC raises XFRC and L (or a short OUT packet) disables the endpoint.
+// With a limited TX FIFO fill rate, core DMA fills TX FIFOs of enabled IN endpoints (up to DIEPTXF
+// depth) as bus time passes, IN is NAKed until the whole packet is in TX FIFO.
+// A setup packet is written at the DMA address (or descriptor buffer) of enabled EP0 OUT, STUP is
+// raised and EP0 OUT is disabled. OUT is NAKed while endpoint is disabled or NAK is set.
+//
+// Registers are plain memory. Control bits (CNAK, SNAK, EPDIS, EPENA edge ...) are applied before
+// each packet and when the driver polls a status bit. Interrupt handler is called after a packet
+// raises an enabled interrupt; status bits seen and enabled at its entry are then cleared as
+// write-1-to-clear, then the task callback is called.
+//
+// Built as non-PIE so that static buffers have 32-bit addresses for the DMA registers.
+//--------------------------------------------------------------------+
+
+enum
+{
+  MODEL_UFRAME_BYTES   = 7500,
+  MODEL_PACKET_OVERHEAD = 50,
+};
+
+typedef void (* dwc2_model_task_t) (void);
+
+typedef struct
+{
+  uint32_t uframes;
+  uint32_t data_packets;        // data packets ACKed (both directions)
+  uint32_t nak_count;
+  uint32_t setup_count;
+  uint32_t stall_count;
+  uint32_t bna_count;           // descriptor not ready
+  uint32_t babble_count;        // OUT data larger than programmed
+  uint64_t data_bytes;
+  uint32_t isr_count;
+  uint64_t isr_ns;              // time spent in dcd_int_handler()
+} dwc2_model_stat_t;
+
+extern dwc2_regs_t dwc2_model_regs;
+
+// Descriptor DMA support is reported in GHWCFG4, without it driver falls back to buffer DMA
+void dwc2_model_init(bool desc_dma, dwc2_model_task_t task_cb);
+
+// USB reset then enumeration done at high speed
+void dwc2_model_bus_reset(void);
+
+// Host control transfer, data has wLength bytes
+void dwc2_model_control(tusb_control_request_t const* request, uint8_t* data);
+
+// Host transfer on non-control endpoint: IN ends with short packet or when len bytes are received,
+// OUT sends len bytes plus zero length packet if zlp and len is multiple of packet size
+void dwc2_model_xfer(uint8_t ep_addr, uint8_t* buf, uint32_t len, bool zlp);
+
+// Transfer (or control transfer with ep_addr 0) is still in progress
+bool dwc2_model_busy(uint8_t ep_addr);
+
+// Bytes transferred by last transfer, or -1 if it was stalled
+int32_t dwc2_model_xferred(uint8_t ep_addr);
+
+// Run one microframe
+void dwc2_model_uframe(void);
+
+// Driver reads a busy-wait status bit
+void dwc2_model_poll(void);
+
+void dwc2_model_irq_enable(bool enabled);
+
+// Bandwidth of core DMA to fill TX FIFOs in bytes per microframe, 0 (default) is unlimited
+void dwc2_model_tx_rate(uint32_t bytes_per_uframe);
+
+dwc2_model_stat_t const* dwc2_model_stat(void);
+void dwc2_model_stat_clear(void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _DWC2_MODEL_H_ */
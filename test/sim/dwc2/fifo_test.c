@@ -0,0 +1,351 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "portable/synopsys/dwc2/dwc2_api.h"
+#include "sim_test.h"
+#include "dwc2_model.h"
+
+//--------------------------------------------------------------------+
+// DWC2 FIFO RAM plan for the whole configuration against the controller model
+// - TX FIFOs of all IN endpoints and RX FIFO fit without overlap, room left gives deeper TX FIFOs
+// - switching alternate settings back and forth keeps the FIFO of the endpoint in place
+// - configuration that does not fit falls back to allocation as endpoints are opened
+// Bulk IN throughput with 1 and 2 packets TX FIFO is reported when core DMA fills TX FIFO slower
+// than USB drains it.
+//--------------------------------------------------------------------+
+
+#define TIMEOUT_UFRAMES   100000
+#define BULK_TOTAL        (1024*1024)
+#define BULK_CHUNK        32768
+#define TX_RATE           5000    // bytes per microframe: 40 MB/s
+
+enum
+{
+  EP_BULK_IN  = 0x81,
+  EP_BULK_OUT = 0x01,
+  EP_ISO_IN   = 0x82,
+  EP_INT_IN   = 0x83,
+};
+
+// bulk pair, audio streaming with alternate settings of 196 and 392 bytes, interrupt IN
+static uint8_t const desc_config[] =
+{
+  9, TUSB_DESC_CONFIGURATION, U16_TO_U8S_LE(9+9+7+7 + 9+9+7+9+7 + 9+7), 3, 1, 0, 0x80, 50,
+
+  9, TUSB_DESC_INTERFACE, 0, 0, 2, TUSB_CLASS_VENDOR_SPECIFIC, 0, 0, 0,
+  7, TUSB_DESC_ENDPOINT, EP_BULK_IN , TUSB_XFER_BULK, U16_TO_U8S_LE(512), 0,
+  7, TUSB_DESC_ENDPOINT, EP_BULK_OUT, TUSB_XFER_BULK, U16_TO_U8S_LE(512), 0,
+
+  9, TUSB_DESC_INTERFACE, 1, 0, 0, TUSB_CLASS_AUDIO, 2, 0x20, 0,
+  9, TUSB_DESC_INTERFACE, 1, 1, 1, TUSB_CLASS_AUDIO, 2, 0x20, 0,
+  7, TUSB_DESC_ENDPOINT, EP_ISO_IN, TUSB_XFER_ISOCHRONOUS | 0x04, U16_TO_U8S_LE(196), 1,
+  9, TUSB_DESC_INTERFACE, 1, 2, 1, TUSB_CLASS_AUDIO, 2, 0x20, 0,
+  7, TUSB_DESC_ENDPOINT, EP_ISO_IN, TUSB_XFER_ISOCHRONOUS | 0x04, U16_TO_U8S_LE(392), 1,
+
+  9, TUSB_DESC_INTERFACE, 2, 0, 1, TUSB_CLASS_HID, 0, 0, 0,
+  7, TUSB_DESC_ENDPOINT, EP_INT_IN, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(64), 4,
+};
+
+// 7 high bandwidth isochronous IN endpoints of 3 x 1024 bytes do not fit in 4 KB
+#define DESC_BIG_EP(_n)  7, TUSB_DESC_ENDPOINT, 0x80 | (_n), TUSB_XFER_ISOCHRONOUS, U16_TO_U8S_LE(0x1000 | 1024), 1
+
+static uint8_t const desc_config_big[] =
+{
+  9, TUSB_DESC_CONFIGURATION, U16_TO_U8S_LE(9+9+7*7), 1, 1, 0, 0x80, 50,
+  9, TUSB_DESC_INTERFACE, 0, 0, 7, TUSB_CLASS_VENDOR_SPECIFIC, 0, 0, 0,
+  DESC_BIG_EP(1), DESC_BIG_EP(2), DESC_BIG_EP(3), DESC_BIG_EP(4), DESC_BIG_EP(5), DESC_BIG_EP(6), DESC_BIG_EP(7)
+};
+
+// buffers in static memory: DMA addresses must be 32-bit
+static TU_ATTR_ALIGNED(4) uint8_t _dev_buf[BULK_CHUNK];
+static TU_ATTR_ALIGNED(4) uint8_t _host_buf[BULK_CHUNK];
+
+//--------------------------------------------------------------------+
+// Events, in place of usbd: only completion of non-control endpoints is used
+//--------------------------------------------------------------------+
+
+static bool     _done[8][2];
+static uint32_t _xferred[8][2];
+
+void dcd_event_handler(dcd_event_t const * event, bool in_isr)
+{
+  (void) in_isr;
+
+  if ( event->event_id == DCD_EVENT_XFER_COMPLETE )
+  {
+    uint8_t const ep_addr = event->xfer_complete.ep_addr;
+    CHECK(event->xfer_complete.result == XFER_RESULT_SUCCESS);
+
+    _done[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)]    = true;
+    _xferred[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = event->xfer_complete.len;
+  }
+}
+
+void dcd_event_bus_signal (uint8_t rhport, dcd_eventid_t eid, bool in_isr)
+{
+  (void) rhport; (void) eid; (void) in_isr;
+}
+
+void dcd_event_bus_reset (uint8_t rhport, tusb_speed_t speed, bool in_isr)
+{
+  (void) rhport; (void) speed; (void) in_isr;
+}
+
+void dcd_event_sof(uint8_t rhport, uint32_t frame_count, bool microframe, bool in_isr)
+{
+  (void) rhport; (void) frame_count; (void) microframe; (void) in_isr;
+}
+
+void dcd_event_setup_received(uint8_t rhport, uint8_t const * setup, bool in_isr)
+{
+  (void) rhport; (void) setup; (void) in_isr;
+}
+
+void dcd_event_xfer_complete (uint8_t rhport, uint8_t ep_addr, uint32_t xferred_bytes, uint8_t result, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_XFER_COMPLETE };
+  event.xfer_complete.ep_addr = ep_addr;
+  event.xfer_complete.len     = xferred_bytes;
+  event.xfer_complete.result  = result;
+  dcd_event_handler(&event, in_isr);
+}
+
+//--------------------------------------------------------------------+
+// Helpers
+//--------------------------------------------------------------------+
+
+// Endpoint descriptor of ep_addr in alternate setting
+static tusb_desc_endpoint_t const* find_edpt(uint8_t const* desc_cfg, uint8_t ep_addr, uint8_t alt)
+{
+  uint8_t const* p_desc   = desc_cfg;
+  uint8_t const* desc_end = desc_cfg + tu_le16toh(((tusb_desc_configuration_t const*) desc_cfg)->wTotalLength);
+  uint8_t cur_alt = 0;
+
+  while ( p_desc < desc_end )
+  {
+    if ( tu_desc_type(p_desc) == TUSB_DESC_INTERFACE ) cur_alt = ((tusb_desc_interface_t const*) p_desc)->bAlternateSetting;
+
+    if ( tu_desc_type(p_desc) == TUSB_DESC_ENDPOINT && cur_alt == alt &&
+         ((tusb_desc_endpoint_t const*) p_desc)->bEndpointAddress == ep_addr )
+    {
+      return (tusb_desc_endpoint_t const*) p_desc;
+    }
+
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  return NULL;
+}
+
+static bool open_edpt(uint8_t const* desc_cfg, uint8_t ep_addr, uint8_t alt)
+{
+  tusb_desc_endpoint_t const* desc_ep = find_edpt(desc_cfg, ep_addr, alt);
+  return desc_ep && dcd_edpt_open(0, desc_ep);
+}
+
+static bool xfer_done(uint8_t ep_addr)
+{
+  return !dwc2_model_busy(ep_addr) && _done[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+}
+
+// Run until host and device are both done with ep_addr
+static bool run_xfer(uint8_t ep_addr)
+{
+  return sim_run_until(ep_addr, xfer_done, dwc2_model_uframe, TIMEOUT_UFRAMES);
+}
+
+static bool xfer_in(uint8_t ep_addr, uint32_t len)
+{
+  for ( uint32_t i = 0; i < len; i++ ) _dev_buf[i] = (uint8_t) (i*13 + len);
+  memset(_host_buf, 0, len);
+
+  _done[tu_edpt_number(ep_addr)][TUSB_DIR_IN] = false;
+  CHECK(dcd_edpt_xfer(0, ep_addr, _dev_buf, (uint16_t) len));
+  dwc2_model_xfer(ep_addr, _host_buf, len, false);
+
+  return run_xfer(ep_addr) && dwc2_model_xferred(ep_addr) == (int32_t) len && memcmp(_dev_buf, _host_buf, len) == 0;
+}
+
+static void reset(void)
+{
+  memset(_done, 0, sizeof(_done));
+  dwc2_model_init(true, NULL);
+
+  dcd_init(0);
+  dcd_int_enable(0);
+  dwc2_model_bus_reset();
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+static void test_plan(void)
+{
+  dwc2_fifo_layout_t layout;
+  CHECK(!dwc2_fifo_layout_get(0, &layout));
+
+  dcd_edpt_plan(0, (tusb_desc_configuration_t const*) desc_config);
+  CHECK(dwc2_fifo_layout_get(0, &layout));
+
+  // FIFOs are below endpoint info, above RX FIFO and do not overlap
+  uint16_t used = layout.rx + layout.epinfo;
+  uint16_t top  = layout.total - layout.epinfo;
+
+  for ( uint8_t n = 0; n < 4; n++ )
+  {
+    CHECK(layout.tx[n].size && layout.tx[n].addr + layout.tx[n].size == top);
+    top   = layout.tx[n].addr;
+    used += layout.tx[n].size;
+
+    if ( n ) CHECK(dwc2_model_regs.dieptxf[n-1] == (uint32_t) ((layout.tx[n].size << DIEPTXF_INEPTXFD_Pos) | layout.tx[n].addr));
+  }
+
+  CHECK(top >= layout.rx);
+  CHECK(layout.free == layout.total - used);
+  CHECK(dwc2_model_regs.grxfsiz == layout.rx);
+  for ( uint8_t n = 4; n < 16; n++ ) CHECK(layout.tx[n].size == 0);
+
+  // sized for largest alternate setting, room left makes them double buffered
+  CHECK(layout.tx[1].size == 2*128 && layout.tx[1].packets == 2);
+  CHECK(layout.tx[2].size == 2*98  && layout.tx[2].packets == 2);
+  CHECK(layout.tx[3].size == 2*16  && layout.tx[3].packets == 2);
+
+  printf("  layout: RX %u, EP0 %u, EP1 %u, EP2 %u, EP3 %u, free %u bytes\n", layout.rx*4, layout.tx[0].size*4,
+         layout.tx[1].size*4, layout.tx[2].size*4, layout.tx[3].size*4, layout.free*4);
+}
+
+static void test_alt_switch(void)
+{
+  uint32_t const dieptxf = dwc2_model_regs.dieptxf[1];
+
+  CHECK(open_edpt(desc_config, EP_BULK_IN , 0));
+  CHECK(open_edpt(desc_config, EP_BULK_OUT, 0));
+  CHECK(open_edpt(desc_config, EP_INT_IN  , 0));
+
+  // endpoint opened after it is closed and reopened many times, FIFO stays in place
+  for ( uint32_t i = 0; i < 100; i++ )
+  {
+    uint8_t const alt = 1 + (i & 1);
+    uint16_t const size = (alt == 1) ? 196 : 392;
+
+    CHECK(open_edpt(desc_config, EP_ISO_IN, alt));
+    CHECK(dwc2_model_regs.dieptxf[1] == dieptxf);
+    CHECK(xfer_in(EP_ISO_IN, size*2));
+
+    dcd_edpt_close(0, EP_ISO_IN);
+  }
+
+  // other endpoints still work
+  CHECK(xfer_in(EP_BULK_IN, 3000));
+  CHECK(xfer_in(EP_INT_IN, 100));
+
+  // closing all drops the plan
+  dcd_edpt_close_all(0);
+  dwc2_fifo_layout_t layout;
+  CHECK(!dwc2_fifo_layout_get(0, &layout));
+}
+
+static void test_fallback(void)
+{
+  dwc2_fifo_layout_t layout;
+
+  dcd_edpt_plan(0, (tusb_desc_configuration_t const*) desc_config_big);
+  CHECK(!dwc2_fifo_layout_get(0, &layout));
+
+  // FIFOs are allocated as endpoints are opened while there is room
+  CHECK(open_edpt(desc_config_big, 0x81, 0));
+  CHECK(xfer_in(0x81, 3000));
+  dcd_edpt_close_all(0);
+}
+
+// Return microframes taken
+static uint32_t bulk_stream(void)
+{
+  uint32_t const start = dwc2_model_stat()->uframes;
+
+  for ( uint32_t offset = 0; offset < BULK_TOTAL; offset += BULK_CHUNK )
+  {
+    if ( !xfer_in(EP_BULK_IN, BULK_CHUNK) )
+    {
+      CHECK(false);
+      break;
+    }
+  }
+
+  return dwc2_model_stat()->uframes - start;
+}
+
+static void bench_tx_depth(void)
+{
+  dcd_edpt_plan(0, (tusb_desc_configuration_t const*) desc_config);
+  CHECK(open_edpt(desc_config, EP_BULK_IN, 0));
+
+  uint32_t const dieptxf = dwc2_model_regs.dieptxf[0];
+  uint32_t const addr    = dieptxf & DIEPTXF_INEPTXSA_Msk;
+  double mbps[3] = { 0 };
+
+  dwc2_model_tx_rate(TX_RATE);
+
+  // TX FIFO is resized within the planned one
+  for ( uint8_t packets = 1; packets <= 2; packets++ )
+  {
+    dwc2_model_regs.dieptxf[0] = ((128u*packets) << DIEPTXF_INEPTXFD_Pos) | addr;
+
+    dwc2_model_stat_clear();
+    uint32_t const uframes = bulk_stream();
+
+    double const mb = (double) BULK_TOTAL / (1024*1024);
+    mbps[packets] = mb / (uframes*125e-6);
+    printf("  bulk IN, TX FIFO of %u packets: %6.1f MB/s, %5.1f NAKs/MB\n", packets, mbps[packets], dwc2_model_stat()->nak_count / mb);
+  }
+
+  dwc2_model_tx_rate(0);
+  dwc2_model_regs.dieptxf[0] = dieptxf;
+
+  CHECK(mbps[2] > mbps[1]);
+}
+
+int main(void)
+{
+  printf("DWC2 device FIFO RAM plan\n");
+
+  reset();
+  CHECK(!(dwc2_model_regs.gintmsk & GINTMSK_RXFLVLM));
+
+  test_plan();
+  test_alt_switch();
+  test_fallback();
+  bench_tx_depth();
+
+  printf("  %s\n", _errors ? "FAILED" : "PASSED");
+  return _errors ? 1 : 0;
+}
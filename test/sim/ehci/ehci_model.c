@@ -0,0 +1,404 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <time.h>
+
+#include "tusb.h"
+#include "host/hcd.h"
+#include "portable/ehci/ehci_api.h"
+#include "portable/ehci/ehci.h"
+#include "ehci_model.h"
+
+//--------------------------------------------------------------------+
+// Register level EHCI model: periodic & async schedule
+//--------------------------------------------------------------------+
+
+// NXP Transdimension frame list as configured by ehci.c
+#define MODEL_FRAMELIST_SIZE   8u
+
+static ehci_registers_t _regs;
+
+static ehci_model_xact_t _xact_cb;
+static ehci_model_stat_t _stat;
+
+static uint32_t _uframe_count;
+static uint32_t _pending;           // USBINT/USBERRINT waiting for interrupt threshold
+static uint32_t _hs_bytes;
+static uint32_t _fs_bytes;
+static bool     _int_enabled;
+
+static inline void* addr_to_ptr(uint32_t addr)
+{
+  return (void*) (uintptr_t) addr;
+}
+
+// Transaction on device, check response against expected length
+static int32_t device_xact(uint8_t dev_addr, uint8_t ep_addr, uint8_t* buf, uint16_t len, bool* babble)
+{
+  int32_t const count = _xact_cb ? _xact_cb(dev_addr, ep_addr, buf, len) : -1;
+  *babble = (count > (int32_t) len);
+  return count;
+}
+
+static void itd_execute(ehci_itd_t* itd, uint8_t uframe)
+{
+  if ( !itd->xact[uframe].active ) return;
+
+  uint8_t const dev_addr = (uint8_t) (itd->BufferPointer[0] & 0x7F);
+  uint8_t const epnum    = (uint8_t) ((itd->BufferPointer[0] >> 8) & 0x0F);
+  uint8_t const dir      = (uint8_t) ((itd->BufferPointer[1] >> 11) & 0x01);
+
+  uint32_t const addr = tu_align4k(itd->BufferPointer[itd->xact[uframe].page_select]) + itd->xact[uframe].offset;
+  uint16_t const len  = (uint16_t) itd->xact[uframe].length;
+
+  bool babble;
+  int32_t const count = device_xact(dev_addr, tu_edpt_addr(epnum, dir), addr_to_ptr(addr), len, &babble);
+
+  if ( count < 0 || babble )
+  {
+    if ( count < 0 ) itd->xact[uframe].error = 1;
+    itd->xact[uframe].babble_err = babble ? 1 : 0;
+    _pending |= EHCI_INT_MASK_ERROR;
+    _stat.error_xact++;
+  }else if ( dir )
+  {
+    // IN: actual length is written back
+    itd->xact[uframe].length = (uint32_t) count;
+  }
+
+  _hs_bytes += (count > 0) ? (uint32_t) count : 0;
+  _stat.itd_xact++;
+
+  itd->xact[uframe].active = 0;
+  if ( itd->xact[uframe].int_on_complete ) _pending |= EHCI_INT_MASK_USB | EHCI_INT_MASK_NXP_PERIODIC;
+}
+
+static void sitd_retire(ehci_sitd_t* sitd)
+{
+  sitd->active = 0;
+  if ( sitd->int_on_complete ) _pending |= EHCI_INT_MASK_USB | EHCI_INT_MASK_NXP_PERIODIC;
+}
+
+// Full speed transaction of a siTD is carried out by the TT: OUT with the first start split,
+// IN with the first complete split. siTD is retired with the last start split (OUT) or
+// the complete split with data (IN).
+static void sitd_execute(ehci_sitd_t* sitd, uint8_t uframe)
+{
+  if ( !sitd->active ) return;
+
+  uint8_t const ep_addr = tu_edpt_addr(sitd->ep_number, sitd->direction);
+  uint8_t* buf = addr_to_ptr(sitd->buffer[0]);
+  uint16_t const len = (uint16_t) sitd->total_bytes;
+  bool babble;
+
+  if ( sitd->direction == 0 )
+  {
+    if ( !(sitd->int_smask & TU_BIT(uframe)) ) return;
+
+    // first start split
+    if ( (sitd->int_smask & (TU_BIT(uframe) - 1)) == 0 )
+    {
+      int32_t const count = device_xact(sitd->dev_addr, ep_addr, buf, len, &babble);
+      _stat.sitd_xact++;
+
+      if ( count < 0 )
+      {
+        sitd->xact_err = 1;
+        _pending |= EHCI_INT_MASK_ERROR;
+        _stat.error_xact++;
+      }else
+      {
+        sitd->total_bytes = 0;
+        _fs_bytes += len;
+      }
+    }
+
+    // last start split
+    if ( (sitd->int_smask >> uframe) == 1 ) sitd_retire(sitd);
+  }else
+  {
+    if ( !sitd->split_state )
+    {
+      if ( sitd->int_smask & TU_BIT(uframe) ) sitd->split_state = 1;
+      return;
+    }
+
+    if ( !(sitd->fl_int_cmask & TU_BIT(uframe)) ) return;
+
+    int32_t const count = device_xact(sitd->dev_addr, ep_addr, buf, len, &babble);
+    _stat.sitd_xact++;
+
+    if ( count < 0 || babble )
+    {
+      if ( count < 0 ) sitd->xact_err = 1;
+      sitd->babble_err = babble ? 1 : 0;
+      _pending |= EHCI_INT_MASK_ERROR;
+      _stat.error_xact++;
+    }else
+    {
+      sitd->total_bytes = (uint32_t) (len - count);
+      _fs_bytes += (uint32_t) count;
+    }
+
+    sitd->split_state = 0;
+    sitd_retire(sitd);
+  }
+}
+
+// Execute qTDs attached to overlay until one is NAKed or the queue ends. Short packet on IN continues
+// with Alternate Next qTD if it is valid. USBINT is raised on Interrupt On Complete or short packet.
+static void qhd_execute(ehci_qhd_t* qhd, uint32_t int_mask)
+{
+  // guard against broken (looping) qTD list
+  for(uint32_t guard = 0; guard < 256; guard++)
+  {
+    if ( qhd->qtd_overlay.halted || qhd->qtd_overlay.next.terminate ) return;
+
+    ehci_qtd_t* qtd = addr_to_ptr(tu_align32(qhd->qtd_overlay.next.address));
+    if ( !qtd->active ) return;
+
+    uint8_t const  dir = (qtd->pid == EHCI_PID_IN) ? 1 : 0;
+    uint16_t const len = (uint16_t) qtd->total_bytes;
+
+    bool babble;
+    int32_t const count = device_xact(qhd->dev_addr, tu_edpt_addr(qhd->ep_number, dir), addr_to_ptr(qtd->buffer[0]), len, &babble);
+
+    // NAK
+    if ( count < 0 ) return;
+
+    _stat.qtd_xact++;
+    qhd->qtd_addr = tu_align32(qhd->qtd_overlay.next.address);
+
+    if ( babble )
+    {
+      qtd->babble_err = qhd->qtd_overlay.babble_err = 1;
+      qtd->halted     = qhd->qtd_overlay.halted     = 1;
+      qtd->active     = 0;
+      _pending |= EHCI_INT_MASK_ERROR;
+      _stat.error_xact++;
+      return;
+    }
+
+    bool const is_short = dir && ((uint16_t) count < len);
+
+    qtd->total_bytes = (uint32_t) (len - count);
+    qtd->active      = 0;
+
+    if ( qtd->int_on_complete || is_short ) _pending |= EHCI_INT_MASK_USB | int_mask;
+
+    qhd->qtd_overlay.next.address = (is_short && !qtd->alternate.terminate) ? qtd->alternate.address : qtd->next.address;
+  }
+}
+
+static void async_execute(void)
+{
+  ehci_qhd_t* const head = addr_to_ptr(_regs.async_list_addr);
+  ehci_qhd_t* qhd = head;
+
+  // guard against broken (non circular) list
+  for(uint32_t guard = 0; guard < 1024; guard++)
+  {
+    qhd_execute(qhd, EHCI_INT_MASK_NXP_ASYNC);
+
+    qhd = addr_to_ptr(tu_align32(qhd->next.address));
+    if ( qhd == head ) return;
+  }
+
+  TU_ASSERT(false, );
+}
+
+static void periodic_execute(uint8_t uframe, uint32_t slot)
+{
+  uint32_t const* framelist = addr_to_ptr(_regs.periodic_list_base);
+  uint32_t link = framelist[slot];
+
+  // guard against broken (looping) list
+  for(uint32_t guard = 0; !(link & 1) && guard < 256; guard++)
+  {
+    uint32_t const addr = tu_align32(link);
+
+    switch ( (link >> 1) & 0x03 )
+    {
+      case EHCI_QTYPE_ITD:
+      {
+        ehci_itd_t* itd = addr_to_ptr(addr);
+        itd_execute(itd, uframe);
+        link = itd->next.address;
+      }
+      break;
+
+      case EHCI_QTYPE_SITD:
+      {
+        ehci_sitd_t* sitd = addr_to_ptr(addr);
+        sitd_execute(sitd, uframe);
+        link = sitd->next.address;
+      }
+      break;
+
+      case EHCI_QTYPE_QHD:
+      {
+        ehci_qhd_t* qhd = addr_to_ptr(addr);
+        if ( qhd->int_smask & TU_BIT(uframe) ) qhd_execute(qhd, EHCI_INT_MASK_NXP_PERIODIC);
+        link = qhd->next.address;
+      }
+      break;
+
+      default:
+        link = ((ehci_link_t*) addr_to_ptr(addr))->address;
+      break;
+    }
+  }
+
+  TU_ASSERT(link & 1, );
+}
+
+//--------------------------------------------------------------------+
+// HCD API implemented by chip glue
+//--------------------------------------------------------------------+
+
+void hcd_int_enable(uint8_t rhport)
+{
+  (void) rhport;
+  _int_enabled = true;
+}
+
+void hcd_int_disable(uint8_t rhport)
+{
+  (void) rhport;
+  _int_enabled = false;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void ehci_model_init(ehci_model_xact_t xact_cb)
+{
+  tu_memclr((void*) (uintptr_t) &_regs, sizeof(_regs));
+  tu_memclr(&_stat, sizeof(_stat));
+
+  _xact_cb      = xact_cb;
+  _uframe_count = 0;
+  _pending      = 0;
+  _hs_bytes     = 0;
+  _fs_bytes     = 0;
+  _int_enabled  = true;
+
+  // reset value
+  _regs.command_bm.int_threshold = 8;
+
+  ehci_init(0, 0, (uint32_t) (uintptr_t) &_regs);
+
+  // status written by init is write-1-to-clear
+  _regs.status = 0;
+}
+
+void ehci_model_uframe(void)
+{
+  uint32_t const frindex = _regs.frame_index;
+  uint8_t  const uframe  = frindex & 0x07;
+
+  if ( _regs.command_bm.run_stop && _regs.command_bm.periodic_enable )
+  {
+    periodic_execute(uframe, (frindex >> 3) % MODEL_FRAMELIST_SIZE);
+  }
+
+  if ( _regs.command_bm.run_stop && _regs.command_bm.async_enable )
+  {
+    async_execute();
+  }
+
+  // async list has been walked once: removed queue heads are no longer cached
+  if ( _regs.command_bm.async_adv_doorbell )
+  {
+    _regs.command_bm.async_adv_doorbell = 0;
+    _regs.status |= EHCI_INT_MASK_ASYNC_ADVANCE;
+  }
+
+  _stat.hs_bytes_max = tu_max32(_stat.hs_bytes_max, _hs_bytes);
+  _hs_bytes = 0;
+
+  if ( uframe == 7 )
+  {
+    _stat.fs_bytes_max = tu_max32(_stat.fs_bytes_max, _fs_bytes);
+    _fs_bytes = 0;
+  }
+
+  //------------- next microframe -------------//
+  _uframe_count++;
+  _regs.frame_index = (frindex + 1) & 0x3FFF;
+
+  if ( (_regs.frame_index & (MODEL_FRAMELIST_SIZE*8 - 1)) == 0 ) _regs.status |= EHCI_INT_MASK_FRAMELIST_ROLLOVER;
+
+  uint32_t const threshold = _regs.command_bm.int_threshold ? _regs.command_bm.int_threshold : 1;
+  if ( (_regs.frame_index % threshold) == 0 )
+  {
+    _regs.status |= _pending;
+    _pending = 0;
+  }
+
+  uint32_t const seen = _regs.status & _regs.inten;
+  if ( seen && _int_enabled )
+  {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    hcd_int_handler(0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    _stat.int_count++;
+    _stat.int_ns += (uint64_t) ((end.tv_sec - start.tv_sec)*1000000000LL + (end.tv_nsec - start.tv_nsec));
+
+    // write-1-to-clear of status bits acknowledged by handler
+    _regs.status &= ~seen;
+  }
+}
+
+uint32_t ehci_model_uframe_count(void)
+{
+  return _uframe_count;
+}
+
+ehci_model_stat_t const* ehci_model_stat(void)
+{
+  return &_stat;
+}
+
+uint32_t ehci_model_iso_td_linked(void)
+{
+  uint32_t const* framelist = addr_to_ptr(_regs.periodic_list_base);
+  uint32_t count = 0;
+
+  for(uint32_t slot = 0; slot < MODEL_FRAMELIST_SIZE; slot++)
+  {
+    for(uint32_t link = framelist[slot]; !(link & 1) && ((link >> 1) & 0x03) != EHCI_QTYPE_QHD; count++)
+    {
+      link = ((ehci_link_t*) addr_to_ptr(tu_align32(link)))->address;
+    }
+  }
+
+  return count;
+}
@@ -0,0 +1,83 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _EHCI_MODEL_H_
+#define _EHCI_MODEL_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Register level EHCI model
+// Operational registers are plain memory handed to ehci_init(). Each call to ehci_model_uframe()
+// advances FRINDEX by one microframe and executes the periodic schedule of the current frame list
+// slot as the controller does: iTD transactions, siTD start/complete splits and interrupt queue
+// heads, then the async list once. A qTD is carried out in one go as if it were a single packet.
+// Status bits are raised with interrupt threshold from USBCMD and hcd_int_handler() is called
+// unless disabled with hcd_int_disable(); bits it has seen are then cleared as write-1-to-clear.
+//
+// Built as non-PIE so that static data (schedule and buffers) has 32-bit addresses, the
+// link pointers of EHCI data structures are 32-bit.
+//--------------------------------------------------------------------+
+
+// Device side of a transaction.
+// IN: fill up to len bytes (more is babble) and return count, OUT/SETUP: consume len bytes and return len.
+// Return -1 for no response: transaction error for isochronous, NAK for queue head (retried later)
+typedef int32_t (* ehci_model_xact_t) (uint8_t dev_addr, uint8_t ep_addr, uint8_t* buf, uint16_t len);
+
+typedef struct
+{
+  uint32_t itd_xact;            // iTD transactions executed
+  uint32_t sitd_xact;           // siTD split transactions executed
+  uint32_t qtd_xact;            // qTDs executed
+  uint32_t error_xact;
+  uint32_t hs_bytes_max;        // max bytes in a microframe
+  uint32_t fs_bytes_max;        // max full speed bytes in a frame
+  uint32_t int_count;           // calls to hcd_int_handler()
+  uint64_t int_ns;              // time spent in hcd_int_handler()
+} ehci_model_stat_t;
+
+void ehci_model_init(ehci_model_xact_t xact_cb);
+
+// Run one microframe
+void ehci_model_uframe(void);
+
+// Microframes since init
+uint32_t ehci_model_uframe_count(void);
+
+ehci_model_stat_t const* ehci_model_stat(void);
+
+// Number of iTD/siTD linked in frame list
+uint32_t ehci_model_iso_td_linked(void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _EHCI_MODEL_H_ */
@@ -0,0 +1,477 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "host/hcd.h"
+#include "ehci_model.h"
+
+//--------------------------------------------------------------------+
+// EHCI isochronous test against the register level model
+// HCD API is called directly as usbh would, completion events are handled by a task emulated
+// with a fixed latency after the interrupt. Each stream is a running byte counter so that data
+// order, gaps and the compaction of short IN packets are checked on both sides.
+// - high speed (iTD) audio IN/OUT and high bandwidth camera IN
+// - full speed (siTD) audio through the transaction translator, with short IN packets
+// - packet without response, closing device with transfer in progress
+// - bandwidth budget and phase balancing of periodic slots
+//--------------------------------------------------------------------+
+
+#define TASK_LATENCY_UFRAMES  2
+#define TIMEOUT_UFRAMES       (200*1000u)
+
+typedef struct
+{
+  char const* name;
+  uint8_t  dev_addr;
+  uint8_t  speed;
+  uint8_t  ep_addr;
+  uint8_t  interval;        // bInterval
+  uint16_t ep_size;         // wMaxPacketSize including mult bits
+  uint32_t xfer_bytes;
+  uint32_t xfer_count;
+  uint16_t dev_len[2];      // IN: device alternates between these packet lengths, 0 is max packet
+  uint32_t error_packet;    // device does not respond to this packet (1-based), 0 if none
+  bool     continuous;      // transfers are expected to be serviced without gap
+
+  // device
+  uint32_t dev_pos;         // stream byte counter
+  uint32_t dev_packets;
+  uint32_t dev_last_uframe;
+  uint32_t dev_gap_max;     // max microframes between packets
+  uint32_t dev_errors;
+
+  // host
+  uint8_t* buf;
+  uint32_t host_pos;
+  uint32_t done;
+  uint32_t failed;
+  uint32_t host_errors;
+} stream_t;
+
+static stream_t* _streams[4];
+static uint8_t   _stream_count;
+
+static struct
+{
+  uint8_t  dev_addr;
+  uint8_t  ep_addr;
+  uint32_t xferred;
+  uint8_t  result;
+  uint32_t uframe;
+} _event[16];
+static uint8_t _event_count;
+
+static uint8_t _dev_speed[CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1];
+
+// static, all addresses used by controller must be 32-bit
+static uint8_t _buf[4][64*1024] TU_ATTR_ALIGNED(4);
+
+//--------------------------------------------------------------------+
+// USBH stubs
+//--------------------------------------------------------------------+
+
+void hcd_devtree_get_info(uint8_t dev_addr, hcd_devtree_info_t* devtree_info)
+{
+  devtree_info->rhport   = 0;
+  devtree_info->speed    = _dev_speed[dev_addr];
+
+  // full speed devices are behind a high speed hub
+  devtree_info->hub_addr = (_dev_speed[dev_addr] == TUSB_SPEED_HIGH) ? 0 : 1;
+  devtree_info->hub_port = (_dev_speed[dev_addr] == TUSB_SPEED_HIGH) ? 0 : dev_addr;
+}
+
+void hcd_event_handler(hcd_event_t const* event, bool in_isr)
+{
+  (void) event; (void) in_isr;
+}
+
+void hcd_event_device_attach(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_device_remove(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_xfer_complete(uint8_t dev_addr, uint8_t ep_addr, uint32_t xferred_bytes, xfer_result_t result, bool in_isr)
+{
+  (void) in_isr;
+  TU_ASSERT(_event_count < TU_ARRAY_SIZE(_event), );
+
+  _event[_event_count].dev_addr = dev_addr;
+  _event[_event_count].ep_addr  = ep_addr;
+  _event[_event_count].xferred  = xferred_bytes;
+  _event[_event_count].result   = (uint8_t) result;
+  _event[_event_count].uframe   = ehci_model_uframe_count();
+  _event_count++;
+}
+
+//--------------------------------------------------------------------+
+// Device
+//--------------------------------------------------------------------+
+
+static stream_t* stream_find(uint8_t dev_addr, uint8_t ep_addr)
+{
+  for(uint8_t i=0; i<_stream_count; i++)
+  {
+    if ( _streams[i]->dev_addr == dev_addr && _streams[i]->ep_addr == ep_addr ) return _streams[i];
+  }
+  return NULL;
+}
+
+static int32_t device_xact(uint8_t dev_addr, uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  stream_t* s = stream_find(dev_addr, ep_addr);
+  if ( s == NULL ) return -1;
+
+  uint32_t const now = ehci_model_uframe_count();
+  if ( s->dev_packets ) s->dev_gap_max = tu_max32(s->dev_gap_max, now - s->dev_last_uframe);
+  s->dev_last_uframe = now;
+  s->dev_packets++;
+
+  if ( s->dev_packets == s->error_packet ) return -1;
+
+  if ( tu_edpt_dir(ep_addr) == TUSB_DIR_IN )
+  {
+    uint16_t count = s->dev_len[s->dev_packets & 1];
+    if ( count == 0 || count > len ) count = len;
+
+    for(uint16_t i=0; i<count; i++) buf[i] = (uint8_t) s->dev_pos++;
+    return count;
+  }else
+  {
+    for(uint16_t i=0; i<len; i++)
+    {
+      if ( buf[i] != (uint8_t) s->dev_pos++ ) s->dev_errors++;
+    }
+    return len;
+  }
+}
+
+//--------------------------------------------------------------------+
+// Host application
+//--------------------------------------------------------------------+
+
+static bool stream_open(stream_t* s, uint8_t* buf)
+{
+  tusb_desc_endpoint_t const desc =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = s->ep_addr,
+    .bmAttributes     = { .xfer = TUSB_XFER_ISOCHRONOUS },
+    .wMaxPacketSize   = tu_htole16(s->ep_size),
+    .bInterval        = s->interval
+  };
+
+  _dev_speed[s->dev_addr] = s->speed;
+
+  TU_VERIFY(hcd_edpt_open(0, s->dev_addr, &desc));
+
+  s->buf = buf;
+  _streams[_stream_count++] = s;
+
+  return true;
+}
+
+static bool stream_submit(stream_t* s)
+{
+  if ( tu_edpt_dir(s->ep_addr) == TUSB_DIR_OUT )
+  {
+    for(uint32_t i=0; i<s->xfer_bytes; i++) s->buf[i] = (uint8_t) (s->host_pos + i);
+  }
+
+  return hcd_edpt_xfer(0, s->dev_addr, s->ep_addr, s->buf, s->xfer_bytes);
+}
+
+static void stream_complete(stream_t* s, uint32_t xferred, uint8_t result)
+{
+  if ( result != XFER_RESULT_SUCCESS ) s->failed++;
+
+  if ( tu_edpt_dir(s->ep_addr) == TUSB_DIR_IN )
+  {
+    for(uint32_t i=0; i<xferred; i++)
+    {
+      if ( s->buf[i] != (uint8_t) s->host_pos++ ) s->host_errors++;
+    }
+  }else
+  {
+    s->host_pos += s->xfer_bytes;
+  }
+
+  s->done++;
+  if ( s->done < s->xfer_count && !stream_submit(s) ) s->host_errors++;
+}
+
+// Run model until all streams are done, completion is handled after task latency
+static bool run_streams(uint32_t max_uframes)
+{
+  uint32_t const start = ehci_model_uframe_count();
+
+  while ( ehci_model_uframe_count() - start < max_uframes )
+  {
+    ehci_model_uframe();
+
+    uint32_t const now = ehci_model_uframe_count();
+    while ( _event_count && now - _event[0].uframe >= TASK_LATENCY_UFRAMES )
+    {
+      stream_t* s = stream_find(_event[0].dev_addr, _event[0].ep_addr);
+      uint32_t const xferred = _event[0].xferred;
+      uint8_t  const result  = _event[0].result;
+
+      _event_count--;
+      memmove(&_event[0], &_event[1], _event_count*sizeof(_event[0]));
+
+      if ( s ) stream_complete(s, xferred, result);
+    }
+
+    bool all_done = true;
+    for(uint8_t i=0; i<_stream_count; i++)
+    {
+      if ( _streams[i]->done < _streams[i]->xfer_count ) all_done = false;
+    }
+    if ( all_done ) return true;
+  }
+
+  return false;
+}
+
+static void close_all(void)
+{
+  for(uint8_t i=0; i<_stream_count; i++) hcd_device_close(0, _streams[i]->dev_addr);
+  _stream_count = 0;
+  _event_count  = 0;
+}
+
+// Microframes between services of endpoint
+static uint32_t stream_interval_uframes(stream_t const* s)
+{
+  return (s->speed == TUSB_SPEED_HIGH ? 1u : 8u) << (s->interval - 1);
+}
+
+static bool check_stream(stream_t* s, uint32_t uframes)
+{
+  uint32_t const interval = stream_interval_uframes(s);
+  uint32_t const bytes = s->host_pos;
+  uint32_t const expected_failed = s->error_packet ? 1 : 0;
+
+  bool ok = (s->done == s->xfer_count) && (s->failed == expected_failed) && !s->host_errors && !s->dev_errors &&
+            (bytes == s->dev_pos);
+  if ( s->continuous ) ok = ok && (s->dev_gap_max == interval);
+
+  printf("%-28s: %4lu transfers, %7lu bytes, %6.0f KB/s, packet gap max %3lu uframes (interval %lu), %lu failed, %lu data errors %s\n",
+         s->name, (unsigned long) s->done, (unsigned long) bytes, bytes / (uframes / 8000.0) / 1024,
+         (unsigned long) s->dev_gap_max, (unsigned long) interval, (unsigned long) s->failed,
+         (unsigned long) (s->host_errors + s->dev_errors), ok ? "" : "FAILED");
+
+  return ok;
+}
+
+static bool test_streams(char const* title, stream_t* streams, uint8_t count)
+{
+  printf("-- %s\n", title);
+
+  for(uint8_t i=0; i<count; i++)
+  {
+    TU_ASSERT(stream_open(&streams[i], _buf[i]));
+  }
+
+  for(uint8_t i=0; i<count; i++)
+  {
+    TU_ASSERT(stream_submit(&streams[i]));
+  }
+
+  uint32_t const start = ehci_model_uframe_count();
+  bool ok = run_streams(TIMEOUT_UFRAMES);
+  uint32_t const uframes = ehci_model_uframe_count() - start;
+
+  for(uint8_t i=0; i<count; i++)
+  {
+    ok = check_stream(&streams[i], uframes) && ok;
+  }
+
+  close_all();
+  TU_ASSERT(ok && ehci_model_iso_td_linked() == 0);
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+static bool test_highspeed(void)
+{
+  stream_t streams[] =
+  {
+    // UAC2 192 kHz 24-bit stereo: 1 packet per ms, 1 ms transfers
+    { .name = "HS audio IN 1 ms", .dev_addr = 1, .speed = TUSB_SPEED_HIGH, .ep_addr = 0x81, .interval = 4,
+      .ep_size = 1152, .xfer_bytes = 1152, .xfer_count = 500, .continuous = true },
+
+    // 8 packets per ms, 4 ms transfers. Interrupt comes after the last microframe: next transfer
+    // cannot continue the stream
+    { .name = "HS audio OUT 125 us", .dev_addr = 2, .speed = TUSB_SPEED_HIGH, .ep_addr = 0x02, .interval = 1,
+      .ep_size = 144, .xfer_bytes = 32*144, .xfer_count = 125 },
+
+    // high bandwidth: 3 x 1024 per microframe, 2 ms transfers, last packet of each is short
+    { .name = "HS camera IN 3x1024", .dev_addr = 3, .speed = TUSB_SPEED_HIGH, .ep_addr = 0x83, .interval = 1,
+      .ep_size = 1024 | (2 << 11), .xfer_bytes = 16*3072, .xfer_count = 100, .dev_len = { 3000, 3072 } },
+  };
+
+  return test_streams("high speed (iTD)", streams, TU_ARRAY_SIZE(streams));
+}
+
+static bool test_fullspeed(void)
+{
+  stream_t streams[] =
+  {
+    // 48 kHz 16-bit stereo with 44.1 kHz style short packets
+    { .name = "FS audio IN 4 ms", .dev_addr = 1, .speed = TUSB_SPEED_FULL, .ep_addr = 0x81, .interval = 1,
+      .ep_size = 196, .xfer_bytes = 4*196, .xfer_count = 250, .dev_len = { 176, 180 }, .continuous = true },
+
+    { .name = "FS audio OUT 1 ms", .dev_addr = 2, .speed = TUSB_SPEED_FULL, .ep_addr = 0x02, .interval = 1,
+      .ep_size = 192, .xfer_bytes = 192, .xfer_count = 1000, .continuous = true },
+
+    // multiple start splits per frame
+    { .name = "FS OUT 900 every 2 ms", .dev_addr = 3, .speed = TUSB_SPEED_FULL, .ep_addr = 0x03, .interval = 2,
+      .ep_size = 900, .xfer_bytes = 2*900, .xfer_count = 200, .continuous = true },
+  };
+
+  return test_streams("full speed via TT (siTD)", streams, TU_ARRAY_SIZE(streams));
+}
+
+static bool test_error(void)
+{
+  stream_t streams[] =
+  {
+    { .name = "HS IN no response", .dev_addr = 1, .speed = TUSB_SPEED_HIGH, .ep_addr = 0x81, .interval = 1,
+      .ep_size = 512, .xfer_bytes = 8*512, .xfer_count = 10, .error_packet = 21 },
+
+    { .name = "FS IN no response", .dev_addr = 2, .speed = TUSB_SPEED_FULL, .ep_addr = 0x81, .interval = 1,
+      .ep_size = 64, .xfer_bytes = 4*64, .xfer_count = 10, .error_packet = 7 },
+  };
+
+  TU_ASSERT(test_streams("transaction error", streams, TU_ARRAY_SIZE(streams)));
+
+  // close with transfer in progress: TDs are unlinked without completion
+  stream_t s = { .name = "close", .dev_addr = 1, .speed = TUSB_SPEED_HIGH, .ep_addr = 0x81, .interval = 1,
+                 .ep_size = 512, .xfer_bytes = 32*512, .xfer_count = 1 };
+
+  TU_ASSERT(stream_open(&s, _buf[0]) && stream_submit(&s));
+  for(uint32_t i=0; i<12; i++) ehci_model_uframe();
+
+  uint32_t const linked = ehci_model_iso_td_linked();
+  close_all();
+  for(uint32_t i=0; i<64; i++) ehci_model_uframe();
+
+  printf("%-28s: %lu TDs linked, %lu after close, %u completion\n", "close in progress",
+         (unsigned long) linked, (unsigned long) ehci_model_iso_td_linked(), _event_count);
+  TU_ASSERT(linked == 4 && ehci_model_iso_td_linked() == 0 && _event_count == 0);
+
+  return true;
+}
+
+static bool test_bandwidth(void)
+{
+  printf("-- bandwidth\n");
+
+  // 3 x 1024 every 2 microframes: only 2 fit, in alternate microframes
+  stream_t hs[] =
+  {
+    { .name = "HS 3x1024 / 250 us #1", .dev_addr = 1, .speed = TUSB_SPEED_HIGH, .ep_addr = 0x81, .interval = 2,
+      .ep_size = 1024 | (2 << 11), .xfer_bytes = 12*3072, .xfer_count = 20 },
+    { .name = "HS 3x1024 / 250 us #2", .dev_addr = 2, .speed = TUSB_SPEED_HIGH, .ep_addr = 0x81, .interval = 2,
+      .ep_size = 1024 | (2 << 11), .xfer_bytes = 12*3072, .xfer_count = 20 },
+    { .name = "HS 3x1024 / 250 us #3", .dev_addr = 3, .speed = TUSB_SPEED_HIGH, .ep_addr = 0x81, .interval = 2,
+      .ep_size = 1024 | (2 << 11), .xfer_bytes = 12*3072, .xfer_count = 20 },
+  };
+
+  // 1023 bytes every 2 frames: only 2 fit, in alternate frames
+  stream_t fs[] =
+  {
+    { .name = "FS 1023 / 2 ms #1", .dev_addr = 4, .speed = TUSB_SPEED_FULL, .ep_addr = 0x81, .interval = 2,
+      .ep_size = 1023, .xfer_bytes = 1023, .xfer_count = 20 },
+    { .name = "FS 1023 / 2 ms #2", .dev_addr = 5, .speed = TUSB_SPEED_FULL, .ep_addr = 0x81, .interval = 2,
+      .ep_size = 1023, .xfer_bytes = 1023, .xfer_count = 20 },
+    { .name = "FS 1023 / 2 ms #3", .dev_addr = 6, .speed = TUSB_SPEED_FULL, .ep_addr = 0x81, .interval = 2,
+      .ep_size = 1023, .xfer_bytes = 1023, .xfer_count = 20 },
+  };
+
+  bool const open_hs[3] = { stream_open(&hs[0], _buf[0]), stream_open(&hs[1], _buf[1]), stream_open(&hs[2], _buf[2]) };
+  bool const open_fs[3] = { stream_open(&fs[0], _buf[3]), stream_open(&fs[1], _buf[3] + 16*1024), stream_open(&fs[2], _buf[3]) };
+
+  printf("%-28s: open %d %d %d\n", "HS 3x1024 / 250 us", open_hs[0], open_hs[1], open_hs[2]);
+  printf("%-28s: open %d %d %d\n", "FS 1023 / 2 ms", open_fs[0], open_fs[1], open_fs[2]);
+
+  TU_ASSERT(open_hs[0] && open_hs[1] && !open_hs[2]);
+  TU_ASSERT(open_fs[0] && open_fs[1] && !open_fs[2]);
+
+  TU_ASSERT(stream_submit(&hs[0]) && stream_submit(&hs[1]) && stream_submit(&fs[0]) && stream_submit(&fs[1]));
+
+  uint32_t const start = ehci_model_uframe_count();
+  bool ok = run_streams(TIMEOUT_UFRAMES);
+  uint32_t const uframes = ehci_model_uframe_count() - start;
+
+  ok = check_stream(&hs[0], uframes) && ok;
+  ok = check_stream(&hs[1], uframes) && ok;
+  ok = check_stream(&fs[0], uframes) && ok;
+  ok = check_stream(&fs[1], uframes) && ok;
+
+  ehci_model_stat_t const* stat = ehci_model_stat();
+  printf("%-28s: high speed %lu bytes per microframe, full speed %lu bytes per frame\n", "max bus load",
+         (unsigned long) stat->hs_bytes_max, (unsigned long) stat->fs_bytes_max);
+  TU_ASSERT(ok && stat->hs_bytes_max <= 6000 && stat->fs_bytes_max <= 1350);
+
+  // bandwidth is released on close
+  close_all();
+  TU_ASSERT(stream_open(&hs[2], _buf[2]) && stream_open(&fs[2], _buf[3]));
+  close_all();
+
+  return true;
+}
+
+int main(void)
+{
+  ehci_model_init(device_xact);
+
+  bool ok = test_highspeed();
+  ok = ok && test_fullspeed();
+  ok = ok && test_error();
+  ok = ok && test_bandwidth();
+
+  ehci_model_stat_t const* stat = ehci_model_stat();
+  printf("-- %lu iTD transactions, %lu siTD transactions, %lu interrupts in %lu ms\n",
+         (unsigned long) stat->itd_xact, (unsigned long) stat->sitd_xact, (unsigned long) stat->int_count,
+         (unsigned long) (ehci_model_uframe_count() / 8));
+
+  printf(ok ? "PASSED\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,320 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "host/hcd.h"
+#include "ehci_model.h"
+
+//--------------------------------------------------------------------+
+// EHCI periodic schedule test against the register level model
+// Interrupt IN endpoints are kept pending while device NAKs, each poll is recorded by the device:
+// - polling period of every bInterval for high speed and full speed, longer than the frame list is clamped
+// - endpoints of the same interval are spread over microframes (high speed) or frames (full speed)
+// - bandwidth budget is enforced and released when device is closed
+// - closing a device does not break the schedule of remaining ones
+//--------------------------------------------------------------------+
+
+#define EP_NOTIF        0x81
+#define RUN_UFRAMES     (64*8*4)
+#define FRAMELIST_SLOTS 8 // NXP Transdimension
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t first;
+  uint32_t last;
+  uint32_t period_min;
+  uint32_t period_max;
+} poll_t;
+
+static uint8_t _dev_speed[CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1];
+static poll_t  _poll[CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1];
+
+// static, all addresses used by controller must be 32-bit
+static uint8_t _buf[CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1][64] TU_ATTR_ALIGNED(4);
+
+//--------------------------------------------------------------------+
+// USBH stubs
+//--------------------------------------------------------------------+
+
+void hcd_devtree_get_info(uint8_t dev_addr, hcd_devtree_info_t* devtree_info)
+{
+  devtree_info->rhport   = 0;
+  devtree_info->speed    = _dev_speed[dev_addr];
+
+  // full speed devices are behind a high speed hub
+  devtree_info->hub_addr = (_dev_speed[dev_addr] == TUSB_SPEED_HIGH) ? 0 : 1;
+  devtree_info->hub_port = (_dev_speed[dev_addr] == TUSB_SPEED_HIGH) ? 0 : dev_addr;
+}
+
+void hcd_event_handler(hcd_event_t const* event, bool in_isr)
+{
+  (void) event; (void) in_isr;
+}
+
+void hcd_event_device_attach(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_device_remove(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_xfer_complete(uint8_t dev_addr, uint8_t ep_addr, uint32_t xferred_bytes, xfer_result_t result, bool in_isr)
+{
+  (void) dev_addr; (void) ep_addr; (void) xferred_bytes; (void) result; (void) in_isr;
+}
+
+//--------------------------------------------------------------------+
+// Device: record every poll and NAK
+//--------------------------------------------------------------------+
+
+static int32_t device_xact(uint8_t dev_addr, uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  (void) buf; (void) len;
+
+  if ( ep_addr == EP_NOTIF )
+  {
+    poll_t* p = &_poll[dev_addr];
+    uint32_t const now = ehci_model_uframe_count();
+
+    if ( p->count )
+    {
+      uint32_t const period = now - p->last;
+      p->period_min = tu_min32(p->period_min, period);
+      p->period_max = tu_max32(p->period_max, period);
+    }else
+    {
+      p->first = now;
+    }
+
+    p->last = now;
+    p->count++;
+  }
+
+  return -1;
+}
+
+//--------------------------------------------------------------------+
+// Test
+//--------------------------------------------------------------------+
+
+static bool notif_open(uint8_t dev_addr, uint8_t speed, uint16_t size, uint8_t interval)
+{
+  tusb_desc_endpoint_t const desc =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = EP_NOTIF,
+    .bmAttributes     = { .xfer = TUSB_XFER_INTERRUPT },
+    .wMaxPacketSize   = tu_htole16(size),
+    .bInterval        = interval
+  };
+
+  _dev_speed[dev_addr] = speed;
+  tu_memclr(&_poll[dev_addr], sizeof(poll_t));
+  _poll[dev_addr].period_min = UINT32_MAX;
+
+  TU_VERIFY(hcd_edpt_open(0, dev_addr, &desc));
+  TU_ASSERT(hcd_edpt_xfer(0, dev_addr, EP_NOTIF, _buf[dev_addr], sizeof(_buf[dev_addr])));
+
+  return true;
+}
+
+static void run(uint32_t uframes)
+{
+  for(uint32_t i = 0; i < uframes; i++) ehci_model_uframe();
+}
+
+static void close_all(uint8_t count)
+{
+  for(uint8_t addr = 1; addr <= count; addr++) hcd_device_close(0, addr);
+  run(16);
+}
+
+// polled at exactly the expected period
+static bool check_period(uint8_t dev_addr, uint32_t period)
+{
+  poll_t const* p = &_poll[dev_addr];
+
+  if ( p->count < 2 || p->period_min != period || p->period_max != period )
+  {
+    printf("  device %u: %lu polls, period %lu..%lu, expected %lu\n", dev_addr, (unsigned long) p->count,
+           (unsigned long) p->period_min, (unsigned long) p->period_max, (unsigned long) period);
+    return false;
+  }
+
+  return true;
+}
+
+static bool test_interval(void)
+{
+  printf("-- interval\n");
+
+  // high speed bInterval 1..8 on device 1..8, full speed bInterval 1, 2, 3, 5, 8, 16, 32, 255 on device 9..16
+  static uint8_t const fs_interval[8] = { 1, 2, 3, 5, 8, 16, 32, 255 };
+
+  for(uint8_t i = 0; i < 8; i++)
+  {
+    TU_ASSERT(notif_open(1+i, TUSB_SPEED_HIGH, 64, (uint8_t) (1+i)));
+    TU_ASSERT(notif_open(9+i, TUSB_SPEED_FULL, 64, fs_interval[i]));
+  }
+
+  run(RUN_UFRAMES);
+
+  bool ok = true;
+  for(uint8_t i = 0; i < 8; i++)
+  {
+    // longer than frame list is polled at frame list period
+    uint32_t const hs_period = tu_min32(1u << i, FRAMELIST_SLOTS*8);
+    uint32_t const fs_period = tu_min32(1u << tu_log2(fs_interval[i]), FRAMELIST_SLOTS) * 8;
+
+    ok = check_period(1+i, hs_period) && ok;
+    ok = check_period(9+i, fs_period) && ok;
+
+    // full speed start split is in microframe 0
+    ok = ((_poll[9+i].first % 8) == 0) && ok;
+  }
+
+  close_all(16);
+  return ok;
+}
+
+// endpoints of the same interval do not share a microframe (high speed) or frame (full speed)
+static bool test_balance(void)
+{
+  printf("-- balance\n");
+
+  for(uint8_t i = 0; i < 8; i++)
+  {
+    TU_ASSERT(notif_open(1+i, TUSB_SPEED_HIGH, 512, 4));  // 1 ms
+    TU_ASSERT(notif_open(9+i, TUSB_SPEED_FULL, 64 , 8));  // 8 ms
+  }
+
+  // 2 ms: 16 microframe slots for 8 endpoints
+  for(uint8_t i = 0; i < 8; i++) TU_ASSERT(notif_open(17+i, TUSB_SPEED_HIGH, 512, 5));
+
+  run(RUN_UFRAMES);
+
+  uint32_t hs_slots = 0, fs_slots = 0, hs2_slots = 0;
+  for(uint8_t i = 0; i < 8; i++)
+  {
+    hs_slots  |= TU_BIT(_poll[1+i].first % 8);
+    fs_slots  |= TU_BIT((_poll[9+i].first / 8) % 8);
+    hs2_slots |= TU_BIT(_poll[17+i].first % 16);
+  }
+
+  printf("  slots: hs 1ms 0x%02lx, hs 2ms 0x%04lx, fs 8ms 0x%02lx\n",
+         (unsigned long) hs_slots, (unsigned long) hs2_slots, (unsigned long) fs_slots);
+
+  close_all(24);
+  return (hs_slots == 0xFF) && (fs_slots == 0xFF) && (__builtin_popcount(hs2_slots) == 8);
+}
+
+// 1024 bytes every microframe: 1079 bytes with overhead, 5 fit in a microframe
+static bool test_bandwidth(void)
+{
+  printf("-- bandwidth\n");
+
+  for(uint8_t round = 0; round < 2; round++)
+  {
+    for(uint8_t i = 0; i < 5; i++) TU_ASSERT(notif_open(1+i, TUSB_SPEED_HIGH, 1024, 1));
+    TU_ASSERT(!notif_open(6, TUSB_SPEED_HIGH, 1024, 1));
+
+    // full speed budget is separated: 64 + 13 bytes every frame, 17 fit in a frame
+    for(uint8_t i = 0; i < 17; i++) TU_ASSERT(notif_open(7+i, TUSB_SPEED_FULL, 64, 1));
+    TU_ASSERT(!notif_open(24, TUSB_SPEED_FULL, 64, 1));
+
+    // low speed is 8 times of full speed: 8 bytes takes 168 bytes
+    TU_ASSERT(!notif_open(25, TUSB_SPEED_LOW, 8, 10));
+
+    run(RUN_UFRAMES);
+    for(uint8_t i = 0; i < 5; i++) TU_ASSERT(check_period(1+i, 1));
+
+    // released when closed: next round gets the same result
+    close_all(25);
+  }
+
+  // low speed after release
+  TU_ASSERT(notif_open(25, TUSB_SPEED_LOW, 8, 10));
+  run(RUN_UFRAMES);
+  TU_ASSERT(check_period(25, 64));
+  close_all(25);
+
+  return true;
+}
+
+// closing devices in the middle of tree nodes keeps others polled
+static bool test_close(void)
+{
+  printf("-- close\n");
+
+  for(uint8_t i = 0; i < 16; i++) TU_ASSERT(notif_open(1+i, TUSB_SPEED_HIGH, 64, (uint8_t) (4 + (i % 4))));
+
+  for(uint8_t addr = 1; addr <= 16; addr += 2) hcd_device_close(0, addr);
+  run(16);
+
+  for(uint8_t addr = 1; addr <= 16; addr++)
+  {
+    tu_memclr(&_poll[addr], sizeof(poll_t));
+    _poll[addr].period_min = UINT32_MAX;
+  }
+  run(RUN_UFRAMES);
+
+  bool ok = true;
+  for(uint8_t i = 0; i < 16; i++)
+  {
+    if ( i & 1 )
+    {
+      ok = check_period(1+i, 8u << (i % 4)) && ok;
+    }else
+    {
+      ok = (_poll[1+i].count == 0) && ok;
+    }
+  }
+
+  close_all(16);
+  return ok;
+}
+
+int main(void)
+{
+  ehci_model_init(device_xact);
+
+  bool ok = true;
+  ok = test_interval()  && ok;
+  ok = test_balance()   && ok;
+  ok = test_bandwidth() && ok;
+  ok = test_close()     && ok;
+
+  printf(ok ? "PASSED\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "tusb.h"
+#include "host/hcd.h"
+#include "ehci_model.h"
+
+//--------------------------------------------------------------------+
+// EHCI queue head benchmark against the register level model
+// N high speed devices are opened with control, bulk IN/OUT and interrupt IN endpoints. Interrupt IN
+// of every device is either not used, or kept pending while device NAKs as an idle notification
+// endpoint would (polled). Transfers are then streamed on bulk endpoints of the last opened device:
+// - submit: time spent in hcd_edpt_xfer()
+// - isr   : time spent in hcd_int_handler() per completed transfer
+// Devices are closed between rounds so that pools are recycled through free lists.
+//--------------------------------------------------------------------+
+
+#define XFER_COUNT      4000
+#define XFER_BYTES      2048
+#define TIMEOUT_UFRAMES 64
+
+enum
+{
+  EP_BULK_IN  = 0x81,
+  EP_BULK_OUT = 0x02,
+  EP_NOTIF    = 0x83,
+};
+
+static uint8_t const _dev_count[] = { 1, 2, 4, 8, 16, CFG_TUH_DEVICE_MAX };
+
+static volatile bool _complete;
+static uint32_t      _xferred;
+static uint8_t       _result;
+
+// static, all addresses used by controller must be 32-bit
+static uint8_t _buf[XFER_BYTES] TU_ATTR_ALIGNED(4);
+static uint8_t _notif_buf[CFG_TUH_DEVICE_MAX+1][16] TU_ATTR_ALIGNED(4);
+
+//--------------------------------------------------------------------+
+// USBH stubs
+//--------------------------------------------------------------------+
+
+void hcd_devtree_get_info(uint8_t dev_addr, hcd_devtree_info_t* devtree_info)
+{
+  (void) dev_addr;
+  devtree_info->rhport   = 0;
+  devtree_info->speed    = TUSB_SPEED_HIGH;
+  devtree_info->hub_addr = 0;
+  devtree_info->hub_port = 0;
+}
+
+void hcd_event_handler(hcd_event_t const* event, bool in_isr)
+{
+  (void) event; (void) in_isr;
+}
+
+void hcd_event_device_attach(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_device_remove(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_xfer_complete(uint8_t dev_addr, uint8_t ep_addr, uint32_t xferred_bytes, xfer_result_t result, bool in_isr)
+{
+  (void) dev_addr; (void) ep_addr; (void) in_isr;
+
+  _complete = true;
+  _xferred  = xferred_bytes;
+  _result   = (uint8_t) result;
+}
+
+//--------------------------------------------------------------------+
+// Device
+//--------------------------------------------------------------------+
+
+static int32_t device_xact(uint8_t dev_addr, uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  (void) dev_addr;
+
+  // idle notification endpoint
+  if ( ep_addr == EP_NOTIF ) return -1;
+
+  if ( tu_edpt_dir(ep_addr) ) memset(buf, dev_addr, len);
+  return len;
+}
+
+//--------------------------------------------------------------------+
+// Benchmark
+//--------------------------------------------------------------------+
+
+static uint64_t time_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static bool edpt_open(uint8_t dev_addr, uint8_t ep_addr, uint8_t xfer_type, uint16_t size, uint8_t interval)
+{
+  tusb_desc_endpoint_t const desc =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep_addr,
+    .bmAttributes     = { .xfer = xfer_type },
+    .wMaxPacketSize   = tu_htole16(size),
+    .bInterval        = interval
+  };
+
+  return hcd_edpt_open(0, dev_addr, &desc);
+}
+
+static bool device_open(uint8_t dev_addr, bool polled)
+{
+  TU_ASSERT(edpt_open(dev_addr, 0x00       , TUSB_XFER_CONTROL  , 64 , 0));
+  TU_ASSERT(edpt_open(dev_addr, EP_BULK_IN , TUSB_XFER_BULK     , 512, 0));
+  TU_ASSERT(edpt_open(dev_addr, EP_BULK_OUT, TUSB_XFER_BULK     , 512, 0));
+  TU_ASSERT(edpt_open(dev_addr, EP_NOTIF   , TUSB_XFER_INTERRUPT, 16 , 4));
+
+  return !polled || hcd_edpt_xfer(0, dev_addr, EP_NOTIF, _notif_buf[dev_addr], sizeof(_notif_buf[dev_addr]));
+}
+
+static void devices_close(uint8_t count)
+{
+  for(uint8_t addr = 1; addr <= count; addr++) hcd_device_close(0, addr);
+
+  // async advance & period frame
+  for(uint32_t i = 0; i < 16; i++) ehci_model_uframe();
+}
+
+static bool xfer_wait(uint32_t len)
+{
+  for(uint32_t i = 0; !_complete && i < TIMEOUT_UFRAMES; i++) ehci_model_uframe();
+
+  TU_ASSERT(_complete && _result == XFER_RESULT_SUCCESS && _xferred == len);
+  return true;
+}
+
+static bool bench(uint8_t count, bool polled)
+{
+  for(uint8_t addr = 1; addr <= count; addr++) TU_ASSERT(device_open(addr, polled));
+
+  uint8_t const dev_addr = count;
+  uint64_t submit_ns = 0;
+  uint64_t const int_ns    = ehci_model_stat()->int_ns;
+  uint32_t const int_count = ehci_model_stat()->int_count;
+
+  for(uint32_t i = 0; i < XFER_COUNT; i++)
+  {
+    uint8_t const ep_addr = (i & 1) ? EP_BULK_IN : EP_BULK_OUT;
+    _complete = false;
+
+    uint64_t const start = time_ns();
+    bool const ok = hcd_edpt_xfer(0, dev_addr, ep_addr, _buf, XFER_BYTES);
+    submit_ns += time_ns() - start;
+
+    TU_ASSERT(ok);
+    TU_ASSERT(xfer_wait(XFER_BYTES));
+    if ( ep_addr == EP_BULK_IN ) TU_ASSERT(_buf[0] == dev_addr && _buf[XFER_BYTES-1] == dev_addr);
+  }
+
+  printf("%3u devices %-6s: submit %5lu ns, isr %5lu ns per transfer, %lu interrupts\n", count, polled ? "polled" : "idle",
+         (unsigned long) (submit_ns / XFER_COUNT),
+         (unsigned long) ((ehci_model_stat()->int_ns - int_ns) / XFER_COUNT),
+         (unsigned long) (ehci_model_stat()->int_count - int_count));
+
+  devices_close(count);
+  return true;
+}
+
+int main(void)
+{
+  ehci_model_init(device_xact);
+
+  bool ok = true;
+  for(uint8_t i = 0; ok && i < TU_ARRAY_SIZE(_dev_count); i++)
+  {
+    ok = bench(_dev_count[i], false) && bench(_dev_count[i], true);
+  }
+
+  // all queue heads must be recycled: open max devices a few more times
+  for(uint8_t i = 0; ok && i < 3; i++)
+  {
+    for(uint8_t addr = 1; ok && addr <= CFG_TUH_DEVICE_MAX; addr++) ok = device_open(addr, true);
+    devices_close(CFG_TUH_DEVICE_MAX);
+  }
+
+  printf(ok ? "PASSED\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,578 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "stm32f0xx.h"
+#include "sim_test.h"
+#include "fsdev_model.h"
+
+//--------------------------------------------------------------------+
+// STM32 FSDEV device driver against the controller model:
+// - Packet memory allocator: configuration plan with double buffered bulk endpoints, alternate
+//   settings, closing all endpoints, configuration that fills packet memory or does not fit
+// - Bulk IN, OUT and both at once, single buffered (endpoints opened without plan) then double
+//   buffered (planned), with CPU at 48 and 24 MHz
+// Data and data toggles are checked, throughput and NAKed transactions are reported.
+// Completed transfers are queued again by the task in place of usbd.
+//--------------------------------------------------------------------+
+
+#define RUN_FRAMES   200
+#define XFER_BYTES   4096
+#define TASK_BITS    1200   // usbd task runs every 100 us
+
+// Buffers follow buffer table and endpoint 0 buffers
+#define PMA_FIRST    (8*8 + 2*CFG_TUD_ENDPOINT0_SIZE)
+#define PMA_END      1024
+
+static inline uint8_t pattern(uint8_t ep_addr, uint32_t offset)
+{
+  return (uint8_t) (offset*7u + ep_addr);
+}
+
+//--------------------------------------------------------------------+
+// Events, in place of usbd
+//--------------------------------------------------------------------+
+
+static struct
+{
+  dcd_event_t queue[64];
+  uint32_t count;
+} _ev;
+
+bool tud_inited(void)
+{
+  return true;
+}
+
+void dcd_event_handler(dcd_event_t const * event, bool in_isr)
+{
+  (void) in_isr;
+  if ( _ev.count >= TU_ARRAY_SIZE(_ev.queue) )
+  {
+    printf("event queue overflow\n");
+    exit(1);
+  }
+  _ev.queue[_ev.count++] = *event;
+}
+
+void dcd_event_bus_signal (uint8_t rhport, dcd_eventid_t eid, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = eid };
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_bus_reset (uint8_t rhport, tusb_speed_t speed, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_BUS_RESET };
+  event.bus_reset.speed = speed;
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_setup_received(uint8_t rhport, uint8_t const * setup, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_SETUP_RECEIVED };
+  memcpy(&event.setup_received, setup, 8);
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_xfer_complete (uint8_t rhport, uint8_t ep_addr, uint32_t xferred_bytes, uint8_t result, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_XFER_COMPLETE };
+  event.xfer_complete.ep_addr = ep_addr;
+  event.xfer_complete.len     = xferred_bytes;
+  event.xfer_complete.result  = result;
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_sof(uint8_t rhport, uint32_t frame_count, bool microframe, bool in_isr)
+{
+  (void) rhport;
+  (void) frame_count;
+  (void) microframe;
+  (void) in_isr;
+}
+
+//--------------------------------------------------------------------+
+// Streams: device transfers are queued again once complete, host transfers too
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint8_t  ep_addr;
+  bool     enabled;
+
+  // device side
+  uint32_t dev_offset;
+  uint32_t dev_bytes;
+  uint32_t dev_xfers;
+  uint8_t  dev_buf[XFER_BYTES];
+
+  // host side
+  uint32_t host_offset;
+  uint8_t  host_buf[XFER_BYTES];
+} stream_t;
+
+static stream_t _stream[2];
+static uint8_t  _stream_count;
+
+static void dev_submit(stream_t* s)
+{
+  if ( tu_edpt_dir(s->ep_addr) )
+  {
+    for ( uint32_t i = 0; i < XFER_BYTES; i++ ) s->dev_buf[i] = pattern(s->ep_addr, s->dev_offset + i);
+  }
+  else
+  {
+    memset(s->dev_buf, 0, XFER_BYTES);
+  }
+
+  CHECK(dcd_edpt_xfer(0, s->ep_addr, s->dev_buf, XFER_BYTES));
+}
+
+static void host_submit(stream_t* s)
+{
+  if ( !tu_edpt_dir(s->ep_addr) )
+  {
+    for ( uint32_t i = 0; i < XFER_BYTES; i++ ) s->host_buf[i] = pattern(s->ep_addr, s->host_offset + i);
+  }
+
+  fsdev_model_host_xfer(s->ep_addr, 64, s->host_buf, XFER_BYTES);
+}
+
+// Host side completion: next transfer is queued right away
+static void host_complete(uint8_t ep_addr, uint32_t len)
+{
+  for ( uint8_t i = 0; i < _stream_count; i++ )
+  {
+    stream_t* s = &_stream[i];
+    if ( !s->enabled || s->ep_addr != ep_addr ) continue;
+
+    if ( tu_edpt_dir(s->ep_addr) )
+    {
+      for ( uint32_t n = 0; n < len; n++ )
+      {
+        if ( s->host_buf[n] != pattern(s->ep_addr, s->host_offset + n) ) { _errors++; break; }
+      }
+    }
+    s->host_offset += len;
+
+    host_submit(s);
+  }
+}
+
+static void dev_complete(stream_t* s, uint32_t len)
+{
+  if ( !tu_edpt_dir(s->ep_addr) )
+  {
+    for ( uint32_t n = 0; n < len; n++ )
+    {
+      if ( s->dev_buf[n] != pattern(s->ep_addr, s->dev_offset + n) ) { _errors++; break; }
+    }
+  }
+
+  s->dev_offset += len;
+  s->dev_bytes  += len;
+  s->dev_xfers++;
+
+  dev_submit(s);
+}
+
+static void task(void)
+{
+  uint32_t const count = _ev.count;
+  dcd_event_t queue[TU_ARRAY_SIZE(_ev.queue)];
+  memcpy(queue, _ev.queue, count*sizeof(dcd_event_t));
+  _ev.count = 0;
+
+  for ( uint32_t i = 0; i < count; i++ )
+  {
+    dcd_event_t const* ev = &queue[i];
+    if ( ev->event_id != DCD_EVENT_XFER_COMPLETE ) continue;
+
+    CHECK(ev->xfer_complete.result == XFER_RESULT_SUCCESS);
+    for ( uint8_t s = 0; s < _stream_count; s++ )
+    {
+      if ( _stream[s].enabled && _stream[s].ep_addr == ev->xfer_complete.ep_addr ) dev_complete(&_stream[s], ev->xfer_complete.len);
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// Setup
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint8_t  ep_addr;
+  uint8_t  xfer_type;
+  uint16_t size;
+  uint8_t  alt;
+} ep_cfg_t;
+
+static uint8_t _desc_cfg[256];
+
+// Configuration descriptor: one interface, an interface descriptor per alternate setting
+static tusb_desc_configuration_t const* build_config(ep_cfg_t const* eps, uint8_t count)
+{
+  tusb_desc_configuration_t* cfg = (tusb_desc_configuration_t*) _desc_cfg;
+  uint8_t* p = _desc_cfg + sizeof(tusb_desc_configuration_t);
+
+  tu_memclr(_desc_cfg, sizeof(_desc_cfg));
+  cfg->bLength             = sizeof(tusb_desc_configuration_t);
+  cfg->bDescriptorType     = TUSB_DESC_CONFIGURATION;
+  cfg->bNumInterfaces      = 1;
+  cfg->bConfigurationValue = 1;
+
+  for ( uint8_t i = 0; i < count; i++ )
+  {
+    if ( i == 0 || eps[i].alt != eps[i-1].alt )
+    {
+      tusb_desc_interface_t* itf = (tusb_desc_interface_t*) p;
+      itf->bLength           = sizeof(tusb_desc_interface_t);
+      itf->bDescriptorType   = TUSB_DESC_INTERFACE;
+      itf->bAlternateSetting = eps[i].alt;
+      itf->bInterfaceClass   = TUSB_CLASS_VENDOR_SPECIFIC;
+      p += sizeof(tusb_desc_interface_t);
+    }
+
+    tusb_desc_endpoint_t* ep = (tusb_desc_endpoint_t*) p;
+    ep->bLength            = sizeof(tusb_desc_endpoint_t);
+    ep->bDescriptorType    = TUSB_DESC_ENDPOINT;
+    ep->bEndpointAddress   = eps[i].ep_addr;
+    ep->bmAttributes.xfer  = eps[i].xfer_type & 3;
+    ep->wMaxPacketSize     = tu_htole16(eps[i].size);
+    ep->bInterval          = 1;
+    p += sizeof(tusb_desc_endpoint_t);
+  }
+
+  cfg->wTotalLength = tu_htole16((uint16_t) (p - _desc_cfg));
+  return cfg;
+}
+
+static bool edpt_open(ep_cfg_t const* ep)
+{
+  tusb_desc_endpoint_t const desc =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep->ep_addr,
+    .bmAttributes     = { .xfer = ep->xfer_type & 3 },
+    .wMaxPacketSize   = tu_htole16(ep->size),
+    .bInterval        = 1
+  };
+
+  return dcd_edpt_open(0, &desc);
+}
+
+static void setup(uint32_t cpu_mhz)
+{
+  tu_memclr(&_ev, sizeof(_ev));
+  tu_memclr(_stream, sizeof(_stream));
+  _stream_count = 0;
+
+  fsdev_model_init(task, cpu_mhz, TASK_BITS);
+  fsdev_model_host_callback(host_complete);
+  dcd_init(0);
+  dcd_int_enable(0);
+
+  fsdev_model_bus_reset();
+  _ev.count = 0;
+}
+
+static uint16_t epr(uint8_t epnum)
+{
+  return (&USB->EP0R)[2*epnum];
+}
+
+static uint16_t btable(uint8_t epnum, uint8_t i)
+{
+  return fsdev_model_pma[4*epnum + i];
+}
+
+static bool epr_dbl(uint8_t epnum)
+{
+  uint16_t const r = epr(epnum);
+  return ((r & USB_EP_T_FIELD) == USB_EP_BULK) && (r & USB_EP_KIND);
+}
+
+static uint16_t rx_buf_size(uint16_t count_rx)
+{
+  uint16_t const blocks = (count_rx >> 10) & 0x1FU;
+  return (uint16_t) ((count_rx & 0x8000U) ? 32u*(blocks + 1u) : 2u*blocks);
+}
+
+//--------------------------------------------------------------------+
+// Allocator
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint16_t addr;
+  uint16_t size;
+} region_t;
+
+// Buffers of open endpoints (EP0 included) are 16-bit aligned, within packet memory after buffer
+// table and do not overlap. Return end of last buffer
+static uint16_t check_buffers(ep_cfg_t const* eps, uint8_t count)
+{
+  region_t region[2 + 2*8];
+  uint8_t n = 0;
+
+  region[n++] = (region_t) { btable(0, 0), CFG_TUD_ENDPOINT0_SIZE };
+  region[n++] = (region_t) { btable(0, 2), rx_buf_size(btable(0, 3)) };
+
+  for ( uint8_t i = 0; i < count; i++ )
+  {
+    uint8_t const epnum = tu_edpt_number(eps[i].ep_addr);
+    bool const in = tu_edpt_dir(eps[i].ep_addr);
+    uint16_t const size = in ? eps[i].size : rx_buf_size(btable(epnum, 3));
+
+    if ( epr_dbl(epnum) )
+    {
+      region[n++] = (region_t) { btable(epnum, 0), in ? size : rx_buf_size(btable(epnum, 1)) };
+      region[n++] = (region_t) { btable(epnum, 2), size };
+    }
+    else
+    {
+      region[n++] = (region_t) { btable(epnum, in ? 0 : 2), size };
+    }
+  }
+
+  uint16_t end = 0;
+  for ( uint8_t i = 0; i < n; i++ )
+  {
+    CHECK(region[i].size >= ((i < 2) ? CFG_TUD_ENDPOINT0_SIZE : 1));
+    CHECK((region[i].addr & 1) == 0);
+    CHECK(region[i].addr >= 8*8 && region[i].addr + region[i].size <= PMA_END);
+    for ( uint8_t j = 0; j < i; j++ )
+    {
+      CHECK(region[i].addr + region[i].size <= region[j].addr || region[j].addr + region[j].size <= region[i].addr);
+    }
+    end = tu_max16(end, (uint16_t) (region[i].addr + region[i].size));
+  }
+
+  return end;
+}
+
+static bool open_all(ep_cfg_t const* eps, uint8_t count, uint8_t alt)
+{
+  bool ok = true;
+  for ( uint8_t i = 0; i < count; i++ )
+  {
+    if ( eps[i].alt == alt ) ok = edpt_open(&eps[i]) && ok;
+  }
+  return ok;
+}
+
+static void test_allocator(void)
+{
+  printf("allocator\n");
+  setup(48);
+
+  // Bulk OUT 1 and IN 2 are double buffered, interrupt IN 3 and bulk 4 used both ways are not
+  {
+    ep_cfg_t const eps[] =
+    {
+      { 0x01, TUSB_XFER_BULK, 64, 0 }, { 0x82, TUSB_XFER_BULK, 64, 0 }, { 0x83, TUSB_XFER_INTERRUPT, 8, 0 },
+      { 0x04, TUSB_XFER_BULK, 64, 0 }, { 0x84, TUSB_XFER_BULK, 64, 0 },
+    };
+    dcd_edpt_plan(0, build_config(eps, TU_ARRAY_SIZE(eps)));
+    CHECK(open_all(eps, TU_ARRAY_SIZE(eps), 0));
+    CHECK(epr_dbl(1) && epr_dbl(2));
+    CHECK(!epr_dbl(3) && !epr_dbl(4));
+    CHECK((epr(3) & USB_EP_T_FIELD) == USB_EP_INTERRUPT);
+    CHECK(check_buffers(eps, TU_ARRAY_SIZE(eps)) == PMA_FIRST + 2*64 + 2*64 + 8 + 2*64);
+    dcd_edpt_close_all(0);
+  }
+
+  // Alternate settings share buffers sized for the largest packet: switching does not leak
+  {
+    ep_cfg_t const eps[] =
+    {
+      { 0x01, TUSB_XFER_BULK, 32, 0 }, { 0x81, TUSB_XFER_INTERRUPT, 16, 0 },
+      { 0x01, TUSB_XFER_BULK, 64, 1 }, { 0x81, TUSB_XFER_INTERRUPT, 64, 1 }, { 0x82, TUSB_XFER_BULK, 64, 1 },
+    };
+    dcd_edpt_plan(0, build_config(eps, TU_ARRAY_SIZE(eps)));
+
+    for ( uint8_t i = 0; i < 10; i++ )
+    {
+      uint8_t const alt = i & 1;
+      CHECK(open_all(eps, TU_ARRAY_SIZE(eps), alt));
+      CHECK(check_buffers(alt ? &eps[2] : eps, alt ? 3 : 2) <= PMA_FIRST + 2*64 + 64 + 64);
+
+      for ( uint8_t e = 0; e < TU_ARRAY_SIZE(eps); e++ )
+      {
+        if ( eps[e].alt == alt ) dcd_edpt_close(0, eps[e].ep_addr);
+      }
+    }
+    dcd_edpt_close_all(0);
+  }
+
+  // Without plan buffers are allocated at open, single buffered, and freed by closing all
+  {
+    ep_cfg_t const eps[] =
+    {
+      { 0x81, TUSB_XFER_BULK, 64, 0 }, { 0x02, TUSB_XFER_BULK, 64, 0 }, { 0x83, TUSB_XFER_INTERRUPT, 10, 0 },
+    };
+    for ( uint8_t i = 0; i < 20; i++ )
+    {
+      CHECK(open_all(eps, TU_ARRAY_SIZE(eps), 0));
+      CHECK(!epr_dbl(1) && !epr_dbl(2));
+      CHECK(btable(1, 0) == PMA_FIRST);
+      CHECK(check_buffers(eps, TU_ARRAY_SIZE(eps)) == PMA_FIRST + 64 + 64 + 10);
+      dcd_edpt_close_all(0);
+    }
+  }
+
+  // Six double buffered bulk OUT and interrupt IN fill packet memory exactly
+  {
+    ep_cfg_t eps[7];
+    for ( uint8_t i = 0; i < 6; i++ ) eps[i] = (ep_cfg_t) { (uint8_t) (i + 1), TUSB_XFER_BULK, 64, 0 };
+    eps[6] = (ep_cfg_t) { 0x87, TUSB_XFER_INTERRUPT, 64, 0 };
+
+    dcd_edpt_plan(0, build_config(eps, 7));
+    CHECK(open_all(eps, 7, 0));
+    for ( uint8_t i = 1; i <= 6; i++ ) CHECK(epr_dbl(i));
+    CHECK(!epr_dbl(7));
+    CHECK(check_buffers(eps, 7) == PMA_END);
+    dcd_edpt_close_all(0);
+  }
+
+  // Configuration too large for a plan: buffers are allocated at open until packet memory is full
+  {
+    ep_cfg_t eps[14];
+    for ( uint8_t i = 0; i < 7; i++ )
+    {
+      eps[2*i]   = (ep_cfg_t) { (uint8_t) (i + 1), TUSB_XFER_BULK, 64, 0 };
+      eps[2*i+1] = (ep_cfg_t) { (uint8_t) (0x80 | (i + 1)), TUSB_XFER_BULK, 64, 0 };
+    }
+
+    dcd_edpt_plan(0, build_config(eps, 14));
+    for ( uint8_t i = 0; i < 13; i++ ) CHECK(edpt_open(&eps[i]));
+    CHECK(!edpt_open(&eps[13]));
+    CHECK(!epr_dbl(1));
+    CHECK(check_buffers(eps, 13) == PMA_END);
+    dcd_edpt_close_all(0);
+
+    CHECK(edpt_open(&eps[13]));
+    CHECK(btable(7, 0) == PMA_FIRST);
+    dcd_edpt_close_all(0);
+  }
+}
+
+//--------------------------------------------------------------------+
+// Bulk throughput
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint32_t kbps;
+  uint32_t nak_pct;
+} bench_result_t;
+
+static bench_result_t bench(uint32_t cpu_mhz, bool dbl, bool out, bool in)
+{
+  setup(cpu_mhz);
+
+  ep_cfg_t const eps[] = { { 0x01, TUSB_XFER_BULK, 64, 0 }, { 0x82, TUSB_XFER_BULK, 64, 0 } };
+  if ( dbl ) dcd_edpt_plan(0, build_config(eps, TU_ARRAY_SIZE(eps)));
+
+  for ( uint8_t i = 0; i < TU_ARRAY_SIZE(eps); i++ )
+  {
+    if ( tu_edpt_dir(eps[i].ep_addr) ? !in : !out ) continue;
+
+    CHECK(edpt_open(&eps[i]));
+    CHECK(epr_dbl(tu_edpt_number(eps[i].ep_addr)) == dbl);
+
+    stream_t* s = &_stream[_stream_count++];
+    s->ep_addr = eps[i].ep_addr;
+    s->enabled = true;
+    dev_submit(s);
+    host_submit(s);
+  }
+
+  for ( uint32_t f = 0; f < RUN_FRAMES; f++ ) fsdev_model_frame();
+
+  fsdev_model_stat_t const* stat = fsdev_model_stat();
+  uint32_t bytes = 0;
+  for ( uint8_t i = 0; i < _stream_count; i++ )
+  {
+    bytes += _stream[i].dev_bytes;
+    CHECK(_stream[i].dev_xfers > 2);
+  }
+  CHECK(stat->toggle_errors == 0);
+
+  bench_result_t const result =
+  {
+    .kbps    = (uint32_t) ((uint64_t) bytes * 1000u / stat->frames / 1024u),
+    .nak_pct = (uint32_t) (stat->nak_bits * 100u / ((uint64_t) stat->frames * MODEL_FRAME_BITS)),
+  };
+
+  printf("  %2u MHz %-6s %-8s: %4u KB/s, %2u%% NAK, %5u interrupts, handler %3u bit times avg\n",
+         (unsigned) cpu_mhz, dbl ? "double" : "single", out ? (in ? "OUT+IN" : "OUT") : "IN",
+         (unsigned) result.kbps, (unsigned) result.nak_pct, (unsigned) stat->irq_count,
+         (unsigned) (stat->irq_count ? stat->isr_bits / stat->irq_count : 0));
+
+  return result;
+}
+
+static void test_bulk(uint32_t cpu_mhz)
+{
+  printf("bulk 64 bytes, %u byte transfers, CPU at %u MHz\n", XFER_BYTES, (unsigned) cpu_mhz);
+
+  bench_result_t const out_single = bench(cpu_mhz, false, true, false);
+  bench_result_t const out_dbl    = bench(cpu_mhz, true, true, false);
+  bench_result_t const in_single  = bench(cpu_mhz, false, false, true);
+  bench_result_t const in_dbl     = bench(cpu_mhz, true, false, true);
+  bench_result_t const both_single = bench(cpu_mhz, false, true, true);
+  bench_result_t const both_dbl    = bench(cpu_mhz, true, true, true);
+
+  // Next packet is moved while the handler copies the previous one. OUT packet is NAKed anyway if
+  // SW_BUF is not toggled by the time the next token is received
+  CHECK(in_dbl.kbps > in_single.kbps);
+  CHECK(in_dbl.nak_pct < in_single.nak_pct);
+  CHECK(out_dbl.kbps >= out_single.kbps);
+  CHECK(both_dbl.kbps >= both_single.kbps);
+  if ( cpu_mhz >= 48 )
+  {
+    CHECK(out_dbl.kbps > out_single.kbps*3/2);
+    CHECK(out_dbl.nak_pct == 0);
+  }
+}
+
+int main(void)
+{
+  test_allocator();
+  test_bulk(48);
+  test_bulk(24);
+
+  return sim_result();
+}
@@ -0,0 +1,876 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stm32f0xx.h"
+#include "device/dcd.h"
+#include "fsdev_model.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM
+//--------------------------------------------------------------------+
+
+enum
+{
+  SOF_BITS    = 40,
+  TOKEN_BITS  = 35,     // endpoint state is sampled once token is received
+  XACT_BITS   = 80,     // token, handshake and gaps of a data transaction
+  NAK_BITS    = 70,
+  EOF_BITS    = 100,    // no transaction is started in the last bit times of a frame
+  EP0_SIZE    = 64,
+  PMA_WORDS   = 512,
+};
+
+// Interrupt handler CPU time
+enum
+{
+  ISR_CYCLES  = 40,     // exception entry until first register access
+  REG_CYCLES  = 12,     // register access (peripheral bus, read-modify-write of helpers)
+  WORD_CYCLES = 8,      // 16-bit word copied between packet memory and RAM
+};
+
+enum
+{
+  CTRL_SETUP = 0,
+  CTRL_DATA,
+  CTRL_STATUS
+};
+
+#define TIME_NONE  UINT64_MAX
+
+// Bits of EPnR that are written as they are
+#define EPR_RW_MASK      (USB_EP_T_FIELD | USB_EP_KIND | USB_EPADDR_FIELD)
+#define EPR_TOGGLE_MASK  (USB_EP_DTOG_RX | USB_EPRX_STAT | USB_EP_DTOG_TX | USB_EPTX_STAT)
+
+// ISTR bits cleared by writing 0, others are read only
+#define ISTR_RC_W0_MASK  0x7F00U
+
+USB_TypeDef fsdev_model_regs;
+uint16_t fsdev_model_pma[PMA_WORDS];
+
+typedef struct
+{
+  uint8_t* buf;
+  uint32_t len;
+  uint32_t xferred;
+  uint16_t mps;
+  bool     active;
+  bool     stalled;
+} host_xfer_t;
+
+static struct
+{
+  uint64_t now;
+  uint32_t cpu_mhz;
+  uint32_t task_bits;
+  fsdev_model_task_t    task_cb;
+  fsdev_model_host_cb_t host_cb;
+
+  bool     irq_enabled;
+  bool     in_isr;
+  bool     in_task;
+  uint64_t task_due;
+  uint64_t frame_end;
+
+  // Hardware value of registers that do not read as written. Register memory holds the value
+  // presented to the driver: any difference is a write not applied yet
+  uint16_t epr[8];
+  uint16_t istr;
+  uint16_t fnr;
+
+  // Interrupt handler: start time and CPU cycles so far, packet memory as it was last seen
+  uint64_t isr_start;
+  uint64_t isr_cycles;
+  uint16_t pma_seen[PMA_WORDS];
+
+  // Words of received packets per buffer: not acknowledged yet (CTR_RX set), to be read by handler
+  uint16_t rx_recv[8][2];
+  uint16_t rx_unread[8][2];
+
+  host_xfer_t host[8][2];
+  uint8_t host_toggle[8][2];
+  uint8_t rr;
+
+  struct
+  {
+    bool     active;
+    uint8_t  stage;
+    uint8_t  setup[8];
+    uint8_t* buf;
+    uint16_t len;
+    uint16_t xferred;
+    bool     stalled;
+  } ctrl;
+
+  fsdev_model_stat_t stat;
+} _model;
+
+static inline uint64_t min64(uint64_t x, uint64_t y)
+{
+  return (x < y) ? x : y;
+}
+
+static inline volatile uint16_t* epr_mem(uint8_t n)
+{
+  return (&fsdev_model_regs.EP0R) + 2*n;
+}
+
+static inline bool epr_dbl(uint16_t epr)
+{
+  return ((epr & USB_EP_T_FIELD) == USB_EP_BULK) && (epr & USB_EP_KIND);
+}
+
+//--------------------------------------------------------------------+
+// Registers
+//--------------------------------------------------------------------+
+
+static void bus_sync(uint64_t t);
+
+static bool irq_pending(void)
+{
+  return (_model.istr & fsdev_model_regs.CNTR & 0xFF00U) != 0;
+}
+
+// CTR, DIR and EP_ID of ISTR follow endpoint registers: lowest endpoint with CTR set
+static void istr_update(void)
+{
+  uint16_t istr = _model.istr & (uint16_t) ~(USB_ISTR_CTR | USB_ISTR_DIR | USB_ISTR_EP_ID);
+  for ( uint8_t n = 0; n < 8; n++ )
+  {
+    uint16_t const epr = _model.epr[n];
+    if ( epr & (USB_EP_CTR_RX | USB_EP_CTR_TX) )
+    {
+      istr |= (uint16_t) (USB_ISTR_CTR | n | ((epr & USB_EP_CTR_RX) ? USB_ISTR_DIR : 0));
+      break;
+    }
+  }
+  _model.istr = istr;
+  fsdev_model_regs.ISTR = istr;
+}
+
+static void raise(uint16_t istr_bit)
+{
+  _model.istr |= istr_bit;
+  istr_update();
+}
+
+// Hardware update of an endpoint register
+static void epr_set(uint8_t n, uint16_t value)
+{
+  _model.epr[n] = value;
+  *epr_mem(n) = value;
+  istr_update();
+}
+
+// Register value after driver writes w
+static uint16_t epr_write(uint16_t v, uint16_t w)
+{
+  uint16_t r = v;
+  r &= (uint16_t) ~((USB_EP_CTR_RX | USB_EP_CTR_TX) & ~w);
+  r ^= (uint16_t) (w & EPR_TOGGLE_MASK);
+  r  = (uint16_t) ((r & ~EPR_RW_MASK) | (w & EPR_RW_MASK));
+  return r;
+}
+
+// OUT buffer a write hands back to hardware: single buffered STAT_RX to VALID gives buffer 1 (RX
+// entries), double buffered SW_BUF (DTOG_TX) toggle gives the buffer DTOG_RX selects. -1 if none
+static int rx_handback(uint16_t v, uint16_t w)
+{
+  uint16_t const r = epr_write(v, w);
+  if ( epr_dbl(r) && (r & USB_EPRX_STAT) != USB_EP_RX_DIS )
+  {
+    if ( !(w & USB_EP_DTOG_TX) ) return -1;
+    return (r & USB_EP_DTOG_RX) ? 1 : 0;
+  }
+  return (((v & USB_EPRX_STAT) != USB_EP_RX_VALID) && ((r & USB_EPRX_STAT) == USB_EP_RX_VALID)) ? 1 : -1;
+}
+
+static void cpu_run(uint64_t cycles);
+
+static void rx_read(uint8_t n, uint8_t buf_id)
+{
+  uint16_t const words = _model.rx_unread[n][buf_id];
+  if ( !words ) return;
+
+  _model.rx_unread[n][buf_id] = 0;
+  _model.stat.pma_words += words;
+  cpu_run((uint64_t) words*WORD_CYCLES);
+}
+
+static void apply_epr(uint8_t n, uint16_t w)
+{
+  // received packet is read before its buffer is given back
+  if ( _model.in_isr )
+  {
+    int const buf_id = rx_handback(_model.epr[n], w);
+    if ( buf_id >= 0 ) rx_read(n, (uint8_t) buf_id);
+  }
+
+  uint16_t const v = _model.epr[n];
+  uint16_t const r = epr_write(v, w);
+
+  if ( (v & USB_EP_CTR_RX) && !(r & USB_EP_CTR_RX) )
+  {
+    for ( uint8_t i = 0; i < 2; i++ )
+    {
+      _model.rx_unread[n][i] = (uint16_t) (_model.rx_unread[n][i] + _model.rx_recv[n][i]);
+      _model.rx_recv[n][i] = 0;
+    }
+  }
+  epr_set(n, r);
+}
+
+// Apply register writes made since last access. Written value is restored first: bus may update
+// the register before the write is applied on top of it
+static void apply(void)
+{
+  USB_TypeDef* const usb = &fsdev_model_regs;
+
+  for ( uint8_t n = 0; n < 8; n++ )
+  {
+    uint16_t const w = *epr_mem(n);
+    if ( w != _model.epr[n] )
+    {
+      *epr_mem(n) = _model.epr[n];
+      apply_epr(n, w);
+    }
+  }
+
+  if ( usb->ISTR != _model.istr )
+  {
+    uint16_t const w = usb->ISTR;
+    _model.istr &= (uint16_t) (w | ~ISTR_RC_W0_MASK);
+    istr_update();
+  }
+
+  usb->FNR = _model.fnr;
+}
+
+//--------------------------------------------------------------------+
+// Interrupt handler time
+//--------------------------------------------------------------------+
+
+// Bus runs until handler CPU time
+static void cpu_sync(void)
+{
+  bus_sync(_model.isr_start + (_model.isr_cycles*12u)/_model.cpu_mhz);
+}
+
+static void cpu_run(uint64_t cycles)
+{
+  _model.isr_cycles += cycles;
+  cpu_sync();
+}
+
+// Packet memory words written by handler since last access
+static void pma_written(void)
+{
+  if ( memcmp(fsdev_model_pma, _model.pma_seen, sizeof(_model.pma_seen)) == 0 ) return;
+
+  uint32_t words = 0;
+  for ( uint32_t i = 0; i < PMA_WORDS; i++ )
+  {
+    if ( fsdev_model_pma[i] != _model.pma_seen[i] )
+    {
+      _model.pma_seen[i] = fsdev_model_pma[i];
+      words++;
+    }
+  }
+
+  if ( words )
+  {
+    _model.stat.pma_words += words;
+    _model.isr_cycles += (uint64_t) words*WORD_CYCLES;
+  }
+}
+
+USB_TypeDef* fsdev_model_usb(void)
+{
+  apply();
+
+  if ( _model.in_isr )
+  {
+    pma_written();
+    _model.stat.reg_access++;
+    cpu_run(REG_CYCLES);
+  }
+
+  return &fsdev_model_regs;
+}
+
+static void run_isr(void)
+{
+  _model.in_isr     = true;
+  _model.isr_start  = _model.now;
+  _model.isr_cycles = ISR_CYCLES;
+  memcpy(_model.pma_seen, fsdev_model_pma, sizeof(_model.pma_seen));
+  cpu_sync();
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  dcd_int_handler(0);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  apply();
+  pma_written();
+  for ( uint8_t n = 0; n < 8; n++ )
+  {
+    rx_read(n, 0);
+    rx_read(n, 1);
+  }
+  cpu_sync();
+
+  _model.in_isr = false;
+  _model.stat.irq_count++;
+  _model.stat.isr_bits += (_model.isr_cycles*12u)/_model.cpu_mhz;
+  _model.stat.isr_ns   += (uint64_t) (t1.tv_sec - t0.tv_sec)*1000000000u + (uint64_t) (t1.tv_nsec - t0.tv_nsec);
+}
+
+static void run_task(void)
+{
+  _model.in_task = true;
+  _model.task_cb();
+  apply();
+  _model.in_task = false;
+  _model.task_due = _model.now + _model.task_bits;
+}
+
+//--------------------------------------------------------------------+
+// Packet memory
+//--------------------------------------------------------------------+
+
+static inline uint16_t btable(uint8_t n, uint8_t i)
+{
+  return fsdev_model_pma[(fsdev_model_regs.BTABLE >> 1) + 4u*n + i];
+}
+
+static inline volatile uint16_t* btable_ptr(uint8_t n, uint8_t i)
+{
+  return &fsdev_model_pma[(fsdev_model_regs.BTABLE >> 1) + 4u*n + i];
+}
+
+// Buffer size from COUNT_RX
+static uint16_t rx_buf_size(uint16_t count_rx)
+{
+  uint16_t const blocks = (count_rx >> 10) & 0x1FU;
+  return (uint16_t) ((count_rx & 0x8000U) ? 32u*(blocks + 1u) : 2u*blocks);
+}
+
+static void pma_check(uint16_t addr, uint16_t len, char const* what)
+{
+  if ( (addr & 1u) || addr + len > 2u*PMA_WORDS )
+  {
+    fprintf(stderr, "fsdev model: %s buffer 0x%03X of %u bytes is outside packet memory\n", what, addr, len);
+    abort();
+  }
+}
+
+static void pma_write(uint16_t addr, uint8_t const* data, uint16_t len)
+{
+  pma_check(addr, len, "RX");
+  for ( uint16_t i = 0; i < len; i += 2 )
+  {
+    uint16_t const word = (uint16_t) (data[i] | ((i + 1u < len) ? (data[i+1] << 8) : 0));
+    fsdev_model_pma[(addr + i)/2] = word;
+    _model.pma_seen[(addr + i)/2] = word;
+  }
+}
+
+static void pma_read(uint8_t* data, uint16_t addr, uint16_t len)
+{
+  pma_check(addr, len, "TX");
+  for ( uint16_t i = 0; i < len; i++ )
+  {
+    uint16_t const word = fsdev_model_pma[(addr + i)/2];
+    data[i] = (uint8_t) ((i & 1u) ? (word >> 8) : word);
+  }
+}
+
+// Store received packet in buffer 0 (TX entries) or 1 (RX entries) of endpoint
+static void rx_store(uint8_t n, uint8_t buf_id, uint8_t const* data, uint16_t len)
+{
+  uint8_t const i = buf_id ? 2 : 0;
+  uint16_t const size = rx_buf_size(btable(n, i+1));
+  if ( len > size )
+  {
+    fprintf(stderr, "fsdev model: %u byte packet for %u byte buffer of endpoint %u\n", len, size, n);
+    abort();
+  }
+
+  pma_write(btable(n, i), data, len);
+  *btable_ptr(n, i+1) = (uint16_t) ((btable(n, i+1) & 0xFC00U) | len);
+  _model.rx_recv[n][buf_id] = (uint16_t) (_model.rx_recv[n][buf_id] + (len + 1u)/2);
+}
+
+//--------------------------------------------------------------------+
+// Bus
+//--------------------------------------------------------------------+
+
+static void host_done(uint8_t ep_addr, host_xfer_t* xfer)
+{
+  xfer->active = false;
+  if ( _model.host_cb ) _model.host_cb(ep_addr, xfer->xferred);
+}
+
+static void nak(void)
+{
+  _model.stat.nak_xact++;
+  _model.stat.nak_bits  += NAK_BITS;
+  _model.stat.busy_bits += NAK_BITS;
+  _model.now += NAK_BITS;
+}
+
+// Data packet is sent before NAK handshake
+static void out_nak(uint16_t len)
+{
+  uint32_t const bits = XACT_BITS + 8u*len;
+  _model.stat.nak_xact++;
+  _model.stat.nak_bits  += bits;
+  _model.stat.busy_bits += bits;
+  _model.now += bits;
+}
+
+// STALL handshake ends host transfer
+static void stall(uint8_t ep_addr, host_xfer_t* xfer)
+{
+  _model.stat.busy_bits += NAK_BITS;
+  _model.now += NAK_BITS;
+
+  xfer->stalled = true;
+  host_done(ep_addr, xfer);
+}
+
+static void control_stall(void)
+{
+  _model.stat.busy_bits += NAK_BITS;
+  _model.now += NAK_BITS;
+
+  _model.ctrl.stalled = true;
+  _model.ctrl.active  = false;
+  if ( _model.host_cb ) _model.host_cb(TUSB_DIR_IN_MASK, _model.ctrl.xferred);
+}
+
+static void data_xact(uint16_t len)
+{
+  uint32_t const bits = XACT_BITS + 8u*len;
+  _model.stat.data_xact++;
+  _model.stat.busy_bits += bits;
+  _model.now += bits;
+}
+
+static void sof(void)
+{
+  _model.fnr = (uint16_t) ((_model.fnr & ~USB_FNR_FN) | ((_model.fnr + 1u) & USB_FNR_FN));
+  fsdev_model_regs.FNR = _model.fnr;
+  raise(USB_ISTR_SOF);
+  _model.now += SOF_BITS;
+}
+
+// Endpoint 0 IN packet of data or status stage, return its length or -1 if not sent
+static int32_t ep0_in(void)
+{
+  uint16_t const epr = _model.epr[0];
+  switch ( epr & USB_EPTX_STAT )
+  {
+    case USB_EP_TX_STALL: control_stall(); return -1;
+    case USB_EP_TX_VALID: break;
+    default: nak(); return -1;
+  }
+
+  uint16_t const len = btable(0, 1) & 0x3FFU;
+  if ( len > EP0_SIZE )
+  {
+    fprintf(stderr, "fsdev model: %u byte packet on endpoint 0\n", len);
+    abort();
+  }
+  data_xact(len);
+
+  uint8_t data[EP0_SIZE];
+  pma_read(data, btable(0, 0), len);
+  uint16_t const count = (uint16_t) tu_min32(len, _model.ctrl.len - _model.ctrl.xferred);
+  if ( count ) memcpy(_model.ctrl.buf + _model.ctrl.xferred, data, count);
+  _model.ctrl.xferred += count;
+
+  epr_set(0, (uint16_t) (((epr ^ USB_EP_DTOG_TX) & ~USB_EPTX_STAT) | USB_EP_TX_NAK | USB_EP_CTR_TX));
+  return len;
+}
+
+static void control_xact(void)
+{
+  switch ( _model.ctrl.stage )
+  {
+    case CTRL_SETUP:
+    {
+      data_xact(8);
+
+      uint16_t const epr = _model.epr[0];
+      rx_store(0, 1, _model.ctrl.setup, 8);
+      epr_set(0, (uint16_t) ((epr & ~USB_EPRX_STAT) | USB_EP_RX_NAK | USB_EP_SETUP | USB_EP_CTR_RX |
+                             USB_EP_DTOG_RX | USB_EP_DTOG_TX));
+      _model.ctrl.stage = _model.ctrl.len ? CTRL_DATA : CTRL_STATUS;
+    }
+    break;
+
+    case CTRL_DATA:
+    {
+      int32_t const len = ep0_in();
+      if ( len >= 0 && (len < EP0_SIZE || _model.ctrl.xferred >= _model.ctrl.len) ) _model.ctrl.stage = CTRL_STATUS;
+    }
+    break;
+
+    case CTRL_STATUS:
+    {
+      if ( _model.ctrl.len )
+      {
+        // zero length OUT
+        uint16_t const epr = _model.epr[0];
+        switch ( epr & USB_EPRX_STAT )
+        {
+          case USB_EP_RX_STALL: control_stall(); return;
+          case USB_EP_RX_VALID: break;
+          default: out_nak(0); return;
+        }
+        data_xact(0);
+        rx_store(0, 1, NULL, 0);
+        epr_set(0, (uint16_t) (((epr ^ USB_EP_DTOG_RX) & ~(USB_EPRX_STAT | USB_EP_SETUP)) | USB_EP_RX_NAK | USB_EP_CTR_RX));
+      }
+      else
+      {
+        if ( ep0_in() < 0 ) return;
+      }
+
+      _model.ctrl.active = false;
+      if ( _model.host_cb ) _model.host_cb(TUSB_DIR_IN_MASK, _model.ctrl.xferred);
+    }
+    break;
+
+    default: break;
+  }
+}
+
+static void bulk_out_xact(uint8_t epnum)
+{
+  host_xfer_t* xfer = &_model.host[epnum][TUSB_DIR_OUT];
+  uint16_t const epr = _model.epr[epnum];
+  uint16_t const len = (uint16_t) tu_min32(xfer->mps, xfer->len - xfer->xferred);
+
+  if ( (epr & USB_EPRX_STAT) == USB_EP_RX_STALL )
+  {
+    stall(epnum, xfer);
+    return;
+  }
+
+  // double buffered: hardware owns buffer DTOG_RX while it differs from SW_BUF
+  bool const dbl = epr_dbl(epr);
+  bool const dtog = (epr & USB_EP_DTOG_RX) != 0;
+  if ( (epr & USB_EPRX_STAT) != USB_EP_RX_VALID || (dbl && dtog == ((epr & USB_EP_DTOG_TX) != 0)) )
+  {
+    out_nak(len);
+    return;
+  }
+
+  data_xact(len);
+
+  // packet with wrong data toggle is ACKed but dropped
+  if ( dtog == _model.host_toggle[epnum][TUSB_DIR_OUT] )
+  {
+    rx_store(epnum, dbl ? dtog : 1, xfer->buf + xfer->xferred, len);
+    uint16_t r = (uint16_t) (((epr ^ USB_EP_DTOG_RX) & ~USB_EP_SETUP) | USB_EP_CTR_RX);
+    if ( !dbl ) r = (uint16_t) ((r & ~USB_EPRX_STAT) | USB_EP_RX_NAK);
+    epr_set(epnum, r);
+  }
+  else
+  {
+    _model.stat.toggle_errors++;
+  }
+  _model.host_toggle[epnum][TUSB_DIR_OUT] ^= 1;
+
+  xfer->xferred += len;
+  if ( len < xfer->mps || xfer->xferred >= xfer->len ) host_done(epnum, xfer);
+}
+
+static void bulk_in_xact(uint8_t epnum)
+{
+  host_xfer_t* xfer = &_model.host[epnum][TUSB_DIR_IN];
+  uint16_t const epr = _model.epr[epnum];
+
+  if ( (epr & USB_EPTX_STAT) == USB_EP_TX_STALL )
+  {
+    stall(epnum | TUSB_DIR_IN_MASK, xfer);
+    return;
+  }
+
+  // double buffered: hardware owns buffer DTOG_TX while it differs from SW_BUF
+  bool const dbl = epr_dbl(epr);
+  bool const dtog = (epr & USB_EP_DTOG_TX) != 0;
+  if ( (epr & USB_EPTX_STAT) != USB_EP_TX_VALID || (dbl && dtog == ((epr & USB_EP_DTOG_RX) != 0)) )
+  {
+    nak();
+    return;
+  }
+
+  uint8_t const i = (dbl && dtog) ? 2 : 0;
+  uint16_t const len = btable(epnum, i+1) & 0x3FFU;
+  if ( len > xfer->mps )
+  {
+    fprintf(stderr, "fsdev model: %u byte packet on endpoint 0x%02X of %u max packet size\n", len, epnum | TUSB_DIR_IN_MASK, xfer->mps);
+    abort();
+  }
+  data_xact(len);
+
+  uint16_t r = (uint16_t) ((epr ^ USB_EP_DTOG_TX) | USB_EP_CTR_TX);
+  if ( !dbl ) r = (uint16_t) ((r & ~USB_EPTX_STAT) | USB_EP_TX_NAK);
+  epr_set(epnum, r);
+
+  // host ignores packet with wrong data toggle
+  if ( dtog != _model.host_toggle[epnum][TUSB_DIR_IN] )
+  {
+    _model.stat.toggle_errors++;
+    return;
+  }
+  _model.host_toggle[epnum][TUSB_DIR_IN] ^= 1;
+
+  uint8_t data[64];
+  pma_read(data, btable(epnum, i), len);
+  uint16_t const count = (uint16_t) tu_min32(len, xfer->len - xfer->xferred);
+  if ( count ) memcpy(xfer->buf + xfer->xferred, data, count);
+
+  xfer->xferred += count;
+  if ( len < xfer->mps || xfer->xferred >= xfer->len ) host_done(epnum | TUSB_DIR_IN_MASK, xfer);
+}
+
+// Next control/bulk/interrupt transaction in round robin: slot 0 is control, then OUT and IN of
+// endpoint 1 to 7. It is started if its token is sent by xact_limit. Return 1 if started, 0 if
+// there is none that fits before end of frame, -1 if one is waiting for xact_limit
+static int nonperiodic_xact(uint64_t xact_limit)
+{
+  enum { SLOT_COUNT = 1 + 2*7 };
+
+  for ( uint8_t i = 0; i < SLOT_COUNT; i++ )
+  {
+    uint8_t const slot = (uint8_t) ((_model.rr + 1 + i) % SLOT_COUNT);
+
+    uint16_t mps;
+    if ( slot == 0 )
+    {
+      if ( !_model.ctrl.active ) continue;
+      mps = EP0_SIZE;
+    }
+    else
+    {
+      host_xfer_t* xfer = &_model.host[(slot+1)/2][slot & 1 ? TUSB_DIR_OUT : TUSB_DIR_IN];
+      if ( !xfer->active ) continue;
+      mps = xfer->mps;
+    }
+
+    // must fit before end of frame
+    if ( _model.now + XACT_BITS + 8u*mps + EOF_BITS > _model.frame_end ) return 0;
+    if ( _model.now + TOKEN_BITS > xact_limit ) return -1;
+
+    _model.rr = slot;
+    if ( slot == 0 )
+    {
+      control_xact();
+    }
+    else if ( slot & 1 )
+    {
+      bulk_out_xact((uint8_t) ((slot+1)/2));
+    }
+    else
+    {
+      bulk_in_xact((uint8_t) (slot/2));
+    }
+    return 1;
+  }
+
+  return 0;
+}
+
+// Start of frame or next transaction, else idle up to idle_limit. Return false if bus is waiting
+static bool bus_event(uint64_t xact_limit, uint64_t idle_limit)
+{
+  if ( _model.now >= _model.frame_end )
+  {
+    _model.frame_end = _model.now + MODEL_FRAME_BITS;
+    _model.stat.frames++;
+    sof();
+    return true;
+  }
+
+  int const xact = nonperiodic_xact(xact_limit);
+  if ( xact ) return xact > 0;
+
+  uint64_t const next = min64(_model.frame_end, idle_limit);
+  if ( next <= _model.now ) return false;
+  _model.now = next;
+  return true;
+}
+
+// Bus runs while interrupt handler is at time t: transactions whose token is sent by then see
+// registers as handler has written them so far
+static void bus_sync(uint64_t t)
+{
+  while ( _model.now < t && bus_event(t, t) ) {}
+}
+
+// Interrupt handler, task when due, or bus event
+static void step(void)
+{
+  if ( _model.irq_enabled && irq_pending() )
+  {
+    run_isr();
+    return;
+  }
+
+  if ( _model.task_cb && !_model.in_task && _model.task_due <= _model.now )
+  {
+    run_task();
+    return;
+  }
+
+  uint64_t idle_limit = _model.frame_end;
+  if ( _model.task_cb && !_model.in_task ) idle_limit = min64(idle_limit, _model.task_due);
+  if ( !bus_event(TIME_NONE, idle_limit) ) _model.now++;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void fsdev_model_irq_enable(bool enable)
+{
+  _model.irq_enabled = enable;
+
+  // thread mode: pending handler preempts right away
+  if ( enable && !_model.in_isr )
+  {
+    apply();
+    if ( irq_pending() ) run_isr();
+  }
+}
+
+void fsdev_model_init(fsdev_model_task_t task_cb, uint32_t cpu_mhz, uint32_t task_bits)
+{
+  tu_memclr(&_model, sizeof(_model));
+  tu_memclr(&fsdev_model_regs, sizeof(fsdev_model_regs));
+  tu_memclr(fsdev_model_pma, sizeof(fsdev_model_pma));
+
+  _model.task_cb   = task_cb;
+  _model.cpu_mhz   = cpu_mhz;
+  _model.task_bits = task_bits;
+  _model.task_due  = task_bits;
+}
+
+void fsdev_model_host_callback(fsdev_model_host_cb_t cb)
+{
+  _model.host_cb = cb;
+}
+
+void fsdev_model_bus_reset(void)
+{
+  apply();
+
+  tu_memclr(_model.host, sizeof(_model.host));
+  tu_memclr(_model.host_toggle, sizeof(_model.host_toggle));
+  tu_memclr(_model.rx_recv, sizeof(_model.rx_recv));
+  tu_memclr(_model.rx_unread, sizeof(_model.rx_unread));
+  _model.ctrl.active = false;
+
+  // endpoints are disabled, address is 0
+  for ( uint8_t n = 0; n < 8; n++ ) epr_set(n, 0);
+  fsdev_model_regs.DADDR = 0;
+
+  // reset lasts long enough for its interrupt and event to be handled
+  raise(USB_ISTR_RESET);
+  while ( _model.irq_enabled && irq_pending() ) run_isr();
+
+  if ( _model.task_cb )
+  {
+    if ( _model.task_due > _model.now ) _model.now = _model.task_due;
+    run_task();
+  }
+}
+
+// Start of frame may be sent while interrupt handler runs: frame is run up to next one
+void fsdev_model_frame(void)
+{
+  uint32_t const frame = _model.stat.frames + 1;
+  while ( _model.stat.frames < frame ) step();
+}
+
+uint64_t fsdev_model_time(void)
+{
+  return _model.now;
+}
+
+fsdev_model_stat_t const* fsdev_model_stat(void)
+{
+  return &_model.stat;
+}
+
+void fsdev_model_host_xfer(uint8_t ep_addr, uint16_t mps, uint8_t* buf, uint32_t len)
+{
+  host_xfer_t* xfer = &_model.host[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+
+  xfer->buf     = buf;
+  xfer->len     = len;
+  xfer->xferred = 0;
+  xfer->mps     = mps;
+  xfer->stalled = false;
+  xfer->active  = true;
+}
+
+bool fsdev_model_host_busy(uint8_t ep_addr)
+{
+  if ( tu_edpt_number(ep_addr) == 0 ) return _model.ctrl.active;
+  return _model.host[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].active;
+}
+
+bool fsdev_model_host_stalled(uint8_t ep_addr)
+{
+  if ( tu_edpt_number(ep_addr) == 0 ) return _model.ctrl.stalled;
+  return _model.host[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].stalled;
+}
+
+void fsdev_model_toggle_reset(uint8_t ep_addr)
+{
+  _model.host_toggle[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = 0;
+}
+
+void fsdev_model_control(uint8_t const setup[8], uint8_t* buf)
+{
+  memcpy(_model.ctrl.setup, setup, 8);
+  _model.ctrl.buf     = buf;
+  _model.ctrl.len     = tu_u16(setup[7], setup[6]);
+  _model.ctrl.xferred = 0;
+  _model.ctrl.stalled = false;
+  _model.ctrl.stage   = CTRL_SETUP;
+  _model.ctrl.active  = true;
+}
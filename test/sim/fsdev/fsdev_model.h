@@ -0,0 +1,119 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _FSDEV_MODEL_H_
+#define _FSDEV_MODEL_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Register level model of the STM32F072 USB full speed device controller (1024 byte packet memory)
+// with the model as host of transfers queued by fsdev_model_host_xfer() and fsdev_model_control().
+// Time is counted in bit times (12 Mbps), a frame is 12000 bits:
+// - Control transfer then bulk/interrupt endpoints are run packet by packet in round robin. Endpoint
+//   state is sampled once the token is sent: OUT NAK costs the data packet, IN NAK does not.
+//   NAK is retried right away.
+// - Single buffered endpoint: STAT_RX/STAT_TX is set to NAK once a packet is ACKed. Double buffered
+//   (bulk type with EP_KIND): packet uses buffer selected by DTOG and is NAKed while DTOG equals
+//   SW_BUF. DTOG is the data PID, a packet with the wrong data toggle is ACKed and dropped.
+// - SETUP is accepted whatever endpoint 0 state is, and sets both data toggles to DATA1.
+//
+// Registers are memory: a register write is applied with its hardware semantics (CTR cleared by
+// writing 0, DTOG/STAT toggled by writing 1) when USB is evaluated for the next access, or after the
+// interrupt handler or task returns. A write of the value just read is not seen: it has no effect
+// unless it toggles bits that are set.
+//
+// The interrupt handler takes CPU time, counted in cycles at cpu_mhz: it starts ISR_CYCLES after the
+// interrupt is raised, each register access and each 16-bit word it writes to packet memory take
+// time. A received packet is read from packet memory once the handler has cleared its CTR_RX, before
+// it hands the buffer back to hardware (or before it returns). Bus runs meanwhile and sees register
+// writes as the handler makes them. The task callback (usbd task) is called every task_bits and
+// takes no time.
+//--------------------------------------------------------------------+
+
+enum
+{
+  MODEL_FRAME_BITS = 12000,
+};
+
+typedef void (* fsdev_model_task_t) (void);
+
+// Host transfer is complete, next one can be queued right away
+typedef void (* fsdev_model_host_cb_t) (uint8_t ep_addr, uint32_t xferred);
+
+typedef struct
+{
+  uint32_t frames;
+  uint32_t data_xact;           // data packets ACKed
+  uint32_t nak_xact;
+  uint32_t toggle_errors;       // packets dropped by device or host for wrong data toggle
+  uint32_t irq_count;
+  uint64_t isr_ns;              // time spent in dcd_int_handler() on the build machine
+  uint64_t isr_bits;            // modeled CPU time of the interrupt handler
+  uint32_t reg_access;          // by interrupt handler
+  uint32_t pma_words;           // copied by interrupt handler, both ways
+  uint64_t busy_bits;           // bus time used by transactions (SOF excluded)
+  uint64_t nak_bits;            // bus time used by NAKed transactions
+} fsdev_model_stat_t;
+
+void fsdev_model_init(fsdev_model_task_t task_cb, uint32_t cpu_mhz, uint32_t task_bits);
+void fsdev_model_host_callback(fsdev_model_host_cb_t cb);
+
+// USB reset signaled by host, its interrupt and task are run before returning
+void fsdev_model_bus_reset(void);
+
+// Run up to start of next frame
+void fsdev_model_frame(void);
+
+// Bit time since init
+uint64_t fsdev_model_time(void);
+
+fsdev_model_stat_t const* fsdev_model_stat(void);
+
+// OUT sends len bytes in packets of mps (zero length packet if len is 0), IN receives up to len
+// bytes until a short packet
+void fsdev_model_host_xfer(uint8_t ep_addr, uint16_t mps, uint8_t* buf, uint32_t len);
+
+// Transfer is in progress, or its last one ended with STALL. ep_addr 0 is the control transfer
+bool fsdev_model_host_busy(uint8_t ep_addr);
+bool fsdev_model_host_stalled(uint8_t ep_addr);
+
+// Host side data toggle back to DATA0 e.g with clear halt
+void fsdev_model_toggle_reset(uint8_t ep_addr);
+
+// Control read or no data request: setup, IN data stage of up to wLength bytes, then status.
+// Callback has ep_addr 0x80
+void fsdev_model_control(uint8_t const setup[8], uint8_t* buf);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _FSDEV_MODEL_H_ */
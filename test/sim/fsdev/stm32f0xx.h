@@ -0,0 +1,157 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _STM32F0XX_H_
+#define _STM32F0XX_H_
+
+//--------------------------------------------------------------------+
+// Stand-in of ST CMSIS headers needed by the stm32_fsdev port (STM32F072). USB registers and
+// packet memory are those of the controller model (fsdev_model.c): USB is evaluated by the driver
+// before each register access, which lets the model apply the write of the previous access with
+// its hardware semantics (toggle and clear on write 0 bits).
+//--------------------------------------------------------------------+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define __I   volatile const
+#define __O   volatile
+#define __IO  volatile
+
+typedef enum
+{
+  USB_IRQn = 31
+} IRQn_Type;
+
+typedef struct
+{
+  __IO uint16_t EP0R;   uint16_t RESERVED0;
+  __IO uint16_t EP1R;   uint16_t RESERVED1;
+  __IO uint16_t EP2R;   uint16_t RESERVED2;
+  __IO uint16_t EP3R;   uint16_t RESERVED3;
+  __IO uint16_t EP4R;   uint16_t RESERVED4;
+  __IO uint16_t EP5R;   uint16_t RESERVED5;
+  __IO uint16_t EP6R;   uint16_t RESERVED6;
+  __IO uint16_t EP7R;   uint16_t RESERVED7[17];
+  __IO uint16_t CNTR;   uint16_t RESERVED8;
+  __IO uint16_t ISTR;   uint16_t RESERVED9;
+  __IO uint16_t FNR;    uint16_t RESERVEDA;
+  __IO uint16_t DADDR;  uint16_t RESERVEDB;
+  __IO uint16_t BTABLE; uint16_t RESERVEDC;
+  __IO uint16_t LPMCSR; uint16_t RESERVEDD;
+  __IO uint16_t BCDR;   uint16_t RESERVEDE;
+} USB_TypeDef;
+
+USB_TypeDef* fsdev_model_usb(void);
+extern uint16_t fsdev_model_pma[512];
+
+#define USB          (fsdev_model_usb())
+#define USB_PMAADDR  (fsdev_model_pma)
+
+// Endpoint register
+#define USB_EP_CTR_RX         0x8000U
+#define USB_EP_DTOG_RX        0x4000U
+#define USB_EPRX_STAT         0x3000U
+#define USB_EP_SETUP          0x0800U
+#define USB_EP_T_FIELD        0x0600U
+#define USB_EP_KIND           0x0100U
+#define USB_EP_CTR_TX         0x0080U
+#define USB_EP_DTOG_TX        0x0040U
+#define USB_EPTX_STAT         0x0030U
+#define USB_EPADDR_FIELD      0x000FU
+
+#define USB_EPREG_MASK        (USB_EP_CTR_RX | USB_EP_SETUP | USB_EP_T_FIELD | USB_EP_KIND | USB_EP_CTR_TX | USB_EPADDR_FIELD)
+#define USB_EP_T_MASK         ((~USB_EP_T_FIELD) & USB_EPREG_MASK)
+#define USB_EPKIND_MASK       ((~USB_EP_KIND) & USB_EPREG_MASK)
+
+#define USB_EP_BULK           0x0000U
+#define USB_EP_CONTROL        0x0200U
+#define USB_EP_ISOCHRONOUS    0x0400U
+#define USB_EP_INTERRUPT      0x0600U
+
+#define USB_EP_TX_DIS         0x0000U
+#define USB_EP_TX_STALL       0x0010U
+#define USB_EP_TX_NAK         0x0020U
+#define USB_EP_TX_VALID       0x0030U
+#define USB_EPTX_DTOG1        0x0010U
+#define USB_EPTX_DTOG2        0x0020U
+#define USB_EPTX_DTOGMASK     (USB_EPTX_STAT | USB_EPREG_MASK)
+
+#define USB_EP_RX_DIS         0x0000U
+#define USB_EP_RX_STALL       0x1000U
+#define USB_EP_RX_NAK         0x2000U
+#define USB_EP_RX_VALID       0x3000U
+#define USB_EPRX_DTOG1        0x1000U
+#define USB_EPRX_DTOG2        0x2000U
+#define USB_EPRX_DTOGMASK     (USB_EPRX_STAT | USB_EPREG_MASK)
+
+// Control register
+#define USB_CNTR_CTRM         0x8000U
+#define USB_CNTR_PMAOVRM      0x4000U
+#define USB_CNTR_ERRM         0x2000U
+#define USB_CNTR_WKUPM        0x1000U
+#define USB_CNTR_SUSPM        0x0800U
+#define USB_CNTR_RESETM       0x0400U
+#define USB_CNTR_SOFM         0x0200U
+#define USB_CNTR_ESOFM        0x0100U
+#define USB_CNTR_RESUME       0x0010U
+#define USB_CNTR_FSUSP        0x0008U
+#define USB_CNTR_LPMODE       0x0004U
+#define USB_CNTR_PDWN         0x0002U
+#define USB_CNTR_FRES         0x0001U
+
+// Interrupt status register
+#define USB_ISTR_CTR          0x8000U
+#define USB_ISTR_PMAOVR       0x4000U
+#define USB_ISTR_ERR          0x2000U
+#define USB_ISTR_WKUP         0x1000U
+#define USB_ISTR_SUSP         0x0800U
+#define USB_ISTR_RESET        0x0400U
+#define USB_ISTR_SOF          0x0200U
+#define USB_ISTR_ESOF         0x0100U
+#define USB_ISTR_DIR          0x0010U
+#define USB_ISTR_EP_ID        0x000FU
+
+#define USB_FNR_FN            0x07FFU
+#define USB_DADDR_EF          0x0080U
+#define USB_DADDR_ADD         0x007FU
+#define USB_BCDR_DPPU         0x8000U
+
+//--------------------------------------------------------------------+
+// CMSIS: NVIC is the model's
+//--------------------------------------------------------------------+
+
+// Enabling the interrupt lets the model run a pending handler, as the core takes it right away
+void fsdev_model_irq_enable(bool enable);
+
+static inline void __ISB(void) { __asm__ volatile ("" ::: "memory"); }
+static inline void __DSB(void) { __asm__ volatile ("" ::: "memory"); }
+
+static inline void NVIC_EnableIRQ(IRQn_Type IRQn)  { (void) IRQn; fsdev_model_irq_enable(true); }
+static inline void NVIC_DisableIRQ(IRQn_Type IRQn) { (void) IRQn; fsdev_model_irq_enable(false); }
+
+#endif /* _STM32F0XX_H_ */
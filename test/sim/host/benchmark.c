@@ -0,0 +1,1133 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tusb.h"
+#include "class/hid/hid_device.h"
+#include "hcd_sim.h"
+#include "ff.h"
+#include "diskio.h"
+
+//--------------------------------------------------------------------+
+// Host stack benchmark with simulated controller
+// Hub with MSC, CDC, HID and MIDI devices is attached to the roothub, then
+// - enumeration time of all devices
+// - control transfer latency
+// - bulk throughput of MSC read/write and CDC loopback
+// - file throughput of FatFs on the MSC disk (formatted by the benchmark)
+// - FTDI, CP210x and CH34x serial adapters are plugged into the hub: configuration and loopback throughput
+// - HID reports lost at 1 kHz polling by an application processing them every few ms
+// - HID report descriptor compile time and report decode time (CPU only)
+// - MIDI serial adapters are replaced by synths: note latency and skew across synths with and without bulk load
+// Virtual time is bus time, CPU time is the host stack + simulator running on this machine.
+//
+// Usage: benchmark [disk image], a patterned 8 MB disk is used if no image is specified
+//--------------------------------------------------------------------+
+
+enum
+{
+  PID_HUB  = 0x4100,
+  PID_MSC  = 0x4001,
+  PID_CDC  = 0x4002,
+  PID_HID  = 0x4004,
+  PID_MIDI = 0x4008,
+
+  PID_FTDI   = 0x6001,
+  PID_CP210X = 0xEA60,
+  PID_CH34X  = 0x7523,
+};
+
+#define TIMEOUT_US          (60*1000*1000ull)
+
+#define CONTROL_COUNT       1000
+#define MSC_XFER_BLOCKS     2048          // 1 MB per SCSI command, a single transfer on bulk endpoint
+#define MSC_TOTAL_BYTES     (2*1024*1024)
+#define MSC_SMALL_BYTES     (256*1024)    // single block accesses e.g FAT & directory of file system
+#define FATFS_FILE_BYTES    (1024*1024)
+#define FATFS_CHUNK         (16*1024)
+#define FATFS_RANDOM_COUNT  1000
+#define FATFS_RANDOM_BYTES  512
+#define CDC_CHUNK           1024
+#define CDC_TOTAL_BYTES     (256*1024)
+#define CDC_BAUDRATE        921600
+#define HID_POLL_MS         1000          // duration of each HID polling run
+#define HID_BATCH           CFG_TUH_HID_REPORT_QUEUE_SZ
+#define MIDI_SYNTH_COUNT    4
+#define MIDI_SEQ_MS         1000          // duration of each sequencer run
+#define MIDI_LOAD_BLOCKS    64
+
+static sim_hub_t  _hub;
+static sim_msc_t  _msc;
+static sim_cdc_t  _cdc;
+static sim_cdc_t  _serial[3];   // FTDI, CP210x, CH34x
+static sim_hid_t  _hid;
+static sim_midi_t _midi;
+static sim_midi_t _synth[MIDI_SYNTH_COUNT-1];
+
+static struct
+{
+  uint8_t mount_count;
+  uint8_t msc_addr;
+  uint8_t cdc_addr;
+  uint8_t hid_addr;
+  uint8_t midi_addr;
+  uint8_t serial_addr[3];
+
+  uint32_t hid_reports;
+  bool     hid_manual;    // report is requested by application task instead of received callback
+
+  uint32_t control_done;
+  uint32_t msc_done;
+  bool     msc_failed;
+
+  uint32_t cdc_control_done;
+
+  uint8_t  midi_count;
+  uint8_t  midi_addrs[MIDI_SYNTH_COUNT];
+  bool     midi_load;
+  uint32_t midi_seq_count;
+  uint32_t midi_sent;
+  uint32_t midi_received;
+} _app;
+
+static uint8_t _buffer[MSC_XFER_BLOCKS*512] TU_ATTR_ALIGNED(4);
+static FATFS   _fatfs;
+static FIL     _file;
+static uint8_t _cdc_tx[CDC_CHUNK];
+static uint8_t _cdc_rx[CDC_CHUNK];
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static uint64_t cpu_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec*1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+typedef struct
+{
+  uint64_t bus_us;
+  uint64_t cpu_ns;
+} measure_t;
+
+static measure_t measure_start(void)
+{
+  return (measure_t) { hcd_sim_time_us(), cpu_ns() };
+}
+
+static measure_t measure_stop(measure_t start)
+{
+  return (measure_t) { hcd_sim_time_us() - start.bus_us, cpu_ns() - start.cpu_ns };
+}
+
+// Run host stack and bus until condition is met, false if timed out
+static bool run_until(bool (*cond)(void))
+{
+  uint64_t const timeout = hcd_sim_time_us() + TIMEOUT_US;
+
+  while ( !cond() )
+  {
+    if ( hcd_sim_time_us() > timeout ) return false;
+
+    tuh_task();
+    hcd_sim_step();
+  }
+
+  // process events posted by the last frame
+  tuh_task();
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Callbacks
+//--------------------------------------------------------------------+
+
+void tuh_mount_cb(uint8_t dev_addr)
+{
+  uint16_t vid, pid;
+  tuh_vid_pid_get(dev_addr, &vid, &pid);
+
+  switch ( pid )
+  {
+    case PID_MSC : _app.msc_addr  = dev_addr; break;
+    case PID_CDC : _app.cdc_addr  = dev_addr; break;
+    case PID_HID : _app.hid_addr  = dev_addr; break;
+    case PID_MIDI: _app.midi_addr = dev_addr; break;
+
+    case PID_FTDI  : _app.serial_addr[0] = dev_addr; break;
+    case PID_CP210X: _app.serial_addr[1] = dev_addr; break;
+    case PID_CH34X : _app.serial_addr[2] = dev_addr; break;
+    default: break;
+  }
+
+  _app.mount_count++;
+}
+
+void tuh_umount_cb(uint8_t dev_addr)
+{
+  (void) dev_addr;
+  _app.mount_count--;
+}
+
+void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* desc_report, uint16_t desc_len)
+{
+  (void) desc_report;
+  (void) desc_len;
+  tuh_hid_receive_report(dev_addr, instance);
+}
+
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len)
+{
+  (void) report;
+  (void) len;
+
+  _app.hid_reports++;
+  if ( !_app.hid_manual ) tuh_hid_receive_report(dev_addr, instance);
+}
+
+void tuh_midi_mount_cb(uint8_t dev_addr, uint8_t in_ep, uint8_t out_ep, uint8_t num_cables_rx, uint16_t num_cables_tx)
+{
+  (void) in_ep;
+  (void) out_ep;
+  (void) num_cables_rx;
+  (void) num_cables_tx;
+
+  if ( _app.midi_count < MIDI_SYNTH_COUNT ) _app.midi_addrs[_app.midi_count++] = dev_addr;
+}
+
+void tuh_midi_umount_cb(uint8_t dev_addr, uint8_t instance)
+{
+  (void) instance;
+
+  for(uint8_t i=0; i<_app.midi_count; i++)
+  {
+    if ( _app.midi_addrs[i] == dev_addr )
+    {
+      _app.midi_addrs[i] = _app.midi_addrs[--_app.midi_count];
+      break;
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// Enumeration
+//--------------------------------------------------------------------+
+
+static bool all_mounted(void)
+{
+  // hub + 4 devices
+  return _app.mount_count == 5;
+}
+
+static bool bench_enumeration(void)
+{
+  sim_hub_plug(&_hub, 1, &_msc.dev);
+  sim_hub_plug(&_hub, 2, &_cdc.dev);
+  sim_hub_plug(&_hub, 3, &_hid.dev);
+  sim_hub_plug(&_hub, 4, &_midi.dev);
+
+  measure_t m = measure_start();
+  hcd_sim_attach(&_hub.dev);
+
+  bool const ok = run_until(all_mounted);
+  m = measure_stop(m);
+
+  printf("Enumeration: hub + 4 devices %s in %.1f ms bus time, %.1f us CPU\n",
+         ok ? "mounted" : "FAILED", m.bus_us/1000.0, m.cpu_ns/1000.0);
+
+  return ok && _app.msc_addr && _app.cdc_addr && _app.hid_addr && _app.midi_addr;
+}
+
+//--------------------------------------------------------------------+
+// Control Transfer
+//--------------------------------------------------------------------+
+
+static tusb_desc_device_t _desc_device;
+
+static bool control_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
+{
+  (void) dev_addr;
+  (void) request;
+
+  if ( result == XFER_RESULT_SUCCESS ) _app.control_done++;
+  return true;
+}
+
+static uint32_t _control_target;
+
+static bool control_reached(void)
+{
+  return _app.control_done == _control_target;
+}
+
+static bool bench_control(void)
+{
+  tusb_control_request_t const request =
+  {
+    .bmRequestType_bit =
+    {
+      .recipient = TUSB_REQ_RCPT_DEVICE,
+      .type      = TUSB_REQ_TYPE_STANDARD,
+      .direction = TUSB_DIR_IN
+    },
+    .bRequest = TUSB_REQ_GET_DESCRIPTOR,
+    .wValue   = TUSB_DESC_DEVICE << 8,
+    .wIndex   = 0,
+    .wLength  = sizeof(tusb_desc_device_t)
+  };
+
+  measure_t m = measure_start();
+
+  for(uint32_t i=0; i<CONTROL_COUNT; i++)
+  {
+    _control_target = i+1;
+    TU_ASSERT(tuh_control_xfer(_app.cdc_addr, &request, &_desc_device, control_complete));
+    TU_ASSERT(run_until(control_reached));
+  }
+
+  m = measure_stop(m);
+
+  printf("Control: %u x GET_DESCRIPTOR(Device) %.1f us bus time, %.0f ns CPU per transfer\n",
+         CONTROL_COUNT, (double) m.bus_us/CONTROL_COUNT, (double) m.cpu_ns/CONTROL_COUNT);
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Bulk Throughput
+//--------------------------------------------------------------------+
+
+static bool msc_complete(uint8_t dev_addr, msc_cbw_t const* cbw, msc_csw_t const* csw)
+{
+  (void) dev_addr;
+  (void) cbw;
+
+  if ( csw->status != MSC_CSW_STATUS_PASSED ) _app.msc_failed = true;
+  _app.msc_done++;
+
+  return true;
+}
+
+static bool msc_idle(void)
+{
+  return _app.msc_done == 1;
+}
+
+static void print_throughput(char const* name, uint32_t bytes, measure_t m)
+{
+  double const mb = bytes / (1024.0*1024.0);
+  printf("%s: %u KB at %.0f KB/s bus time, %.1f ms CPU per MB\n",
+         name, (unsigned) (bytes/1024), (bytes/1024.0) / (m.bus_us/1000000.0), (m.cpu_ns/1000000.0)/mb);
+}
+
+static bool bench_msc(bool is_write)
+{
+  uint8_t const  daddr       = _app.msc_addr;
+  uint16_t const block_size  = (uint16_t) tuh_msc_get_block_size(daddr, 0);
+  uint32_t const xfer_bytes  = MSC_XFER_BLOCKS*block_size;
+  uint32_t const total_bytes = tu_min32(MSC_TOTAL_BYTES, tuh_msc_get_block_count(daddr, 0)*block_size);
+
+  TU_ASSERT(block_size == 512);
+
+  measure_t m = measure_start();
+
+  for(uint32_t offset = 0; offset + xfer_bytes <= total_bytes; offset += xfer_bytes)
+  {
+    uint32_t const lba = offset / block_size;
+    _app.msc_done = 0;
+
+    if ( is_write )
+    {
+      // write back image content with inverted bits, then verify the disk
+      for(uint32_t i=0; i<xfer_bytes; i++) _buffer[i] = (uint8_t) ~_msc.image[offset+i];
+      TU_ASSERT(tuh_msc_write10(daddr, 0, _buffer, lba, MSC_XFER_BLOCKS, msc_complete));
+      TU_ASSERT(run_until(msc_idle));
+      TU_ASSERT(!_app.msc_failed && _msc.image[offset] == _buffer[0] && _msc.image[offset+xfer_bytes-1] == _buffer[xfer_bytes-1]);
+    }else
+    {
+      TU_ASSERT(tuh_msc_read10(daddr, 0, _buffer, lba, MSC_XFER_BLOCKS, msc_complete));
+      TU_ASSERT(run_until(msc_idle));
+      TU_ASSERT(!_app.msc_failed && 0 == memcmp(_buffer, _msc.image + offset, xfer_bytes));
+    }
+  }
+
+  m = measure_stop(m);
+  print_throughput(is_write ? "MSC WRITE10" : "MSC READ10 ", total_bytes, m);
+
+  return true;
+}
+
+static bool msc_cache_complete(uint8_t dev_addr, uint8_t lun, bool success)
+{
+  (void) dev_addr;
+  (void) lun;
+
+  if ( !success ) _app.msc_failed = true;
+  _app.msc_done++;
+
+  return true;
+}
+
+// Sequential single block read/write, directly or through block cache
+static bool bench_msc_small(bool is_write, bool use_cache)
+{
+  uint8_t const daddr = _app.msc_addr;
+  uint8_t const first = (uint8_t) ~_msc.image[0];
+  uint8_t block[512];
+
+  measure_t m = measure_start();
+
+  for(uint32_t lba = 0; lba < MSC_SMALL_BYTES/512; lba++)
+  {
+    uint8_t const* disk = _msc.image + lba*512;
+    _app.msc_done = 0;
+
+    if ( is_write )
+    {
+      for(uint32_t i=0; i<512; i++) block[i] = (uint8_t) ~disk[i];
+
+      TU_ASSERT(use_cache ? tuh_msc_cache_write(daddr, 0, block, lba, 1, msc_cache_complete) :
+                            tuh_msc_write10(daddr, 0, block, lba, 1, msc_complete));
+      TU_ASSERT(run_until(msc_idle) && !_app.msc_failed);
+    }else
+    {
+      TU_ASSERT(use_cache ? tuh_msc_cache_read(daddr, 0, block, lba, 1, msc_cache_complete) :
+                            tuh_msc_read10(daddr, 0, block, lba, 1, msc_complete));
+      TU_ASSERT(run_until(msc_idle) && !_app.msc_failed && 0 == memcmp(block, disk, 512));
+    }
+  }
+
+  if ( is_write && use_cache )
+  {
+    _app.msc_done = 0;
+    TU_ASSERT(tuh_msc_cache_flush(daddr, msc_cache_complete));
+    TU_ASSERT(run_until(msc_idle) && !_app.msc_failed);
+  }
+
+  m = measure_stop(m);
+
+  // written data is on disk
+  if ( is_write ) TU_ASSERT(_msc.image[0] == first && 0 == memcmp(_msc.image + MSC_SMALL_BYTES - 512, block, 512));
+
+  char name[40];
+  snprintf(name, sizeof(name), "MSC %s x 1 block%s", is_write ? "WRITE10" : "READ10 ", use_cache ? " (cache)" : "");
+  print_throughput(name, MSC_SMALL_BYTES, m);
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// FatFs
+//--------------------------------------------------------------------+
+
+// Bus is only running in run_until(), also step it when diskio is waiting for command completion
+void diskio_wait_cb(BYTE pdrv)
+{
+  (void) pdrv;
+  hcd_sim_step();
+}
+
+static uint8_t file_pattern(uint32_t offset)
+{
+  return (uint8_t) (offset ^ (offset >> 8) ^ 0x5a);
+}
+
+static bool bench_fatfs_rw(char const* path, bool is_write, uint8_t* buf)
+{
+  UINT count;
+
+  measure_t m = measure_start();
+
+  TU_ASSERT(FR_OK == f_open(&_file, path, is_write ? (FA_CREATE_ALWAYS | FA_WRITE) : FA_READ));
+
+  for(uint32_t offset = 0; offset < FATFS_FILE_BYTES; offset += FATFS_CHUNK)
+  {
+    if ( is_write )
+    {
+      for(uint32_t i=0; i<FATFS_CHUNK; i++) buf[i] = file_pattern(offset + i);
+      TU_ASSERT(FR_OK == f_write(&_file, buf, FATFS_CHUNK, &count) && count == FATFS_CHUNK);
+    }else
+    {
+      TU_ASSERT(FR_OK == f_read(&_file, buf, FATFS_CHUNK, &count) && count == FATFS_CHUNK);
+      for(uint32_t i=0; i<FATFS_CHUNK; i++) TU_ASSERT(buf[i] == file_pattern(offset + i));
+    }
+  }
+
+  TU_ASSERT(FR_OK == f_close(&_file));
+
+  m = measure_stop(m);
+
+  char name[40];
+  snprintf(name, sizeof(name), "FatFs %s%s", is_write ? "write" : "read ", ((uintptr_t) buf) & 3 ? " (unaligned)" : "");
+  print_throughput(name, FATFS_FILE_BYTES, m);
+
+  return true;
+}
+
+static bool bench_fatfs_random(char const* path)
+{
+  uint8_t buf[FATFS_RANDOM_BYTES];
+  uint32_t seed = 1;
+  UINT count;
+
+  measure_t m = measure_start();
+
+  TU_ASSERT(FR_OK == f_open(&_file, path, FA_READ));
+
+  for(uint32_t n = 0; n < FATFS_RANDOM_COUNT; n++)
+  {
+    seed = seed*1103515245u + 12345u;
+    uint32_t const offset = (seed >> 8) % (FATFS_FILE_BYTES - FATFS_RANDOM_BYTES);
+
+    TU_ASSERT(FR_OK == f_lseek(&_file, offset));
+    TU_ASSERT(FR_OK == f_read(&_file, buf, FATFS_RANDOM_BYTES, &count) && count == FATFS_RANDOM_BYTES);
+    for(uint32_t i=0; i<FATFS_RANDOM_BYTES; i++) TU_ASSERT(buf[i] == file_pattern(offset + i));
+  }
+
+  TU_ASSERT(FR_OK == f_close(&_file));
+
+  m = measure_stop(m);
+  print_throughput("FatFs random read x 512", FATFS_RANDOM_COUNT*FATFS_RANDOM_BYTES, m);
+
+  return true;
+}
+
+static bool bench_fatfs(void)
+{
+  BYTE const vol = (BYTE) (_app.msc_addr - 1);
+  char path[16];
+  snprintf(path, sizeof(path), "%u:/bench.bin", vol);
+
+  // format whole disk without partition table, 32 KB cluster as common for flash drives
+  TU_ASSERT(FR_OK == f_mount(vol, &_fatfs));
+  TU_ASSERT(FR_OK == f_mkfs(vol, 1, 32*1024));
+
+  TU_ASSERT(bench_fatfs_rw(path, true, _buffer));
+  TU_ASSERT(bench_fatfs_rw(path, false, _buffer));
+  TU_ASSERT(bench_fatfs_rw(path, false, _buffer + 1)); // through bounce buffer
+  TU_ASSERT(bench_fatfs_random(path));
+
+  f_mount(vol, NULL);
+
+  return true;
+}
+
+static inline uint8_t cdc_pattern(uint32_t i)
+{
+  // not repeated every 256 bytes to catch data shifted by a whole block
+  return (uint8_t) (i + (i >> 8));
+}
+
+// Loopback through tx & rx FIFO, both are kept busy at the same time
+static bool bench_cdc(char const* name, uint8_t idx)
+{
+  uint64_t const timeout = hcd_sim_time_us() + TIMEOUT_US;
+  uint32_t sent = 0;
+  uint32_t received = 0;
+
+  measure_t m = measure_start();
+
+  while ( received < CDC_TOTAL_BYTES )
+  {
+    TU_ASSERT(hcd_sim_time_us() < timeout);
+
+    uint32_t const count = tu_min32(tuh_cdc_write_available(idx), tu_min32(CDC_TOTAL_BYTES - sent, CDC_CHUNK));
+    if ( count )
+    {
+      for(uint32_t i=0; i<count; i++) _cdc_tx[i] = cdc_pattern(sent + i);
+      TU_ASSERT(count == tuh_cdc_write(idx, _cdc_tx, count));
+      sent += count;
+    }
+    tuh_cdc_write_flush(idx);
+
+    uint32_t const len = tuh_cdc_read(idx, _cdc_rx, CDC_CHUNK);
+    for(uint32_t i=0; i<len; i++) TU_ASSERT(_cdc_rx[i] == cdc_pattern(received + i));
+    received += len;
+
+    tuh_task();
+    hcd_sim_step();
+  }
+
+  m = measure_stop(m);
+
+  char title[32];
+  snprintf(title, sizeof(title), "CDC %s loopback", name);
+  print_throughput(title, CDC_TOTAL_BYTES, m);
+
+  return true;
+}
+
+static bool serial_mounted(void)
+{
+  // hub + 7 devices
+  return _app.mount_count == 8;
+}
+
+static bool cdc_control_complete(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
+{
+  (void) dev_addr;
+  (void) request;
+  TU_ASSERT(result == XFER_RESULT_SUCCESS);
+
+  _app.cdc_control_done++;
+  return true;
+}
+
+static bool cdc_control_all_done(void)
+{
+  return _app.cdc_control_done == 1;
+}
+
+// Change baudrate & line state with vendor requests, then loopback
+static bool bench_serial(void)
+{
+  static char const* const name[3] = { "FTDI", "CP210x", "CH34x" };
+
+  sim_hub_plug(&_hub, 5, &_serial[0].dev);
+  sim_hub_plug(&_hub, 6, &_serial[1].dev);
+  sim_hub_plug(&_hub, 7, &_serial[2].dev);
+
+  measure_t m = measure_start();
+  bool const ok = run_until(serial_mounted);
+  m = measure_stop(m);
+
+  printf("Enumeration: FTDI + CP210x + CH34x %s in %.1f ms bus time, %.1f us CPU\n",
+         ok ? "mounted" : "FAILED", m.bus_us/1000.0, m.cpu_ns/1000.0);
+  TU_ASSERT(ok);
+
+  for(uint8_t i=0; i<3; i++)
+  {
+    sim_cdc_t const* serial = &_serial[i];
+    uint8_t const idx = tuh_cdc_itf_get_index(_app.serial_addr[i], 0);
+
+    TU_ASSERT(tuh_cdc_mounted(idx));
+
+    // configured on enumeration: 115200 8N1, DTR & RTS
+    uint32_t const baud_enum = serial->baudrate;
+    TU_ASSERT(serial->uart_enabled && baud_enum);
+    TU_ASSERT(serial->line_state == (CDC_CONTROL_LINE_STATE_DTR | CDC_CONTROL_LINE_STATE_RTS));
+
+    _app.cdc_control_done = 0;
+    TU_ASSERT(tuh_cdc_set_baudrate(idx, CDC_BAUDRATE, cdc_control_complete));
+    TU_ASSERT(run_until(cdc_control_all_done));
+    TU_ASSERT(serial->baudrate != baud_enum);
+
+    cdc_line_coding_t line_coding;
+    TU_ASSERT(tuh_cdc_get_line_coding(idx, &line_coding) && line_coding.bit_rate == CDC_BAUDRATE && line_coding.data_bits == 8);
+
+    _app.cdc_control_done = 0;
+    TU_ASSERT(tuh_cdc_disconnect(idx, cdc_control_complete));
+    TU_ASSERT(run_until(cdc_control_all_done));
+    TU_ASSERT(serial->line_state == 0 && !tuh_cdc_connected(idx));
+
+    TU_ASSERT(bench_cdc(name[i], idx));
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// HID polling
+//--------------------------------------------------------------------+
+
+// Run bus for duration, application task is called every period
+static void run_app(uint32_t duration_ms, uint32_t period_ms, void (*task)(void))
+{
+  uint64_t const end = hcd_sim_time_us() + duration_ms*1000ull;
+  uint64_t next = hcd_sim_time_us();
+
+  while ( hcd_sim_time_us() < end )
+  {
+    tuh_task();
+
+    if ( hcd_sim_time_us() >= next )
+    {
+      task();
+      next += period_ms*1000ull;
+    }
+
+    hcd_sim_step();
+  }
+
+  tuh_task();
+}
+
+// report is requested again only when application gets to it
+static void hid_manual_task(void)
+{
+  tuh_hid_receive_report(_app.hid_addr, 0);
+}
+
+static tuh_hid_report_t _hid_reports[HID_BATCH];
+static uint8_t  _hid_seq_next;
+static uint32_t _hid_seq_error;
+
+static void hid_auto_task(void)
+{
+  uint16_t count;
+
+  while ( (count = tuh_hid_report_read(_app.hid_addr, 0, _hid_reports, HID_BATCH)) > 0 )
+  {
+    for(uint16_t i=0; i<count; i++)
+    {
+      // byte 1 is sequence number, reports must be in order though some can be lost
+      uint8_t const seq = _hid_reports[i].data[1];
+      if ( (uint8_t) (seq - _hid_seq_next) >= 128 ) _hid_seq_error++;
+      _hid_seq_next = (uint8_t) (seq + 1);
+    }
+
+    _app.hid_reports += count;
+  }
+}
+
+static bool hid_unmounted(void)
+{
+  return _app.mount_count == 7;
+}
+
+static bool hid_mounted(void)
+{
+  return _app.mount_count == 8 && _app.hid_addr && tuh_hid_mounted(_app.hid_addr, 0);
+}
+
+static void print_hid_poll(char const* name, uint32_t period_ms, uint32_t reports, uint32_t generated, uint32_t dropped, uint32_t overrun)
+{
+  printf("HID 1 kHz %s, app every %2lu ms: %lu/%lu reports received, %lu dropped by device, %lu queue overrun\n",
+         name, (unsigned long) period_ms, (unsigned long) reports, (unsigned long) generated,
+         (unsigned long) dropped, (unsigned long) overrun);
+}
+
+// Keyboard is replugged with bInterval = 1 ms and a report every 1 ms
+static bool bench_hid_poll(void)
+{
+  static uint32_t const period_ms[] = { 1, 4, 16, 32 };
+
+  sim_hub_unplug(&_hub, 3);
+  TU_ASSERT(run_until(hid_unmounted));
+
+  sim_hid_init(&_hid, TUSB_SPEED_FULL, 1);
+  _hid.auto_interval_us = 1000;
+  _app.hid_addr = 0;
+  sim_hub_plug(&_hub, 3, &_hid.dev);
+  TU_ASSERT(run_until(hid_mounted));
+
+  uint8_t const daddr = _app.hid_addr;
+
+  //------------- report is requested by application task -------------//
+  _app.hid_manual = true;
+
+  for(uint8_t i=0; i<TU_ARRAY_SIZE(period_ms); i++)
+  {
+    uint32_t const seq     = _hid.auto_seq;
+    uint32_t const dropped = _hid.auto_dropped;
+    _app.hid_reports = 0;
+
+    run_app(HID_POLL_MS, period_ms[i], hid_manual_task);
+    print_hid_poll("manual", period_ms[i], _app.hid_reports, _hid.auto_seq - seq, _hid.auto_dropped - dropped, 0);
+  }
+
+  // last request is complete within next interval
+  run_app(10, 10, hid_auto_task);
+
+  //------------- automatic polling with report queue -------------//
+  _hid_seq_next = (uint8_t) _hid.auto_seq;
+  TU_ASSERT(tuh_hid_receive_auto(daddr, 0, true));
+  run_app(10, 1, hid_auto_task); // report held by device while endpoint was not polled
+
+  for(uint8_t i=0; i<TU_ARRAY_SIZE(period_ms); i++)
+  {
+    hid_auto_task();
+
+    uint32_t const seq     = _hid.auto_seq;
+    uint32_t const dropped = _hid.auto_dropped;
+    uint32_t const overrun = tuh_hid_report_overrun(daddr, 0);
+    _app.hid_reports = 0;
+
+    run_app(HID_POLL_MS, period_ms[i], hid_auto_task);
+    hid_auto_task();
+
+    uint32_t const generated = _hid.auto_seq - seq;
+    print_hid_poll("auto  ", period_ms[i], _app.hid_reports, generated, _hid.auto_dropped - dropped,
+                   tuh_hid_report_overrun(daddr, 0) - overrun);
+
+    // endpoint is polled every frame, device never drops a report
+    TU_ASSERT(_hid.auto_dropped == dropped);
+
+    // queue holds all reports generated between 2 application runs
+    if ( period_ms[i] < HID_BATCH ) TU_ASSERT(tuh_hid_report_overrun(daddr, 0) == overrun);
+  }
+
+  TU_ASSERT(_hid_seq_error == 0);
+  TU_ASSERT(tuh_hid_receive_auto(daddr, 0, false));
+  _app.hid_manual = false;
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// HID Report Descriptor
+//--------------------------------------------------------------------+
+
+enum
+{
+  RC_COMPILE_LOOP = 100000,
+  RC_DECODE_LOOP  = 1000000,
+  RC_FIELD_MAX    = 32,
+  RC_VALUE_MAX    = 64
+};
+
+static uint8_t const _desc_keyboard [] = { TUD_HID_REPORT_DESC_KEYBOARD() };
+static uint8_t const _desc_mouse    [] = { TUD_HID_REPORT_DESC_MOUSE()    };
+static uint8_t const _desc_gamepad  [] = { TUD_HID_REPORT_DESC_GAMEPAD()  };
+static uint8_t const _desc_composite[] =
+{
+  TUD_HID_REPORT_DESC_KEYBOARD( HID_REPORT_ID(1) ),
+  TUD_HID_REPORT_DESC_MOUSE   ( HID_REPORT_ID(2) )
+};
+
+// Left Shift + Right Ctrl, keys A B
+static uint8_t const _report_keyboard[] = { 0x12, 0, HID_KEY_A, HID_KEY_B, 0, 0, 0, 0 };
+static int32_t const _values_keyboard[] = { 0, 1, 0, 0, 1, 0, 0, 0, HID_KEY_A, HID_KEY_B, 0, 0, 0, 0 };
+
+// buttons 1 & 3, x = -2, y = 16, wheel = -127, pan = 1
+static uint8_t const _report_mouse[] = { 0x05, 0xFE, 0x10, 0x81, 0x01 };
+static int32_t const _values_mouse[] = { 1, 0, 1, 0, 0, -2, 16, -127, 1 };
+
+// axes, hat = 3, buttons 1 & 32
+static uint8_t const _report_gamepad[] = { 0xFF, 2, 0xFD, 4, 0xFB, 6, 3, 0x01, 0x00, 0x00, 0x80 };
+static int32_t const _values_gamepad[] =
+{
+  -1, 2, -3, 4, -5, 6, 3,
+  1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+};
+
+// mouse report of composite device
+static uint8_t const _report_composite[] = { 2, 0x05, 0xFE, 0x10, 0x81, 0x01 };
+
+static tuh_hid_field_t _rc_fields[RC_FIELD_MAX];
+static int32_t _rc_values[RC_VALUE_MAX];
+
+static bool bench_report_desc(char const* name, uint8_t const* desc, uint16_t desc_len,
+                              uint8_t const* report, uint16_t report_len, int32_t const* expected, uint16_t expected_count)
+{
+  // compile vs existing parser which only extracts report ID and top level usage
+  uint16_t field_count = 0;
+  uint64_t t = cpu_ns();
+  for(uint32_t i=0; i<RC_COMPILE_LOOP; i++) field_count = tuh_hid_report_compile(_rc_fields, RC_FIELD_MAX, desc, desc_len);
+  uint64_t const compile_ns = cpu_ns() - t;
+
+  tuh_hid_report_info_t info[4];
+  t = cpu_ns();
+  for(uint32_t i=0; i<RC_COMPILE_LOOP; i++) (void) tuh_hid_parse_report_descriptor(info, 4, desc, desc_len);
+  uint64_t const parse_ns = cpu_ns() - t;
+
+  TU_ASSERT(field_count);
+  uint16_t const value_count = tuh_hid_report_value_count(_rc_fields, field_count);
+  TU_ASSERT(value_count <= RC_VALUE_MAX);
+
+  uint16_t decoded = 0;
+  t = cpu_ns();
+  for(uint32_t i=0; i<RC_DECODE_LOOP; i++) decoded = tuh_hid_report_decode(_rc_fields, field_count, report, report_len, _rc_values);
+  uint64_t const decode_ns = cpu_ns() - t;
+
+  printf("HID %-9s desc %3u bytes: %2u fields (%3u bytes), compile %4.0f ns (parse %4.0f ns), decode %2u values %4.1f ns\n",
+         name, desc_len, field_count, (unsigned) (field_count*sizeof(tuh_hid_field_t)),
+         (double) compile_ns / RC_COMPILE_LOOP, (double) parse_ns / RC_COMPILE_LOOP,
+         decoded, (double) decode_ns / RC_DECODE_LOOP);
+
+  if ( expected )
+  {
+    TU_ASSERT(decoded == expected_count && value_count == expected_count);
+    TU_ASSERT(0 == memcmp(_rc_values, expected, expected_count*sizeof(int32_t)));
+  }
+
+  return true;
+}
+
+static bool bench_hid_report(void)
+{
+  TU_ASSERT(bench_report_desc("keyboard", _desc_keyboard, sizeof(_desc_keyboard), _report_keyboard, sizeof(_report_keyboard),
+                              _values_keyboard, TU_ARRAY_SIZE(_values_keyboard)));
+  TU_ASSERT(bench_report_desc("mouse", _desc_mouse, sizeof(_desc_mouse), _report_mouse, sizeof(_report_mouse),
+                              _values_mouse, TU_ARRAY_SIZE(_values_mouse)));
+  TU_ASSERT(bench_report_desc("gamepad", _desc_gamepad, sizeof(_desc_gamepad), _report_gamepad, sizeof(_report_gamepad),
+                              _values_gamepad, TU_ARRAY_SIZE(_values_gamepad)));
+
+  // mouse report only updates mouse values, keyboard values are left untouched
+  for(uint8_t i=0; i<RC_VALUE_MAX; i++) _rc_values[i] = 0x55;
+  TU_ASSERT(bench_report_desc("composite", _desc_composite, sizeof(_desc_composite), _report_composite, sizeof(_report_composite), NULL, 0));
+
+  uint16_t const field_count = tuh_hid_report_compile(_rc_fields, RC_FIELD_MAX, _desc_composite, sizeof(_desc_composite));
+  uint16_t x_idx, wheel_idx;
+  TU_ASSERT(tuh_hid_report_find_value(_rc_fields, field_count, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_X, &x_idx));
+  TU_ASSERT(tuh_hid_report_find_value(_rc_fields, field_count, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_WHEEL, &wheel_idx));
+  TU_ASSERT(_rc_values[x_idx] == -2 && _rc_values[wheel_idx] == -127);
+  TU_ASSERT(_rc_values[0] == 0x55 && _rc_fields[0].report_id == 1);
+
+  // report descriptor of mounted keyboard is compiled by the driver: modifiers, LEDs and keycodes
+  uint16_t kbd_count = 0;
+  tuh_hid_field_t const* kbd_fields = tuh_hid_get_fields(_app.hid_addr, 0, &kbd_count);
+  TU_ASSERT(kbd_count == 3);
+  TU_ASSERT(tuh_hid_decode_report(_app.hid_addr, 0, _report_keyboard, sizeof(_report_keyboard), _rc_values) == 14);
+  TU_ASSERT(0 == memcmp(_rc_values, _values_keyboard, sizeof(_values_keyboard)));
+  TU_ASSERT(kbd_fields[1].report_type == HID_REPORT_TYPE_OUTPUT && kbd_fields[1].count == 5);
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// MIDI Sequencer
+//--------------------------------------------------------------------+
+
+static bool midi_synth_unplugged(void)
+{
+  // hub + MSC, CDC, HID, MIDI
+  return _app.mount_count == 5;
+}
+
+static bool midi_synth_mounted(void)
+{
+  return _app.mount_count == 8 && _app.midi_count == MIDI_SYNTH_COUNT;
+}
+
+static sim_midi_t* midi_synth(uint8_t i)
+{
+  return (i == 0) ? &_midi : &_synth[i-1];
+}
+
+// Loopback packets are read back in batch
+static void midi_read_task(void)
+{
+  for(uint8_t i=0; i<MIDI_SYNTH_COUNT; i++)
+  {
+    uint8_t rx[16][4];
+    uint32_t count;
+    while ( (count = tuh_midi_packet_read_n(_app.midi_addrs[i], &rx[0][0], 16)) > 0 ) _app.midi_received += count;
+  }
+}
+
+static bool midi_rx_available(void)
+{
+  return tuh_midi_available(_app.midi_addrs[0]) > 0;
+}
+
+// Note On & Off on every synth each millisecond, velocity is the time stamp
+static void midi_seq_task(void)
+{
+  uint8_t const stamp = (uint8_t) ((hcd_sim_time_us() / 1000) & 0x7f);
+  uint8_t const note  = (uint8_t) (0x30 + (_app.midi_seq_count % 24));
+
+  uint8_t const packets[2][4] =
+  {
+    { MIDI_CIN_NOTE_ON , 0x90, note, stamp },
+    { MIDI_CIN_NOTE_OFF, 0x80, note, 0     },
+  };
+
+  for(uint8_t i=0; i<MIDI_SYNTH_COUNT; i++)
+  {
+    uint8_t const daddr = _app.midi_addrs[i];
+
+    // events are written one by one as sequencer generates them
+    for(uint8_t p=0; p<2; p++)
+    {
+      if ( tuh_midi_packet_write(daddr, packets[p]) ) _app.midi_sent++;
+    }
+  }
+
+  midi_read_task();
+
+  // background bulk load: MSC reads back to back
+  if ( _app.midi_load && _app.msc_done )
+  {
+    _app.msc_done = 0;
+    tuh_msc_read10(_app.msc_addr, 0, _buffer, 0, MIDI_LOAD_BLOCKS, msc_complete);
+  }
+
+  _app.midi_seq_count++;
+}
+
+static bool midi_seq_run(bool load)
+{
+  for(uint8_t i=0; i<MIDI_SYNTH_COUNT; i++)
+  {
+    sim_midi_t* synth = midi_synth(i);
+    synth->note_count     = 0;
+    synth->latency_sum_ms = 0;
+    synth->latency_max_ms = 0;
+  }
+
+  _app.midi_load     = load;
+  _app.midi_sent     = 0;
+  _app.midi_received = 0;
+  _app.msc_done      = 1;
+
+  uint32_t const xfer_count = hcd_sim_stat()->xfer_count;
+
+  measure_t m = measure_start();
+  run_app(MIDI_SEQ_MS, 1, midi_seq_task);
+  m = measure_stop(m);
+
+  // drain pending loopback and MSC read
+  run_app(20, 1, midi_read_task);
+  TU_ASSERT(run_until(msc_idle));
+
+  uint32_t notes = 0, latency_sum = 0, latency_max = 0;
+  for(uint8_t i=0; i<MIDI_SYNTH_COUNT; i++)
+  {
+    sim_midi_t const* synth = midi_synth(i);
+    notes       += synth->note_count;
+    latency_sum += synth->latency_sum_ms;
+    latency_max  = tu_max32(latency_max, synth->latency_max_ms);
+  }
+
+  // spread of arrival time of the same time stamp across synths, over the last 100 ms
+  uint32_t spread_max = 0;
+  uint32_t const now_ms = (uint32_t) (hcd_sim_time_us() / 1000);
+  for(uint32_t t = now_ms - 120; t < now_ms - 20; t++)
+  {
+    uint32_t lo = UINT32_MAX, hi = 0;
+    for(uint8_t i=0; i<MIDI_SYNTH_COUNT; i++)
+    {
+      uint32_t const arrival = midi_synth(i)->arrival_ms[t & 0x7f];
+      lo = tu_min32(lo, arrival);
+      hi = tu_max32(hi, arrival);
+    }
+    spread_max = tu_max32(spread_max, hi - lo);
+  }
+
+  printf("MIDI %u synths%-12s: %lu notes, latency avg %.2f ms max %lu ms, spread max %lu ms, %lu transfers, %.1f us CPU per ms\n",
+         MIDI_SYNTH_COUNT, load ? " + MSC load" : "", (unsigned long) notes, (double) latency_sum / notes,
+         (unsigned long) latency_max, (unsigned long) spread_max, (unsigned long) (hcd_sim_stat()->xfer_count - xfer_count),
+         (m.cpu_ns/1000.0) / MIDI_SEQ_MS);
+
+  TU_ASSERT(notes >= MIDI_SYNTH_COUNT*MIDI_SEQ_MS);
+  TU_ASSERT(_app.midi_received == _app.midi_sent);
+
+  return true;
+}
+
+static bool bench_midi(void)
+{
+  // serial adapters are replaced by 3 more MIDI synths
+  for(uint8_t p=5; p<=7; p++) sim_hub_unplug(&_hub, p);
+  TU_ASSERT(run_until(midi_synth_unplugged));
+
+  for(uint8_t i=0; i<MIDI_SYNTH_COUNT-1; i++)
+  {
+    sim_midi_init(&_synth[i], TUSB_SPEED_FULL);
+    sim_hub_plug(&_hub, (uint8_t) (5+i), &_synth[i].dev);
+  }
+  TU_ASSERT(run_until(midi_synth_mounted));
+
+  // stream API: notes written to different cables of the same device are packed separately
+  uint8_t const daddr = _app.midi_addrs[0];
+  uint8_t const note_on [] = { 0x90, 0x40, 0x7f };
+  TU_ASSERT(tuh_midih_get_num_tx_cables(daddr) == 1);
+  TU_ASSERT(tuh_midi_stream_write(daddr, 0, note_on, 2) == 2);
+  TU_ASSERT(tuh_midi_stream_write(daddr, 0, note_on + 2, 1) == 1);
+  TU_ASSERT(tuh_midi_stream_write(daddr, 1, note_on, 3) == 0); // single cable device
+  TU_ASSERT(run_until(midi_rx_available));
+
+  uint8_t cable = 0xff;
+  uint8_t msg[8];
+  TU_ASSERT(tuh_midi_stream_read(daddr, &cable, msg, sizeof(msg)) == 3);
+  TU_ASSERT(cable == 0 && 0 == memcmp(msg, note_on, 3));
+
+  TU_ASSERT(midi_seq_run(false));
+  TU_ASSERT(midi_seq_run(true));
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Main
+//--------------------------------------------------------------------+
+
+int main(int argc, char* argv[])
+{
+  uint8_t* image = NULL;
+  uint32_t image_size = 0;
+
+  if ( argc > 1 )
+  {
+    image = sim_msc_load_image(argv[1], &image_size);
+    if ( image == NULL )
+    {
+      printf("Failed to load disk image %s\n", argv[1]);
+      return 1;
+    }
+  }else
+  {
+    image_size = 8*1024*1024;
+    image = malloc(image_size);
+    for(uint32_t i=0; i<image_size; i++) image[i] = (uint8_t) (i ^ (i >> 9));
+  }
+
+  sim_hub_init(&_hub, 7);
+  sim_msc_init(&_msc, TUSB_SPEED_FULL, image, image_size/512, 512);
+  sim_cdc_init(&_cdc, TUSB_SPEED_FULL, SIM_CDC_ACM);
+  sim_cdc_init(&_serial[0], TUSB_SPEED_FULL, SIM_CDC_FTDI);
+  sim_cdc_init(&_serial[1], TUSB_SPEED_FULL, SIM_CDC_CP210X);
+  sim_cdc_init(&_serial[2], TUSB_SPEED_FULL, SIM_CDC_CH34X);
+  sim_hid_init(&_hid, TUSB_SPEED_FULL, 10);
+  sim_midi_init(&_midi, TUSB_SPEED_FULL);
+
+  // keyboard report every 10 ms to share the bus with bulk transfers
+  _hid.auto_interval_us = 10000;
+
+  tusb_init();
+
+  bool ok = bench_enumeration();
+  ok = ok && bench_control();
+  ok = ok && bench_msc(false);
+  ok = ok && bench_msc(true);
+  ok = ok && bench_msc_small(false, false);
+  ok = ok && bench_msc_small(false, true);
+  ok = ok && bench_msc_small(true, false);
+  ok = ok && bench_msc_small(true, true);
+  ok = ok && bench_fatfs();
+  ok = ok && bench_cdc("ACM", tuh_cdc_itf_get_index(_app.cdc_addr, 0));
+  ok = ok && bench_serial();
+  ok = ok && bench_hid_poll();
+  ok = ok && bench_hid_report();
+  ok = ok && bench_midi();
+
+  hcd_sim_stat_t const* stat = hcd_sim_stat();
+  printf("Bus: %u setup, %u transfers, %u packets, %u NAKs, %u STALLs, %llu bytes, %u HID reports\n",
+         stat->setup_count, stat->xfer_count, stat->packet_count, stat->nak_count, stat->stall_count,
+         (unsigned long long) stat->bytes, _app.hid_reports);
+
+  free(image);
+
+  return ok ? 0 : 1;
+}
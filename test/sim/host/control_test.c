@@ -0,0 +1,322 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "host/hcd.h"
+#include "host/usbh_classdriver.h"
+#include "sim_test.h"
+
+//--------------------------------------------------------------------+
+// Control transfer queue of usbh against HCD stubs, built once per HCD kind:
+// a control pipe per device, and one control pipe shared by all devices (HCD_ATTR_CONTROL_SHARED)
+// - transfers to 3 devices and 2 back-to-back to one of them: setup order and completion order,
+//   round robin of the shared pipe so that the device with 2 transfers does not go first twice
+// - full queue, setup that fails when queued is rolled back, setup that fails when started
+//   after the transfer ahead completes with XFER_RESULT_FAILED
+//--------------------------------------------------------------------+
+
+#define LOG_MAX  16
+
+// Order of setup packets sent by the HCD and of completed transfers, as dev_addr << 8 | bRequest
+static struct
+{
+  uint16_t entry[LOG_MAX];
+  uint8_t  count;
+} _setup_log, _complete_log;
+
+static xfer_result_t _complete_result[LOG_MAX];
+
+static bool    _setup_fail;      // next setup packet is refused by the HCD
+static uint8_t _pending_stage[CFG_TUH_DEVICE_MAX + CFG_TUH_HUB + 1];  // stage events the device is waiting for
+
+static void log_add(uint16_t value, bool setup)
+{
+  if ( setup )
+  {
+    if ( _setup_log.count < LOG_MAX ) _setup_log.entry[_setup_log.count++] = value;
+  }else
+  {
+    if ( _complete_log.count < LOG_MAX ) _complete_log.entry[_complete_log.count++] = value;
+  }
+}
+
+static void log_clear(void)
+{
+  tu_varclr(&_setup_log);
+  tu_varclr(&_complete_log);
+}
+
+static bool log_equal(uint16_t const* expected, uint8_t count, bool setup)
+{
+  uint8_t const n = setup ? _setup_log.count : _complete_log.count;
+  uint16_t const* entry = setup ? _setup_log.entry : _complete_log.entry;
+
+  bool equal = (n == count) && !memcmp(entry, expected, count * sizeof(uint16_t));
+  if ( !equal )
+  {
+    printf("  %s order:", setup ? "setup" : "completion");
+    for ( uint8_t i = 0; i < n; i++ ) printf(" %u.%u", entry[i] >> 8, entry[i] & 0xFF);
+    printf("\n");
+  }
+  return equal;
+}
+
+//--------------------------------------------------------------------+
+// HCD and usbh stubs
+//--------------------------------------------------------------------+
+
+// from usbh_control.c, called by usbh on control endpoint events
+extern bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+
+uint8_t usbh_get_rhport(uint8_t dev_addr)
+{
+  (void) dev_addr;
+  return 0;
+}
+
+bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet[8])
+{
+  (void) rhport;
+  if ( _setup_fail )
+  {
+    _setup_fail = false;
+    return false;
+  }
+
+  tusb_control_request_t const* request = (tusb_control_request_t const*) setup_packet;
+  log_add((uint16_t) (dev_addr << 8 | request->bRequest), true);
+
+  // setup, optional data and status stage
+  CHECK(_pending_stage[dev_addr] == 0);
+  _pending_stage[dev_addr] = request->wLength ? 3 : 2;
+  return true;
+}
+
+bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint32_t buflen)
+{
+  (void) rhport; (void) dev_addr; (void) ep_addr; (void) buffer; (void) buflen;
+  return true;
+}
+
+static bool complete_cb(uint8_t dev_addr, tusb_control_request_t const * request, xfer_result_t result)
+{
+  _complete_result[_complete_log.count] = result;
+  log_add((uint16_t) (dev_addr << 8 | request->bRequest), false);
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Host side
+//--------------------------------------------------------------------+
+
+static bool control(uint8_t dev_addr, uint8_t id, uint16_t length)
+{
+  static uint8_t buf[64];
+  tusb_control_request_t const request =
+  {
+    .bmRequestType = 0x80,  // device to host, standard, device
+    .bRequest      = id,
+    .wValue        = 0,
+    .wIndex        = 0,
+    .wLength       = length
+  };
+  return tuh_control_xfer(dev_addr, &request, buf, complete_cb);
+}
+
+// Run all stages of the transfer in progress on the device, as the HCD completes them
+static void finish(uint8_t dev_addr)
+{
+  // completion of the last stage may start the next transfer of the device
+  uint8_t const stages = _pending_stage[dev_addr];
+  CHECK(stages);
+  for ( uint8_t i = 0; i < stages; i++ )
+  {
+    _pending_stage[dev_addr]--;
+    usbh_control_xfer_cb(dev_addr, 0, XFER_RESULT_SUCCESS, 0);
+  }
+}
+
+static void fail(uint8_t dev_addr)
+{
+  CHECK(_pending_stage[dev_addr]);
+  _pending_stage[dev_addr] = 0;
+  usbh_control_xfer_cb(dev_addr, 0, XFER_RESULT_STALLED, 0);
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+#ifdef HCD_ATTR_CONTROL_SHARED
+  #define SHARED 1
+#else
+  #define SHARED 0
+#endif
+
+// Device 1 queues 2 transfers back-to-back, devices 2 and 3 one each
+static void test_order(void)
+{
+  printf("3 devices, 2 transfers back-to-back to device 1\n");
+  log_clear();
+
+  CHECK(control(1, 0x10, 0));
+  CHECK(control(1, 0x11, 18));
+  CHECK(control(2, 0x20, 8));
+  CHECK(control(3, 0x30, 0));
+
+  if ( SHARED )
+  {
+    // only one transfer on the pipe, others wait
+    uint16_t const setup[] = { 0x0110 };
+    CHECK(log_equal(setup, TU_ARRAY_SIZE(setup), true));
+  }else
+  {
+    // every device starts right away, the second transfer of device 1 waits for the first
+    uint16_t const setup[] = { 0x0110, 0x0220, 0x0330 };
+    CHECK(log_equal(setup, TU_ARRAY_SIZE(setup), true));
+  }
+
+  if ( SHARED )
+  {
+    // pipe goes round robin: devices 2 and 3 before the second transfer of device 1
+    finish(1);
+    finish(2);
+    finish(3);
+    finish(1);
+
+    uint16_t const order[] = { 0x0110, 0x0220, 0x0330, 0x0111 };
+    CHECK(log_equal(order, TU_ARRAY_SIZE(order), true));
+    CHECK(log_equal(order, TU_ARRAY_SIZE(order), false));
+  }else
+  {
+    // devices complete in any order, transfers of a device in queue order
+    finish(3);
+    finish(1);
+    finish(2);
+    finish(1);
+
+    uint16_t const setup[]    = { 0x0110, 0x0220, 0x0330, 0x0111 };
+    uint16_t const complete[] = { 0x0330, 0x0110, 0x0220, 0x0111 };
+    CHECK(log_equal(setup, TU_ARRAY_SIZE(setup), true));
+    CHECK(log_equal(complete, TU_ARRAY_SIZE(complete), false));
+  }
+
+  for ( uint8_t i = 0; i < _complete_log.count; i++ ) CHECK(_complete_result[i] == XFER_RESULT_SUCCESS);
+}
+
+// A failed stage completes the transfer and starts the next one
+static void test_stall(void)
+{
+  printf("stalled transfer\n");
+  log_clear();
+
+  CHECK(control(2, 0x21, 0));
+  CHECK(control(2, 0x22, 0));
+  fail(2);
+  finish(2);
+
+  uint16_t const order[] = { 0x0221, 0x0222 };
+  CHECK(log_equal(order, TU_ARRAY_SIZE(order), true));
+  CHECK(log_equal(order, TU_ARRAY_SIZE(order), false));
+  CHECK(_complete_result[0] == XFER_RESULT_STALLED);
+  CHECK(_complete_result[1] == XFER_RESULT_SUCCESS);
+}
+
+static void test_queue_full(void)
+{
+  printf("full queue\n");
+  log_clear();
+
+  for ( uint8_t i = 0; i < CFG_TUH_CONTROL_QUEUE_SZ; i++ ) CHECK(control(1, (uint8_t) (0x40 + i), 0));
+  CHECK(!control(1, 0x4F, 0));
+
+  for ( uint8_t i = 0; i < CFG_TUH_CONTROL_QUEUE_SZ; i++ ) finish(1);
+  CHECK(_complete_log.count == CFG_TUH_CONTROL_QUEUE_SZ);
+}
+
+// Setup refused by the HCD when queued: the transfer is not queued, the device and the pipe stay usable
+static void test_enqueue_rollback(void)
+{
+  printf("setup refused when queued\n");
+  log_clear();
+
+  _setup_fail = true;
+  CHECK(!control(3, 0x31, 0));
+  CHECK(_complete_log.count == 0);
+
+  // whole queue is still available and the next transfer starts right away
+  for ( uint8_t i = 0; i < CFG_TUH_CONTROL_QUEUE_SZ; i++ ) CHECK(control(3, (uint8_t) (0x32 + i), 0));
+  uint16_t const setup[] = { 0x0332 };
+  CHECK(log_equal(setup, TU_ARRAY_SIZE(setup), true));
+
+  // other devices still get the pipe
+  CHECK(control(2, 0x23, 0));
+  finish(3);
+  finish(2);
+  finish(3);
+
+  uint16_t const order[] = { 0x0332, 0x0223, 0x0333 };
+  CHECK(log_equal(order, TU_ARRAY_SIZE(order), false));
+}
+
+// Setup refused by the HCD when the queued transfer is started: it completes as failed
+static void test_start_failure(void)
+{
+  printf("setup refused when started\n");
+  log_clear();
+
+  CHECK(control(1, 0x50, 0));
+  CHECK(control(1, 0x51, 0));
+
+  _setup_fail = true;
+  finish(1);
+
+  uint16_t const order[] = { 0x0150, 0x0151 };
+  CHECK(log_equal(order, TU_ARRAY_SIZE(order), false));
+  CHECK(_complete_result[0] == XFER_RESULT_SUCCESS);
+  CHECK(_complete_result[1] == XFER_RESULT_FAILED);
+
+  // queue is empty again
+  CHECK(control(1, 0x52, 0));
+  finish(1);
+  CHECK(_complete_log.count == 3);
+}
+
+int main(void)
+{
+  printf("control pipe %s\n", SHARED ? "shared by all devices" : "per device");
+
+  test_order();
+  test_stall();
+  test_queue_full();
+  test_enqueue_rollback();
+  test_start_failure();
+
+  return sim_result();
+}
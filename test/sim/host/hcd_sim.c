@@ -0,0 +1,716 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if TUSB_OPT_HOST_ENABLED
+
+#include <string.h>
+
+#include "host/hcd.h"
+#include "hcd_sim.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+#define SIM_ADDR_MAX    (CFG_TUH_DEVICE_MAX + CFG_TUH_HUB + 1)
+#define SIM_PIPE_MAX    (4*SIM_ADDR_MAX)
+
+extern sim_driver_t const sim_hub_driver;
+
+enum
+{
+  CTRL_IDLE = 0,
+  CTRL_SETUP,        // setup packet is pending
+  CTRL_WAIT,         // waiting for data/status stage from usbh
+  CTRL_DATA,
+  CTRL_STATUS
+};
+
+typedef struct
+{
+  uint8_t  stage;
+  bool     stalled;  // request is stalled, reported on the next stage
+  bool     failed;   // no device responding
+  uint16_t ep0_size;
+
+  tusb_control_request_t request;
+
+  uint8_t* buffer;   // buffer of data stage
+  uint16_t len;
+  uint16_t xferred;
+
+  // response of IN request is prepared when setup is received
+  uint8_t  resp[CFG_TUH_ENUMERATION_BUFSIZE];
+  uint16_t resp_len;
+} sim_ctrl_t;
+
+typedef struct
+{
+  bool     opened;
+  bool     active;
+  uint8_t  dev_addr;
+  uint8_t  ep_addr;
+  uint8_t  xfer_type;
+  uint16_t mps;
+  uint32_t interval;  // in (micro)frames for periodic endpoint
+  uint64_t next_frame;
+
+  uint8_t* buffer;
+  uint32_t len;
+  uint32_t xferred;
+} sim_pipe_t;
+
+typedef struct
+{
+  uint8_t  dev_addr;
+  uint8_t  ep_addr;
+  uint8_t  result;
+  uint32_t len;
+} sim_event_t;
+
+static struct
+{
+  sim_device_t* root;
+
+  uint64_t time_us;
+  uint64_t frame_count;   // (micro)frame
+  uint32_t budget;        // remaining bytes in current frame
+
+  sim_ctrl_t ctrl[SIM_ADDR_MAX];
+  sim_pipe_t pipe[SIM_PIPE_MAX];
+  uint8_t    rr_start;    // bulk pipe round robin
+
+  sim_event_t event[SIM_PIPE_MAX + SIM_ADDR_MAX];
+  uint8_t     event_count;
+
+  hcd_sim_stat_t stat;
+} _sim;
+
+//--------------------------------------------------------------------+
+// Device tree
+//--------------------------------------------------------------------+
+
+static bool is_high_speed(void)
+{
+  return _sim.root && (_sim.root->speed == TUSB_SPEED_HIGH);
+}
+
+// all enabled devices with address, count is used to detect address 0 collision
+static sim_device_t* find_device(sim_device_t* dev, uint8_t dev_addr, uint8_t* count)
+{
+  if ( dev == NULL || !dev->enabled ) return NULL;
+
+  sim_device_t* found = NULL;
+
+  if ( dev->address == dev_addr )
+  {
+    found = dev;
+    (*count)++;
+  }
+
+  if ( dev->driver == &sim_hub_driver && dev->config_num )
+  {
+    sim_hub_t* hub = (sim_hub_t*) dev;
+    for(uint8_t p=1; p <= hub->port_count; p++)
+    {
+      sim_device_t* child = find_device(hub->port[p].child, dev_addr, count);
+      if ( child ) found = child;
+    }
+  }
+
+  return found;
+}
+
+sim_device_t* hcd_sim_find_device(uint8_t dev_addr)
+{
+  uint8_t count = 0;
+  sim_device_t* dev = find_device(_sim.root, dev_addr, &count);
+
+  // more than one device at the same address, none of them could respond correctly
+  return (count == 1) ? dev : NULL;
+}
+
+static void device_sof(sim_device_t* dev, uint32_t frame_us)
+{
+  if ( dev == NULL ) return;
+
+  if ( dev->driver->sof ) dev->driver->sof(dev, frame_us);
+
+  if ( dev->driver == &sim_hub_driver )
+  {
+    sim_hub_t* hub = (sim_hub_t*) dev;
+    for(uint8_t p=1; p <= hub->port_count; p++) device_sof(hub->port[p].child, frame_us);
+  }
+}
+
+void hcd_sim_device_reset(sim_device_t* dev)
+{
+  dev->enabled    = true;
+  dev->address    = 0;
+  dev->config_num = 0;
+
+  if ( dev->driver->reset ) dev->driver->reset(dev);
+}
+
+//--------------------------------------------------------------------+
+// Bus scheduler
+//--------------------------------------------------------------------+
+
+static void queue_event(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t len)
+{
+  TU_ASSERT(_sim.event_count < TU_ARRAY_SIZE(_sim.event), );
+  _sim.event[_sim.event_count++] = (sim_event_t) { dev_addr, ep_addr, (uint8_t) result, len };
+}
+
+// consume bandwidth of a packet, false if not enough left in this frame
+static bool packet_budget(uint16_t len)
+{
+  uint32_t const cost = len + (is_high_speed() ? SIM_PACKET_OVERHEAD_HS : SIM_PACKET_OVERHEAD_FS);
+  if ( _sim.budget < cost ) return false;
+
+  _sim.budget -= cost;
+  _sim.stat.packet_count++;
+  _sim.stat.bytes += len;
+
+  return true;
+}
+
+static void packet_refund(uint16_t len)
+{
+  _sim.budget     += len;
+  _sim.stat.bytes -= len;
+}
+
+// Standard requests are handled here, the rest by device model. Return data length or -1 for STALL
+static int32_t device_request(sim_device_t* dev, tusb_control_request_t const* request, uint8_t* data)
+{
+  if ( request->bmRequestType_bit.type      == TUSB_REQ_TYPE_STANDARD &&
+       request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_DEVICE )
+  {
+    switch ( request->bRequest )
+    {
+      case TUSB_REQ_GET_DESCRIPTOR:
+      {
+        uint8_t const desc_type = tu_u16_high(request->wValue);
+
+        if ( desc_type == TUSB_DESC_DEVICE )
+        {
+          uint16_t const len = tu_min16(request->wLength, sizeof(tusb_desc_device_t));
+          memcpy(data, dev->desc_device, len);
+          return len;
+        }
+        else if ( desc_type == TUSB_DESC_CONFIGURATION )
+        {
+          uint16_t const total_len = tu_unaligned_read16(dev->desc_config + offsetof(tusb_desc_configuration_t, wTotalLength));
+          uint16_t const len = tu_min16(request->wLength, total_len);
+          memcpy(data, dev->desc_config, len);
+          return len;
+        }
+      }
+      break;
+
+      case TUSB_REQ_SET_ADDRESS:
+        // address is changed after status stage
+        return 0;
+
+      case TUSB_REQ_SET_CONFIGURATION:
+        dev->config_num = (uint8_t) request->wValue;
+        return 0;
+
+      default: break;
+    }
+  }
+
+  if ( dev->driver->control ) return dev->driver->control(dev, request, data);
+
+  // ack standard requests not supported by model e.g SET_INTERFACE, CLEAR_FEATURE
+  return (request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD) ? 0 : -1;
+}
+
+static void control_process(uint8_t dev_addr)
+{
+  sim_ctrl_t* ctrl = &_sim.ctrl[dev_addr];
+  tusb_control_request_t const* request = &ctrl->request;
+
+  switch ( ctrl->stage )
+  {
+    case CTRL_SETUP:
+    {
+      if ( !packet_budget(8) ) return;
+      _sim.stat.setup_count++;
+
+      sim_device_t* dev = hcd_sim_find_device(dev_addr);
+
+      ctrl->failed  = (dev == NULL);
+      ctrl->stalled = false;
+      ctrl->stage   = CTRL_WAIT;
+
+      if ( dev == NULL )
+      {
+        // nobody responds, host controller reports transaction error
+        queue_event(dev_addr, 0, XFER_RESULT_FAILED, 0);
+        ctrl->stage = CTRL_IDLE;
+        return;
+      }
+
+      // OUT request with data is executed when data is received
+      if ( request->bmRequestType_bit.direction == TUSB_DIR_IN || request->wLength == 0 )
+      {
+        int32_t const len = device_request(dev, request, ctrl->resp);
+        ctrl->stalled  = (len < 0);
+        ctrl->resp_len = (len < 0) ? 0 : (uint16_t) len;
+      }
+
+      queue_event(dev_addr, 0, XFER_RESULT_SUCCESS, 8);
+    }
+    break;
+
+    case CTRL_DATA:
+    {
+      if ( ctrl->stalled )
+      {
+        if ( !packet_budget(0) ) return;
+        _sim.stat.stall_count++;
+        ctrl->stage = CTRL_IDLE;
+        queue_event(dev_addr, tu_edpt_addr(0, request->bmRequestType_bit.direction), XFER_RESULT_STALLED, 0);
+        return;
+      }
+
+      bool const is_in = (request->bmRequestType_bit.direction == TUSB_DIR_IN);
+      bool complete = false;
+
+      while ( !complete )
+      {
+        uint16_t const remaining = (uint16_t) (ctrl->len - ctrl->xferred);
+        uint16_t packet = tu_min16(remaining, ctrl->ep0_size);
+
+        if ( is_in ) packet = tu_min16(packet, (uint16_t) (ctrl->resp_len - ctrl->xferred));
+        if ( !packet_budget(packet) ) return;
+
+        if ( is_in )
+        {
+          memcpy(ctrl->buffer + ctrl->xferred, ctrl->resp + ctrl->xferred, packet);
+        }else
+        {
+          memcpy(ctrl->resp + ctrl->xferred, ctrl->buffer + ctrl->xferred, packet);
+        }
+        ctrl->xferred += packet;
+
+        complete = (ctrl->xferred == ctrl->len) || (packet < ctrl->ep0_size);
+      }
+
+      if ( !is_in )
+      {
+        sim_device_t* dev = hcd_sim_find_device(dev_addr);
+        int32_t const len = dev ? device_request(dev, request, ctrl->resp) : -1;
+
+        if ( len < 0 )
+        {
+          _sim.stat.stall_count++;
+          ctrl->stage = CTRL_IDLE;
+          queue_event(dev_addr, 0, XFER_RESULT_STALLED, 0);
+          return;
+        }
+      }
+
+      ctrl->stage = CTRL_WAIT;
+      queue_event(dev_addr, tu_edpt_addr(0, request->bmRequestType_bit.direction), XFER_RESULT_SUCCESS, ctrl->xferred);
+    }
+    break;
+
+    case CTRL_STATUS:
+      if ( !packet_budget(0) ) return;
+
+      ctrl->stage = CTRL_IDLE;
+
+      if ( ctrl->stalled )
+      {
+        _sim.stat.stall_count++;
+        queue_event(dev_addr, 0, XFER_RESULT_STALLED, 0);
+        return;
+      }
+
+      // Set Address takes effect after status stage
+      if ( request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD && request->bRequest == TUSB_REQ_SET_ADDRESS )
+      {
+        sim_device_t* dev = hcd_sim_find_device(dev_addr);
+        if ( dev ) dev->address = (uint8_t) request->wValue;
+      }
+
+      queue_event(dev_addr, tu_edpt_addr(0, 1-request->bmRequestType_bit.direction), XFER_RESULT_SUCCESS, 0);
+    break;
+
+    default: break;
+  }
+}
+
+// Move packets of a non-control pipe, only one if one_packet is set.
+// Return true if pipe can move more packets in this frame, false if it is NAKed, complete or out of bandwidth
+static bool pipe_process(sim_pipe_t* pipe, bool one_packet)
+{
+  sim_device_t* dev = hcd_sim_find_device(pipe->dev_addr);
+  if ( dev == NULL )
+  {
+    pipe->active = false;
+    queue_event(pipe->dev_addr, pipe->ep_addr, XFER_RESULT_FAILED, pipe->xferred);
+    return false;
+  }
+
+  bool const is_in    = (tu_edpt_dir(pipe->ep_addr) == TUSB_DIR_IN);
+  bool const periodic = (pipe->xfer_type == TUSB_XFER_INTERRUPT) || (pipe->xfer_type == TUSB_XFER_ISOCHRONOUS);
+
+  while(1)
+  {
+    uint16_t const packet = (uint16_t) tu_min32(pipe->len - pipe->xferred, pipe->mps);
+
+    if ( !packet_budget(packet) ) return false;
+
+    int32_t const count = dev->driver->xfer ? dev->driver->xfer(dev, pipe->ep_addr, pipe->buffer + pipe->xferred, packet) : -1;
+
+    // IN NAK or short packet: only the bytes sent by device take bus time
+    if ( is_in )
+    {
+      uint16_t const received = (count < 0) ? 0 : tu_min16((uint16_t) count, packet);
+      packet_refund((uint16_t) (packet - received));
+    }
+
+    if ( count < 0 )
+    {
+      // ISO has no handshake, an empty packet is received instead
+      if ( pipe->xfer_type != TUSB_XFER_ISOCHRONOUS )
+      {
+        _sim.stat.nak_count++;
+        return false;
+      }
+    }else
+    {
+      pipe->xferred += is_in ? tu_min16((uint16_t) count, packet) : packet;
+    }
+
+    // short packet or all bytes are transferred
+    if ( (pipe->xferred == pipe->len) || (count >= 0 && count < pipe->mps) || (pipe->xfer_type == TUSB_XFER_ISOCHRONOUS) )
+    {
+      pipe->active = false;
+      _sim.stat.xfer_count++;
+      queue_event(pipe->dev_addr, pipe->ep_addr, XFER_RESULT_SUCCESS, pipe->xferred);
+      return false;
+    }
+
+    // one packet per interval for periodic endpoint
+    if ( periodic ) return false;
+    if ( one_packet ) return true;
+  }
+}
+
+void hcd_sim_step(void)
+{
+  uint32_t const frame_us = is_high_speed() ? 125 : 1000;
+
+  _sim.budget = is_high_speed() ? SIM_FRAME_BYTES_HS : SIM_FRAME_BYTES_FS;
+
+  device_sof(_sim.root, frame_us);
+
+  // periodic first
+  for(uint8_t i=0; i<SIM_PIPE_MAX; i++)
+  {
+    sim_pipe_t* pipe = &_sim.pipe[i];
+
+    if ( pipe->active && pipe->xfer_type != TUSB_XFER_BULK && _sim.frame_count >= pipe->next_frame )
+    {
+      pipe->next_frame = _sim.frame_count + pipe->interval;
+      pipe_process(pipe, false);
+    }
+  }
+
+  // then control
+  for(uint8_t addr=0; addr<SIM_ADDR_MAX; addr++)
+  {
+    control_process(addr);
+  }
+
+  // bulk uses remaining bandwidth, one packet per pipe in turn as the asynchronous schedule of
+  // a real controller. Pipe is skipped for the rest of the frame once it is NAKed or complete.
+  bool more[SIM_PIPE_MAX];
+  for(uint8_t i=0; i<SIM_PIPE_MAX; i++) more[i] = _sim.pipe[i].active && _sim.pipe[i].xfer_type == TUSB_XFER_BULK;
+
+  bool progress = true;
+  while ( progress )
+  {
+    progress = false;
+
+    for(uint8_t n=0; n<SIM_PIPE_MAX; n++)
+    {
+      uint8_t const i = (uint8_t) ((_sim.rr_start + n) % SIM_PIPE_MAX);
+
+      if ( more[i] )
+      {
+        more[i] = pipe_process(&_sim.pipe[i], true);
+        progress = progress || more[i];
+      }
+    }
+  }
+  _sim.rr_start = (uint8_t) ((_sim.rr_start + 1) % SIM_PIPE_MAX);
+
+  _sim.time_us += frame_us;
+  _sim.frame_count++;
+
+  // Post events as ISR at the end of frame, usbh may queue new transfers in response
+  uint8_t const count = _sim.event_count;
+  sim_event_t event[TU_ARRAY_SIZE(_sim.event)];
+  memcpy(event, _sim.event, count*sizeof(sim_event_t));
+  _sim.event_count = 0;
+
+  for(uint8_t i=0; i<count; i++)
+  {
+    hcd_event_xfer_complete(event[i].dev_addr, event[i].ep_addr, event[i].len, (xfer_result_t) event[i].result, true);
+  }
+}
+
+//--------------------------------------------------------------------+
+// Simulator API
+//--------------------------------------------------------------------+
+
+void hcd_sim_attach(sim_device_t* dev)
+{
+  _sim.root   = dev;
+  dev->parent = NULL;
+  dev->port   = 0;
+
+  // roothub port is reset by controller on attach
+  hcd_sim_device_reset(dev);
+  hcd_event_device_attach(0, false);
+}
+
+void hcd_sim_detach(void)
+{
+  if ( _sim.root ) _sim.root->enabled = false;
+  _sim.root = NULL;
+  hcd_event_device_remove(0, false);
+}
+
+uint64_t hcd_sim_time_us(void)
+{
+  return _sim.time_us;
+}
+
+hcd_sim_stat_t const* hcd_sim_stat(void)
+{
+  return &_sim.stat;
+}
+
+//--------------------------------------------------------------------+
+// Controller API
+//--------------------------------------------------------------------+
+
+bool hcd_init(uint8_t rhport)
+{
+  (void) rhport;
+  tu_memclr(&_sim, sizeof(_sim));
+  return true;
+}
+
+void hcd_int_handler(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void hcd_int_enable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void hcd_int_disable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+uint32_t hcd_frame_number(uint8_t rhport)
+{
+  (void) rhport;
+  return (uint32_t) (_sim.time_us / 1000);
+}
+
+//--------------------------------------------------------------------+
+// Port API
+//--------------------------------------------------------------------+
+
+bool hcd_port_connect_status(uint8_t rhport)
+{
+  (void) rhport;
+  return _sim.root != NULL;
+}
+
+void hcd_port_reset(uint8_t rhport)
+{
+  (void) rhport;
+  if ( _sim.root ) hcd_sim_device_reset(_sim.root);
+}
+
+void hcd_port_reset_end(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+tusb_speed_t hcd_port_speed_get(uint8_t rhport)
+{
+  (void) rhport;
+  return _sim.root ? (tusb_speed_t) _sim.root->speed : TUSB_SPEED_INVALID;
+}
+
+void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
+{
+  (void) rhport;
+
+  tu_memclr(&_sim.ctrl[dev_addr], sizeof(sim_ctrl_t));
+
+  for(uint8_t i=0; i<SIM_PIPE_MAX; i++)
+  {
+    if ( _sim.pipe[i].dev_addr == dev_addr ) tu_memclr(&_sim.pipe[i], sizeof(sim_pipe_t));
+  }
+}
+
+//--------------------------------------------------------------------+
+// Endpoints API
+//--------------------------------------------------------------------+
+
+static sim_pipe_t* find_pipe(uint8_t dev_addr, uint8_t ep_addr)
+{
+  for(uint8_t i=0; i<SIM_PIPE_MAX; i++)
+  {
+    sim_pipe_t* pipe = &_sim.pipe[i];
+    if ( pipe->opened && pipe->dev_addr == dev_addr && pipe->ep_addr == ep_addr ) return pipe;
+  }
+
+  return NULL;
+}
+
+bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
+{
+  (void) rhport;
+  TU_ASSERT(dev_addr < SIM_ADDR_MAX);
+
+  uint16_t const mps = tu_edpt_packet_size(ep_desc);
+
+  if ( ep_desc->bEndpointAddress == 0 )
+  {
+    tu_memclr(&_sim.ctrl[dev_addr], sizeof(sim_ctrl_t));
+    _sim.ctrl[dev_addr].ep0_size = mps;
+    return true;
+  }
+
+  sim_pipe_t* pipe = find_pipe(dev_addr, ep_desc->bEndpointAddress);
+
+  for(uint8_t i=0; i<SIM_PIPE_MAX && pipe == NULL; i++)
+  {
+    if ( !_sim.pipe[i].opened ) pipe = &_sim.pipe[i];
+  }
+  TU_ASSERT(pipe);
+
+  tu_memclr(pipe, sizeof(sim_pipe_t));
+
+  pipe->opened    = true;
+  pipe->dev_addr  = dev_addr;
+  pipe->ep_addr   = ep_desc->bEndpointAddress;
+  pipe->xfer_type = ep_desc->bmAttributes.xfer;
+  pipe->mps       = mps;
+
+  if ( pipe->xfer_type == TUSB_XFER_INTERRUPT || pipe->xfer_type == TUSB_XFER_ISOCHRONOUS )
+  {
+    uint8_t const interval = tu_max8(ep_desc->bInterval, 1);
+
+    // high speed interval is 2^(bInterval-1) microframes, full speed is in frames
+    if ( is_high_speed() )
+    {
+      pipe->interval = 1u << (tu_min8(interval, 16) - 1);
+    }else
+    {
+      pipe->interval = (pipe->xfer_type == TUSB_XFER_ISOCHRONOUS) ? (1u << (tu_min8(interval, 16) - 1)) : interval;
+    }
+  }
+
+  return true;
+}
+
+bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet[8])
+{
+  (void) rhport;
+  TU_ASSERT(dev_addr < SIM_ADDR_MAX);
+
+  sim_ctrl_t* ctrl = &_sim.ctrl[dev_addr];
+  TU_ASSERT(ctrl->ep0_size);
+
+  memcpy(&ctrl->request, setup_packet, 8);
+  ctrl->stage = CTRL_SETUP;
+
+  return true;
+}
+
+bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint32_t buflen)
+{
+  (void) rhport;
+  TU_ASSERT(dev_addr < SIM_ADDR_MAX);
+
+  if ( tu_edpt_number(ep_addr) == 0 )
+  {
+    sim_ctrl_t* ctrl = &_sim.ctrl[dev_addr];
+    TU_ASSERT(ctrl->stage == CTRL_WAIT);
+
+    // data stage if direction is the same as request, otherwise status
+    bool const is_data = buflen && (tu_edpt_dir(ep_addr) == ctrl->request.bmRequestType_bit.direction);
+
+    // OUT data is kept in response buffer until the request is executed
+    TU_ASSERT(!is_data || tu_edpt_dir(ep_addr) == TUSB_DIR_IN || buflen <= sizeof(ctrl->resp));
+    TU_ASSERT(buflen <= UINT16_MAX);
+
+    ctrl->stage   = is_data ? CTRL_DATA : CTRL_STATUS;
+    ctrl->buffer  = buffer;
+    ctrl->len     = (uint16_t) buflen;
+    ctrl->xferred = 0;
+
+    return true;
+  }
+
+  sim_pipe_t* pipe = find_pipe(dev_addr, ep_addr);
+  TU_ASSERT(pipe && !pipe->active);
+
+  pipe->buffer  = buffer;
+  pipe->len     = buflen;
+  pipe->xferred = 0;
+  pipe->active  = true;
+
+  return true;
+}
+
+bool hcd_edpt_clear_stall(uint8_t dev_addr, uint8_t ep_addr)
+{
+  (void) dev_addr;
+  (void) ep_addr;
+  return true;
+}
+
+#endif
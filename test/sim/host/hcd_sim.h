@@ -0,0 +1,255 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _HCD_SIM_H_
+#define _HCD_SIM_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Virtual Host Controller
+// Implements hcd.h on Linux with a bus scheduler driven by virtual time.
+// Each call to hcd_sim_step() runs one (micro)frame: pending transfers are
+// moved packet by packet to/from device models within the frame bandwidth,
+// completion events are then posted to usbh as the controller ISR would.
+//--------------------------------------------------------------------+
+
+// Max packet per (micro)frame: 19 x 64 bytes for full speed, 13 x 512 bytes for high speed
+enum
+{
+  SIM_FRAME_BYTES_FS    = 1500,
+  SIM_FRAME_BYTES_HS    = 7500,
+  SIM_PACKET_OVERHEAD_FS = 14,
+  SIM_PACKET_OVERHEAD_HS = 50,
+};
+
+typedef struct sim_device sim_device_t;
+
+// Device model callbacks. Standard device requests (GET_DESCRIPTOR of device & configuration,
+// SET_ADDRESS, SET_CONFIGURATION) are handled by the virtual controller.
+typedef struct
+{
+  char const* name;
+
+  // optional: bus reset
+  void (* reset) (sim_device_t* dev);
+
+  // optional: class, vendor or interface request. For IN request, data is filled and its length is returned.
+  // For OUT request, data contains wLength bytes. Return -1 to STALL
+  int32_t (* control) (sim_device_t* dev, tusb_control_request_t const* request, uint8_t* data);
+
+  // optional: one packet on non-control endpoint. IN: fill up to len bytes and return count,
+  // OUT: consume len bytes and return len. Return -1 to NAK
+  int32_t (* xfer) (sim_device_t* dev, uint8_t ep_addr, uint8_t* buf, uint16_t len);
+
+  // optional: called on every (micro)frame
+  void (* sof) (sim_device_t* dev, uint32_t frame_us);
+} sim_driver_t;
+
+struct sim_device
+{
+  sim_driver_t const* driver;
+
+  uint8_t speed;                // tusb_speed_t
+  uint8_t const* desc_device;
+  uint8_t const* desc_config;
+
+  // managed by virtual controller
+  sim_device_t* parent;         // hub, NULL for roothub
+  uint8_t port;
+  bool    enabled;              // port enabled i.e reset complete
+  uint8_t address;
+  uint8_t config_num;
+};
+
+// Statistics
+typedef struct
+{
+  uint32_t setup_count;
+  uint32_t xfer_count;
+  uint32_t packet_count;
+  uint32_t nak_count;
+  uint32_t stall_count;
+  uint64_t bytes;
+} hcd_sim_stat_t;
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+// Attach/Detach device on the roothub port, event is posted to usbh
+void hcd_sim_attach(sim_device_t* dev);
+void hcd_sim_detach(void);
+
+// Run one frame (full/low speed roothub device) or microframe (high speed)
+void hcd_sim_step(void);
+
+// Virtual time since init
+uint64_t hcd_sim_time_us(void);
+
+hcd_sim_stat_t const* hcd_sim_stat(void);
+
+// Find device model by its (assigned) address
+sim_device_t* hcd_sim_find_device(uint8_t dev_addr);
+
+// Used by hub model
+void hcd_sim_device_reset(sim_device_t* dev);
+
+//--------------------------------------------------------------------+
+// Device Models
+//--------------------------------------------------------------------+
+
+//------------- Hub -------------//
+enum { SIM_HUB_PORT_MAX = 7 };
+
+typedef struct
+{
+  sim_device_t dev;
+
+  uint8_t port_count;
+  uint8_t reset_ms;             // port reset duration
+
+  struct
+  {
+    sim_device_t* child;
+    uint16_t status;
+    uint16_t change;
+    uint32_t reset_end_us;
+  } port[SIM_HUB_PORT_MAX+1];   // port 0 is not used
+} sim_hub_t;
+
+void sim_hub_init(sim_hub_t* hub, uint8_t port_count);
+void sim_hub_plug(sim_hub_t* hub, uint8_t port, sim_device_t* child);
+void sim_hub_unplug(sim_hub_t* hub, uint8_t port);
+
+//------------- MSC Bulk-Only with SCSI disk -------------//
+typedef struct
+{
+  sim_device_t dev;
+
+  uint8_t* image;               // disk image
+  uint32_t block_count;
+  uint16_t block_size;
+
+  uint8_t  stage;
+  uint8_t  cbw[31];
+  uint8_t  csw[13];
+  uint8_t  resp[36];            // response of non read/write command
+  uint8_t* data;
+  uint32_t data_len;
+  uint32_t data_xferred;
+  uint8_t  sense_key;
+} sim_msc_t;
+
+// image is used as it is, could be loaded with sim_msc_load_image()
+void sim_msc_init(sim_msc_t* msc, uint8_t speed, uint8_t* image, uint32_t block_count, uint16_t block_size);
+uint8_t* sim_msc_load_image(char const* path, uint32_t* size);
+
+//------------- CDC ACM or vendor serial adapter loopback -------------//
+typedef enum
+{
+  SIM_CDC_ACM = 0,
+  SIM_CDC_FTDI,                 // FT232R: 2 status bytes at the start of each IN packet
+  SIM_CDC_CP210X,
+  SIM_CDC_CH34X,
+} sim_cdc_type_t;
+
+typedef struct
+{
+  sim_device_t dev;
+
+  uint8_t  type;                // sim_cdc_type_t
+  uint8_t  ep_in;
+  uint8_t  ep_out;
+
+  uint8_t  line_coding[7];      // ACM only
+  uint16_t line_state;          // DTR & RTS bits as CDC
+
+  // vendor serial adapter: raw value as written by host
+  bool     uart_enabled;        // FTDI reset, CP210x IFC_ENABLE, CH34x serial init
+  uint32_t baudrate;            // CP210x baudrate, FTDI & CH34x divisor register
+  uint16_t data_format;         // line control register
+  uint64_t status_next_us;      // FTDI sends status only packet every latency timer period
+
+  uint8_t  fifo[4096];          // data received on OUT is sent back on IN
+  uint32_t wr_idx;
+  uint32_t rd_idx;
+} sim_cdc_t;
+
+void sim_cdc_init(sim_cdc_t* cdc, uint8_t speed, sim_cdc_type_t type);
+
+//------------- HID boot keyboard -------------//
+typedef struct
+{
+  sim_device_t dev;
+
+  uint8_t  protocol;
+  uint8_t  idle_rate;
+
+  uint8_t  report[16][8];       // reports queued by script, sent on interrupt IN
+  uint8_t  report_count;
+  uint8_t  report_rd;
+
+  uint32_t auto_interval_us;    // if not zero, generate a report every interval, report[1] is its sequence number
+  uint64_t auto_next_us;
+  uint32_t auto_seq;
+  uint8_t  auto_report[8];
+  bool     auto_pending;        // generated report is not sent yet
+  uint32_t auto_dropped;        // reports replaced by a newer one before host polls them
+
+  uint8_t  desc_config[34];     // bInterval is set by init
+} sim_hid_t;
+
+void sim_hid_init(sim_hid_t* hid, uint8_t speed, uint8_t interval_ms);
+bool sim_hid_push_report(sim_hid_t* hid, uint8_t const report[8]);
+
+//------------- MIDI loopback -------------//
+typedef struct
+{
+  sim_device_t dev;
+
+  uint8_t  fifo[1024];          // event packets received on OUT are sent back on IN
+  uint32_t wr_idx;
+  uint32_t rd_idx;
+
+  // Note On velocity is used as time stamp: millisecond (modulo 128) when it is written by host
+  uint32_t note_count;
+  uint32_t latency_sum_ms;
+  uint32_t latency_max_ms;
+  uint32_t arrival_ms[128];     // arrival time of each time stamp
+} sim_midi_t;
+
+void sim_midi_init(sim_midi_t* midi, uint8_t speed);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _HCD_SIM_H_ */
@@ -0,0 +1,365 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+
+#include "tusb.h"
+#include "device/usbd.h"
+#include "hcd_sim.h"
+
+//--------------------------------------------------------------------+
+// CDC model: ACM or vendor serial adapter with data received on OUT looped back to IN
+//--------------------------------------------------------------------+
+
+#include "class/cdc/serial/ftdi_sio.h"
+#include "class/cdc/serial/cp210x.h"
+#include "class/cdc/serial/ch34x.h"
+
+enum
+{
+  EP_NOTIF = 0x81,
+  EP_OUT   = 0x02,
+  EP_IN    = 0x82
+};
+
+// FTDI status sent on IN packets: modem status (CTS, DSR) & line status (THRE, TEMT)
+enum
+{
+  FTDI_MODEM_STATUS  = 0x31,
+  FTDI_LINE_STATUS   = 0x60,
+  FTDI_LATENCY_US    = 16000,
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+
+// IAD is used, device class is Misc
+static uint8_t const desc_device[] =
+{
+  18, TUSB_DESC_DEVICE, U16_TO_U8S_LE(0x0200), TUSB_CLASS_MISC, MISC_SUBCLASS_COMMON, MISC_PROTOCOL_IAD, 64,
+  U16_TO_U8S_LE(0xCAFE), U16_TO_U8S_LE(0x4002), U16_TO_U8S_LE(0x0100), 0, 0, 0, 1
+};
+
+static uint8_t const desc_config_fs[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, 2, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+  TUD_CDC_DESCRIPTOR(0, 0, EP_NOTIF, 8, EP_OUT, EP_IN, 64)
+};
+
+static uint8_t const desc_config_hs[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, 2, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+  TUD_CDC_DESCRIPTOR(0, 0, EP_NOTIF, 8, EP_OUT, EP_IN, 512)
+};
+
+//------------- Vendor serial adapters (full speed) -------------//
+#define VENDOR_DEVICE_DESC(_vid, _pid) \
+  18, TUSB_DESC_DEVICE, U16_TO_U8S_LE(0x0110), 0, 0, 0, 64, \
+  U16_TO_U8S_LE(_vid), U16_TO_U8S_LE(_pid), U16_TO_U8S_LE(0x0600), 0, 0, 0, 1
+
+#define VENDOR_CONFIG_DESC(_ep_count) \
+  TUD_CONFIG_DESCRIPTOR(1, 1, 0, TUD_CONFIG_DESC_LEN + 9 + (_ep_count)*7, 0x00, 90), \
+  9, TUSB_DESC_INTERFACE, 0, 0, _ep_count, TUSB_CLASS_VENDOR_SPECIFIC, 0xFF, 0xFF, 0
+
+#define VENDOR_BULK_EP(_addr) \
+  7, TUSB_DESC_ENDPOINT, _addr, TUSB_XFER_BULK, U16_TO_U8S_LE(64), 0
+
+static uint8_t const desc_device_ftdi  [] = { VENDOR_DEVICE_DESC(FTDI_VID  , 0x6001) };
+static uint8_t const desc_device_cp210x[] = { VENDOR_DEVICE_DESC(SILABS_VID, 0xEA60) };
+static uint8_t const desc_device_ch34x [] = { VENDOR_DEVICE_DESC(WCH_VID   , 0x7523) };
+
+static uint8_t const desc_config_ftdi[] =
+{
+  VENDOR_CONFIG_DESC(2),
+  VENDOR_BULK_EP(0x81),
+  VENDOR_BULK_EP(0x02)
+};
+
+static uint8_t const desc_config_cp210x[] =
+{
+  VENDOR_CONFIG_DESC(2),
+  VENDOR_BULK_EP(0x81),
+  VENDOR_BULK_EP(0x01)
+};
+
+// CH34x also has an interrupt endpoint for modem status
+static uint8_t const desc_config_ch34x[] =
+{
+  VENDOR_CONFIG_DESC(3),
+  VENDOR_BULK_EP(0x82),
+  VENDOR_BULK_EP(0x02),
+  7, TUSB_DESC_ENDPOINT, 0x81, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(8), 1
+};
+
+static void cdc_reset(sim_device_t* dev)
+{
+  sim_cdc_t* cdc = (sim_cdc_t*) dev;
+
+  cdc->line_state     = 0;
+  cdc->uart_enabled   = false;
+  cdc->status_next_us = 0;
+  cdc->wr_idx         = 0;
+  cdc->rd_idx         = 0;
+}
+
+static int32_t acm_control(sim_cdc_t* cdc, tusb_control_request_t const* request, uint8_t* data)
+{
+  if ( request->bmRequestType_bit.type != TUSB_REQ_TYPE_CLASS ) return 0;
+
+  switch ( request->bRequest )
+  {
+    case CDC_REQUEST_SET_LINE_CODING:
+      memcpy(cdc->line_coding, data, tu_min16(request->wLength, sizeof(cdc->line_coding)));
+      return 0;
+
+    case CDC_REQUEST_GET_LINE_CODING:
+    {
+      uint16_t const len = tu_min16(request->wLength, sizeof(cdc->line_coding));
+      memcpy(data, cdc->line_coding, len);
+      return len;
+    }
+
+    case CDC_REQUEST_SET_CONTROL_LINE_STATE:
+      cdc->line_state = request->wValue;
+      return 0;
+
+    default: return -1;
+  }
+}
+
+// bits of value are only changed if their mask (high byte) is set
+static uint16_t modem_ctrl_update(uint16_t line_state, uint16_t value)
+{
+  uint8_t const mask = (uint8_t) (value >> 8);
+  return (uint16_t) ((line_state & ~mask) | (value & mask & 0x03));
+}
+
+static int32_t ftdi_control(sim_cdc_t* cdc, tusb_control_request_t const* request, uint8_t* data)
+{
+  (void) data;
+  TU_VERIFY(request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR, -1);
+
+  switch ( request->bRequest )
+  {
+    case FTDI_SIO_RESET:
+      if ( request->wValue == FTDI_SIO_RESET_SIO ) cdc->uart_enabled = true;
+      return 0;
+
+    case FTDI_SIO_MODEM_CTRL:
+      cdc->line_state = modem_ctrl_update(cdc->line_state, request->wValue);
+      return 0;
+
+    case FTDI_SIO_SET_BAUD_RATE:
+      // single port chip: bit 16 of divisor is in wIndex
+      cdc->baudrate = (uint32_t) request->wValue | ((uint32_t) (request->wIndex & 0x01) << 16);
+      return 0;
+
+    case FTDI_SIO_SET_DATA:
+      cdc->data_format = request->wValue;
+      return 0;
+
+    default: return -1;
+  }
+}
+
+static int32_t cp210x_control(sim_cdc_t* cdc, tusb_control_request_t const* request, uint8_t* data)
+{
+  TU_VERIFY(request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR &&
+            request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_INTERFACE, -1);
+
+  switch ( request->bRequest )
+  {
+    case CP210X_IFC_ENABLE:
+      cdc->uart_enabled = (request->wValue == CP210X_UART_ENABLE);
+      return 0;
+
+    case CP210X_SET_MHS:
+      cdc->line_state = modem_ctrl_update(cdc->line_state, request->wValue);
+      return 0;
+
+    case CP210X_SET_BAUDRATE:
+      TU_VERIFY(request->wLength == 4, -1);
+      cdc->baudrate = tu_le32toh(tu_unaligned_read32(data));
+      return 0;
+
+    case CP210X_SET_LINE_CTL:
+      cdc->data_format = request->wValue;
+      return 0;
+
+    default: return -1;
+  }
+}
+
+static int32_t ch34x_control(sim_cdc_t* cdc, tusb_control_request_t const* request, uint8_t* data)
+{
+  TU_VERIFY(request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR, -1);
+
+  switch ( request->bRequest )
+  {
+    case CH34X_REQ_READ_VERSION:
+      data[0] = 0x31;
+      data[1] = 0x00;
+      return tu_min16(request->wLength, 2);
+
+    case CH34X_REQ_SERIAL_INIT:
+      cdc->uart_enabled = true;
+      return 0;
+
+    case CH34X_REQ_MODEM_CTRL:
+    {
+      // bits are active low
+      uint16_t const control = (uint16_t) ~request->wValue;
+      cdc->line_state = (uint16_t) (((control & CH34X_BIT_DTR) ? CDC_CONTROL_LINE_STATE_DTR : 0) |
+                                    ((control & CH34X_BIT_RTS) ? CDC_CONTROL_LINE_STATE_RTS : 0));
+      return 0;
+    }
+
+    case CH34X_REQ_WRITE_REG:
+      switch ( request->wValue )
+      {
+        case (CH34X_REG_DIVISOR << 8) | CH34X_REG_PRESCALER: cdc->baudrate    = request->wIndex; return 0;
+        case (CH34X_REG_LCR2    << 8) | CH34X_REG_LCR      : cdc->data_format = request->wIndex; return 0;
+        default: return -1;
+      }
+
+    default: return -1;
+  }
+}
+
+static int32_t cdc_control(sim_device_t* dev, tusb_control_request_t const* request, uint8_t* data)
+{
+  sim_cdc_t* cdc = (sim_cdc_t*) dev;
+
+  switch ( cdc->type )
+  {
+    case SIM_CDC_FTDI  : return ftdi_control(cdc, request, data);
+    case SIM_CDC_CP210X: return cp210x_control(cdc, request, data);
+    case SIM_CDC_CH34X : return ch34x_control(cdc, request, data);
+    default            : return acm_control(cdc, request, data);
+  }
+}
+
+static int32_t cdc_xfer(sim_device_t* dev, uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  sim_cdc_t* cdc = (sim_cdc_t*) dev;
+  uint32_t const depth = sizeof(cdc->fifo);
+  uint32_t const count = cdc->wr_idx - cdc->rd_idx;
+
+  if ( ep_addr == cdc->ep_out )
+  {
+    // NAK until there is room for the whole packet
+    if ( depth - count < len ) return -1;
+
+    for(uint16_t i=0; i<len; i++) cdc->fifo[(cdc->wr_idx++) % depth] = buf[i];
+    return len;
+  }
+
+  if ( ep_addr == cdc->ep_in )
+  {
+    uint16_t status_len = 0;
+
+    if ( cdc->type == SIM_CDC_FTDI )
+    {
+      // status only packet is sent when latency timer expires
+      if ( count == 0 && hcd_sim_time_us() < cdc->status_next_us ) return -1;
+
+      buf[0] = FTDI_MODEM_STATUS;
+      buf[1] = FTDI_LINE_STATUS;
+      status_len = FTDI_STATUS_BYTES;
+      cdc->status_next_us = hcd_sim_time_us() + FTDI_LATENCY_US;
+    }
+    else if ( count == 0 )
+    {
+      return -1;
+    }
+
+    uint16_t const n = (uint16_t) tu_min32(len - status_len, count);
+    for(uint16_t i=0; i<n; i++) buf[status_len + i] = cdc->fifo[(cdc->rd_idx++) % depth];
+    return status_len + n;
+  }
+
+  // no notification
+  return -1;
+}
+
+static sim_driver_t const sim_cdc_driver =
+{
+  .name    = "CDC",
+  .reset   = cdc_reset,
+  .control = cdc_control,
+  .xfer    = cdc_xfer,
+  .sof     = NULL
+};
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void sim_cdc_init(sim_cdc_t* cdc, uint8_t speed, sim_cdc_type_t type)
+{
+  tu_memclr(cdc, sizeof(sim_cdc_t));
+
+  cdc->dev.driver = &sim_cdc_driver;
+  cdc->dev.speed  = speed;
+  cdc->type       = (uint8_t) type;
+
+  switch ( type )
+  {
+    case SIM_CDC_FTDI:
+      cdc->dev.desc_device = desc_device_ftdi;
+      cdc->dev.desc_config = desc_config_ftdi;
+      cdc->ep_in           = 0x81;
+      cdc->ep_out          = 0x02;
+    break;
+
+    case SIM_CDC_CP210X:
+      cdc->dev.desc_device = desc_device_cp210x;
+      cdc->dev.desc_config = desc_config_cp210x;
+      cdc->ep_in           = 0x81;
+      cdc->ep_out          = 0x01;
+    break;
+
+    case SIM_CDC_CH34X:
+      cdc->dev.desc_device = desc_device_ch34x;
+      cdc->dev.desc_config = desc_config_ch34x;
+      cdc->ep_in           = 0x82;
+      cdc->ep_out          = 0x02;
+    break;
+
+    default:
+      cdc->dev.desc_device = desc_device;
+      cdc->dev.desc_config = (speed == TUSB_SPEED_HIGH) ? desc_config_hs : desc_config_fs;
+      cdc->ep_in           = EP_IN;
+      cdc->ep_out          = EP_OUT;
+    break;
+  }
+
+  // vendor serial adapters are full speed only
+  if ( type != SIM_CDC_ACM ) cdc->dev.speed = TUSB_SPEED_FULL;
+
+  // 115200 8N1
+  uint8_t const line_coding[7] = { U32_TO_U8S_LE(115200), 0, 0, 8 };
+  memcpy(cdc->line_coding, line_coding, sizeof(line_coding));
+}
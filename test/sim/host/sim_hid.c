@@ -0,0 +1,209 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+
+#include "tusb.h"
+#include "device/usbd.h"
+#include "class/hid/hid_device.h"
+#include "hcd_sim.h"
+
+//--------------------------------------------------------------------+
+// HID model: boot keyboard, reports are queued by script or generated periodically
+//--------------------------------------------------------------------+
+
+enum
+{
+  EP_IN = 0x81
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN)
+
+static uint8_t const desc_device[] =
+{
+  18, TUSB_DESC_DEVICE, U16_TO_U8S_LE(0x0200), 0, 0, 0, 64,
+  U16_TO_U8S_LE(0xCAFE), U16_TO_U8S_LE(0x4004), U16_TO_U8S_LE(0x0100), 0, 0, 0, 1
+};
+
+static uint8_t const desc_report[] =
+{
+  TUD_HID_REPORT_DESC_KEYBOARD()
+};
+
+// bInterval is patched by init
+static uint8_t const desc_config[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, 1, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+  TUD_HID_DESCRIPTOR(0, 0, HID_ITF_PROTOCOL_KEYBOARD, sizeof(desc_report), EP_IN, 8, 10)
+};
+
+TU_VERIFY_STATIC(sizeof(desc_config) == sizeof(((sim_hid_t*) 0)->desc_config), "desc_config size mismatch");
+
+static void hid_reset(sim_device_t* dev)
+{
+  sim_hid_t* hid = (sim_hid_t*) dev;
+
+  hid->protocol     = HID_PROTOCOL_REPORT;
+  hid->idle_rate    = 0;
+  hid->report_count = 0;
+  hid->report_rd    = 0;
+  hid->auto_pending = false;
+  hid->auto_next_us = 0;
+}
+
+static int32_t hid_control(sim_device_t* dev, tusb_control_request_t const* request, uint8_t* data)
+{
+  sim_hid_t* hid = (sim_hid_t*) dev;
+
+  // Report descriptor is a standard request with interface recipient
+  if ( request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD )
+  {
+    if ( request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_INTERFACE &&
+         request->bRequest == TUSB_REQ_GET_DESCRIPTOR &&
+         tu_u16_high(request->wValue) == HID_DESC_TYPE_REPORT )
+    {
+      uint16_t const len = tu_min16(request->wLength, sizeof(desc_report));
+      memcpy(data, desc_report, len);
+      return len;
+    }
+
+    return 0;
+  }
+
+  TU_VERIFY(request->bmRequestType_bit.type == TUSB_REQ_TYPE_CLASS, -1);
+
+  switch ( request->bRequest )
+  {
+    case HID_REQ_CONTROL_SET_IDLE:
+      hid->idle_rate = tu_u16_high(request->wValue);
+      return 0;
+
+    case HID_REQ_CONTROL_GET_IDLE:
+      data[0] = hid->idle_rate;
+      return 1;
+
+    case HID_REQ_CONTROL_SET_PROTOCOL:
+      hid->protocol = (uint8_t) request->wValue;
+      return 0;
+
+    case HID_REQ_CONTROL_GET_PROTOCOL:
+      data[0] = hid->protocol;
+      return 1;
+
+    // LED output report is accepted and ignored
+    case HID_REQ_CONTROL_SET_REPORT:
+      return 0;
+
+    default: return -1;
+  }
+}
+
+static int32_t hid_xfer(sim_device_t* dev, uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  sim_hid_t* hid = (sim_hid_t*) dev;
+  TU_VERIFY(ep_addr == EP_IN, -1);
+
+  uint16_t const count = tu_min16(len, 8);
+
+  if ( hid->report_count )
+  {
+    memcpy(buf, hid->report[hid->report_rd], count);
+    hid->report_rd = (uint8_t) ((hid->report_rd + 1) % TU_ARRAY_SIZE(hid->report));
+    hid->report_count--;
+    return count;
+  }
+
+  if ( hid->auto_pending )
+  {
+    memcpy(buf, hid->auto_report, count);
+    hid->auto_pending = false;
+    return count;
+  }
+
+  return -1;
+}
+
+// Generate report on time regardless of host polling, the latest one is sent as a real device does
+static void hid_sof(sim_device_t* dev, uint32_t frame_us)
+{
+  (void) frame_us;
+  sim_hid_t* hid = (sim_hid_t*) dev;
+
+  if ( !(hid->auto_interval_us && dev->config_num && hcd_sim_time_us() >= hid->auto_next_us) ) return;
+
+  if ( hid->auto_pending ) hid->auto_dropped++;
+
+  // alternate key press and release of 'a' to 'z'
+  tu_memclr(hid->auto_report, sizeof(hid->auto_report));
+  hid->auto_report[1] = (uint8_t) hid->auto_seq;
+  if ( (hid->auto_seq & 1) == 0 ) hid->auto_report[2] = (uint8_t) (HID_KEY_A + (hid->auto_seq/2) % 26);
+
+  hid->auto_seq++;
+  hid->auto_pending = true;
+
+  // next report is scheduled from the previous one, not from now, to keep a fixed rate
+  hid->auto_next_us = (hid->auto_next_us ? hid->auto_next_us : hcd_sim_time_us()) + hid->auto_interval_us;
+}
+
+static sim_driver_t const sim_hid_driver =
+{
+  .name    = "HID",
+  .reset   = hid_reset,
+  .control = hid_control,
+  .xfer    = hid_xfer,
+  .sof     = hid_sof
+};
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void sim_hid_init(sim_hid_t* hid, uint8_t speed, uint8_t interval_ms)
+{
+  tu_memclr(hid, sizeof(sim_hid_t));
+
+  // bInterval is the last byte of endpoint descriptor
+  memcpy(hid->desc_config, desc_config, sizeof(desc_config));
+  hid->desc_config[sizeof(desc_config)-1] = interval_ms;
+
+  hid->dev.driver      = &sim_hid_driver;
+  hid->dev.speed       = speed;
+  hid->dev.desc_device = desc_device;
+  hid->dev.desc_config = hid->desc_config;
+
+  hid->protocol = HID_PROTOCOL_REPORT;
+}
+
+bool sim_hid_push_report(sim_hid_t* hid, uint8_t const report[8])
+{
+  TU_VERIFY(hid->report_count < TU_ARRAY_SIZE(hid->report));
+
+  uint8_t const wr_idx = (uint8_t) ((hid->report_rd + hid->report_count) % TU_ARRAY_SIZE(hid->report));
+  memcpy(hid->report[wr_idx], report, 8);
+  hid->report_count++;
+
+  return true;
+}
@@ -0,0 +1,285 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+
+#include "tusb.h"
+#include "host/hub.h"
+#include "hcd_sim.h"
+
+//--------------------------------------------------------------------+
+// Hub model: single TT full speed hub with up to 7 ports
+//--------------------------------------------------------------------+
+
+enum
+{
+  PORT_STATUS_CONNECTION = TU_BIT(0),
+  PORT_STATUS_ENABLE     = TU_BIT(1),
+  PORT_STATUS_RESET      = TU_BIT(4),
+  PORT_STATUS_POWER      = TU_BIT(8),
+  PORT_STATUS_LOW_SPEED  = TU_BIT(9),
+  PORT_STATUS_HIGH_SPEED = TU_BIT(10),
+};
+
+enum
+{
+  PORT_CHANGE_CONNECTION = TU_BIT(0),
+  PORT_CHANGE_ENABLE     = TU_BIT(1),
+  PORT_CHANGE_RESET      = TU_BIT(4),
+};
+
+static uint8_t const desc_device[] =
+{
+  18, TUSB_DESC_DEVICE, U16_TO_U8S_LE(0x0200), TUSB_CLASS_HUB, 0, 0, 64,
+  U16_TO_U8S_LE(0xCAFE), U16_TO_U8S_LE(0x4100), U16_TO_U8S_LE(0x0100), 0, 0, 0, 1
+};
+
+static uint8_t const desc_config[] =
+{
+  9, TUSB_DESC_CONFIGURATION, U16_TO_U8S_LE(25), 1, 1, 0, 0xE0, 50,
+  9, TUSB_DESC_INTERFACE, 0, 0, 1, TUSB_CLASS_HUB, 0, 0, 0,
+  7, TUSB_DESC_ENDPOINT, 0x81, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(1), 12
+};
+
+static void hub_port_disconnect(sim_hub_t* hub, uint8_t port)
+{
+  sim_device_t* child = hub->port[port].child;
+  if ( child ) child->enabled = false;
+
+  hub->port[port].status &= (uint16_t) ~(PORT_STATUS_CONNECTION | PORT_STATUS_ENABLE | PORT_STATUS_RESET);
+  hub->port[port].reset_end_us = 0;
+}
+
+static void hub_reset(sim_device_t* dev)
+{
+  sim_hub_t* hub = (sim_hub_t*) dev;
+
+  // all ports are powered off
+  for(uint8_t p=1; p <= hub->port_count; p++)
+  {
+    hub_port_disconnect(hub, p);
+    hub->port[p].status = 0;
+    hub->port[p].change = 0;
+  }
+}
+
+static int32_t hub_control(sim_device_t* dev, tusb_control_request_t const* request, uint8_t* data)
+{
+  sim_hub_t* hub = (sim_hub_t*) dev;
+
+  TU_VERIFY(request->bmRequestType_bit.type == TUSB_REQ_TYPE_CLASS, -1);
+
+  // hub request
+  if ( request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_DEVICE )
+  {
+    switch ( request->bRequest )
+    {
+      case HUB_REQUEST_GET_DESCRIPTOR:
+      {
+        descriptor_hub_desc_t const desc_hub =
+        {
+          .bLength             = sizeof(descriptor_hub_desc_t),
+          .bDescriptorType     = 0x29,
+          .bNbrPorts           = hub->port_count,
+          .wHubCharacteristics = 0,
+          .bPwrOn2PwrGood      = 50,
+          .bHubContrCurrent    = 0,
+          .DeviceRemovable     = 0,
+          .PortPwrCtrlMask     = 0xff
+        };
+
+        uint16_t const len = tu_min16(request->wLength, sizeof(desc_hub));
+        memcpy(data, &desc_hub, len);
+        return len;
+      }
+
+      case HUB_REQUEST_GET_STATUS:
+        memset(data, 0, 4);
+        return 4;
+
+      default: return 0;
+    }
+  }
+
+  uint8_t const port = (uint8_t) request->wIndex;
+  TU_VERIFY(port >= 1 && port <= hub->port_count, -1);
+
+  switch ( request->bRequest )
+  {
+    case HUB_REQUEST_GET_STATUS:
+      memcpy(data    , &hub->port[port].status, 2);
+      memcpy(data + 2, &hub->port[port].change, 2);
+      return 4;
+
+    case HUB_REQUEST_SET_FEATURE:
+      switch ( request->wValue )
+      {
+        case HUB_FEATURE_PORT_POWER:
+          hub->port[port].status |= PORT_STATUS_POWER;
+          if ( hub->port[port].child )
+          {
+            hub->port[port].status |= PORT_STATUS_CONNECTION;
+            hub->port[port].change |= PORT_CHANGE_CONNECTION;
+          }
+        break;
+
+        case HUB_FEATURE_PORT_RESET:
+          if ( hub->port[port].status & PORT_STATUS_CONNECTION )
+          {
+            if ( hub->port[port].child ) hub->port[port].child->enabled = false;
+
+            hub->port[port].status &= (uint16_t) ~PORT_STATUS_ENABLE;
+            hub->port[port].status |= PORT_STATUS_RESET;
+            hub->port[port].reset_end_us = (uint32_t) hcd_sim_time_us() + hub->reset_ms*1000u;
+          }
+        break;
+
+        default: break;
+      }
+      return 0;
+
+    case HUB_REQUEST_CLEAR_FEATURE:
+      switch ( request->wValue )
+      {
+        case HUB_FEATURE_PORT_ENABLE:
+          if ( hub->port[port].child ) hub->port[port].child->enabled = false;
+          hub->port[port].status &= (uint16_t) ~PORT_STATUS_ENABLE;
+        break;
+
+        case HUB_FEATURE_PORT_POWER:
+          hub_port_disconnect(hub, port);
+          hub->port[port].status &= (uint16_t) ~PORT_STATUS_POWER;
+        break;
+
+        case HUB_FEATURE_PORT_CONNECTION_CHANGE: hub->port[port].change &= (uint16_t) ~PORT_CHANGE_CONNECTION; break;
+        case HUB_FEATURE_PORT_ENABLE_CHANGE    : hub->port[port].change &= (uint16_t) ~PORT_CHANGE_ENABLE    ; break;
+        case HUB_FEATURE_PORT_RESET_CHANGE     : hub->port[port].change &= (uint16_t) ~PORT_CHANGE_RESET     ; break;
+
+        default: break;
+      }
+      return 0;
+
+    default: return -1;
+  }
+}
+
+// Status change endpoint: bitmap of ports with change, NAK if none
+static int32_t hub_xfer(sim_device_t* dev, uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  sim_hub_t* hub = (sim_hub_t*) dev;
+  TU_VERIFY(ep_addr == 0x81 && len, -1);
+
+  uint8_t bitmap = 0;
+  for(uint8_t p=1; p <= hub->port_count; p++)
+  {
+    if ( hub->port[p].change ) bitmap |= TU_BIT(p);
+  }
+
+  if ( !bitmap ) return -1;
+
+  buf[0] = bitmap;
+  return 1;
+}
+
+static void hub_sof(sim_device_t* dev, uint32_t frame_us)
+{
+  (void) frame_us;
+  sim_hub_t* hub = (sim_hub_t*) dev;
+
+  for(uint8_t p=1; p <= hub->port_count; p++)
+  {
+    if ( hub->port[p].reset_end_us && hcd_sim_time_us() >= hub->port[p].reset_end_us )
+    {
+      sim_device_t* child = hub->port[p].child;
+
+      hub->port[p].reset_end_us = 0;
+      hub->port[p].status &= (uint16_t) ~(PORT_STATUS_RESET | PORT_STATUS_LOW_SPEED | PORT_STATUS_HIGH_SPEED);
+      hub->port[p].status |= PORT_STATUS_ENABLE;
+      hub->port[p].change |= PORT_CHANGE_RESET;
+
+      if ( child->speed == TUSB_SPEED_LOW  ) hub->port[p].status |= PORT_STATUS_LOW_SPEED;
+      if ( child->speed == TUSB_SPEED_HIGH ) hub->port[p].status |= PORT_STATUS_HIGH_SPEED;
+
+      hcd_sim_device_reset(child);
+    }
+  }
+}
+
+sim_driver_t const sim_hub_driver =
+{
+  .name    = "Hub",
+  .reset   = hub_reset,
+  .control = hub_control,
+  .xfer    = hub_xfer,
+  .sof     = hub_sof
+};
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void sim_hub_init(sim_hub_t* hub, uint8_t port_count)
+{
+  tu_memclr(hub, sizeof(sim_hub_t));
+
+  hub->dev.driver      = &sim_hub_driver;
+  hub->dev.speed       = TUSB_SPEED_FULL;
+  hub->dev.desc_device = desc_device;
+  hub->dev.desc_config = desc_config;
+
+  hub->port_count = tu_min8(port_count, SIM_HUB_PORT_MAX);
+  hub->reset_ms   = 10;
+}
+
+void sim_hub_plug(sim_hub_t* hub, uint8_t port, sim_device_t* child)
+{
+  TU_VERIFY(port >= 1 && port <= hub->port_count, );
+
+  child->parent  = &hub->dev;
+  child->port    = port;
+  child->enabled = false;
+
+  hub->port[port].child = child;
+
+  if ( hub->port[port].status & PORT_STATUS_POWER )
+  {
+    hub->port[port].status |= PORT_STATUS_CONNECTION;
+    hub->port[port].change |= PORT_CHANGE_CONNECTION;
+  }
+}
+
+void sim_hub_unplug(sim_hub_t* hub, uint8_t port)
+{
+  TU_VERIFY(port >= 1 && port <= hub->port_count && hub->port[port].child, );
+
+  hub_port_disconnect(hub, port);
+  hub->port[port].child = NULL;
+
+  if ( hub->port[port].status & PORT_STATUS_POWER )
+  {
+    hub->port[port].change |= PORT_CHANGE_CONNECTION;
+  }
+}
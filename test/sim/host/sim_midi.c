@@ -0,0 +1,133 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+
+#include "tusb.h"
+#include "device/usbd.h"
+#include "hcd_sim.h"
+
+//--------------------------------------------------------------------+
+// MIDI model: one cable, event packets received on OUT are looped back to IN.
+// Latency of Note On is measured with its velocity as time stamp
+//--------------------------------------------------------------------+
+
+enum
+{
+  EP_OUT = 0x03,
+  EP_IN  = 0x83
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_MIDI_DESC_LEN)
+
+static uint8_t const desc_device[] =
+{
+  18, TUSB_DESC_DEVICE, U16_TO_U8S_LE(0x0200), 0, 0, 0, 64,
+  U16_TO_U8S_LE(0xCAFE), U16_TO_U8S_LE(0x4008), U16_TO_U8S_LE(0x0100), 0, 0, 0, 1
+};
+
+static uint8_t const desc_config_fs[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, 2, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+  TUD_MIDI_DESCRIPTOR(0, 0, EP_OUT, EP_IN, 64)
+};
+
+static uint8_t const desc_config_hs[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, 2, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+  TUD_MIDI_DESCRIPTOR(0, 0, EP_OUT, EP_IN, 512)
+};
+
+static void midi_reset(sim_device_t* dev)
+{
+  sim_midi_t* midi = (sim_midi_t*) dev;
+
+  midi->wr_idx = 0;
+  midi->rd_idx = 0;
+}
+
+static int32_t midi_xfer(sim_device_t* dev, uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  sim_midi_t* midi = (sim_midi_t*) dev;
+  uint32_t const depth = sizeof(midi->fifo);
+  uint32_t const count = midi->wr_idx - midi->rd_idx;
+
+  if ( ep_addr == EP_OUT )
+  {
+    // NAK until there is room for the whole packet
+    if ( depth - count < len ) return -1;
+
+    for(uint16_t i=0; i<len; i++) midi->fifo[(midi->wr_idx++) % depth] = buf[i];
+
+    // latency of time stamped Note On
+    uint32_t const now_ms = (uint32_t) (hcd_sim_time_us() / 1000);
+    for(uint16_t i=0; i+4 <= len; i += 4)
+    {
+      if ( (buf[i] & 0x0f) != MIDI_CIN_NOTE_ON ) continue;
+
+      uint8_t  const stamp   = buf[i+3] & 0x7f;
+      uint32_t const latency = (now_ms - stamp) & 0x7f;
+
+      midi->note_count++;
+      midi->latency_sum_ms += latency;
+      midi->latency_max_ms  = tu_max32(midi->latency_max_ms, latency);
+      midi->arrival_ms[stamp] = now_ms;
+    }
+
+    return len;
+  }
+
+  TU_VERIFY(ep_addr == EP_IN && count, -1);
+
+  // only complete 4-byte event packets
+  uint16_t const n = (uint16_t) (tu_min32(len, count) & ~3u);
+  for(uint16_t i=0; i<n; i++) buf[i] = midi->fifo[(midi->rd_idx++) % depth];
+
+  return n;
+}
+
+static sim_driver_t const sim_midi_driver =
+{
+  .name    = "MIDI",
+  .reset   = midi_reset,
+  .control = NULL,
+  .xfer    = midi_xfer,
+  .sof     = NULL
+};
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void sim_midi_init(sim_midi_t* midi, uint8_t speed)
+{
+  tu_memclr(midi, sizeof(sim_midi_t));
+
+  midi->dev.driver      = &sim_midi_driver;
+  midi->dev.speed       = speed;
+  midi->dev.desc_device = desc_device;
+  midi->dev.desc_config = (speed == TUSB_SPEED_HIGH) ? desc_config_hs : desc_config_fs;
+}
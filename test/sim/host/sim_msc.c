@@ -0,0 +1,326 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "device/usbd.h"
+#include "hcd_sim.h"
+
+//--------------------------------------------------------------------+
+// MSC model: Bulk-Only Transport with a SCSI direct access disk
+//--------------------------------------------------------------------+
+
+enum
+{
+  EP_OUT = 0x01,
+  EP_IN  = 0x81
+};
+
+enum
+{
+  STAGE_CMD = 0,
+  STAGE_DATA_IN,
+  STAGE_DATA_OUT,
+  STAGE_STATUS
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_MSC_DESC_LEN)
+
+static uint8_t const desc_device[] =
+{
+  18, TUSB_DESC_DEVICE, U16_TO_U8S_LE(0x0200), 0, 0, 0, 64,
+  U16_TO_U8S_LE(0xCAFE), U16_TO_U8S_LE(0x4001), U16_TO_U8S_LE(0x0100), 0, 0, 0, 1
+};
+
+static uint8_t const desc_config_fs[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, 1, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+  TUD_MSC_DESCRIPTOR(0, 0, EP_OUT, EP_IN, 64)
+};
+
+static uint8_t const desc_config_hs[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, 1, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+  TUD_MSC_DESCRIPTOR(0, 0, EP_OUT, EP_IN, 512)
+};
+
+static void msc_reset(sim_device_t* dev)
+{
+  sim_msc_t* msc = (sim_msc_t*) dev;
+  msc->stage = STAGE_CMD;
+}
+
+static int32_t msc_control(sim_device_t* dev, tusb_control_request_t const* request, uint8_t* data)
+{
+  sim_msc_t* msc = (sim_msc_t*) dev;
+
+  if ( request->bmRequestType_bit.type != TUSB_REQ_TYPE_CLASS ) return 0;
+
+  switch ( request->bRequest )
+  {
+    case MSC_REQ_GET_MAX_LUN:
+      data[0] = 0;
+      return 1;
+
+    case MSC_REQ_RESET:
+      msc->stage = STAGE_CMD;
+      return 0;
+
+    default: return -1;
+  }
+}
+
+// Parse CBW and prepare data stage, return CSW status
+static uint8_t scsi_command(sim_msc_t* msc, msc_cbw_t const* cbw)
+{
+  uint8_t const* cmd = cbw->command;
+
+  msc->data     = msc->resp;
+  msc->data_len = 0;
+
+  switch ( cmd[0] )
+  {
+    case SCSI_CMD_TEST_UNIT_READY:
+    break;
+
+    case SCSI_CMD_INQUIRY:
+    {
+      scsi_inquiry_resp_t* resp = (scsi_inquiry_resp_t*) msc->resp;
+      tu_memclr(resp, sizeof(scsi_inquiry_resp_t));
+
+      resp->is_removable         = 1;
+      resp->version              = 2;
+      resp->response_data_format = 2;
+      resp->additional_length    = sizeof(scsi_inquiry_resp_t) - 5;
+      memcpy(resp->vendor_id  , "TinyUSB ", 8);
+      memcpy(resp->product_id , "Simulated Disk  ", 16);
+      memcpy(resp->product_rev, "1.0 ", 4);
+
+      msc->data_len = sizeof(scsi_inquiry_resp_t);
+    }
+    break;
+
+    case SCSI_CMD_REQUEST_SENSE:
+    {
+      scsi_sense_fixed_resp_t resp;
+      tu_memclr(&resp, sizeof(resp));
+
+      resp.response_code = 0x70;
+      resp.valid         = 1;
+      resp.sense_key     = msc->sense_key;
+      resp.add_sense_len = sizeof(resp) - 8;
+
+      memcpy(msc->resp, &resp, sizeof(resp));
+      msc->data_len = sizeof(resp);
+      msc->sense_key = SCSI_SENSE_NONE;
+    }
+    break;
+
+    case SCSI_CMD_MODE_SENSE_6:
+      memset(msc->resp, 0, 4);
+      msc->resp[0] = 3;
+      msc->data_len = 4;
+    break;
+
+    case SCSI_CMD_READ_CAPACITY_10:
+    {
+      scsi_read_capacity10_resp_t const resp =
+      {
+        .last_lba   = tu_htonl(msc->block_count - 1),
+        .block_size = tu_htonl(msc->block_size)
+      };
+
+      memcpy(msc->resp, &resp, sizeof(resp));
+      msc->data_len = sizeof(resp);
+    }
+    break;
+
+    case SCSI_CMD_READ_10:
+    case SCSI_CMD_WRITE_10:
+    {
+      scsi_read10_t rw;
+      memcpy(&rw, cmd, sizeof(rw));
+
+      uint32_t const lba         = tu_ntohl(rw.lba);
+      uint16_t const block_count = tu_ntohs(rw.block_count);
+
+      if ( (uint64_t) lba + block_count > msc->block_count )
+      {
+        msc->sense_key = SCSI_SENSE_ILLEGAL_REQUEST;
+        return MSC_CSW_STATUS_FAILED;
+      }
+
+      msc->data     = msc->image + lba*msc->block_size;
+      msc->data_len = block_count*msc->block_size;
+    }
+    break;
+
+    default:
+      msc->sense_key = SCSI_SENSE_ILLEGAL_REQUEST;
+      return MSC_CSW_STATUS_FAILED;
+  }
+
+  return MSC_CSW_STATUS_PASSED;
+}
+
+static void prepare_csw(sim_msc_t* msc, msc_cbw_t const* cbw, uint8_t status)
+{
+  msc_csw_t const csw =
+  {
+    .signature    = MSC_CSW_SIGNATURE,
+    .tag          = cbw->tag,
+    .data_residue = cbw->total_bytes - msc->data_xferred,
+    .status       = status
+  };
+
+  memcpy(msc->csw, &csw, sizeof(csw));
+  msc->stage = STAGE_STATUS;
+}
+
+static int32_t msc_xfer(sim_device_t* dev, uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  sim_msc_t* msc = (sim_msc_t*) dev;
+
+  msc_cbw_t cbw;
+  memcpy(&cbw, msc->cbw, sizeof(cbw));
+
+  if ( ep_addr == EP_OUT )
+  {
+    switch ( msc->stage )
+    {
+      case STAGE_CMD:
+      {
+        // invalid CBW is ignored
+        if ( len != sizeof(msc_cbw_t) ) return len;
+
+        memcpy(msc->cbw, buf, sizeof(msc_cbw_t));
+        memcpy(&cbw, buf, sizeof(cbw));
+        TU_VERIFY(cbw.signature == MSC_CBW_SIGNATURE, len);
+
+        msc->data_xferred = 0;
+        uint8_t const status = scsi_command(msc, &cbw);
+
+        // data length is limited by host expected length
+        msc->data_len = tu_min32(msc->data_len, cbw.total_bytes);
+
+        if ( status != MSC_CSW_STATUS_PASSED || cbw.total_bytes == 0 )
+        {
+          prepare_csw(msc, &cbw, status);
+        }else
+        {
+          msc->stage = (cbw.dir & TUSB_DIR_IN_MASK) ? STAGE_DATA_IN : STAGE_DATA_OUT;
+        }
+      }
+      return len;
+
+      case STAGE_DATA_OUT:
+      {
+        uint16_t const count = (uint16_t) tu_min32(len, msc->data_len - msc->data_xferred);
+        memcpy(msc->data + msc->data_xferred, buf, count);
+        msc->data_xferred += count;
+
+        if ( msc->data_xferred == msc->data_len ) prepare_csw(msc, &cbw, MSC_CSW_STATUS_PASSED);
+      }
+      return len;
+
+      default: return -1;
+    }
+  }
+
+  switch ( msc->stage )
+  {
+    case STAGE_DATA_IN:
+    {
+      uint16_t const count = (uint16_t) tu_min32(len, msc->data_len - msc->data_xferred);
+      memcpy(buf, msc->data + msc->data_xferred, count);
+      msc->data_xferred += count;
+
+      // last packet, short packet also ends data stage
+      if ( msc->data_xferred == msc->data_len ) prepare_csw(msc, &cbw, MSC_CSW_STATUS_PASSED);
+
+      return count;
+    }
+
+    case STAGE_STATUS:
+      memcpy(buf, msc->csw, sizeof(msc_csw_t));
+      msc->stage = STAGE_CMD;
+      return sizeof(msc_csw_t);
+
+    default: return -1;
+  }
+}
+
+static sim_driver_t const sim_msc_driver =
+{
+  .name    = "MSC",
+  .reset   = msc_reset,
+  .control = msc_control,
+  .xfer    = msc_xfer,
+  .sof     = NULL
+};
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void sim_msc_init(sim_msc_t* msc, uint8_t speed, uint8_t* image, uint32_t block_count, uint16_t block_size)
+{
+  tu_memclr(msc, sizeof(sim_msc_t));
+
+  msc->dev.driver      = &sim_msc_driver;
+  msc->dev.speed       = speed;
+  msc->dev.desc_device = desc_device;
+  msc->dev.desc_config = (speed == TUSB_SPEED_HIGH) ? desc_config_hs : desc_config_fs;
+
+  msc->image       = image;
+  msc->block_count = block_count;
+  msc->block_size  = block_size;
+}
+
+uint8_t* sim_msc_load_image(char const* path, uint32_t* size)
+{
+  FILE* file = fopen(path, "rb");
+  if ( file == NULL ) return NULL;
+
+  fseek(file, 0, SEEK_END);
+  long const file_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  uint8_t* image = (file_size > 0) ? malloc((size_t) file_size) : NULL;
+
+  if ( image && fread(image, 1, (size_t) file_size, file) != (size_t) file_size )
+  {
+    free(image);
+    image = NULL;
+  }
+  fclose(file);
+
+  if ( image ) *size = (uint32_t) file_size;
+  return image;
+}
@@ -0,0 +1,475 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "device/usbd_pvt.h"
+#include "nrf.h"
+#include "sim_test.h"
+#include "nrf5x_model.h"
+
+//--------------------------------------------------------------------+
+// nRF5x device driver EasyDMA arbitration against the controller model:
+// - Composite bulk: several OUT and IN endpoints, packets of different endpoints complete within
+//   the same interrupt and contend for EasyDMA
+// - Isochronous OUT/IN and control reads under the same bulk load
+// DMA started while EasyDMA is busy (conflict) and starts deferred to usbd task are counted, data
+// and missed isochronous packets are checked, throughput and OUT packet wait for DMA are reported.
+// Completed transfers are queued again by the task in place of usbd.
+//--------------------------------------------------------------------+
+
+#define RUN_FRAMES   500
+#define XFER_BYTES   2048
+#define ISR_BITS     240    // 20 us interrupt latency e.g. radio events of a SoftDevice
+#define TASK_BITS    1200   // usbd task runs every 100 us on a busy device
+
+static uint32_t _iso_skipped;
+
+static inline uint8_t pattern(uint8_t ep_addr, uint32_t offset)
+{
+  return (uint8_t) (offset*3u + ep_addr);
+}
+
+//--------------------------------------------------------------------+
+// Events and deferred functions, in place of usbd
+//--------------------------------------------------------------------+
+
+static struct
+{
+  dcd_event_t queue[64];
+  uint32_t count;
+
+  struct
+  {
+    osal_task_func_t func;
+    void* param;
+  } defer[64];
+  uint32_t defer_count;
+  uint32_t defer_total;
+} _ev;
+
+bool tud_inited(void)
+{
+  return true;
+}
+
+void dcd_event_handler(dcd_event_t const * event, bool in_isr)
+{
+  (void) in_isr;
+  if ( _ev.count >= TU_ARRAY_SIZE(_ev.queue) )
+  {
+    printf("event queue overflow\n");
+    exit(1);
+  }
+  _ev.queue[_ev.count++] = *event;
+}
+
+void dcd_event_bus_signal (uint8_t rhport, dcd_eventid_t eid, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = eid };
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_bus_reset (uint8_t rhport, tusb_speed_t speed, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_BUS_RESET };
+  event.bus_reset.speed = speed;
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_setup_received(uint8_t rhport, uint8_t const * setup, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_SETUP_RECEIVED };
+  memcpy(&event.setup_received, setup, 8);
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_xfer_complete (uint8_t rhport, uint8_t ep_addr, uint32_t xferred_bytes, uint8_t result, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_XFER_COMPLETE };
+  event.xfer_complete.ep_addr = ep_addr;
+  event.xfer_complete.len     = xferred_bytes;
+  event.xfer_complete.result  = result;
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_sof(uint8_t rhport, uint32_t frame_count, bool microframe, bool in_isr)
+{
+  (void) rhport;
+  (void) frame_count;
+  (void) microframe;
+  (void) in_isr;
+}
+
+void usbd_defer_func(osal_task_func_t func, void* param, bool in_isr)
+{
+  (void) in_isr;
+  if ( _ev.defer_count >= TU_ARRAY_SIZE(_ev.defer) )
+  {
+    printf("defer queue overflow\n");
+    exit(1);
+  }
+  _ev.defer[_ev.defer_count].func  = func;
+  _ev.defer[_ev.defer_count].param = param;
+  _ev.defer_count++;
+  _ev.defer_total++;
+}
+
+//--------------------------------------------------------------------+
+// Streams: device transfers are queued again once complete, host transfers too
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint8_t  ep_addr;
+  uint16_t mps;
+  bool     enabled;
+
+  // device side
+  uint32_t dev_len;
+  uint32_t dev_offset;
+  uint32_t dev_bytes;
+  uint32_t dev_xfers;
+  uint8_t  dev_buf[XFER_BYTES];
+
+  // host side
+  uint32_t host_len;
+  uint32_t host_offset;
+  uint8_t  host_buf[XFER_BYTES];
+} stream_t;
+
+// EasyDMA pointers are 32 bit: buffers are static
+static stream_t _stream[8];
+static uint8_t  _stream_count;
+
+static struct
+{
+  bool     enabled;
+  uint8_t  desc[256];
+  uint8_t  host_buf[256];
+  uint32_t count;
+} _ctrl;
+
+static uint8_t const _ctrl_setup[8] = { 0x80, TUSB_REQ_GET_DESCRIPTOR, 0, TUSB_DESC_CONFIGURATION, 0, 0, 200, 0 };
+
+static void dev_submit(stream_t* s)
+{
+  if ( tu_edpt_dir(s->ep_addr) )
+  {
+    for ( uint32_t i = 0; i < s->dev_len; i++ ) s->dev_buf[i] = pattern(s->ep_addr, s->dev_offset + i);
+  }
+  else
+  {
+    memset(s->dev_buf, 0, s->dev_len);
+  }
+
+  CHECK(dcd_edpt_xfer(0, s->ep_addr, s->dev_buf, (uint16_t) s->dev_len));
+}
+
+static void host_submit(stream_t* s)
+{
+  if ( !tu_edpt_dir(s->ep_addr) )
+  {
+    for ( uint32_t i = 0; i < s->host_len; i++ ) s->host_buf[i] = pattern(s->ep_addr, s->host_offset + i);
+  }
+
+  nrf5x_model_host_xfer(s->ep_addr, s->mps, s->host_buf, s->host_len);
+}
+
+// Host side completion: next transfer is queued right away
+static void host_complete(uint8_t ep_addr, uint32_t len)
+{
+  if ( ep_addr == TUSB_DIR_IN_MASK )
+  {
+    if ( len != _ctrl_setup[6] || memcmp(_ctrl.host_buf, _ctrl.desc, len) ) _errors++;
+    _ctrl.count++;
+    nrf5x_model_control(_ctrl_setup, _ctrl.host_buf);
+    return;
+  }
+
+  for ( uint8_t i = 0; i < _stream_count; i++ )
+  {
+    stream_t* s = &_stream[i];
+    if ( !s->enabled || s->ep_addr != ep_addr ) continue;
+
+    if ( tu_edpt_dir(s->ep_addr) )
+    {
+      // An isochronous IN packet reported sent one frame early, at the SOF its DMA ended after
+      // (both handled by one late interrupt), is overwritten by the next one: count it
+      if ( tu_edpt_number(s->ep_addr) == 8 && len && s->host_buf[0] != pattern(s->ep_addr, s->host_offset) &&
+           s->host_buf[0] == pattern(s->ep_addr, s->host_offset + len) )
+      {
+        _iso_skipped++;
+        s->host_offset += len;
+      }
+
+      for ( uint32_t n = 0; n < len; n++ )
+      {
+        if ( s->host_buf[n] != pattern(s->ep_addr, s->host_offset + n) ) { _errors++; break; }
+      }
+    }
+    s->host_offset += len;
+
+    host_submit(s);
+  }
+}
+
+static void dev_complete(stream_t* s, uint32_t len)
+{
+  if ( !tu_edpt_dir(s->ep_addr) )
+  {
+    for ( uint32_t n = 0; n < len; n++ )
+    {
+      if ( s->dev_buf[n] != pattern(s->ep_addr, s->dev_offset + n) ) { _errors++; break; }
+    }
+  }
+
+  s->dev_offset += len;
+  s->dev_bytes  += len;
+  s->dev_xfers++;
+
+  dev_submit(s);
+}
+
+static void task(void)
+{
+  // deferred functions first, as usbd queues them with events
+  uint32_t const defer_count = _ev.defer_count;
+  _ev.defer_count = 0;
+  for ( uint32_t i = 0; i < defer_count; i++ ) _ev.defer[i].func(_ev.defer[i].param);
+
+  uint32_t const count = _ev.count;
+  dcd_event_t queue[TU_ARRAY_SIZE(_ev.queue)];
+  memcpy(queue, _ev.queue, count*sizeof(dcd_event_t));
+  _ev.count = 0;
+
+  for ( uint32_t i = 0; i < count; i++ )
+  {
+    dcd_event_t const* ev = &queue[i];
+
+    if ( ev->event_id == DCD_EVENT_SETUP_RECEIVED )
+    {
+      tusb_control_request_t const* request = &ev->setup_received;
+      CHECK(dcd_edpt_xfer(0, TUSB_DIR_IN_MASK, _ctrl.desc, request->wLength));
+      continue;
+    }
+
+    if ( ev->event_id != DCD_EVENT_XFER_COMPLETE ) continue;
+
+    CHECK(ev->xfer_complete.result == XFER_RESULT_SUCCESS);
+    uint8_t const ep_addr = ev->xfer_complete.ep_addr;
+
+    if ( ep_addr == TUSB_DIR_IN_MASK )
+    {
+      // control data stage complete: status
+      CHECK(dcd_edpt_xfer(0, 0x00, NULL, 0));
+      continue;
+    }
+    if ( ep_addr == 0x00 ) continue;
+
+    for ( uint8_t s = 0; s < _stream_count; s++ )
+    {
+      if ( _stream[s].enabled && _stream[s].ep_addr == ep_addr ) dev_complete(&_stream[s], ev->xfer_complete.len);
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// Setup
+//--------------------------------------------------------------------+
+
+static bool edpt_open(uint8_t ep_addr, uint8_t xfer_type, uint16_t size)
+{
+  tusb_desc_endpoint_t const desc =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep_addr,
+    .bmAttributes     = { .xfer = xfer_type },
+    .wMaxPacketSize   = tu_htole16(size),
+    .bInterval        = 1
+  };
+
+  return dcd_edpt_open(0, &desc);
+}
+
+static void setup(void)
+{
+  tu_memclr(&_ev, sizeof(_ev));
+  tu_memclr(_stream, sizeof(_stream));
+  tu_memclr(&_ctrl, sizeof(_ctrl));
+  _stream_count = 0;
+  _iso_skipped  = 0;
+
+  for ( uint32_t i = 0; i < sizeof(_ctrl.desc); i++ ) _ctrl.desc[i] = (uint8_t) (0xC0 + i);
+
+  nrf5x_model_init(task, ISR_BITS, TASK_BITS);
+  nrf5x_model_host_callback(host_complete);
+  dcd_init(0);
+
+  // as USB power ready event does
+  NRF_USBD->INTENSET = USBD_INTEN_USBRESET_Msk;
+  dcd_int_enable(0);
+
+  nrf5x_model_bus_reset();
+  _ev.count = 0;
+}
+
+static stream_t* stream_add(uint8_t ep_addr, uint8_t xfer_type, uint16_t mps, uint32_t dev_len, uint32_t host_len)
+{
+  if ( !edpt_open(ep_addr, xfer_type, mps) )
+  {
+    printf("open %02x failed\n", ep_addr);
+    exit(1);
+  }
+
+  stream_t* s = &_stream[_stream_count++];
+  s->ep_addr  = ep_addr;
+  s->mps      = mps;
+  s->enabled  = true;
+  s->dev_len  = dev_len;
+  s->host_len = host_len;
+  return s;
+}
+
+static void run(uint32_t frames)
+{
+  for ( uint8_t i = 0; i < _stream_count; i++ )
+  {
+    dev_submit(&_stream[i]);
+    host_submit(&_stream[i]);
+  }
+
+  if ( _ctrl.enabled ) nrf5x_model_control(_ctrl_setup, _ctrl.host_buf);
+
+  for ( uint32_t f = 0; f < frames; f++ ) nrf5x_model_frame();
+}
+
+// frames run by the model, a thread waiting for DMA keeps it going
+static uint32_t kbps(uint32_t bytes)
+{
+  return (uint32_t) ((uint64_t) bytes * 1000u / nrf5x_model_stat()->frames / 1024u);
+}
+
+static void report(void)
+{
+  nrf5x_model_stat_t const* stat = nrf5x_model_stat();
+  printf("  bus %u%% used, %u%% NAK, %u interrupts, %u DMA, %u deferred to task, %u DMA conflicts\n",
+         (unsigned) (stat->busy_bits * 100u / ((uint64_t) stat->frames * MODEL_FRAME_BITS)),
+         (unsigned) (stat->nak_bits * 100u / ((uint64_t) stat->frames * MODEL_FRAME_BITS)),
+         (unsigned) stat->irq_count, (unsigned) stat->dma_count, (unsigned) _ev.defer_total,
+         (unsigned) stat->dma_conflicts);
+
+  uint32_t out_dma = 0;
+  for ( uint8_t i = 0; i < _stream_count; i++ )
+  {
+    if ( !tu_edpt_dir(_stream[i].ep_addr) && tu_edpt_number(_stream[i].ep_addr) != 8 ) out_dma += _stream[i].dev_bytes / _stream[i].mps;
+  }
+  if ( out_dma )
+  {
+    printf("  OUT packet wait for DMA: avg %u, max %u bit times\n",
+           (unsigned) (stat->out_wait_bits / out_dma), (unsigned) stat->out_wait_max_bits);
+  }
+}
+
+static uint32_t total_bytes(void)
+{
+  uint32_t bytes = 0;
+  for ( uint8_t i = 0; i < _stream_count; i++ ) bytes += _stream[i].dev_bytes;
+  return bytes;
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+static void test_composite(void)
+{
+  printf("composite: bulk OUT 1 and IN 4, interrupt OUT 2, 3 and IN 5, 6 of 16 and 8 bytes\n");
+  setup();
+
+  stream_add(0x01, TUSB_XFER_BULK, 64, XFER_BYTES, XFER_BYTES);
+  stream_add(0x02, TUSB_XFER_INTERRUPT, 16, 256, 256);
+  stream_add(0x03, TUSB_XFER_INTERRUPT, 8, 256, 256);
+  stream_add(0x84, TUSB_XFER_BULK, 64, XFER_BYTES, XFER_BYTES);
+  stream_add(0x85, TUSB_XFER_INTERRUPT, 16, 256, 256);
+  stream_add(0x86, TUSB_XFER_INTERRUPT, 8, 256, 256);
+  run(RUN_FRAMES);
+
+  printf("  %u KB/s\n", (unsigned) kbps(total_bytes()));
+  report();
+
+  nrf5x_model_stat_t const* stat = nrf5x_model_stat();
+  for ( uint8_t i = 0; i < _stream_count; i++ ) CHECK(_stream[i].dev_xfers > 10);
+  CHECK(stat->dma_conflicts == 0);
+  CHECK(_ev.defer_total == 0);
+
+  // DMA is started by the interrupt handler ending the previous one, not by the task
+  CHECK(stat->out_wait_max_bits < TASK_BITS);
+}
+
+static void test_iso_control(void)
+{
+  printf("isochronous OUT + IN 192 bytes and control reads with bulk OUT 1, 2 and IN 3\n");
+  setup();
+
+  stream_add(0x08, TUSB_XFER_ISOCHRONOUS, 192, 192, 192);
+  stream_add(0x88, TUSB_XFER_ISOCHRONOUS, 192, 192, 192);
+  stream_add(0x01, TUSB_XFER_BULK, 64, XFER_BYTES, XFER_BYTES);
+  stream_add(0x02, TUSB_XFER_BULK, 64, XFER_BYTES, XFER_BYTES);
+  stream_add(0x83, TUSB_XFER_BULK, 64, XFER_BYTES, XFER_BYTES);
+  _ctrl.enabled = true;
+  run(RUN_FRAMES);
+
+  nrf5x_model_stat_t const* stat = nrf5x_model_stat();
+  printf("  iso out %u KB/s, iso in %u KB/s, bulk %u KB/s\n", (unsigned) kbps(_stream[0].dev_bytes),
+         (unsigned) kbps(_stream[1].dev_bytes),
+         (unsigned) kbps(_stream[2].dev_bytes + _stream[3].dev_bytes + _stream[4].dev_bytes));
+  printf("  %u control reads, setup to status: avg %u, max %u bit times, %u iso missed, %u iso in skipped\n", (unsigned) _ctrl.count,
+         (unsigned) (stat->ctrl_count ? stat->ctrl_bits / stat->ctrl_count : 0), (unsigned) stat->ctrl_max_bits,
+         (unsigned) stat->iso_missed, (unsigned) _iso_skipped);
+  report();
+
+  CHECK(_stream[0].dev_xfers > RUN_FRAMES - 10);
+  CHECK(_stream[1].dev_xfers > RUN_FRAMES - 10);
+  CHECK(_ctrl.count > 10);
+  CHECK(stat->iso_missed == 0);
+  CHECK(_iso_skipped == 0);
+  CHECK(stat->dma_conflicts == 0);
+  CHECK(_ev.defer_total == 0);
+}
+
+int main(void)
+{
+  test_composite();
+  test_iso_control();
+
+  return sim_result();
+}
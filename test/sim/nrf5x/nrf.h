@@ -0,0 +1,202 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _NRF_H_
+#define _NRF_H_
+
+//--------------------------------------------------------------------+
+// Stand-in of nRF MDK and CMSIS headers needed by the nrf5x port, USBD registers are memory
+// of the controller model (nrf5x_model.c). Layout follows nRF52840: STARTEPIN[8], EPIN[8],
+// STARTEPOUT[8] and EPOUT[8] are the isochronous ones as the driver uses them.
+//--------------------------------------------------------------------+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+  USBD_IRQn = 39
+} IRQn_Type;
+
+typedef struct
+{
+  volatile uint32_t PTR;
+  volatile uint32_t MAXCNT;
+  volatile uint32_t AMOUNT;
+  volatile uint32_t RESERVED[2];
+} USBD_EP_Type;
+
+typedef struct
+{
+  volatile uint32_t EPOUT[8];
+  volatile uint32_t ISOOUT;
+} USBD_SIZE_Type;
+
+typedef struct
+{
+  union
+  {
+    volatile uint32_t TASKS_STARTEPIN[9];
+    struct { volatile uint32_t RESERVED0[8]; volatile uint32_t TASKS_STARTISOIN; };
+  };
+  union
+  {
+    volatile uint32_t TASKS_STARTEPOUT[9];
+    struct { volatile uint32_t RESERVED1[8]; volatile uint32_t TASKS_STARTISOOUT; };
+  };
+  volatile uint32_t TASKS_EP0RCVOUT;
+  volatile uint32_t TASKS_EP0STATUS;
+  volatile uint32_t TASKS_EP0STALL;
+  volatile uint32_t TASKS_DPDMDRIVE;
+  volatile uint32_t TASKS_DPDMNODRIVE;
+
+  // Events in order of their INTEN bit
+  volatile uint32_t EVENTS_USBRESET;
+  volatile uint32_t EVENTS_STARTED;
+  volatile uint32_t EVENTS_ENDEPIN[8];
+  volatile uint32_t EVENTS_EP0DATADONE;
+  volatile uint32_t EVENTS_ENDISOIN;
+  volatile uint32_t EVENTS_ENDEPOUT[8];
+  volatile uint32_t EVENTS_ENDISOOUT;
+  volatile uint32_t EVENTS_SOF;
+  volatile uint32_t EVENTS_USBEVENT;
+  volatile uint32_t EVENTS_EP0SETUP;
+  volatile uint32_t EVENTS_EPDATA;
+
+  volatile uint32_t INTEN;
+  volatile uint32_t INTENSET;
+  volatile uint32_t INTENCLR;
+  volatile uint32_t EVENTCAUSE;
+  volatile uint32_t EPSTATUS;
+  volatile uint32_t EPDATASTATUS;
+  volatile uint32_t USBADDR;
+  volatile uint32_t BMREQUESTTYPE;
+  volatile uint32_t BREQUEST;
+  volatile uint32_t WVALUEL;
+  volatile uint32_t WVALUEH;
+  volatile uint32_t WINDEXL;
+  volatile uint32_t WINDEXH;
+  volatile uint32_t WLENGTHL;
+  volatile uint32_t WLENGTHH;
+  USBD_SIZE_Type    SIZE;
+  volatile uint32_t ENABLE;
+  volatile uint32_t USBPULLUP;
+  volatile uint32_t DPDMVALUE;
+  volatile uint32_t DTOGGLE;
+  volatile uint32_t EPINEN;
+  volatile uint32_t EPOUTEN;
+  volatile uint32_t EPSTALL;
+  volatile uint32_t ISOSPLIT;
+  volatile uint32_t FRAMECNTR;
+  volatile uint32_t LOWPOWER;
+  volatile uint32_t ISOINCONFIG;
+  union
+  {
+    USBD_EP_Type EPIN[9];
+    struct { USBD_EP_Type RESERVED2[8]; USBD_EP_Type ISOIN; };
+  };
+  union
+  {
+    USBD_EP_Type EPOUT[9];
+    struct { USBD_EP_Type RESERVED3[8]; USBD_EP_Type ISOOUT; };
+  };
+} NRF_USBD_Type;
+
+extern NRF_USBD_Type nrf5x_model_usbd;
+#define NRF_USBD        (&nrf5x_model_usbd)
+#define NRF_USBD_BASE   ((uintptr_t) NRF_USBD)
+
+#define USBD_INTEN_USBRESET_Msk        (1UL << 0)
+#define USBD_INTEN_ENDEPIN0_Pos        2
+#define USBD_INTEN_ENDEPIN0_Msk        (1UL << USBD_INTEN_ENDEPIN0_Pos)
+#define USBD_INTEN_EP0DATADONE_Msk     (1UL << 10)
+#define USBD_INTEN_ENDISOIN_Msk        (1UL << 11)
+#define USBD_INTEN_ENDEPOUT0_Pos       12
+#define USBD_INTEN_ENDEPOUT0_Msk       (1UL << USBD_INTEN_ENDEPOUT0_Pos)
+#define USBD_INTEN_ENDISOOUT_Msk       (1UL << 20)
+#define USBD_INTEN_SOF_Msk             (1UL << 21)
+#define USBD_INTEN_USBEVENT_Msk        (1UL << 22)
+#define USBD_INTEN_EP0SETUP_Msk        (1UL << 23)
+#define USBD_INTEN_EPDATA_Pos          24
+#define USBD_INTEN_EPDATA_Msk          (1UL << USBD_INTEN_EPDATA_Pos)
+
+#define USBD_INTENSET_ENDISOIN_Msk     USBD_INTEN_ENDISOIN_Msk
+#define USBD_INTENSET_ENDISOOUT_Msk    USBD_INTEN_ENDISOOUT_Msk
+#define USBD_INTENSET_SOF_Msk          USBD_INTEN_SOF_Msk
+#define USBD_INTENCLR_ENDISOIN_Msk     USBD_INTEN_ENDISOIN_Msk
+#define USBD_INTENCLR_ENDISOOUT_Msk    USBD_INTEN_ENDISOOUT_Msk
+#define USBD_INTENCLR_SOF_Msk          USBD_INTEN_SOF_Msk
+
+#define USBD_EVENTCAUSE_SUSPEND_Msk       (1UL << 8)
+#define USBD_EVENTCAUSE_RESUME_Msk        (1UL << 9)
+#define USBD_EVENTCAUSE_USBWUALLOWED_Msk  (1UL << 10)
+#define USBD_EVENTCAUSE_READY_Msk         (1UL << 11)
+
+#define USBD_SIZE_ISOOUT_ZERO_Msk      (1UL << 16)
+
+#define USBD_DPDMVALUE_STATE_Resume    1UL
+#define USBD_DTOGGLE_VALUE_Pos         8
+#define USBD_DTOGGLE_VALUE_Data0       1UL
+#define USBD_EPSTALL_STALL_Pos         8
+#define USBD_EPSTALL_STALL_UnStall     0UL
+#define USBD_EPSTALL_STALL_Stall       1UL
+#define USBD_EPINEN_ISOIN_Msk          (1UL << 8)
+#define USBD_EPOUTEN_ISOOUT_Msk        (1UL << 8)
+#define USBD_ISOSPLIT_SPLIT_OneDir     0x0000UL
+#define USBD_ISOSPLIT_SPLIT_HalfIN     0x0080UL
+
+//--------------------------------------------------------------------+
+// CMSIS: exception state and NVIC are the model's
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  volatile uint32_t ICSR;
+} SCB_Type;
+
+extern SCB_Type nrf5x_model_scb;
+#define SCB                        (&nrf5x_model_scb)
+#define SCB_ICSR_VECTACTIVE_Msk    0x1FFUL
+
+// Data barrier lets the model apply register writes (tasks, INTENSET/INTENCLR)
+void nrf5x_model_apply(void);
+
+static inline void __ISB(void) { __asm__ volatile ("" ::: "memory"); }
+static inline void __DSB(void) { nrf5x_model_apply(); }
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+
+// Enabling the interrupt lets the model run a pending handler, as the core takes it right away
+void nrf5x_model_irq_enable(bool enable);
+bool nrf5x_model_irq_enabled(void);
+
+static inline void NVIC_EnableIRQ(IRQn_Type IRQn)       { (void) IRQn; nrf5x_model_irq_enable(true); }
+static inline void NVIC_DisableIRQ(IRQn_Type IRQn)      { (void) IRQn; nrf5x_model_irq_enable(false); }
+static inline void NVIC_ClearPendingIRQ(IRQn_Type IRQn) { (void) IRQn; }
+static inline uint32_t NVIC_GetEnableIRQ(IRQn_Type IRQn) { (void) IRQn; return nrf5x_model_irq_enabled() ? 1 : 0; }
+#define NVIC_GetEnableIRQ NVIC_GetEnableIRQ
+
+#endif /* _NRF_H_ */
@@ -0,0 +1,861 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nrf.h"
+#include "device/dcd.h"
+#include "nrf5x_model.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM
+//--------------------------------------------------------------------+
+
+enum
+{
+  SOF_BITS     = 40,
+  XACT_BITS    = 80,     // token, handshake and gaps of a data transaction
+  NAK_BITS     = 70,
+  EOF_BITS     = 100,    // no transaction is started in the last bit times of a frame
+  ISO_EP       = 8,
+  EP_BUF_SIZE  = 64,
+  ISO_BUF_SIZE = 1023,
+  EVENT_COUNT  = USBD_INTEN_EPDATA_Pos + 1
+};
+
+enum
+{
+  CTRL_SETUP = 0,
+  CTRL_DATA,
+  CTRL_STATUS
+};
+
+#define TIME_NONE  UINT64_MAX
+
+// EPSTALL is a write only command register: it reads all ones once the command is applied
+#define EPSTALL_NONE  UINT32_MAX
+
+NRF_USBD_Type nrf5x_model_usbd;
+SCB_Type nrf5x_model_scb;
+
+typedef struct
+{
+  uint8_t* buf;
+  uint32_t len;
+  uint32_t xferred;
+  uint16_t mps;
+  bool     active;
+  bool     stalled;
+} host_xfer_t;
+
+// Endpoint buffer between bus and EasyDMA
+typedef struct
+{
+  uint8_t  data[EP_BUF_SIZE];
+  uint16_t len;
+  bool     full;
+  uint64_t since;     // OUT: time packet was received
+} ep_buf_t;
+
+static struct
+{
+  uint64_t now;
+  uint32_t isr_bits;
+  uint32_t task_bits;
+  nrf5x_model_task_t    task_cb;
+  nrf5x_model_host_cb_t host_cb;
+
+  bool     irq_enabled;
+  bool     in_isr;
+  bool     in_task;
+  uint64_t irq_due;
+  uint64_t task_due;
+  uint64_t enable_time;     // last interrupt enable in thread mode
+  uint64_t frame_end;
+
+  // EasyDMA task running and its end
+  volatile uint32_t* dma_task;
+  uint64_t dma_end;
+
+  ep_buf_t epin[8];
+  ep_buf_t epout[8];
+
+  // Isochronous OUT: packet received in this frame, packet of previous frame given to DMA
+  uint8_t  iso_out_rx[ISO_BUF_SIZE];
+  int32_t  iso_out_rx_len;        // -1 if none
+  uint8_t  iso_out_ready[ISO_BUF_SIZE];
+  uint16_t iso_out_ready_len;
+  bool     iso_out_pending;
+
+  // Isochronous IN: packet moved by DMA for next frame, packet sent in this frame
+  uint8_t  iso_in_next[ISO_BUF_SIZE];
+  uint16_t iso_in_next_len;
+  bool     iso_in_loaded;
+  uint8_t  iso_in_cur[ISO_BUF_SIZE];
+  uint16_t iso_in_cur_len;
+  bool     iso_in_valid;
+  bool     iso_in_started;
+
+  host_xfer_t host[9][2];
+  uint8_t rr;
+  bool    ep_stall[8][2];
+
+  struct
+  {
+    bool     active;
+    uint8_t  stage;
+    uint8_t  setup[8];
+    uint8_t* buf;
+    uint16_t len;
+    uint16_t xferred;
+    uint64_t start;
+    bool     status_armed;
+    bool     stall;         // EP0STALL task: data or status stage is stalled until next setup
+    bool     stalled;
+  } ctrl;
+
+  nrf5x_model_stat_t stat;
+} _model;
+
+static inline uint64_t min64(uint64_t x, uint64_t y)
+{
+  return (x < y) ? x : y;
+}
+
+static inline uint8_t* dma_ptr(uint32_t ptr)
+{
+  return (uint8_t*) (uintptr_t) ptr;
+}
+
+//--------------------------------------------------------------------+
+// Interrupt
+//--------------------------------------------------------------------+
+
+static bool irq_pending(void)
+{
+  volatile uint32_t const* evt = &NRF_USBD->EVENTS_USBRESET;
+  for ( uint8_t i = 0; i < EVENT_COUNT; i++ )
+  {
+    if ( tu_bit_test(NRF_USBD->INTEN, i) && evt[i] ) return true;
+  }
+  return false;
+}
+
+static void schedule_irq(void)
+{
+  if ( _model.irq_due == TIME_NONE && irq_pending() ) _model.irq_due = _model.now + _model.isr_bits;
+}
+
+static void raise(volatile uint32_t* evt)
+{
+  *evt = 1;
+  schedule_irq();
+}
+
+//--------------------------------------------------------------------+
+// Tasks and EasyDMA
+//--------------------------------------------------------------------+
+
+static void dma_start(volatile uint32_t* task)
+{
+  if ( !(*task) ) return;
+  *task = 0;
+
+  if ( _model.dma_task )
+  {
+    _model.stat.dma_conflicts++;
+    return;
+  }
+
+  NRF_USBD_Type* const usbd = NRF_USBD;
+  uint32_t len = 0;
+
+  for ( uint8_t n = 0; n < 9; n++ )
+  {
+    if ( task == &usbd->TASKS_STARTEPIN[n] )
+    {
+      len = usbd->EPIN[n].MAXCNT;
+    }
+    else if ( task == &usbd->TASKS_STARTEPOUT[n] )
+    {
+      if ( n == ISO_EP )
+      {
+        len = tu_min32(usbd->ISOOUT.MAXCNT, _model.iso_out_ready_len);
+      }
+      else
+      {
+        ep_buf_t* ep = &_model.epout[n];
+        len = tu_min32(usbd->EPOUT[n].MAXCNT, ep->len);
+
+        uint32_t const wait = (uint32_t) (_model.now - ep->since);
+        _model.stat.out_wait_bits += wait;
+        _model.stat.out_wait_max_bits = tu_max32(_model.stat.out_wait_max_bits, wait);
+      }
+    }
+  }
+
+  _model.dma_task = task;
+  _model.dma_end  = _model.now + 2 + len/8;
+  _model.stat.dma_count++;
+}
+
+static void dma_complete(void)
+{
+  NRF_USBD_Type* const usbd = NRF_USBD;
+  volatile uint32_t* task = _model.dma_task;
+  _model.dma_task = NULL;
+
+  for ( uint8_t n = 0; n < 9; n++ )
+  {
+    if ( task == &usbd->TASKS_STARTEPIN[n] )
+    {
+      USBD_EP_Type* ep = &usbd->EPIN[n];
+      if ( n == ISO_EP )
+      {
+        uint16_t const len = (uint16_t) tu_min32(ep->MAXCNT, ISO_BUF_SIZE);
+        memcpy(_model.iso_in_next, dma_ptr(ep->PTR), len);
+        _model.iso_in_next_len = len;
+        _model.iso_in_loaded   = true;
+        ep->AMOUNT = len;
+        raise(&usbd->EVENTS_ENDISOIN);
+      }
+      else
+      {
+        uint16_t const len = (uint16_t) tu_min32(ep->MAXCNT, EP_BUF_SIZE);
+        if ( len ) memcpy(_model.epin[n].data, dma_ptr(ep->PTR), len);
+        _model.epin[n].len  = len;
+        _model.epin[n].full = true;
+        ep->AMOUNT = len;
+        raise(&usbd->EVENTS_ENDEPIN[n]);
+      }
+    }
+    else if ( task == &usbd->TASKS_STARTEPOUT[n] )
+    {
+      USBD_EP_Type* ep = &usbd->EPOUT[n];
+      if ( n == ISO_EP )
+      {
+        uint16_t const len = (uint16_t) tu_min32(ep->MAXCNT, _model.iso_out_ready_len);
+        memcpy(dma_ptr(ep->PTR), _model.iso_out_ready, len);
+        _model.iso_out_pending = false;
+        ep->AMOUNT = len;
+        raise(&usbd->EVENTS_ENDISOOUT);
+      }
+      else
+      {
+        // endpoint buffer is empty, next packet is accepted
+        uint16_t const len = (uint16_t) tu_min32(ep->MAXCNT, _model.epout[n].len);
+        memcpy(dma_ptr(ep->PTR), _model.epout[n].data, len);
+        _model.epout[n].full = false;
+        ep->AMOUNT = len;
+        raise(&usbd->EVENTS_ENDEPOUT[n]);
+      }
+    }
+  }
+}
+
+static void apply(void)
+{
+  NRF_USBD_Type* const usbd = NRF_USBD;
+
+  if ( usbd->INTENCLR )
+  {
+    usbd->INTEN &= ~usbd->INTENCLR;
+    usbd->INTENCLR = 0;
+  }
+  if ( usbd->INTENSET )
+  {
+    usbd->INTEN |= usbd->INTENSET;
+    usbd->INTENSET = 0;
+  }
+
+  // Control tasks need EasyDMA to be available without moving data
+  if ( usbd->TASKS_EP0STATUS )
+  {
+    usbd->TASKS_EP0STATUS = 0;
+    if ( _model.dma_task ) _model.stat.dma_conflicts++;
+    _model.ctrl.status_armed = true;
+  }
+  if ( usbd->TASKS_EP0RCVOUT )
+  {
+    usbd->TASKS_EP0RCVOUT = 0;
+    if ( _model.dma_task ) _model.stat.dma_conflicts++;
+  }
+  if ( usbd->TASKS_EP0STALL )
+  {
+    usbd->TASKS_EP0STALL = 0;
+    if ( _model.ctrl.active && _model.ctrl.stage != CTRL_SETUP ) _model.ctrl.stall = true;
+  }
+  if ( usbd->EPSTALL != EPSTALL_NONE )
+  {
+    uint8_t const ep_addr = usbd->EPSTALL & 0x87;
+    _model.ep_stall[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = tu_bit_test(usbd->EPSTALL, USBD_EPSTALL_STALL_Pos);
+    usbd->EPSTALL = EPSTALL_NONE;
+  }
+  usbd->TASKS_DPDMDRIVE   = 0;
+  usbd->TASKS_DPDMNODRIVE = 0;
+
+  for ( uint8_t n = 0; n < 9; n++ )
+  {
+    dma_start(&usbd->TASKS_STARTEPIN[n]);
+    dma_start(&usbd->TASKS_STARTEPOUT[n]);
+  }
+
+  schedule_irq();
+}
+
+static void run_isr(void)
+{
+  _model.irq_due = TIME_NONE;
+  if ( !irq_pending() ) return;
+
+  NRF_USBD_Type* const usbd = NRF_USBD;
+  bool const data_evt = usbd->EVENTS_EPDATA || usbd->EVENTS_EP0DATADONE;
+
+  _model.in_isr = true;
+  SCB->ICSR = 16 + USBD_IRQn;
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  dcd_int_handler(0);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  SCB->ICSR = 0;
+  _model.in_isr = false;
+  _model.stat.irq_count++;
+  _model.stat.isr_ns += (uint64_t) (t1.tv_sec - t0.tv_sec)*1000000000u + (uint64_t) (t1.tv_nsec - t0.tv_nsec);
+
+  // handler writes back EPDATASTATUS it has read
+  if ( data_evt && !usbd->EVENTS_EPDATA && !usbd->EVENTS_EP0DATADONE ) usbd->EPDATASTATUS = 0;
+
+  apply();
+}
+
+// CPU side at current time: register writes, DMA end then interrupt handler
+static void service(void)
+{
+  apply();
+  if ( _model.dma_task && _model.dma_end <= _model.now ) dma_complete();
+  if ( _model.irq_enabled && !_model.in_isr && _model.irq_due <= _model.now ) run_isr();
+}
+
+// Bus time goes on: DMA end and interrupt handler are run when due
+static void advance(uint32_t bits)
+{
+  uint64_t const target = _model.now + bits;
+
+  for(;;)
+  {
+    service();
+    if ( _model.now >= target ) break;
+
+    uint64_t next = target;
+    if ( _model.dma_task ) next = min64(next, _model.dma_end);
+    if ( _model.irq_enabled && !_model.in_isr ) next = min64(next, _model.irq_due);
+
+    if ( next > _model.now ) _model.now = next;
+  }
+}
+
+//--------------------------------------------------------------------+
+// Bus
+//--------------------------------------------------------------------+
+
+static void host_done(uint8_t ep_addr, host_xfer_t* xfer)
+{
+  xfer->active = false;
+  if ( _model.host_cb ) _model.host_cb(ep_addr, xfer->xferred);
+}
+
+static void nak(void)
+{
+  _model.stat.nak_xact++;
+  _model.stat.nak_bits  += NAK_BITS;
+  _model.stat.busy_bits += NAK_BITS;
+  advance(NAK_BITS);
+}
+
+// STALL handshake ends host transfer
+static void stall(uint8_t ep_addr, host_xfer_t* xfer)
+{
+  _model.stat.busy_bits += NAK_BITS;
+  advance(NAK_BITS);
+
+  xfer->stalled = true;
+  host_done(ep_addr, xfer);
+}
+
+static void control_stall(void)
+{
+  _model.stat.busy_bits += NAK_BITS;
+  advance(NAK_BITS);
+
+  _model.ctrl.stalled = true;
+  _model.ctrl.active  = false;
+  if ( _model.host_cb ) _model.host_cb(TUSB_DIR_IN_MASK, _model.ctrl.xferred);
+}
+
+static void data_xact(uint16_t len)
+{
+  uint32_t const bits = XACT_BITS + 8u*len;
+  _model.stat.data_xact++;
+  _model.stat.busy_bits += bits;
+  advance(bits);
+}
+
+static void sof(void)
+{
+  NRF_USBD_Type* const usbd = NRF_USBD;
+
+  usbd->FRAMECNTR = (usbd->FRAMECNTR + 1) & 0x7FF;
+
+  // Isochronous OUT packet of last frame is moved by DMA in this frame
+  if ( usbd->EPOUTEN & USBD_EPOUTEN_ISOOUT_Msk )
+  {
+    if ( _model.iso_out_pending ) _model.stat.iso_missed++;
+
+    if ( _model.iso_out_rx_len >= 0 )
+    {
+      _model.iso_out_ready_len = (uint16_t) _model.iso_out_rx_len;
+      memcpy(_model.iso_out_ready, _model.iso_out_rx, _model.iso_out_ready_len);
+      usbd->SIZE.ISOOUT = _model.iso_out_ready_len;
+      _model.iso_out_pending = true;
+    }
+    else
+    {
+      usbd->SIZE.ISOOUT = USBD_SIZE_ISOOUT_ZERO_Msk;
+      _model.iso_out_pending = false;
+    }
+    _model.iso_out_rx_len = -1;
+  }
+
+  // Isochronous IN packet moved by DMA before SOF is sent in this frame
+  if ( usbd->EPINEN & USBD_EPINEN_ISOIN_Msk )
+  {
+    _model.iso_in_valid = _model.iso_in_loaded;
+    if ( _model.iso_in_loaded )
+    {
+      memcpy(_model.iso_in_cur, _model.iso_in_next, _model.iso_in_next_len);
+      _model.iso_in_cur_len = _model.iso_in_next_len;
+      _model.iso_in_loaded  = false;
+    }
+  }
+
+  raise(&usbd->EVENTS_SOF);
+  advance(SOF_BITS);
+}
+
+static void iso_xact(void)
+{
+  host_xfer_t* out = &_model.host[ISO_EP][TUSB_DIR_OUT];
+  if ( out->active && (NRF_USBD->EPOUTEN & USBD_EPOUTEN_ISOOUT_Msk) )
+  {
+    uint16_t const len = (uint16_t) tu_min32(out->mps, out->len - out->xferred);
+    memcpy(_model.iso_out_rx, out->buf + out->xferred, len);
+    data_xact(len);
+
+    _model.iso_out_rx_len = len;
+    out->xferred += len;
+    if ( out->xferred >= out->len ) host_done(ISO_EP, out);
+  }
+
+  host_xfer_t* in = &_model.host[ISO_EP][TUSB_DIR_IN];
+  if ( in->active && (NRF_USBD->EPINEN & USBD_EPINEN_ISOIN_Msk) )
+  {
+    if ( _model.iso_in_valid )
+    {
+      uint16_t const len = (uint16_t) tu_min32(_model.iso_in_cur_len, in->len - in->xferred);
+      data_xact(len);
+
+      memcpy(in->buf + in->xferred, _model.iso_in_cur, len);
+      _model.iso_in_valid   = false;
+      _model.iso_in_started = true;
+      in->xferred += len;
+      if ( in->xferred >= in->len || len < in->mps ) host_done(ISO_EP | TUSB_DIR_IN_MASK, in);
+    }
+    else
+    {
+      // zero length packet
+      if ( _model.iso_in_started ) _model.stat.iso_missed++;
+      data_xact(0);
+    }
+  }
+}
+
+static void control_xact(void)
+{
+  NRF_USBD_Type* const usbd = NRF_USBD;
+  ep_buf_t* ep = &_model.epin[0];
+
+  switch ( _model.ctrl.stage )
+  {
+    case CTRL_SETUP:
+    {
+      _model.ctrl.start = _model.now;
+      data_xact(8);
+
+      uint8_t const* setup = _model.ctrl.setup;
+      usbd->BMREQUESTTYPE = setup[0];
+      usbd->BREQUEST      = setup[1];
+      usbd->WVALUEL       = setup[2];
+      usbd->WVALUEH       = setup[3];
+      usbd->WINDEXL       = setup[4];
+      usbd->WINDEXH       = setup[5];
+      usbd->WLENGTHL      = setup[6];
+      usbd->WLENGTHH      = setup[7];
+
+      // SET_ADDRESS status stage is answered by the controller
+      bool const set_addr = (setup[0] == 0) && (setup[1] == TUSB_REQ_SET_ADDRESS);
+      if ( set_addr ) usbd->USBADDR = setup[2];
+
+      ep->full = false;
+      _model.ctrl.stall        = false;
+      _model.ctrl.status_armed = set_addr;
+      _model.ctrl.stage        = _model.ctrl.len ? CTRL_DATA : CTRL_STATUS;
+      raise(&usbd->EVENTS_EP0SETUP);
+    }
+    break;
+
+    case CTRL_DATA:
+      if ( _model.ctrl.stall )
+      {
+        control_stall();
+      }
+      else if ( !ep->full )
+      {
+        nak();
+      }
+      else
+      {
+        uint16_t const len = (uint16_t) tu_min32(ep->len, _model.ctrl.len - _model.ctrl.xferred);
+        data_xact(len);
+
+        memcpy(_model.ctrl.buf + _model.ctrl.xferred, ep->data, len);
+        _model.ctrl.xferred += len;
+        ep->full = false;
+        if ( len < EP_BUF_SIZE || _model.ctrl.xferred >= _model.ctrl.len ) _model.ctrl.stage = CTRL_STATUS;
+        raise(&usbd->EVENTS_EP0DATADONE);
+      }
+    break;
+
+    case CTRL_STATUS:
+      if ( _model.ctrl.stall )
+      {
+        control_stall();
+      }
+      else if ( !_model.ctrl.status_armed )
+      {
+        nak();
+      }
+      else
+      {
+        data_xact(0);
+
+        uint32_t const bits = (uint32_t) (_model.now - _model.ctrl.start);
+        _model.stat.ctrl_count++;
+        _model.stat.ctrl_bits += bits;
+        _model.stat.ctrl_max_bits = tu_max32(_model.stat.ctrl_max_bits, bits);
+
+        _model.ctrl.active = false;
+        if ( _model.host_cb ) _model.host_cb(TUSB_DIR_IN_MASK, _model.ctrl.xferred);
+      }
+    break;
+
+    default: break;
+  }
+}
+
+static void bulk_out_xact(uint8_t epnum)
+{
+  NRF_USBD_Type* const usbd = NRF_USBD;
+  host_xfer_t* xfer = &_model.host[epnum][TUSB_DIR_OUT];
+  ep_buf_t* ep = &_model.epout[epnum];
+
+  if ( _model.ep_stall[epnum][TUSB_DIR_OUT] )
+  {
+    stall(epnum, xfer);
+    return;
+  }
+
+  if ( !tu_bit_test(usbd->EPOUTEN, epnum) || ep->full )
+  {
+    nak();
+    return;
+  }
+
+  uint16_t const len = (uint16_t) tu_min32(xfer->mps, xfer->len - xfer->xferred);
+  data_xact(len);
+
+  if ( len ) memcpy(ep->data, xfer->buf + xfer->xferred, len);
+  ep->len   = len;
+  ep->full  = true;
+  ep->since = _model.now;
+  usbd->SIZE.EPOUT[epnum] = len;
+  usbd->EPDATASTATUS |= TU_BIT(16 + epnum);
+  raise(&usbd->EVENTS_EPDATA);
+
+  xfer->xferred += len;
+  if ( len < xfer->mps || xfer->xferred >= xfer->len ) host_done(epnum, xfer);
+}
+
+static void bulk_in_xact(uint8_t epnum)
+{
+  NRF_USBD_Type* const usbd = NRF_USBD;
+  host_xfer_t* xfer = &_model.host[epnum][TUSB_DIR_IN];
+  ep_buf_t* ep = &_model.epin[epnum];
+
+  if ( _model.ep_stall[epnum][TUSB_DIR_IN] )
+  {
+    stall(epnum | TUSB_DIR_IN_MASK, xfer);
+    return;
+  }
+
+  if ( !tu_bit_test(usbd->EPINEN, epnum) || !ep->full )
+  {
+    nak();
+    return;
+  }
+
+  uint16_t const len = (uint16_t) tu_min32(ep->len, xfer->len - xfer->xferred);
+  data_xact(len);
+
+  memcpy(xfer->buf + xfer->xferred, ep->data, len);
+  ep->full = false;
+  usbd->EPDATASTATUS |= TU_BIT(epnum);
+  raise(&usbd->EVENTS_EPDATA);
+
+  xfer->xferred += len;
+  if ( len < xfer->mps || xfer->xferred >= xfer->len ) host_done(epnum | TUSB_DIR_IN_MASK, xfer);
+}
+
+// Next control/bulk/interrupt transaction in round robin: slot 0 is control, then OUT and IN of
+// endpoint 1 to 7. Return false if there is none
+static bool nonperiodic_xact(uint64_t frame_end)
+{
+  enum { SLOT_COUNT = 1 + 2*7 };
+
+  for ( uint8_t i = 0; i < SLOT_COUNT; i++ )
+  {
+    uint8_t const slot = (uint8_t) ((_model.rr + 1 + i) % SLOT_COUNT);
+
+    uint16_t mps;
+    if ( slot == 0 )
+    {
+      if ( !_model.ctrl.active ) continue;
+      mps = EP_BUF_SIZE;
+    }
+    else
+    {
+      host_xfer_t* xfer = &_model.host[(slot+1)/2][slot & 1 ? TUSB_DIR_OUT : TUSB_DIR_IN];
+      if ( !xfer->active ) continue;
+      mps = xfer->mps;
+    }
+
+    // must fit before end of frame
+    if ( _model.now + XACT_BITS + 8u*mps + EOF_BITS > frame_end ) return false;
+
+    _model.rr = slot;
+    if ( slot == 0 )
+    {
+      control_xact();
+    }
+    else if ( slot & 1 )
+    {
+      bulk_out_xact((uint8_t) ((slot+1)/2));
+    }
+    else
+    {
+      bulk_in_xact((uint8_t) (slot/2));
+    }
+    return true;
+  }
+
+  return false;
+}
+
+static void run_task(void)
+{
+  _model.in_task = true;
+  _model.task_cb();
+  _model.in_task = false;
+  _model.task_due = _model.now + _model.task_bits;
+}
+
+// Task when due, start of frame or next transaction. The task is run between transactions
+static void bus_step(void)
+{
+  if ( _model.task_cb && !_model.in_task && _model.task_due <= _model.now )
+  {
+    run_task();
+    return;
+  }
+
+  if ( _model.now >= _model.frame_end )
+  {
+    _model.frame_end = _model.now + MODEL_FRAME_BITS;
+    _model.stat.frames++;
+    sof();
+    iso_xact();
+    return;
+  }
+
+  if ( !nonperiodic_xact(_model.frame_end) )
+  {
+    // idle until end of frame or task
+    uint64_t next = _model.frame_end;
+    if ( _model.task_cb && !_model.in_task ) next = min64(next, _model.task_due);
+    advance(tu_max32((uint32_t) (next - _model.now), 1));
+  }
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void nrf5x_model_apply(void)
+{
+  apply();
+}
+
+void nrf5x_model_irq_enable(bool enable)
+{
+  _model.irq_enabled = enable;
+  if ( !enable || _model.in_isr ) return;
+
+  // thread mode: pending handler preempts right away
+  service();
+
+  // Thread enabling again at the same time with DMA busy or its handler pending is waiting for
+  // them: bus goes on meanwhile
+  if ( (_model.dma_task || _model.irq_due != TIME_NONE) && _model.now == _model.enable_time )
+  {
+    if ( _model.in_task )
+    {
+      bus_step();
+    }else
+    {
+      advance(1);
+    }
+  }
+  _model.enable_time = _model.now;
+}
+
+bool nrf5x_model_irq_enabled(void)
+{
+  return _model.irq_enabled;
+}
+
+void nrf5x_model_init(nrf5x_model_task_t task_cb, uint32_t isr_bits, uint32_t task_bits)
+{
+  tu_memclr(&_model, sizeof(_model));
+  tu_memclr(&nrf5x_model_usbd, sizeof(nrf5x_model_usbd));
+  tu_memclr(&nrf5x_model_scb, sizeof(nrf5x_model_scb));
+
+  _model.task_cb   = task_cb;
+  _model.isr_bits  = isr_bits;
+  _model.task_bits = task_bits;
+  _model.task_due  = task_bits;
+  _model.irq_due   = TIME_NONE;
+  _model.iso_out_rx_len = -1;
+  nrf5x_model_usbd.EPSTALL = EPSTALL_NONE;
+}
+
+void nrf5x_model_host_callback(nrf5x_model_host_cb_t cb)
+{
+  _model.host_cb = cb;
+}
+
+void nrf5x_model_bus_reset(void)
+{
+  tu_memclr(_model.epin, sizeof(_model.epin));
+  tu_memclr(_model.epout, sizeof(_model.epout));
+  tu_memclr(_model.host, sizeof(_model.host));
+  tu_memclr(_model.ep_stall, sizeof(_model.ep_stall));
+  _model.ctrl.active = false;
+
+  // reset lasts long enough for its interrupt and event to be handled
+  raise(&NRF_USBD->EVENTS_USBRESET);
+  advance(_model.isr_bits);
+
+  if ( _model.task_cb )
+  {
+    if ( _model.task_due > _model.now ) advance((uint32_t) (_model.task_due - _model.now));
+    run_task();
+  }
+}
+
+void nrf5x_model_frame(void)
+{
+  uint32_t const frame = _model.stat.frames + 1;
+  while ( _model.stat.frames < frame || _model.now < _model.frame_end ) bus_step();
+}
+
+uint64_t nrf5x_model_time(void)
+{
+  return _model.now;
+}
+
+nrf5x_model_stat_t const* nrf5x_model_stat(void)
+{
+  return &_model.stat;
+}
+
+void nrf5x_model_host_xfer(uint8_t ep_addr, uint16_t mps, uint8_t* buf, uint32_t len)
+{
+  host_xfer_t* xfer = &_model.host[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+
+  xfer->buf     = buf;
+  xfer->len     = len;
+  xfer->xferred = 0;
+  xfer->mps     = mps;
+  xfer->stalled = false;
+  xfer->active  = true;
+}
+
+bool nrf5x_model_host_busy(uint8_t ep_addr)
+{
+  if ( tu_edpt_number(ep_addr) == 0 ) return _model.ctrl.active;
+  return _model.host[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].active;
+}
+
+bool nrf5x_model_host_stalled(uint8_t ep_addr)
+{
+  if ( tu_edpt_number(ep_addr) == 0 ) return _model.ctrl.stalled;
+  return _model.host[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].stalled;
+}
+
+void nrf5x_model_control(uint8_t const setup[8], uint8_t* buf)
+{
+  memcpy(_model.ctrl.setup, setup, 8);
+  _model.ctrl.buf     = buf;
+  _model.ctrl.len     = tu_u16(setup[7], setup[6]);
+  _model.ctrl.xferred = 0;
+  _model.ctrl.stalled = false;
+  _model.ctrl.stage   = CTRL_SETUP;
+  _model.ctrl.active  = true;
+}
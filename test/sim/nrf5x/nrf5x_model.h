@@ -0,0 +1,118 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _NRF5X_MODEL_H_
+#define _NRF5X_MODEL_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Register level model of the nRF52840 USBD controller with the model as full speed host of
+// transfers queued by nrf5x_model_host_xfer() and nrf5x_model_control(). Time is counted
+// in bit times (12 Mbps), a frame is 12000 bits:
+// - SOF: isochronous OUT packet received in previous frame is given to SIZE.ISOOUT, isochronous
+//   IN packet moved by DMA before SOF is sent in this frame
+// - Control transfer then bulk/interrupt endpoints are run packet by packet in round robin.
+//   OUT is ACKed while endpoint buffer is empty (i.e. its previous packet was moved by DMA), IN
+//   while endpoint buffer has a packet moved by DMA. NAK is retried right away.
+// - EasyDMA runs one STARTEPIN/STARTEPOUT/STARTISOIN/STARTISOOUT task at a time, END event is raised
+//   once done. A task triggered while DMA is busy (EP0STATUS and EP0RCVOUT too) is a conflict, its
+//   data would be corrupted on hardware: it is counted and dropped.
+// - EPSTALL stalls bulk/interrupt endpoint, EP0STALL the control transfer until next setup. SET_ADDRESS
+//   status stage is answered by the controller.
+//
+// Registers are plain memory. Tasks and INTENSET/INTENCLR are applied by __DSB(), between transactions
+// and after the interrupt handler and task return, EPDATASTATUS is cleared by a handler that clears
+// EPDATA or EP0DATADONE. The interrupt handler is called isr_bits after an interrupt is raised
+// while it is enabled, the task callback (usbd task) is called every task_bits. Enabling the
+// interrupt in thread mode takes a bit time, a pending handler is called right away.
+// EasyDMA pointers are 32 bit: buffers must be static (binary is not position independent).
+//--------------------------------------------------------------------+
+
+enum
+{
+  MODEL_FRAME_BITS = 12000,
+};
+
+typedef void (* nrf5x_model_task_t) (void);
+
+// Host transfer is complete, next one can be queued right away
+typedef void (* nrf5x_model_host_cb_t) (uint8_t ep_addr, uint32_t xferred);
+
+typedef struct
+{
+  uint32_t frames;
+  uint32_t data_xact;           // data packets ACKed
+  uint32_t nak_xact;
+  uint32_t irq_count;
+  uint64_t isr_ns;              // time spent in dcd_int_handler()
+  uint32_t dma_count;
+  uint32_t dma_conflicts;       // DMA task triggered while EasyDMA is busy
+  uint32_t iso_missed;          // isochronous OUT packet not moved before next SOF, IN without packet
+  uint32_t ctrl_count;          // control transfers complete
+  uint64_t ctrl_bits;           // setup to status complete, total and max
+  uint32_t ctrl_max_bits;
+  uint64_t out_wait_bits;       // OUT packet held in endpoint buffer until its DMA starts, total and max
+  uint32_t out_wait_max_bits;
+  uint64_t busy_bits;           // bus time used by transactions (SOF excluded)
+  uint64_t nak_bits;            // bus time used by NAKed transactions
+} nrf5x_model_stat_t;
+
+void nrf5x_model_init(nrf5x_model_task_t task_cb, uint32_t isr_bits, uint32_t task_bits);
+void nrf5x_model_host_callback(nrf5x_model_host_cb_t cb);
+
+// USB reset signaled by host, its interrupt and task are run before returning
+void nrf5x_model_bus_reset(void);
+
+// Run one frame
+void nrf5x_model_frame(void);
+
+// Bit time since init
+uint64_t nrf5x_model_time(void);
+
+nrf5x_model_stat_t const* nrf5x_model_stat(void);
+
+// OUT sends len bytes in packets of mps, IN receives up to len bytes until a short packet.
+// Isochronous endpoint (number 8) has a packet per frame
+void nrf5x_model_host_xfer(uint8_t ep_addr, uint16_t mps, uint8_t* buf, uint32_t len);
+
+// Transfer is in progress, or its last one ended with STALL. ep_addr 0 is the control transfer
+bool nrf5x_model_host_busy(uint8_t ep_addr);
+bool nrf5x_model_host_stalled(uint8_t ep_addr);
+
+// Control read or no data request: setup, IN data stage of up to wLength bytes, then status.
+// Callback has ep_addr 0x80
+void nrf5x_model_control(uint8_t const setup[8], uint8_t* buf);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _NRF5X_MODEL_H_ */
@@ -0,0 +1,43 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _NRF_CLOCK_H_
+#define _NRF_CLOCK_H_
+
+// Stand-in of nrfx clock HAL: HFCLK is always running
+#include "nrf.h"
+
+#define NRF_CLOCK                       NULL
+#define NRF_CLOCK_HFCLK_HIGH_ACCURACY   1
+#define NRF_CLOCK_EVENT_HFCLKSTARTED    0
+#define NRF_CLOCK_TASK_HFCLKSTART       0
+#define NRF_CLOCK_TASK_HFCLKSTOP        4
+
+static inline bool nrf_clock_hf_is_running(void const* reg, int src) { (void) reg; (void) src; return true; }
+static inline void nrf_clock_event_clear(void const* reg, int evt)   { (void) reg; (void) evt; }
+static inline void nrf_clock_task_trigger(void const* reg, int task) { (void) reg; (void) task; }
+
+#endif /* _NRF_CLOCK_H_ */
@@ -0,0 +1,266 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "host/hcd.h"
+#include "ohci_model.h"
+
+//--------------------------------------------------------------------+
+// OHCI gTD chain test against the register level model
+// Bulk transfers larger than a gTD (4 KB) are split into a chain of gTDs:
+// - IN and OUT transfers of several gTDs move all data, xferred_bytes is the transfer length
+// - device ending the IN data early with a short packet in a gTD in the middle of the chain (ED halts
+//   with DATA_UNDERRUN), on the last gTD, or with a zero length packet at a gTD boundary: transfer
+//   completes once with the bytes received, gTDs after the short one are not executed and the next
+//   transfer starts from its first gTD
+// Cases are repeated so that leaked gTDs would run the pool out.
+//--------------------------------------------------------------------+
+
+#define EP_BULK_IN      0x81
+#define EP_BULK_OUT     0x02
+#define XFER_MAX        (32*1024)
+#define TIMEOUT_FRAMES  16
+#define REPEAT          50
+
+enum { DEV_ADDR = 1 };
+
+// Device side of current transfer
+static struct
+{
+  uint32_t in_avail;    // bytes device has to send before it ends with a short packet
+  uint32_t offset;      // bytes sent or received in the transfer
+  uint32_t xact;        // gTDs carried out
+  uint32_t errors;      // OUT data mismatch
+} _dev;
+
+static struct
+{
+  uint32_t count;
+  uint32_t xferred;
+  uint8_t  result;
+  uint8_t  ep_addr;
+} _complete;
+
+// static, all addresses used by controller must be 32-bit
+static uint8_t _buf[XFER_MAX + 4] TU_ATTR_ALIGNED(4);
+
+static inline uint8_t pattern(uint32_t offset)
+{
+  return (uint8_t) (offset*7u + (offset >> 8));
+}
+
+//--------------------------------------------------------------------+
+// USBH stubs
+//--------------------------------------------------------------------+
+
+void hcd_devtree_get_info(uint8_t dev_addr, hcd_devtree_info_t* devtree_info)
+{
+  (void) dev_addr;
+  devtree_info->rhport   = 0;
+  devtree_info->speed    = TUSB_SPEED_FULL;
+  devtree_info->hub_addr = 0;
+  devtree_info->hub_port = 0;
+}
+
+void hcd_event_handler(hcd_event_t const* event, bool in_isr)
+{
+  (void) event; (void) in_isr;
+}
+
+void hcd_event_device_attach(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_device_remove(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_xfer_complete(uint8_t dev_addr, uint8_t ep_addr, uint32_t xferred_bytes, xfer_result_t result, bool in_isr)
+{
+  (void) dev_addr; (void) in_isr;
+
+  _complete.count++;
+  _complete.xferred = xferred_bytes;
+  _complete.result  = (uint8_t) result;
+  _complete.ep_addr = ep_addr;
+}
+
+//--------------------------------------------------------------------+
+// Device: IN data is patterned by offset in transfer, OUT data is checked against it
+//--------------------------------------------------------------------+
+
+static int32_t device_xact(uint8_t dev_addr, uint8_t ep_addr, uint8_t* buf, uint16_t len)
+{
+  (void) dev_addr;
+  _dev.xact++;
+
+  uint32_t count = len;
+
+  if ( tu_edpt_dir(ep_addr) )
+  {
+    count = tu_min32(len, _dev.in_avail - _dev.offset);
+    for(uint32_t i = 0; i < count; i++) buf[i] = pattern(_dev.offset + i);
+  }else
+  {
+    for(uint32_t i = 0; i < count; i++)
+    {
+      if ( buf[i] != pattern(_dev.offset + i) ) { _dev.errors++; break; }
+    }
+  }
+
+  _dev.offset += count;
+  return (int32_t) count;
+}
+
+//--------------------------------------------------------------------+
+// Test
+//--------------------------------------------------------------------+
+
+static bool edpt_open(uint8_t ep_addr, uint8_t xfer_type, uint16_t size)
+{
+  tusb_desc_endpoint_t const desc =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep_addr,
+    .bmAttributes     = { .xfer = xfer_type },
+    .wMaxPacketSize   = tu_htole16(size),
+    .bInterval        = 0
+  };
+
+  return hcd_edpt_open(0, DEV_ADDR, &desc);
+}
+
+static uint32_t gtd_count(uint32_t len)
+{
+  return len ? tu_div_ceil(len, 4096) : 1;
+}
+
+// Transfer of len bytes, device sends up to in_avail bytes on IN
+static bool xfer(uint8_t ep_addr, uint32_t len, uint32_t in_avail)
+{
+  bool const is_in = tu_edpt_dir(ep_addr);
+  uint32_t const expected = is_in ? tu_min32(len, in_avail) : len;
+
+  tu_memclr(&_dev, sizeof(_dev));
+  tu_memclr(&_complete, sizeof(_complete));
+  _dev.in_avail = in_avail;
+
+  if ( is_in )
+  {
+    memset(_buf, 0xEE, sizeof(_buf));
+  }else
+  {
+    for(uint32_t i = 0; i < len; i++) _buf[i] = pattern(i);
+  }
+
+  TU_ASSERT(hcd_edpt_xfer(0, DEV_ADDR, ep_addr, _buf, len));
+  for(uint32_t i = 0; !_complete.count && i < TIMEOUT_FRAMES; i++) ohci_model_frame();
+
+  // a few more frames: transfer must not complete twice
+  for(uint32_t i = 0; i < 4; i++) ohci_model_frame();
+
+  bool ok = (_complete.count == 1) && (_complete.result == XFER_RESULT_SUCCESS) && (_complete.ep_addr == ep_addr) &&
+            (_complete.xferred == expected) && (_dev.offset == expected) && !_dev.errors;
+
+  // gTDs after the one with short packet are not executed
+  uint32_t const xact = (expected < len) ? (expected / 4096) + 1 : gtd_count(len);
+  ok = ok && (_dev.xact == xact);
+
+  if ( is_in )
+  {
+    for(uint32_t i = 0; ok && i < expected; i++) ok = (_buf[i] == pattern(i));
+    for(uint32_t i = expected; ok && i < sizeof(_buf); i++) ok = (_buf[i] == 0xEE);
+  }
+
+  if ( !ok )
+  {
+    printf("  %s %lu bytes, device %lu: %lu completions, xferred %lu (expected %lu), %lu gTDs executed (expected %lu)\n",
+           is_in ? "IN" : "OUT", (unsigned long) len, (unsigned long) in_avail, (unsigned long) _complete.count,
+           (unsigned long) _complete.xferred, (unsigned long) expected, (unsigned long) _dev.xact, (unsigned long) xact);
+  }
+
+  return ok;
+}
+
+static bool test_full(void)
+{
+  TU_ASSERT(xfer(EP_BULK_IN , 10000 , UINT32_MAX));
+  TU_ASSERT(xfer(EP_BULK_OUT, 10000 , 0));
+  TU_ASSERT(xfer(EP_BULK_IN , 8192  , UINT32_MAX)); // exact multiple of gTD size
+  TU_ASSERT(xfer(EP_BULK_IN , 100   , UINT32_MAX)); // single gTD
+  TU_ASSERT(xfer(EP_BULK_OUT, XFER_MAX, 0));
+  TU_ASSERT(xfer(EP_BULK_IN , XFER_MAX, UINT32_MAX));
+
+  return true;
+}
+
+static bool test_short(void)
+{
+  // middle of second gTD of three, then full transfer right after
+  TU_ASSERT(xfer(EP_BULK_IN, 10000, 5000));
+  TU_ASSERT(xfer(EP_BULK_IN, 10000, UINT32_MAX));
+
+  // last gTD
+  TU_ASSERT(xfer(EP_BULK_IN, 10000, 9000));
+
+  // zero length packet at gTD boundary: first gTD complete, second one short
+  TU_ASSERT(xfer(EP_BULK_IN, 10000, 4096));
+
+  // first gTD
+  TU_ASSERT(xfer(EP_BULK_IN, XFER_MAX, 100));
+
+  // no data at all
+  TU_ASSERT(xfer(EP_BULK_IN, XFER_MAX, 0));
+
+  // OUT in between keeps its own ED
+  TU_ASSERT(xfer(EP_BULK_OUT, 10000, 0));
+  TU_ASSERT(xfer(EP_BULK_IN , XFER_MAX, 20000));
+
+  return true;
+}
+
+int main(void)
+{
+  ohci_model_init(device_xact);
+
+  bool ok = edpt_open(0x00, TUSB_XFER_CONTROL, 64) && edpt_open(EP_BULK_IN, TUSB_XFER_BULK, 64) &&
+            edpt_open(EP_BULK_OUT, TUSB_XFER_BULK, 64);
+
+  printf("-- full length\n");
+  for(uint32_t i = 0; ok && i < REPEAT; i++) ok = test_full();
+
+  printf("-- short packet\n");
+  for(uint32_t i = 0; ok && i < REPEAT; i++) ok = test_short();
+
+  printf(ok ? "PASSED\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,308 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <time.h>
+
+#include "tusb.h"
+#include "host/hcd.h"
+#include "portable/ohci/ohci.h"
+#include "ohci_model.h"
+
+//--------------------------------------------------------------------+
+// Register level OHCI model: periodic, control & bulk lists
+//--------------------------------------------------------------------+
+
+enum
+{
+  MODEL_CC_NO_ERROR       = 0,
+  MODEL_CC_DATA_OVERRUN   = 8,
+  MODEL_CC_DATA_UNDERRUN  = 9,
+};
+
+enum
+{
+  MODEL_INT_WDH = TU_BIT(1),   // writeback done head
+  MODEL_INT_FNO = TU_BIT(5),   // frame number overflow
+  MODEL_INT_MIE = TU_BIT(31),  // master interrupt enable
+};
+
+enum
+{
+  MODEL_PID_SETUP = 0,
+  MODEL_PID_OUT,
+  MODEL_PID_IN,
+};
+
+enum
+{
+  MODEL_DI_NO_INTERRUPT = 7,
+  MODEL_FUNCSTATE_OPERATIONAL = 2,
+};
+
+static ohci_registers_t _regs;
+
+static ohci_model_xact_t _xact_cb;
+static ohci_model_stat_t _stat;
+
+static uint32_t _frame_count;
+static uint32_t _done_head;         // retired gTDs not yet written back to HCCA
+static bool     _done_int;          // done queue is to be written back at end of frame
+static bool     _int_enabled;
+
+static inline void* addr_to_ptr(uint32_t addr)
+{
+  return (void*) (uintptr_t) addr;
+}
+
+// Write-1-to-clear of HcInterruptDisable and completion of a software reset, which takes
+// the controller a few microseconds: done by the next register access of the driver
+void* ohci_model_regs(void)
+{
+  if ( _regs.interrupt_disable )
+  {
+    _regs.interrupt_enable &= ~_regs.interrupt_disable;
+    _regs.interrupt_disable = 0;
+  }
+
+  if ( _regs.command_status_bit.controller_reset )
+  {
+    tu_memclr((void*) (uintptr_t) &_regs, sizeof(_regs));
+    _regs.revision       = 0x10;
+    _regs.frame_interval = 0x2EDF;
+  }
+
+  return (void*) (uintptr_t) &_regs;
+}
+
+static inline bool ed_is_empty(ohci_ed_t const* ed)
+{
+  return tu_align16(ed->td_head.address) == tu_align16(ed->td_tail);
+}
+
+// Move gTD at head of ED to done queue, ED is halted on error
+static void gtd_retire(ohci_ed_t* ed, ohci_gtd_t* gtd, uint8_t cc)
+{
+  uint32_t const next = tu_align16(gtd->next);
+
+  gtd->condition_code = cc;
+  ed->td_head.address = (ed->td_head.address & 0x0Ful) | next;
+
+  if ( cc != MODEL_CC_NO_ERROR )
+  {
+    ed->td_head.halted = 1;
+    _stat.error_xact++;
+  }
+
+  gtd->next  = _done_head;
+  _done_head = (uint32_t) (uintptr_t) gtd;
+
+  // error always interrupts at end of frame, delay of others is not modeled
+  if ( cc != MODEL_CC_NO_ERROR || gtd->delay_interrupt != MODEL_DI_NO_INTERRUPT ) _done_int = true;
+}
+
+// Execute gTDs of ED until one is NAKed, ED is halted or empty, at most max gTDs.
+// Return true if ED still has gTDs to carry out.
+static bool ed_execute(ohci_ed_t* ed, uint32_t max)
+{
+  for(uint32_t i = 0; i < max; i++)
+  {
+    if ( ed->skip || ed->td_head.halted || ed_is_empty(ed) ) return false;
+
+    ohci_gtd_t* gtd = addr_to_ptr(tu_align16(ed->td_head.address));
+
+    uint8_t const  pid = (ed->pid == 0 || ed->pid == 3) ? (uint8_t) gtd->pid : (uint8_t) ed->pid;
+    uint8_t const  dir = (pid == MODEL_PID_IN) ? 1 : 0;
+    uint32_t const cbp = gtd->current_buffer_pointer;
+
+    // buffer is contiguous on the build machine, no page crossing to follow
+    uint16_t const len = (uint16_t) (cbp ? (gtd->buffer_end - cbp + 1) : 0);
+
+    int32_t const count = _xact_cb ? _xact_cb((uint8_t) ed->dev_addr, tu_edpt_addr(ed->ep_number, dir), addr_to_ptr(cbp), len) : -1;
+
+    // NAK
+    if ( count < 0 ) return true;
+
+    _stat.gtd_xact++;
+
+    if ( count > (int32_t) len )
+    {
+      gtd_retire(ed, gtd, MODEL_CC_DATA_OVERRUN);
+    }else if ( count == (int32_t) len )
+    {
+      // all data transferred
+      gtd->current_buffer_pointer = 0;
+      gtd_retire(ed, gtd, MODEL_CC_NO_ERROR);
+    }else
+    {
+      // short packet: error unless buffer rounding is set
+      gtd->current_buffer_pointer = cbp + (uint32_t) count;
+      gtd_retire(ed, gtd, gtd->buffer_rounding ? MODEL_CC_NO_ERROR : MODEL_CC_DATA_UNDERRUN);
+    }
+  }
+
+  return !(ed->skip || ed->td_head.halted || ed_is_empty(ed));
+}
+
+// Walk list from head, return true if any ED still has gTDs to carry out
+static bool list_execute(uint32_t head, uint32_t max_per_ed)
+{
+  bool filled = false;
+
+  // guard against broken (looping) list
+  uint32_t guard;
+  for(guard = 0; head && guard < 1024; guard++)
+  {
+    ohci_ed_t* ed = addr_to_ptr(tu_align16(head));
+    if ( ed_execute(ed, max_per_ed) ) filled = true;
+    head = ed->next;
+  }
+
+  TU_ASSERT(head == 0, filled);
+  return filled;
+}
+
+//--------------------------------------------------------------------+
+// HCD API implemented by chip glue
+//--------------------------------------------------------------------+
+
+void hcd_int_enable(uint8_t rhport)
+{
+  (void) rhport;
+  _int_enabled = true;
+}
+
+void hcd_int_disable(uint8_t rhport)
+{
+  (void) rhport;
+  _int_enabled = false;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void ohci_model_init(ohci_model_xact_t xact_cb)
+{
+  tu_memclr((void*) (uintptr_t) &_regs, sizeof(_regs));
+  tu_memclr(&_stat, sizeof(_stat));
+
+  _xact_cb     = xact_cb;
+  _frame_count = 0;
+  _done_head   = 0;
+  _done_int    = false;
+  _int_enabled = true;
+
+  hcd_init(0);
+
+  // status written by init is write-1-to-clear
+  (void) ohci_model_regs();
+  _regs.interrupt_status = 0;
+}
+
+void ohci_model_frame(void)
+{
+  (void) ohci_model_regs();
+
+  ohci_hcca_t* hcca = addr_to_ptr(_regs.hcca);
+
+  if ( _regs.control_bit.hc_functional_state == MODEL_FUNCSTATE_OPERATIONAL && hcca )
+  {
+    // interrupt EDs get one gTD per frame
+    if ( _regs.control_bit.periodic_list_enable )
+    {
+      (void) list_execute(hcca->interrupt_table[_regs.frame_number % 32], 1);
+    }
+
+    if ( _regs.control_bit.control_list_enable && _regs.command_status_bit.control_list_filled )
+    {
+      _regs.command_status_bit.control_list_filled = list_execute(_regs.control_head_ed, UINT32_MAX) ? 1 : 0;
+    }
+
+    if ( _regs.control_bit.bulk_list_enable && _regs.command_status_bit.bulk_list_filled )
+    {
+      _regs.command_status_bit.bulk_list_filled = list_execute(_regs.bulk_head_ed, UINT32_MAX) ? 1 : 0;
+    }
+
+    // done queue is written back once driver has handled the previous one
+    if ( _done_int && !(_regs.interrupt_status & MODEL_INT_WDH) )
+    {
+      hcca->done_head = _done_head;
+      _done_head = 0;
+      _done_int  = false;
+      _regs.interrupt_status |= MODEL_INT_WDH;
+    }
+
+    //------------- next frame -------------//
+    _regs.frame_number = (_regs.frame_number + 1) & 0xFFFF;
+    hcca->frame_number = (uint16_t) _regs.frame_number;
+    if ( _regs.frame_number == 0 ) _regs.interrupt_status |= MODEL_INT_FNO;
+  }
+
+  _frame_count++;
+
+  uint32_t const seen = _regs.interrupt_status & _regs.interrupt_enable & ~MODEL_INT_MIE;
+  if ( seen && (_regs.interrupt_enable & MODEL_INT_MIE) && _int_enabled )
+  {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    hcd_int_handler(0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    _stat.int_count++;
+    _stat.int_ns += (uint64_t) ((end.tv_sec - start.tv_sec)*1000000000LL + (end.tv_nsec - start.tv_nsec));
+
+    // write-1-to-clear of status bits acknowledged by handler
+    (void) ohci_model_regs();
+    _regs.interrupt_status &= ~seen;
+  }
+}
+
+uint32_t ohci_model_frame_count(void)
+{
+  return _frame_count;
+}
+
+ohci_model_stat_t const* ohci_model_stat(void)
+{
+  return &_stat;
+}
+
+static uint32_t list_count(uint32_t head)
+{
+  uint32_t count = 0;
+  for(uint32_t guard = 0; head && guard < 1024; guard++, count++) head = ((ohci_ed_t*) addr_to_ptr(tu_align16(head)))->next;
+  return count;
+}
+
+uint32_t ohci_model_ed_linked(void)
+{
+  ohci_hcca_t const* hcca = addr_to_ptr(_regs.hcca);
+
+  // driver links every interrupt ED to all HCCA slots
+  return (list_count(_regs.control_head_ed) - 1) + (list_count(_regs.bulk_head_ed) - 1) +
+         (list_count(hcca->interrupt_table[0]) - 1);
+}
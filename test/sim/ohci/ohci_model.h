@@ -0,0 +1,81 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _OHCI_MODEL_H_
+#define _OHCI_MODEL_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Register level OHCI model
+// Operational registers are plain memory reached by ohci.c through LPC_USB_BASE, see chip.h.
+// Each call to ohci_model_frame() advances the frame number and executes the interrupt ED list of
+// the current HCCA slot (one gTD per ED), then the control and bulk lists when their filled bit is
+// set. A gTD is carried out in one go as if it were a single packet. Retired gTDs are put on the done
+// queue, which is written back to HCCA at the end of the frame when one of them asks for an interrupt
+// or ended with an error, then hcd_int_handler() is called unless disabled with hcd_int_disable().
+// Status bits it has seen are cleared as write-1-to-clear.
+//
+// Built as non-PIE so that static data (EDs, gTDs and buffers) has 32-bit addresses, the
+// link and buffer pointers of OHCI data structures are 32-bit.
+//--------------------------------------------------------------------+
+
+// Device side of a transaction.
+// IN: fill up to len bytes (more is babble) and return count, OUT/SETUP: consume len bytes and return len.
+// Return -1 for NAK (retried later)
+typedef int32_t (* ohci_model_xact_t) (uint8_t dev_addr, uint8_t ep_addr, uint8_t* buf, uint16_t len);
+
+typedef struct
+{
+  uint32_t gtd_xact;            // gTDs executed
+  uint32_t error_xact;
+  uint32_t int_count;           // calls to hcd_int_handler()
+  uint64_t int_ns;              // time spent in hcd_int_handler()
+} ohci_model_stat_t;
+
+// Reset model and call hcd_init()
+void ohci_model_init(ohci_model_xact_t xact_cb);
+
+// Run one frame
+void ohci_model_frame(void);
+
+// Frames since init
+uint32_t ohci_model_frame_count(void);
+
+ohci_model_stat_t const* ohci_model_stat(void);
+
+// Number of EDs linked in control, bulk and interrupt lists besides list heads
+uint32_t ohci_model_ed_linked(void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _OHCI_MODEL_H_ */
@@ -0,0 +1,503 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "pico.h"
+#include "hardware/structs/usb.h"
+#include "sim_test.h"
+#include "rp2040_model.h"
+
+//--------------------------------------------------------------------+
+// RP2040 device driver against the controller model (device mode):
+// - Bulk OUT/IN streams on a double buffered bulk endpoint against a single buffered interrupt one
+// - Back to back OUT messages ending with a short packet: the next message may be received by the
+//   other buffer before the short packet is handled
+// - Isochronous OUT/IN with buffer 1 offset of 256 and 1024 bytes
+// - DPRAM allocator: endpoints opened and closed as alternate settings do, buffers must not overlap
+// Data, data toggle and missed isochronous packets are checked, bulk throughput is reported.
+// Completed transfers are queued again by the task in place of usbd.
+//--------------------------------------------------------------------+
+
+#define RUN_FRAMES   500
+#define XFER_BYTES   4096
+#define ISR_BITS     120    // 10 us interrupt latency
+
+static inline uint8_t pattern(uint8_t ep_addr, uint32_t offset)
+{
+  return (uint8_t) (offset*3u + ep_addr);
+}
+
+//--------------------------------------------------------------------+
+// Events, in place of usbd
+//--------------------------------------------------------------------+
+
+static struct
+{
+  dcd_event_t queue[64];
+  uint32_t count;
+  uint32_t early_count;       // completed when queued: packet received before
+} _ev;
+
+void dcd_event_handler(dcd_event_t const * event, bool in_isr)
+{
+  if ( _ev.count >= TU_ARRAY_SIZE(_ev.queue) ) panic("event queue overflow");
+  _ev.queue[_ev.count++] = *event;
+
+  if ( event->event_id == DCD_EVENT_XFER_COMPLETE && !in_isr ) _ev.early_count++;
+}
+
+void dcd_event_bus_signal (uint8_t rhport, dcd_eventid_t eid, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = eid };
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_bus_reset (uint8_t rhport, tusb_speed_t speed, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_BUS_RESET };
+  event.bus_reset.speed = speed;
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_setup_received(uint8_t rhport, uint8_t const * setup, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_SETUP_RECEIVED };
+  memcpy(&event.setup_received, setup, 8);
+  dcd_event_handler(&event, in_isr);
+}
+
+void dcd_event_xfer_complete (uint8_t rhport, uint8_t ep_addr, uint32_t xferred_bytes, uint8_t result, bool in_isr)
+{
+  dcd_event_t event = { .rhport = rhport, .event_id = DCD_EVENT_XFER_COMPLETE };
+  event.xfer_complete.ep_addr = ep_addr;
+  event.xfer_complete.len     = xferred_bytes;
+  event.xfer_complete.result  = result;
+  dcd_event_handler(&event, in_isr);
+}
+
+//--------------------------------------------------------------------+
+// Streams: device transfers are queued again once complete, host transfers too
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint8_t  ep_addr;
+  uint16_t mps;
+  bool     iso;
+  bool     enabled;
+
+  // device side
+  uint32_t dev_len;           // transfer length
+  uint32_t dev_offset;        // pattern offset
+  uint32_t dev_bytes;
+  uint32_t dev_xfers;
+  uint8_t  dev_buf[XFER_BYTES];
+
+  // host side: OUT messages of random length if msg_max is not zero
+  uint32_t host_len;
+  uint32_t host_offset;
+  uint16_t msg_max;
+  uint32_t msg_len[4096];     // lengths sent, checked against device transfers
+  uint32_t msg_wr;
+  uint32_t msg_rd;
+  uint8_t  host_buf[XFER_BYTES];
+} stream_t;
+
+static stream_t _stream[4];
+static uint8_t  _stream_count;
+
+static void dev_submit(stream_t* s)
+{
+  if ( tu_edpt_dir(s->ep_addr) )
+  {
+    for ( uint32_t i = 0; i < s->dev_len; i++ ) s->dev_buf[i] = pattern(s->ep_addr, s->dev_offset + i);
+  }
+  else
+  {
+    memset(s->dev_buf, 0, s->dev_len);
+  }
+
+  CHECK(dcd_edpt_xfer(0, s->ep_addr, s->dev_buf, (uint16_t) s->dev_len));
+}
+
+static void host_submit(stream_t* s)
+{
+  uint32_t len = s->host_len;
+
+  if ( !tu_edpt_dir(s->ep_addr) )
+  {
+    if ( s->msg_max )
+    {
+      // short packet ends each message
+      len = 1 + (uint32_t) rand() % s->msg_max;
+      if ( len % s->mps == 0 ) len--;
+      s->msg_len[s->msg_wr++ % TU_ARRAY_SIZE(s->msg_len)] = len;
+    }
+
+    for ( uint32_t i = 0; i < len; i++ ) s->host_buf[i] = pattern(s->ep_addr, s->host_offset + i);
+  }
+
+  rp2040_model_dev_xfer(s->ep_addr, s->mps, s->iso, s->host_buf, len);
+}
+
+// Host side completion: next transfer is queued right away
+static void host_complete(uint8_t ep_addr, uint32_t len)
+{
+  for ( uint8_t i = 0; i < _stream_count; i++ )
+  {
+    stream_t* s = &_stream[i];
+    if ( !s->enabled || s->ep_addr != ep_addr ) continue;
+
+    if ( tu_edpt_dir(s->ep_addr) )
+    {
+      for ( uint32_t n = 0; n < len; n++ )
+      {
+        if ( s->host_buf[n] != pattern(s->ep_addr, s->host_offset + n) ) { _errors++; break; }
+      }
+    }
+    s->host_offset += len;
+
+    host_submit(s);
+  }
+}
+
+static void dev_complete(stream_t* s, uint32_t len)
+{
+  if ( !tu_edpt_dir(s->ep_addr) )
+  {
+    for ( uint32_t n = 0; n < len; n++ )
+    {
+      if ( s->dev_buf[n] != pattern(s->ep_addr, s->dev_offset + n) ) { _errors++; break; }
+    }
+
+    if ( s->msg_max )
+    {
+      if ( s->msg_rd == s->msg_wr || s->msg_len[s->msg_rd++ % TU_ARRAY_SIZE(s->msg_len)] != len ) _errors++;
+    }
+  }
+
+  s->dev_offset += len;
+  s->dev_bytes  += len;
+  s->dev_xfers++;
+
+  dev_submit(s);
+}
+
+static void task(void)
+{
+  for ( uint32_t i = 0; i < _ev.count; i++ )
+  {
+    dcd_event_t const* ev = &_ev.queue[i];
+    if ( ev->event_id != DCD_EVENT_XFER_COMPLETE ) continue;
+
+    CHECK(ev->xfer_complete.result == XFER_RESULT_SUCCESS);
+    for ( uint8_t s = 0; s < _stream_count; s++ )
+    {
+      if ( _stream[s].enabled && _stream[s].ep_addr == ev->xfer_complete.ep_addr ) dev_complete(&_stream[s], ev->xfer_complete.len);
+    }
+  }
+  _ev.count = 0;
+}
+
+//--------------------------------------------------------------------+
+// Setup
+//--------------------------------------------------------------------+
+
+static bool edpt_open(uint8_t ep_addr, uint8_t xfer_type, uint16_t size)
+{
+  tusb_desc_endpoint_t const desc =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep_addr,
+    .bmAttributes     = { .xfer = xfer_type },
+    .wMaxPacketSize   = tu_htole16(size),
+    .bInterval        = 1
+  };
+
+  return dcd_edpt_open(0, &desc);
+}
+
+static void setup(uint32_t isr_bits)
+{
+  tu_memclr(&_ev, sizeof(_ev));
+  tu_memclr(_stream, sizeof(_stream));
+  _stream_count = 0;
+  srand(1);
+
+  rp2040_model_init(NULL, task, isr_bits);
+  rp2040_model_dev_callback(host_complete);
+  dcd_init(0);
+  dcd_int_enable(0);
+}
+
+static stream_t* stream_add(uint8_t ep_addr, uint8_t xfer_type, uint16_t mps, uint32_t dev_len, uint32_t host_len)
+{
+  if ( !edpt_open(ep_addr, xfer_type, mps) ) panic("open %02x failed", ep_addr);
+
+  stream_t* s = &_stream[_stream_count++];
+  s->ep_addr  = ep_addr;
+  s->mps      = mps;
+  s->iso      = (xfer_type == TUSB_XFER_ISOCHRONOUS);
+  s->enabled  = true;
+  s->dev_len  = dev_len;
+  s->host_len = host_len;
+  return s;
+}
+
+static void run(uint32_t frames)
+{
+  for ( uint8_t i = 0; i < _stream_count; i++ )
+  {
+    dev_submit(&_stream[i]);
+    host_submit(&_stream[i]);
+  }
+
+  for ( uint32_t f = 0; f < frames; f++ ) rp2040_model_frame();
+}
+
+static uint32_t kbps(uint32_t bytes, uint32_t frames)
+{
+  return (uint32_t) ((uint64_t) bytes * 1000u / frames / 1024u);
+}
+
+static void report(void)
+{
+  rp2040_model_stat_t const* stat = rp2040_model_stat();
+  printf("  bus %u%% used, %u%% NAK, %u interrupts, toggle errors %u, iso missed %u\n",
+         (unsigned) (stat->busy_bits * 100u / ((uint64_t) stat->frames * MODEL_FRAME_BITS)),
+         (unsigned) (stat->nak_bits * 100u / ((uint64_t) stat->frames * MODEL_FRAME_BITS)),
+         (unsigned) stat->irq_count, (unsigned) stat->toggle_errors, (unsigned) stat->iso_missed);
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+static uint32_t bulk_stream(uint8_t ep_addr, uint8_t xfer_type)
+{
+  setup(ISR_BITS);
+  stream_t* s = stream_add(ep_addr, xfer_type, 64, XFER_BYTES, XFER_BYTES);
+  run(RUN_FRAMES);
+
+  uint8_t const num = tu_edpt_number(ep_addr);
+  bool const double_buf = (tu_edpt_dir(ep_addr) ? usb_dpram->ep_ctrl[num-1].in : usb_dpram->ep_ctrl[num-1].out) & EP_CTRL_DOUBLE_BUFFERED_BITS;
+  printf("  %s %s buffered: %u KB/s\n", tu_edpt_dir(ep_addr) ? "IN " : "OUT",
+         (xfer_type == TUSB_XFER_BULK) ? "double" : "single", (unsigned) kbps(s->dev_bytes, RUN_FRAMES));
+  report();
+
+  CHECK(double_buf == (xfer_type == TUSB_XFER_BULK));
+  CHECK(rp2040_model_stat()->toggle_errors == 0);
+  CHECK(s->dev_xfers > 10);
+
+  return s->dev_bytes;
+}
+
+static void test_bulk(void)
+{
+  printf("bulk stream: double buffered bulk vs single buffered interrupt endpoint\n");
+  uint32_t const out_double = bulk_stream(0x01, TUSB_XFER_BULK);
+  uint32_t const out_single = bulk_stream(0x01, TUSB_XFER_INTERRUPT);
+  uint32_t const in_double  = bulk_stream(0x81, TUSB_XFER_BULK);
+  uint32_t const in_single  = bulk_stream(0x81, TUSB_XFER_INTERRUPT);
+
+  printf("  OUT %u%%, IN %u%% of single buffered\n", (unsigned) (out_double * 100ull / out_single),
+         (unsigned) (in_double * 100ull / in_single));
+
+  // single buffered IN is refilled while host polls other endpoints, OUT has to wait for the interrupt
+  CHECK(out_double * 10ull > out_single * 15ull);
+  CHECK(in_double  * 10ull > in_single  * 11ull);
+}
+
+static void test_short_packet(void)
+{
+  printf("back to back OUT messages ending with short packet\n");
+  // longer interrupt latency: next message often arrives before the short packet is handled
+  setup(8*ISR_BITS);
+  stream_t* s = stream_add(0x02, TUSB_XFER_BULK, 64, 512, 0);
+  s->msg_max = 300;
+  run(RUN_FRAMES);
+
+  printf("  %u messages, %u received before transfer is queued\n", (unsigned) s->dev_xfers, (unsigned) _ev.early_count);
+  report();
+
+  CHECK(s->dev_xfers > 100);
+  CHECK(_ev.early_count > 0);
+  CHECK(rp2040_model_stat()->toggle_errors == 0);
+}
+
+static void test_iso(void)
+{
+  printf("isochronous OUT 1023 bytes\n");
+  setup(ISR_BITS);
+  stream_t* s = stream_add(0x03, TUSB_XFER_ISOCHRONOUS, 1023, 4*1023, 4*1023);
+  run(RUN_FRAMES);
+
+  printf("  %u KB/s\n", (unsigned) kbps(s->dev_bytes, RUN_FRAMES));
+  report();
+  CHECK(usb_dpram->ep_ctrl[2].out & EP_CTRL_DOUBLE_BUFFERED_BITS);
+  CHECK(s->dev_bytes + 4*1023 >= (RUN_FRAMES - 1) * 1023u);
+  CHECK(rp2040_model_stat()->iso_missed == 0);
+
+  printf("isochronous OUT + IN 192 bytes with bulk OUT\n");
+  setup(ISR_BITS);
+  stream_t* iso_out = stream_add(0x03, TUSB_XFER_ISOCHRONOUS, 192, 4*192, 4*192);
+  stream_t* iso_in  = stream_add(0x83, TUSB_XFER_ISOCHRONOUS, 192, 4*192, 4*192);
+  stream_t* bulk    = stream_add(0x01, TUSB_XFER_BULK, 64, XFER_BYTES, XFER_BYTES);
+  run(RUN_FRAMES);
+
+  printf("  iso out %u KB/s, iso in %u KB/s, bulk %u KB/s\n", (unsigned) kbps(iso_out->dev_bytes, RUN_FRAMES),
+         (unsigned) kbps(iso_in->dev_bytes, RUN_FRAMES), (unsigned) kbps(bulk->dev_bytes, RUN_FRAMES));
+  report();
+  CHECK(iso_out->dev_bytes + 4*192 >= (RUN_FRAMES - 1) * 192u);
+  CHECK(iso_in->host_offset + 4*192 >= (RUN_FRAMES - 1) * 192u);
+  CHECK(bulk->dev_bytes > 0);
+  CHECK(rp2040_model_stat()->iso_missed == 0);
+  CHECK(rp2040_model_stat()->toggle_errors == 0);
+}
+
+//------------- DPRAM allocator -------------//
+
+static struct
+{
+  uint16_t mps;
+  uint8_t  xfer_type;
+} _open[USB_MAX_ENDPOINTS][2];
+
+static bool alloc_open(uint8_t ep_addr, uint8_t xfer_type, uint16_t mps)
+{
+  if ( !edpt_open(ep_addr, xfer_type, mps) ) return false;
+
+  _open[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].mps       = mps;
+  _open[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].xfer_type = xfer_type;
+  return true;
+}
+
+static void alloc_close(uint8_t ep_addr)
+{
+  dcd_edpt_close(0, ep_addr);
+  _open[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].mps = 0;
+}
+
+// 64-byte blocks used by buffers of open endpoints as set in endpoint control, overlap is an error
+static uint32_t dpram_blocks(void)
+{
+  uint64_t used = 0;
+
+  for ( uint8_t num = 1; num < USB_MAX_ENDPOINTS; num++ )
+  {
+    for ( uint8_t dir = 0; dir < 2; dir++ )
+    {
+      uint16_t const mps = _open[num][dir].mps;
+      if ( !mps ) continue;
+
+      uint32_t const ep_ctrl = dir ? usb_dpram->ep_ctrl[num-1].in : usb_dpram->ep_ctrl[num-1].out;
+      CHECK(ep_ctrl & EP_CTRL_ENABLE_BITS);
+
+      uint32_t const first = ((ep_ctrl & 0xFFC0u) - offsetof(usb_device_dpram_t, epx_data)) / 64;
+      uint64_t const buf_mask = (1ull << tu_div_ceil(mps, 64)) - 1;
+      uint64_t mask = buf_mask;
+
+      if ( ep_ctrl & EP_CTRL_DOUBLE_BUFFERED_BITS )
+      {
+        uint32_t buf1 = 64;
+        if ( _open[num][dir].xfer_type == TUSB_XFER_ISOCHRONOUS )
+        {
+          for ( buf1 = 128; buf1 < mps; buf1 <<= 1 ) {}
+        }
+        mask |= buf_mask << (buf1 / 64);
+      }
+
+      CHECK(first + 64 - (uint32_t) __builtin_clzll(mask) <= sizeof(usb_dpram->epx_data) / 64);
+      CHECK(!(used & (mask << first)));
+      used |= mask << first;
+    }
+  }
+
+  return (uint32_t) __builtin_popcountll(used);
+}
+
+static void test_alloc(void)
+{
+  printf("DPRAM allocator: alternate settings switched with endpoints closed or opened again\n");
+  setup(ISR_BITS);
+  tu_memclr(_open, sizeof(_open));
+
+  CHECK(alloc_open(0x01, TUSB_XFER_BULK, 64));
+  CHECK(alloc_open(0x81, TUSB_XFER_BULK, 64));
+  CHECK(alloc_open(0x84, TUSB_XFER_INTERRUPT, 8));
+
+  uint32_t max_blocks = 0;
+  for ( uint32_t i = 0; i < 200; i++ )
+  {
+    bool const alt_a = i & 1;
+
+    // every other switch opens endpoints again without closing them
+    if ( i & 2 )
+    {
+      alloc_close(0x03);
+      alloc_close(0x83);
+    }
+
+    CHECK(alloc_open(0x03, TUSB_XFER_ISOCHRONOUS, alt_a ? 1023 : 512));
+    CHECK(alloc_open(0x83, TUSB_XFER_ISOCHRONOUS, alt_a ? 192 : 1023));
+    max_blocks = tu_max32(max_blocks, dpram_blocks());
+  }
+
+  printf("  200 switches, up to %u of %u blocks used\n", (unsigned) max_blocks, (unsigned) (sizeof(usb_dpram->epx_data) / 64));
+  CHECK(usb_dpram->ep_ctrl[2].in & EP_CTRL_DOUBLE_BUFFERED_BITS);
+
+  // DPRAM is short: single buffered, then open fails
+  alloc_close(0x83);
+  CHECK(alloc_open(0x03, TUSB_XFER_ISOCHRONOUS, 1023));
+  CHECK(alloc_open(0x83, TUSB_XFER_ISOCHRONOUS, 1023));
+  CHECK(!(usb_dpram->ep_ctrl[2].in & EP_CTRL_DOUBLE_BUFFERED_BITS));
+  CHECK(!edpt_open(0x05, TUSB_XFER_ISOCHRONOUS, 1023));
+  printf("  iso 1023 OUT double + IN single buffered: %u blocks used\n", (unsigned) dpram_blocks());
+
+  // buffers are given back on close
+  alloc_close(0x03);
+  alloc_close(0x83);
+  CHECK(dpram_blocks() == 2*2 + 1);
+  CHECK(alloc_open(0x03, TUSB_XFER_ISOCHRONOUS, 1023));
+  CHECK(usb_dpram->ep_ctrl[2].out & EP_CTRL_DOUBLE_BUFFERED_BITS);
+  dpram_blocks();
+}
+
+int main(void)
+{
+  test_bulk();
+  test_short_packet();
+  test_iso();
+  test_alloc();
+
+  return sim_result();
+}
@@ -0,0 +1,557 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "host/hcd.h"
+#include "pico.h"
+#include "rp2040_model.h"
+
+//--------------------------------------------------------------------+
+// Shared epx scheduling benchmark against the controller model
+// Full speed devices behind the root port:
+// - MSC  : bulk IN streams a pattern, bulk OUT checks it
+// - CDC  : bulk IN NAKs until a 16-byte message is ready every 10 ms, notification IN NAKs
+// - CTRL : GET_STATUS is sent every 5 ms
+// Transfers are queued again by the task as soon as they complete. Each scenario checks data,
+// data toggle and reports throughput, fairness and latency. Last, a device is closed while its
+// transfers are pending or running on epx, other devices must go on.
+//--------------------------------------------------------------------+
+
+#define RUN_FRAMES   1000
+#define XFER_BYTES   4096
+#define ISR_BITS     48     // 4 us per interrupt
+
+enum
+{
+  DEV_MSC1 = 1,
+  DEV_MSC2,
+  DEV_CDC,
+  DEV_CTRL,
+};
+
+enum
+{
+  EP_BULK_IN  = 0x81,
+  EP_BULK_OUT = 0x02,
+  EP_NOTIF    = 0x83,
+};
+
+enum
+{
+  CDC_PERIOD_MS = 10,
+  CDC_MSG_LEN   = 16,
+  CTRL_PERIOD_MS = 5,
+};
+
+//--------------------------------------------------------------------+
+// Devices
+//--------------------------------------------------------------------+
+
+static struct
+{
+  uint32_t in_offset[DEV_CTRL+1];     // pattern offset sent on bulk IN
+  uint32_t out_offset[DEV_CTRL+1];    // pattern offset expected on bulk OUT
+  uint32_t out_errors;
+
+  uint64_t cdc_ready_time;            // 0 if no message
+  uint32_t cdc_next_ms;
+  uint32_t cdc_msg_count;
+  uint64_t cdc_latency_sum;
+  uint64_t cdc_latency_max;
+
+  uint8_t  setup[8];
+} _dev;
+
+static inline uint8_t pattern(uint8_t dev_addr, uint32_t offset)
+{
+  return (uint8_t) (offset + 7u*dev_addr);
+}
+
+static int32_t device_xact(uint8_t dev_addr, uint8_t ep_addr, bool setup, uint8_t* buf, uint16_t len)
+{
+  if ( setup )
+  {
+    memcpy(_dev.setup, buf, 8);
+    return 8;
+  }
+
+  // control: 2 byte status, zero length status stage
+  if ( tu_edpt_number(ep_addr) == 0 )
+  {
+    if ( tu_edpt_dir(ep_addr) )
+    {
+      uint16_t const count = tu_min16(len, 2);
+      memset(buf, 0, count);
+      return count;
+    }
+    return len;
+  }
+
+  if ( ep_addr == EP_NOTIF ) return -1;
+
+  if ( dev_addr == DEV_CDC )
+  {
+    if ( ep_addr != EP_BULK_IN || !_dev.cdc_ready_time ) return -1;
+
+    uint64_t const latency = rp2040_model_time() - _dev.cdc_ready_time;
+    _dev.cdc_latency_sum += latency;
+    _dev.cdc_latency_max  = tu_max32((uint32_t) _dev.cdc_latency_max, (uint32_t) latency);
+    _dev.cdc_msg_count++;
+    _dev.cdc_ready_time = 0;
+
+    uint16_t const count = tu_min16(len, CDC_MSG_LEN);
+    memset(buf, 'c', count);
+    return count;
+  }
+
+  if ( ep_addr == EP_BULK_IN )
+  {
+    for(uint16_t i = 0; i < len; i++) buf[i] = pattern(dev_addr, _dev.in_offset[dev_addr]++);
+    return len;
+  }
+
+  for(uint16_t i = 0; i < len; i++)
+  {
+    if ( buf[i] != pattern(dev_addr, _dev.out_offset[dev_addr]++) ) _dev.out_errors++;
+  }
+  return len;
+}
+
+//--------------------------------------------------------------------+
+// USBH stubs
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint8_t  dev_addr;
+  uint8_t  ep_addr;
+  uint8_t  result;
+  uint32_t len;
+} event_t;
+
+static event_t  _events[64];
+static uint32_t _event_count;
+
+tusb_speed_t tuh_speed_get(uint8_t dev_addr)
+{
+  (void) dev_addr;
+  return TUSB_SPEED_FULL;
+}
+
+void hcd_event_handler(hcd_event_t const* event, bool in_isr)
+{
+  (void) event; (void) in_isr;
+}
+
+void hcd_event_device_attach(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_device_remove(uint8_t rhport, bool in_isr)
+{
+  (void) rhport; (void) in_isr;
+}
+
+void hcd_event_xfer_complete(uint8_t dev_addr, uint8_t ep_addr, uint32_t xferred_bytes, xfer_result_t result, bool in_isr)
+{
+  (void) in_isr;
+  if ( _event_count >= TU_ARRAY_SIZE(_events) ) panic("event queue overflow");
+
+  _events[_event_count++] = (event_t) { .dev_addr = dev_addr, .ep_addr = ep_addr, .result = (uint8_t) result, .len = xferred_bytes };
+}
+
+//--------------------------------------------------------------------+
+// Host application
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint8_t  dev_addr;
+  uint8_t  ep_addr;
+  bool     enabled;
+  uint32_t offset;      // pattern offset
+  uint32_t bytes;
+  uint32_t errors;
+  uint8_t  buf[XFER_BYTES];
+} stream_t;
+
+static stream_t _stream[4];
+static uint8_t  _stream_count;
+
+static struct
+{
+  bool     enabled;
+  uint8_t  stage;       // 0: idle, 1: setup, 2: data, 3: status
+  uint8_t  buf[8];
+  uint32_t next_ms;
+  uint32_t count;
+  uint64_t start_time;
+  uint64_t latency_max;
+} _ctrl;
+
+static uint8_t _cdc_buf[64];
+static bool    _cdc_enabled;
+static uint32_t _cdc_bytes;
+
+static void stream_submit(stream_t* s)
+{
+  uint32_t const len = tu_edpt_dir(s->ep_addr) ? XFER_BYTES : (XFER_BYTES - 37);
+
+  if ( !tu_edpt_dir(s->ep_addr) )
+  {
+    for(uint32_t i = 0; i < len; i++) s->buf[i] = pattern(s->dev_addr, s->offset + i);
+  }
+
+  if ( !hcd_edpt_xfer(0, s->dev_addr, s->ep_addr, s->buf, (uint16_t) len) ) panic("xfer failed");
+}
+
+static void stream_complete(stream_t* s, uint32_t len)
+{
+  if ( tu_edpt_dir(s->ep_addr) )
+  {
+    for(uint32_t i = 0; i < len; i++)
+    {
+      if ( s->buf[i] != pattern(s->dev_addr, s->offset + i) ) s->errors++;
+    }
+  }
+
+  s->offset += len;
+  s->bytes  += len;
+  stream_submit(s);
+}
+
+static void ctrl_complete(void)
+{
+  switch ( _ctrl.stage )
+  {
+    case 1:
+      _ctrl.stage = 2;
+      hcd_edpt_xfer(0, DEV_CTRL, 0x80, _ctrl.buf, 2);
+    break;
+
+    case 2:
+      _ctrl.stage = 3;
+      hcd_edpt_xfer(0, DEV_CTRL, 0x00, NULL, 0);
+    break;
+
+    default:
+    {
+      uint64_t const latency = rp2040_model_time() - _ctrl.start_time;
+      _ctrl.latency_max = tu_max32((uint32_t) _ctrl.latency_max, (uint32_t) latency);
+      _ctrl.count++;
+      _ctrl.stage = 0;
+    }
+    break;
+  }
+}
+
+static void task(void)
+{
+  uint32_t const ms = rp2040_model_stat()->frames;
+
+  // device side: CDC message
+  if ( _cdc_enabled && ms >= _dev.cdc_next_ms )
+  {
+    _dev.cdc_next_ms += CDC_PERIOD_MS;
+    if ( !_dev.cdc_ready_time ) _dev.cdc_ready_time = rp2040_model_time();
+  }
+
+  if ( _ctrl.enabled && !_ctrl.stage && ms >= _ctrl.next_ms )
+  {
+    static tusb_control_request_t const request =
+    {
+      .bmRequestType = 0x80,
+      .bRequest      = TUSB_REQ_GET_STATUS,
+      .wValue        = 0,
+      .wIndex        = 0,
+      .wLength       = 2
+    };
+
+    _ctrl.next_ms   += CTRL_PERIOD_MS;
+    _ctrl.stage      = 1;
+    _ctrl.start_time = rp2040_model_time();
+    hcd_setup_send(0, DEV_CTRL, (uint8_t const*) &request);
+  }
+
+  for(uint32_t i = 0; i < _event_count; i++)
+  {
+    event_t const* ev = &_events[i];
+    if ( ev->result != XFER_RESULT_SUCCESS ) panic("dev %u ep %02x failed %u", ev->dev_addr, ev->ep_addr, ev->result);
+
+    if ( tu_edpt_number(ev->ep_addr) == 0 )
+    {
+      ctrl_complete();
+    }else if ( ev->dev_addr == DEV_CDC )
+    {
+      if ( ev->ep_addr == EP_BULK_IN )
+      {
+        _cdc_bytes += ev->len;
+        hcd_edpt_xfer(0, DEV_CDC, EP_BULK_IN, _cdc_buf, sizeof(_cdc_buf));
+      }
+    }else
+    {
+      for(uint8_t s = 0; s < _stream_count; s++)
+      {
+        stream_t* st = &_stream[s];
+        if ( st->enabled && st->dev_addr == ev->dev_addr && st->ep_addr == ev->ep_addr ) stream_complete(st, ev->len);
+      }
+    }
+  }
+  _event_count = 0;
+}
+
+//--------------------------------------------------------------------+
+// Scenarios
+//--------------------------------------------------------------------+
+
+static void edpt_open(uint8_t dev_addr, uint8_t ep_addr, uint8_t xfer_type, uint16_t size, uint8_t interval)
+{
+  tusb_desc_endpoint_t const desc =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep_addr,
+    .bmAttributes     = { .xfer = xfer_type },
+    .wMaxPacketSize   = tu_htole16(size),
+    .bInterval        = interval
+  };
+
+  if ( !hcd_edpt_open(0, dev_addr, &desc) ) panic("open failed");
+}
+
+static void setup(void)
+{
+  tu_memclr(&_dev, sizeof(_dev));
+  tu_memclr(_stream, sizeof(_stream));
+  tu_memclr(&_ctrl, sizeof(_ctrl));
+  _stream_count = 0;
+  _event_count  = 0;
+  _cdc_enabled  = false;
+  _cdc_bytes    = 0;
+
+  rp2040_model_init(device_xact, task, ISR_BITS);
+  hcd_init(0);
+  hcd_int_enable(0);
+  rp2040_model_attach();
+
+  for(uint8_t dev_addr = DEV_MSC1; dev_addr <= DEV_CTRL; dev_addr++)
+  {
+    edpt_open(dev_addr, 0x00, TUSB_XFER_CONTROL, 64, 0);
+  }
+
+  edpt_open(DEV_MSC1, EP_BULK_IN , TUSB_XFER_BULK, 64, 0);
+  edpt_open(DEV_MSC1, EP_BULK_OUT, TUSB_XFER_BULK, 64, 0);
+  edpt_open(DEV_MSC2, EP_BULK_IN , TUSB_XFER_BULK, 64, 0);
+  edpt_open(DEV_CDC , EP_BULK_IN , TUSB_XFER_BULK, 64, 0);
+  edpt_open(DEV_CDC , EP_NOTIF   , TUSB_XFER_INTERRUPT, 16, 16);
+}
+
+static stream_t* stream_add(uint8_t dev_addr, uint8_t ep_addr)
+{
+  stream_t* s = &_stream[_stream_count++];
+  s->dev_addr = dev_addr;
+  s->ep_addr  = ep_addr;
+  s->enabled  = true;
+  return s;
+}
+
+static void cdc_start(void)
+{
+  static uint8_t notif[16];
+
+  _cdc_enabled     = true;
+  _dev.cdc_next_ms = 3;
+  hcd_edpt_xfer(0, DEV_CDC, EP_BULK_IN, _cdc_buf, sizeof(_cdc_buf));
+  hcd_edpt_xfer(0, DEV_CDC, EP_NOTIF, notif, sizeof(notif));
+}
+
+static void run(void)
+{
+  for(uint8_t s = 0; s < _stream_count; s++) stream_submit(&_stream[s]);
+
+  for(uint32_t f = 0; f < RUN_FRAMES; f++) rp2040_model_frame();
+}
+
+static uint32_t kbps(uint32_t bytes)
+{
+  // bytes per RUN_FRAMES ms
+  return (uint32_t) ((uint64_t) bytes * 1000u / RUN_FRAMES / 1024u);
+}
+
+static uint32_t bits_to_us(uint64_t bits)
+{
+  return (uint32_t) (bits / 12u);
+}
+
+static bool check_common(char const* name)
+{
+  rp2040_model_stat_t const* stat = rp2040_model_stat();
+  uint32_t errors = _dev.out_errors;
+  for(uint8_t s = 0; s < _stream_count; s++) errors += _stream[s].errors;
+
+  printf("  bus %u%% used, %u%% NAK, %u interrupts, toggle errors %u, data errors %u\n",
+         (unsigned) (stat->busy_bits * 100u / ((uint64_t) stat->frames * MODEL_FRAME_BITS)),
+         (unsigned) (stat->nak_bits * 100u / ((uint64_t) stat->frames * MODEL_FRAME_BITS)),
+         (unsigned) stat->irq_count, (unsigned) stat->toggle_errors, (unsigned) errors);
+
+  if ( stat->toggle_errors || errors )
+  {
+    printf("%s: FAILED\n", name);
+    return false;
+  }
+  return true;
+}
+
+// Single bulk IN stream: reference throughput
+static uint32_t _msc_alone;
+
+static bool scenario_msc(void)
+{
+  printf("msc read alone\n");
+  setup();
+  stream_t* msc = stream_add(DEV_MSC1, EP_BULK_IN);
+  run();
+
+  _msc_alone = msc->bytes;
+  printf("  msc %u KB/s\n", (unsigned) kbps(msc->bytes));
+
+  return check_common("msc");
+}
+
+// Idle CDC IN (NAK most of the time) must not hold epx
+static bool scenario_msc_cdc(void)
+{
+  printf("msc read + cdc in\n");
+  setup();
+  stream_t* msc = stream_add(DEV_MSC1, EP_BULK_IN);
+  cdc_start();
+  run();
+
+  uint32_t const avg_us = _dev.cdc_msg_count ? bits_to_us(_dev.cdc_latency_sum / _dev.cdc_msg_count) : 0;
+  printf("  msc %u KB/s (%u%% of alone), cdc %u messages, latency avg %u us max %u us\n",
+         (unsigned) kbps(msc->bytes), (unsigned) (msc->bytes * 100ull / _msc_alone),
+         (unsigned) _dev.cdc_msg_count, (unsigned) avg_us, (unsigned) bits_to_us(_dev.cdc_latency_max));
+
+  bool ok = check_common("msc + cdc");
+  if ( msc->bytes*100ull < _msc_alone*85ull || _dev.cdc_msg_count < RUN_FRAMES/CDC_PERIOD_MS - 1 ||
+       bits_to_us(_dev.cdc_latency_max) > 20000u )
+  {
+    printf("msc + cdc: FAILED\n");
+    ok = false;
+  }
+  return ok;
+}
+
+// Two bulk IN streams get the same share
+static bool scenario_two_msc(void)
+{
+  printf("two msc read\n");
+  setup();
+  stream_t* msc1 = stream_add(DEV_MSC1, EP_BULK_IN);
+  stream_t* msc2 = stream_add(DEV_MSC2, EP_BULK_IN);
+  run();
+
+  uint32_t const total = msc1->bytes + msc2->bytes;
+  uint32_t const diff  = (msc1->bytes > msc2->bytes) ? (msc1->bytes - msc2->bytes) : (msc2->bytes - msc1->bytes);
+  printf("  msc1 %u KB/s, msc2 %u KB/s, combined %u%% of alone\n", (unsigned) kbps(msc1->bytes),
+         (unsigned) kbps(msc2->bytes), (unsigned) (total * 100ull / _msc_alone));
+
+  bool ok = check_common("two msc");
+  if ( diff*100ull > total*5ull || total*100ull < _msc_alone*90ull )
+  {
+    printf("two msc: FAILED\n");
+    ok = false;
+  }
+  return ok;
+}
+
+// Read, write, CDC, notification and control transfers together
+static bool scenario_mixed(void)
+{
+  printf("mixed: msc read + msc write + msc2 read + cdc + control\n");
+  setup();
+  stream_t* rd  = stream_add(DEV_MSC1, EP_BULK_IN);
+  stream_t* wr  = stream_add(DEV_MSC1, EP_BULK_OUT);
+  stream_t* rd2 = stream_add(DEV_MSC2, EP_BULK_IN);
+  cdc_start();
+  _ctrl.enabled = true;
+  _ctrl.next_ms = 1;
+  run();
+
+  uint32_t const total = rd->bytes + wr->bytes + rd2->bytes;
+  printf("  read %u KB/s, write %u KB/s, read2 %u KB/s, combined %u KB/s\n", (unsigned) kbps(rd->bytes),
+         (unsigned) kbps(wr->bytes), (unsigned) kbps(rd2->bytes), (unsigned) kbps(total));
+  printf("  cdc %u messages, latency max %u us, control %u transfers, latency max %u us\n",
+         (unsigned) _dev.cdc_msg_count, (unsigned) bits_to_us(_dev.cdc_latency_max),
+         (unsigned) _ctrl.count, (unsigned) bits_to_us(_ctrl.latency_max));
+
+  uint32_t const diff = (rd->bytes > rd2->bytes) ? (rd->bytes - rd2->bytes) : (rd2->bytes - rd->bytes);
+
+  bool ok = check_common("mixed");
+  if ( diff*100ull > rd->bytes*10ull || !wr->bytes || _ctrl.count < RUN_FRAMES/CTRL_PERIOD_MS - 1 ||
+       bits_to_us(_ctrl.latency_max) > 5000u || _dev.cdc_msg_count < RUN_FRAMES/CDC_PERIOD_MS - 2 )
+  {
+    printf("mixed: FAILED\n");
+    ok = false;
+  }
+
+  // close device with read & write streams, its transfers are dropped from epx
+  printf("  close msc1\n");
+  rd->enabled = wr->enabled = false;
+  hcd_device_close(0, DEV_MSC1);
+
+  uint32_t const rd2_bytes = rd2->bytes;
+  uint32_t const ctrl_count = _ctrl.count;
+  for(uint32_t f = 0; f < 100; f++) rp2040_model_frame();
+
+  printf("  read2 %u KB/s, control %u transfers\n", (unsigned) kbps((rd2->bytes - rd2_bytes)*10u),
+         (unsigned) (_ctrl.count - ctrl_count));
+
+  ok &= check_common("close");
+  if ( (rd2->bytes - rd2_bytes)*10u*100ull < _msc_alone*75ull || _ctrl.count - ctrl_count < 100/CTRL_PERIOD_MS - 1 )
+  {
+    printf("close: FAILED\n");
+    ok = false;
+  }
+  return ok;
+}
+
+int main(void)
+{
+  bool ok = true;
+
+  ok &= scenario_msc();
+  ok &= scenario_msc_cdc();
+  ok &= scenario_two_msc();
+  ok &= scenario_mixed();
+
+  printf(ok ? "PASSED\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _HARDWARE_STRUCTS_USB_H_
+#define _HARDWARE_STRUCTS_USB_H_
+
+#include "pico.h"
+
+//--------------------------------------------------------------------+
+// USB controller registers and DPRAM layout as pico-sdk, only bits used by the port
+//--------------------------------------------------------------------+
+
+#define USB_MAX_ENDPOINTS            16
+#define USB_HOST_INTERRUPT_ENDPOINTS (USB_MAX_ENDPOINTS - 1)
+
+typedef struct
+{
+  io_rw_32 dev_addr_ctrl;
+  io_rw_32 int_ep_addr_ctrl[USB_HOST_INTERRUPT_ENDPOINTS];
+  io_rw_32 main_ctrl;
+  io_rw_32 sof_wr;
+  io_ro_32 sof_rd;
+  io_rw_32 sie_ctrl;
+  io_rw_32 sie_status;
+  io_rw_32 int_ep_ctrl;
+  io_rw_32 buf_status;
+  io_ro_32 buf_cpu_should_handle;
+  io_rw_32 abort;
+  io_rw_32 abort_done;
+  io_rw_32 ep_stall_arm;
+  io_rw_32 nak_poll;
+  io_rw_32 ep_nak_stall_status;
+  io_rw_32 muxing;
+  io_rw_32 pwr;
+  io_rw_32 phy_direct;
+  io_rw_32 phy_direct_override;
+  io_rw_32 phy_trim;
+  uint32_t _pad0;
+  io_ro_32 intr;
+  io_rw_32 inte;
+  io_rw_32 intf;
+  io_ro_32 ints;
+} usb_hw_t;
+
+typedef struct
+{
+  volatile uint8_t setup_packet[8];
+
+  struct usb_device_dpram_ep_ctrl
+  {
+    io_rw_32 in;
+    io_rw_32 out;
+  } ep_ctrl[USB_MAX_ENDPOINTS - 1];
+
+  struct usb_device_dpram_ep_buf_ctrl
+  {
+    io_rw_32 in;
+    io_rw_32 out;
+  } ep_buf_ctrl[USB_MAX_ENDPOINTS];
+
+  uint8_t ep0_buf_a[0x40];
+  uint8_t ep0_buf_b[0x40];
+  uint8_t epx_data[4096 - 0x180];
+} usb_device_dpram_t;
+
+typedef struct
+{
+  volatile uint8_t setup_packet[8];
+
+  struct usb_host_dpram_ep_ctrl
+  {
+    io_rw_32 ctrl;
+    io_rw_32 spare;
+  } int_ep_ctrl[USB_HOST_INTERRUPT_ENDPOINTS];
+
+  io_rw_32 epx_buf_ctrl;
+  io_rw_32 _spare0;
+
+  struct usb_host_dpram_ep_buf_ctrl
+  {
+    io_rw_32 ctrl;
+    io_rw_32 spare;
+  } int_ep_buffer_ctrl[USB_HOST_INTERRUPT_ENDPOINTS];
+
+  io_rw_32 epx_ctrl;
+  uint8_t _spare1[124];
+  uint8_t epx_data[4096 - 0x180];
+} usb_host_dpram_t;
+
+// registers and 4K aligned DPRAM of the model
+extern usb_hw_t rp2040_model_regs;
+extern uint8_t  rp2040_model_dpram[4096];
+
+#define usb_hw     (&rp2040_model_regs)
+#define usb_dpram  ((usb_device_dpram_t*) rp2040_model_dpram)
+#define usbh_dpram ((usb_host_dpram_t*) rp2040_model_dpram)
+
+// Endpoint and buffer control
+#define EP_CTRL_ENABLE_BITS                  (1u << 31u)
+#define EP_CTRL_DOUBLE_BUFFERED_BITS         (1u << 30u)
+#define EP_CTRL_INTERRUPT_PER_BUFFER         (1u << 29u)
+#define EP_CTRL_INTERRUPT_PER_DOUBLE_BUFFER  (1u << 28u)
+#define EP_CTRL_BUFFER_TYPE_LSB              26u
+#define EP_CTRL_HOST_INTERRUPT_INTERVAL_LSB  16u
+
+#define USB_BUF_CTRL_FULL      0x00008000u
+#define USB_BUF_CTRL_LAST      0x00004000u
+#define USB_BUF_CTRL_DATA0_PID 0x00000000u
+#define USB_BUF_CTRL_DATA1_PID 0x00002000u
+#define USB_BUF_CTRL_SEL       0x00001000u
+#define USB_BUF_CTRL_STALL     0x00000800u
+#define USB_BUF_CTRL_AVAIL     0x00000400u
+#define USB_BUF_CTRL_LEN_MASK  0x000003FFu
+
+// ADDR_ENDP
+#define USB_ADDR_ENDP_ENDPOINT_LSB          16u
+#define USB_ADDR_ENDP1_ENDPOINT_LSB         16u
+#define USB_ADDR_ENDP1_INTEP_DIR_BITS       0x02000000u
+#define USB_ADDR_ENDP1_INTEP_PREAMBLE_BITS  0x04000000u
+
+// EP_STALL_ARM
+#define USB_EP_STALL_ARM_EP0_IN_BITS        0x00000001u
+#define USB_EP_STALL_ARM_EP0_OUT_BITS       0x00000002u
+
+// MAIN_CTRL
+#define USB_MAIN_CTRL_CONTROLLER_EN_BITS    0x00000001u
+#define USB_MAIN_CTRL_HOST_NDEVICE_BITS     0x00000002u
+
+// SIE_CTRL
+#define USB_SIE_CTRL_START_TRANS_BITS       0x00000001u
+#define USB_SIE_CTRL_SEND_SETUP_BITS        0x00000002u
+#define USB_SIE_CTRL_SEND_DATA_BITS         0x00000004u
+#define USB_SIE_CTRL_RECEIVE_DATA_BITS      0x00000008u
+#define USB_SIE_CTRL_STOP_TRANS_BITS        0x00000010u
+#define USB_SIE_CTRL_PREAMBLE_EN_BITS       0x00000040u
+#define USB_SIE_CTRL_SOF_EN_BITS            0x00000200u
+#define USB_SIE_CTRL_KEEP_ALIVE_EN_BITS     0x00000400u
+#define USB_SIE_CTRL_RESUME_BITS            0x00001000u
+#define USB_SIE_CTRL_PULLDOWN_EN_BITS       0x00008000u
+#define USB_SIE_CTRL_PULLUP_EN_BITS         0x00010000u
+#define USB_SIE_CTRL_EP0_INT_1BUF_BITS      0x20000000u
+
+// SIE_STATUS
+#define USB_SIE_STATUS_SUSPENDED_BITS       0x00000010u
+#define USB_SIE_STATUS_SPEED_BITS           0x00000300u
+#define USB_SIE_STATUS_SPEED_LSB            8u
+#define USB_SIE_STATUS_RESUME_BITS          0x00000800u
+#define USB_SIE_STATUS_CONNECTED_BITS       0x00010000u
+#define USB_SIE_STATUS_SETUP_REC_BITS       0x00020000u
+#define USB_SIE_STATUS_TRANS_COMPLETE_BITS  0x00040000u
+#define USB_SIE_STATUS_BUS_RESET_BITS       0x00080000u
+#define USB_SIE_STATUS_RX_TIMEOUT_BITS      0x08000000u
+#define USB_SIE_STATUS_NAK_REC_BITS         0x10000000u
+#define USB_SIE_STATUS_STALL_REC_BITS       0x20000000u
+#define USB_SIE_STATUS_DATA_SEQ_ERROR_BITS  0x80000000u
+
+// NAK_POLL
+#define USB_NAK_POLL_DELAY_FS_LSB           16u
+#define USB_NAK_POLL_DELAY_LS_LSB           0u
+
+// USB_MUXING & USB_PWR
+#define USB_USB_MUXING_TO_PHY_BITS              0x00000001u
+#define USB_USB_MUXING_SOFTCON_BITS             0x00000008u
+#define USB_USB_PWR_VBUS_DETECT_BITS            0x00000004u
+#define USB_USB_PWR_VBUS_DETECT_OVERRIDE_EN_BITS 0x00000008u
+
+// INTR, INTE, INTS
+#define USB_INTS_HOST_CONN_DIS_BITS       0x00000001u
+#define USB_INTS_HOST_RESUME_BITS         0x00000002u
+#define USB_INTS_HOST_SOF_BITS            0x00000004u
+#define USB_INTS_TRANS_COMPLETE_BITS      0x00000008u
+#define USB_INTS_BUFF_STATUS_BITS         0x00000010u
+#define USB_INTS_ERROR_DATA_SEQ_BITS      0x00000020u
+#define USB_INTS_ERROR_RX_TIMEOUT_BITS    0x00000040u
+#define USB_INTS_ERROR_RX_OVERFLOW_BITS   0x00000080u
+#define USB_INTS_ERROR_BIT_STUFF_BITS     0x00000100u
+#define USB_INTS_ERROR_CRC_BITS           0x00000200u
+#define USB_INTS_STALL_BITS               0x00000400u
+#define USB_INTS_BUS_RESET_BITS           0x00001000u
+#define USB_INTS_DEV_CONN_DIS_BITS        0x00002000u
+#define USB_INTS_DEV_SUSPEND_BITS         0x00004000u
+#define USB_INTS_DEV_RESUME_FROM_HOST_BITS 0x00008000u
+#define USB_INTS_SETUP_REQ_BITS           0x00010000u
+
+#define USB_INTE_HOST_CONN_DIS_BITS       USB_INTS_HOST_CONN_DIS_BITS
+#define USB_INTE_HOST_RESUME_BITS         USB_INTS_HOST_RESUME_BITS
+#define USB_INTE_HOST_SOF_BITS            USB_INTS_HOST_SOF_BITS
+#define USB_INTE_TRANS_COMPLETE_BITS      USB_INTS_TRANS_COMPLETE_BITS
+#define USB_INTE_BUFF_STATUS_BITS         USB_INTS_BUFF_STATUS_BITS
+#define USB_INTE_ERROR_DATA_SEQ_BITS      USB_INTS_ERROR_DATA_SEQ_BITS
+#define USB_INTE_ERROR_RX_TIMEOUT_BITS    USB_INTS_ERROR_RX_TIMEOUT_BITS
+#define USB_INTE_STALL_BITS               USB_INTS_STALL_BITS
+
+#endif /* _HARDWARE_STRUCTS_USB_H_ */
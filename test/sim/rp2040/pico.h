@@ -0,0 +1,71 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _PICO_H_
+#define _PICO_H_
+
+//--------------------------------------------------------------------+
+// Stand-in of pico-sdk headers needed by the rp2040 port, registers and
+// DPRAM are memory of the controller model (rp2040_model.c)
+//--------------------------------------------------------------------+
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+typedef volatile uint32_t io_rw_32;
+typedef volatile uint32_t const io_ro_32;
+typedef volatile uint16_t io_rw_16;
+
+// Atomic set/clear register aliases are shadow registers applied by the model
+void* rp2040_model_set_alias(void const volatile* reg);
+void* rp2040_model_clear_alias(void const volatile* reg);
+
+#define hw_set_alias(p)   ((__typeof__(p)) rp2040_model_set_alias(p))
+#define hw_clear_alias(p) ((__typeof__(p)) rp2040_model_clear_alias(p))
+
+// Busy wait loops let the model apply register writes (EP_ABORT)
+void rp2040_model_poll(void);
+
+static inline void tight_loop_contents(void)
+{
+  rp2040_model_poll();
+}
+
+static inline void busy_wait_at_least_cycles(uint32_t minimum_cycles)
+{
+  (void) minimum_cycles;
+}
+
+void panic(const char* fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+#endif /* _PICO_H_ */
@@ -0,0 +1,925 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tusb.h"
+#include "hardware/structs/usb.h"
+#include "hardware/irq.h"
+#include "hardware/resets.h"
+#include "rp2040_model.h"
+
+//--------------------------------------------------------------------+
+// Register level RP2040 USB controller model
+//--------------------------------------------------------------------+
+
+// Full speed bit times: token and handshake packets with sync and EOP, data packet without
+// payload (bit stuffing is not counted) and inter-packet gap
+enum
+{
+  BITS_TOKEN     = 35,
+  BITS_HANDSHAKE = 19,
+  BITS_DATA      = 35,
+  BITS_GAP       = 8,
+  BITS_EOF       = 64,  // no transaction is started in this window before next SOF
+};
+
+typedef enum
+{
+  XACT_ACK = 0,
+  XACT_NAK,
+  XACT_STALL,
+  XACT_WAIT,            // not started: buffer is not available or does not fit in frame
+} xact_result_t;
+
+usb_hw_t rp2040_model_regs;
+uint8_t  rp2040_model_dpram[4096] TU_ATTR_ALIGNED(4096);
+
+// Alias write is pending in shadow registers until next alias is taken or registers are applied
+static usb_hw_t _alias;
+static enum { ALIAS_NONE, ALIAS_SET, ALIAS_CLEAR } _alias_type;
+
+static irq_handler_t       _irq_handler;
+static bool                _irq_enabled;
+static rp2040_model_xact_t _xact_cb;
+static rp2040_model_task_t _task_cb;
+static uint32_t            _isr_bits;
+static rp2040_model_stat_t _stat;
+
+static uint64_t _time;
+static bool     _conn_change;
+static bool     _sof_pending;
+static uint16_t _int_poll[USB_HOST_INTERRUPT_ENDPOINTS];  // frames until next poll
+
+// device side data toggle
+static uint8_t _toggle[128][16][2];
+
+// epx transaction
+static struct
+{
+  bool     active;
+  bool     setup;
+  uint8_t  buf_id;
+  uint64_t retry_time;  // NAK retried after NAK_POLL delay
+} _epx;
+
+// device mode: host side transfer per device endpoint
+typedef struct
+{
+  bool     busy;
+  bool     iso;
+  uint16_t mps;
+  uint8_t* buf;
+  uint32_t len;
+  uint32_t xferred;
+  bool     stalled;
+} dev_xfer_t;
+
+enum
+{
+  CTRL_IDLE = 0,
+  CTRL_SETUP,
+  CTRL_DATA,
+  CTRL_STATUS,
+};
+
+// device mode: host side control transfer, its data and status stages run on endpoint 0 transfers
+static struct
+{
+  uint8_t  stage;
+  uint8_t  setup[8];
+  uint8_t* buf;
+  uint32_t xferred;
+  bool     stalled;
+} _dev_ctrl;
+
+static dev_xfer_t _dev_xfer[USB_MAX_ENDPOINTS][2];
+static uint8_t    _dev_sel[USB_MAX_ENDPOINTS][2];   // buffer selector
+static uint8_t    _dev_rr;                          // round robin among bulk & interrupt endpoints
+static uint8_t    _buf_pending[32];                 // buffer status raised again when it is cleared
+static uint64_t   _irq_due;                         // device interrupt is handled at this time
+static rp2040_model_dev_cb_t _dev_cb;
+
+#define REG(_x)  (*(volatile uint32_t*) (uintptr_t) &rp2040_model_regs._x)
+
+//--------------------------------------------------------------------+
+// Registers
+//--------------------------------------------------------------------+
+
+static void apply_alias(void)
+{
+  if ( _alias_type == ALIAS_NONE ) return;
+
+  // clearing speed bits clears the connect/disconnect latch
+  if ( _alias_type == ALIAS_CLEAR && (_alias.sie_status & USB_SIE_STATUS_SPEED_BITS) )
+  {
+    _conn_change = false;
+    _alias.sie_status &= ~USB_SIE_STATUS_SPEED_BITS;
+  }
+
+  volatile uint32_t* regs = (volatile uint32_t*) (uintptr_t) &rp2040_model_regs;
+  uint32_t const* alias = (uint32_t const*) &_alias;
+
+  for(size_t i = 0; i < sizeof(usb_hw_t)/4; i++)
+  {
+    regs[i] = (_alias_type == ALIAS_SET) ? (regs[i] | alias[i]) : (regs[i] & ~alias[i]);
+  }
+
+  // a buffer completed while its status bit is still set is reported once that is cleared
+  if ( _alias_type == ALIAS_CLEAR )
+  {
+    for(uint8_t i = 0; i < 32; i++)
+    {
+      if ( (_alias.buf_status & TU_BIT(i)) && _buf_pending[i] )
+      {
+        _buf_pending[i]--;
+        REG(buf_status) |= TU_BIT(i);
+      }
+    }
+  }
+
+  _alias_type = ALIAS_NONE;
+
+  // STOP_TRANS takes effect right away
+  if ( REG(sie_ctrl) & USB_SIE_CTRL_STOP_TRANS_BITS )
+  {
+    _epx.active = false;
+    REG(sie_ctrl) &= ~USB_SIE_CTRL_STOP_TRANS_BITS;
+  }
+}
+
+static void* take_alias(void const volatile* reg, uint8_t type)
+{
+  if ( reg != &rp2040_model_regs ) panic("alias is only modeled for usb_hw");
+
+  apply_alias();
+  tu_memclr(&_alias, sizeof(_alias));
+  _alias_type = type;
+
+  return &_alias;
+}
+
+void* rp2040_model_set_alias(void const volatile* reg)
+{
+  return take_alias(reg, ALIAS_SET);
+}
+
+void* rp2040_model_clear_alias(void const volatile* reg)
+{
+  return take_alias(reg, ALIAS_CLEAR);
+}
+
+// Apply alias write, then SIE_CTRL START_TRANS. EP_ABORT is done right away (between transactions)
+static void apply_regs(void)
+{
+  apply_alias();
+
+  REG(abort_done) = REG(abort);
+
+  uint32_t const sie_ctrl = REG(sie_ctrl);
+
+  if ( sie_ctrl & USB_SIE_CTRL_START_TRANS_BITS )
+  {
+    if ( _epx.active ) panic("START_TRANS while transaction is in progress");
+
+    _epx.active     = true;
+    _epx.setup      = (sie_ctrl & USB_SIE_CTRL_SEND_SETUP_BITS) != 0;
+    _epx.buf_id     = 0;
+    _epx.retry_time = 0;
+  }
+
+  REG(sie_ctrl) = sie_ctrl & ~USB_SIE_CTRL_START_TRANS_BITS;
+}
+
+static void update_ints(void)
+{
+  uint32_t const sie_status = REG(sie_status);
+  uint32_t intr = 0;
+
+  if ( _conn_change                                    ) intr |= USB_INTS_HOST_CONN_DIS_BITS;
+  if ( _sof_pending                                    ) intr |= USB_INTS_HOST_SOF_BITS;
+  if ( sie_status & USB_SIE_STATUS_TRANS_COMPLETE_BITS ) intr |= USB_INTS_TRANS_COMPLETE_BITS;
+  if ( REG(buf_status)                                 ) intr |= USB_INTS_BUFF_STATUS_BITS;
+  if ( sie_status & USB_SIE_STATUS_STALL_REC_BITS      ) intr |= USB_INTS_STALL_BITS;
+  if ( sie_status & USB_SIE_STATUS_DATA_SEQ_ERROR_BITS ) intr |= USB_INTS_ERROR_DATA_SEQ_BITS;
+  if ( sie_status & USB_SIE_STATUS_SETUP_REC_BITS      ) intr |= USB_INTS_SETUP_REQ_BITS;
+  if ( sie_status & USB_SIE_STATUS_BUS_RESET_BITS      ) intr |= USB_INTS_BUS_RESET_BITS;
+
+  REG(intr) = intr;
+  REG(ints) = (intr & REG(inte)) | REG(intf);
+}
+
+// Interrupt handler while enabled, then usbh task
+static void service(void)
+{
+  for(uint32_t loop = 0; ; loop++)
+  {
+    apply_regs();
+    update_ints();
+
+    if ( !_irq_enabled || !_irq_handler || !REG(ints) ) break;
+    if ( loop > 16 ) panic("interrupt storm 0x%08x", REG(ints));
+
+    bool const sof = REG(ints) & USB_INTS_HOST_SOF_BITS;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    _irq_handler();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    _stat.irq_count++;
+    _stat.isr_ns += (uint64_t) (t1.tv_sec - t0.tv_sec)*1000000000u + (uint64_t) (t1.tv_nsec - t0.tv_nsec);
+
+    // host controller: bus is idle while handler runs
+    if ( REG(main_ctrl) & USB_MAIN_CTRL_HOST_NDEVICE_BITS ) _time += _isr_bits;
+
+    if ( sof ) _sof_pending = false;
+  }
+
+  if ( _task_cb )
+  {
+    _task_cb();
+    apply_regs();
+    update_ints();
+  }
+}
+
+//--------------------------------------------------------------------+
+// Transactions
+//--------------------------------------------------------------------+
+
+static int32_t device_xact(uint8_t dev_addr, uint8_t ep_addr, bool setup, uint8_t* buf, uint16_t len)
+{
+  return _xact_cb ? _xact_cb(dev_addr, ep_addr, setup, buf, len) : -1;
+}
+
+// Data packet on buffer (buf_id half of buffer control), frame_end limits its start
+static xact_result_t buffer_xact(uint8_t dev_addr, uint8_t ep_addr, volatile uint32_t* buf_ctrl, uint8_t buf_id,
+                                 uint8_t* data, uint64_t frame_end, bool* end)
+{
+  uint8_t  const shift = buf_id ? 16 : 0;
+  uint32_t bc = (*buf_ctrl >> shift) & 0xFFFFu;
+
+  if ( !(bc & USB_BUF_CTRL_AVAIL) ) return XACT_WAIT;
+
+  uint16_t const len = bc & USB_BUF_CTRL_LEN_MASK;
+  uint8_t  const pid = (bc & USB_BUF_CTRL_DATA1_PID) ? 1 : 0;
+  bool     const in  = tu_edpt_dir(ep_addr);
+  uint8_t* toggle    = &_toggle[dev_addr][tu_edpt_number(ep_addr)][in];
+
+  uint32_t const cost = BITS_TOKEN + BITS_GAP + BITS_DATA + 8u*len + BITS_GAP + BITS_HANDSHAKE;
+  if ( _time + cost > frame_end ) return XACT_WAIT;
+
+  int32_t count;
+
+  if ( in )
+  {
+    uint8_t tmp[1024];
+    count = device_xact(dev_addr, ep_addr, false, tmp, len);
+
+    if ( count >= 0 )
+    {
+      if ( count > len ) panic("babble on dev %u ep %02x", dev_addr, ep_addr);
+
+      // data is ACKed but host flags mismatched toggle
+      if ( pid != *toggle )
+      {
+        _stat.toggle_errors++;
+        REG(sie_status) |= USB_SIE_STATUS_DATA_SEQ_ERROR_BITS;
+      }
+      *toggle ^= 1;
+
+      memcpy(data, tmp, (size_t) count);
+      bc = (bc & ~(USB_BUF_CTRL_LEN_MASK | USB_BUF_CTRL_AVAIL)) | (uint32_t) count | USB_BUF_CTRL_FULL;
+      _time += BITS_TOKEN + BITS_GAP + BITS_DATA + 8u*(uint32_t) count + BITS_GAP + BITS_HANDSHAKE;
+    }else
+    {
+      _time += BITS_TOKEN + BITS_GAP + BITS_HANDSHAKE;
+      _stat.nak_bits += BITS_TOKEN + BITS_GAP + BITS_HANDSHAKE;
+    }
+  }else
+  {
+    _time += cost;
+
+    if ( pid != *toggle )
+    {
+      // device ACKs and discards repeated data
+      _stat.toggle_errors++;
+      count = len;
+    }else
+    {
+      count = device_xact(dev_addr, ep_addr, false, data, len);
+      if ( count >= 0 ) *toggle ^= 1;
+    }
+
+    if ( count >= 0 ) bc &= ~(USB_BUF_CTRL_AVAIL | USB_BUF_CTRL_FULL);
+    else _stat.nak_bits += cost;
+  }
+
+  _stat.busy_bits += cost;
+
+  if ( count == -1 )
+  {
+    _stat.nak_xact++;
+    REG(sie_status) |= USB_SIE_STATUS_NAK_REC_BITS;
+    return XACT_NAK;
+  }
+
+  if ( count < 0 )
+  {
+    REG(sie_status) |= USB_SIE_STATUS_STALL_REC_BITS;
+    return XACT_STALL;
+  }
+
+  _stat.data_xact++;
+  *buf_ctrl = (*buf_ctrl & ~(0xFFFFu << shift)) | (bc << shift);
+  *end = (bc & USB_BUF_CTRL_LAST) || (count < len);
+
+  return XACT_ACK;
+}
+
+static void int_ep_poll(uint64_t frame_end)
+{
+  for(uint8_t i = 0; i < USB_HOST_INTERRUPT_ENDPOINTS; i++)
+  {
+    if ( !(REG(int_ep_ctrl) & TU_BIT(i+1)) ) continue;
+
+    if ( _int_poll[i] )
+    {
+      _int_poll[i]--;
+      continue;
+    }
+
+    uint32_t const ep_ctrl = usbh_dpram->int_ep_ctrl[i].ctrl;
+    _int_poll[i] = (uint16_t) ((ep_ctrl >> EP_CTRL_HOST_INTERRUPT_INTERVAL_LSB) & 0x3FFu);
+
+    uint32_t const addr_ctrl = REG(int_ep_addr_ctrl[i]);
+    uint8_t  const dev_addr  = addr_ctrl & 0x7F;
+    uint8_t  const ep_num    = (addr_ctrl >> USB_ADDR_ENDP1_ENDPOINT_LSB) & 0x0F;
+    uint8_t  const ep_addr   = tu_edpt_addr(ep_num, (addr_ctrl & USB_ADDR_ENDP1_INTEP_DIR_BITS) ? TUSB_DIR_OUT : TUSB_DIR_IN);
+
+    bool end;
+    xact_result_t const result = buffer_xact(dev_addr, ep_addr, &usbh_dpram->int_ep_buffer_ctrl[i].ctrl, 0,
+                                             rp2040_model_dpram + (ep_ctrl & 0xFFC0u), frame_end, &end);
+
+    if ( result == XACT_ACK ) REG(buf_status) |= TU_BIT(2*(i+1));
+    if ( result != XACT_WAIT ) service();
+  }
+}
+
+// Returns false if epx has nothing to do now
+static bool epx_step(uint64_t frame_end)
+{
+  if ( !_epx.active || _time < _epx.retry_time ) return false;
+
+  uint32_t const addr_ctrl = REG(dev_addr_ctrl);
+  uint8_t  const dev_addr  = addr_ctrl & 0x7F;
+  uint8_t  const ep_num    = (addr_ctrl >> USB_ADDR_ENDP_ENDPOINT_LSB) & 0x0F;
+
+  if ( _epx.setup )
+  {
+    uint32_t const cost = BITS_TOKEN + BITS_GAP + BITS_DATA + 8u*8 + BITS_GAP + BITS_HANDSHAKE;
+    if ( _time + cost > frame_end ) return false;
+
+    uint8_t setup[8];
+    memcpy(setup, (uint8_t const*) usbh_dpram->setup_packet, 8);
+    (void) device_xact(dev_addr, 0x00, true, setup, 8);
+
+    // setup is DATA0, data stage starts with DATA1
+    _toggle[dev_addr][0][0] = _toggle[dev_addr][0][1] = 1;
+
+    _time += cost;
+    _stat.busy_bits += cost;
+    _stat.setup_xact++;
+
+    _epx.active = false;
+    REG(sie_status) |= USB_SIE_STATUS_TRANS_COMPLETE_BITS;
+    return true;
+  }
+
+  uint32_t const ep_ctrl = usbh_dpram->epx_ctrl;
+  uint8_t  const ep_addr = tu_edpt_addr(ep_num, (REG(sie_ctrl) & USB_SIE_CTRL_RECEIVE_DATA_BITS) ? TUSB_DIR_IN : TUSB_DIR_OUT);
+  bool     const double_buf = ep_ctrl & EP_CTRL_DOUBLE_BUFFERED_BITS;
+
+  bool end = false;
+  xact_result_t const result = buffer_xact(dev_addr, ep_addr, &usbh_dpram->epx_buf_ctrl, _epx.buf_id,
+                                           rp2040_model_dpram + (ep_ctrl & 0xFFC0u) + 64u*_epx.buf_id, frame_end, &end);
+  switch ( result )
+  {
+    case XACT_WAIT:
+      return false;
+
+    case XACT_NAK:
+      _epx.retry_time = _time + 12u*((REG(nak_poll) >> USB_NAK_POLL_DELAY_FS_LSB) & 0x3FFu);
+      break;
+
+    case XACT_STALL:
+      _epx.active = false;
+      break;
+
+    case XACT_ACK:
+      // buffer status per buffer, or per double buffer
+      if ( !double_buf || (ep_ctrl & EP_CTRL_INTERRUPT_PER_BUFFER) || _epx.buf_id || end )
+      {
+        REG(buf_status) |= 0b1;
+      }
+
+      if ( end )
+      {
+        _epx.active = false;
+        REG(sie_status) |= USB_SIE_STATUS_TRANS_COMPLETE_BITS;
+      }else if ( double_buf )
+      {
+        _epx.buf_id ^= 1;
+      }
+    break;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Device mode
+//--------------------------------------------------------------------+
+
+// Interrupt is handled isr_bits after it is raised, bus keeps going meanwhile
+static void dev_service(void)
+{
+  apply_regs();
+  update_ints();
+
+  if ( _irq_enabled && REG(ints) )
+  {
+    if ( !_irq_due ) _irq_due = _time + _isr_bits;
+    if ( _time < _irq_due ) return;
+  }
+
+  _irq_due = 0;
+  service();
+}
+
+static void dev_buf_status(uint8_t ep_id)
+{
+  if ( REG(buf_status) & TU_BIT(ep_id) ) _buf_pending[ep_id]++;
+  else REG(buf_status) |= TU_BIT(ep_id);
+}
+
+static void dev_control_done(uint8_t in)
+{
+  dev_xfer_t* xfer = &_dev_xfer[0][in];
+
+  if ( _dev_ctrl.stage == CTRL_DATA && !xfer->stalled )
+  {
+    // status stage is a zero length packet with DATA1 in the other direction
+    _dev_ctrl.xferred = xfer->xferred;
+    _dev_ctrl.stage   = CTRL_STATUS;
+    _toggle[0][0][!in] = 1;
+    _dev_xfer[0][!in] = (dev_xfer_t) { .busy = true, .mps = 64 };
+    return;
+  }
+
+  _dev_ctrl.stalled = xfer->stalled;
+  _dev_ctrl.stage   = CTRL_IDLE;
+  if ( _dev_cb ) _dev_cb(0, _dev_ctrl.xferred);
+}
+
+static void dev_xfer_done(uint8_t num, uint8_t in)
+{
+  _dev_xfer[num][in].busy = false;
+
+  if ( num == 0 )
+  {
+    dev_control_done(in);
+  }
+  else if ( _dev_cb )
+  {
+    _dev_cb(tu_edpt_addr(num, in), _dev_xfer[num][in].xferred);
+  }
+}
+
+// One packet of host transfer on device endpoint
+static xact_result_t dev_xact(uint8_t num, uint8_t in, uint64_t frame_end)
+{
+  dev_xfer_t* xfer = &_dev_xfer[num][in];
+
+  uint8_t            const ep_id    = (uint8_t) (2*num + (in ? 0 : 1));
+  uint32_t           const ep0_ctrl = EP_CTRL_ENABLE_BITS | offsetof(usb_device_dpram_t, ep0_buf_a);
+  uint32_t           const ep_ctrl  = !num ? ep0_ctrl : in ? usb_dpram->ep_ctrl[num-1].in : usb_dpram->ep_ctrl[num-1].out;
+  volatile uint32_t* const buf_ctrl = in ? &usb_dpram->ep_buf_ctrl[num].in : &usb_dpram->ep_buf_ctrl[num].out;
+  uint8_t*           const toggle   = &_toggle[0][num][in];
+
+  uint16_t const out_len = (uint16_t) tu_min32(xfer->mps, xfer->len - xfer->xferred);
+  uint32_t const nak_cost = BITS_TOKEN + BITS_GAP + (in ? 0 : BITS_DATA + 8u*out_len + BITS_GAP) + BITS_HANDSHAKE;
+  uint32_t const max_cost = BITS_TOKEN + BITS_GAP + BITS_DATA + 8u*xfer->mps + BITS_GAP + BITS_HANDSHAKE;
+  if ( _time + max_cost > frame_end ) return XACT_WAIT;
+
+  // SEL resets buffer selector
+  if ( *buf_ctrl & USB_BUF_CTRL_SEL )
+  {
+    _dev_sel[num][in] = 0;
+    *buf_ctrl &= ~USB_BUF_CTRL_SEL;
+  }
+
+  bool     const double_buf = ep_ctrl & EP_CTRL_DOUBLE_BUFFERED_BITS;
+  uint8_t  const buf_id     = double_buf ? _dev_sel[num][in] : 0;
+  uint8_t  const shift      = buf_id ? 16 : 0;
+  uint32_t       bc         = (*buf_ctrl >> shift) & 0xFFFFu;
+
+  // STALL is in buffer 0 half for the endpoint. Endpoint 0 stalls only while armed, setup packet disarms it
+  uint32_t const stall_arm = in ? USB_EP_STALL_ARM_EP0_IN_BITS : USB_EP_STALL_ARM_EP0_OUT_BITS;
+  if ( !xfer->iso && (*buf_ctrl & USB_BUF_CTRL_STALL) && (num || (REG(ep_stall_arm) & stall_arm)) )
+  {
+    _time += nak_cost;
+    _stat.busy_bits += nak_cost;
+    xfer->stalled = true;
+    dev_xfer_done(num, in);
+    return XACT_STALL;
+  }
+
+  if ( !(ep_ctrl & EP_CTRL_ENABLE_BITS) || !(bc & USB_BUF_CTRL_AVAIL) || (REG(abort) & TU_BIT(ep_id)) )
+  {
+    _time += nak_cost;
+    _stat.busy_bits += nak_cost;
+
+    if ( xfer->iso )
+    {
+      // no data (IN) or data is dropped (OUT), transfer goes on with next frame
+      _stat.iso_missed++;
+      if ( !in ) xfer->xferred += out_len;
+      if ( xfer->xferred == xfer->len ) dev_xfer_done(num, in);
+    }else
+    {
+      _stat.nak_xact++;
+      _stat.nak_bits += nak_cost;
+    }
+    return XACT_NAK;
+  }
+
+  uint16_t const buf1_offset = (ep_ctrl & (3u << EP_CTRL_BUFFER_TYPE_LSB)) == ((uint32_t) TUSB_XFER_ISOCHRONOUS << EP_CTRL_BUFFER_TYPE_LSB) ?
+                               (uint16_t) (128u << ((*buf_ctrl >> 27) & 3u)) : 64u;
+  uint8_t* data = rp2040_model_dpram + (ep_ctrl & 0xFFC0u) + (buf_id ? buf1_offset : 0);
+  uint8_t  const pid = (bc & USB_BUF_CTRL_DATA1_PID) ? 1 : 0;
+  uint16_t count;
+
+  if ( in )
+  {
+    count = bc & USB_BUF_CTRL_LEN_MASK;
+    if ( count > xfer->mps || xfer->xferred + count > xfer->len ) panic("babble on ep %02x", tu_edpt_addr(num, in));
+
+    // data is taken but host flags mismatched toggle
+    if ( !xfer->iso && pid != *toggle ) _stat.toggle_errors++;
+
+    if ( count ) memcpy(xfer->buf + xfer->xferred, data, count);
+    bc &= ~(USB_BUF_CTRL_AVAIL | USB_BUF_CTRL_FULL);
+  }else
+  {
+    count = out_len;
+    if ( count > (bc & USB_BUF_CTRL_LEN_MASK) ) panic("rx overflow on ep %02x", num);
+
+    if ( !xfer->iso && pid != *toggle )
+    {
+      // device ACKs and discards data it takes as repeated
+      _stat.toggle_errors++;
+      bc |= USB_BUF_CTRL_AVAIL;
+    }else
+    {
+      if ( count ) memcpy(data, xfer->buf + xfer->xferred, count);
+      bc = (bc & ~(USB_BUF_CTRL_LEN_MASK | USB_BUF_CTRL_AVAIL)) | count | USB_BUF_CTRL_FULL;
+    }
+  }
+
+  uint32_t const cost = BITS_TOKEN + BITS_GAP + BITS_DATA + 8u*count + BITS_GAP + (xfer->iso ? 0 : BITS_HANDSHAKE);
+  _time += cost;
+  _stat.busy_bits += cost;
+  _stat.data_xact++;
+
+  if ( !xfer->iso ) *toggle ^= 1;
+  xfer->xferred += count;
+
+  if ( !(bc & USB_BUF_CTRL_AVAIL) )
+  {
+    *buf_ctrl = (*buf_ctrl & ~(0xFFFFu << shift)) | (bc << shift);
+
+    // buffer status per buffer, or per double buffer
+    if ( !double_buf || (ep_ctrl & EP_CTRL_INTERRUPT_PER_BUFFER) || buf_id || count < xfer->mps ) dev_buf_status(ep_id);
+    if ( double_buf ) _dev_sel[num][in] ^= 1;
+  }
+
+  if ( count < xfer->mps || xfer->xferred == xfer->len ) dev_xfer_done(num, in);
+
+  return XACT_ACK;
+}
+
+// Setup packet is always ACKed: it clears endpoint 0 stall and starts data (or status) stage
+static xact_result_t dev_setup_xact(uint64_t frame_end)
+{
+  uint32_t const cost = BITS_TOKEN + BITS_GAP + BITS_DATA + 8u*8 + BITS_GAP + BITS_HANDSHAKE;
+  if ( _time + cost > frame_end ) return XACT_WAIT;
+
+  _time += cost;
+  _stat.busy_bits += cost;
+  _stat.setup_xact++;
+
+  memcpy((void*) usb_dpram->setup_packet, _dev_ctrl.setup, 8);
+  REG(sie_status)   |= USB_SIE_STATUS_SETUP_REC_BITS;
+  REG(ep_stall_arm) &= ~(USB_EP_STALL_ARM_EP0_IN_BITS | USB_EP_STALL_ARM_EP0_OUT_BITS);
+
+  uint16_t const wLength = tu_u16(_dev_ctrl.setup[7], _dev_ctrl.setup[6]);
+  uint8_t  const in      = (_dev_ctrl.setup[0] & TUSB_DIR_IN_MASK) ? 1 : 0;
+
+  _toggle[0][0][0] = _toggle[0][0][1] = 1;
+  _dev_ctrl.xferred = 0;
+
+  if ( wLength )
+  {
+    _dev_ctrl.stage = CTRL_DATA;
+    _dev_xfer[0][in] = (dev_xfer_t) { .busy = true, .mps = 64, .buf = _dev_ctrl.buf, .len = wLength };
+  }
+  else
+  {
+    _dev_ctrl.stage = CTRL_STATUS;
+    _dev_xfer[0][1] = (dev_xfer_t) { .busy = true, .mps = 64 };
+  }
+
+  return XACT_ACK;
+}
+
+// Next control, bulk or interrupt transfer in round robin, returns false if there is none or it does not fit in frame
+static bool dev_step(uint64_t frame_end)
+{
+  for(uint8_t i = 0; i < 2*USB_MAX_ENDPOINTS; i++)
+  {
+    uint8_t const idx = (uint8_t) ((_dev_rr + i) % (2*USB_MAX_ENDPOINTS));
+    uint8_t const num = idx >> 1;
+    uint8_t const in  = idx & 1;
+
+    if ( !num && !in && _dev_ctrl.stage == CTRL_SETUP )
+    {
+      _dev_rr = (uint8_t) (idx + 1);
+      return dev_setup_xact(frame_end) != XACT_WAIT;
+    }
+
+    if ( !_dev_xfer[num][in].busy || _dev_xfer[num][in].iso ) continue;
+
+    _dev_rr = (uint8_t) (idx + 1);
+    return dev_xact(num, in, frame_end) != XACT_WAIT;
+  }
+
+  return false;
+}
+
+static void dev_frame(uint64_t frame_end)
+{
+  _time += BITS_TOKEN;
+  dev_service();
+
+  // a packet per isochronous endpoint
+  for(uint8_t num = 1; num < USB_MAX_ENDPOINTS; num++)
+  {
+    for(uint8_t in = 0; in < 2; in++)
+    {
+      if ( _dev_xfer[num][in].busy && _dev_xfer[num][in].iso )
+      {
+        (void) dev_xact(num, in, frame_end);
+        dev_service();
+      }
+    }
+  }
+
+  // NAKed transaction is retried right away
+  while ( _time < frame_end )
+  {
+    if ( dev_step(frame_end) )
+    {
+      dev_service();
+    }else if ( _irq_due && _irq_due < frame_end )
+    {
+      _time = _irq_due;
+      dev_service();
+    }else
+    {
+      break;
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void rp2040_model_init(rp2040_model_xact_t xact_cb, rp2040_model_task_t task_cb, uint32_t isr_bits)
+{
+  _xact_cb  = xact_cb;
+  _task_cb  = task_cb;
+  _isr_bits = isr_bits;
+
+  tu_memclr(&_stat, sizeof(_stat));
+  tu_memclr(_toggle, sizeof(_toggle));
+  tu_memclr(_dev_xfer, sizeof(_dev_xfer));
+  tu_memclr(&_dev_ctrl, sizeof(_dev_ctrl));
+  _dev_cb = NULL;
+  _time = 0;
+}
+
+void rp2040_model_attach(void)
+{
+  REG(sie_status) = (REG(sie_status) & ~USB_SIE_STATUS_SPEED_BITS) | (2u << USB_SIE_STATUS_SPEED_LSB);
+  _conn_change = true;
+  service();
+}
+
+void rp2040_model_frame(void)
+{
+  uint64_t const frame_start = _time;
+  uint64_t const frame_end   = frame_start + MODEL_FRAME_BITS - BITS_EOF;
+
+  _stat.frames++;
+  REG(sof_rd) = (REG(sof_rd) + 1) & 0x7FFu;
+
+  uint32_t const enabled = USB_MAIN_CTRL_CONTROLLER_EN_BITS | USB_MAIN_CTRL_HOST_NDEVICE_BITS;
+  bool const device = (REG(main_ctrl) & enabled) == USB_MAIN_CTRL_CONTROLLER_EN_BITS;
+
+  if ( device )
+  {
+    if ( REG(sie_ctrl) & USB_SIE_CTRL_PULLUP_EN_BITS ) dev_frame(frame_end);
+  }
+  else if ( (REG(main_ctrl) & enabled) == enabled && (REG(sie_status) & USB_SIE_STATUS_SPEED_BITS) )
+  {
+    _time += BITS_TOKEN;
+    _sof_pending = true;
+    service();
+
+    int_ep_poll(frame_end);
+
+    while ( _time < frame_end )
+    {
+      if ( epx_step(frame_end) )
+      {
+        service();
+      }else if ( _epx.active && _epx.retry_time > _time && _epx.retry_time < frame_end )
+      {
+        // idle until NAK is retried
+        _time = _epx.retry_time;
+        service();
+      }else
+      {
+        break;
+      }
+    }
+  }
+
+  _time = frame_start + MODEL_FRAME_BITS;
+  if ( device ) dev_service();
+}
+
+uint64_t rp2040_model_time(void)
+{
+  return _time;
+}
+
+rp2040_model_stat_t const* rp2040_model_stat(void)
+{
+  return &_stat;
+}
+
+void rp2040_model_poll(void)
+{
+  apply_regs();
+}
+
+void rp2040_model_dev_xfer(uint8_t ep_addr, uint16_t mps, bool iso, uint8_t* buf, uint32_t len)
+{
+  dev_xfer_t* xfer = &_dev_xfer[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+
+  if ( tu_edpt_number(ep_addr) == 0 ) panic("endpoint 0 transfers are queued with rp2040_model_dev_control()");
+  if ( xfer->busy ) panic("ep %02x is busy", ep_addr);
+
+  xfer->busy    = true;
+  xfer->iso     = iso;
+  xfer->mps     = mps;
+  xfer->buf     = buf;
+  xfer->len     = len;
+  xfer->xferred = 0;
+  xfer->stalled = false;
+}
+
+void rp2040_model_dev_control(uint8_t const setup[8], uint8_t* buf)
+{
+  if ( _dev_ctrl.stage != CTRL_IDLE ) panic("control transfer is busy");
+
+  memcpy(_dev_ctrl.setup, setup, 8);
+  _dev_ctrl.buf     = buf;
+  _dev_ctrl.xferred = 0;
+  _dev_ctrl.stalled = false;
+  _dev_ctrl.stage   = CTRL_SETUP;
+}
+
+void rp2040_model_dev_bus_reset(void)
+{
+  tu_memclr(_dev_xfer, sizeof(_dev_xfer));
+  tu_memclr(&_dev_ctrl, sizeof(_dev_ctrl));
+  tu_memclr(_toggle, sizeof(_toggle));
+
+  // reset lasts long enough for its interrupt to be handled
+  REG(sie_status) |= USB_SIE_STATUS_BUS_RESET_BITS;
+  dev_service();
+  _time += _isr_bits;
+  dev_service();
+}
+
+void rp2040_model_dev_callback(rp2040_model_dev_cb_t cb)
+{
+  _dev_cb = cb;
+}
+
+bool rp2040_model_dev_busy(uint8_t ep_addr)
+{
+  if ( tu_edpt_number(ep_addr) == 0 ) return _dev_ctrl.stage != CTRL_IDLE;
+  return _dev_xfer[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].busy;
+}
+
+uint32_t rp2040_model_dev_xferred(uint8_t ep_addr)
+{
+  if ( tu_edpt_number(ep_addr) == 0 ) return _dev_ctrl.xferred;
+  return _dev_xfer[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].xferred;
+}
+
+bool rp2040_model_dev_stalled(uint8_t ep_addr)
+{
+  if ( tu_edpt_number(ep_addr) == 0 ) return _dev_ctrl.stalled;
+  return _dev_xfer[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)].stalled;
+}
+
+void rp2040_model_dev_toggle_reset(uint8_t ep_addr)
+{
+  _toggle[0][tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)] = 0;
+}
+
+//--------------------------------------------------------------------+
+// pico-sdk stand-in
+//--------------------------------------------------------------------+
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+  (void) num;
+  _irq_handler = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+  (void) num;
+  _irq_enabled = enabled;
+}
+
+void reset_block(uint32_t bits)
+{
+  (void) bits;
+  tu_memclr(&_epx, sizeof(_epx));
+  tu_memclr(_int_poll, sizeof(_int_poll));
+  tu_memclr(_dev_sel, sizeof(_dev_sel));
+  tu_memclr(_buf_pending, sizeof(_buf_pending));
+  _conn_change = _sof_pending = false;
+  _irq_due = 0;
+}
+
+void unreset_block_wait(uint32_t bits)
+{
+  (void) bits;
+}
+
+void panic(const char* fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fprintf(stderr, "\n");
+  abort();
+}
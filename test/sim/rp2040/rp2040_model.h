@@ -0,0 +1,128 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _RP2040_MODEL_H_
+#define _RP2040_MODEL_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Register level model of the RP2040 USB controller in host mode, full speed device(s) behind the
+// root port (hub is transparent). Time is counted in bit times (12 Mbps), a frame is 12000 bits:
+// - SOF token, then interrupt endpoints enabled in INT_EP_CTRL are polled by their interval
+// - epx runs the transaction started with SIE_CTRL START_TRANS: setup packet, or data packets
+//   on available buffers (SEL, double buffered) until a buffer with LAST or a short packet.
+//   NAK is retried after NAK_POLL delay, STALL ends it, STOP_TRANS aborts it between packets.
+// - A transaction is not started if it does not fit before end of frame
+// Data toggle is tracked per device endpoint: DATA_SEQ_ERROR is raised on IN mismatch and OUT
+// mismatch (data discarded by device) is counted.
+//
+// Registers are plain memory. A set/clear alias write is applied when the next alias is taken or
+// between transactions, STOP_TRANS takes effect when it is applied, START_TRANS between transactions.
+// The interrupt handler is called between transactions while enabled, then the task callback (usbh
+// task) is called. HOST_SOF is cleared by the handler call as reading SOF_RD would.
+//
+// Device mode (MAIN_CTRL HOST_NDEVICE clear, pull up enabled): the model is the host of transfers
+// queued with rp2040_model_dev_xfer() and of control transfers. Each frame, isochronous endpoints
+// get a packet then control/bulk/interrupt ones are run packet by packet in round robin, a NAK is
+// retried right away. Setup packet is written to DPRAM and disarms endpoint 0 stall. Device buffers are used as selected by SEL and double buffering (isochronous buffer 1
+// offset from buffer control), buffer status is raised per buffer and again on clear if a buffer
+// completes while it is set. EP_ABORT NAKs at once. The interrupt handler is called isr_bits after
+// an interrupt is raised while the bus keeps going.
+//--------------------------------------------------------------------+
+
+enum
+{
+  MODEL_FRAME_BITS = 12000,
+};
+
+// Device side of a transaction.
+// SETUP/OUT: consume len bytes and return len. IN: fill up to len bytes and return count.
+// Return -1 for NAK, -2 for STALL
+typedef int32_t (* rp2040_model_xact_t) (uint8_t dev_addr, uint8_t ep_addr, bool setup, uint8_t* buf, uint16_t len);
+
+typedef void (* rp2040_model_task_t) (void);
+
+typedef struct
+{
+  uint32_t frames;
+  uint32_t data_xact;           // data packets ACKed
+  uint32_t nak_xact;
+  uint32_t setup_xact;
+  uint32_t toggle_errors;
+  uint32_t irq_count;
+  uint64_t isr_ns;              // time spent in interrupt handler
+  uint32_t iso_missed;          // device mode: isochronous packet without available buffer
+  uint64_t busy_bits;           // bus time used by transactions (SOF excluded)
+  uint64_t nak_bits;            // bus time used by NAKed transactions
+} rp2040_model_stat_t;
+
+// Bus idle time per interrupt handler call (bit times), interrupt latency in device mode
+void rp2040_model_init(rp2040_model_xact_t xact_cb, rp2040_model_task_t task_cb, uint32_t isr_bits);
+
+// Full speed device connected to root port
+void rp2040_model_attach(void);
+
+// Run one frame
+void rp2040_model_frame(void);
+
+// Bit time since init
+uint64_t rp2040_model_time(void);
+
+rp2040_model_stat_t const* rp2040_model_stat(void);
+
+// Device mode: OUT sends len bytes in packets of mps, IN receives up to len bytes until a short packet.
+// Isochronous endpoint has a packet per frame
+void rp2040_model_dev_xfer(uint8_t ep_addr, uint16_t mps, bool iso, uint8_t* buf, uint32_t len);
+
+// Device mode: called when a host transfer is complete (or stalled), next one can be queued right away
+typedef void (* rp2040_model_dev_cb_t) (uint8_t ep_addr, uint32_t xferred);
+void rp2040_model_dev_callback(rp2040_model_dev_cb_t cb);
+bool rp2040_model_dev_busy(uint8_t ep_addr);
+uint32_t rp2040_model_dev_xferred(uint8_t ep_addr);
+
+// Device mode: control transfer with data stage of wLength bytes (or none), callback has ep_addr 0.
+// Busy, xferred (data stage) and stalled take ep_addr 0 for it
+void rp2040_model_dev_control(uint8_t const setup[8], uint8_t* buf);
+
+// Device mode: USB reset, pending host transfers are dropped
+void rp2040_model_dev_bus_reset(void);
+
+// Device mode: last host transfer ended with STALL
+bool rp2040_model_dev_stalled(uint8_t ep_addr);
+
+// Host side data toggle back to DATA0 e.g with clear halt
+void rp2040_model_dev_toggle_reset(uint8_t ep_addr);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _RP2040_MODEL_H_ */
@@ -0,0 +1,66 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef SIM_TEST_H_
+#define SIM_TEST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//--------------------------------------------------------------------+
+// Checks shared by the device driver tests against controller models.
+// Include from the file containing main() only: each test binary has its own error count.
+//--------------------------------------------------------------------+
+
+// Number of failed checks, test passes if none
+static uint32_t _errors;
+
+// Report a failed condition and keep running so that a single run shows all failures
+#define CHECK(_cond)  do { if ( !(_cond) ) { printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #_cond); _errors++; } } while(0)
+
+// Step the model until done(ep_addr) is true, count an error and return false on timeout
+static inline bool sim_run_until(uint8_t ep_addr, bool (*done)(uint8_t ep_addr), void (*step)(void), uint32_t timeout)
+{
+  for ( uint32_t i = 0; i < timeout; i++ )
+  {
+    if ( done(ep_addr) ) return true;
+    step();
+  }
+
+  printf("  timeout on endpoint %02X\n", ep_addr);
+  _errors++;
+  return false;
+}
+
+// Print the overall result, return exit code of the test
+static inline int sim_result(void)
+{
+  printf(_errors ? "FAILED\n" : "PASSED\n");
+  return _errors ? 1 : 0;
+}
+
+#endif
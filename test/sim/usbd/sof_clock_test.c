@@ -0,0 +1,189 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "device/dcd.h"
+#include "sim_test.h"
+
+//--------------------------------------------------------------------+
+// SOF clock recovery of usbd against DCD stubs: the local clock is sampled at SOFs of a host
+// running at the nominal rate, with a given drift and interrupt latency of the local clock.
+// - full speed, SOF once per frame
+// - high speed, SOF every microframe and once per frame as stated by the DCD, and SOF sent by
+//   dcd_event_bus_signal() that is taken as once per frame
+// tud_sof_clock_ticks_per_sof() must be the ticks per (micro)frame and tud_sof_clock_drift_ppm()
+// the drift within the error the latency causes, frame numbers must follow the bus.
+//--------------------------------------------------------------------+
+
+#define SOF_FRAMES     2000  // 1 ms frames per case
+
+//--------------------------------------------------------------------+
+// DCD stubs
+//--------------------------------------------------------------------+
+
+void dcd_init(uint8_t rhport) { (void) rhport; }
+void dcd_int_enable(uint8_t rhport) { (void) rhport; }
+void dcd_int_disable(uint8_t rhport) { (void) rhport; }
+void dcd_set_address(uint8_t rhport, uint8_t dev_addr) { (void) rhport; (void) dev_addr; }
+void dcd_remote_wakeup(uint8_t rhport) { (void) rhport; }
+void dcd_connect(uint8_t rhport) { (void) rhport; }
+void dcd_disconnect(uint8_t rhport) { (void) rhport; }
+void dcd_edpt_close_all(uint8_t rhport) { (void) rhport; }
+void dcd_edpt_stall(uint8_t rhport, uint8_t ep_addr) { (void) rhport; (void) ep_addr; }
+void dcd_edpt_clear_stall(uint8_t rhport, uint8_t ep_addr) { (void) rhport; (void) ep_addr; }
+
+bool dcd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const * desc_ep)
+{
+  (void) rhport; (void) desc_ep;
+  return true;
+}
+
+bool dcd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes)
+{
+  (void) rhport; (void) ep_addr; (void) buffer; (void) total_bytes;
+  return true;
+}
+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  (void) index;
+  return NULL;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) index; (void) langid;
+  return NULL;
+}
+
+//--------------------------------------------------------------------+
+// Local clock
+//--------------------------------------------------------------------+
+
+static uint32_t _ticks;
+
+uint32_t tud_sof_clock_ticks_cb(void)
+{
+  return _ticks;
+}
+
+// Deterministic interrupt latency in [0, max] ticks
+static uint32_t latency(uint32_t max)
+{
+  static uint32_t lfsr = 0xACE1u;
+  lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);
+  return max ? lfsr % (max + 1) : 0;
+}
+
+//--------------------------------------------------------------------+
+// Cases
+//--------------------------------------------------------------------+
+
+typedef enum
+{
+  SOF_FRAME,          // dcd_event_sof() once per frame
+  SOF_MICROFRAME,     // dcd_event_sof() every microframe
+  SOF_BUS_SIGNAL,     // dcd_event_bus_signal() once per frame, without frame number
+} sof_signal_t;
+
+static void run_case(char const* name, tusb_speed_t speed, sof_signal_t signal, int32_t ppm, uint32_t max_latency,
+                     int32_t tolerance_ppm)
+{
+  printf("%s\n", name);
+
+  bool const microframe = (signal == SOF_MICROFRAME);
+  uint32_t const sof_per_frame = microframe ? 8 : 1;
+  uint32_t const nominal       = CFG_TUD_SOF_CLOCK_FREQUENCY / 1000 / sof_per_frame;
+
+  // local clock starts anywhere, it wraps around in the middle of the case
+  uint64_t const start = 0xFFFFFFFFu - 1000u * nominal;
+
+  dcd_event_bus_reset(0, speed, false);
+  tud_task();
+
+  uint32_t frame = 0x7F0;  // frame number wraps around too
+  for ( uint32_t n = 0; n < SOF_FRAMES * sof_per_frame; n++ )
+  {
+    if ( n && (n % sof_per_frame == 0) ) frame++;
+
+    uint64_t const t = (uint64_t) n * nominal * (uint64_t) (1000000 + ppm) / 1000000u;
+    _ticks = (uint32_t) (start + t + latency(max_latency));
+
+    if ( signal == SOF_BUS_SIGNAL )
+    {
+      dcd_event_bus_signal(0, DCD_EVENT_SOF, true);
+    }else
+    {
+      dcd_event_sof(0, frame & 0x7FFu, microframe, true);
+    }
+  }
+
+  // ticks per SOF is per microframe in high speed
+  uint32_t const expected_tps = (uint32_t) ((((uint64_t) CFG_TUD_SOF_CLOCK_FREQUENCY << 8) / (speed == TUSB_SPEED_HIGH ? 8000u : 1000u))
+                                            * (uint64_t) (1000000 + ppm) / 1000000u);
+  uint32_t const tps   = tud_sof_clock_ticks_per_sof();
+  int32_t  const drift = tud_sof_clock_drift_ppm();
+
+  int64_t const tps_error = ((int64_t) tps - expected_tps) * 1000000 / expected_tps;
+  CHECK(tps_error <= tolerance_ppm && tps_error >= -tolerance_ppm);
+  CHECK(drift <= ppm + tolerance_ppm && drift >= ppm - tolerance_ppm);
+
+  uint32_t ticks;
+  uint16_t frame_number;
+  CHECK(tud_sof_clock_get(&ticks, &frame_number));
+  CHECK(ticks == _ticks);
+  if ( signal != SOF_BUS_SIGNAL ) CHECK(frame_number == (frame & 0x7FFu));
+  else CHECK(frame_number == ((SOF_FRAMES * sof_per_frame) & 0x7FFu));
+
+  printf("  ticks per SOF %u.%02u (expected %u.%02u), drift %d ppm (expected %d)\n",
+         (unsigned) (tps >> 8), (unsigned) ((tps & 0xFF) * 100 / 256),
+         (unsigned) (expected_tps >> 8), (unsigned) ((expected_tps & 0xFF) * 100 / 256),
+         (int) drift, (int) ppm);
+}
+
+int main(void)
+{
+  tud_init(0);
+
+  run_case("full speed, exact clock",               TUSB_SPEED_FULL, SOF_FRAME,        0,    0,  1);
+  run_case("full speed, +100 ppm, latency",         TUSB_SPEED_FULL, SOF_FRAME,        100,  48, 20);
+  run_case("high speed microframe, -50 ppm",        TUSB_SPEED_HIGH, SOF_MICROFRAME,   -50,  0,  2);
+  run_case("high speed microframe, +250 ppm, latency", TUSB_SPEED_HIGH, SOF_MICROFRAME, 250, 12, 60);
+  run_case("high speed frame, +30 ppm",             TUSB_SPEED_HIGH, SOF_FRAME,        30,   0,  2);
+  run_case("high speed bus signal, -400 ppm",       TUSB_SPEED_HIGH, SOF_BUS_SIGNAL,   -400, 0,  2);
+  run_case("full speed bus signal, +1000 ppm",      TUSB_SPEED_FULL, SOF_BUS_SIGNAL,   1000, 0,  2);
+
+  return sim_result();
+}
@@ -0,0 +1,504 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2021, Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusb.h"
+#include "device/usbd_pvt.h"
+#include "sim_test.h"
+
+//--------------------------------------------------------------------+
+// Video streaming class driver against usbd stubs, with zero copy payloads:
+// - probe negotiation: GET_DEF and GET_MAX advertise the payload transfer size the commit uses,
+//   the whole endpoint buffer for bulk, a share of the frame per millisecond for isochronous
+// - a frame is streamed by isochronous payloads, the host side receives the frame data
+//   unchanged and the frame buffer is the same as before the transfer
+// - a frame transfer is aborted by bus reset and by selecting the alternate setting 0
+//   while a payload header is written in the frame buffer, the frame buffer is restored
+// - throughput of isochronous and bulk streaming on a high speed bus
+//--------------------------------------------------------------------+
+
+#define FRAME_WIDTH    160
+#define FRAME_HEIGHT   120
+#define FRAME_SIZE     (FRAME_WIDTH * FRAME_HEIGHT * 16 / 8)
+
+// continuous frame intervals from 30 to 15 fps in 100 ns, 15 fps by default
+#define INTERVAL_MIN   (10000000/30)
+#define INTERVAL_MAX   (10000000/15)
+#define INTERVAL_DEF   INTERVAL_MAX
+
+#define BENCH_FRAMES   20
+
+#define EPNUM_VIDEO_IN 0x81
+#define ITF_NUM_VC     0
+#define ITF_NUM_VS     1
+
+#define UVC_ENTITY_CAP_INPUT_TERMINAL  0x01
+#define UVC_ENTITY_CAP_OUTPUT_TERMINAL 0x02
+
+// Same interfaces as the video_capture example without IAD: usbd opens the driver at the VC interface
+#define DESC_VC \
+  TUD_VIDEO_DESC_STD_VC(ITF_NUM_VC, 0, 0), \
+    TUD_VIDEO_DESC_CS_VC(0x0150, TUD_VIDEO_DESC_CAMERA_TERM_LEN + TUD_VIDEO_DESC_OUTPUT_TERM_LEN, \
+                         27000000, ITF_NUM_VS), \
+      TUD_VIDEO_DESC_CAMERA_TERM(UVC_ENTITY_CAP_INPUT_TERMINAL, 0, 0, 0, 0, 0, 0), \
+      TUD_VIDEO_DESC_OUTPUT_TERM(UVC_ENTITY_CAP_OUTPUT_TERMINAL, VIDEO_TT_STREAMING, 0, 1, 0)
+
+#define DESC_VS_FORMAT \
+    TUD_VIDEO_DESC_CS_VS_INPUT(1, \
+        TUD_VIDEO_DESC_CS_VS_FMT_UNCOMPR_LEN + TUD_VIDEO_DESC_CS_VS_FRM_UNCOMPR_CONT_LEN \
+        + TUD_VIDEO_DESC_CS_VS_COLOR_MATCHING_LEN, \
+        EPNUM_VIDEO_IN, 0, UVC_ENTITY_CAP_OUTPUT_TERMINAL, 0, 0, 0, 0), \
+      TUD_VIDEO_DESC_CS_VS_FMT_UNCOMPR(1, 1, TUD_VIDEO_GUID_YUY2, 16, 1, 0, 0, 0, 0), \
+        TUD_VIDEO_DESC_CS_VS_FRM_UNCOMPR_CONT(1, 0, FRAME_WIDTH, FRAME_HEIGHT, \
+            FRAME_SIZE * 8 * 15, FRAME_SIZE * 8 * 30, FRAME_SIZE, \
+            INTERVAL_DEF, INTERVAL_MIN, INTERVAL_MAX, INTERVAL_MAX - INTERVAL_MIN), \
+        TUD_VIDEO_DESC_CS_VS_COLOR_MATCHING(VIDEO_COLOR_PRIMARIES_BT709, VIDEO_COLOR_XFER_CH_BT709, \
+                                            VIDEO_COLOR_COEF_SMPTE170M)
+
+// isochronous endpoint in alternate setting 1
+static uint8_t const _desc_iso[] =
+{
+  DESC_VC,
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VS, 0, 0, 0),
+    DESC_VS_FORMAT,
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VS, 1, 1, 0),
+    TUD_VIDEO_DESC_EP_ISO(EPNUM_VIDEO_IN, 1024, 1),
+};
+
+// bulk endpoint in alternate setting 0
+static uint8_t const _desc_bulk[] =
+{
+  DESC_VC,
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VS, 0, 1, 0),
+    DESC_VS_FORMAT,
+    TUD_VIDEO_DESC_EP_BULK(EPNUM_VIDEO_IN, 512, 1),
+};
+
+static inline uint8_t pattern(uint32_t offset)
+{
+  return (uint8_t) (offset*7u + 3u);
+}
+
+//--------------------------------------------------------------------+
+// Endpoint and control stubs, in place of usbd
+//--------------------------------------------------------------------+
+
+static struct
+{
+  bool      opened;
+  bool      claimed;
+  bool      busy;
+  uint8_t*  buffer;
+  uint16_t  len;
+} _ep;
+
+static uint8_t const* _ctrl_out;     // data stage of the next OUT request
+static uint8_t        _ctrl_in[64];  // data stage of the last IN request
+
+bool usbd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const * desc_ep)
+{
+  (void) rhport;
+  CHECK(desc_ep->bEndpointAddress == EPNUM_VIDEO_IN);
+  tu_varclr(&_ep);
+  _ep.opened = true;
+  return true;
+}
+
+void usbd_edpt_close(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+  (void) ep_addr;
+  tu_varclr(&_ep);
+}
+
+bool usbd_edpt_claim(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+  (void) ep_addr;
+  if ( _ep.busy || _ep.claimed ) return false;
+  _ep.claimed = true;
+  return true;
+}
+
+bool usbd_edpt_release(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+  (void) ep_addr;
+  _ep.claimed = false;
+  return true;
+}
+
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes)
+{
+  (void) rhport;
+  (void) ep_addr;
+  CHECK(_ep.opened && _ep.claimed && !_ep.busy);
+  _ep.busy    = true;
+  _ep.claimed = false;
+  _ep.buffer  = buffer;
+  _ep.len     = total_bytes;
+  return true;
+}
+
+bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const * request, void* buffer, uint16_t len)
+{
+  (void) rhport;
+  if ( request->bmRequestType_bit.direction == TUSB_DIR_OUT )
+  {
+    if ( len ) memcpy(buffer, _ctrl_out, len);
+  }
+  else
+  {
+    CHECK(len <= sizeof(_ctrl_in));
+    memcpy(_ctrl_in, buffer, tu_min16(len, sizeof(_ctrl_in)));
+  }
+  return true;
+}
+
+bool tud_control_status(uint8_t rhport, tusb_control_request_t const * request)
+{
+  (void) rhport;
+  (void) request;
+  return true;
+}
+
+static uint32_t _frames_complete;
+
+void tud_video_frame_xfer_complete_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx)
+{
+  (void) ctl_idx;
+  (void) stm_idx;
+  _frames_complete++;
+}
+
+//--------------------------------------------------------------------+
+// Host side
+//--------------------------------------------------------------------+
+
+// Setup and status stage of a request to the streaming interface
+static bool vs_request(uint8_t type, uint8_t request, uint16_t value, void const* data, uint16_t len)
+{
+  tusb_control_request_t const req =
+  {
+    .bmRequestType = (uint8_t) (type | TUSB_REQ_RCPT_INTERFACE),
+    .bRequest      = request,
+    .wValue        = value,
+    .wIndex        = ITF_NUM_VS,
+    .wLength       = len
+  };
+  _ctrl_out = data;
+  if ( !videod_control_xfer_cb(0, CONTROL_STAGE_SETUP, &req) ) return false;
+  return videod_control_xfer_cb(0, CONTROL_STAGE_ACK, &req);
+}
+
+static bool set_interface(uint8_t alt)
+{
+  return vs_request(TUSB_REQ_TYPE_STANDARD << 5, TUSB_REQ_SET_INTERFACE, alt, NULL, 0);
+}
+
+static bool probe_set(uint8_t control, video_probe_and_commit_control_t const* param)
+{
+  return vs_request(TUSB_REQ_TYPE_CLASS << 5, VIDEO_REQUEST_SET_CUR, (uint16_t) (control << 8), param, sizeof(*param));
+}
+
+static bool probe_get(uint8_t request, video_probe_and_commit_control_t* param)
+{
+  uint8_t const type = (uint8_t) ((TUSB_REQ_TYPE_CLASS << 5) | (TUSB_DIR_IN << 7));
+  tu_memclr(_ctrl_in, sizeof(_ctrl_in));
+  if ( !vs_request(type, request, VIDEO_VS_CTL_PROBE << 8, NULL, sizeof(*param)) ) return false;
+  memcpy(param, _ctrl_in, sizeof(*param));
+  return true;
+}
+
+// Probe and commit the only format and frame at the given interval
+static bool commit(uint32_t interval)
+{
+  video_probe_and_commit_control_t param;
+  tu_varclr(&param);
+  param.bFormatIndex    = 1;
+  param.bFrameIndex     = 1;
+  param.dwFrameInterval = interval;
+
+  if ( !probe_set(VIDEO_VS_CTL_PROBE, &param) ) return false;
+  return probe_set(VIDEO_VS_CTL_COMMIT, &param);
+}
+
+static struct
+{
+  uint32_t offset;    // of the current frame
+  uint32_t frames;
+  uint32_t payloads;
+  uint32_t zlps;
+  uint32_t mismatch;
+  uint8_t  frame_id;
+} _rx;
+
+// Complete the pending payload: check its header and data, let the driver queue the next one
+static bool complete_payload(void)
+{
+  if ( !_ep.busy ) return false;
+
+  uint8_t const* payload = _ep.buffer;
+  uint16_t const len     = _ep.len;
+
+  if ( len == 0 )
+  {
+    // terminates a short bulk payload
+    _rx.zlps++;
+  }
+  else
+  {
+    tusb_video_payload_header_t const* hdr = (tusb_video_payload_header_t const*) payload;
+    uint8_t const hdr_len = hdr->bHeaderLength;
+    CHECK(hdr_len == sizeof(tusb_video_payload_header_t) && hdr_len <= len);
+
+    if ( _rx.offset ) CHECK(hdr->FrameID == _rx.frame_id);
+    _rx.frame_id = hdr->FrameID;
+
+    uint32_t const data_len = len - hdr_len;
+    for ( uint32_t i = 0; i < data_len; i++ )
+    {
+      if ( payload[hdr_len + i] != pattern(_rx.offset + i) ) _rx.mismatch++;
+    }
+    _rx.offset += data_len;
+    _rx.payloads++;
+
+    if ( hdr->EndOfFrame )
+    {
+      CHECK(_rx.offset == FRAME_SIZE);
+      _rx.offset = 0;
+      _rx.frames++;
+    }
+  }
+
+  _ep.busy = false;
+  videod_xfer_cb(0, EPNUM_VIDEO_IN, XFER_RESULT_SUCCESS, len);
+  return true;
+}
+
+static void fill_frame(uint8_t* frame)
+{
+  for ( uint32_t i = 0; i < FRAME_SIZE; i++ ) frame[i] = pattern(i);
+}
+
+static bool frame_intact(uint8_t const* frame)
+{
+  for ( uint32_t i = 0; i < FRAME_SIZE; i++ )
+  {
+    if ( frame[i] != pattern(i) )
+    {
+      printf("  frame buffer changed at %u\n", (unsigned) i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Enumerate up to alternate setting 0 as a host does before negotiation
+static void open_interfaces(bool bulk)
+{
+  videod_reset(0);
+  tu_varclr(&_ep);
+  uint8_t const* desc = bulk ? _desc_bulk : _desc_iso;
+  uint16_t const len  = bulk ? sizeof(_desc_bulk) : sizeof(_desc_iso);
+  CHECK(videod_open(0, (tusb_desc_interface_t const*) desc, len) == len);
+  CHECK(set_interface(0));
+}
+
+// Commit the default frame rate and start streaming: bulk by the commit, isochronous by alternate setting 1
+static void start_streaming(bool bulk)
+{
+  open_interfaces(bulk);
+  CHECK(commit(INTERVAL_DEF));
+  if ( !bulk ) CHECK(set_interface(1));
+  CHECK(tud_video_n_streaming(0, 0));
+  tu_varclr(&_rx);
+}
+
+//--------------------------------------------------------------------+
+// High speed bus with the streaming endpoint alone: an isochronous endpoint of bInterval 1 moves
+// one packet per microframe, a bulk endpoint up to 13 packets of 512 bytes per microframe.
+// The driver queues the next payload right away on completion.
+//--------------------------------------------------------------------+
+
+#define HS_BULK_PACKETS  13
+
+static uint32_t _pkts_sent;  // packets of the pending payload already on the bus
+
+static void run_microframe(bool bulk)
+{
+  uint16_t const mps = bulk ? 512 : 1024;
+  uint32_t budget    = bulk ? HS_BULK_PACKETS : 1;
+
+  while ( budget && _ep.busy )
+  {
+    if ( !bulk ) CHECK(_ep.len <= mps);
+    uint32_t const pkts = tu_max32(1, tu_div_ceil(_ep.len, mps));
+    uint32_t const n    = tu_min32(budget, pkts - _pkts_sent);
+    _pkts_sent += n;
+    budget     -= n;
+    if ( _pkts_sent == pkts )
+    {
+      _pkts_sent = 0;
+      complete_payload();
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+static uint8_t _frame[2][FRAME_SIZE];
+
+static void test_negotiation(bool bulk)
+{
+  printf("%s negotiation\n", bulk ? "bulk" : "isochronous");
+  open_interfaces(bulk);
+
+  // interval left to the device, negotiated by GET_DEF
+  video_probe_and_commit_control_t param;
+  tu_varclr(&param);
+  param.bFormatIndex = 1;
+  param.bFrameIndex  = 1;
+  CHECK(probe_set(VIDEO_VS_CTL_PROBE, &param));
+
+  // isochronous payloads carry the frame in the milliseconds of an interval
+  uint32_t const bulk_size = tu_min32(FRAME_SIZE + 2, CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE);
+  uint32_t const def_size  = bulk ? bulk_size : tu_div_ceil(FRAME_SIZE, INTERVAL_DEF / 10000) + 2;
+  uint32_t const max_size  = bulk ? bulk_size : tu_div_ceil(FRAME_SIZE, INTERVAL_MIN / 10000) + 2;
+
+  video_probe_and_commit_control_t reply;
+  CHECK(probe_get(VIDEO_REQUEST_GET_MAX, &reply));
+  CHECK(reply.dwFrameInterval == INTERVAL_MAX);
+  CHECK(reply.dwMaxPayloadTransferSize == max_size);
+
+  CHECK(probe_get(VIDEO_REQUEST_GET_DEF, &reply));
+  CHECK(reply.dwFrameInterval == INTERVAL_DEF);
+  CHECK(reply.dwMaxPayloadTransferSize == def_size);
+
+  // host takes the default, the device keeps the advertised size
+  CHECK(probe_set(VIDEO_VS_CTL_PROBE, &reply));
+  CHECK(probe_get(VIDEO_REQUEST_GET_CUR, &param));
+  CHECK(param.dwMaxPayloadTransferSize == def_size);
+  printf("  dwMaxPayloadTransferSize %u\n", (unsigned) param.dwMaxPayloadTransferSize);
+}
+
+static void test_frame(void)
+{
+  printf("frame transfer\n");
+  start_streaming(false);
+  fill_frame(_frame[0]);
+  _frames_complete = 0;
+
+  CHECK(tud_video_n_frame_xfer(0, 0, _frame[0], FRAME_SIZE));
+  while ( complete_payload() ) {}
+
+  CHECK(_frames_complete == 1);
+  CHECK(_rx.frames == 1);
+  CHECK(_rx.mismatch == 0);
+  CHECK(frame_intact(_frame[0]));
+  printf("  %u bytes in %u payloads\n", (unsigned) FRAME_SIZE, (unsigned) _rx.payloads);
+}
+
+// Abort the frame after a few payloads while the header of the pending one is in the frame buffer
+static void test_abort(char const* name, void (*abort)(void))
+{
+  printf("abort by %s\n", name);
+  start_streaming(false);
+  fill_frame(_frame[0]);
+
+  CHECK(tud_video_n_frame_xfer(0, 0, _frame[0], FRAME_SIZE));
+  for ( int i = 0; i < 3; i++ ) CHECK(complete_payload());
+  CHECK(_ep.busy && _ep.buffer > _frame[0] && _ep.buffer < _frame[0] + FRAME_SIZE);
+
+  abort();
+  CHECK(frame_intact(_frame[0]));
+}
+
+static void abort_bus_reset(void)
+{
+  videod_reset(0);
+  tu_varclr(&_ep);
+}
+
+static void abort_alt_zero(void)
+{
+  CHECK(set_interface(0));
+  CHECK(!_ep.opened);
+}
+
+// Stream frames as fast as the bus allows, the application queues the next frame once there is room
+static void bench(bool bulk)
+{
+  printf("%s streaming\n", bulk ? "bulk" : "isochronous");
+  start_streaming(bulk);
+  fill_frame(_frame[0]);
+  fill_frame(_frame[1]);
+  _frames_complete = 0;
+  _pkts_sent       = 0;
+
+  uint32_t queued  = 0;
+  uint32_t uframes = 0;
+  while ( _frames_complete < BENCH_FRAMES && uframes < 8000 )
+  {
+    while ( queued < BENCH_FRAMES && tud_video_n_frame_queue_available(0, 0) )
+    {
+      CHECK(tud_video_n_frame_xfer(0, 0, _frame[queued & 1], FRAME_SIZE));
+      queued++;
+    }
+    run_microframe(bulk);
+    uframes++;
+  }
+
+  CHECK(_frames_complete == BENCH_FRAMES);
+  CHECK(_rx.frames == BENCH_FRAMES);
+  CHECK(_rx.mismatch == 0);
+  CHECK(frame_intact(_frame[0]) && frame_intact(_frame[1]));
+
+  uint64_t const bytes = (uint64_t) FRAME_SIZE * BENCH_FRAMES;
+  printf("  %u frames in %u microframes, %u payloads, %u ZLPs: %u KB/s, %u fps\n",
+         (unsigned) _rx.frames, (unsigned) uframes, (unsigned) _rx.payloads, (unsigned) _rx.zlps,
+         (unsigned) (bytes * 8000 / uframes / 1024), (unsigned) (_rx.frames * 8000u / uframes));
+}
+
+int main(void)
+{
+  videod_init();
+
+  test_negotiation(false);
+  test_negotiation(true);
+  test_frame();
+  test_abort("bus reset", abort_bus_reset);
+  test_abort("alternate setting 0", abort_alt_zero);
+  bench(false);
+  bench(true);
+
+  return sim_result();
+}